@@ -37,6 +37,7 @@ public:
     std::string recovery2KeyPath() const { return dir_ + "Recovery2Key.json"; }
     std::string rootKeyPath() const { return dir_ + "RootKey.json"; }
     std::string stashPath() const { return dir_ + "Stash.json"; }
+    std::string summaryPath() const { return dir_ + "Summary.json"; }
 
 private:
     bool ok_;
@@ -6,16 +6,31 @@
  */
 
 #include "Context.hpp"
+#include "General.hpp"
 #include "bitcoin/cache/BlockCache.hpp"
 #include "exchange/ExchangeCache.hpp"
 #include "bitcoin/cache/ServerCache.hpp"
+#include "util/SharedState.hpp"
 
 namespace abcd {
 
 std::unique_ptr<Context> gContext;
 
+static std::shared_ptr<SharedState>
+sharedStateOpen(const std::string &path)
+{
+    auto out = std::make_shared<SharedState>();
+    out->open(path).log(); // Failure just means we run unshared
+    return out;
+}
+
 Context::~Context()
 {
+    // The startup loads point back at us:
+    blockCacheWait();
+    if (generalLoaded_.valid())
+        generalLoaded_.wait();
+
     delete &blockCache;
     delete &exchangeCache;
 }
@@ -28,11 +43,36 @@ Context::Context(const std::string &rootDir, const std::string &certPath,
     accountType_(accountType),
     hiddenBitsKey_(hiddenBitsKey),
     paths(rootDir, certPath),
-    blockCache(*new BlockCache(paths.blockCachePath())),
-    exchangeCache(*new ExchangeCache(paths.exchangeCachePath())),
-    serverCache(*new ServerCache(paths.serverScoresPath()))
+    shared(sharedStateOpen(paths.sharedStatePath())),
+    blockCache(*new BlockCache(paths.blockCachePath(),
+                               paths.blockHeadersPath(), shared)),
+    exchangeCache(*new ExchangeCache(paths.exchangeCachePath(),
+                                     paths.exchangeHistoryPath(), shared)),
+    serverCache(*new ServerCache(paths.serverScoresPath(), shared))
+{
+}
+
+void
+Context::startup()
+{
+    blockCacheLoaded_ = std::async(std::launch::async, [this]()
+    {
+        blockCache.load().log(); // Failure is fine
+    }).share();
+
+    // Pull the general info into memory, refreshing it if it is stale,
+    // before the first login or wallet needs the server lists:
+    generalLoaded_ = std::async(std::launch::async, []()
+    {
+        generalBitcoinServers();
+    }).share();
+}
+
+void
+Context::blockCacheWait() const
 {
-    blockCache.load().log(); // Failure is fine
+    if (blockCacheLoaded_.valid())
+        blockCacheLoaded_.wait();
 }
 
 } // namespace abcd
@@ -9,6 +9,7 @@
 #define ABCD_CONTEXT_H
 
 #include "RootPaths.hpp"
+#include <future>
 #include <memory>
 
 namespace abcd {
@@ -16,6 +17,7 @@ namespace abcd {
 class BlockCache;
 class ExchangeCache;
 class ServerCache;
+class SharedState;
 
 /**
  * An object holding app-wide information, such as paths.
@@ -33,13 +35,38 @@ public:
     const std::string &accountType() const { return accountType_; }
     const std::string &hiddenBitsKey() const { return hiddenBitsKey_; }
 
+    /**
+     * Starts loading the app-wide caches on background threads,
+     * so startup itself only pays for what it needs right away.
+     * Call this once `gContext` points at this object.
+     */
+    void
+    startup();
+
+    /**
+     * Waits for the startup load of the block cache.
+     * Anything that changes the cache contents, rather than just
+     * holding a reference, must call this first.
+     */
+    void
+    blockCacheWait() const;
+
 private:
     const std::string apiKey_;
     const std::string accountType_;
     const std::string hiddenBitsKey_;
+    std::shared_future<void> blockCacheLoaded_;
+    std::shared_future<void> generalLoaded_;
 
 public:
     RootPaths paths;
+
+    /**
+     * Lets the root-level caches follow each other's updates
+     * across every process using this root directory.
+     */
+    std::shared_ptr<SharedState> shared;
+
     BlockCache &blockCache;
     ExchangeCache &exchangeCache;
     ServerCache &serverCache;
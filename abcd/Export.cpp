@@ -385,6 +385,35 @@ exportQBOGenerateHeader(std::string &result, std::string date_today,
     return Status();
 }
 
+static std::string
+exportQBOGenerateFooter(std::string date_today)
+{
+    return "</BANKTRANLIST>\n"
+           "<LEDGERBAL>\n"
+           "<BALAMT>0.00\n"
+           "<DTASOF>" + date_today + "\n"
+           "</LEDGERBAL>\n"
+           "<AVAILBAL>\n"
+           "<BALAMT>0.00\n"
+           "<DTASOF>" +  date_today + "\n"
+           "</AVAILBAL>\n"
+           "</STMTRS>\n"
+           "</STMTTRNRS>\n"
+           "</BANKMSGSRSV1>\n"
+           "</OFX>\n";
+}
+
+static std::string
+exportQBODateToday()
+{
+    time_t rawtime = time(nullptr);
+    tm *timeinfo = localtime(&rawtime);
+
+    char buffer[80];
+    strftime(buffer, 80, "%Y%m%d%H%M%S.000", timeinfo);
+    return buffer;
+}
+
 #define MAX_MEMO_SIZE 253
 
 static Status
@@ -472,12 +501,7 @@ Status
 exportFormatQBO(std::string &result, tABC_TxInfo **pTransactions,
                 unsigned int iTransactionCount, std::string currency)
 {
-    time_t rawtime = time(nullptr);
-    tm *timeinfo = localtime(&rawtime);
-
-    char buffer[80];
-    strftime(buffer, 80, "%Y%m%d%H%M%S.000", timeinfo);
-    std::string date_today = buffer;
+    std::string date_today = exportQBODateToday();
 
     std::string out;
     {
@@ -494,24 +518,83 @@ exportFormatQBO(std::string &result, tABC_TxInfo **pTransactions,
     }
 
     // Write footer
-    out += "</BANKTRANLIST>\n"
-           "<LEDGERBAL>\n"
-           "<BALAMT>0.00\n"
-           "<DTASOF>" + date_today + "\n"
-           "</LEDGERBAL>\n"
-           "<AVAILBAL>\n"
-           "<BALAMT>0.00\n"
-           "<DTASOF>" +  date_today + "\n"
-           "</AVAILBAL>\n"
-           "</STMTRS>\n"
-           "</STMTTRNRS>\n"
-           "</BANKMSGSRSV1>\n"
-           "</OFX>\n";
+    out += exportQBOGenerateFooter(date_today);
 
     result = out;
     return Status();
 }
 
+// Hand text to the sink once this much has piled up:
+constexpr size_t exportChunkSize = 64 * 1024;
+
+ExportWriter::ExportWriter(tABC_ExportFormat format,
+                           const std::string &currency, const Sink &sink):
+    format_(format),
+    currency_(currency),
+    dateToday_(exportQBODateToday()),
+    sink_(sink)
+{
+    buffer_.reserve(exportChunkSize + ABC_CSV_MAX_REC_SZ);
+}
+
+Status
+ExportWriter::begin()
+{
+    if (ABC_ExportQbo == format_)
+    {
+        std::string header;
+        ABC_CHECK(exportQBOGenerateHeader(header, dateToday_, currency_));
+        return write(header);
+    }
+
+    AutoString header;
+    ABC_CHECK_OLD(ABC_ExportGenerateHeader(&header.get(), &error, currency_));
+    return write(header.get());
+}
+
+Status
+ExportWriter::add(tABC_TxInfo *pTransaction)
+{
+    if (ABC_ExportQbo == format_)
+    {
+        std::string record;
+        ABC_CHECK(exportQBOGenerateRecord(record, pTransaction, currency_));
+        return write(record);
+    }
+
+    AutoString record;
+    ABC_CHECK_OLD(ABC_ExportGenerateRecord(pTransaction, &record.get(), &error));
+    return write(record.get());
+}
+
+Status
+ExportWriter::finish()
+{
+    if (ABC_ExportQbo == format_)
+        ABC_CHECK(write(exportQBOGenerateFooter(dateToday_)));
+    return flush();
+}
+
+Status
+ExportWriter::write(const std::string &text)
+{
+    buffer_ += text;
+    if (exportChunkSize <= buffer_.size())
+        ABC_CHECK(flush());
+    return Status();
+}
+
+Status
+ExportWriter::flush()
+{
+    if (buffer_.empty())
+        return Status();
+
+    ABC_CHECK(sink_(buffer_.data(), buffer_.size()));
+    buffer_.clear();
+    return Status();
+}
+
 
 
 } // namespace abcd
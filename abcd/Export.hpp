@@ -13,6 +13,7 @@
 #define ABC_Export_h
 
 #include "util/Status.hpp"
+#include <functional>
 
 namespace abcd {
 
@@ -26,6 +27,52 @@ Status
 exportFormatQBO(std::string &result, tABC_TxInfo **pTransactions,
                 unsigned int iTransactionCount, std::string currency);
 
+/**
+ * Builds an export one transaction at a time,
+ * handing the text to a sink in bounded chunks
+ * rather than holding the whole file in memory.
+ */
+class ExportWriter
+{
+public:
+    typedef std::function<Status (const char *data, size_t size)> Sink;
+
+    ExportWriter(tABC_ExportFormat format, const std::string &currency,
+                 const Sink &sink);
+
+    /**
+     * Writes the file header.
+     */
+    Status
+    begin();
+
+    /**
+     * Writes one transaction.
+     * Transactions should arrive oldest first.
+     */
+    Status
+    add(tABC_TxInfo *pTransaction);
+
+    /**
+     * Writes the file footer and flushes whatever is left.
+     */
+    Status
+    finish();
+
+private:
+    tABC_ExportFormat format_;
+    std::string currency_;
+    std::string dateToday_;
+    Sink sink_;
+    std::string buffer_;
+
+    Status
+    write(const std::string &text);
+
+    Status
+    flush();
+};
+
 } // namespace abcd
 
 #endif
@@ -21,9 +21,12 @@
 #include "login/server/LoginServer.hpp"
 #include "util/FileIO.hpp"
 #include "util/Debug.hpp"
+#include "util/TaskPool.hpp"
 #include "http/HttpRequest.hpp"
 #include <time.h>
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <mutex>
 
 namespace abcd {
@@ -116,21 +119,150 @@ struct GeneralJson:
     ABC_JSON_VALUE(syncServers,    "syncServers", JsonArray)
 };
 
+static std::atomic<uint64_t> gFeeRevision(0);
+
+/**
+ * The general info, parsed once per download and shared in memory.
+ * Readers grab the current snapshot under the lock and then work
+ * on their own reference, so a refresh never blocks them for long.
+ */
+struct GeneralInfo
+{
+    std::string path;
+    time_t fileTime;
+    BitcoinFeeInfo bitcoinFees; // The server defaults
+    AirbitzFeeInfo airbitzFees;
+    std::vector<std::string> bitcoinServers;
+    std::vector<std::string> syncServers;
+};
+
+static std::shared_ptr<const GeneralInfo> gGeneral;
+static std::mutex gGeneralMutex;
+static std::atomic<bool> gGeneralRefreshing(false);
+static std::atomic<time_t> gGeneralRefreshTried(0);
+constexpr time_t generalRetrySeconds = 5 * 60;
+
+static std::vector<std::string>
+stringsLoad(JsonArray arrayJson)
+{
+    std::vector<std::string> out;
+    size_t size = arrayJson.size();
+    out.reserve(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        auto stringJson = arrayJson[i];
+        if (json_is_string(stringJson.get()))
+            out.push_back(json_string_value(stringJson.get()));
+    }
+    return out;
+}
+
+/**
+ * Parses the general info file into a fresh snapshot.
+ * A missing or broken file gives a snapshot full of defaults.
+ */
+static std::shared_ptr<const GeneralInfo>
+generalInfoLoad(const std::string &path)
+{
+    std::shared_ptr<GeneralInfo> out(new GeneralInfo());
+    out->path = path;
+    if (!fileTime(out->fileTime, path))
+        out->fileTime = 0;
+
+    GeneralJson json;
+    if (out->fileTime)
+        json.load(path).log();
+
+    // Copy everything out, so readers never share jansson objects:
+    auto feeJson = json.bitcoinFees();
+    auto &fees = out->bitcoinFees;
+    fees.confirmFees[1] = feeJson.confirmFees1();
+    fees.confirmFees[2] = feeJson.confirmFees2();
+    fees.confirmFees[3] = feeJson.confirmFees3();
+    fees.confirmFees[4] = feeJson.confirmFees4();
+    fees.confirmFees[5] = feeJson.confirmFees5();
+    fees.confirmFees[6] = feeJson.confirmFees6();
+    fees.confirmFees[7] = feeJson.confirmFees7();
+    fees.highFeeBlock = feeJson.highFeeBlock();
+    fees.standardFeeBlockHigh = feeJson.standardFeeBlockHigh();
+    fees.standardFeeBlockLow = feeJson.standardFeeBlockLow();
+    fees.lowFeeBlock = feeJson.lowFeeBlock();
+    fees.targetFeePercentage = feeJson.targetFeePercentage();
+
+    auto airbitzJson = json.airbitzFees();
+    auto &airbitz = out->airbitzFees;
+    for (const auto &address: stringsLoad(airbitzJson.addresses()))
+        airbitz.addresses.insert(address);
+
+    airbitz.incomingRate = airbitzJson.incomingRate();
+    airbitz.incomingMin  = airbitzJson.incomingMin();
+    airbitz.incomingMax  = airbitzJson.incomingMax();
+
+    airbitz.outgoingRate = airbitzJson.outgoingPercentage() / 100.0;
+    airbitz.outgoingMin  = airbitzJson.outgoingMin();
+    airbitz.outgoingMax  = airbitzJson.outgoingMax();
+    airbitz.noFeeMinSatoshi = airbitzJson.noFeeMinSatoshi();
+
+    airbitz.sendMin = airbitzJson.sendMin();
+    airbitz.sendPeriod = airbitzJson.sendPeriod();
+    airbitz.sendPayee = airbitzJson.sendPayee();
+    airbitz.sendCategory = airbitzJson.sendCategory();
+
+    out->bitcoinServers = stringsLoad(json.bitcoinServers());
+    out->syncServers = stringsLoad(json.syncServers());
+    return out;
+}
+
+/**
+ * Starts a background `generalUpdate`, unless one is already running
+ * or the last attempt was too recent.
+ */
+static void
+generalRefresh()
+{
+    const time_t now = time(nullptr);
+    if (now < gGeneralRefreshTried + generalRetrySeconds)
+        return;
+    if (gGeneralRefreshing.exchange(true))
+        return;
+    gGeneralRefreshTried = now;
+
+    taskPoolRun([]()
+    {
+        if (gContext)
+            generalUpdate().log();
+        gGeneralRefreshing = false;
+    });
+}
+
 /**
- * Attempts to load the general information from disk.
+ * Returns the in-memory general info.
+ * Only the first call reads the disk. Missing or stale info
+ * triggers a background download, and this returns what it has.
  */
-static GeneralJson
+static std::shared_ptr<const GeneralInfo>
 generalLoad()
 {
+    static const auto empty = generalInfoLoad("");
     if (!gContext)
-        return GeneralJson();
+        return empty;
 
     const auto path = gContext->paths.generalPath();
-    if (!fileExists(path))
-        generalUpdate().log();
+    std::shared_ptr<const GeneralInfo> out;
+    {
+        std::lock_guard<std::mutex> lock(gGeneralMutex);
+        out = gGeneral;
+    }
+    if (!out || out->path != path)
+    {
+        out = generalInfoLoad(path);
+        std::lock_guard<std::mutex> lock(gGeneralMutex);
+        if (!gGeneral || gGeneral->path != path)
+            gGeneral = out;
+    }
 
-    GeneralJson out;
-    out.load(path).log();
+    if (out->fileTime + GENERAL_ACCEPTABLE_INFO_FILE_AGE_SECS < time(nullptr))
+        generalRefresh();
     return out;
 }
 
@@ -142,12 +274,17 @@ general21FeesUpdate()
     const auto path = gContext->paths.twentyOneFeeCachePath();
 
     ABC_CHECK(HttpRequest()
+              .ifChanged(path)
               .get(reply, url));
+    if (reply.notModified())
+        return Status();
     ABC_CHECK(reply.codeOk());
 
     TwentyOneFeesJson feesJson;
     ABC_CHECK(feesJson.decode(reply.body));
     ABC_CHECK(feesJson.save(path));
+    httpValidatorsSave(path, reply).log();
+    ++gFeeRevision;
 
     return Status();
 }
@@ -155,6 +292,10 @@ general21FeesUpdate()
 Status
 generalUpdate()
 {
+    // Logins prefetch this in the background, so callers can overlap:
+    static std::mutex updateMutex;
+    std::lock_guard<std::mutex> lock(updateMutex);
+
     const auto path = gContext->paths.generalPath();
 
     time_t lastTime;
@@ -165,6 +306,19 @@ generalUpdate()
         ABC_CHECK(loginServerGetGeneral(infoJson));
         ABC_CHECK(infoJson.save(path));
     }
+
+    // Swap in the new copy before anyone rebuilds their fee tables:
+    auto fresh = generalInfoLoad(path);
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(gGeneralMutex);
+        changed = !gGeneral || gGeneral->path != path ||
+                  gGeneral->fileTime != fresh->fileTime;
+        if (changed)
+            gGeneral = fresh;
+    }
+    if (changed)
+        ++gFeeRevision;
     general21FeesUpdate();
 
     return Status();
@@ -285,18 +439,56 @@ generalEstimateFeesUpdate(size_t blocks, double fee)
         const auto path = gContext->paths.feeCachePath();
 
         ABC_CHECK(feesJson.save(path));
+        ++gFeeRevision;
+
+        // Rebuild the shared table here, rather than on the next spend:
+        generalBitcoinFeeInfo();
     }
     return Status();
 }
 
+Status
+generalEstimateFeesNewBlock()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Keep the old values as fallbacks, but let the next replies
+    // replace the averages rather than blending into them:
+    for (size_t i = 0; i < MAX_FEES_BLOCKS; ++i)
+        estimatedFeesNumResponses[i] = 0;
+
+    return Status();
+}
+
+uint64_t
+generalFeeRevision()
+{
+    return gFeeRevision;
+}
+
 const double MAX_FEE = 999999999.0;
 const int MAX_STANDARD_DELAY = 12;
 const int MIN_STANDARD_DELAY = 3;
 
-BitcoinFeeInfo
-generalBitcoinFeeInfo()
+/**
+ * The most recently built fee table, along with the revision it came from.
+ * Spends read this copy, so they never touch the disk or the JSON parser
+ * unless one of the fee sources has changed since the last build.
+ */
+struct FeeTable
+{
+    uint64_t revision;
+    BitcoinFeeInfo info;
+};
+
+static std::shared_ptr<const FeeTable> gFeeTable;
+static std::mutex gFeeTableMutex;
+
+static BitcoinFeeInfo
+bitcoinFeeInfoBuild()
 {
-    BitcoinFeesJson feeJson = generalLoad().bitcoinFees();
+    const auto general = generalLoad();
+    const BitcoinFeeInfo &defaults = general->bitcoinFees;
     EstimateFeesJson estimateFeesJson = estimateFeesLoad();
     TwentyOneFeesJson twentyOneFeesJson = twentyOneFeesLoad();
 
@@ -406,7 +598,7 @@ generalBitcoinFeeInfo()
 
     BitcoinFeeInfo out;
 
-    out.targetFeePercentage = feeJson.targetFeePercentage();
+    out.targetFeePercentage = defaults.targetFeePercentage;
 
     //
     // Check if we have a complete set of fee info.
@@ -433,23 +625,23 @@ generalBitcoinFeeInfo()
     {
         // Complete set not found. Use the bitcoind/stratum fee estimates
         out.confirmFees[1] = estimateFeesJson.confirmFees1() ?
-                             estimateFeesJson.confirmFees1() : feeJson.confirmFees1();
+                             estimateFeesJson.confirmFees1() : defaults.confirmFees[1];
         out.confirmFees[2] = estimateFeesJson.confirmFees2() ?
-                             estimateFeesJson.confirmFees2() : feeJson.confirmFees2();
+                             estimateFeesJson.confirmFees2() : defaults.confirmFees[2];
         out.confirmFees[3] = estimateFeesJson.confirmFees3() ?
-                             estimateFeesJson.confirmFees3() : feeJson.confirmFees3();
+                             estimateFeesJson.confirmFees3() : defaults.confirmFees[3];
         out.confirmFees[4] = estimateFeesJson.confirmFees4() ?
-                             estimateFeesJson.confirmFees4() : feeJson.confirmFees4();
+                             estimateFeesJson.confirmFees4() : defaults.confirmFees[4];
         out.confirmFees[5] = estimateFeesJson.confirmFees5() ?
-                             estimateFeesJson.confirmFees5() : feeJson.confirmFees5();
+                             estimateFeesJson.confirmFees5() : defaults.confirmFees[5];
         out.confirmFees[6] = estimateFeesJson.confirmFees6() ?
-                             estimateFeesJson.confirmFees6() : feeJson.confirmFees6();
+                             estimateFeesJson.confirmFees6() : defaults.confirmFees[6];
         out.confirmFees[7] = estimateFeesJson.confirmFees7() ?
-                             estimateFeesJson.confirmFees7() : feeJson.confirmFees7();
-        out.lowFeeBlock             = feeJson.lowFeeBlock();
-        out.standardFeeBlockLow     = feeJson.standardFeeBlockLow();
-        out.standardFeeBlockHigh    = feeJson.standardFeeBlockHigh();
-        out.highFeeBlock            = feeJson.highFeeBlock();
+                             estimateFeesJson.confirmFees7() : defaults.confirmFees[7];
+        out.lowFeeBlock             = defaults.lowFeeBlock;
+        out.standardFeeBlockLow     = defaults.standardFeeBlockLow;
+        out.standardFeeBlockHigh    = defaults.standardFeeBlockHigh;
+        out.highFeeBlock            = defaults.highFeeBlock;
     }
 
     // Fix any fees that contradict. ie. confirmFees1 < confirmFees2
@@ -482,36 +674,35 @@ generalBitcoinFeeInfo()
     return out;
 }
 
-AirbitzFeeInfo
-generalAirbitzFeeInfo()
+BitcoinFeeInfo
+generalBitcoinFeeInfo()
 {
-    AirbitzFeeInfo out;
-    auto feeJson = generalLoad().airbitzFees();
-
-    auto arrayJson = feeJson.addresses();
-    size_t size = arrayJson.size();
-    for (size_t i = 0; i < size; i++)
+    std::shared_ptr<const FeeTable> table;
     {
-        auto stringJson = arrayJson[i];
-        if (json_is_string(stringJson.get()))
-            out.addresses.insert(json_string_value(stringJson.get()));
+        std::lock_guard<std::mutex> lock(gFeeTableMutex);
+        table = gFeeTable;
     }
 
-    out.incomingRate = feeJson.incomingRate();
-    out.incomingMin  = feeJson.incomingMin();
-    out.incomingMax  = feeJson.incomingMax();
-
-    out.outgoingRate = feeJson.outgoingPercentage() / 100.0;
-    out.outgoingMin  = feeJson.outgoingMin();
-    out.outgoingMax  = feeJson.outgoingMax();
-    out.noFeeMinSatoshi = feeJson.noFeeMinSatoshi();
+    const uint64_t revision = gFeeRevision;
+    if (!table || table->revision != revision)
+    {
+        // Build outside the lock, so readers keep getting the old copy:
+        std::shared_ptr<const FeeTable> fresh(
+            new FeeTable{revision, bitcoinFeeInfoBuild()});
+
+        std::lock_guard<std::mutex> lock(gFeeTableMutex);
+        if (!gFeeTable || gFeeTable->revision <= revision)
+            gFeeTable = fresh;
+        table = fresh;
+    }
 
-    out.sendMin = feeJson.sendMin();
-    out.sendPeriod = feeJson.sendPeriod();
-    out.sendPayee = feeJson.sendPayee();
-    out.sendCategory = feeJson.sendCategory();
+    return table->info;
+}
 
-    return out;
+AirbitzFeeInfo
+generalAirbitzFeeInfo()
+{
+    return generalLoad()->airbitzFees;
 }
 
 std::vector<std::string>
@@ -530,19 +721,7 @@ generalBitcoinServers()
         return out;
     }
 
-    auto arrayJson = generalLoad().bitcoinServers();
-
-    size_t size = arrayJson.size();
-    out.reserve(size);
-    for (size_t i = 0; i < size; i++)
-    {
-        auto stringJson = arrayJson[i];
-        if (json_is_string(stringJson.get()))
-        {
-            std::string servername = json_string_value(stringJson.get());
-            out.push_back(servername);
-        }
-    }
+    out = generalLoad()->bitcoinServers;
 
     if (!out.size())
     {
@@ -558,17 +737,7 @@ generalBitcoinServers()
 std::vector<std::string>
 generalSyncServers()
 {
-    auto arrayJson = generalLoad().syncServers();
-
-    std::vector<std::string> out;
-    size_t size = arrayJson.size();
-    out.reserve(size);
-    for (size_t i = 0; i < size; i++)
-    {
-        auto stringJson = arrayJson[i];
-        if (json_is_string(stringJson.get()))
-            out.push_back(json_string_value(stringJson.get()));
-    }
+    std::vector<std::string> out = generalLoad()->syncServers;
 
     if (!out.size())
     {
@@ -100,7 +100,10 @@ struct AirbitzFeeInfo
 };
 
 /**
- * Downloads general info from the server if the local file is out of date.
+ * Downloads general info from the server if the local file is out of date,
+ * then refreshes the in-memory copy the other functions here read from.
+ * Those functions start this in the background when their copy is stale,
+ * so they never wait on the disk or the network themselves.
  */
 Status
 generalUpdate();
@@ -120,9 +123,25 @@ generalEstimateFeesNeedUpdate();
 Status
 generalEstimateFeesUpdate(size_t blocks, double fee);
 
+/**
+ * Starts a fresh round of fee averaging after a new block arrives.
+ * The previous estimates stay in place until new replies replace them.
+ */
+Status
+generalEstimateFeesNewBlock();
+
+/**
+ * Returns a counter that moves whenever the saved fee tables change,
+ * so callers can tell when their copies of the fee information are stale.
+ */
+uint64_t
+generalFeeRevision();
+
 /**
  * Obtains the Bitcoin mining fee information.
  * The returned table always has at least one entry.
+ * The table is built once per fee revision and shared in memory,
+ * so this is cheap enough to call on every spend.
  */
 BitcoinFeeInfo
 generalBitcoinFeeInfo();
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "QrCode.hpp"
+#include "util/AutoFree.hpp"
+#include <qrencode.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+namespace abcd {
+
+// A handful of requests on screen at once is plenty:
+constexpr size_t qrCacheSize = 8;
+
+struct QrCacheEntry
+{
+    std::string text;
+    QrLevel level;
+    std::shared_ptr<const QrMatrix> qr;
+};
+
+static std::mutex gQrMutex;
+static std::list<QrCacheEntry> gQrCache; // Most recent first
+
+static Status
+qrEncodeRaw(std::shared_ptr<const QrMatrix> &result,
+            const std::string &text, QrLevel level)
+{
+    AutoFree<QRcode, QRcode_free>
+    qr(QRcode_encodeString(text.c_str(), 0,
+                           static_cast<QRecLevel>(level), QR_MODE_8, 1));
+    if (!qr)
+        return ABC_ERROR(ABC_CC_Error, "Unable to create QR code");
+
+    auto out = std::make_shared<QrMatrix>();
+    out->width = qr->width;
+    out->modules.resize(qr->width * qr->width);
+    for (size_t i = 0; i < out->modules.size(); ++i)
+        out->modules[i] = qr->data[i] & 0x1;
+
+    result = std::move(out);
+    return Status();
+}
+
+Status
+qrEncode(std::shared_ptr<const QrMatrix> &result,
+         const std::string &text, QrLevel level)
+{
+    {
+        std::lock_guard<std::mutex> lock(gQrMutex);
+        for (auto i = gQrCache.begin(); i != gQrCache.end(); ++i)
+        {
+            if (i->level == level && i->text == text)
+            {
+                gQrCache.splice(gQrCache.begin(), gQrCache, i);
+                result = i->qr;
+                return Status();
+            }
+        }
+    }
+
+    // Encode outside the lock, since Reed-Solomon is the slow part:
+    std::shared_ptr<const QrMatrix> qr;
+    ABC_CHECK(qrEncodeRaw(qr, text, level));
+
+    std::lock_guard<std::mutex> lock(gQrMutex);
+    gQrCache.push_front(QrCacheEntry{text, level, qr});
+    if (qrCacheSize < gQrCache.size())
+        gQrCache.pop_back();
+
+    result = std::move(qr);
+    return Status();
+}
+
+DataChunk
+qrBitmap(const QrMatrix &qr, unsigned scale, size_t &stride)
+{
+    const size_t pixels = qr.width * scale;
+    stride = (pixels + 7) / 8;
+
+    DataChunk out(stride * pixels, 0);
+    for (size_t y = 0; y < qr.width; ++y)
+    {
+        // Build the first pixel row for these modules, then repeat it:
+        uint8_t *row = out.data() + y * scale * stride;
+        const uint8_t *modules = qr.modules.data() + y * qr.width;
+        for (size_t x = 0; x < pixels; ++x)
+            if (modules[x / scale])
+                row[x / 8] |= 0x80 >> (x % 8);
+
+        for (size_t i = 1; i < scale; ++i)
+            std::copy(row, row + stride, row + i * stride);
+    }
+
+    return out;
+}
+
+void
+qrCacheClear()
+{
+    std::lock_guard<std::mutex> lock(gQrMutex);
+    gQrCache.clear();
+}
+
+} // namespace abcd
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * QR code encoding, with a small cache of recent results.
+ */
+
+#ifndef ABCD_QR_CODE_HPP
+#define ABCD_QR_CODE_HPP
+
+#include "util/Data.hpp"
+#include "util/Status.hpp"
+#include <memory>
+
+namespace abcd {
+
+/**
+ * An encoded QR symbol, with one byte per module, row by row.
+ * Dark modules are 1, and light ones are 0.
+ */
+struct QrMatrix
+{
+    unsigned width;
+    DataChunk modules;
+};
+
+/**
+ * Error-correction levels, in the same order as libqrencode's.
+ */
+enum class QrLevel
+{
+    low, medium, quartile, high
+};
+
+/**
+ * Encodes some text as a QR symbol.
+ * Screens tend to redraw the same request over and over,
+ * so the last few results are kept around and shared.
+ */
+Status
+qrEncode(std::shared_ptr<const QrMatrix> &result,
+         const std::string &text, QrLevel level=QrLevel::low);
+
+/**
+ * Packs a QR symbol into a 1-bit bitmap, `scale` pixels per module.
+ * Each row starts on a fresh byte, with the leftmost pixel in the
+ * most significant bit, and dark pixels are set.
+ * @param stride receives the number of bytes in each row.
+ */
+DataChunk
+qrBitmap(const QrMatrix &qr, unsigned scale, size_t &stride);
+
+/**
+ * Drops every cached QR symbol.
+ */
+void
+qrCacheClear();
+
+} // namespace abcd
+
+#endif
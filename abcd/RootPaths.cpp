@@ -21,6 +21,14 @@ struct UsernameJson:
     ABC_JSON_STRING(username, "userName", nullptr)
 };
 
+struct AccountIndexJson:
+    public JsonObject
+{
+    ABC_JSON_STRING(dir, "dir", "")
+    ABC_JSON_INTEGER(time, "time", 0)
+    ABC_JSON_VALUE(accounts, "accounts", JsonObject)
+};
+
 constexpr auto usernameFilename = "UserName.json";
 
 /**
@@ -52,70 +60,60 @@ RootPaths::accountsDir() const
         return dir_ + "Accounts/";
 }
 
-std::list<std::string>
-RootPaths::accountList()
+std::string
+RootPaths::exchangeSourcePath(const std::string &source) const
 {
-    std::list<std::string> out;
-
-    std::string accounts = accountsDir();
-    DIR *dir = opendir(accounts.c_str());
-    if (!dir)
-        return out;
-
-    struct dirent *de;
-    while (nullptr != (de = readdir(dir)))
-    {
-        // Skip hidden files:
-        if (de->d_name[0] == '.')
-            continue;
+    return dir_ + "ExchangeSource-" + source + ".json";
+}
 
-        auto account = accounts + de->d_name + '/';
+std::string
+RootPaths::accountIndexPath() const
+{
+    if (isTestnet())
+        return dir_ + "AccountIndex-testnet.json";
+    else
+        return dir_ + "AccountIndex.json";
+}
 
-        std::string username;
-        if (readUsername(account, username))
-            out.push_back(username);
-    }
+std::list<std::string>
+RootPaths::accountList()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    indexUpdate();
 
-    closedir(dir);
+    std::list<std::string> out;
+    for (const auto &i: index_)
+        out.push_back(i.first);
     return out;
 }
 
 Status
 RootPaths::accountDir(AccountPaths &result, const std::string &username)
 {
-    std::string out;
-
-    std::string accounts = accountsDir();
-    DIR *dir = opendir(accounts.c_str());
-    if (!dir)
-        return ABC_ERROR(ABC_CC_FileDoesNotExist,
-                         "Cannot open accounts directory");
+    std::lock_guard<std::mutex> lock(mutex_);
+    indexUpdate();
 
-    struct dirent *de;
-    while (nullptr != (de = readdir(dir)))
+    // Another process may have added the account without moving the
+    // directory's time, so a miss is worth a fresh scan:
+    auto i = index_.find(username);
+    if (index_.end() == i)
     {
-        // Skip hidden files:
-        if (de->d_name[0] == '.')
-            continue;
-
-        auto out = accounts + de->d_name + '/';
-
-        std::string dirUsername;
-        if (readUsername(out, dirUsername) && username == dirUsername)
-        {
-            result = out;
-            closedir(dir);
-            return Status();
-        }
+        indexUpdate(true);
+        i = index_.find(username);
     }
+    if (index_.end() == i)
+        return ABC_ERROR(ABC_CC_FileDoesNotExist, "No account directory");
 
-    closedir(dir);
-    return ABC_ERROR(ABC_CC_FileDoesNotExist, "No account directory");
+    result = i->second;
+    return Status();
 }
 
 Status
 RootPaths::accountDirNew(AccountPaths &result, const std::string &username)
 {
+    std::lock_guard<std::mutex> lock(mutex_);
+    indexUpdate();
+
     std::string accounts = accountsDir();
     std::string account;
 
@@ -136,15 +134,109 @@ RootPaths::accountDirNew(AccountPaths &result, const std::string &username)
     ABC_CHECK(json.usernameSet(username));
     ABC_CHECK(json.save(account + usernameFilename));
 
+    index_[username] = account;
+    indexSave();
+
     result = account;
     return Status();
 }
 
+Status
+RootPaths::accountDirDelete(const std::string &username)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    indexUpdate();
+
+    const auto i = index_.find(username);
+    if (index_.end() == i)
+        return ABC_ERROR(ABC_CC_FileDoesNotExist, "No account directory");
+
+    ABC_CHECK(fileDelete(i->second));
+    index_.erase(i);
+    indexSave();
+    return Status();
+}
+
 WalletPaths
 RootPaths::walletDir(const std::string &id)
 {
     return WalletPaths(walletsDir() + id + '/');
 }
 
+void
+RootPaths::indexUpdate(bool rescan)
+{
+    const auto accounts = accountsDir();
+    int64_t now;
+    if (!fileTimeExact(now, accounts))
+        now = 0;
+    if (!rescan && indexDir_ == accounts && indexTime_ == now)
+        return;
+
+    // Try the saved index on first use:
+    if (indexDir_ != accounts)
+    {
+        index_.clear();
+        indexDir_ = accounts;
+        indexTime_ = 0;
+
+        AccountIndexJson json;
+        if (!rescan && json.load(accountIndexPath()) &&
+                accounts == json.dir() && now == json.time())
+        {
+            auto users = json.accounts();
+            for (void *i = json_object_iter(users.get());
+                    i;
+                    i = json_object_iter_next(users.get(), i))
+            {
+                const auto value = json_object_iter_value(i);
+                if (json_is_string(value))
+                    index_[json_object_iter_key(i)] = json_string_value(value);
+            }
+            indexTime_ = now;
+            return;
+        }
+    }
+
+    // Scan the directory:
+    index_.clear();
+    DIR *dir = opendir(accounts.c_str());
+    if (dir)
+    {
+        struct dirent *de;
+        while (nullptr != (de = readdir(dir)))
+        {
+            // Skip hidden files:
+            if (de->d_name[0] == '.')
+                continue;
+
+            auto account = accounts + de->d_name + '/';
+
+            std::string username;
+            if (readUsername(account, username))
+                index_[username] = account;
+        }
+        closedir(dir);
+    }
+    indexSave();
+}
+
+void
+RootPaths::indexSave()
+{
+    if (!fileTimeExact(indexTime_, indexDir_))
+        indexTime_ = 0;
+
+    JsonObject users;
+    for (const auto &i: index_)
+        users.set(i.first.c_str(), i.second).log();
+
+    AccountIndexJson json;
+    json.dirSet(indexDir_).log();
+    json.timeSet(indexTime_).log();
+    json.accountsSet(users).log();
+    json.save(accountIndexPath()).log();
+}
+
 
 } // namespace abcd
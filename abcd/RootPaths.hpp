@@ -10,6 +10,8 @@
 
 #include "util/Status.hpp"
 #include <list>
+#include <map>
+#include <mutex>
 
 namespace abcd {
 
@@ -48,6 +50,12 @@ public:
     Status
     accountDirNew(AccountPaths &result, const std::string &username);
 
+    /**
+     * Deletes an account's directory off the device.
+     */
+    Status
+    accountDirDelete(const std::string &username);
+
     /**
      * Returns the directory name for a particular wallet.
      */
@@ -57,18 +65,51 @@ public:
     // Individual files:
     const std::string &certPath() const { return certPath_; }
     std::string blockCachePath() const { return dir_ + "Blocks.json"; }
+    std::string blockHeadersPath() const { return dir_ + "BlockHeaders.bin"; }
     std::string exchangeCachePath() const { return dir_ + "Exchange.json"; }
+    std::string exchangeHistoryPath() const { return dir_ + "ExchangeHistory.bin"; }
+    std::string exchangeSourcePath(const std::string &source) const;
     std::string feeCachePath() const { return dir_ + "Fees.json"; }
     std::string twentyOneFeeCachePath() const { return dir_ + "TwentyOneFees.json"; }
     std::string generalPath() const { return dir_ + "Servers.json"; }
     std::string serverScoresPath() const { return dir_ + "ServerScores.json"; }
+    std::string sharedStatePath() const { return dir_ + "Shared.bin"; }
+    std::string tlsSessionsPath() const { return dir_ + "TlsSessions.json"; }
+    std::string userIdsPath() const { return dir_ + "UserIds.json"; }
+    std::string accountIndexPath() const;
+    std::string otpPendingPath() const { return dir_ + "OtpPending.json"; }
+    std::string scryptProfilePath() const { return dir_ + "ScryptProfile.json"; }
     std::string questionsPath() const { return dir_ + "Questions.json"; }
     std::string logPath() const { return dir_ + "abc.log"; }
     std::string logPrevPath() const { return dir_ + "abc-prev.log"; }
+    std::string tracePath() const { return dir_ + "Trace.bin"; }
+    std::string tracePrevPath() const { return dir_ + "Trace-prev.bin"; }
 
 private:
     const std::string dir_;
     const std::string certPath_;
+
+    // Maps usernames to account directories, so lookups skip the scan:
+    std::mutex mutex_;
+    std::string indexDir_; // The accounts directory the index describes
+    int64_t indexTime_ = 0; // That directory's modification time, in ns
+    std::map<std::string, std::string> index_;
+
+    /**
+     * Brings the index up to date with the accounts directory,
+     * re-scanning only if something else has changed the directory,
+     * or if the caller asks for a fresh scan.
+     * The caller must hold the mutex.
+     */
+    void
+    indexUpdate(bool rescan=false);
+
+    /**
+     * Notes our own change to the accounts directory and saves the index.
+     * The caller must hold the mutex.
+     */
+    void
+    indexSave();
 };
 
 } // namespace abcd
@@ -30,8 +30,12 @@ public:
     // Files:
     std::string currencyPath() const { return dir_ + "sync/Currency.json"; }
     std::string namePath() const { return dir_ + "sync/WalletName.json"; }
+    std::string txSnapshotPath() const { return dir_ + "sync/TxSnapshot.json"; }
     std::string cachePath() const { return dir_ + "Cache.json"; }
+    std::string txCachePath() const { return dir_ + "TxCache.bin"; }
     std::string cachePathOld() const { return dir_ + "watcher.ser"; }
+    std::string addressPackPath() const { return dir_ + "AddressPack.json"; }
+    std::string txPackPath() const { return dir_ + "TxPack.json"; }
 
 private:
     std::string dir_;
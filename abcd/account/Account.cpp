@@ -6,6 +6,8 @@
  */
 
 #include "Account.hpp"
+#include "AccountSettings.hpp"
+#include "PluginData.hpp"
 #include "../Context.hpp"
 #include "../crypto/Encoding.hpp"
 #include "../login/Login.hpp"
@@ -33,9 +35,17 @@ Account::create(std::shared_ptr<Account> &result, Login &login)
 Status
 Account::sync(bool &dirty)
 {
-    ABC_CHECK(syncRepo(dir(), syncKey_, dirty));
+    std::vector<std::string> changes;
+    ABC_CHECK(syncRepo(dir(), syncKey_, dirty, changes));
+
+    // Drop anything cached that the sync has changed:
     if (dirty)
-        ABC_CHECK(load());
+    {
+        ABC_CHECK(wallets.reload(changes));
+        accountSettingsReload(*this, changes);
+        accountCategoriesReload(*this, changes);
+        pluginDataReload(*this, changes);
+    }
 
     return Status();
 }
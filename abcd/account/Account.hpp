@@ -8,12 +8,17 @@
 #ifndef ABCD_ACCOUNT_ACCOUNT_HPP
 #define ABCD_ACCOUNT_ACCOUNT_HPP
 
+#include "AccountCategories.hpp"
 #include "WalletList.hpp"
+#include "../util/SecureData.hpp"
+#include <map>
 #include <memory>
+#include <mutex>
 
 namespace abcd {
 
 class Login;
+struct PluginCache;
 
 /**
  * Manages the account sync directory.
@@ -28,7 +33,7 @@ public:
     create(std::shared_ptr<Account> &result, Login &login);
 
     const std::string &dir() const { return dir_; }
-    const DataChunk &dataKey() const { return dataKey_; }
+    DataSlice dataKey() const { return dataKey_; }
 
     /**
      * Syncs the account with the file server.
@@ -40,7 +45,7 @@ public:
 private:
     const std::shared_ptr<Login> parent_;
     const std::string dir_;
-    const DataChunk dataKey_;
+    const SecureChunk dataKey_;
     const std::string syncKey_;
 
     Account(Login &login, DataSlice dataKey, DataSlice syncKey);
@@ -54,6 +59,18 @@ public:
     // Set to the current PIN when the settings are loaded.
     // Used to detect changes to the PIN.
     std::string pin;
+
+    // The decrypted settings, managed by AccountSettings.cpp:
+    std::mutex settingsMutex;
+    std::shared_ptr<const tABC_AccountSettings> settings;
+
+    // The decrypted categories, managed by AccountCategories.cpp:
+    mutable std::mutex categoriesMutex;
+    mutable std::shared_ptr<const AccountCategories> categories;
+
+    // The plugin key/value caches, by plugin id, managed by PluginData.cpp:
+    mutable std::mutex pluginMutex;
+    mutable std::map<std::string, std::shared_ptr<PluginCache>> plugins;
 };
 
 } // namespace abcd
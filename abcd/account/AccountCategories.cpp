@@ -10,6 +10,8 @@
 #include "../json/JsonArray.hpp"
 #include "../json/JsonObject.hpp"
 #include "../login/Login.hpp"
+#include "../util/FileIO.hpp"
+#include <algorithm>
 
 namespace abcd {
 
@@ -25,7 +27,7 @@ categoriesPath(const Account &account)
     return account.dir() + "Categories.json";
 }
 
-Status
+static Status
 accountCategoriesSave(const Account &account,
                       const AccountCategories &categories)
 {
@@ -37,13 +39,16 @@ accountCategoriesSave(const Account &account,
 
     CategoriesJson json;
     ABC_CHECK(json.categoriesSet(arrayJson));
-    ABC_CHECK(json.save(categoriesPath(account), account.dataKey()));
+    ABC_CHECK(json.saveQueued(categoriesPath(account), account.dataKey()));
 
     return Status();
 }
 
-Status
-accountCategoriesLoad(AccountCategories &result, const Account &account)
+/**
+ * Reads the categories file, bypassing the cache.
+ */
+static Status
+accountCategoriesRead(AccountCategories &result, const Account &account)
 {
     AccountCategories out;
 
@@ -65,24 +70,80 @@ accountCategoriesLoad(AccountCategories &result, const Account &account)
     return Status();
 }
 
+/**
+ * Fills the cache if it is empty.
+ * The caller must hold the categories mutex.
+ */
+static Status
+accountCategoriesCache(const Account &account)
+{
+    if (!account.categories)
+    {
+        auto out = std::make_shared<AccountCategories>();
+        ABC_CHECK(accountCategoriesRead(*out, account));
+        account.categories = out;
+    }
+    return Status();
+}
+
 Status
-accountCategoriesAdd(const Account &account, const std::string &category)
+accountCategoriesLoad(AccountCategories &result, const Account &account)
 {
-    AccountCategories categories;
-    accountCategoriesLoad(categories, account);
-    categories.insert(category);
-    ABC_CHECK(accountCategoriesSave(account, categories));
+    std::lock_guard<std::mutex> lock(account.categoriesMutex);
+    ABC_CHECK(accountCategoriesCache(account));
+
+    result = *account.categories;
     return Status();
 }
 
+Status
+accountCategoriesAdd(const Account &account, const std::string &category)
+{
+    return accountCategoriesUpdate(account, AccountCategories{category},
+                                   AccountCategories());
+}
+
 Status
 accountCategoriesRemove(const Account &account, const std::string &category)
 {
-    AccountCategories categories;
-    ABC_CHECK(accountCategoriesLoad(categories, account));
-    categories.erase(category);
-    ABC_CHECK(accountCategoriesSave(account, categories));
+    return accountCategoriesUpdate(account, AccountCategories(),
+                                   AccountCategories{category});
+}
+
+Status
+accountCategoriesUpdate(const Account &account,
+                        const AccountCategories &add,
+                        const AccountCategories &remove)
+{
+    std::lock_guard<std::mutex> lock(account.categoriesMutex);
+
+    // A brand-new account has no file yet, which is fine:
+    if (!account.categories && !fileExists(categoriesPath(account)))
+        account.categories = std::make_shared<AccountCategories>();
+    ABC_CHECK(accountCategoriesCache(account));
+
+    auto out = std::make_shared<AccountCategories>(*account.categories);
+    out->insert(add.begin(), add.end());
+    for (const auto &category: remove)
+        out->erase(category);
+    if (*out == *account.categories)
+        return Status();
+
+    ABC_CHECK(accountCategoriesSave(account, *out));
+    account.categories = out;
     return Status();
 }
 
+void
+accountCategoriesReload(const Account &account,
+                        const std::vector<std::string> &changes)
+{
+    const auto path = categoriesPath(account);
+    if (changes.end() == std::find(changes.begin(), changes.end(), path))
+        return;
+
+    std::lock_guard<std::mutex> lock(account.categoriesMutex);
+    account.categories.reset();
+}
+
 } // namespace abcd
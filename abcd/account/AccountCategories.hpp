@@ -10,6 +10,7 @@
 
 #include "../util/Status.hpp"
 #include <set>
+#include <vector>
 
 namespace abcd {
 
@@ -19,6 +20,7 @@ typedef std::set<std::string> AccountCategories;
 
 /**
  * Loads the categories from an account.
+ * The set stays cached on the account until a sync changes it.
  */
 Status
 accountCategoriesLoad(AccountCategories &result, const Account &account);
@@ -35,6 +37,23 @@ accountCategoriesAdd(const Account &account, const std::string &category);
 Status
 accountCategoriesRemove(const Account &account, const std::string &category);
 
+/**
+ * Adds and removes many categories in one step,
+ * writing the file once at the end.
+ * Removals happen after additions.
+ */
+Status
+accountCategoriesUpdate(const Account &account,
+                        const AccountCategories &add,
+                        const AccountCategories &remove);
+
+/**
+ * Drops the cached categories if a sync has changed them.
+ */
+void
+accountCategoriesReload(const Account &account,
+                        const std::vector<std::string> &changes);
+
 } // namespace abcd
 
 #endif
@@ -13,6 +13,7 @@
 #include "../login/LoginPin2.hpp"
 #include "../login/LoginStore.hpp"
 #include "../util/Util.hpp"
+#include <algorithm>
 
 namespace abcd {
 
@@ -127,14 +128,14 @@ accountSettingsPinSync(Login &login, tABC_AccountSettings *settings,
     return Status();
 }
 
-tABC_AccountSettings *
-accountSettingsLoad(Account &account)
+/**
+ * Converts the settings file contents into the API structure.
+ */
+static AccountSettingsPtr
+settingsFromJson(Account &account, SettingsJson &json)
 {
     tABC_AccountSettings *out = structAlloc<tABC_AccountSettings>();
 
-    SettingsJson json;
-    json.load(settingsPath(account), account.dataKey()).log();
-
     // Account:
     out->szPIN = json.pinOk() ? stringCopy(json.pin()) : nullptr;
     out->bDisablePINLogin = json.disablePinLogin();
@@ -175,9 +176,66 @@ accountSettingsLoad(Account &account)
     if (out->szPIN)
         account.pin = out->szPIN;
 
+    return AccountSettingsPtr(out, accountSettingsFree);
+}
+
+static char *
+stringCopyOrNull(const char *string)
+{
+    return string ? stringCopy(string) : nullptr;
+}
+
+AccountSettingsPtr
+accountSettingsShared(Account &account)
+{
+    {
+        std::lock_guard<std::mutex> lock(account.settingsMutex);
+        if (account.settings)
+            return account.settings;
+    }
+
+    // Decrypt outside the lock. Racing readers just do duplicate work:
+    SettingsJson json;
+    json.load(settingsPath(account), account.dataKey()).log();
+    auto out = settingsFromJson(account, json);
+
+    std::lock_guard<std::mutex> lock(account.settingsMutex);
+    if (!account.settings)
+        account.settings = out;
+    return account.settings;
+}
+
+tABC_AccountSettings *
+accountSettingsLoad(Account &account)
+{
+    const auto shared = accountSettingsShared(account);
+
+    tABC_AccountSettings *out = structAlloc<tABC_AccountSettings>();
+    *out = *shared;
+    out->szFirstName = stringCopyOrNull(shared->szFirstName);
+    out->szLastName = stringCopyOrNull(shared->szLastName);
+    out->szNickname = stringCopyOrNull(shared->szNickname);
+    out->szPIN = stringCopyOrNull(shared->szPIN);
+    out->szLanguage = stringCopyOrNull(shared->szLanguage);
+    out->szExchangeRateSource = stringCopyOrNull(shared->szExchangeRateSource);
+    out->szFullName = stringCopyOrNull(shared->szFullName);
+    out->szOverrideBitcoinServerList =
+        stringCopyOrNull(shared->szOverrideBitcoinServerList);
     return out;
 }
 
+void
+accountSettingsReload(Account &account,
+                      const std::vector<std::string> &changes)
+{
+    const auto path = settingsPath(account);
+    if (changes.end() == std::find(changes.begin(), changes.end(), path))
+        return;
+
+    std::lock_guard<std::mutex> lock(account.settingsMutex);
+    account.settings.reset();
+}
+
 Status
 accountSettingsSave(Account &account, tABC_AccountSettings *pSettings)
 {
@@ -235,7 +293,14 @@ accountSettingsSave(Account &account, tABC_AccountSettings *pSettings)
         ABC_CHECK(json.overrideBitcoinServerListSet(DEFAULT_SERVER_LIST));
     }
 
-    ABC_CHECK(json.save(settingsPath(account), account.dataKey()));
+    ABC_CHECK(json.saveQueued(settingsPath(account), account.dataKey()));
+
+    // Readers see exactly what the next load would give them:
+    auto fresh = settingsFromJson(account, json);
+    {
+        std::lock_guard<std::mutex> lock(account.settingsMutex);
+        account.settings = fresh;
+    }
 
     // Update the PIN package to match:
     bool pinChanged = pSettings->szPIN && pSettings->szPIN != account.pin;
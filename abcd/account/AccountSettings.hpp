@@ -9,6 +9,8 @@
 #define ABCD_ACCOUNT_ACCOUNT_SETTINGS_HPP
 
 #include "../util/Status.hpp"
+#include <memory>
+#include <vector>
 
 #define DEFAULT_SERVER_LIST "stratum://electrum.airbitz.co\nstratum://electrum-bu-az-weuro.airbitz.co:50001\nstratum://electrum-bu-az-wjapan.airbitz.co:50001\nstratum://electrum-bc-az-eusa.airbitz.co:50001"
 
@@ -21,7 +23,21 @@ class Account;
 class Login;
 
 /**
- * Loads the settings from an account.
+ * A read-only view of an account's settings.
+ */
+typedef std::shared_ptr<const tABC_AccountSettings> AccountSettingsPtr;
+
+/**
+ * Returns the account's settings, decrypting them on first use only.
+ * The view stays valid after later saves or syncs replace the settings.
+ * Returns default settings if anything goes wrong.
+ */
+AccountSettingsPtr
+accountSettingsShared(Account &account);
+
+/**
+ * Loads the settings from an account,
+ * as a private copy the caller must free.
  * Returns default settings if anything goes wrong.
  */
 tABC_AccountSettings *
@@ -33,6 +49,15 @@ accountSettingsLoad(Account &account);
 Status
 accountSettingsSave(Account &account, tABC_AccountSettings *pSettings);
 
+/**
+ * Drops the in-memory settings if a sync changed the settings file,
+ * so the next read goes back to disk.
+ * @param changes the paths the sync touched.
+ */
+void
+accountSettingsReload(Account &account,
+                      const std::vector<std::string> &changes);
+
 /**
  * Frees the account settings structure, along with its contents.
  */
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "AccountSummary.hpp"
+#include "Account.hpp"
+#include "../bitcoin/cache/Cache.hpp"
+#include "../json/JsonArray.hpp"
+#include "../json/JsonObject.hpp"
+#include "../login/Login.hpp"
+#include "../util/FileIO.hpp"
+#include "../wallet/Wallet.hpp"
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace abcd {
+
+// Enough for a home screen, without the file getting big:
+constexpr size_t summaryTxsMax = 10;
+
+struct SummaryTxJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(SummaryTxJson, JsonObject)
+
+    ABC_JSON_STRING(txid, "txid", nullptr)
+    ABC_JSON_INTEGER(time, "time", 0)
+    ABC_JSON_INTEGER(amount, "amountSatoshi", 0)
+    ABC_JSON_STRING(name, "name", "")
+};
+
+struct SummaryWalletJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(SummaryWalletJson, JsonObject)
+
+    ABC_JSON_STRING(id, "id", nullptr)
+    ABC_JSON_STRING(name, "name", "")
+    ABC_JSON_INTEGER(currency, "currency", 0)
+    ABC_JSON_INTEGER(balance, "balanceSatoshi", 0)
+    ABC_JSON_BOOLEAN(archived, "archived", false)
+    ABC_JSON_INTEGER(updated, "updated", 0)
+    ABC_JSON_VALUE(txs, "transactions", JsonArray)
+};
+
+struct SummaryJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(SummaryJson, JsonObject)
+
+    ABC_JSON_VALUE(wallets, "wallets", JsonArray)
+};
+
+/**
+ * What we know of one account's summary.
+ * The JSON only gets touched with the mutex held.
+ */
+struct SummaryState
+{
+    std::map<std::string, SummaryWalletJson> wallets;
+};
+
+static std::mutex gSummaryMutex;
+static std::map<std::string, SummaryState> gSummaries; // By login dir
+
+/**
+ * Finds the state for an account, reading any earlier summary off disk,
+ * so rows for wallets that have not loaded yet survive the next write.
+ * The caller must hold the mutex.
+ */
+static Status
+summaryState(SummaryState *&result, const AccountPaths &paths)
+{
+    auto i = gSummaries.find(paths.dir());
+    if (gSummaries.end() == i)
+    {
+        SummaryState state;
+
+        SummaryJson json;
+        if (fileExists(paths.summaryPath()) &&
+                json.load(paths.summaryPath()).log())
+        {
+            auto wallets = json.wallets();
+            for (size_t j = 0; j < wallets.size(); ++j)
+            {
+                SummaryWalletJson walletJson(wallets[j]);
+                if (walletJson.idOk())
+                    state.wallets[walletJson.id()] = walletJson;
+            }
+        }
+        i = gSummaries.emplace(paths.dir(), std::move(state)).first;
+    }
+
+    result = &i->second;
+    return Status();
+}
+
+/**
+ * Lists the wallet's newest transactions, newest first.
+ */
+static Status
+summaryTxs(JsonArray &result, Wallet &wallet)
+{
+    const auto items = wallet.txIndex.page(0, 0).items;
+    const size_t count = std::min(items.size(), summaryTxsMax);
+
+    JsonArray out;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const auto &item = items[items.size() - 1 - i];
+
+        int64_t amount = 0;
+        TxInfo info;
+        if (item.cached && wallet.cache.txs.info(info, item.id))
+            amount = wallet.addresses.balance(info);
+
+        SummaryTxJson txJson;
+        ABC_CHECK(txJson.txidSet(item.id));
+        ABC_CHECK(txJson.timeSet(item.time));
+        ABC_CHECK(txJson.amountSet(amount));
+        TxMeta meta;
+        if (wallet.txs.get(meta, item.ntxid))
+            ABC_CHECK(txJson.nameSet(meta.metadata.name));
+        ABC_CHECK(out.append(txJson));
+    }
+
+    result = std::move(out);
+    return Status();
+}
+
+Status
+accountSummaryUpdate(Wallet &wallet)
+{
+    auto &account = wallet.account;
+    const auto &paths = account.login.paths;
+
+    // Gather the row before taking the lock:
+    bool archived = false;
+    account.wallets.archived(archived, wallet.id()).log();
+    JsonArray txs;
+    ABC_CHECK(summaryTxs(txs, wallet));
+
+    SummaryWalletJson walletJson;
+    ABC_CHECK(walletJson.idSet(wallet.id()));
+    ABC_CHECK(walletJson.nameSet(wallet.name()));
+    ABC_CHECK(walletJson.currencySet(wallet.currency()));
+    ABC_CHECK(walletJson.balanceSet(wallet.cache.txs.balance().total()));
+    ABC_CHECK(walletJson.archivedSet(archived));
+    ABC_CHECK(walletJson.updatedSet(time(nullptr)));
+    ABC_CHECK(walletJson.txsSet(txs));
+
+    std::lock_guard<std::mutex> lock(gSummaryMutex);
+    SummaryState *state;
+    ABC_CHECK(summaryState(state, paths));
+    // A deep copy, since jansson reference counts are not thread-safe:
+    state->wallets[wallet.id()] = walletJson.clone();
+
+    // Write the rows out in the account's own order:
+    JsonArray wallets;
+    std::map<std::string, SummaryWalletJson> kept;
+    for (const auto &id: account.wallets.list())
+    {
+        auto i = state->wallets.find(id);
+        if (state->wallets.end() == i)
+            continue;
+        ABC_CHECK(wallets.append(i->second));
+        kept.insert(*i);
+    }
+    state->wallets.swap(kept);
+
+    SummaryJson json;
+    ABC_CHECK(json.walletsSet(wallets));
+    ABC_CHECK(json.saveQueued(paths.summaryPath()));
+
+    return Status();
+}
+
+Status
+accountSummaryLoad(std::string &result, const AccountPaths &paths)
+{
+    if (!fileExists(paths.summaryPath()))
+        return ABC_ERROR(ABC_CC_FileDoesNotExist, "No account summary");
+
+    JsonPtr json;
+    ABC_CHECK(json.load(paths.summaryPath()));
+
+    result = json.encode();
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A small snapshot of an account's wallets, for showing at launch
+ * before the account and its wallets have loaded.
+ */
+
+#ifndef ABCD_ACCOUNT_ACCOUNT_SUMMARY_HPP
+#define ABCD_ACCOUNT_ACCOUNT_SUMMARY_HPP
+
+#include "../util/Status.hpp"
+
+namespace abcd {
+
+class AccountPaths;
+class Wallet;
+
+/**
+ * Refreshes one wallet's row in its account's summary,
+ * dropping any wallets that have left the account,
+ * and queues the summary for the disk.
+ */
+Status
+accountSummaryUpdate(Wallet &wallet);
+
+/**
+ * Reads an account's summary as JSON, without logging in.
+ * The summary is stored in the clear, since there is no key
+ * to protect it with until the user logs in.
+ */
+Status
+accountSummaryLoad(std::string &result, const AccountPaths &paths);
+
+} // namespace abcd
+
+#endif
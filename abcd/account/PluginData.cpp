@@ -11,7 +11,9 @@
 #include "../json/JsonObject.hpp"
 #include "../login/Login.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/WriteQueue.hpp"
 #include <dirent.h>
+#include <string.h>
 
 namespace abcd {
 
@@ -23,6 +25,18 @@ struct PluginNameJson:
 
 constexpr auto nameFilename = "Name.json";
 
+/**
+ * What we know about one plugin's key/value store.
+ */
+struct PluginCache
+{
+    // The file holding each key:
+    std::map<std::string, std::string> files;
+
+    // Values that have been read or written so far:
+    PluginDataMap values;
+};
+
 struct PluginDataFile:
     public JsonObject
 {
@@ -49,8 +63,180 @@ static std::string
 keyFilename(const Account &account, const std::string &plugin,
             const std::string &key)
 {
-    return pluginDirectory(account, plugin) +
-           cryptoFilename(account.dataKey(), key) + ".json";
+    const HmacKey filenameKey(account.dataKey());
+    return pluginsDirectory(account) +
+           filenameKey.filename(plugin) + "/" +
+           filenameKey.filename(key) + ".json";
+}
+
+/**
+ * The index lives outside the sync directory,
+ * since each device builds its own from whatever it has seen.
+ */
+static std::string
+indexDirectory(const Account &account)
+{
+    return account.login.paths.dir() + "PluginIndex/";
+}
+
+static std::string
+indexFilename(const Account &account, const std::string &plugin)
+{
+    return indexDirectory(account) +
+           cryptoFilename(account.dataKey(), plugin) + ".json";
+}
+
+/**
+ * Queues a new copy of the index, mapping filenames to key names.
+ */
+static Status
+indexSave(const Account &account, const std::string &plugin,
+          const PluginCache &cache)
+{
+    JsonPtr index(json_object());
+    for (const auto &file: cache.files)
+        if (json_object_set_new(index.get(), file.second.c_str(),
+                                json_string(file.first.c_str())) < 0)
+            return ABC_ERROR(ABC_CC_JSONError, "Cannot build plugin index");
+
+    ABC_CHECK(fileEnsureDir(indexDirectory(account)));
+    ABC_CHECK(index.saveQueued(indexFilename(account, plugin),
+                               account.dataKey()));
+    return Status();
+}
+
+/**
+ * Finds the cache for a plugin, building it if needed.
+ * The directory listing is the truth, since a sync can add or
+ * remove files, so the index only saves decrypting files it covers.
+ * The caller must hold the plugin mutex.
+ */
+static PluginCache &
+cacheLoad(const Account &account, const std::string &plugin)
+{
+    auto &slot = account.plugins[plugin];
+    if (slot)
+        return *slot;
+    slot = std::make_shared<PluginCache>();
+
+    std::map<std::string, std::string> index;
+    JsonPtr indexJson;
+    if (indexJson.load(indexFilename(account, plugin), account.dataKey()) &&
+            json_is_object(indexJson.get()))
+    {
+        for (void *i = json_object_iter(indexJson.get());
+                i;
+                i = json_object_iter_next(indexJson.get(), i))
+        {
+            json_t *value = json_object_iter_value(i);
+            if (json_is_string(value))
+                index[json_object_iter_key(i)] = json_string_value(value);
+        }
+    }
+
+    std::string outer = pluginDirectory(account, plugin);
+    writeQueueFlush(outer).log();
+    DIR *dir = opendir(outer.c_str());
+    if (!dir)
+        return *slot;
+
+    size_t found = 0;
+    struct dirent *de;
+    while (nullptr != (de = readdir(dir)))
+    {
+        if (!fileIsJson(de->d_name) || !strcmp(de->d_name, nameFilename))
+            continue;
+
+        auto i = index.find(de->d_name);
+        if (index.end() != i)
+        {
+            slot->files[i->second] = de->d_name;
+            ++found;
+            continue;
+        }
+
+        // This file is new to us, so we have to read it:
+        PluginDataFile json;
+        if (json.load(outer + de->d_name, account.dataKey())
+                && json.keyOk() && json.dataOk())
+        {
+            slot->files[json.key()] = de->d_name;
+            slot->values[json.key()] = json.data();
+        }
+    }
+    closedir(dir);
+
+    if (found != index.size() || found != slot->files.size())
+        indexSave(account, plugin, *slot).log();
+    return *slot;
+}
+
+/**
+ * Reads one value through the cache.
+ * The caller must hold the plugin mutex.
+ */
+static Status
+cacheGet(const Account &account, const std::string &plugin,
+         PluginCache &cache, const std::string &key, std::string &data)
+{
+    auto value = cache.values.find(key);
+    if (cache.values.end() != value)
+    {
+        data = value->second;
+        return Status();
+    }
+    if (cache.files.end() == cache.files.find(key))
+        return ABC_ERROR(ABC_CC_FileDoesNotExist, "No plugin data for " + key);
+
+    PluginDataFile json;
+    ABC_CHECK(json.load(keyFilename(account, plugin, key),
+                        account.dataKey()));
+    ABC_CHECK(json.keyOk());
+    ABC_CHECK(json.dataOk());
+
+    if (json.key() != key)
+        return ABC_ERROR(ABC_CC_JSONError, "Plugin filename does not match contents");
+
+    data = json.data();
+    cache.values[key] = data;
+    return Status();
+}
+
+/**
+ * Writes one value through the cache, leaving the index to the caller.
+ * The caller must hold the plugin mutex.
+ */
+static Status
+cacheSet(const Account &account, const std::string &plugin,
+         PluginCache &cache, const std::string &key, const std::string &data)
+{
+    PluginDataFile json;
+    json.keySet(key);
+    json.dataSet(data);
+    ABC_CHECK(json.saveQueued(keyFilename(account, plugin, key),
+                              account.dataKey()));
+
+    const HmacKey filenameKey(account.dataKey());
+    cache.files[key] = filenameKey.filename(key) + ".json";
+    cache.values[key] = data;
+    return Status();
+}
+
+static Status
+pluginEnsureDir(const Account &account, const std::string &plugin)
+{
+    ABC_CHECK(fileEnsureDir(pluginsDirectory(account)));
+    ABC_CHECK(fileEnsureDir(pluginDirectory(account, plugin)));
+
+    const auto namePath = pluginDirectory(account, plugin) + nameFilename;
+    if (!fileExists(namePath))
+    {
+        PluginNameJson json;
+        ABC_CHECK(json.nameSet(plugin));
+        json.save(namePath, account.dataKey());
+    }
+
+    return Status();
 }
 
 std::list<std::string>
@@ -59,6 +245,7 @@ pluginDataList(const Account &account)
     std::list<std::string> out;
 
     std::string outer = pluginsDirectory(account);
+    writeQueueFlush(outer).log();
     DIR *dir = opendir(outer.c_str());
     if (!dir)
         return out;
@@ -81,24 +268,12 @@ pluginDataList(const Account &account)
 std::list<std::string>
 pluginDataKeys(const Account &account, const std::string &plugin)
 {
-    std::list<std::string> out;
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    const auto &cache = cacheLoad(account, plugin);
 
-    std::string outer = pluginDirectory(account, plugin);
-    DIR *dir = opendir(outer.c_str());
-    if (!dir)
-        return out;
-
-    struct dirent *de;
-    while (nullptr != (de = readdir(dir)))
-    {
-        PluginDataFile json;
-        if (fileIsJson(de->d_name)
-                && json.load(outer + de->d_name, account.dataKey())
-                && json.keyOk())
-            out.push_back(json.key());
-    }
-
-    closedir(dir);
+    std::list<std::string> out;
+    for (const auto &file: cache.files)
+        out.push_back(file.first);
     return out;
 }
 
@@ -106,16 +281,30 @@ Status
 pluginDataGet(const Account &account, const std::string &plugin,
               const std::string &key, std::string &data)
 {
-    PluginDataFile json;
-    ABC_CHECK(json.load(keyFilename(account, plugin, key),
-                        account.dataKey()));
-    ABC_CHECK(json.keyOk());
-    ABC_CHECK(json.dataOk());
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    auto &cache = cacheLoad(account, plugin);
+    ABC_CHECK(cacheGet(account, plugin, cache, key, data));
+    return Status();
+}
 
-    if (json.key() != key)
-        return ABC_ERROR(ABC_CC_JSONError, "Plugin filename does not match contents");
+Status
+pluginDataGetMany(const Account &account, const std::string &plugin,
+                  const std::vector<std::string> &keys, PluginDataMap &result)
+{
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    auto &cache = cacheLoad(account, plugin);
 
-    data = json.data();
+    PluginDataMap out;
+    for (const auto &key: keys)
+    {
+        if (cache.files.end() == cache.files.find(key))
+            continue;
+        std::string data;
+        ABC_CHECK(cacheGet(account, plugin, cache, key, data));
+        out[key] = data;
+    }
+
+    result = std::move(out);
     return Status();
 }
 
@@ -123,22 +312,27 @@ Status
 pluginDataSet(const Account &account, const std::string &plugin,
               const std::string &key, const std::string &data)
 {
-    ABC_CHECK(fileEnsureDir(pluginsDirectory(account)));
-    ABC_CHECK(fileEnsureDir(pluginDirectory(account, plugin)));
+    PluginDataMap items;
+    items[key] = data;
+    return pluginDataSetMany(account, plugin, items);
+}
 
-    const auto namePath = pluginDirectory(account, plugin) + "Name.json";
-    if (!fileExists(namePath))
-    {
-        PluginNameJson json;
-        ABC_CHECK(json.nameSet(plugin));
-        json.save(namePath, account.dataKey());
-    }
+Status
+pluginDataSetMany(const Account &account, const std::string &plugin,
+                  const PluginDataMap &items)
+{
+    ABC_CHECK(pluginEnsureDir(account, plugin));
 
-    PluginDataFile json;
-    json.keySet(key);
-    json.dataSet(data);
-    ABC_CHECK(json.save(keyFilename(account, plugin, key),
-                        account.dataKey()));
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    auto &cache = cacheLoad(account, plugin);
+    const auto size = cache.files.size();
+
+    for (const auto &item: items)
+        ABC_CHECK(cacheSet(account, plugin, cache, item.first, item.second));
+
+    // Existing keys keep their filenames, so only new keys touch the index:
+    if (size != cache.files.size())
+        ABC_CHECK(indexSave(account, plugin, cache));
 
     return Status();
 }
@@ -152,6 +346,14 @@ pluginDataRemove(const Account &account, const std::string &plugin,
     if (fileExists(filename))
         ABC_CHECK(fileDelete(filename));
 
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    auto slot = account.plugins.find(plugin);
+    if (account.plugins.end() != slot && slot->second->files.erase(key))
+    {
+        slot->second->values.erase(key);
+        ABC_CHECK(indexSave(account, plugin, *slot->second));
+    }
+
     return Status();
 }
 
@@ -163,7 +365,32 @@ pluginDataClear(const Account &account, const std::string &plugin)
     if (fileExists(directory))
         ABC_CHECK(fileDelete(directory));
 
+    std::string index = indexFilename(account, plugin);
+    if (fileExists(index))
+        ABC_CHECK(fileDelete(index));
+
+    std::lock_guard<std::mutex> lock(account.pluginMutex);
+    account.plugins.erase(plugin);
+
     return Status();
 }
 
+void
+pluginDataReload(const Account &account,
+                 const std::vector<std::string> &changes)
+{
+    // Changed files keep their names, but the cached values go stale,
+    // so drop everything and let the index speed up the rebuild:
+    const auto outer = pluginsDirectory(account);
+    for (const auto &path: changes)
+    {
+        if (!path.compare(0, outer.size(), outer))
+        {
+            std::lock_guard<std::mutex> lock(account.pluginMutex);
+            account.plugins.clear();
+            return;
+        }
+    }
+}
+
 } // namespace abcd
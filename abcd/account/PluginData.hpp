@@ -10,11 +10,18 @@
 
 #include "../util/Status.hpp"
 #include <list>
+#include <map>
+#include <vector>
 
 namespace abcd {
 
 class Account;
 
+/**
+ * A set of plugin values, by key.
+ */
+typedef std::map<std::string, std::string> PluginDataMap;
+
 /**
  * Lists the plugin key/value stores in the account.
  * This mainly exists for diagnostics,
@@ -27,6 +34,8 @@ pluginDataList(const Account &account);
 
 /**
  * Lists the keys in a plugin key/value store.
+ * The key names come from a local index,
+ * so this only decrypts files that other devices have added.
  */
 std::list<std::string>
 pluginDataKeys(const Account &account, const std::string &plugin);
@@ -43,13 +52,29 @@ Status
 pluginDataGet(const Account &account, const std::string &plugin,
               const std::string &key, std::string &data);
 
+/**
+ * Retreives several items from the plugin key/value store at once.
+ * Keys that do not exist are left out of the result.
+ */
+Status
+pluginDataGetMany(const Account &account, const std::string &plugin,
+                  const std::vector<std::string> &keys, PluginDataMap &result);
+
 /**
  * Saves an item to the plugin key/value store.
+ * The disk write happens in the background.
  */
 Status
 pluginDataSet(const Account &account, const std::string &plugin,
               const std::string &key, const std::string &data);
 
+/**
+ * Saves several items to the plugin key/value store at once.
+ */
+Status
+pluginDataSetMany(const Account &account, const std::string &plugin,
+                  const PluginDataMap &items);
+
 /**
  * Deletes an item from the plugin key/value store.
  */
@@ -63,6 +88,13 @@ pluginDataRemove(const Account &account, const std::string &plugin,
 Status
 pluginDataClear(const Account &account, const std::string &plugin);
 
+/**
+ * Drops any cached plugin data that a sync has changed.
+ */
+void
+pluginDataReload(const Account &account,
+                 const std::vector<std::string> &changes);
+
 } // namespace abcd
 
 #endif
@@ -10,8 +10,10 @@
 #include "../json/JsonObject.hpp"
 #include "../login/Login.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/WriteQueue.hpp"
 #include <dirent.h>
 #include <string.h>
+#include <algorithm>
 
 namespace abcd {
 
@@ -26,7 +28,8 @@ struct WalletJson:
 
 WalletList::WalletList(const Account &account):
     account_(account),
-    dir_(account.dir() + "Wallets/")
+    dir_(account.dir() + "Wallets/"),
+    archived_(std::make_shared<ArchivedMap>())
 {}
 
 Status
@@ -40,6 +43,7 @@ WalletList::load()
                                      account_.dataKey()));
 
     // Step 2: scan the directory for new wallets:
+    writeQueueFlush(dir_).log();
     DIR *dir = opendir(dir_.c_str());
     if (!dir)
         return Status(); // No directory, so no wallets
@@ -64,6 +68,31 @@ WalletList::load()
     }
 
     closedir(dir);
+    archivedUpdate();
+    return Status();
+}
+
+Status
+WalletList::reload(const std::vector<std::string> &paths)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &path: paths)
+    {
+        const auto name = path.substr(std::min(path.size(), dir_.size()));
+        if (path.compare(0, dir_.size(), dir_) || !fileIsJson(name) ||
+                std::string::npos != name.find('/'))
+            continue;
+        const std::string id(name, 0, name.size() - 5);
+
+        JsonPtr json;
+        if (json.load(path, account_.dataKey()))
+            wallets_[id] = std::move(json);
+        else if (!fileExists(path))
+            wallets_.erase(id);
+    }
+
+    archivedUpdate();
     return Status();
 }
 
@@ -96,8 +125,32 @@ WalletList::reorder(const std::string &id, unsigned index)
         return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
 
     WalletJson json(wallet->second);
+    if (json.sortOk() && json_int_t(index) == json.sort())
+        return Status();
     ABC_CHECK(json.sortSet(index));
-    ABC_CHECK(json.save(path(id), account_.dataKey()));
+    ABC_CHECK(json.saveQueued(path(id), account_.dataKey()));
+    return Status();
+}
+
+Status
+WalletList::reorder(const std::vector<std::string> &ids)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Check everything first, so a bad id doesn't leave a half-sorted list:
+    for (const auto &id: ids)
+        if (wallets_.end() == wallets_.find(id))
+            return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
+
+    for (size_t i = 0; i < ids.size(); ++i)
+    {
+        WalletJson json(wallets_[ids[i]]);
+        if (json.sortOk() && json_int_t(i) == json.sort())
+            continue;
+        ABC_CHECK(json.sortSet(i));
+        ABC_CHECK(json.saveQueued(path(ids[i]), account_.dataKey()));
+    }
+
     return Status();
 }
 
@@ -113,6 +166,7 @@ WalletList::insert(const std::string &id, const JsonPtr &keys)
     // TODO: Don't add the wallet until the sync has finished!
     std::lock_guard<std::mutex> lock(mutex_);
     wallets_[id] = json;
+    archivedUpdate();
 
     return Status();
 }
@@ -126,6 +180,7 @@ WalletList::remove(const std::string &id)
     if (wallet == wallets_.end())
         return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
     wallets_.erase(wallet);
+    archivedUpdate();
 
     ABC_CHECK(fileDelete(path(id)));
 
@@ -148,32 +203,64 @@ WalletList::json(JsonPtr &result, const std::string &id) const
 Status
 WalletList::archived(bool &result, const std::string &id) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    const auto snapshot = archivedSnapshot();
 
-    auto wallet = wallets_.find(id);
-    if (wallet == wallets_.end())
+    auto wallet = snapshot->find(id);
+    if (wallet == snapshot->end())
         return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
 
-    WalletJson json(wallet->second);
-    result = json.archived();
+    result = wallet->second;
     return Status();
 }
 
+std::shared_ptr<const WalletList::ArchivedMap>
+WalletList::archivedSnapshot() const
+{
+    return std::atomic_load(&archived_);
+}
+
 Status
 WalletList::archivedSet(const std::string &id, bool archived)
+{
+    ArchivedMap changes;
+    changes[id] = archived;
+    return archivedSet(changes);
+}
+
+Status
+WalletList::archivedSet(const ArchivedMap &changes)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto wallet = wallets_.find(id);
-    if (wallet == wallets_.end())
-        return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
+    for (const auto &change: changes)
+        if (wallets_.end() == wallets_.find(change.first))
+            return ABC_ERROR(ABC_CC_InvalidWalletID, "No such wallet");
 
-    WalletJson json(wallet->second);
-    ABC_CHECK(json.archivedSet(archived));
-    ABC_CHECK(json.save(path(id), account_.dataKey()));
+    bool changed = false;
+    for (const auto &change: changes)
+    {
+        WalletJson json(wallets_[change.first]);
+        if (json.archivedOk() && change.second == json.archived())
+            continue;
+        ABC_CHECK(json.archivedSet(change.second));
+        ABC_CHECK(json.saveQueued(path(change.first), account_.dataKey()));
+        changed = true;
+    }
+
+    if (changed)
+        archivedUpdate();
     return Status();
 }
 
+void
+WalletList::archivedUpdate()
+{
+    auto out = std::make_shared<ArchivedMap>();
+    for (const auto &wallet: wallets_)
+        (*out)[wallet.first] = WalletJson(wallet.second).archived();
+    std::atomic_store(&archived_, std::shared_ptr<const ArchivedMap>(out));
+}
+
 std::string
 WalletList::path(const std::string &id) const
 {
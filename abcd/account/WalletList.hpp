@@ -11,7 +11,9 @@
 #include "../json/JsonPtr.hpp"
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace abcd {
 
@@ -19,12 +21,17 @@ class Account;
 
 /**
  * Manages the list of wallets stored under the account sync directory.
- * Uses a write-through caching scheme, where changes go straight to disk,
+ * Uses a write-behind caching scheme, where changes are queued for the disk,
  * but queries come out of RAM.
  */
 class WalletList
 {
 public:
+    /**
+     * The archived state of each wallet, by id.
+     */
+    typedef std::map<std::string, bool> ArchivedMap;
+
     WalletList(const Account &account);
 
     /**
@@ -34,6 +41,14 @@ public:
     Status
     load();
 
+    /**
+     * Re-reads just the given wallet files after a sync,
+     * ignoring any paths outside the wallet directory.
+     * Wallets whose files have gone away drop off the list.
+     */
+    Status
+    reload(const std::vector<std::string> &paths);
+
     /**
      * Obtains a sorted list of wallets.
      */
@@ -46,6 +61,13 @@ public:
     Status
     reorder(const std::string &id, unsigned index);
 
+    /**
+     * Sorts the listed wallets in the given order, in one step.
+     * Only wallets whose index actually changes get written.
+     */
+    Status
+    reorder(const std::vector<std::string> &ids);
+
     /**
      * Adds a new wallet to the account.
      */
@@ -67,22 +89,45 @@ public:
 
     /**
      * Returns the archived state for the given id.
+     * This does not take the list's lock.
      */
     Status
     archived(bool &result, const std::string &id) const;
 
+    /**
+     * Returns the archived state of every wallet, without locking.
+     * The snapshot never changes, so callers such as the sync scheduler
+     * can hold on to it for a whole pass.
+     */
+    std::shared_ptr<const ArchivedMap>
+    archivedSnapshot() const;
+
     /**
      * Adjusts the archived status of a wallet.
      */
     Status
     archivedSet(const std::string &id, bool archived);
 
+    /**
+     * Adjusts the archived status of several wallets in one step.
+     */
+    Status
+    archivedSet(const ArchivedMap &changes);
+
 private:
     mutable std::mutex mutex_;
     const Account &account_;
     const std::string dir_;
 
     std::map<std::string, JsonPtr> wallets_;
+    std::shared_ptr<const ArchivedMap> archived_;
+
+    /**
+     * Publishes a new archived snapshot.
+     * The caller must hold the mutex.
+     */
+    void
+    archivedUpdate();
 
     /**
      * Builds the path to a wallet file.
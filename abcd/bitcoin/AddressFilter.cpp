@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "AddressFilter.hpp"
+
+namespace abcd {
+
+// Sixteen bits and three probes per entry gives about 0.5% false hits:
+constexpr size_t bitsPerEntry = 16;
+constexpr unsigned probes = 3;
+
+void
+AddressFilter::clear()
+{
+    hashes_.clear();
+    bits_.clear();
+}
+
+void
+AddressFilter::insert(const std::string &address)
+{
+    const auto h = hash(address);
+    hashes_.push_back(h);
+    if (64 * bits_.size() < bitsPerEntry * hashes_.size())
+        rebuild();
+    else
+        set(h);
+}
+
+bool
+AddressFilter::mayContain(const std::string &address) const
+{
+    if (bits_.empty())
+        return false;
+
+    const auto h = hash(address);
+    const uint64_t mask = 64 * bits_.size() - 1;
+    const uint64_t step = (h >> 32) | 1;
+    uint64_t bit = h;
+    for (unsigned i = 0; i < probes; ++i, bit += step)
+    {
+        const auto n = bit & mask;
+        if (!(bits_[n / 64] & (uint64_t(1) << (n % 64))))
+            return false;
+    }
+    return true;
+}
+
+uint64_t
+AddressFilter::hash(const std::string &address)
+{
+    // 64-bit FNV-1a, which is plenty for base58 text:
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c: address)
+    {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void
+AddressFilter::rebuild()
+{
+    size_t words = 1;
+    while (64 * words < bitsPerEntry * hashes_.size())
+        words *= 2;
+
+    bits_.assign(hashes_.empty() ? 0 : words, 0);
+    for (auto h: hashes_)
+        set(h);
+}
+
+void
+AddressFilter::set(uint64_t h)
+{
+    const uint64_t mask = 64 * bits_.size() - 1;
+    const uint64_t step = (h >> 32) | 1;
+    uint64_t bit = h;
+    for (unsigned i = 0; i < probes; ++i, bit += step)
+    {
+        const auto n = bit & mask;
+        bits_[n / 64] |= uint64_t(1) << (n % 64);
+    }
+}
+
+} // namespace abcd
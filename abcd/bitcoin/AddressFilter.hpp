@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Quick rejection of addresses outside a wallet.
+ */
+
+#ifndef ABCD_BITCOIN_ADDRESS_FILTER_HPP
+#define ABCD_BITCOIN_ADDRESS_FILTER_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * A bloom filter over a set of addresses.
+ * `mayContain` never misses an inserted address,
+ * but lets through about one foreign address in 200,
+ * so callers still need the real set to confirm a hit.
+ *
+ * Most of the outputs in a wallet's history pay someone else,
+ * so this turns the usual lookup into a hash and a few bit tests.
+ * The filter keeps one 64-bit hash per entry, which lets it grow
+ * without going back to the addresses. This class has no locking of its own.
+ */
+class AddressFilter
+{
+public:
+    void
+    clear();
+
+    /**
+     * Adds an address. Adding the same address twice is harmless,
+     * but takes up another slot.
+     */
+    void
+    insert(const std::string &address);
+
+    /**
+     * Returns false if the address was definitely never inserted.
+     */
+    bool
+    mayContain(const std::string &address) const;
+
+    /**
+     * Replaces the contents with a whole collection of addresses.
+     */
+    template<typename C> void
+    assign(const C &addresses)
+    {
+        hashes_.clear();
+        hashes_.reserve(addresses.size());
+        for (const auto &address: addresses)
+            hashes_.push_back(hash(address));
+        rebuild();
+    }
+
+private:
+    std::vector<uint64_t> hashes_;
+    std::vector<uint64_t> bits_; // Always a power-of-two number of words
+
+    static uint64_t
+    hash(const std::string &address);
+
+    /**
+     * Sizes the bit array for the current entry count and refills it.
+     */
+    void
+    rebuild();
+
+    void
+    set(uint64_t h);
+};
+
+} // namespace abcd
+
+#endif
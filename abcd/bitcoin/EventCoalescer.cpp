@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "EventCoalescer.hpp"
+
+namespace abcd {
+
+constexpr std::chrono::milliseconds defaultInterval(500);
+
+EventCoalescer::EventCoalescer(std::chrono::milliseconds interval):
+    interval_(interval)
+{
+}
+
+void
+EventCoalescer::intervalSet(std::chrono::milliseconds interval)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    interval_ = interval;
+}
+
+void
+EventCoalescer::post(const std::string &wallet, tABC_AsyncEventType type,
+                     const std::string &txid, const Deliver &deliver)
+{
+    post(wallet, type, txid, deliver, std::chrono::steady_clock::now());
+}
+
+std::chrono::milliseconds
+EventCoalescer::flush()
+{
+    return flush(std::chrono::steady_clock::now());
+}
+
+void
+EventCoalescer::drop(const std::string &wallet)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    wallets_.erase(wallet);
+}
+
+void
+EventCoalescer::post(const std::string &wallet, tABC_AsyncEventType type,
+                     const std::string &txid, const Deliver &deliver,
+                     TimePoint now)
+{
+    Ready ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &events = wallets_[wallet];
+        auto &pending = events.pending[type];
+        if (!txid.empty())
+            pending.txids.insert(txid);
+        pending.deliver = deliver;
+
+        // A wallet that has been quiet gets its news right away:
+        if (events.lastDelivery + interval_ <= now)
+            take(ready, events, now);
+    }
+    EventCoalescer::deliver(ready);
+}
+
+std::chrono::milliseconds
+EventCoalescer::flush(TimePoint now)
+{
+    Ready ready;
+    std::chrono::milliseconds out(0);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &wallet: wallets_)
+        {
+            auto &events = wallet.second;
+            if (events.pending.empty())
+                continue;
+
+            const auto due = events.lastDelivery + interval_;
+            if (due <= now)
+            {
+                take(ready, events, now);
+                continue;
+            }
+
+            // Round up, since a zero sleep means forever:
+            const auto wait = std::chrono::duration_cast<
+                              std::chrono::milliseconds>(due - now) +
+                              std::chrono::milliseconds(1);
+            if (!out.count() || wait < out)
+                out = wait;
+        }
+    }
+    deliver(ready);
+    return out;
+}
+
+void
+EventCoalescer::take(Ready &ready, WalletEvents &events, TimePoint now)
+{
+    for (auto &pending: events.pending)
+        ready.push_back(std::move(pending));
+    events.pending.clear();
+    events.lastDelivery = now;
+}
+
+void
+EventCoalescer::deliver(Ready &ready)
+{
+    for (const auto &event: ready)
+        if (event.second.deliver)
+            event.second.deliver(event.first, event.second.txids);
+}
+
+EventCoalescer &
+eventCoalescer()
+{
+    static EventCoalescer coalescer(defaultInterval);
+    return coalescer;
+}
+
+} // namespace abcd
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Rate-limits watcher callbacks by merging bursts of events.
+ */
+
+#ifndef ABCD_BITCOIN_EVENT_COALESCER_HPP
+#define ABCD_BITCOIN_EVENT_COALESCER_HPP
+
+#include "../../src/ABC.h"
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace abcd {
+
+/**
+ * Merges bursts of wallet events into occasional deliveries.
+ * Each wallet gets at most one delivery per event type per interval.
+ * Events posted in between pile up, with their txids merged into a set,
+ * and go out together once the interval has passed.
+ */
+class EventCoalescer
+{
+public:
+    typedef std::set<std::string> TxidSet;
+    typedef std::function<void (tABC_AsyncEventType type,
+                                const TxidSet &txids)> Deliver;
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    EventCoalescer(std::chrono::milliseconds interval);
+
+    /**
+     * Sets the minimum time between deliveries to the same wallet.
+     * Zero delivers every event immediately.
+     */
+    void
+    intervalSet(std::chrono::milliseconds interval);
+
+    /**
+     * Queues an event, delivering it right away if the wallet
+     * has been quiet for long enough.
+     * @param txid the affected transaction, or empty for none.
+     * @param deliver sends the merged event. The latest one posted wins.
+     */
+    void
+    post(const std::string &wallet, tABC_AsyncEventType type,
+         const std::string &txid, const Deliver &deliver);
+
+    /**
+     * Delivers any events whose interval has run out.
+     * @return the time until the next delivery is due, or 0 if none are.
+     */
+    std::chrono::milliseconds
+    flush();
+
+    /**
+     * Throws away everything queued for a wallet.
+     */
+    void
+    drop(const std::string &wallet);
+
+    // Versions that take the current time, for testing:
+    void
+    post(const std::string &wallet, tABC_AsyncEventType type,
+         const std::string &txid, const Deliver &deliver, TimePoint now);
+
+    std::chrono::milliseconds
+    flush(TimePoint now);
+
+private:
+    struct Pending
+    {
+        TxidSet txids;
+        Deliver deliver;
+    };
+    struct WalletEvents
+    {
+        TimePoint lastDelivery;
+        std::map<tABC_AsyncEventType, Pending> pending;
+    };
+    typedef std::list<std::pair<tABC_AsyncEventType, Pending>> Ready;
+
+    std::mutex mutex_;
+    std::chrono::milliseconds interval_;
+    std::map<std::string, WalletEvents> wallets_;
+
+    /**
+     * Moves a wallet's events into the ready list.
+     */
+    static void
+    take(Ready &ready, WalletEvents &events, TimePoint now);
+
+    /**
+     * Runs the deliveries, which must happen outside the lock.
+     */
+    static void
+    deliver(Ready &ready);
+};
+
+/**
+ * The event coalescer shared by every watcher.
+ */
+EventCoalescer &
+eventCoalescer();
+
+} // namespace abcd
+
+#endif
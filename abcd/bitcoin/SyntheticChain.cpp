@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "SyntheticChain.hpp"
+#include "Testnet.hpp"
+#include "Utility.hpp"
+#include "spend/Outputs.hpp"
+#include "../crypto/Encoding.hpp"
+#include "../json/JsonArray.hpp"
+#include "../json/JsonObject.hpp"
+#include "../json/JsonSchema.hpp"
+#include <algorithm>
+#include <random>
+
+namespace abcd {
+
+constexpr uint32_t sequenceFinal = 0xffffffff;
+constexpr uint32_t sequenceReplaceable = 0xfffffffd;
+constexpr time_t genesisTime = 1231006505;
+
+struct SyntheticJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(SyntheticJson, JsonObject)
+
+    ABC_JSON_INTEGER(height, "height", 0)
+    ABC_JSON_VALUE(addresses, "addresses", JsonArray)
+    ABC_JSON_VALUE(txs, "txs", JsonArray)
+};
+
+struct SyntheticJsonRow
+{
+    std::string data;
+    json_int_t height = 0;
+};
+
+static const auto syntheticRowSchema = jsonSchema(
+        jsonField("data", &SyntheticJsonRow::data, jsonRequired),
+        jsonField("height", &SyntheticJsonRow::height));
+
+static std::string
+scriptAddress(const bc::script_type &script)
+{
+    bc::payment_address address;
+    return bc::extract(address, script) ? address.encoded() : "";
+}
+
+Status
+SyntheticChain::build(const std::vector<std::string> &addresses,
+                      const SyntheticParams &params)
+{
+    if (addresses.empty())
+        return ABC_ERROR(ABC_CC_Error, "No addresses to build a chain around");
+    if (!params.maxInputs || !params.maxOutputs)
+        return ABC_ERROR(ABC_CC_Error, "Transactions need inputs and outputs");
+    if (params.height < params.transactions / 2 + 1)
+        return ABC_ERROR(ABC_CC_Error, "The chain is too short to hold them");
+    clear(addresses, params.height);
+
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<double> chance(0, 1);
+    const auto pick = [&rng](size_t n)
+    {
+        return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    };
+    const auto randomHash = [&rng]()
+    {
+        bc::hash_digest out;
+        for (auto &byte: out)
+            byte = static_cast<uint8_t>(rng());
+        return out;
+    };
+
+    std::vector<bc::script_type> ours;
+    for (const auto &address: addresses)
+    {
+        bc::script_type script;
+        ABC_CHECK(outputScriptForAddress(script, address));
+        ours.push_back(script);
+    }
+    const auto theirs = [&]()
+    {
+        bc::short_hash hash;
+        const auto digest = randomHash();
+        std::copy(digest.begin(), digest.begin() + hash.size(), hash.begin());
+
+        bc::script_type script;
+        outputScriptForAddress(script,
+                               bc::payment_address(pubkeyVersion(), hash).encoded());
+        return script;
+    };
+
+    // Spread the confirmed transactions two to a block, ending at the tip:
+    const size_t total = params.transactions;
+    const size_t unconfirmed = total * params.unconfirmedRate;
+    const size_t confirmed = total - unconfirmed;
+    const size_t first = params.height - std::min(params.height - 1,
+                         confirmed / 2);
+
+    struct Coin
+    {
+        bc::output_point point;
+        uint64_t value;
+    };
+    std::vector<Coin> coins;
+
+    for (size_t i = 0; i < total; ++i)
+    {
+        bc::transaction_type tx;
+        tx.version = 1;
+        tx.locktime = 0;
+        const uint32_t sequence = chance(rng) < params.replaceByFeeRate ?
+                                  sequenceReplaceable : sequenceFinal;
+
+        if (!coins.empty() && chance(rng) < params.spendRate)
+        {
+            // Gather some of our coins:
+            const auto inputs = 1 + pick(std::min(params.maxInputs,
+                                                  coins.size()));
+            uint64_t totalIn = 0;
+            for (size_t j = 0; j < inputs; ++j)
+            {
+                const auto k = pick(coins.size());
+                totalIn += coins[k].value;
+                tx.inputs.push_back(bc::transaction_input_type
+                {
+                    coins[k].point, bc::script_type(), sequence
+                });
+                coins[k] = coins.back();
+                coins.pop_back();
+            }
+
+            // Pay some of it out, sending the rest back as change:
+            const uint64_t fee = 1000 + 150 * inputs;
+            const auto available = totalIn - std::min(totalIn, fee);
+            const auto outputs = 1 + pick(params.maxOutputs);
+            const auto payees = std::max<size_t>(1, outputs - 1);
+            const uint64_t paid = available * (0.1 + 0.8 * chance(rng));
+            for (size_t j = 0; j < payees; ++j)
+                tx.outputs.push_back(bc::transaction_output_type
+                {
+                    paid / payees, theirs()
+                });
+            if (1 < outputs)
+                tx.outputs.push_back(bc::transaction_output_type
+                {
+                    available - paid / payees * payees,
+                    ours[pick(ours.size())]
+                });
+        }
+        else
+        {
+            // Funds arrive from outside, alongside other payments:
+            const auto inputs = 1 + pick(params.maxInputs);
+            for (size_t j = 0; j < inputs; ++j)
+                tx.inputs.push_back(bc::transaction_input_type
+                {
+                    {randomHash(), static_cast<uint32_t>(pick(4))},
+                    bc::script_type(), sequence
+                });
+
+            const auto outputs = 1 + pick(params.maxOutputs);
+            tx.outputs.push_back(bc::transaction_output_type
+            {
+                10000 + pick(10000000), ours[pick(ours.size())]
+            });
+            for (size_t j = 1; j < outputs; ++j)
+                tx.outputs.push_back(bc::transaction_output_type
+                {
+                    10000 + pick(100000000), theirs()
+                });
+        }
+
+        // Our new outputs become spendable coins:
+        const auto hash = bc::hash_transaction(tx);
+        for (uint32_t j = 0; j < tx.outputs.size(); ++j)
+            if (ours_.count(scriptAddress(tx.outputs[j].script)))
+                coins.push_back(Coin{{hash, j}, tx.outputs[j].value});
+
+        rowInsert(tx, i < confirmed ? std::min(first + i / 2, height_) : 0);
+    }
+
+    return Status();
+}
+
+Status
+SyntheticChain::load(const std::string &path)
+{
+    SyntheticJson json;
+    ABC_CHECK(json.load(path));
+
+    std::vector<std::string> addresses;
+    auto addressesJson = json.addresses();
+    for (size_t i = 0; i < addressesJson.size(); ++i)
+    {
+        const auto item = addressesJson[i].get();
+        if (json_is_string(item))
+            addresses.push_back(json_string_value(item));
+    }
+    clear(addresses, json.height());
+
+    auto txsJson = json.txs();
+    for (size_t i = 0; i < txsJson.size(); ++i)
+    {
+        SyntheticJsonRow row;
+        ABC_CHECK(syntheticRowSchema.decode(row, txsJson[i].get()));
+
+        DataChunk raw;
+        if (!base16Decode(raw, row.data))
+            return ABC_ERROR(ABC_CC_ParseError, "Bad transaction hex");
+        bc::transaction_type tx;
+        ABC_CHECK(decodeTx(tx, raw));
+        rowInsert(tx, row.height);
+    }
+
+    return Status();
+}
+
+Status
+SyntheticChain::save(const std::string &path) const
+{
+    JsonArray addressesJson;
+    for (const auto &address: addresses_)
+        ABC_CHECK(addressesJson.append(json_string(address.c_str())));
+
+    JsonArray txsJson;
+    for (const auto &txid: order_)
+    {
+        const auto &row = rows_.at(txid);
+        DataChunk raw(satoshi_raw_size(row.tx));
+        bc::satoshi_save(row.tx, raw.begin());
+
+        SyntheticJsonRow rowOut;
+        rowOut.data = base16Encode(raw);
+        rowOut.height = row.height;
+
+        JsonPtr rowJson;
+        ABC_CHECK(syntheticRowSchema.encode(rowJson, rowOut));
+        ABC_CHECK(txsJson.append(rowJson));
+    }
+
+    SyntheticJson json;
+    ABC_CHECK(json.heightSet(height_));
+    ABC_CHECK(json.addressesSet(addressesJson));
+    ABC_CHECK(json.txsSet(txsJson));
+    ABC_CHECK(json.save(path));
+    return Status();
+}
+
+AddressHistory
+SyntheticChain::history(const std::string &address) const
+{
+    AddressHistory out;
+    const auto i = index_.find(address);
+    if (index_.end() != i)
+        for (const auto &txid: i->second)
+            out[txid] = rows_.at(txid).height;
+    return out;
+}
+
+std::string
+SyntheticChain::statusHash(const std::string &address) const
+{
+    const auto i = index_.find(address);
+    if (index_.end() == i)
+        return "";
+
+    std::string status;
+    for (const auto &txid: i->second)
+        status += txid + ":" + std::to_string(rows_.at(txid).height) + ":";
+    return base16Encode(bc::sha256_hash(DataSlice(
+                            reinterpret_cast<const uint8_t *>(status.data()),
+                            reinterpret_cast<const uint8_t *>(status.data()) +
+                            status.size())));
+}
+
+Status
+SyntheticChain::txData(DataChunk &result, const std::string &txid) const
+{
+    const auto i = rows_.find(txid);
+    if (rows_.end() == i)
+        return ABC_ERROR(ABC_CC_Synchronizing, "No such transaction " + txid);
+
+    result.resize(satoshi_raw_size(i->second.tx));
+    bc::satoshi_save(i->second.tx, result.begin());
+    return Status();
+}
+
+bc::block_header_type
+SyntheticChain::header(size_t height)
+{
+    const auto seed = bc::to_little_endian<uint64_t>(height);
+    const DataSlice seedSlice(seed.data(), seed.data() + seed.size());
+
+    bc::block_header_type out;
+    out.version = 2;
+    out.previous_block_hash = bc::sha256_hash(seedSlice);
+    out.merkle = bc::bitcoin_hash(seedSlice);
+    out.timestamp = genesisTime + 600 * height;
+    out.bits = 0x1d00ffff;
+    out.nonce = height;
+    return out;
+}
+
+void
+SyntheticChain::clear(const std::vector<std::string> &addresses, size_t height)
+{
+    height_ = height;
+    addresses_ = addresses;
+    ours_ = std::set<std::string>(addresses.begin(), addresses.end());
+    rows_.clear();
+    order_.clear();
+    index_.clear();
+}
+
+void
+SyntheticChain::rowInsert(const bc::transaction_type &tx, size_t height)
+{
+    const auto txid = bc::encode_hash(bc::hash_transaction(tx));
+    if (rows_.count(txid))
+        return;
+
+    Row row{tx, height, 0, 0};
+    std::set<std::string> touched;
+
+    // Inputs spending known outputs tell us the fee and our share:
+    bool inputsKnown = true;
+    int64_t totalIn = 0;
+    for (const auto &input: tx.inputs)
+    {
+        const auto i = rows_.find(bc::encode_hash(input.previous_output.hash));
+        if (rows_.end() == i ||
+                i->second.tx.outputs.size() <= input.previous_output.index)
+        {
+            inputsKnown = false;
+            continue;
+        }
+
+        const auto &output = i->second.tx.outputs[input.previous_output.index];
+        totalIn += output.value;
+        const auto address = scriptAddress(output.script);
+        if (ours_.count(address))
+        {
+            row.balance -= output.value;
+            touched.insert(address);
+        }
+    }
+
+    int64_t totalOut = 0;
+    for (const auto &output: tx.outputs)
+    {
+        totalOut += output.value;
+        const auto address = scriptAddress(output.script);
+        if (ours_.count(address))
+        {
+            row.balance += output.value;
+            touched.insert(address);
+        }
+    }
+    if (inputsKnown)
+        row.fee = totalIn - totalOut;
+
+    for (const auto &address: touched)
+        index_[address].push_back(txid);
+    rows_[txid] = row;
+    order_.push_back(txid);
+}
+
+} // namespace abcd
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Made-up blockchain data for exercising a wallet at scale.
+ */
+
+#ifndef ABCD_BITCOIN_SYNTHETIC_CHAIN_HPP
+#define ABCD_BITCOIN_SYNTHETIC_CHAIN_HPP
+
+#include "network/IBitcoinConnection.hpp"
+#include "../util/Data.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * Knobs for shaping the generated wallet history.
+ */
+struct SyntheticParams
+{
+    size_t transactions = 1000;
+    size_t maxInputs = 4;       // Fan-in
+    size_t maxOutputs = 4;      // Fan-out, including any change
+    double spendRate = 0.3;     // Share of transactions spending our funds
+    double unconfirmedRate = 0.02;
+    double replaceByFeeRate = 0.01;
+    size_t height = 450000;     // Chain tip
+    uint32_t seed = 1;
+};
+
+/**
+ * A deterministic wallet history, built around a list of addresses.
+ * The same addresses, parameters, and seed always give the same chain,
+ * and the chain can be saved to disk to replay it exactly.
+ *
+ * Spends draw on earlier outputs to our addresses, with change,
+ * but carry empty input scripts, since the generator has no keys.
+ * The unconfirmed transactions all come at the end of the history.
+ */
+class SyntheticChain
+{
+public:
+    struct Row
+    {
+        bc::transaction_type tx;
+        size_t height; // Zero if unconfirmed
+        int64_t balance; // Net effect on our addresses
+        int64_t fee;
+    };
+
+    /**
+     * Generates a new history paying to and from the given addresses.
+     */
+    Status
+    build(const std::vector<std::string> &addresses,
+          const SyntheticParams &params);
+
+    Status
+    load(const std::string &path);
+
+    Status
+    save(const std::string &path) const;
+
+    /**
+     * Adds a transaction, such as one broadcast by a client under test.
+     */
+    void
+    insert(const bc::transaction_type &tx, size_t height=0)
+    {
+        rowInsert(tx, height);
+    }
+
+    // Queries ------------------------------------------------------------
+
+    size_t
+    height() const { return height_; }
+
+    const std::vector<std::string> &
+    addresses() const { return addresses_; }
+
+    const std::map<std::string, Row> &
+    rows() const { return rows_; }
+
+    /**
+     * The transactions touching an address, with their heights.
+     */
+    AddressHistory
+    history(const std::string &address) const;
+
+    /**
+     * The Electrum-style status hash for an address,
+     * or a blank string if it has no history.
+     */
+    std::string
+    statusHash(const std::string &address) const;
+
+    /**
+     * Finds a raw transaction by its txid.
+     */
+    Status
+    txData(DataChunk &result, const std::string &txid) const;
+
+    /**
+     * Makes up a plausible block header, with one block every ten minutes.
+     */
+    static bc::block_header_type
+    header(size_t height);
+
+private:
+    size_t height_ = 0;
+    std::vector<std::string> addresses_;
+    std::set<std::string> ours_;
+    std::map<std::string, Row> rows_;
+    std::vector<std::string> order_; // Parents before children
+    std::map<std::string, std::vector<std::string>> index_;
+
+    void
+    clear(const std::vector<std::string> &addresses, size_t height);
+
+    /**
+     * Adds a transaction to the history,
+     * working out its balance and fee from the rows already there.
+     */
+    void
+    rowInsert(const bc::transaction_type &tx, size_t height);
+};
+
+} // namespace abcd
+
+#endif
@@ -12,9 +12,95 @@
 #include "../http/Uri.hpp"
 #include <bitcoin/bitcoin.hpp>
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 
 namespace abcd {
 
+// Base58check of a version byte, a 20-byte hash, and a 4-byte checksum:
+constexpr size_t addressSizeMin = 25;
+constexpr size_t addressSizeMax = 35;
+
+// Base58check of a version byte, a 32-byte secret, an optional
+// compression flag, and a 4-byte checksum:
+constexpr size_t wifSizeMin = 51;
+constexpr size_t wifSizeMax = 52;
+
+// Minikeys and hbits keys come in legacy and modern lengths:
+constexpr size_t minikeySizeShort = 22;
+constexpr size_t minikeySizeLong = 30;
+
+static bool
+isBase58(const char c)
+{
+    return
+        ('1' <= c && c <= '9') ||
+        ('A' <= c && c <= 'Z' && 'I' != c && 'O' != c) ||
+        ('a' <= c && c <= 'z' && 'l' != c);
+}
+
+static bool
+isAlnum(const char c)
+{
+    return
+        ('0' <= c && c <= '9') ||
+        ('A' <= c && c <= 'Z') ||
+        ('a' <= c && c <= 'z');
+}
+
+static bool
+isSchemeStart(const char c)
+{
+    return ('A' <= c && c <= 'Z') || ('a' <= c && c <= 'z');
+}
+
+static bool
+isScheme(const char c)
+{
+    return isAlnum(c) || '+' == c || '-' == c || '.' == c;
+}
+
+TextShape
+textShape(const std::string &text)
+{
+    TextShape out;
+    if (text.empty())
+        return out;
+
+    // One pass over the characters:
+    bool base58 = true;
+    bool alnum = true;
+    size_t colon = std::string::npos;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        const char c = text[i];
+        if (':' == c)
+        {
+            colon = i;
+            break;
+        }
+        base58 = base58 && isBase58(c);
+        alnum = alnum && isAlnum(c);
+    }
+
+    // Anything with a colon can only be a URI:
+    if (std::string::npos != colon)
+    {
+        out.uri = 0 < colon && isSchemeStart(text[0]) &&
+                  std::all_of(text.begin(), text.begin() + colon, isScheme);
+        return out;
+    }
+
+    const auto size = text.size();
+    out.address = base58 &&
+                  addressSizeMin <= size && size <= addressSizeMax;
+    out.wif = base58 && wifSizeMin <= size && size <= wifSizeMax;
+
+    const bool keySize = minikeySizeShort == size || minikeySizeLong == size;
+    out.minikey = alnum && keySize && 'S' == text[0];
+    out.hbits = alnum && keySize;
+    return out;
+}
+
 /**
  * Checks a bitcoin payment address for validity.
  */
@@ -31,7 +117,7 @@ static bool
 minikeyOk(const std::string &text)
 {
     // Legacy minikeys are 22 chars long
-    if (text.size() != 22 && text.size() != 30)
+    if (text.size() != minikeySizeShort && text.size() != minikeySizeLong)
         return false;
     return bc::sha256_hash(bc::to_data_chunk(text + "?"))[0] == 0x00;
 }
@@ -42,7 +128,7 @@ minikeyOk(const std::string &text)
 static Status
 hbitsOk(const std::string &text)
 {
-    if (text.size() != 22 && text.size() != 30)
+    if (text.size() != minikeySizeShort && text.size() != minikeySizeLong)
         return ABC_ERROR(ABC_CC_ParseError, "Wrong text length");
     if (0x00 != bc::sha256_hash(bc::to_data_chunk(text + "!"))[0])
         return ABC_ERROR(ABC_CC_ParseError, "Wrong text checksum");
@@ -80,50 +166,62 @@ hbitsDecode(bc::ec_secret &result, const std::string &text)
 Status
 parseUri(ParsedUri &result, const std::string &text)
 {
-    Uri uri;
+    const auto shape = textShape(text);
+    UriView uri;
 
-    if (uri.decode(text, false))
+    if (shape.uri && uri.decode(text, false))
     {
-        // Turn Airbitz URI's into bitcoin URI's:
-        if ("airbitz" == uri.scheme())
+        // Airbitz URI's are bitcoin URI's with a prefix:
+        const bool airbitz = uri.schemeIs("airbitz");
+        if (airbitz || uri.schemeIs("bitcoin"))
         {
-            uri.deauthorize();
-            auto path = uri.path();
-            if (0 != path.find("bitcoin/", 0))
-                return ABC_ERROR(ABC_CC_ParseError, "Unknown airbitz URI");
-            path.erase(0, 8);
-            uri.pathSet(path);
-            uri.schemeSet("bitcoin");
-        }
+            auto path = uri.opaquePath().unescape();
+            if (airbitz)
+            {
+                if (0 != path.find("bitcoin/", 0))
+                    return ABC_ERROR(ABC_CC_ParseError, "Unknown airbitz URI");
+                path.erase(0, 8);
+            }
+            if (addressOk(path))
+                result.address = path;
 
-        // Check the scheme:
-        if ("bitcoin" == uri.scheme())
-        {
-            uri.deauthorize();
-            if (addressOk(uri.path()))
-                result.address = uri.path();
-
-            auto query = uri.queryDecode();
-            bc::decode_base10(result.amountSatoshi, query["amount"], 8);
-            result.label = query["label"];
-            result.message = query["message"];
-            result.category = query["category"];
-            result.ret = query["ret"];
-            result.paymentProto = query["r"];
+            // Pick out the fields we know in one pass,
+            // letting later copies of a key win:
+            auto query = uri.queryIterator();
+            UriSlice key, value;
+            std::string amount;
+            while (query.next(key, value))
+            {
+                if (key.unescapedEquals("amount"))
+                    value.unescape(amount);
+                else if (key.unescapedEquals("label"))
+                    value.unescape(result.label);
+                else if (key.unescapedEquals("message"))
+                    value.unescape(result.message);
+                else if (key.unescapedEquals("category"))
+                    value.unescape(result.category);
+                else if (key.unescapedEquals("ret"))
+                    value.unescape(result.ret);
+                else if (key.unescapedEquals("r"))
+                    value.unescape(result.paymentProto);
+            }
+            bc::decode_base10(result.amountSatoshi, amount, 8);
         }
-        else if ("hbits" == uri.scheme())
+        else if (uri.schemeIs("hbits"))
         {
-            uri.deauthorize();
             bc::ec_secret secret;
-            ABC_CHECK(hbitsDecode(secret, uri.path()));
+            ABC_CHECK(hbitsDecode(secret, uri.opaquePath().unescape()));
             result.wif = bc::secret_to_wif(secret, true);
         }
-        else if ("bitid" == uri.scheme())
+        else if (uri.schemeIs("bitid"))
         {
             result.bitidUri = text;
 
             // Check for metadata requests:
-            const auto s = uri.queryDecode()["s"];
+            UriSlice slice;
+            std::string s;
+            if (uri.queryFind(slice, "s"))
+                slice.unescape(s);
             if (std::string::npos != s.find("a"))
                 result.bitidPaymentAddress = true;
             if (std::string::npos != s.find("i1"))
@@ -136,22 +234,22 @@ parseUri(ParsedUri &result, const std::string &text)
             return ABC_ERROR(ABC_CC_ParseError, "Unknown URI scheme");
         }
     }
-    else if (addressOk(text))
+    else if (shape.address && addressOk(text))
     {
         // This is a raw bitcoin address:
         result.address = text;
     }
-    else if (bc::null_hash != bc::wif_to_secret(text))
+    else if (shape.wif && bc::null_hash != bc::wif_to_secret(text))
     {
         // This is a raw WIF private key:
         result.wif = text;
     }
-    else if (minikeyOk(text))
+    else if (shape.minikey && minikeyOk(text))
     {
         // This is a raw Casascius minikey:
         result.wif = bc::secret_to_wif(bc::minikey_to_secret(text), false);
     }
-    else if (hbitsOk(text))
+    else if (shape.hbits && hbitsOk(text))
     {
         // This is a raw hbits key:
         bc::ec_secret secret;
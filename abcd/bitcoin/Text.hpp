@@ -40,8 +40,29 @@ struct ParsedUri
     bool bitidKycRequest = false;
 };
 
+/**
+ * The formats a scanned string could be in, judging only by its shape.
+ */
+struct TextShape
+{
+    bool uri = false;
+    bool address = false;
+    bool wif = false;
+    bool minikey = false;
+    bool hbits = false;
+};
+
+/**
+ * Looks at the length, prefix and characters of a string
+ * to rule out the formats it cannot be in.
+ * This runs no hashes, so it is cheap enough for every camera frame.
+ */
+TextShape
+textShape(const std::string &text);
+
 /**
  * Decodes a URI, bitcoin address, or private key.
+ * Only the decoders that `textShape` allows get to run.
  */
 Status
 parseUri(ParsedUri &result, const std::string &text);
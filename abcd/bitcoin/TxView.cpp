@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TxView.hpp"
+#include "Testnet.hpp"
+#include "Utility.hpp"
+
+namespace abcd {
+
+/**
+ * A bounds-checked cursor over the raw bytes.
+ * Reads past the end return zeros and clear the `ok` flag.
+ */
+struct TxReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    bool ok = true;
+
+    TxReader(DataSlice data):
+        p(data.begin()), end(data.end())
+    {}
+
+    bool
+    have(uint64_t size)
+    {
+        if (uint64_t(end - p) < size)
+            ok = false;
+        return ok;
+    }
+
+    uint64_t
+    fixed(unsigned size)
+    {
+        if (!have(size))
+            return 0;
+        uint64_t out = 0;
+        for (unsigned i = 0; i < size; ++i)
+            out |= uint64_t(p[i]) << (8 * i);
+        p += size;
+        return out;
+    }
+
+    uint64_t
+    varint()
+    {
+        const auto first = fixed(1);
+        if (first < 0xfd)
+            return first;
+        if (0xfd == first)
+            return fixed(2);
+        if (0xfe == first)
+            return fixed(4);
+        return fixed(8);
+    }
+
+    DataSlice
+    bytes(uint64_t size)
+    {
+        if (!have(size))
+            return DataSlice();
+        DataSlice out(p, p + size);
+        p += size;
+        return out;
+    }
+
+    /**
+     * Reads a length-prefixed script.
+     */
+    DataSlice
+    script()
+    {
+        return bytes(varint());
+    }
+};
+
+static void
+appendFixed(DataChunk &out, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; ++i)
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static void
+appendVarint(DataChunk &out, uint64_t value)
+{
+    if (value < 0xfd)
+    {
+        appendFixed(out, value, 1);
+    }
+    else if (value <= 0xffff)
+    {
+        out.push_back(0xfd);
+        appendFixed(out, value, 2);
+    }
+    else if (value <= 0xffffffff)
+    {
+        out.push_back(0xfe);
+        appendFixed(out, value, 4);
+    }
+    else
+    {
+        out.push_back(0xff);
+        appendFixed(out, value, 8);
+    }
+}
+
+// Past this many names, the cache starts over:
+constexpr size_t namesMax = 100000;
+
+static std::string
+hashAddress(uint8_t version, const uint8_t *hash, AddressNames *names)
+{
+    if (names)
+        return names->encode(version, hash);
+
+    bc::short_hash out;
+    std::copy(hash, hash + out.size(), out.begin());
+    return bc::payment_address(version, out).encoded();
+}
+
+const std::string &
+AddressNames::encode(uint8_t version, const uint8_t *hash)
+{
+    std::string key(1, static_cast<char>(version));
+    key.append(reinterpret_cast<const char *>(hash), sizeof(bc::short_hash));
+
+    auto i = names_.find(key);
+    if (names_.end() != i)
+        return i->second;
+
+    if (namesMax <= names_.size())
+        names_.clear();
+    return names_[key] = hashAddress(version, hash, nullptr);
+}
+
+/**
+ * Falls back on libbitcoin for the unusual script shapes.
+ */
+static std::string
+extractAddress(DataSlice script)
+{
+    try
+    {
+        bc::payment_address address;
+        const auto parsed = bc::parse_script(
+                                bc::data_chunk(script.begin(), script.end()));
+        return bc::extract(address, parsed) ? address.encoded() : "";
+    }
+    catch (bc::end_of_stream)
+    {
+        return "";
+    }
+}
+
+Status
+TxView::parse(DataSlice raw)
+{
+    TxReader reader(raw);
+    raw_ = raw;
+    inputs_.clear();
+    outputs_.clear();
+
+    version_ = reader.fixed(4);
+
+    // A zero marker and a one flag mean segwit,
+    // since real transactions never have zero inputs:
+    segwit_ = reader.have(2) && 0x00 == reader.p[0] && 0x01 == reader.p[1];
+    if (segwit_)
+        reader.fixed(2);
+
+    // Check the counts against the size, so a bad one can't blow up `resize`:
+    const auto inputCount = reader.varint();
+    if (raw.size() / 41 < inputCount)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad transaction format - too little data");
+    inputs_.resize(inputCount);
+    for (auto &input: inputs_)
+    {
+        const auto hash = reader.bytes(32);
+        std::copy(hash.begin(), hash.end(), input.point.hash.begin());
+        input.point.index = reader.fixed(4);
+        input.script = reader.script();
+        input.sequence = reader.fixed(4);
+    }
+
+    const auto outputCount = reader.varint();
+    if (raw.size() / 9 < outputCount)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad transaction format - too little data");
+    outputs_.resize(outputCount);
+    for (auto &output: outputs_)
+    {
+        output.value = reader.fixed(8);
+        output.script = reader.script();
+    }
+
+    // Each input has its own witness stack:
+    if (segwit_)
+    {
+        for (size_t i = 0; i < inputs_.size() && reader.ok; ++i)
+        {
+            const auto items = reader.varint();
+            for (uint64_t j = 0; j < items && reader.ok; ++j)
+                reader.script();
+        }
+    }
+
+    locktime_ = reader.fixed(4);
+
+    if (!reader.ok)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad transaction format - too little data");
+    return Status();
+}
+
+bc::hash_digest
+TxView::ntxid() const
+{
+    // The legacy serialization with blank input scripts,
+    // followed by the SIGHASH_ALL type code:
+    DataChunk data;
+    data.reserve(raw_.size());
+    appendFixed(data, version_, 4);
+    appendVarint(data, inputs_.size());
+    for (const auto &input: inputs_)
+    {
+        data.insert(data.end(), input.point.hash.begin(), input.point.hash.end());
+        appendFixed(data, input.point.index, 4);
+        appendVarint(data, 0);
+        appendFixed(data, input.sequence, 4);
+    }
+    appendVarint(data, outputs_.size());
+    for (const auto &output: outputs_)
+    {
+        appendFixed(data, output.value, 8);
+        appendVarint(data, output.script.size());
+        data.insert(data.end(), output.script.begin(), output.script.end());
+    }
+    appendFixed(data, locktime_, 4);
+    appendFixed(data, bc::sighash::all, 4);
+
+    return bc::bitcoin_hash(data);
+}
+
+bool
+TxView::isReplaceByFee() const
+{
+    for (const auto &input: inputs_)
+        if (input.sequence < 0xffffffff - 1)
+            return true;
+    return false;
+}
+
+Status
+TxView::tx(bc::transaction_type &result) const
+{
+    return decodeTx(result, raw_);
+}
+
+std::string
+inputScriptAddress(DataSlice script, AddressNames *names)
+{
+    // <signature> <pubkey> spends a pubkey hash,
+    // with the signature being a DER blob plus a type byte:
+    const auto *p = script.begin();
+    const auto size = script.size();
+    if (10 <= size && 9 <= p[0] && p[0] <= 73 && p[0] + 2u < size)
+    {
+        const auto *key = p + p[0] + 1;
+        const size_t keySize = key[0];
+        const bool compressed = 33 == keySize && (2 == key[1] || 3 == key[1]);
+        const bool full = 65 == keySize && 4 == key[1];
+        if ((compressed || full) && key + 1 + keySize == script.end())
+        {
+            const auto hash = bc::bitcoin_short_hash(
+                                  bc::data_slice(key + 1, key + 1 + keySize));
+            return hashAddress(pubkeyVersion(), hash.data(), names);
+        }
+    }
+
+    return extractAddress(script);
+}
+
+std::string
+outputScriptAddress(DataSlice script, AddressNames *names)
+{
+    const auto *p = script.begin();
+
+    // OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY OP_CHECKSIG:
+    if (25 == script.size() && 0x76 == p[0] && 0xa9 == p[1] && 20 == p[2] &&
+            0x88 == p[23] && 0xac == p[24])
+        return hashAddress(pubkeyVersion(), p + 3, names);
+
+    // OP_HASH160 <hash> OP_EQUAL:
+    if (23 == script.size() && 0xa9 == p[0] && 20 == p[1] && 0x87 == p[22])
+        return hashAddress(scriptVersion(), p + 2, names);
+
+    return extractAddress(script);
+}
+
+} // namespace abcd
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Read-only access to a serialized transaction.
+ */
+
+#ifndef ABCD_BITCOIN_TX_VIEW_HPP
+#define ABCD_BITCOIN_TX_VIEW_HPP
+
+#include "../util/Data.hpp"
+#include "../util/Status.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * Indexes the fields of a raw transaction in one pass,
+ * without copying any scripts out of the buffer.
+ * The buffer must outlive the view.
+ *
+ * This covers everything the transaction cache needs to build its rows,
+ * so only callers that really need a `bc::transaction_type`,
+ * such as the signing code, pay for the full decode.
+ */
+class TxView
+{
+public:
+    struct Input
+    {
+        bc::output_point point;
+        DataSlice script;
+        uint32_t sequence;
+    };
+
+    struct Output
+    {
+        uint64_t value;
+        DataSlice script;
+    };
+
+    /**
+     * Indexes a raw transaction, in either the legacy or segwit format.
+     */
+    Status
+    parse(DataSlice raw);
+
+    DataSlice
+    raw() const { return raw_; }
+
+    bool
+    segwit() const { return segwit_; }
+
+    const std::vector<Input> &
+    inputs() const { return inputs_; }
+
+    const std::vector<Output> &
+    outputs() const { return outputs_; }
+
+    /**
+     * Calculates the non-malleable id, like `makeNtxid`.
+     */
+    bc::hash_digest
+    ntxid() const;
+
+    /**
+     * Returns true if the transaction opts in to RBF semantics,
+     * like `isReplaceByFee`.
+     */
+    bool
+    isReplaceByFee() const;
+
+    /**
+     * Builds the full libbitcoin object, for callers that need one.
+     */
+    Status
+    tx(bc::transaction_type &result) const;
+
+private:
+    DataSlice raw_;
+    bool segwit_ = false;
+    uint32_t version_ = 0;
+    uint32_t locktime_ = 0;
+    std::vector<Input> inputs_;
+    std::vector<Output> outputs_;
+};
+
+/**
+ * Remembers the base58 names of recently-seen hashes.
+ * A wallet's history keeps paying to and from the same few addresses,
+ * so this skips most of the checksum hashing and base conversion.
+ * This class has no locking of its own.
+ */
+class AddressNames
+{
+public:
+    const std::string &
+    encode(uint8_t version, const uint8_t *hash);
+
+    void
+    clear() { names_.clear(); }
+
+private:
+    std::unordered_map<std::string, std::string> names_;
+};
+
+/**
+ * Finds the address an input script spends from,
+ * or returns a blank string if the script is non-standard.
+ * This gives the same answers as `bc::extract`, but handles
+ * the common script shapes without parsing them into operations.
+ */
+std::string
+inputScriptAddress(DataSlice script, AddressNames *names=nullptr);
+
+/**
+ * Finds the address an output script pays to,
+ * or returns a blank string if the script is non-standard.
+ * P2PKH and P2SH outputs are read straight from the bytes.
+ */
+std::string
+outputScriptAddress(DataSlice script, AddressNames *names=nullptr);
+
+} // namespace abcd
+
+#endif
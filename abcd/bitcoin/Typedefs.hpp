@@ -14,6 +14,7 @@
 
 #include "../util/Status.hpp"
 #include <functional>
+#include <map>
 #include <set>
 #include <string>
 
@@ -28,6 +29,7 @@ namespace abcd {
 
 typedef std::set<std::string> AddressSet;
 typedef std::set<std::string> TxidSet;
+typedef std::map<std::string, size_t> TxidHeightMap; // Txid to block height
 
 typedef std::function<void(Status)> StatusCallback;
 
@@ -89,14 +89,17 @@ decodeTx(bc::transaction_type &result, bc::data_slice rawTx)
             out.outputs.push_back(output);
         }
 
-        // Read witnesses:
+        // Read witnesses, one stack per input:
         if (isSegwit)
         {
-            uint64_t witnessCount = deserial.read_variable_uint();
-            for (size_t i = 0; i < witnessCount; ++i)
+            for (size_t tx_in_i = 0; tx_in_i < tx_in_count; ++tx_in_i)
             {
-                uint64_t witnessSize = deserial.read_variable_uint();
-                deserial.read_data(witnessSize);
+                uint64_t witnessCount = deserial.read_variable_uint();
+                for (size_t i = 0; i < witnessCount; ++i)
+                {
+                    uint64_t witnessSize = deserial.read_variable_uint();
+                    deserial.read_data(witnessSize);
+                }
             }
         }
 
@@ -6,10 +6,16 @@
  */
 
 #include "Watcher.hpp"
+#include "EventCoalescer.hpp"
 #include "../util/Debug.hpp"
+#include "../util/Metrics.hpp"
 #include "../wallet/Wallet.hpp"
 #include <bitcoin/bitcoin.hpp>
-#include <sstream>
+#include <zmq.hpp>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <mutex>
 
 namespace abcd {
 
@@ -25,77 +31,111 @@ zmq::context_t &zmqContext()
     return *ctx;
 }
 
-using std::placeholders::_1;
-using std::placeholders::_2;
+Watcher::Watcher(Wallet &wallet):
+    txu_(wallet, zmqContext())
+{
+    pipeOpen();
+}
 
-static unsigned watcher_id = 0;
+Watcher::Watcher():
+    txu_(zmqContext())
+{
+    pipeOpen();
+}
 
-enum
+Watcher::~Watcher()
 {
-    msg_quit,
-    msg_wakeup,
-    msg_disconnect,
-    msg_connect,
-    msg_send
-};
+    if (0 <= wakeRead_)
+        close(wakeRead_);
+    if (0 <= wakeWrite_)
+        close(wakeWrite_);
+}
 
-Watcher::Watcher(Wallet &wallet):
-    socket_(zmqContext(), ZMQ_PAIR),
-    txu_(wallet, zmqContext())
+void
+Watcher::pipeOpen()
 {
-    std::stringstream name;
-    name << "inproc://watcher-" << watcher_id++;
-    socket_name_ = name.str();
-    socket_.bind(socket_name_.c_str());
-    int linger = 0;
-    socket_.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    int pipes[2];
+    if (pipe(pipes))
+    {
+        ABC_DebugLog("Watcher cannot create wakeup pipe: %s", strerror(errno));
+        return;
+    }
+    wakeRead_ = pipes[0];
+    wakeWrite_ = pipes[1];
+    fcntl(wakeRead_, F_SETFL, fcntl(wakeRead_, F_GETFL) | O_NONBLOCK);
+    fcntl(wakeWrite_, F_SETFL, fcntl(wakeWrite_, F_GETFL) | O_NONBLOCK);
 }
 
 void
-Watcher::sendWakeup()
+Watcher::post(Command command)
 {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
+    commands_.push(std::move(command));
 
-    uint8_t req = msg_wakeup;
-    socket_.send(&req, 1);
+    // One byte in the pipe is enough to wake the thread,
+    // which then drains everything in the queue:
+    if (!wakePending_.exchange(true))
+    {
+        const char c = 0;
+        if (write(wakeWrite_, &c, 1) < 0)
+            ; // A full pipe means the loop is already awake
+    }
 }
 
-void Watcher::disconnect()
+void
+Watcher::sendWakeup()
 {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
+    Command command;
+    command.type = Command::wakeup;
+    post(std::move(command));
+}
 
-    uint8_t req = msg_disconnect;
-    socket_.send(&req, 1);
+void Watcher::disconnect()
+{
+    Command command;
+    command.type = Command::disconnect;
+    post(std::move(command));
 }
 
 void Watcher::connect()
 {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
-
-    uint8_t req = msg_connect;
-    socket_.send(&req, 1);
+    Command command;
+    command.type = Command::connect;
+    post(std::move(command));
 }
 
 void
 Watcher::sendTx(StatusCallback status, DataSlice tx)
 {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
+    Command command;
+    command.type = Command::send;
+    command.status = std::move(status);
+    command.tx = DataChunk(tx.begin(), tx.end());
+    post(std::move(command));
+}
 
-    auto statusCopy = new StatusCallback(std::move(status));
-    auto statusInt = reinterpret_cast<uintptr_t>(statusCopy);
+void
+Watcher::walletAdd(Wallet &wallet)
+{
+    Command command;
+    command.type = Command::add;
+    command.wallet = wallet.shared_from_this();
+    post(std::move(command));
+}
 
-    auto data = buildData({bc::to_byte(msg_send),
-                           bc::to_little_endian(statusInt), tx
-                          });
-    socket_.send(data.data(), data.size());
+void
+Watcher::walletRemove(Wallet &wallet)
+{
+    Command command;
+    command.type = Command::remove;
+    command.walletId = wallet.id();
+    post(std::move(command));
 }
 
 void Watcher::stop()
 {
-    std::lock_guard<std::mutex> lock(socket_mutex_);
-
-    uint8_t req = msg_quit;
-    socket_.send(&req, 1);
+    Command command;
+    command.type = Command::quit;
+    post(std::move(command));
 
     // Log time to start logout
     ABC_DebugLog("Watcher::stop() %lu", this);
@@ -117,22 +157,34 @@ void throw_intr()
 
 void Watcher::loop()
 {
-    zmq::socket_t socket(zmqContext(), ZMQ_PAIR);
-    socket.connect(socket_name_.c_str());
-    int linger = 0;
-    socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    // How late the loop wakes up, compared to when it asked to:
+    static auto &lagTime = metricHistogram("watcher.lag_us");
+
+    // The poll list keeps its storage from one pass to the next:
+    std::vector<zmq_pollitem_t> items;
+    bool polled = false;
 
     bool done = false;
     while (!done)
     {
-        auto nextWakeup = txu_.wakeup();
+        // After a plain poll, only the connections that fired need service.
+        // Commands can change anything, so they get a full pass:
+        auto nextWakeup = polled ?
+                          txu_.wakeup(items.data() + 1, items.size() - 1) :
+                          txu_.wakeup();
+
+        // Deliver any merged events that have come due:
+        auto eventWakeup = eventCoalescer().flush();
+        if (eventWakeup.count() &&
+                (!nextWakeup.count() || eventWakeup < nextWakeup))
+            nextWakeup = eventWakeup;
         int delay = nextWakeup.count() ? nextWakeup.count() : -1;
 
-        std::vector<zmq_pollitem_t> items;
-        items.push_back(zmq_pollitem_t{ socket, 0, ZMQ_POLLIN, 0 });
-        auto txuItems = txu_.pollitems();
-        items.insert(items.end(), txuItems.begin(), txuItems.end());
+        items.clear();
+        items.push_back(zmq_pollitem_t{ nullptr, wakeRead_, ZMQ_POLLIN, 0 });
+        txu_.pollitems(items);
 
+        const auto pollStart = std::chrono::steady_clock::now();
         if (zmq_poll(items.data(), items.size(), delay) < 0)
             switch (errno)
             {
@@ -146,47 +198,66 @@ void Watcher::loop()
                 throw_intr();
                 break;
             }
+        polled = true;
+
+        if (0 <= delay)
+        {
+            const auto late = std::chrono::steady_clock::now() -
+                              (pollStart + std::chrono::milliseconds(delay));
+            if (late.count() >= 0)
+                lagTime.record(std::chrono::duration_cast<
+                               std::chrono::microseconds>(late).count());
+        }
 
         if (items[0].revents)
         {
-            zmq::message_t msg;
-            socket.recv(&msg);
-            if (!command(static_cast<uint8_t *>(msg.data()), msg.size()))
-                done = true;
+            // Clear the flag before draining the queue,
+            // so anything pushed after this point writes a fresh byte:
+            char buffer[64];
+            while (0 < read(wakeRead_, buffer, sizeof(buffer)))
+                ;
+            wakePending_ = false;
+
+            Command next;
+            while (!done && commands_.pop(next))
+                done = !command(next);
+            polled = false;
         }
     }
 }
 
-bool Watcher::command(uint8_t *data, size_t size)
+bool Watcher::command(Command &command)
 {
-    auto serial = bc::make_deserializer(data, data + size);
-    switch (serial.read_byte())
+    switch (command.type)
     {
     default:
-    case msg_quit:
+    case Command::quit:
         // Log time to finish watcher.
         ABC_DebugLog("Watcher Successfully Quit %lu", this);
         return false;
 
-    case msg_wakeup:
+    case Command::wakeup:
         return true;
 
-    case msg_disconnect:
+    case Command::disconnect:
         txu_.disconnect();
         return true;
 
-    case msg_connect:
+    case Command::connect:
         txu_.connect().log();
         return true;
 
-    case msg_send:
-    {
-        auto statusInt = serial.read_little_endian<uintptr_t>();
-        auto statusCopy = reinterpret_cast<StatusCallback *>(statusInt);
-        txu_.sendTx(*statusCopy, DataSlice(serial.iterator(), data + size));
-        delete statusCopy;
-    }
-    return true;
+    case Command::send:
+        txu_.sendTx(command.status, command.tx);
+        return true;
+
+    case Command::add:
+        txu_.walletAdd(command.wallet);
+        return true;
+
+    case Command::remove:
+        txu_.walletRemove(command.walletId);
+        return true;
     }
 }
 
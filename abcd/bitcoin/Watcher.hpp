@@ -9,9 +9,9 @@
 #define ABCD_BITCOIN_WATCHER_HPP
 
 #include "network/TxUpdater.hpp"
+#include "../util/MpscQueue.hpp"
 #include "../wallet/Wallet.hpp"
-#include <zmq.hpp>
-#include <mutex>
+#include <atomic>
 
 namespace abcd {
 
@@ -23,11 +23,21 @@ class Watcher
 public:
     Watcher(Wallet &wallet);
 
+    /**
+     * Creates the shared network engine,
+     * which syncs any number of wallets over one set of connections.
+     */
+    Watcher();
+
+    ~Watcher();
+
     // - Updater messages: -------------
     void sendWakeup();
     void disconnect();
     void connect();
     void sendTx(StatusCallback status, DataSlice tx);
+    void walletAdd(Wallet &wallet);
+    void walletRemove(Wallet &wallet);
 
     // - Thread implementation: --------
 
@@ -48,13 +58,39 @@ public:
     Watcher &operator=(const Watcher &copy) = delete;
 
 private:
-    // Socket for talking to the thread:
-    std::mutex socket_mutex_;
-    std::string socket_name_;
-    zmq::socket_t socket_;
+    /**
+     * A message for the thread.
+     */
+    struct Command
+    {
+        enum Type
+        {
+            quit,
+            wakeup,
+            disconnect,
+            connect,
+            send,
+            add,
+            remove
+        } type = wakeup;
+
+        StatusCallback status; // For `send`
+        DataChunk tx; // For `send`
+        std::shared_ptr<Wallet> wallet; // For `add`
+        std::string walletId; // For `remove`
+    };
+
+    // Queue for talking to the thread, along with a pipe to wake it:
+    MpscQueue<Command> commands_;
+    int wakeRead_ = -1;
+    int wakeWrite_ = -1;
+    std::atomic<bool> wakePending_{false}; // A byte is already in the pipe
+
+    void pipeOpen();
+    void post(Command command);
 
     // Everything below this point is only touched by the thread:
-    bool command(uint8_t *data, size_t size);
+    bool command(Command &command);
 
     // This needs to be constructed last, since it uses everything else:
     TxUpdater txu_;
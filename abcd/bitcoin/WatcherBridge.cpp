@@ -6,22 +6,42 @@
  */
 
 #include "WatcherBridge.hpp"
+#include "EventCoalescer.hpp"
 #include "Watcher.hpp"
 #include "cache/Cache.hpp"
 #include "spend/Sweep.hpp"
 #include "../Context.hpp"
+#include "../account/AccountSummary.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/TaskPool.hpp"
 #include "../wallet/Receive.hpp"
 #include "../wallet/Wallet.hpp"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 namespace abcd {
 
+/**
+ * The shared network engine, if the app is running one.
+ */
+static std::mutex engineMutex_;
+static std::shared_ptr<Watcher> engine_;
+static bool engineConnected_ = false;
+
+/**
+ * Prefetch passes that still leave transactions undated
+ * only wake the watcher on the 1st, 2nd, 4th, 8th... pass,
+ * and stop doing so entirely after this many.
+ */
+constexpr unsigned prefetchWakeupMax = 64;
+
 struct WatcherInfo
 {
 private:
@@ -29,19 +49,55 @@ private:
     std::shared_ptr<Wallet> parent_;
 
 public:
-    WatcherInfo(Wallet &wallet):
+    WatcherInfo(Wallet &wallet, std::shared_ptr<Watcher> engine):
         parent_(wallet.shared_from_this()),
-        watcher(wallet),
+        watcher(engine ? engine : std::make_shared<Watcher>(wallet)),
+        shared(!!engine),
         wallet(wallet)
     {
     }
 
-    Watcher watcher;
+    std::shared_ptr<Watcher> watcher;
+    const bool shared; // True if `watcher` is the shared engine
     Wallet &wallet;
-    std::map<std::string, std::string> sweeping; // address to key
+
+    /**
+     * Keys being swept together, along with the addresses
+     * whose histories have not finished loading yet.
+     */
+    struct SweepJob
+    {
+        KeyTable keys;
+        AddressSet waiting;
+    };
+    std::mutex sweepMutex;
+    std::map<std::string, std::shared_ptr<SweepJob>> sweeping; // By address
 
     tABC_BitCoin_Event_Callback fCallback;
     void *pData;
+
+    // The chain height the last height event went out for:
+    std::atomic<size_t> height{0};
+
+    // True while a background index refresh is waiting to start:
+    std::atomic<bool> prefetchQueued{false};
+
+    // Back-to-back prefetch passes that left transactions undated:
+    std::atomic<unsigned> prefetchMisses{0};
+
+    // Receives whose address bookkeeping is still to do:
+    std::mutex finishMutex;
+    std::list<TxInfo> finishing;
+
+    // Lets `bridgeWatcherStop` end a loop running on the shared engine:
+    std::mutex stopMutex;
+    std::condition_variable stopCondition;
+    bool stopped = false;
+
+    // The wallet's own view of the shared engine's connection,
+    // guarded by `engineMutex_`:
+    bool joined = false;
+    bool paused = false;
 };
 
 static std::mutex watchersMutex_;
@@ -63,8 +119,179 @@ listWatchers()
     return out;
 }
 
+/**
+ * Connects or disconnects the shared engine, so it stays online
+ * while any wallet on it still wants the network.
+ * The caller must hold `engineMutex_`.
+ */
+static void
+engineConnectionUpdate(Watcher &engine)
+{
+    size_t joined = 0;
+    size_t paused = 0;
+    for (const auto &watcher: watchers_)
+    {
+        const auto &info = *watcher.second;
+        if (!info.shared || !info.joined)
+            continue;
+        ++joined;
+        if (info.paused)
+            ++paused;
+    }
+
+    // With no wallets to ask, the engine stays the way it was:
+    if (!joined)
+        return;
+    const bool want = paused < joined;
+    if (want == engineConnected_)
+        return;
+
+    engineConnected_ = want;
+    if (want)
+        engine.connect();
+    else
+        engine.disconnect();
+}
+
+/**
+ * Records that a wallet started or stopped riding the shared engine.
+ */
+static void
+engineJoinedSet(WatcherInfo &info, bool joined)
+{
+    std::lock_guard<std::mutex> lock(watchersMutex_);
+    std::lock_guard<std::mutex> engineLock(engineMutex_);
+    info.joined = joined;
+    engineConnectionUpdate(*info.watcher);
+}
+
+/**
+ * Records one wallet's connect or disconnect request on the shared engine.
+ */
+static void
+enginePausedSet(WatcherInfo &info, bool paused)
+{
+    std::lock_guard<std::mutex> lock(watchersMutex_);
+    std::lock_guard<std::mutex> engineLock(engineMutex_);
+    info.paused = paused;
+    engineConnectionUpdate(*info.watcher);
+}
+
+/**
+ * Hands a merged event to the wallet's callback.
+ */
+static void
+bridgeDeliver(std::shared_ptr<WatcherInfo> watcherInfo,
+              tABC_AsyncEventType type, const EventCoalescer::TxidSet &txids)
+{
+    // Keep the launch-time summary in step with the balance:
+    if (ABC_AsyncEventType_BalanceUpdate == type ||
+            ABC_AsyncEventType_TransactionUpdate == type)
+        accountSummaryUpdate(watcherInfo->wallet).log();
+
+    if (!watcherInfo->fCallback)
+        return;
+
+    std::vector<const char *> list;
+    for (const auto &txid: txids)
+        list.push_back(txid.c_str());
+
+    ABC_DebugLog("Event %d callback: wallet %s, %d txids", type,
+                 watcherInfo->wallet.id().c_str(), list.size());
+    tABC_AsyncBitCoinInfo info;
+    info.pData = watcherInfo->pData;
+    info.eventType = type;
+    Status().toError(info.status, ABC_HERE());
+    info.szWalletUUID = watcherInfo->wallet.id().c_str();
+    info.szTxID = list.empty() ? nullptr : list[0];
+    info.sweepSatoshi = 0;
+    info.aszTxIDs = list.empty() ? nullptr : list.data();
+    info.countTxIDs = list.size();
+    watcherInfo->fCallback(&info);
+}
+
+/**
+ * Queues an event for the wallet, merging it with any others
+ * that arrive before the coalescing interval is up.
+ */
+static void
+bridgeQueue(std::shared_ptr<WatcherInfo> watcherInfo,
+            tABC_AsyncEventType type, const std::string &txid="")
+{
+    auto deliver = [watcherInfo](tABC_AsyncEventType type,
+                                 const EventCoalescer::TxidSet &txids)
+    {
+        bridgeDeliver(watcherInfo, type, txids);
+    };
+    eventCoalescer().post(watcherInfo->wallet.id(), type, txid, deliver);
+}
+
+/**
+ * Sits between `onReceive` and the wallet's callback.
+ * New money goes straight through, but balance updates get merged.
+ * The `pData` is a pointer to the wallet's `WatcherInfo` pointer.
+ */
+static void
+bridgeOnReceive(const tABC_AsyncBitCoinInfo *pInfo)
+{
+    const auto &watcherInfo =
+        *static_cast<std::shared_ptr<WatcherInfo> *>(pInfo->pData);
+
+    if (ABC_AsyncEventType_BalanceUpdate == pInfo->eventType)
+        return bridgeQueue(watcherInfo, pInfo->eventType, pInfo->szTxID);
+
+    if (watcherInfo->fCallback)
+    {
+        auto info = *pInfo;
+        info.pData = watcherInfo->pData;
+        info.aszTxIDs = &info.szTxID;
+        watcherInfo->fCallback(&info);
+    }
+}
+
+/**
+ * Refreshes the wallet's transaction index on the task pool,
+ * so the GUI's next history request is a plain read.
+ * Any block headers the history still lacks go out
+ * with the watcher's next batch of header requests.
+ * The same task first finishes off any pending receives.
+ */
+static void
+bridgePrefetch(std::shared_ptr<WatcherInfo> watcherInfo)
+{
+    if (watcherInfo->prefetchQueued.exchange(true))
+        return;
+
+    taskPoolRun([watcherInfo]()
+    {
+        // Clear the flag first, so later changes trigger another pass:
+        watcherInfo->prefetchQueued = false;
+
+        std::list<TxInfo> finishing;
+        {
+            std::lock_guard<std::mutex> lock(watcherInfo->finishMutex);
+            finishing.swap(watcherInfo->finishing);
+        }
+        for (const auto &info: finishing)
+            onReceiveFinish(watcherInfo->wallet, info).log();
+
+        if (!watcherInfo->wallet.txIndex.prefetch())
+        {
+            watcherInfo->prefetchMisses = 0;
+            return;
+        }
+
+        // Some headers may never arrive, so back off:
+        const auto misses = ++watcherInfo->prefetchMisses;
+        if (misses <= prefetchWakeupMax && !(misses & (misses - 1)))
+            watcherInfo->watcher->sendWakeup();
+    });
+}
+
 /**
  * Tells all running watchers that height has changed.
+ * Each event lists the wallet's transactions whose confirmation count
+ * changed, so the app does not need to reload the whole history.
  * This is a temporary hack until we gain support for app-wide callbacks.
  */
 static void
@@ -72,19 +299,27 @@ onHeight(size_t height)
 {
     for (auto &watcher: listWatchers())
     {
-        if (watcher->fCallback)
+        if (!watcher->fCallback)
+            continue;
+
+        const auto before = watcher->height.exchange(height);
+        const auto txids = watcher->wallet.cache.txs.confirmationsChanged(
+                               before, height, confirmationsShallow);
+        const auto mine = watcher->wallet.cache.addresses.txidsSnapshot();
+
+        bool any = false;
+        for (const auto &txid: txids)
         {
-            ABC_DebugLog("BlockHeightChange callback: wallet %s",
-                         watcher->wallet.id().c_str());
-            tABC_AsyncBitCoinInfo info;
-            info.pData = watcher->pData;
-            info.eventType = ABC_AsyncEventType_BlockHeightChange;
-            Status().toError(info.status, ABC_HERE());
-            info.szWalletUUID = watcher->wallet.id().c_str();
-            info.szTxID = nullptr;
-            info.sweepSatoshi = 0;
-            watcher->fCallback(&info);
+            if (mine->count(txid))
+            {
+                bridgeQueue(watcher, ABC_AsyncEventType_BlockHeightChange, txid);
+                any = true;
+            }
         }
+
+        // The event still goes out with no txids, for the height display:
+        if (!any)
+            bridgeQueue(watcher, ABC_AsyncEventType_BlockHeightChange);
     }
 }
 
@@ -95,24 +330,17 @@ onHeight(size_t height)
 static void
 onHeader(void)
 {
+    // New headers can date transactions in any wallet:
+    for (auto &watcher: listWatchers())
+        bridgePrefetch(watcher);
+
     for (auto &watcher: listWatchers())
     {
         if (watcher->fCallback)
         {
-            ABC_DebugLog("BlockHeader callback: wallet %s",
-                         watcher->wallet.id().c_str());
-            tABC_AsyncBitCoinInfo info;
-            info.pData = watcher->pData;
-            info.eventType = ABC_AsyncEventType_TransactionUpdate;
-            Status().toError(info.status, ABC_HERE());
-            info.szWalletUUID = watcher->wallet.id().c_str();
-
-            // XXX Todo: Look up TxIDs that actually have a matching height and
-            // send a notification for each one OR send one notification with all
-            // affected TxIDs in a std::set.
-            info.szTxID = nullptr;
-            info.sweepSatoshi = 0;
-            watcher->fCallback(&info);
+            // XXX Todo: Look up TxIDs that actually have a matching height,
+            // and pass them along so they end up in the merged event.
+            bridgeQueue(watcher, ABC_AsyncEventType_TransactionUpdate);
 
             break;
         }
@@ -129,34 +357,34 @@ bridgeOnComplete(std::shared_ptr<WatcherInfo> watcherInfo,
 {
     auto &wallet = watcherInfo->wallet;
 
-    // If we are sweeping this address, do that now:
-    auto i = watcherInfo->sweeping.find(address);
-    if (watcherInfo->sweeping.end() != i)
+    // If we are sweeping this address, and it was the last one
+    // its group was waiting for, do that now:
+    std::shared_ptr<WatcherInfo::SweepJob> job;
     {
         // We need to do this first, since the actual send
         // triggers another `onComplete` callback for the sweep address:
-        auto sweep = *i;
-        watcherInfo->sweeping.erase(i);
-
-        sweepOnComplete(wallet, sweep.first, sweep.second, fCallback, pData);
+        std::lock_guard<std::mutex> lock(watcherInfo->sweepMutex);
+        auto i = watcherInfo->sweeping.find(address);
+        if (watcherInfo->sweeping.end() != i)
+        {
+            i->second->waiting.erase(address);
+            if (i->second->waiting.empty())
+                job = i->second;
+            watcherInfo->sweeping.erase(i);
+        }
     }
+    if (job)
+        sweepOnComplete(wallet, job->keys, fCallback, pData);
 
     // Send the AddressCheckDone callback if its time:
     const auto p = wallet.cache.addresses.progress();
     if (p.first == p.second)
     {
-        ABC_DebugLog("AddressCheckDone callback: wallet %s",
-                     wallet.id().c_str());
-        tABC_AsyncBitCoinInfo info;
-        info.pData = pData;
-        info.eventType = ABC_AsyncEventType_AddressCheckDone;
-        Status().toError(info.status, ABC_HERE());
-        info.szWalletUUID = wallet.id().c_str();
-        info.szTxID = nullptr;
-        info.sweepSatoshi = 0;
         wallet.cache.addressCheckDoneSet();
         wallet.cache.save();
-        fCallback(&info);
+        wallet.addresses.restoreDone();
+        bridgePrefetch(watcherInfo);
+        bridgeQueue(watcherInfo, ABC_AsyncEventType_AddressCheckDone);
     }
 }
 
@@ -176,13 +404,41 @@ watcherFind(std::shared_ptr<WatcherInfo> &result, const Wallet &self)
 Status
 bridgeSweepKey(Wallet &self, const std::string &wif,
                const std::string &address)
+{
+    KeyTable keys;
+    keys[address] = wif;
+    return bridgeSweepKeys(self, keys);
+}
+
+Status
+bridgeSweepKeys(Wallet &self, const KeyTable &keys)
 {
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    // Start the sweep:
-    watcherInfo->sweeping[address] = wif;
-    self.cache.addresses.insert(address, true);
+    // Register the whole group before any address can complete,
+    // leaving out keys that an earlier sweep is still waiting on:
+    auto job = std::make_shared<WatcherInfo::SweepJob>();
+    {
+        std::lock_guard<std::mutex> lock(watcherInfo->sweepMutex);
+        for (const auto &key: keys)
+        {
+            if (watcherInfo->sweeping.count(key.first))
+                continue;
+            job->keys.insert(key);
+            job->waiting.insert(key.first);
+        }
+        for (const auto &address: job->waiting)
+            watcherInfo->sweeping[address] = job;
+    }
+    if (job->keys.empty())
+        return Status();
+
+    // Start the sweep, checking every address at once:
+    const auto addresses = job->waiting;
+    for (const auto &address: addresses)
+        self.cache.addresses.insert(address, true);
+    self.cache.addresses.prioritize(addresses);
 
     return Status();
 }
@@ -195,7 +451,10 @@ bridgeWatcherStart(Wallet &self)
         return ABC_ERROR(ABC_CC_Error,
                          "Watcher already exists for " + self.id());
 
-    watchers_[self.id()].reset(new WatcherInfo(self));
+    // The engine's connections can only follow one server list:
+    std::lock_guard<std::mutex> engineLock(engineMutex_);
+    const auto engine = self.bOverrideBitcoinServers ? nullptr : engine_;
+    watchers_[self.id()].reset(new WatcherInfo(self, engine));
 
     return Status();
 }
@@ -211,13 +470,14 @@ bridgeWatcherLoop(Wallet &self,
     // Set up new-block callback:
     watcherInfo->fCallback = fCallback;
     watcherInfo->pData = pData;
+    watcherInfo->height = gContext->blockCache.height();
     gContext->blockCache.onHeightSet(onHeight);
     gContext->blockCache.onHeaderSet(onHeader);
 
     // Set up the address-changed callback:
     auto wakeupCallback = [watcherInfo]()
     {
-        watcherInfo->watcher.sendWakeup();
+        watcherInfo->watcher->sendWakeup();
     };
     self.cache.addresses.wakeupCallbackSet(wakeupCallback);
 
@@ -230,8 +490,16 @@ bridgeWatcherLoop(Wallet &self,
         ABC_DebugLog("**************************************************************\n");
 
         TxInfo info;
+        auto receiveData = watcherInfo;
         if (watcherInfo->wallet.cache.txs.info(info, txid).log())
-            onReceive(watcherInfo->wallet, info, fCallback, pData).log();
+        {
+            onReceive(watcherInfo->wallet, info, bridgeOnReceive,
+                      &receiveData).log();
+
+            std::lock_guard<std::mutex> lock(watcherInfo->finishMutex);
+            watcherInfo->finishing.push_back(info);
+        }
+        bridgePrefetch(watcherInfo);
     };
     self.cache.addresses.onTxSet(onTx);
 
@@ -244,9 +512,28 @@ bridgeWatcherLoop(Wallet &self,
     self.cache.addresses.onCompleteSet(onComplete);
 
     // Do the loop:
-    watcherInfo->watcher.loop();
+    if (watcherInfo->shared)
+    {
+        // The engine thread does the work, so just wait for the stop:
+        watcherInfo->watcher->walletAdd(self);
+        engineJoinedSet(*watcherInfo, true);
+        {
+            std::unique_lock<std::mutex> lock(watcherInfo->stopMutex);
+            watcherInfo->stopCondition.wait(lock, [watcherInfo]()
+            {
+                return watcherInfo->stopped;
+            });
+        }
+        engineJoinedSet(*watcherInfo, false);
+        watcherInfo->watcher->walletRemove(self);
+    }
+    else
+    {
+        watcherInfo->watcher->loop();
+    }
 
     // Cancel all callbacks:
+    eventCoalescer().drop(self.id());
     self.cache.addresses.wakeupCallbackSet(nullptr);
     self.cache.addresses.onTxSet(nullptr);
     self.cache.addresses.onCompleteSet(nullptr);
@@ -262,18 +549,27 @@ bridgeWatcherConnect(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.connect();
+    if (watcherInfo->shared)
+        enginePausedSet(*watcherInfo, false);
+    else
+        watcherInfo->watcher->connect();
 
     return Status();
 }
 
+void
+bridgeWatcherActiveSet(Wallet &self)
+{
+    txUpdaterActiveSet(self.id());
+}
+
 Status
 watcherSend(Wallet &self, StatusCallback status, DataSlice tx)
 {
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.sendTx(status, tx);
+    watcherInfo->watcher->sendTx(status, tx);
 
     return Status();
 }
@@ -284,7 +580,10 @@ bridgeWatcherDisconnect(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.disconnect();
+    if (watcherInfo->shared)
+        enginePausedSet(*watcherInfo, true);
+    else
+        watcherInfo->watcher->disconnect();
 
     return Status();
 }
@@ -295,7 +594,16 @@ bridgeWatcherStop(Wallet &self)
     std::shared_ptr<WatcherInfo> watcherInfo;
     ABC_CHECK(watcherFind(watcherInfo, self));
 
-    watcherInfo->watcher.stop();
+    if (watcherInfo->shared)
+    {
+        std::lock_guard<std::mutex> lock(watcherInfo->stopMutex);
+        watcherInfo->stopped = true;
+        watcherInfo->stopCondition.notify_all();
+    }
+    else
+    {
+        watcherInfo->watcher->stop();
+    }
 
     return Status();
 }
@@ -311,4 +619,41 @@ bridgeWatcherDelete(Wallet &self)
     return Status();
 }
 
+Status
+bridgeEngineLoop()
+{
+    std::shared_ptr<Watcher> engine;
+    {
+        std::lock_guard<std::mutex> lock(engineMutex_);
+        if (engine_)
+            return ABC_ERROR(ABC_CC_Error, "The shared watcher is already running");
+        engine_ = engine = std::make_shared<Watcher>();
+        engineConnected_ = true;
+    }
+
+    engine->connect();
+    engine->loop();
+
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    engine_.reset();
+    return Status();
+}
+
+void
+bridgeEventIntervalSet(std::chrono::milliseconds interval)
+{
+    eventCoalescer().intervalSet(interval);
+}
+
+Status
+bridgeEngineStop()
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    if (!engine_)
+        return ABC_ERROR(ABC_CC_Error, "The shared watcher is not running");
+
+    engine_->stop();
+    return Status();
+}
+
 } // namespace abcd
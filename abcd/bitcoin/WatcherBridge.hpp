@@ -18,7 +18,9 @@
 #define ABC_Bridge_h
 
 #include "Typedefs.hpp"
+#include "spend/Inputs.hpp"
 #include "../util/Data.hpp"
+#include <chrono>
 
 namespace abcd {
 
@@ -28,6 +30,15 @@ Status
 bridgeSweepKey(Wallet &self, const std::string &wif,
                const std::string &address);
 
+/**
+ * Sweeps a group of keys into the wallet with one transaction.
+ * Every address gets checked at once, and the transaction goes out
+ * when the last history has loaded.
+ * @param keys a map from addresses to their WIF keys.
+ */
+Status
+bridgeSweepKeys(Wallet &self, const KeyTable &keys);
+
 Status
 bridgeWatcherStart(Wallet &self);
 
@@ -39,6 +50,13 @@ bridgeWatcherLoop(Wallet &self,
 Status
 bridgeWatcherConnect(Wallet &self);
 
+/**
+ * Gives this wallet's watcher first pick of the network connections,
+ * since the user is looking at it.
+ */
+void
+bridgeWatcherActiveSet(Wallet &self);
+
 Status
 bridgeWatcherDisconnect(Wallet &self);
 
@@ -51,6 +69,23 @@ bridgeWatcherDelete(Wallet &self);
 Status
 watcherSend(Wallet &self, StatusCallback status, DataSlice rawTx);
 
+/**
+ * Runs the shared network engine until `bridgeEngineStop` is called.
+ * Watchers started while the engine is running share its connections
+ * rather than opening their own, and their loops just wait to be stopped.
+ */
+Status
+bridgeEngineLoop();
+
+Status
+bridgeEngineStop();
+
+/**
+ * Sets the minimum time between event callbacks for one wallet.
+ */
+void
+bridgeEventIntervalSet(std::chrono::milliseconds interval);
+
 } // namespace abcd
 
 #endif
@@ -9,12 +9,25 @@
 #include "TxCache.hpp"
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
+#include "../../json/JsonSchema.hpp"
 #include "../../util/Debug.hpp"
+#include <algorithm>
 
 namespace abcd {
 
-constexpr auto periodDefault = 20;
-constexpr auto periodPriority = 4;
+// Check periods, in seconds:
+constexpr time_t periodPriority = 4;
+constexpr time_t periodHot = 10;
+constexpr time_t periodDefault = 20;
+constexpr time_t periodCold = 60 * 60; // The back-off stops here
+
+// How long addresses stay in the faster tiers:
+constexpr time_t hotTime = 10 * 60;
+constexpr time_t warmTime = 24 * 60 * 60;
+constexpr unsigned quietChecksMax = 16;
+
+// Blocks to re-fetch below the newest known history, to catch re-orgs:
+constexpr size_t reorgDepth = 6;
 
 struct CacheJson:
     public JsonObject
@@ -24,21 +37,35 @@ struct CacheJson:
     ABC_JSON_VALUE(addresses, "addresses", JsonArray)
 };
 
-struct AddressJson:
-    public JsonObject
+struct AddressJsonRow
 {
-    ABC_JSON_CONSTRUCTORS(AddressJson, JsonObject)
-
-    ABC_JSON_STRING(address, "address", 0)
-    ABC_JSON_BOOLEAN(dirty, "dirty", false)
-    ABC_JSON_VALUE(txids, "txids", JsonArray)
-    ABC_JSON_INTEGER(lastCheck, "lastCheck", 0)
-    ABC_JSON_STRING(stratumHash, "stratumHash", 0)
+    std::string address;
+    bool dirty = false;
+    TxidSet txids;
+    time_t lastCheck = 0;
+    time_t lastActivity = 0;
+    unsigned quietChecks = 0;
+    std::string stratumHash;
+    std::string server;
 };
 
+static const auto addressSchema = jsonSchema(
+    jsonField("address", &AddressJsonRow::address, jsonRequired),
+    jsonField("dirty", &AddressJsonRow::dirty, jsonSkipEmpty),
+    jsonField("txids", &AddressJsonRow::txids),
+    jsonField("lastCheck", &AddressJsonRow::lastCheck),
+    jsonField("lastActivity", &AddressJsonRow::lastActivity, jsonSkipEmpty),
+    jsonField("quietChecks", &AddressJsonRow::quietChecks, jsonSkipEmpty),
+    jsonField("stratumHash", &AddressJsonRow::stratumHash, jsonSkipEmpty),
+    jsonField("server", &AddressJsonRow::server, jsonSkipEmpty));
+
 bool
 operator <(const AddressStatus &a, const AddressStatus &b)
 {
+    // Hotter addresses go first:
+    if (a.tier != b.tier)
+        return a.tier < b.tier;
+
     // A longer missing transaction list is more urgent (sorts lower):
     if (a.missingTxids.size() != b.missingTxids.size())
         return a.missingTxids.size() > b.missingTxids.size();
@@ -62,9 +89,17 @@ AddressCache::clear()
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
     priorityAddress_ = "";
+    priorityGroup_.clear();
+    txidRows_.clear();
     for (auto &row: rows_)
+    {
         row.second = AddressRow();
+        recheck_.insert(row.first);
+    }
+    scheduleRebuild();
     knownTxids_.clear();
+    knownChanged_ = true;
+    snapshotPublish();
 }
 
 Status
@@ -78,32 +113,28 @@ AddressCache::load(JsonObject &json)
     size_t size = arrayJson.size();
     for (size_t i = 0; i < size; i++)
     {
-        AddressJson addressJson(arrayJson[i]);
-        if (addressJson.addressOk())
+        AddressJsonRow addressJson;
+        if (addressSchema.decode(addressJson, json_array_get(arrayJson.get(), i)))
         {
-            auto address = addressJson.address();
+            const auto &address = addressJson.address;
             AddressRow row;
-
-            auto arrayJson = addressJson.txids();
-            size_t size = arrayJson.size();
-            for (size_t i = 0; i < size; i++)
-            {
-                auto stringJson = arrayJson[i];
-                if (json_is_string(stringJson.get()))
-                    row.insertTxid(json_string_value(stringJson.get()));
-            }
-
-            row.dirty = addressJson.dirty();
-            row.lastCheck = addressJson.lastCheck();
+            row.txids = std::move(addressJson.txids);
+            row.dirty = addressJson.dirty;
+            row.lastCheck = addressJson.lastCheck;
+            row.lastActivity = addressJson.lastActivity;
+            row.quietChecks = addressJson.quietChecks;
             if (now < nextCheck(address, row))
                 row.checkedOnce = true;
+            row.stratumHash = std::move(addressJson.stratumHash);
+            row.server = std::move(addressJson.server);
 
-            if (addressJson.stratumHashOk())
-                row.stratumHash = addressJson.stratumHash();
-
+            for (const auto &txid: row.txids)
+                txidRows_[txid].insert(address);
+            recheck_.insert(address);
             rows_[address] = row;
         }
     }
+    scheduleRebuild();
     updateInternal();
 
     return Status();
@@ -121,18 +152,18 @@ AddressCache::save(JsonObject &json)
         if (row.second.sweep)
             continue;
 
-        JsonArray txidsJson;
-        for (const auto &txid: row.second.txids)
-            ABC_CHECK(txidsJson.append(json_string(txid.c_str())));
-
-        AddressJson address;
-        ABC_CHECK(address.addressSet(row.first));
-        if (row.second.dirty)
-            ABC_CHECK(address.dirtySet(row.second.dirty));
-        ABC_CHECK(address.txidsSet(txidsJson));
-        ABC_CHECK(address.lastCheckSet(row.second.lastCheck));
-        if (!row.second.stratumHash.empty())
-            ABC_CHECK(address.stratumHashSet(row.second.stratumHash));
+        AddressJsonRow addressJson;
+        addressJson.address = row.first;
+        addressJson.dirty = row.second.dirty;
+        addressJson.txids = row.second.txids;
+        addressJson.lastCheck = row.second.lastCheck;
+        addressJson.lastActivity = row.second.lastActivity;
+        addressJson.quietChecks = row.second.quietChecks;
+        addressJson.stratumHash = row.second.stratumHash;
+        addressJson.server = row.second.server;
+
+        JsonPtr address;
+        ABC_CHECK(addressSchema.encode(address, addressJson));
         ABC_CHECK(addressesJson.append(address));
     }
     cacheJson.addressesSet(addressesJson);
@@ -140,48 +171,85 @@ AddressCache::save(JsonObject &json)
     return Status();
 }
 
-std::pair<size_t, size_t>
-AddressCache::progress() const
+size_t
+AddressCache::memoryUsed() const
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
-    size_t done = 0;
+    // Each txid is listed once in its row and once in the reverse index:
+    size_t out = 0;
     for (const auto &row: rows_)
-        if (row.second.checkedOnce && row.second.complete)
-            ++done;
+        out += sizeof(row) + row.first.capacity() +
+               row.second.txids.size() * 2 * (sizeof(std::string) + 64);
+    out += knownTxids_.size() * (sizeof(std::string) + 64);
+    return out;
+}
 
-    return std::pair<size_t, size_t>(done, rows_.size());
+std::pair<size_t, size_t>
+AddressCache::progress() const
+{
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return progressSnapshot_;
 }
 
-std::list<AddressStatus>
+std::vector<AddressStatus>
 AddressCache::statuses(time_t &sleep) const
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    std::list<AddressStatus> out;
+    std::vector<AddressStatus> out;
 
     time_t now = time(nullptr);
-    time_t nextCheck = now;
-    for (auto &row: rows_)
+
+    // Gather the rows with work to do:
+    AddressSet work = dirty_;
+    work.insert(incomplete_.begin(), incomplete_.end());
+    const auto due = schedule_.lower_bound(std::make_pair(now + 1, ""));
+    for (auto i = schedule_.begin(); due != i; ++i)
+        work.insert(i->second);
+
+    out.reserve(work.size());
+    for (const auto &address: work)
     {
-        const auto s = status(row.first, row.second, now);
+        auto s = status(address, rows_.find(address)->second, now);
         if (s.dirty || s.needsCheck || s.missingTxids.size())
             out.push_back(std::move(s));
-
-        if (now < s.nextCheck
-                && (s.nextCheck < nextCheck || now == nextCheck))
-            nextCheck = s.nextCheck;
     }
 
-    sleep = nextCheck - now;
-    out.sort();
+    sleep = schedule_.end() != due ? due->first - now : 0;
+    std::sort(out.begin(), out.end());
     return out;
 }
 
+bool
+AddressCache::statusFind(AddressStatus &result,
+                         const std::string &address) const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    const auto i = rows_.find(address);
+    if (rows_.end() == i)
+        return false;
+
+    result = status(address, i->second, time(nullptr));
+    return true;
+}
+
 TxidSet
 AddressCache::txids() const
 {
-    std::lock_guard<std::recursive_mutex> lock(mutex_);
-    return knownTxids_;
+    std::shared_ptr<const TxidSet> txids;
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex_);
+        txids = txidsSnapshot_;
+    }
+    return txids ? *txids : TxidSet();
+}
+
+std::shared_ptr<const TxidSet>
+AddressCache::txidsSnapshot() const
+{
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    return txidsSnapshot_;
 }
 
 void
@@ -193,6 +261,9 @@ AddressCache::insert(const std::string &address, bool sweep)
     {
         auto &row = rows_[address];
         row.sweep = sweep;
+        recheck_.insert(address);
+        scheduleUpdate(address, row);
+        snapshotPublish();
 
         if (wakeupCallback_)
             wakeupCallback_();
@@ -202,7 +273,9 @@ AddressCache::insert(const std::string &address, bool sweep)
         if (sweep)
         {
             // We are re-sweeping a key, so re-arm the callback:
-            rows_[address].knownComplete = false;
+            auto &row = rows_[address];
+            row.knownComplete = false;
+            scheduleUpdate(address, row);
             updateInternal();
         }
     }
@@ -213,12 +286,81 @@ AddressCache::prioritize(const std::string &address)
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
 
+    // Both the old and new addresses change their check period:
+    const auto old = priorityAddress_;
     priorityAddress_ = address;
+    for (const auto &changed: {old, address})
+    {
+        auto i = rows_.find(changed);
+        if (rows_.end() != i)
+            scheduleUpdate(i->first, i->second);
+    }
 
     if (wakeupCallback_)
         wakeupCallback_();
 }
 
+void
+AddressCache::prioritize(const AddressSet &addresses)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    for (const auto &address: addresses)
+    {
+        auto i = rows_.find(address);
+        if (rows_.end() == i || i->second.knownComplete)
+            continue;
+        priorityGroup_.insert(address);
+        scheduleUpdate(i->first, i->second);
+    }
+
+    if (wakeupCallback_)
+        wakeupCallback_();
+}
+
+void
+AddressCache::touch(const std::string &address)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    auto i = rows_.find(address);
+    if (rows_.end() == i)
+        return;
+    i->second.lastTouched = time(nullptr);
+    scheduleUpdate(i->first, i->second);
+
+    if (wakeupCallback_)
+        wakeupCallback_();
+}
+
+void
+AddressCache::expiredCheck(time_t now)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    TxidSet orphans;
+    for (const auto &txid: txCache_.expiredTake(now))
+    {
+        const auto i = txidRows_.find(txid);
+        if (txidRows_.end() == i)
+        {
+            orphans.insert(txid);
+            continue;
+        }
+
+        for (const auto &address: i->second)
+        {
+            auto row = rows_.find(address);
+            if (rows_.end() == row)
+                continue;
+            row->second.dirty = true;
+            scheduleUpdate(address, row->second);
+        }
+    }
+    if (!orphans.empty())
+        txCache_.dropMany(orphans, now);
+}
+
 void
 AddressCache::update()
 {
@@ -230,33 +372,65 @@ void
 AddressCache::update(const std::string &address, const TxidSet &txids)
 {
     std::lock_guard<std::recursive_mutex> lock(mutex_);
-    auto &row = rows_[address];
+    updateRows(std::map<std::string, TxidSet>{{address, txids}});
 
-    // Look for dropped txids:
-    TxidSet drops;
-    for (const auto &txid: row.txids)
+    // Fire callbacks:
+    updateInternal();
+}
+
+size_t
+AddressCache::historyHeight(const std::string &address) const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    auto i = rows_.find(address);
+    if (rows_.end() == i || !i->second.lastCheck)
+        return 0;
+
+    size_t newest = 0;
+    for (const auto &txid: i->second.txids)
     {
-        if (!txids.count(txid) && txCache_.drop(txid))
-        {
-            drops.insert(txid);
-            knownTxids_.erase(txid);
-        }
+        newest = std::max(newest, txCache_.height(txid));
     }
 
-    // Remove the dropped txids from all addresses:
-    for (const auto &txid: drops)
-        for (auto &row: rows_)
-            row.second.txids.erase(txid);
+    return reorgDepth < newest ? newest - reorgDepth : 0;
+}
+
+void
+AddressCache::updateFrom(const std::string &address, const TxidSet &txids,
+                         size_t fromHeight)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    updateRows(std::map<std::string, TxidSet>
+    {
+        {address, historyMerge(address, txids, fromHeight)}
+    });
 
-    // Look for new txids:
-    for (const auto &txid: txids)
-        if (!row.txids.count(txid))
-            row.insertTxid(txid);
+    // Fire callbacks:
+    updateInternal();
+}
+
+void
+AddressCache::historyApply(const std::vector<AddressHistoryUpdate> &updates)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
 
-    // Update timestamp:
-    row.dirty = false;
-    row.lastCheck = time(nullptr);
-    row.checkedOnce = true;
+    // Heights first, since the merge looks at them:
+    TxidHeightMap heights;
+    for (const auto &update: updates)
+        heights.insert(update.history.begin(), update.history.end());
+    txCache_.confirmedMany(heights);
+
+    std::map<std::string, TxidSet> lists;
+    for (const auto &update: updates)
+    {
+        TxidSet txids;
+        for (const auto &row: update.history)
+            txids.insert(row.first);
+        lists[update.address] =
+            historyMerge(update.address, txids, update.fromHeight);
+    }
+    updateRows(lists);
 
     // Fire callbacks:
     updateInternal();
@@ -271,7 +445,10 @@ AddressCache::updateSpend(TxInfo &info)
     {
         const auto i = rows_.find(io.address);
         if (rows_.end() != i)
-            i->second.insertTxid(info.txid);
+        {
+            txidInsert(i->first, i->second, info.txid);
+            scheduleUpdate(i->first, i->second);
+        }
     }
 
     // Fire callbacks:
@@ -285,7 +462,12 @@ AddressCache::updateSubscribe(const std::string &address)
     auto &row = rows_[address];
 
     if (row.checkedOnce)
-        row.lastCheck = time(nullptr);
+    {
+        const auto now = time(nullptr);
+        checked(row, false, now);
+        row.lastCheck = now;
+    }
+    scheduleUpdate(address, row);
 }
 
 std::string
@@ -313,14 +495,32 @@ AddressCache::updateStratumHash(const std::string &address,
         return true;
     auto &row = i->second;
 
+    // A changed hash means new activity, so stop backing off:
+    if (!row.stratumHash.empty() && !hash.empty() && hash != row.stratumHash)
+        checked(row, true, time(nullptr));
+
     row.dirty |= (row.stratumHash.empty() || hash != row.stratumHash);
     if (!hash.empty())
         row.stratumHash = hash;
-    if (!row.dirty)
+    const bool firstCheck = !row.dirty && !row.checkedOnce;
+    if (firstCheck)
         row.checkedOnce = true;
+    scheduleUpdate(address, row);
+    if (firstCheck)
+        snapshotPublish();
     return row.dirty;
 }
 
+void
+AddressCache::updateServer(const std::string &address, const std::string &uri)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+
+    auto i = rows_.find(address);
+    if (rows_.end() != i)
+        i->second.server = uri;
+}
+
 void
 AddressCache::wakeupCallbackSet(const Callback &callback)
 {
@@ -342,28 +542,225 @@ AddressCache::onCompleteSet(const CompleteCallback &onComplete)
     onComplete_ = onComplete;
 }
 
+bool
+AddressCache::isPriority(const std::string &address) const
+{
+    return priorityAddress_ == address || priorityGroup_.count(address);
+}
+
+AddressTier
+AddressCache::tier(const std::string &address, const AddressRow &row,
+                   time_t now) const
+{
+    if (isPriority(address) || now < row.lastTouched + hotTime)
+        return AddressTier::hot;
+    if (now < row.lastActivity + warmTime)
+        return AddressTier::warm;
+    return AddressTier::cold;
+}
+
 time_t
 AddressCache::nextCheck(const std::string &address, const AddressRow &row) const
 {
+    if (isPriority(address))
+        return row.lastCheck + periodPriority;
+
     time_t period = periodDefault;
-    if (priorityAddress_ == address)
-        period = periodPriority;
+    switch (tier(address, row, time(nullptr)))
+    {
+    case AddressTier::hot:
+        period = periodHot;
+        break;
+    case AddressTier::warm:
+        break;
+    case AddressTier::cold:
+        // Double the period for each check that came back empty:
+        for (unsigned i = 0; i < row.quietChecks && period < periodCold; ++i)
+            period *= 2;
+        period = std::min(period, periodCold);
+        break;
+    }
 
     return row.lastCheck + period;
 }
 
+void
+AddressCache::checked(AddressRow &row, bool activity, time_t now)
+{
+    if (activity)
+    {
+        row.lastActivity = now;
+        row.quietChecks = 0;
+    }
+    else if (row.quietChecks < quietChecksMax)
+    {
+        ++row.quietChecks;
+    }
+}
+
+TxidSet
+AddressCache::historyMerge(const std::string &address, const TxidSet &txids,
+                           size_t fromHeight) const
+{
+    TxidSet out = txids;
+    auto i = rows_.find(address);
+    if (fromHeight && rows_.end() != i)
+    {
+        for (const auto &txid: i->second.txids)
+        {
+            const auto height = txCache_.height(txid);
+            if (height && height < fromHeight)
+                out.insert(txid);
+        }
+    }
+    return out;
+}
+
+void
+AddressCache::updateRows(const std::map<std::string, TxidSet> &lists)
+{
+    // Anything a row lost is a drop candidate,
+    // unless another row in the batch still lists it:
+    TxidSet keep;
+    for (const auto &list: lists)
+        keep.insert(list.second.begin(), list.second.end());
+    TxidSet candidates;
+    for (const auto &list: lists)
+    {
+        auto i = rows_.find(list.first);
+        if (rows_.end() == i)
+            continue;
+        for (const auto &txid: i->second.txids)
+            if (!keep.count(txid))
+                candidates.insert(txid);
+    }
+
+    // Remove the dropped txids from the addresses that list them:
+    AddressSet activity;
+    for (const auto &txid: txCache_.dropMany(candidates))
+    {
+        auto i = txidRows_.find(txid);
+        if (txidRows_.end() != i)
+            activity.insert(i->second.begin(), i->second.end());
+        txidErase(txid);
+        knownTxids_.erase(txid);
+        knownChanged_ = true;
+    }
+
+    const auto now = time(nullptr);
+    for (const auto &list: lists)
+    {
+        const auto &address = list.first;
+        auto &row = rows_[address];
+
+        // Look for new txids:
+        bool active = activity.count(address);
+        for (const auto &txid: list.second)
+        {
+            if (!row.txids.count(txid))
+            {
+                txidInsert(address, row, txid);
+                active = true;
+            }
+        }
+
+        // Update timestamp:
+        checked(row, active, now);
+        row.dirty = false;
+        row.lastCheck = now;
+        row.checkedOnce = true;
+        scheduleUpdate(address, row);
+    }
+}
+
+void
+AddressCache::txidInsert(const std::string &address, AddressRow &row,
+                         const std::string &txid)
+{
+    row.txids.insert(txid);
+    row.complete = false;
+    row.knownComplete = false;
+    txidRows_[txid].insert(address);
+    recheck_.insert(address);
+}
+
+void
+AddressCache::txidErase(const std::string &txid)
+{
+    auto i = txidRows_.find(txid);
+    if (txidRows_.end() == i)
+        return;
+
+    for (const auto &address: i->second)
+    {
+        auto row = rows_.find(address);
+        if (rows_.end() == row)
+            continue;
+        row->second.txids.erase(txid);
+        row->second.missing.erase(txid);
+        recheck_.insert(address);
+        scheduleUpdate(row->first, row->second);
+    }
+    txidRows_.erase(i);
+}
+
+void
+AddressCache::scheduleUpdate(const std::string &address,
+                              const AddressRow &row)
+{
+    auto i = scheduled_.find(address);
+    if (scheduled_.end() != i)
+        schedule_.erase(std::make_pair(i->second, address));
+    const auto check = nextCheck(address, row);
+    scheduled_[address] = check;
+    schedule_.insert(std::make_pair(check, address));
+
+    auto file = [&address](AddressSet &set, bool member)
+    {
+        if (member)
+            set.insert(address);
+        else
+            set.erase(address);
+    };
+    file(dirty_, row.dirty);
+    file(incomplete_, !row.complete);
+    file(unannounced_, !row.knownComplete);
+    file(unchecked_, !row.checkedOnce);
+}
+
+void
+AddressCache::scheduleRebuild()
+{
+    schedule_.clear();
+    scheduled_.clear();
+    dirty_.clear();
+    incomplete_.clear();
+    unannounced_.clear();
+    unchecked_.clear();
+    for (const auto &row: rows_)
+        scheduleUpdate(row.first, row.second);
+}
+
 AddressStatus
 AddressCache::status(const std::string &address, const AddressRow &row,
                      time_t now) const
 {
+    // The schedule and missing list are both kept current,
+    // so this never has to go back to the TxCache:
+    const auto check = scheduled_.find(address);
+
     AddressStatus out{address};
     out.dirty = row.dirty;
-    out.nextCheck = nextCheck(address, row);
+    out.nextCheck = scheduled_.end() != check ? check->second :
+                    nextCheck(address, row);
     out.needsCheck = out.nextCheck <= now;
     out.count = row.txids.size();
+    out.priority = isPriority(address) || row.sweep;
+    out.tier = tier(address, row, now);
 
     if (!row.complete)
-        out.missingTxids = txCache_.missingTxids(row.txids);
+        out.missingTxids = row.missing;
+    out.server = row.server;
 
     return out;
 }
@@ -371,23 +768,59 @@ AddressCache::status(const std::string &address, const AddressRow &row,
 void
 AddressCache::updateInternal()
 {
-    // Check for newly-completed transactions:
-    for (auto &row: rows_)
+    // Rows whose txids changed, or with nothing outstanding, need a full
+    // look, but the rest can only change once a missing txid turns up:
+    AddressSet visit = recheck_;
+    recheck_.clear();
+    TxidSet outstanding;
+    for (const auto &address: incomplete_)
+    {
+        const auto &row = rows_.find(address)->second;
+        if (row.missing.empty())
+            visit.insert(address);
+        else
+            outstanding.insert(row.missing.begin(), row.missing.end());
+    }
+    const auto stillMissing = txCache_.missingTxids(outstanding);
+    for (const auto &txid: outstanding)
     {
-        // Skip rows that are already complete:
-        if (row.second.complete)
+        if (stillMissing.count(txid))
             continue;
+        const auto i = txidRows_.find(txid);
+        if (txidRows_.end() != i)
+            visit.insert(i->second.begin(), i->second.end());
+    }
+
+    // Ask the TxCache about the rows to visit in one go:
+    TxidSet unknown;
+    for (const auto &address: visit)
+    {
+        const auto i = rows_.find(address);
+        if (rows_.end() != i)
+            for (const auto &txid: i->second.txids)
+                if (!knownTxids_.count(txid))
+                    unknown.insert(txid);
+    }
+    const auto missing = txCache_.missingTxids(unknown);
 
+    // Check for newly-completed transactions:
+    for (const auto &address: visit)
+    {
+        if (rows_.end() == rows_.find(address))
+            continue;
+        auto &row = *rows_.find(address);
         row.second.complete = true;
+        row.second.missing.clear();
         for (const auto &txid: row.second.txids)
         {
             // Skip transactions we already know about:
             if (knownTxids_.count(txid))
                 continue;
 
-            if (txCache_.missing(txid))
+            if (missing.count(txid))
             {
                 row.second.complete = false;
+                row.second.missing.insert(txid);
                 continue;
             }
 
@@ -395,23 +828,51 @@ AddressCache::updateInternal()
             if (!row.second.sweep)
             {
                 knownTxids_.insert(txid);
+                knownChanged_ = true;
                 if (onTx_)
                     onTx_(txid);
             }
         }
+        scheduleUpdate(row.first, row.second);
     }
 
     // Check for newly-completed addresses:
-    for (auto &row: rows_)
+    const auto unannounced = unannounced_;
+    for (const auto &address: unannounced)
     {
-        if (row.second.checkedOnce && row.second.complete
-                && !row.second.knownComplete)
+        auto &row = *rows_.find(address);
+        if (row.second.checkedOnce && row.second.complete)
         {
             row.second.knownComplete = true;
+            priorityGroup_.erase(row.first);
+            scheduleUpdate(row.first, row.second);
             if (onComplete_)
                 onComplete_(row.first);
         }
     }
+
+    snapshotPublish();
+}
+
+void
+AddressCache::snapshotPublish()
+{
+    // Rows are done once they are both checked and complete:
+    size_t pending = incomplete_.size();
+    for (const auto &address: unchecked_)
+        if (!incomplete_.count(address))
+            ++pending;
+    const auto progress = std::make_pair(rows_.size() - pending, rows_.size());
+
+    std::shared_ptr<const TxidSet> txids;
+    if (knownChanged_)
+        txids = std::make_shared<const TxidSet>(knownTxids_);
+    knownChanged_ = false;
+
+    std::lock_guard<std::mutex> lock(snapshotMutex_);
+    progressSnapshot_ = progress;
+    if (txids)
+        txidsSnapshot_ = txids;
 }
 
 } // namespace abcd
@@ -12,7 +12,10 @@
 #include "../../util/Status.hpp"
 #include <time.h>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <vector>
 
 namespace abcd {
 
@@ -20,6 +23,19 @@ class JsonObject;
 class TxCache;
 struct TxInfo;
 
+/**
+ * How closely an address is being watched.
+ */
+enum class AddressTier
+{
+    /** Just handed out to the user. */
+    hot,
+    /** Saw activity recently. */
+    warm,
+    /** Long unused, so each quiet check pushes the next one further out. */
+    cold
+};
+
 /**
  * Status of an address that needs work.
  */
@@ -40,8 +56,28 @@ struct AddressStatus
     /** The size of the known transaction list. */
     bool count;
 
+    /** True if the user is waiting on this address, such as a sweep. */
+    bool priority;
+
+    /** How closely to watch this address. Sorts before everything else. */
+    AddressTier tier;
+
     /** A list of transactions that are missing from the cache. */
     TxidSet missingTxids;
+
+    /** The server that last answered for this address, if any. */
+    std::string server;
+};
+
+/**
+ * An address history fetched from the network, ready to apply.
+ */
+struct AddressHistoryUpdate
+{
+    std::string address;
+    TxidHeightMap history;
+    /** The height the fetch started from, or zero for a full history. */
+    size_t fromHeight = 0;
 };
 
 /**
@@ -91,28 +127,52 @@ public:
     Status
     save(JsonObject &json);
 
+    /**
+     * Roughly how much heap the cache is holding, in bytes.
+     */
+    size_t
+    memoryUsed() const;
+
     // Queries -------------------------------------------------------------
 
     /**
      * Returns the number of completed addresses & total addresses.
+     * This reads a snapshot, so it never waits for updates to finish.
      */
     std::pair<size_t, size_t>
     progress() const;
 
     /**
      * Returns the status of all unsynced addresses.
+     * This only visits addresses that are dirty, incomplete, or due
+     * for a check, so it costs almost nothing when the wallet is idle.
      * @param sleep If there is no work to be performed,
      * the number of seconds until the next time work will be available.
      */
-    std::list<AddressStatus>
+    std::vector<AddressStatus>
     statuses(time_t &sleep) const;
 
+    /**
+     * Returns the status of one address, synced or not.
+     * @return false if the address is not in the cache.
+     */
+    bool
+    statusFind(AddressStatus &result, const std::string &address) const;
+
     /**
      * Builds a list of transactions that are relevant to these addresses.
+     * This reads a snapshot, so it never waits for updates to finish.
      */
     TxidSet
     txids() const;
 
+    /**
+     * Same as `txids`, but returns the shared snapshot without copying it.
+     * The pointer changes whenever the set of txids does.
+     */
+    std::shared_ptr<const TxidSet>
+    txidsSnapshot() const;
+
     // Updates -------------------------------------------------------------
 
     /**
@@ -128,6 +188,29 @@ public:
     void
     prioritize(const std::string &address);
 
+    /**
+     * Checks a group of addresses at high speed, alongside the single
+     * priority address, until each one has completed.
+     */
+    void
+    prioritize(const AddressSet &addresses);
+
+    /**
+     * Marks an address as just shown to the user,
+     * so it gets checked often for a while.
+     */
+    void
+    touch(const std::string &address);
+
+    /**
+     * Marks the addresses listing any newly-expired unconfirmed
+     * transaction as dirty, so their next history fetch either confirms
+     * the transaction or drops it. Expired transactions that no address
+     * lists get dropped right away.
+     */
+    void
+    expiredCheck(time_t now=time(nullptr));
+
     /**
      * Indicates that the transaction cache has been updated.
      */
@@ -140,6 +223,33 @@ public:
     void
     update(const std::string &address, const TxidSet &txids);
 
+    /**
+     * Returns the height from which to fetch an address's history,
+     * or zero if the address needs a full fetch.
+     * This backs off a few blocks from the newest confirmed transaction,
+     * so the fetch still picks up any re-organizations.
+     */
+    size_t
+    historyHeight(const std::string &address) const;
+
+    /**
+     * Updates an address with a history fetched from the given height.
+     * Known transactions confirmed below that height stay in place,
+     * and everything else is replaced with the new list.
+     */
+    void
+    updateFrom(const std::string &address, const TxidSet &txids,
+               size_t fromHeight);
+
+    /**
+     * Applies a batch of fetched histories in one step:
+     * the block heights, then the drops, then the new txid lists,
+     * all under one lock, with one round of callbacks at the end.
+     * Each history is merged as in `updateFrom`.
+     */
+    void
+    historyApply(const std::vector<AddressHistoryUpdate> &updates);
+
     /**
      * Updates all addresses touched by a spend.
      */
@@ -167,6 +277,14 @@ public:
     bool
     updateStratumHash(const std::string &address, const std::string &hash="");
 
+    /**
+     * Records which server last answered for an address.
+     * This is saved with the cache, so a restart can go back
+     * to the same server and compare its hash with the saved one.
+     */
+    void
+    updateServer(const std::string &address, const std::string &uri);
+
     /**
      * Sets up a callback to notify when addresses change.
      * This wakes up the updater to check for new work.
@@ -190,13 +308,17 @@ private:
     mutable std::recursive_mutex mutex_; // The callbacks force this on us
     TxCache &txCache_;
     std::string priorityAddress_;
+    AddressSet priorityGroup_;
 
     struct AddressRow
     {
         // Persistent state:
         TxidSet txids;
         time_t lastCheck = 0;
+        time_t lastActivity = 0; // Last time something new turned up
+        unsigned quietChecks = 0; // Checks in a row that found nothing
         std::string stratumHash;
+        std::string server; // Whoever gave us `stratumHash`
 
         // Dynamic state:
         bool dirty = true;
@@ -204,17 +326,23 @@ private:
         bool complete = false; // True if all txids are known to the GUI.
         bool knownComplete = false; // True if `onComplete` has been called.
         bool sweep = false; // True if we don't own this address
-
-        void
-        insertTxid(const std::string &txid)
-        {
-            txids.insert(txid);
-            complete = false;
-            knownComplete = false;
-        }
+        time_t lastTouched = 0; // Last time the user saw this address
+        TxidSet missing; // Txids not in the TxCache, as of the last update
     };
     std::map<std::string, AddressRow> rows_;
 
+    // Which rows list each txid, so changes only touch the rows involved:
+    std::map<std::string, AddressSet> txidRows_;
+    AddressSet recheck_; // Rows whose txids changed since the last update
+
+    // Work queues, so we never have to scan every row:
+    std::set<std::pair<time_t, std::string>> schedule_; // By next check
+    std::map<std::string, time_t> scheduled_; // Keys into `schedule_`
+    AddressSet dirty_;
+    AddressSet incomplete_; // Rows that are not `complete`
+    AddressSet unannounced_; // Rows that are not `knownComplete`
+    AddressSet unchecked_; // Rows that are not `checkedOnce`
+
     /**
      * Transactions that are relevant, in the cache,
      * and that the GUI knows about.
@@ -225,9 +353,76 @@ private:
     TxidCallback onTx_;
     CompleteCallback onComplete_;
 
+    // Copies of the state the GUI polls, published after each update
+    // so readers only contend for a pointer copy:
+    mutable std::mutex snapshotMutex_;
+    std::shared_ptr<const TxidSet> txidsSnapshot_;
+    std::pair<size_t, size_t> progressSnapshot_;
+    bool knownChanged_ = true; // `knownTxids_` differs from the snapshot
+
+    /**
+     * Publishes fresh snapshots. Should be called with the mutex held.
+     */
+    void
+    snapshotPublish();
+
+    AddressTier
+    tier(const std::string &address, const AddressRow &row, time_t now) const;
+
+    bool
+    isPriority(const std::string &address) const;
+
     time_t
     nextCheck(const std::string &address, const AddressRow &row) const;
 
+    /**
+     * Records the outcome of a check, for the back-off.
+     */
+    void
+    checked(AddressRow &row, bool activity, time_t now);
+
+    /**
+     * Files a row into the correct work queues after it changes.
+     * Should be called with the mutex held.
+     */
+    void
+    scheduleUpdate(const std::string &address, const AddressRow &row);
+
+    /**
+     * Adds the known txids confirmed below `fromHeight`
+     * to a partial history.
+     */
+    TxidSet
+    historyMerge(const std::string &address, const TxidSet &txids,
+                 size_t fromHeight) const;
+
+    /**
+     * Replaces the txid lists for a batch of addresses,
+     * dropping whatever fell out of the lists in a single pass.
+     * Should be called with the mutex held. Does not fire callbacks.
+     */
+    void
+    updateRows(const std::map<std::string, TxidSet> &lists);
+
+    /**
+     * Adds a txid to a row, keeping the reverse index current.
+     */
+    void
+    txidInsert(const std::string &address, AddressRow &row,
+               const std::string &txid);
+
+    /**
+     * Removes a txid from every row that lists it.
+     */
+    void
+    txidErase(const std::string &txid);
+
+    /**
+     * Rebuilds the work queues from scratch.
+     */
+    void
+    scheduleRebuild();
+
     AddressStatus
     status(const std::string &address, const AddressRow &row,
            time_t now) const;
@@ -11,11 +11,18 @@
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
 #include "../../util/Debug.hpp"
+#include "../../util/Metrics.hpp"
+#include "../../util/SharedState.hpp"
+#include "../../util/WriteQueue.hpp"
 
 namespace abcd {
 
 constexpr time_t onHeaderTimeout = 5;
 
+// How far past the known tip a header may land, since the height
+// and the headers come in separately:
+constexpr size_t headerHeightSlack = 100;
+
 struct BlockHeaderJson:
     public JsonObject
 {
@@ -32,8 +39,12 @@ struct BlockCacheJson:
     ABC_JSON_VALUE(headers, "headers", JsonArray)
 };
 
-BlockCache::BlockCache(const std::string &path):
+BlockCache::BlockCache(const std::string &path,
+                       const std::string &headersPath,
+                       std::shared_ptr<SharedState> shared):
     path_(path),
+    headersPath_(headersPath),
+    shared_(shared),
     dirty_(false),
     height_(0)
 {
@@ -44,6 +55,7 @@ BlockCache::clear()
 {
     std::lock_guard<std::mutex> lock(mutex_);
     height_ = 0;
+    shared_->set(SharedSlot::blockHeight, 0);
     headers_.clear();
     headersNeeded_.clear();
     dirty_ = true;
@@ -54,10 +66,15 @@ BlockCache::load()
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    // The header file works even if there is no JSON file yet:
+    ABC_CHECK(headers_.open(headersPath_));
+
     BlockCacheJson json;
-    ABC_CHECK(json.load(path_));
-    height_ = json.height();
+    ABC_CHECK(json.loadChecked(path_));
+    height_ = shared_->raise(SharedSlot::blockHeight, json.height());
+    dirty_ = false;
 
+    // Move headers from older JSON files over to the header file:
     auto headersJson = json.headers();
     size_t headersSize = headersJson.size();
     for (size_t i = 0; i < headersSize; i++)
@@ -70,41 +87,76 @@ BlockCache::load()
             bc::block_header_type header;
             ABC_CHECK(decodeHeader(header, rawHeader));
 
-            headers_[blockHeaderJson.height()] = std::move(header);
+            if (!headers_.has(blockHeaderJson.height()))
+                ABC_CHECK(headers_.insert(blockHeaderJson.height(), header));
         }
+        dirty_ = true;
     }
 
-    dirty_ = false;
     return Status();
 }
 
 Status
 BlockCache::save()
 {
+    static auto &duration = metricHistogram("blockcache.save_us");
+    MetricTimer timer(duration);
     std::lock_guard<std::mutex> lock(mutex_);
 
+    // Headers go straight into their file, so only the height is left:
     if (dirty_)
     {
-        BlockCacheJson json;
-        ABC_CHECK(json.heightSet(height_));
+        headers_.sync();
+        dirty_ = false;
 
-        JsonArray headersJson;
-        for (const auto &header: headers_)
+        // Another process may have seen a newer block since:
+        const auto path = path_;
+        const auto height = std::max<size_t>(height_,
+                                             shared_->get(SharedSlot::blockHeight));
+        writeQueueAdd(path, [path, height]()
         {
-            bc::data_chunk rawHeader(satoshi_raw_size(header.second));
-            bc::satoshi_save(header.second, rawHeader.begin());
+            BlockCacheJson json;
+            ABC_CHECK(json.heightSet(height));
+            ABC_CHECK(json.saveChecked(path));
+            return Status();
+        });
+    }
 
-            BlockHeaderJson blockHeaderJson;
-            ABC_CHECK(blockHeaderJson.heightSet(header.first));
-            ABC_CHECK(blockHeaderJson.headerSet(base64Encode(rawHeader)));
-            ABC_CHECK(headersJson.append(blockHeaderJson));
-        }
-        ABC_CHECK(json.headersSet(headersJson));
+    return Status();
+}
 
-        ABC_CHECK(json.save(path_));
-        dirty_ = false;
-    }
+size_t
+BlockCache::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return headers_.memoryUsed();
+}
 
+void
+BlockCache::trim()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    headers_.sync();
+    headers_.trim();
+}
+
+Status
+BlockCache::checkpointsLoad(const std::string &path)
+{
+    HeaderCheckpoints checkpoints;
+    ABC_CHECK(checkpoints.open(path));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    checkpoints_ = checkpoints;
+
+    // Drop any requests the checkpoints now answer:
+    for (auto i = headersNeeded_.begin(); headersNeeded_.end() != i; )
+    {
+        if (checkpoints_.covers(*i))
+            i = headersNeeded_.erase(i);
+        else
+            ++i;
+    }
     return Status();
 }
 
@@ -112,7 +164,7 @@ size_t
 BlockCache::height() const
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    return height_;
+    return std::max<size_t>(height_, shared_->get(SharedSlot::blockHeight));
 }
 
 size_t
@@ -124,6 +176,7 @@ BlockCache::heightSet(size_t height)
     {
         height_ = height;
         dirty_ = true;
+        shared_->raise(SharedSlot::blockHeight, height);
 
         if (onHeight_)
             onHeight_(height_);
@@ -141,13 +194,25 @@ BlockCache::onHeightSet(const HeightCallback &onHeight)
 Status
 BlockCache::headerTime(time_t &result, size_t height)
 {
+    static auto &hits = metricCounter("blockcache.header_hit");
+    static auto &misses = metricCounter("blockcache.header_miss");
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto it = headers_.find(height);
-    if (it == headers_.end())
+    if (!headers_.time(result, height) && !checkpoints_.time(result, height))
+    {
+        // Another process may have fetched the header already:
+        headers_.refresh().log();
+        if (headers_.time(result, height))
+        {
+            hits.add();
+            return Status();
+        }
+
+        misses.add();
         return ABC_ERROR(ABC_CC_Synchronizing, "Header not available.");
+    }
 
-    result = it->second.timestamp;
+    hits.add();
     return Status();
 }
 
@@ -156,11 +221,18 @@ BlockCache::headerInsert(size_t height, const bc::block_header_type &header)
 {
     std::unique_lock<std::mutex> lock(mutex_);
 
+    if (!headerHeightOk(height))
+    {
+        ABC_DebugLog("Rejecting header %d past the tip", height);
+        return false;
+    }
+
     // Do not stomp existing headers:
-    if (headers_.end() == headers_.find(height))
+    if (!headers_.has(height))
     {
         ABC_DebugLog("Adding header %d", height);
-        headers_[height] = header;
+        if (!headers_.insert(height, header).log())
+            return false;
         dirty_ = true;
         headersDirty_ = true;
 
@@ -170,6 +242,38 @@ BlockCache::headerInsert(size_t height, const bc::block_header_type &header)
     return false;
 }
 
+size_t
+BlockCache::headersInsert(size_t height,
+                          const std::vector<bc::block_header_type> &headers)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!headerHeightOk(height + headers.size()))
+    {
+        ABC_DebugLog("Rejecting headers %d to %d past the tip",
+                     height, height + headers.size());
+        return 0;
+    }
+
+    size_t out = 0;
+    for (size_t i = 0; i < headers.size(); ++i)
+    {
+        if (headers_.has(height + i))
+            continue;
+        if (!headers_.insert(height + i, headers[i]).log())
+            break;
+        ++out;
+    }
+
+    if (out)
+    {
+        ABC_DebugLog("Adding %d headers from %d", out, height);
+        dirty_ = true;
+        headersDirty_ = true;
+    }
+    return out;
+}
+
 void
 BlockCache::onHeaderSet(const HeaderCallback &onHeader)
 {
@@ -199,31 +303,51 @@ BlockCache::onHeaderInvoke(void)
     }
 }
 
-size_t
-BlockCache::headerNeeded()
+bool
+BlockCache::headersNeeded(size_t &height, size_t &count, size_t limit)
 {
     std::unique_lock<std::mutex> lock(mutex_);
 
-    while (!headersNeeded_.empty())
+    // Find the first item that is truly missing,
+    // counting the ones other processes have fetched:
+    if (!headersNeeded_.empty())
+        headers_.refresh().log();
+    height = 0;
+    while (!headersNeeded_.empty() && !height)
     {
-        // Pull an item from the set:
-        const auto out = *headersNeeded_.begin();
+        height = *headersNeeded_.begin();
         headersNeeded_.erase(headersNeeded_.begin());
-
-        // Only return the item if it is truly missing:
-        if (headers_.end() == headers_.find(out))
-            return out;
+        if (headers_.has(height))
+            height = 0;
     }
+    if (!height)
+        return false;
 
-    // There is none:
-    return 0;
+    // Extend the run as far as the requests allow:
+    count = 1;
+    while (count < limit && !headersNeeded_.empty() &&
+            height + count == *headersNeeded_.begin())
+    {
+        headersNeeded_.erase(headersNeeded_.begin());
+        ++count;
+    }
+    return true;
 }
 
 void
 BlockCache::headerNeededAdd(size_t height)
 {
     std::unique_lock<std::mutex> lock(mutex_);
-    headersNeeded_.insert(height);
+    if (!checkpoints_.covers(height))
+        headersNeeded_.insert(height);
+}
+
+bool
+BlockCache::headerHeightOk(size_t height) const
+{
+    const size_t tip = std::max<size_t>(height_,
+                                        shared_->get(SharedSlot::blockHeight));
+    return height <= std::max(tip, checkpoints_.last()) + headerHeightSlack;
 }
 
 } // namespace abcd
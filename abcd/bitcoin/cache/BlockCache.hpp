@@ -8,17 +8,23 @@
 #ifndef ABCD_BITCOIN_BLOCK_CACHE_HPP
 #define ABCD_BITCOIN_BLOCK_CACHE_HPP
 
+#include "HeaderCheckpoints.hpp"
+#include "HeaderFile.hpp"
 #include "../../util/Status.hpp"
 #include <bitcoin/bitcoin.hpp>
 #include <functional>
-#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <vector>
 
 namespace abcd {
 
+class SharedState;
+
 /**
  * A block-height cache.
+ * Other processes using the same root share the height and headers.
  */
 class BlockCache
 {
@@ -28,7 +34,13 @@ public:
 
     // Lifetime ------------------------------------------------------------
 
-    BlockCache(const std::string &path);
+    /**
+     * @param path the JSON file holding the chain height.
+     * @param headersPath the memory-mapped block header file.
+     * @param shared the counters shared with other processes.
+     */
+    BlockCache(const std::string &path, const std::string &headersPath,
+               std::shared_ptr<SharedState> shared);
 
     /**
      * Clears the cache in case something goes wrong.
@@ -44,14 +56,36 @@ public:
 
     /**
      * Saves the database contents to disk, but only if there are changes.
+     * The file write itself happens on the write-behind queue.
      */
     Status
     save();
 
+    /**
+     * Returns the size of the mapped header file, in bytes.
+     */
+    size_t
+    memoryUsed() const;
+
+    /**
+     * Hands the mapped header pages back to the kernel,
+     * for when the system is low on memory.
+     */
+    void
+    trim();
+
+    /**
+     * Loads a table of shipped block timestamps.
+     * Heights the table covers never need a header fetch.
+     */
+    Status
+    checkpointsLoad(const std::string &path);
+
     // Chain height --------------------------------------------------------
 
     /**
-     * Returns the highest block that this cache has seen.
+     * Returns the highest block that this cache,
+     * or any other process sharing it, has seen.
      */
     size_t
     height() const;
@@ -83,6 +117,14 @@ public:
     bool
     headerInsert(size_t height, const libbitcoin::block_header_type &header);
 
+    /**
+     * Stores a run of consecutive block headers, starting at `height`.
+     * @return the number of headers that were new.
+     */
+    size_t
+    headersInsert(size_t height,
+                  const std::vector<libbitcoin::block_header_type> &headers);
+
     /**
      * Provides a callback to be invoked when a new header is inserted.
      */
@@ -99,11 +141,12 @@ public:
     // Missing header list -------------------------------------------------
 
     /**
-     * Returns the next requested block header missing from the cache,
-     * or zero if there is none.
+     * Pulls the next run of consecutive missing headers off the request list.
+     * @param limit the longest run to return.
+     * @return false if there are no missing headers.
      */
-    size_t
-    headerNeeded();
+    bool
+    headersNeeded(size_t &height, size_t &count, size_t limit);
 
     /**
      * Requests that a particular block header be added to the cache.
@@ -114,6 +157,8 @@ public:
 private:
     mutable std::mutex mutex_;
     const std::string path_;
+    const std::string headersPath_;
+    const std::shared_ptr<SharedState> shared_;
     bool dirty_;
 
     // Chain height:
@@ -121,13 +166,23 @@ private:
     HeightCallback onHeight_;
 
     // Chain headers:
-    std::map<size_t, libbitcoin::block_header_type> headers_;
+    HeaderFile headers_;
+    HeaderCheckpoints checkpoints_;
     bool headersDirty_ = false;
     time_t onHeaderLastCall_ = 0;
     HeaderCallback onHeader_;
 
     // Missing headers:
     std::set<size_t> headersNeeded_;
+
+    /**
+     * Returns false for heights too far past the chain tip
+     * and the checkpoints to be real, so a bad server
+     * cannot make the header file grow without bound.
+     * The caller must hold the mutex.
+     */
+    bool
+    headerHeightOk(size_t height) const;
 };
 
 } // namespace abcd
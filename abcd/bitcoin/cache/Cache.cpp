@@ -8,16 +8,19 @@
 #include "Cache.hpp"
 #include "../../json/JsonObject.hpp"
 #include "../../util/FileIO.hpp"
+#include "../../util/Metrics.hpp"
+#include "../../util/WriteQueue.hpp"
 
 namespace abcd {
 
-Cache::Cache(const std::string &path, BlockCache &blockCache,
-             ServerCache &serverCache):
+Cache::Cache(const std::string &path, const std::string &txsPath,
+             BlockCache &blockCache, ServerCache &serverCache):
     txs(blockCache),
     blocks(blockCache),
     addresses(txs),
     servers(serverCache),
     path_(path),
+    txsPath_(txsPath),
     addressCheckDone_(false)
 {
 }
@@ -35,11 +38,18 @@ Cache::clear()
 Status
 Cache::load()
 {
+    static auto &hits = metricCounter("cache.load_hit");
+    static auto &misses = metricCounter("cache.load_miss");
+
     JsonObject cacheJson;
     servers.serverCacheLoad();
-    ABC_CHECK(cacheJson.load(path_));
-    ABC_CHECK(txs.load(cacheJson));
+    const auto loaded = cacheJson.loadChecked(path_);
+    (loaded ? hits : misses).add();
+    ABC_CHECK(loaded);
+    if (!fileExists(txsPath_) || !txs.loadLog(txsPath_).log())
+        ABC_CHECK(txs.load(cacheJson));
     ABC_CHECK(addresses.load(cacheJson));
+    ABC_CHECK(outbox.load(cacheJson));
     addressCheckDoneLoad(cacheJson);
     return Status();
 }
@@ -148,11 +158,23 @@ Cache::loadLegacy(const std::string &path)
 Status
 Cache::save()
 {
-    JsonObject cacheJson;
-    ABC_CHECK(txs.save(cacheJson));
-    ABC_CHECK(addresses.save(cacheJson));
-    ABC_CHECK(addressCheckDoneSave(cacheJson));
-    ABC_CHECK(cacheJson.save(path_));
+    static auto &duration = metricHistogram("cache.save_us");
+    MetricTimer timer(duration);
+
+    ABC_CHECK(txs.save(txsPath_));
+
+    // Only the worker touches the JSON after this, so the jansson
+    // reference counts never change on two threads at once:
+    auto cacheJson = std::make_shared<JsonObject>();
+    ABC_CHECK(addresses.save(*cacheJson));
+    ABC_CHECK(outbox.save(*cacheJson));
+    ABC_CHECK(addressCheckDoneSave(*cacheJson));
+
+    const auto path = path_;
+    writeQueueAdd(path, [cacheJson, path]()
+    {
+        return cacheJson->saveChecked(path);
+    });
     return Status();
 }
 
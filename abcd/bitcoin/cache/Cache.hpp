@@ -10,6 +10,7 @@
 
 #include "AddressCache.hpp"
 #include "BlockCache.hpp"
+#include "Outbox.hpp"
 #include "TxCache.hpp"
 #include "ServerCache.hpp"
 
@@ -22,9 +23,10 @@ public:
     BlockCache &blocks;
     AddressCache addresses;
     ServerCache &servers;
+    Outbox outbox;
 
-    Cache(const std::string &path, BlockCache &blockCache,
-          ServerCache &serverCache);
+    Cache(const std::string &path, const std::string &txsPath,
+          BlockCache &blockCache, ServerCache &serverCache);
 
     /**
      * Sets the address check done for this wallet meaning that
@@ -50,6 +52,7 @@ public:
 
     /**
      * Loads the cache from disk.
+     * Upgrades the transactions from the JSON format if there is no log.
      */
     Status
     load();
@@ -62,6 +65,8 @@ public:
 
     /**
      * Saves the cache to disk.
+     * This only takes a snapshot, leaving the encoding and disk writes
+     * to the write-behind queue, so it is cheap on the network thread.
      */
     Status
     save();
@@ -81,6 +86,7 @@ private:
     addressCheckDoneLoad(JsonObject &json);
 
     const std::string path_;
+    const std::string txsPath_;
     bool addressCheckDone_;
 };
 
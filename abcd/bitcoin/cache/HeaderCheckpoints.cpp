@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "HeaderCheckpoints.hpp"
+#include "../../util/FileIO.hpp"
+#include "../../util/MappedFile.hpp"
+
+namespace abcd {
+
+// The file is a header of little-endian 32-bit words,
+// followed by one 32-bit timestamp per checkpoint:
+constexpr uint32_t checkpointMagic = 0x50434241; // "ABCP"
+constexpr uint32_t checkpointVersion = 1;
+constexpr size_t headerWords = 5; // magic, version, start, interval, count
+
+static uint32_t
+readWord(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+static void
+writeWord(DataChunk &out, uint32_t word)
+{
+    out.push_back(word);
+    out.push_back(word >> 8);
+    out.push_back(word >> 16);
+    out.push_back(word >> 24);
+}
+
+Status
+HeaderCheckpoints::open(const std::string &path)
+{
+    std::shared_ptr<MappedFile> file;
+    ABC_CHECK(MappedFile::create(file, path));
+
+    const auto data = file->data();
+    if (data.size() < 4 * headerWords ||
+            checkpointMagic != readWord(data.data()))
+        return ABC_ERROR(ABC_CC_ParseError, "Not a checkpoint file " + path);
+    if (checkpointVersion != readWord(data.data() + 4))
+        return ABC_ERROR(ABC_CC_ParseError,
+                         "Unknown checkpoint version in " + path);
+
+    const size_t start = readWord(data.data() + 8);
+    const size_t interval = readWord(data.data() + 12);
+    const size_t count = readWord(data.data() + 16);
+    if (!interval || (data.size() - 4 * headerWords) / 4 < count)
+        return ABC_ERROR(ABC_CC_ParseError, "Truncated checkpoint file " + path);
+
+    file_ = file;
+    times_ = data.data() + 4 * headerWords;
+    start_ = start;
+    interval_ = interval;
+    count_ = count;
+    return Status();
+}
+
+Status
+HeaderCheckpoints::write(const std::string &path, size_t start,
+                         size_t interval, const std::vector<uint32_t> &times)
+{
+    DataChunk out;
+    out.reserve(4 * (headerWords + times.size()));
+    writeWord(out, checkpointMagic);
+    writeWord(out, checkpointVersion);
+    writeWord(out, start);
+    writeWord(out, interval);
+    writeWord(out, times.size());
+    for (auto time: times)
+        writeWord(out, time);
+
+    ABC_CHECK(fileSave(out, path));
+    return Status();
+}
+
+bool
+HeaderCheckpoints::covers(size_t height) const
+{
+    return count_ && start_ <= height &&
+           height <= start_ + (count_ - 1) * interval_;
+}
+
+size_t
+HeaderCheckpoints::last() const
+{
+    return count_ ? start_ + (count_ - 1) * interval_ : 0;
+}
+
+bool
+HeaderCheckpoints::time(time_t &result, size_t height) const
+{
+    if (!covers(height))
+        return false;
+
+    const auto offset = height - start_;
+    const auto i = offset / interval_;
+    const auto rest = offset % interval_;
+    if (!rest)
+    {
+        result = at(i);
+        return true;
+    }
+
+    // Block times wander, but the average over an interval is steady:
+    const int64_t before = at(i);
+    const int64_t after = at(i + 1);
+    result = before + (after - before) * int64_t(rest) / int64_t(interval_);
+    return true;
+}
+
+uint32_t
+HeaderCheckpoints::at(size_t i) const
+{
+    return readWord(times_ + 4 * i);
+}
+
+} // namespace abcd
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A shipped table of block timestamps for dating old transactions.
+ */
+
+#ifndef ABCD_BITCOIN_CACHE_HEADER_CHECKPOINTS_HPP
+#define ABCD_BITCOIN_CACHE_HEADER_CHECKPOINTS_HPP
+
+#include "../../util/Status.hpp"
+#include <time.h>
+#include <memory>
+#include <vector>
+
+namespace abcd {
+
+class MappedFile;
+
+/**
+ * A read-only table of block timestamps, shipped with the app
+ * so new installs can date old transactions without fetching headers.
+ *
+ * The file holds one timestamp every `interval` blocks.
+ * Heights between two checkpoints get an interpolated time,
+ * which is exact when the interval is one.
+ */
+class HeaderCheckpoints
+{
+public:
+    /**
+     * Maps a checkpoint file into memory,
+     * replacing any checkpoints already loaded.
+     */
+    Status
+    open(const std::string &path);
+
+    /**
+     * Writes a checkpoint file.
+     * @param times the timestamps at `start`, `start + interval`, and so on.
+     */
+    static Status
+    write(const std::string &path, size_t start, size_t interval,
+          const std::vector<uint32_t> &times);
+
+    /**
+     * Returns true if the table can date this height.
+     */
+    bool
+    covers(size_t height) const;
+
+    /**
+     * Returns the height of the last checkpoint, or 0 if there are none.
+     */
+    size_t
+    last() const;
+
+    /**
+     * Looks up or interpolates a block's timestamp.
+     * @return false if the height is outside the table.
+     */
+    bool
+    time(time_t &result, size_t height) const;
+
+private:
+    std::shared_ptr<MappedFile> file_;
+    const uint8_t *times_ = nullptr;
+    size_t start_ = 0;
+    size_t interval_ = 1;
+    size_t count_ = 0;
+
+    uint32_t
+    at(size_t i) const;
+};
+
+} // namespace abcd
+
+#endif
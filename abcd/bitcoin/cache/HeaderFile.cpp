@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "HeaderFile.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace abcd {
+
+// Each record is a little-endian timestamp followed by the block hash.
+// A zero timestamp marks an empty slot:
+constexpr size_t timeSize = 4;
+constexpr size_t recordSize = timeSize + bc::hash_size;
+
+// Grow the file this many records at a time, to avoid constant remapping:
+constexpr size_t growRecords = 4096;
+
+HeaderFile::~HeaderFile()
+{
+    unmap();
+    if (0 <= fd_)
+        close(fd_);
+}
+
+HeaderFile::HeaderFile()
+{
+}
+
+Status
+HeaderFile::open(const std::string &path)
+{
+    unmap();
+    if (0 <= fd_)
+        close(fd_);
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Cannot open " + path);
+
+    struct stat statbuf;
+    if (fstat(fd_, &statbuf))
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot stat " + path);
+
+    // A torn final record is simply dropped:
+    return reserve(statbuf.st_size / recordSize);
+}
+
+void
+HeaderFile::clear()
+{
+    // Other processes may have the file mapped, so empty the slots
+    // rather than truncating the file out from under them:
+    if (data_)
+    {
+        memset(data_, 0, capacity_ * recordSize);
+        sync();
+    }
+}
+
+Status
+HeaderFile::refresh()
+{
+    if (fd_ < 0)
+        return Status();
+
+    struct stat statbuf;
+    if (fstat(fd_, &statbuf))
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot stat header file");
+
+    return reserve(statbuf.st_size / recordSize);
+}
+
+void
+HeaderFile::sync()
+{
+    if (data_)
+        msync(data_, capacity_ * recordSize, MS_ASYNC);
+}
+
+size_t
+HeaderFile::memoryUsed() const
+{
+    return data_ ? capacity_ * recordSize : 0;
+}
+
+void
+HeaderFile::trim()
+{
+    // The mapping is shared, so dirty pages still reach the file:
+    if (data_)
+        madvise(data_, capacity_ * recordSize, MADV_DONTNEED);
+}
+
+bool
+HeaderFile::has(size_t height) const
+{
+    return record(height);
+}
+
+bool
+HeaderFile::time(time_t &result, size_t height) const
+{
+    const auto *p = record(height);
+    if (!p)
+        return false;
+
+    result = bc::from_little_endian_unsafe<uint32_t>(p);
+    return true;
+}
+
+bool
+HeaderFile::hash(bc::hash_digest &result, size_t height) const
+{
+    const auto *p = record(height);
+    if (!p)
+        return false;
+
+    std::copy(p + timeSize, p + recordSize, result.begin());
+    return true;
+}
+
+Status
+HeaderFile::insert(size_t height, const bc::block_header_type &header)
+{
+    if (capacity_ <= height)
+        ABC_CHECK(reserve(height + 1));
+
+    // Write the hash first, so a crash never leaves a timestamp without it:
+    auto *p = data_ + height * recordSize;
+    const auto hash = bc::hash_block_header(header);
+    std::copy(hash.begin(), hash.end(), p + timeSize);
+    const auto time = bc::to_little_endian<uint32_t>(header.timestamp);
+    std::copy(time.begin(), time.end(), p);
+
+    return Status();
+}
+
+const uint8_t *
+HeaderFile::record(size_t height) const
+{
+    if (capacity_ <= height)
+        return nullptr;
+
+    const auto *p = data_ + height * recordSize;
+    if (!p[0] && !p[1] && !p[2] && !p[3])
+        return nullptr;
+    return p;
+}
+
+Status
+HeaderFile::reserve(size_t records)
+{
+    if (fd_ < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Header file is not open");
+    if (records <= capacity_)
+        return Status();
+
+    // Round up, then extend the file. The new space is a hole until used.
+    // Other processes may be growing the file too, so hold the lock,
+    // and never cut the file shorter than someone else made it:
+    size_t capacity = (records + growRecords - 1) / growRecords *
+                      growRecords;
+    flock(fd_, LOCK_EX);
+    struct stat statbuf;
+    const size_t size = fstat(fd_, &statbuf) ? 0 : statbuf.st_size;
+    capacity = std::max(capacity, size / recordSize);
+    if (size < capacity * recordSize &&
+            ftruncate(fd_, capacity * recordSize))
+    {
+        flock(fd_, LOCK_UN);
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot grow header file");
+    }
+    flock(fd_, LOCK_UN);
+
+    unmap();
+    void *data = mmap(nullptr, capacity * recordSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd_, 0);
+    if (MAP_FAILED == data)
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot map header file");
+
+    data_ = static_cast<uint8_t *>(data);
+    capacity_ = capacity;
+    return Status();
+}
+
+void
+HeaderFile::unmap()
+{
+    if (data_)
+        munmap(data_, capacity_ * recordSize);
+    data_ = nullptr;
+    capacity_ = 0;
+}
+
+} // namespace abcd
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Memory-mapped storage for block header timestamps and hashes.
+ */
+
+#ifndef ABCD_BITCOIN_CACHE_HEADER_FILE_HPP
+#define ABCD_BITCOIN_CACHE_HEADER_FILE_HPP
+
+#include "../../util/Status.hpp"
+#include <bitcoin/bitcoin.hpp>
+
+namespace abcd {
+
+/**
+ * A height-indexed file of block header summaries, mapped into memory.
+ * Each height gets a fixed-size slot holding the header's timestamp
+ * and hash, so lookups are a single array access, and storing a header
+ * touches nothing but its own slot. Heights we have never seen are
+ * holes in a sparse file, and cost no disk space.
+ * The mapping is shared, so every process using the file
+ * sees the others' headers as soon as they land.
+ */
+class HeaderFile
+{
+public:
+    ~HeaderFile();
+    HeaderFile();
+
+    /**
+     * Opens or creates the file at the given path.
+     */
+    Status
+    open(const std::string &path);
+
+    /**
+     * Drops every stored header.
+     */
+    void
+    clear();
+
+    /**
+     * Picks up any growth from other processes writing the same file.
+     */
+    Status
+    refresh();
+
+    /**
+     * Pushes recent writes out to disk, without waiting for them.
+     */
+    void
+    sync();
+
+    /**
+     * Returns the size of the mapping, in bytes.
+     */
+    size_t
+    memoryUsed() const;
+
+    /**
+     * Lets the kernel take back the mapped pages.
+     * They read back in from the file on the next lookup.
+     */
+    void
+    trim();
+
+    bool
+    has(size_t height) const;
+
+    /**
+     * Looks up a header's timestamp.
+     * @return false if the header is not in the file.
+     */
+    bool
+    time(time_t &result, size_t height) const;
+
+    /**
+     * Looks up a header's hash.
+     * @return false if the header is not in the file.
+     */
+    bool
+    hash(bc::hash_digest &result, size_t height) const;
+
+    /**
+     * Stores the parts of a header that we care about.
+     */
+    Status
+    insert(size_t height, const bc::block_header_type &header);
+
+private:
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+    size_t capacity_ = 0; // In records
+
+    const uint8_t *
+    record(size_t height) const;
+
+    Status
+    reserve(size_t records);
+
+    void
+    unmap();
+
+    HeaderFile(const HeaderFile &) = delete;
+    HeaderFile &operator=(const HeaderFile &) = delete;
+};
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Outbox.hpp"
+#include "../../crypto/Encoding.hpp"
+#include "../../json/JsonArray.hpp"
+#include "../../json/JsonObject.hpp"
+#include "../../json/JsonSchema.hpp"
+#include <algorithm>
+
+namespace abcd {
+
+// Retry delays, in seconds, doubling after each failed try:
+constexpr time_t retryMin = 5;
+constexpr time_t retryMax = 10 * 60;
+
+// After this long, the inputs have probably gone elsewhere:
+constexpr time_t outboxMaxAge = 3 * 24 * 60 * 60;
+
+struct CacheJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(CacheJson, JsonObject)
+
+    ABC_JSON_VALUE(outbox, "outbox", JsonArray)
+};
+
+struct OutboxJsonRow
+{
+    std::string txid;
+    std::string tx;
+    time_t added = 0;
+    time_t delay = 0;
+};
+
+static const auto outboxSchema = jsonSchema(
+    jsonField("txid", &OutboxJsonRow::txid, jsonRequired),
+    jsonField("tx", &OutboxJsonRow::tx, jsonRequired),
+    jsonField("added", &OutboxJsonRow::added),
+    jsonField("delay", &OutboxJsonRow::delay, jsonSkipEmpty));
+
+void
+Outbox::add(const std::string &txid, DataSlice tx, time_t now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto i = rows_.find(txid);
+    if (rows_.end() != i)
+    {
+        i->second.nextTry = now;
+        return;
+    }
+    rows_[txid] = Row{DataChunk(tx.begin(), tx.end()), now, now, retryMin};
+}
+
+bool
+Outbox::remove(const std::string &txid)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rows_.erase(txid);
+}
+
+std::list<OutboxEntry>
+Outbox::due(time_t &sleep, time_t now)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::list<OutboxEntry> out;
+
+    sleep = 0;
+    auto i = rows_.begin();
+    while (rows_.end() != i)
+    {
+        auto &row = i->second;
+        if (row.added + outboxMaxAge < now)
+        {
+            i = rows_.erase(i);
+            continue;
+        }
+
+        if (row.nextTry <= now)
+        {
+            out.push_back(OutboxEntry{i->first, row.tx});
+            row.nextTry = now + row.delay;
+            row.delay = std::min(2 * row.delay, retryMax);
+        }
+
+        const time_t wait = row.nextTry - now;
+        if (!sleep || wait < sleep)
+            sleep = wait;
+        ++i;
+    }
+    return out;
+}
+
+void
+Outbox::wake()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &row: rows_)
+    {
+        row.second.nextTry = 0;
+        row.second.delay = retryMin;
+    }
+}
+
+std::list<std::string>
+Outbox::txids() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::list<std::string> out;
+    for (const auto &row: rows_)
+        out.push_back(row.first);
+    return out;
+}
+
+size_t
+Outbox::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rows_.size();
+}
+
+Status
+Outbox::load(JsonObject &json)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheJson cacheJson(json);
+
+    auto arrayJson = cacheJson.outbox();
+    size_t size = arrayJson.size();
+    for (size_t i = 0; i < size; i++)
+    {
+        OutboxJsonRow rowJson;
+        DataChunk tx;
+        if (outboxSchema.decode(rowJson, json_array_get(arrayJson.get(), i)) &&
+                base16Decode(tx, rowJson.tx))
+        {
+            // Loading means we just started, so try again right away:
+            const auto delay = rowJson.delay ?
+                               std::min(rowJson.delay, retryMax) : retryMin;
+            rows_[rowJson.txid] = Row{std::move(tx), rowJson.added, 0, delay};
+        }
+    }
+
+    return Status();
+}
+
+Status
+Outbox::save(JsonObject &json) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheJson cacheJson(json);
+
+    JsonArray outboxJson;
+    for (const auto &row: rows_)
+    {
+        OutboxJsonRow rowJson;
+        rowJson.txid = row.first;
+        rowJson.tx = base16Encode(row.second.tx);
+        rowJson.added = row.second.added;
+        rowJson.delay = row.second.delay;
+
+        JsonPtr entry;
+        ABC_CHECK(outboxSchema.encode(entry, rowJson));
+        ABC_CHECK(outboxJson.append(entry));
+    }
+    ABC_CHECK(cacheJson.outboxSet(outboxJson));
+
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Sent transactions that are still waiting to appear on the network.
+ */
+
+#ifndef ABCD_BITCOIN_CACHE_OUTBOX_HPP
+#define ABCD_BITCOIN_CACHE_OUTBOX_HPP
+
+#include "../../util/Data.hpp"
+#include "../../util/Status.hpp"
+#include <list>
+#include <map>
+#include <mutex>
+#include <time.h>
+
+namespace abcd {
+
+class JsonObject;
+
+/**
+ * A transaction waiting to show up on the network.
+ */
+struct OutboxEntry
+{
+    std::string txid;
+    DataChunk tx;
+};
+
+/**
+ * Sent transactions that no server has reported in an address history yet.
+ * The watcher keeps re-sending these, backing off between tries,
+ * until one shows up, a server rejects it for good, or it gets too old.
+ * Safe to use from any thread.
+ */
+class Outbox
+{
+public:
+    /**
+     * Queues a transaction, due right away.
+     * Adding a transaction that is already queued just makes it due.
+     */
+    void
+    add(const std::string &txid, DataSlice tx, time_t now=time(nullptr));
+
+    /**
+     * Forgets a transaction, once the network has it,
+     * a server rejects it, or the user gives up on it.
+     * @return false if the transaction was not queued.
+     */
+    bool
+    remove(const std::string &txid);
+
+    /**
+     * Takes the transactions that are ready for another try,
+     * pushing each one's next try further out.
+     * Drops transactions that have been failing for days.
+     * @param sleep the number of seconds until the next one is due,
+     * or 0 if the outbox is empty.
+     */
+    std::list<OutboxEntry>
+    due(time_t &sleep, time_t now=time(nullptr));
+
+    /**
+     * Makes everything due right away, such as after a new connection.
+     */
+    void
+    wake();
+
+    /**
+     * Lists the queued transaction ids.
+     */
+    std::list<std::string>
+    txids() const;
+
+    size_t
+    size() const;
+
+    /**
+     * Reads the queue from the wallet's cache file.
+     */
+    Status
+    load(JsonObject &json);
+
+    /**
+     * Writes the queue into the wallet's cache file.
+     */
+    Status
+    save(JsonObject &json) const;
+
+private:
+    struct Row
+    {
+        DataChunk tx;
+        time_t added;
+        time_t nextTry;
+        time_t delay;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Row> rows_;
+};
+
+} // namespace abcd
+
+#endif
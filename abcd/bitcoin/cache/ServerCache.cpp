@@ -11,6 +11,8 @@
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
 #include "../../util/Debug.hpp"
+#include "../../util/SharedState.hpp"
+#include "../../util/WriteQueue.hpp"
 #include "../../General.hpp"
 
 
@@ -19,17 +21,68 @@ namespace abcd {
 constexpr auto AIRBITZ_DOMAIN = ".airbitz.co:";
 constexpr auto STRATUM_PREFIX = "stratum://";
 constexpr auto STRATUM_PREFIX_LENGTH = 10;
+constexpr auto STRATUMS_PREFIX = "stratums://";
+constexpr auto STRATUMS_PREFIX_LENGTH = 11;
 constexpr auto MAX_SCORE = 500;
 constexpr auto MIN_SCORE = -100;
 
 #define RESPONSE_TIME_UNINITIALIZED 999999999
 
+// How much weight each new sample carries:
+constexpr double RESPONSE_TIME_WEIGHT = 0.2;
+constexpr double LATENCY_DECAY = 0.95;
+constexpr double FAILURE_WEIGHT = 0.1;
+constexpr double FAILURE_RATE_MAX = 0.9;
+
+// Process-wide socket budget:
+constexpr size_t SOCKETS_MAX = 12;
+constexpr size_t SOCKETS_PER_SERVER = 3;
+constexpr size_t SOCKETS_PRIORITY_RESERVE = 5; // One full watcher's worth
+
 /**
  * Utility routines
  */
-bool sortServersByTime(ServerInfo si1, ServerInfo si2)
+static unsigned long
+latencyBucketLimit(size_t bucket)
+{
+    return 25ul << bucket;
+}
+
+static unsigned long
+latencyPercentile(const ServerInfo &serverInfo, double fraction)
+{
+    double total = 0;
+    for (auto count: serverInfo.latencyHistogram)
+        total += count;
+    if (total <= 0)
+        return 0;
+
+    double sum = 0;
+    for (size_t i = 0; i < serverLatencyBuckets; ++i)
+    {
+        sum += serverInfo.latencyHistogram[i];
+        if (fraction * total <= sum)
+            return latencyBucketLimit(i);
+    }
+    return latencyBucketLimit(serverLatencyBuckets - 1);
+}
+
+/**
+ * The expected cost of using a server: its slow-case latency,
+ * stretched by the retries its recent failure rate implies.
+ */
+static double
+serverCost(const ServerInfo &serverInfo)
+{
+    double latency = latencyPercentile(serverInfo, 0.95);
+    if (!latency)
+        latency = serverInfo.responseTime;
+    return latency / (1 - std::min(serverInfo.failureRate, FAILURE_RATE_MAX));
+}
+
+bool sortServersByCost(ServerInfo si1, ServerInfo si2)
 {
-    return si1.responseTime < si2.responseTime;
+    return serverCost(si1) < serverCost(si2);
 }
 
 bool sortServersByScore(ServerInfo si1, ServerInfo si2)
@@ -42,6 +95,13 @@ int roundUpDivide(int x, int y)
     return (x % y) ? (x / y + 1) : (x / y);
 }
 
+static bool
+checkIfStratumServer(const std::string &str)
+{
+    return 0 == str.compare(0, STRATUM_PREFIX_LENGTH, STRATUM_PREFIX) ||
+           0 == str.compare(0, STRATUMS_PREFIX_LENGTH, STRATUMS_PREFIX);
+}
+
 static bool
 checkIfAirbitzServer(std::string str)
 {
@@ -67,11 +127,44 @@ struct ServerScoreJson:
     ABC_JSON_INTEGER(serverScore, "serverScore", 0)
     ABC_JSON_INTEGER(serverResponseTime, "serverResponseTime",
                      RESPONSE_TIME_UNINITIALIZED)
+    ABC_JSON_VALUE(serverLatency, "serverLatency", JsonArray)
+    ABC_JSON_NUMBER(serverFailureRate, "serverFailureRate", 0)
 };
 
-ServerCache::ServerCache(const std::string &path):
+/**
+ * Writes a snapshot of the scores out, best first.
+ * This runs on the write queue's thread.
+ */
+static Status
+serverCacheWrite(std::vector<ServerInfo> &serverInfos, const std::string &path)
+{
+    JsonArray serverScoresJsonArray;
+    std::sort(serverInfos.begin(), serverInfos.end(), sortServersByScore);
+    for (const auto &serverInfo: serverInfos)
+    {
+        ServerScoreJson ssj;
+        ABC_CHECK(ssj.serverUrlSet(serverInfo.serverUrl));
+        ABC_CHECK(ssj.serverScoreSet(serverInfo.score));
+        ABC_CHECK(ssj.serverResponseTimeSet(serverInfo.responseTime));
+        JsonArray latencyJson;
+        for (auto count: serverInfo.latencyHistogram)
+            ABC_CHECK(latencyJson.append(json_real(count)));
+        ABC_CHECK(ssj.serverLatencySet(latencyJson));
+        ABC_CHECK(ssj.serverFailureRateSet(serverInfo.failureRate));
+        ABC_CHECK(serverScoresJsonArray.append(ssj));
+        ABC_DebugLevel(2, "ServerCache::save %d %d ms %s",
+                       serverInfo.score, serverInfo.responseTime,
+                       serverInfo.serverUrl.c_str())
+    }
+    return serverScoresJsonArray.saveChecked(path);
+}
+
+ServerCache::ServerCache(const std::string &path,
+                         std::shared_ptr<SharedState> shared):
     path_(path),
+    shared_(shared),
     dirty_(false),
+    saveFailed_(std::make_shared<std::atomic<bool>>(false)),
     lastUpScoreTime_(0),
     cacheLastSave_(0)
 {
@@ -89,12 +182,13 @@ ServerCache::serverCacheLoad()
 {
     std::lock_guard<std::mutex> lock(mutex_);
     ABC_Debug(2, "ServerCache::load()");
+    seen_ = shared_->get(SharedSlot::serverScores);
 
     // Load the saved server scores if they exist
     JsonArray serverScoresJsonArray;
 
     // It's ok if this fails
-    serverScoresJsonArray.load(path_).log();
+    serverScoresJsonArray.loadChecked(path_).log();
 
     // Add any new servers coming out of the auth server
     std::vector<std::string> bitcoinServers = generalBitcoinServers();
@@ -170,7 +264,26 @@ ServerCache::serverCacheLoad()
             serverInfo.score = serverScore;
         serverInfo.responseTime = serverResponseTime;
         serverInfo.numResponseTimes = 0;
+
+        // Old measurements count for half on each bootup,
+        // not each time another wallet loads the same cache:
+        const double decay = 0 == cacheLastSave_ ? 0.5 : 1;
+        auto latencyJson = ssj.serverLatency();
+        for (size_t i = 0; i < serverLatencyBuckets; ++i)
+        {
+            serverInfo.latencyHistogram[i] = 0;
+            if (i < latencyJson.size() &&
+                    json_is_number(latencyJson[i].get()))
+                serverInfo.latencyHistogram[i] =
+                    json_number_value(latencyJson[i].get()) * decay;
+        }
+        serverInfo.failureRate = ssj.serverFailureRate() * decay;
         servers_[serverUrl] = serverInfo;
+
+        // Saving the decayed values sets `cacheLastSave_`,
+        // which keeps later loads from decaying them again:
+        if (0 == cacheLastSave_)
+            dirty_ = true;
         ABC_DebugLevel(1, "ServerCache::load %d %d ms %s",
                        serverInfo.score, serverInfo.responseTime, serverInfo.serverUrl.c_str())
 
@@ -183,7 +296,10 @@ Status
 ServerCache::save_nolock()
 {
     ABC_Debug(2, "ServerCache::save()");
-    JsonArray serverScoresJsonArray;
+
+    // Changes from a write that failed still need to go out:
+    if (saveFailed_->exchange(false))
+        dirty_ = true;
 
     if (dirty_)
     {
@@ -192,26 +308,28 @@ ServerCache::save_nolock()
         if (10 <= now - cacheLastSave_)
         {
             cacheLastSave_ = now;
-            std::vector<ServerInfo> serverInfos;
+            dirty_ = false;
 
+            // Copy from map to vector so the worker can sort it:
+            std::vector<ServerInfo> serverInfos;
+            serverInfos.reserve(servers_.size());
             for (const auto &server: servers_)
-            {
-                // Copy from map to vector so we can sort it.
                 serverInfos.push_back(server.second);
-            }
-            std::sort(serverInfos.begin(), serverInfos.end(), sortServersByScore);
-            for (const auto &serverInfo: serverInfos)
+
+            const auto path = path_;
+            const auto shared = shared_;
+            auto failed = saveFailed_;
+            writeQueueAdd(path, [serverInfos, path, shared, failed]() mutable
             {
-                ServerScoreJson ssj;
-                ABC_CHECK(ssj.serverUrlSet(serverInfo.serverUrl));
-                ABC_CHECK(ssj.serverScoreSet(serverInfo.score));
-                ABC_CHECK(ssj.serverResponseTimeSet(serverInfo.responseTime));
-                ABC_CHECK(serverScoresJsonArray.append(ssj));
-                ABC_DebugLevel(2, "ServerCache::save %d %d ms %s",
-                               serverInfo.score, serverInfo.responseTime, serverInfo.serverUrl.c_str())
-            }
-            ABC_CHECK(serverScoresJsonArray.save(path_));
-            dirty_ = false;
+                const Status s = serverCacheWrite(serverInfos, path);
+                if (!s)
+                {
+                    *failed = true; // The next save tries again
+                    return s;
+                }
+                shared->bump(SharedSlot::serverScores);
+                return Status();
+            });
         }
         else
         {
@@ -222,6 +340,43 @@ ServerCache::save_nolock()
     return Status();
 }
 
+void
+ServerCache::follow_nolock()
+{
+    const auto version = shared_->get(SharedSlot::serverScores);
+    if (version == seen_ || dirty_ || *saveFailed_)
+        return;
+    seen_ = version;
+
+    JsonArray serverScoresJsonArray;
+    if (!serverScoresJsonArray.loadChecked(path_).log())
+        return;
+
+    // Only servers we already know about, since the list comes from auth:
+    size_t size = serverScoresJsonArray.size();
+    for (size_t i = 0; i < size; i++)
+    {
+        ServerScoreJson ssj = serverScoresJsonArray[i];
+        auto svr = servers_.find(ssj.serverUrl());
+        if (servers_.end() == svr)
+            continue;
+
+        ServerInfo &serverInfo = svr->second;
+        serverInfo.score = ssj.serverScore();
+        serverInfo.responseTime = ssj.serverResponseTime();
+        auto latencyJson = ssj.serverLatency();
+        for (size_t j = 0; j < serverLatencyBuckets; ++j)
+        {
+            if (j < latencyJson.size() &&
+                    json_is_number(latencyJson[j].get()))
+                serverInfo.latencyHistogram[j] =
+                    json_number_value(latencyJson[j].get());
+        }
+        serverInfo.failureRate = ssj.serverFailureRate();
+    }
+    ABC_Debug(2, "ServerCache::follow() adopted shared scores");
+}
+
 Status
 ServerCache::serverCacheSave()
 {
@@ -233,18 +388,22 @@ Status
 ServerCache::serverScoreUp(std::string serverUrl, int changeScore)
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    follow_nolock();
 
     auto svr = servers_.find(serverUrl);
     if (servers_.end() != svr)
     {
-        ServerInfo serverInfo = svr->second;
-        serverInfo.score += changeScore;
-        if (serverInfo.score > MAX_SCORE)
-            serverInfo.score = MAX_SCORE;
-        servers_[serverUrl] = serverInfo;
-        dirty_ = true;
-        ABC_Debug(2, "serverScoreUp:" + serverUrl + " " + std::to_string(
-                      serverInfo.score));
+        ServerInfo &serverInfo = svr->second;
+        const int score = std::min(serverInfo.score + changeScore, MAX_SCORE);
+
+        // A zero change only keeps the network alive, with nothing to save:
+        if (score != serverInfo.score)
+        {
+            serverInfo.score = score;
+            dirty_ = true;
+            ABC_Debug(2, "serverScoreUp:" + serverUrl + " " + std::to_string(
+                          serverInfo.score));
+        }
     }
     lastUpScoreTime_ = time(nullptr);
     return Status();
@@ -254,6 +413,7 @@ Status
 ServerCache::serverScoreDown(std::string serverUrl, int changeScore)
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    follow_nolock();
 
     time_t currentTime = time(nullptr);
 
@@ -271,6 +431,7 @@ ServerCache::serverScoreDown(std::string serverUrl, int changeScore)
         serverInfo.score -= changeScore;
         if (serverInfo.score < MIN_SCORE)
             serverInfo.score = MIN_SCORE;
+        serverInfo.failureRate += FAILURE_WEIGHT * (1 - serverInfo.failureRate);
         servers_[serverUrl] = serverInfo;
         dirty_ = true;
         ABC_Debug(2, "serverScoreDown:" + serverUrl + " " + std::to_string(
@@ -297,43 +458,60 @@ void
 ServerCache::setResponseTime(std::string serverUrl,
                              unsigned long long responseTimeMilliseconds)
 {
-    // Collects that last 10 response time values to provide an average response time.
-    // This is used in weighting the score of a particular server
+    std::lock_guard<std::mutex> lock(mutex_);
+    follow_nolock();
+
+    // Keeps a decaying histogram alongside the moving average,
+    // so outliers don't dominate and old samples fade away:
     auto svr = servers_.find(serverUrl);
     if (servers_.end() != svr)
     {
-        ServerInfo serverInfo = svr->second;
+        ServerInfo &serverInfo = svr->second;
         serverInfo.numResponseTimes++;
 
         unsigned long long oldtime = serverInfo.responseTime;
         unsigned long long newTime = 0;
         if (RESPONSE_TIME_UNINITIALIZED == oldtime)
-        {
             newTime = responseTimeMilliseconds;
-        }
         else
-        {
-            // Every 10th setting of response time, decrease effect of prior values by 5x
-            if (serverInfo.numResponseTimes % 10 == 0)
-            {
-                newTime = (oldtime + (responseTimeMilliseconds * 4)) / 5;
-            }
-            else
-            {
-                newTime = (oldtime + responseTimeMilliseconds) / 2;
-            }
-        }
+            newTime = (1 - RESPONSE_TIME_WEIGHT) * oldtime +
+                      RESPONSE_TIME_WEIGHT * responseTimeMilliseconds;
         serverInfo.responseTime = newTime;
-        servers_[serverUrl] = serverInfo;
+
+        size_t bucket = 0;
+        while (bucket + 1 < serverLatencyBuckets &&
+                latencyBucketLimit(bucket) <= responseTimeMilliseconds)
+            ++bucket;
+        for (auto &count: serverInfo.latencyHistogram)
+            count *= LATENCY_DECAY;
+        serverInfo.latencyHistogram[bucket] += 1;
+
+        serverInfo.failureRate *= 1 - FAILURE_WEIGHT;
+        dirty_ = true;
+
         ABC_Debug(2, "setResponseTime:" + serverUrl + " oldTime:" + std::to_string(
-                      oldtime) + " newTime:" + std::to_string(newTime));
+                      oldtime) + " newTime:" + std::to_string(newTime) +
+                  " p50:" + std::to_string(latencyPercentile(serverInfo, 0.5)) +
+                  " p95:" + std::to_string(latencyPercentile(serverInfo, 0.95)));
     }
 }
 
+unsigned long
+ServerCache::responseTimePercentile(std::string serverUrl, double fraction)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto svr = servers_.find(serverUrl);
+    if (servers_.end() == svr)
+        return 0;
+    return latencyPercentile(svr->second, fraction);
+}
+
 std::vector<std::string>
 ServerCache::getServers(ServerType type, unsigned int numServersWanted)
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    follow_nolock();
     std::vector<ServerInfo> serverInfos;
     std::vector<ServerInfo> newServerInfos;
     std::vector<std::string> servers;
@@ -349,12 +527,12 @@ ServerCache::getServers(ServerType type, unsigned int numServersWanted)
     {
         if (ServerTypeStratum == type)
         {
-            if (0 != server.first.compare(0, STRATUM_PREFIX_LENGTH, STRATUM_PREFIX))
+            if (!checkIfStratumServer(server.first))
                 continue;
         }
         else if (ServerTypeAirbitz == type)
         {
-            if (0 != server.first.compare(0, STRATUM_PREFIX_LENGTH, STRATUM_PREFIX))
+            if (!checkIfStratumServer(server.first))
                 continue;
             if (!checkIfAirbitzServer(server.first))
                 continue;
@@ -412,7 +590,8 @@ ServerCache::getServers(ServerType type, unsigned int numServersWanted)
         serverEnd = it;
     }
 
-    std::sort(serverStart, serverEnd, sortServersByTime);
+    // Rank the top servers by current latency and reliability:
+    std::sort(serverStart, serverEnd, sortServersByCost);
 
 
     int numNewServers = 0;
@@ -463,4 +642,57 @@ ServerCache::getServers(ServerType type, unsigned int numServersWanted)
     return servers;
 
 }
+
+ServerSocketPtr
+ServerCache::socketClaim(const std::string &serverUrl, bool priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto limit = priority ? SOCKETS_MAX :
+                       SOCKETS_MAX - SOCKETS_PRIORITY_RESERVE;
+    const auto i = sockets_.find(serverUrl);
+    const size_t count = sockets_.end() != i ? i->second : 0;
+    if (limit <= socketsTotal_ || SOCKETS_PER_SERVER <= count)
+    {
+        ABC_DebugLevel(1, "socketClaim: no room for %s (%d total, %d here)",
+                       serverUrl.c_str(), socketsTotal_, count);
+        return ServerSocketPtr();
+    }
+
+    ++sockets_[serverUrl];
+    ++socketsTotal_;
+    return ServerSocketPtr(new ServerSocket(*this, serverUrl));
+}
+
+size_t
+ServerCache::socketCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return socketsTotal_;
+}
+
+void
+ServerCache::socketRelease(const std::string &serverUrl)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto i = sockets_.find(serverUrl);
+    if (sockets_.end() == i)
+        return;
+    if (!--i->second)
+        sockets_.erase(i);
+    --socketsTotal_;
+}
+
+ServerSocket::~ServerSocket()
+{
+    cache_.socketRelease(serverUrl_);
+}
+
+ServerSocket::ServerSocket(ServerCache &cache, const std::string &serverUrl):
+    cache_(cache),
+    serverUrl_(serverUrl)
+{
+}
+
 } // namespace abcd
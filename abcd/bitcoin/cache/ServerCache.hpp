@@ -10,8 +10,11 @@
 
 #include "../../util/Status.hpp"
 #include <bitcoin/bitcoin.hpp>
+#include <array>
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <vector>
@@ -24,16 +27,50 @@ typedef enum
     ServerTypeAirbitz
 } ServerType;
 
+/**
+ * Number of buckets in each server's latency histogram.
+ * Bucket `i` holds replies faster than 25ms * 2^i.
+ */
+constexpr size_t serverLatencyBuckets = 16;
+
 typedef struct
 {
     std::string serverUrl;
     int score;
+    /** Exponentially-weighted average response time, in ms. */
     unsigned long responseTime;
     unsigned long numResponseTimes;
+    /** Decaying counts of recent response times. */
+    std::array<double, serverLatencyBuckets> latencyHistogram;
+    /** Decaying fraction of recent interactions that failed. */
+    double failureRate;
 } ServerInfo;
 
+class ServerCache;
+class SharedState;
+
+/**
+ * One slot in the process-wide socket budget,
+ * handed back to the server cache when this goes away.
+ */
+class ServerSocket
+{
+public:
+    ~ServerSocket();
+    ServerSocket(ServerCache &cache, const std::string &serverUrl);
+
+    ServerSocket(const ServerSocket &copy) = delete;
+    ServerSocket &operator=(const ServerSocket &copy) = delete;
+
+private:
+    ServerCache &cache_;
+    const std::string serverUrl_;
+};
+typedef std::unique_ptr<ServerSocket> ServerSocketPtr;
+
 /**
  * A block-height cache.
+ * Other processes sharing the root pick up each other's saved scores.
  */
 class ServerCache
 {
@@ -41,7 +78,7 @@ public:
 
     // Lifetime ------------------------------------------------------------
 
-    ServerCache(const std::string &path);
+    ServerCache(const std::string &path, std::shared_ptr<SharedState> shared);
 
     /**
      * Clears the cache in case something goes wrong.
@@ -57,6 +94,8 @@ public:
 
     /**
      * Saves the database contents to disk, but only if there are changes.
+     * This copies the scores under the lock, and leaves the encoding
+     * and disk write to the write-behind queue.
      */
     Status
     serverCacheSave();
@@ -80,6 +119,14 @@ public:
     setResponseTime(std::string serverUrl,
                     unsigned long long responseTimeMilliseconds);
 
+    /**
+     * Estimates the given percentile (0 to 1) of the server's recent
+     * response times, in ms.
+     * Returns 0 if there are no measurements.
+     */
+    unsigned long
+    responseTimePercentile(std::string serverUrl, double fraction);
+
     /**
      * Get a vector of server URLs by type. This returns the top 'numServers' of servers with
      * the highest connectivity score
@@ -90,17 +137,54 @@ public:
     static
     unsigned long long getCurrentTimeMilliSeconds();
 
+    // Sockets -------------------------------------------------------------
+
+    /**
+     * Claims a socket to the given server out of the budget
+     * shared by every watcher in the process.
+     * No server gets more than a few sockets at once,
+     * and background claims leave enough room for a priority watcher
+     * to open a full set.
+     * @return null if the budget is used up.
+     */
+    ServerSocketPtr
+    socketClaim(const std::string &serverUrl, bool priority);
+
+    /**
+     * The number of sockets currently claimed.
+     */
+    size_t
+    socketCount() const;
+
 private:
+    friend class ServerSocket;
+
+    void
+    socketRelease(const std::string &serverUrl);
+
     Status
     save_nolock();
 
+    /**
+     * Adopts the scores another process has saved since we last looked,
+     * unless we have changes of our own waiting to go out.
+     */
+    void
+    follow_nolock();
+
     mutable std::mutex mutex_;
     const std::string path_;
+    const std::shared_ptr<SharedState> shared_;
+    uint64_t seen_ = 0; // The last shared save we have loaded
     bool dirty_;
+    std::shared_ptr<std::atomic<bool>> saveFailed_; // Set by the write queue
     time_t lastUpScoreTime_;
     time_t cacheLastSave_;
 
     std::map<std::string, ServerInfo> servers_;
+
+    std::map<std::string, size_t> sockets_; // Claimed sockets by server
+    size_t socketsTotal_ = 0;
 };
 
 } // namespace abcd
@@ -7,35 +7,36 @@
 
 #include "TxCache.hpp"
 #include "BlockCache.hpp"
+#include "../TxView.hpp"
 #include "../Utility.hpp"
 #include "../../crypto/Encoding.hpp"
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
+#include "../../json/JsonSchema.hpp"
 #include "../../util/Debug.hpp"
-#include <unordered_set>
+#include "../../util/FileIO.hpp"
+#include "../../util/MappedFile.hpp"
+#include "../../util/WriteQueue.hpp"
+#include <algorithm>
+#include <atomic>
 
-namespace std {
+namespace abcd {
 
-/**
- * Allows `bc::point_type` to be used with `std::unordered_set`.
- */
-template<> struct hash<bc::point_type>
-{
-    typedef bc::point_type argument_type;
-    typedef std::size_t result_type;
+constexpr size_t decodedMax = 64;
 
-    result_type
-    operator()(argument_type const &p) const
-    {
-        auto h = libbitcoin::from_little_endian_unsafe<result_type>(
-                     p.hash.begin());
-        return h ^ p.index;
-    }
-};
+// Unconfirmed transactions younger than this are never dropped:
+constexpr time_t dropAge = 60*60;
 
-} // namespace std
+// Pruning visits every confirmed row, so only do it about once a day:
+constexpr size_t prunePeriod = 144;
 
-namespace abcd {
+static std::atomic<size_t> gPruneDepth(0);
+
+void
+txCachePruneDepthSet(size_t depth)
+{
+    gPruneDepth = depth;
+}
 
 libbitcoin::output_info_list
 filterOutputs(const TxOutputList &utxos, bool filter)
@@ -55,113 +56,122 @@ filterOutputs(const TxOutputList &utxos, bool filter)
     return out;
 }
 
-typedef std::unordered_set<bc::point_type> PointSet;
+// Problem flags:
+constexpr unsigned doubleSpent = 1 << 0;
+constexpr unsigned replaceByFee = 1 << 1;
 
-/**
- * Knows how to check a transaction for double-spends and other problems.
- * This uses a memoized recursive function to do the graph search,
- * so the more checks this object performs,
- * the faster those checks can potentially become (for a fixed graph).
- */
-class TxGraph
+struct CacheJson:
+    public JsonObject
 {
-public:
-    static constexpr unsigned doubleSpent = 1 << 0;
-    static constexpr unsigned replaceByFee = 1 << 1;
-
-    TxGraph(const TxCache &cache):
-        cache_(cache)
-    {
-        for (auto &row: cache_.txs_)
-        {
-            for (auto &input: row.second.inputs)
-            {
-                if (!spends_.insert(input.previous_output).second)
-                    doubleSpends_.insert(input.previous_output);
-            }
-        }
-    }
-
-    /**
-     * Returns true if the output point has been spent from.
-     */
-    bool isSpent(bc::output_point point)
-    {
-        return spends_.count(point);
-    }
+    ABC_JSON_CONSTRUCTORS(CacheJson, JsonObject)
 
-    /**
-     * Recursively checks the transaction graph for problems.
-     * @return A bitfield containing problem flags.
-     */
-    unsigned
-    problems(const std::string &txid)
-    {
-        // Just use the previous result if we have been here before:
-        auto vi = visited_.find(txid);
-        if (visited_.end() != vi)
-            return vi->second;
+    ABC_JSON_VALUE(txs, "txs", JsonArray)
+    ABC_JSON_VALUE(heights, "heights", JsonArray)
+};
 
-        // We have to assume missing transactions are safe:
-        auto i = cache_.txs_.find(txid);
-        if (cache_.txs_.end() == i)
-            return (visited_[txid] = 0);
+struct TxJsonRow
+{
+    std::string txid;
+    std::string data;
+};
 
-        // Confirmed transactions are also safe:
-        if (cache_.txidHeight(txid))
-            return (visited_[txid] = 0);
+static const auto txSchema = jsonSchema(
+    jsonField("txid", &TxJsonRow::txid, jsonRequired),
+    jsonField("data", &TxJsonRow::data, jsonRequired));
 
-        // Check for the opt-in replace-by-fee flag:
-        unsigned out = 0;
-        if (isReplaceByFee(i->second))
-            out |= replaceByFee;
+struct HeightJsonRow
+{
+    std::string txid;
+    json_int_t height = 0;
+    json_int_t firstSeen = 0;
+};
 
-        // Recursively check all the inputs:
-        for (const auto &input: i->second.inputs)
-        {
-            out |= problems(bc::encode_hash(input.previous_output.hash));
-            if (doubleSpends_.count(input.previous_output))
-                out |= doubleSpent;
-        }
-        return (visited_[txid] = out);
-    }
+static const auto heightSchema = jsonSchema(
+    jsonField("txid", &HeightJsonRow::txid, jsonRequired),
+    jsonField("height", &HeightJsonRow::height),
+    jsonField("firstSeen", &HeightJsonRow::firstSeen));
 
-private:
-    const TxCache &cache_;
+/**
+ * The binary log starts with a magic number,
+ * followed by a series of records. Each record has a type byte,
+ * a 4-byte little-endian payload size, and the payload itself.
+ * The payload always begins with the 32-byte transaction hash.
+ * Later records override earlier ones, so updates are simple appends.
+ */
+constexpr uint32_t logMagic = 0xfecdb764;
 
-    PointSet spends_;
-    PointSet doubleSpends_;
-    std::map<std::string, unsigned> visited_;
+enum LogRecord: uint8_t
+{
+    logTx = 1, // Hash, then the satoshi-serialized transaction
+    logHeight = 2, // Hash, then 8-byte height and 8-byte first-seen time
+    logDrop = 3, // Hash only
+    logSummary = 4 // Hash, then a pruned transaction's summary fields
 };
 
-struct CacheJson:
-    public JsonObject
+static void
+logInt(DataChunk &out, uint64_t value, size_t bytes)
 {
-    ABC_JSON_CONSTRUCTORS(CacheJson, JsonObject)
-
-    ABC_JSON_VALUE(txs, "txs", JsonArray)
-    ABC_JSON_VALUE(heights, "heights", JsonArray)
-};
+    for (size_t i = 0; i < bytes; ++i)
+        out.push_back(static_cast<uint8_t>(value >> 8 * i));
+}
 
-struct TxJson:
-    public JsonObject
+static void
+logRecord(DataChunk &out, LogRecord type, const bc::hash_digest &hash,
+          DataSlice body=DataSlice())
 {
-    ABC_JSON_CONSTRUCTORS(TxJson, JsonObject)
+    out.push_back(type);
+    logInt(out, hash.size() + body.size(), 4);
+    out.insert(out.end(), hash.begin(), hash.end());
+    out.insert(out.end(), body.begin(), body.end());
+}
 
-    ABC_JSON_STRING(txid, "txid", 0)
-    ABC_JSON_STRING(data, "data", 0)
-};
+static void
+logString(DataChunk &out, const std::string &value)
+{
+    // Addresses are always short:
+    out.push_back(static_cast<uint8_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
 
-struct HeightJson:
-    public JsonObject
+static void
+logHeightRecord(DataChunk &out, const bc::hash_digest &hash,
+                size_t height, time_t firstSeen)
 {
-    ABC_JSON_CONSTRUCTORS(HeightJson, JsonObject)
+    DataChunk body;
+    logInt(body, height, 8);
+    logInt(body, firstSeen, 8);
+    logRecord(out, logHeight, hash, body);
+}
 
-    ABC_JSON_STRING(txid, "txid", 0)
-    ABC_JSON_INTEGER(height, "height", 0)
-    ABC_JSON_INTEGER(firstSeen, "firstSeen", 0)
-};
+/**
+ * Serializes a transaction for a new row,
+ * unless another wallet has already done so.
+ */
+static SharedTxData
+txShare(const bc::hash_digest &hash, const bc::transaction_type &tx)
+{
+    auto data = txStoreFind(hash);
+    if (!data)
+    {
+        DataChunk rawTx(satoshi_raw_size(tx));
+        bc::satoshi_save(tx, rawTx.begin());
+        data = txStoreShare(hash, std::move(rawTx));
+    }
+    return data;
+}
 
+/**
+ * Converts a txid from the public interface into a map key.
+ * Malformed txids become the null hash, which never matches a row.
+ */
+static bc::hash_digest
+txidHash(const std::string &txid)
+{
+    bc::hash_digest out;
+    if (!bc::decode_hash(out, txid))
+        return bc::null_hash;
+    return out;
+}
 
 TxCache::TxCache(BlockCache &blockCache):
     blocks_(blockCache)
@@ -171,31 +181,57 @@ TxCache::TxCache(BlockCache &blockCache):
 void
 TxCache::clear()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    WriteLock lock(mutex_);
+    for (const auto &row: txs_)
+        touch(row.first);
     txs_.clear();
     heights_.clear();
+    heightIndex_.clear();
+    file_.reset();
+    addressNames_.clear();
+    decoded_.clear();
+    decodedIndex_.clear();
+    infos_.clear();
+    refetch_.clear();
+    prunedHeight_ = 0;
+    expiry_.clear();
+    expiryDue_.clear();
+    spenders_.clear();
+    unspent_.clear();
+    problems_.clear();
+    balance_ = TxBalance();
+    txBalances_.clear();
+    journal_.clear();
+    journalRecords_ = 0;
+    logCompact_ = true;
 }
 
 Status
 TxCache::load(JsonObject &json)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    WriteLock lock(mutex_);
     CacheJson cacheJson(json);
+    infos_.clear();
 
     // Tx data:
     auto txsJson = cacheJson.txs();
     size_t txsSize = txsJson.size();
     for (size_t i = 0; i < txsSize; i++)
     {
-        TxJson txJson(txsJson[i]);
-        if (txJson.txidOk() && txJson.dataOk())
+        TxJsonRow txJson;
+        if (txSchema.decode(txJson, json_array_get(txsJson.get(), i)))
         {
             DataChunk rawTx;
-            ABC_CHECK(base64Decode(rawTx, txJson.data()));
-            bc::transaction_type tx;
-            ABC_CHECK(decodeTx(tx, rawTx));
-
-            txs_[txJson.txid()] = std::move(tx);
+            ABC_CHECK(base64Decode(rawTx, txJson.data));
+            const auto hash = txidHash(txJson.txid);
+            const auto data = txStoreShare(hash, std::move(rawTx));
+            TxView view;
+            ABC_CHECK(view.parse(*data));
+
+            auto &row = txs_[hash];
+            row = TxRow();
+            rowMake(row, view, addressNames_);
+            row.rawSet(data);
         }
     }
 
@@ -204,83 +240,454 @@ TxCache::load(JsonObject &json)
     size_t heightsSize = heightsJson.size();
     for (size_t i = 0; i < heightsSize; i++)
     {
-        HeightJson heightJson(heightsJson[i]);
-        if (heightJson.txidOk())
+        HeightJsonRow heightJson;
+        if (heightSchema.decode(heightJson,
+                                json_array_get(heightsJson.get(), i)))
         {
             HeightInfo info;
-            info.height = heightJson.height();
-            info.firstSeen = heightJson.firstSeen();
-            heights_[heightJson.txid()] = info;
+            info.height = heightJson.height;
+            info.firstSeen = heightJson.firstSeen;
+            heights_[txidHash(heightJson.txid)] = info;
             blocks_.headerNeededAdd(info.height);
         }
     }
 
+    indexRebuild();
+    logCompact_ = true;
     return Status();
 }
 
 Status
-TxCache::save(JsonObject &json)
+TxCache::loadLog(const std::string &path)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    CacheJson cacheJson(json);
+    if (writeQueuePending(path))
+        ABC_CHECK(writeQueueFlush(path));
 
-    // Tx data:
-    JsonArray txsJson;
-    for (const auto &tx: txs_)
+    std::shared_ptr<MappedFile> file;
+    ABC_CHECK(MappedFile::create(file, path));
+    const auto data = file->data();
+    auto serial = bc::make_deserializer(data.begin(), data.end());
+
+    TxidMap<TxRow> txs;
+    TxidMap<HeightInfo> heights;
+    AddressNames names;
+    size_t records = 0;
+    bool truncated = false;
+
+    try
     {
-        bc::data_chunk rawTx(satoshi_raw_size(tx.second));
-        bc::satoshi_save(tx.second, rawTx.begin());
+        if (logMagic != serial.read_4_bytes())
+            return ABC_ERROR(ABC_CC_ParseError,
+                             "Unknown transaction cache header");
+
+        while (data.end() != serial.iterator())
+        {
+            // A partial append is harmless, since we can compact it away:
+            size_t left = data.end() - serial.iterator();
+            if (left < 5)
+            {
+                truncated = true;
+                break;
+            }
+            const auto type = serial.read_byte();
+            const size_t size = serial.read_4_bytes();
+            if (left - 5 < size || size < sizeof(bc::hash_digest))
+            {
+                truncated = true;
+                break;
+            }
+
+            // Leave the record in place, so the raw tx can point to it:
+            const DataSlice body(serial.iterator(), serial.iterator() + size);
+            serial.set_iterator(body.end());
+            ++records;
+
+            bc::hash_digest hash;
+            std::copy(body.begin(), body.begin() + hash.size(), hash.begin());
+            const DataSlice rest(body.begin() + hash.size(), body.end());
 
-        TxJson txJson;
-        ABC_CHECK(txJson.txidSet(tx.first));
-        ABC_CHECK(txJson.dataSet(base64Encode(rawTx)));
-        ABC_CHECK(txsJson.append(txJson));
+            if (logTx == type)
+            {
+                TxView view;
+                ABC_CHECK(view.parse(rest));
+
+                auto &row = txs[hash];
+                row = TxRow();
+                rowMake(row, view, names);
+                row.raw = rest;
+            }
+            else if (logSummary == type)
+            {
+                auto &row = txs[hash];
+                row = TxRow();
+                ABC_CHECK(rowParse(row, rest));
+            }
+            else if (logHeight == type)
+            {
+                auto fields = bc::make_deserializer(rest.begin(), rest.end());
+                HeightInfo info;
+                info.height = fields.read_8_bytes();
+                info.firstSeen = fields.read_8_bytes();
+                heights[hash] = info;
+            }
+            else if (logDrop == type)
+            {
+                txs.erase(hash);
+                heights.erase(hash);
+            }
+        }
+    }
+    catch (bc::end_of_stream)
+    {
+        return ABC_ERROR(ABC_CC_ParseError, "Truncated transaction cache");
     }
-    cacheJson.txsSet(txsJson);
 
-    // Heights:
-    JsonArray heightsJson;
+    WriteLock lock(mutex_);
+    for (const auto &row: txs_)
+        touch(row.first);
+    txs_ = std::move(txs);
+    heights_ = std::move(heights);
+    file_ = std::move(file);
+    addressNames_ = std::move(names);
+    decoded_.clear();
+    decodedIndex_.clear();
+    infos_.clear();
     for (const auto &height: heights_)
+        blocks_.headerNeededAdd(height.second.height);
+    indexRebuild();
+
+    journal_.clear();
+    journalRecords_ = 0;
+    logRecords_ = records;
+    logCompact_ = truncated;
+
+    return Status();
+}
+
+Status
+TxCache::save(const std::string &path)
+{
+    // Keeps the records in order, since the cache lock drops below:
+    std::lock_guard<std::mutex> saveLock(saveMutex_);
+
+    DataChunk data;
+    bool rewrite = false;
     {
-        HeightJson heightJson;
-        ABC_CHECK(heightJson.txidSet(height.first));
-        if (height.second.height)
-            ABC_CHECK(heightJson.heightSet(height.second.height));
-        ABC_CHECK(heightJson.firstSeenSet(height.second.firstSeen));
-        ABC_CHECK(heightsJson.append(heightJson));
+        WriteLock lock(mutex_);
+
+        const size_t depth = gPruneDepth;
+        const auto height = blocks_.height();
+        if (depth && prunedHeight_ + prunePeriod <= height)
+        {
+            pruneInternal(depth);
+            prunedHeight_ = height;
+        }
+
+        // Rewrite the whole log if it is mostly stale records:
+        const auto live = txs_.size() + heights_.size();
+        if (logCompact_ || 2 * live + 64 < logRecords_ + journalRecords_)
+        {
+            logInt(data, logMagic, 4);
+            for (const auto &tx: txs_)
+                logRow(data, tx.first, tx.second);
+            for (const auto &height: heights_)
+                logHeightRecord(data, height.first, height.second.height,
+                                height.second.firstSeen);
+
+            // Rows loaded earlier still point into the old mapping,
+            // which stays valid after the rename.
+            rewrite = true;
+            logRecords_ = live;
+            logCompact_ = false;
+        }
+        else
+        {
+            data = std::move(journal_);
+            logRecords_ += journalRecords_;
+        }
+
+        journal_.clear();
+        journalRecords_ = 0;
+    }
+
+    // The pending lock is never taken with the cache lock held,
+    // since the queued write below holds it during disk I/O:
+    auto pending = logPending_;
+    {
+        std::lock_guard<std::mutex> pendingLock(pending->mutex);
+        if (rewrite)
+        {
+            pending->data = std::move(data);
+            pending->rewrite = true;
+        }
+        else
+        {
+            pending->data.insert(pending->data.end(),
+                                 data.begin(), data.end());
+        }
+
+        // An earlier write that failed leaves its data behind,
+        // so it goes back on the queue even if nothing is new:
+        if (pending->data.empty() && !pending->rewrite)
+            return Status();
     }
-    cacheJson.heightsSet(heightsJson);
 
+    // Every queued write shares the pending buffer,
+    // so a newer one replacing an older one loses nothing:
+    writeQueueAdd(path, [pending, path]()
+    {
+        std::lock_guard<std::mutex> pendingLock(pending->mutex);
+        if (pending->rewrite)
+            ABC_CHECK(fileSave(pending->data, path));
+        else
+            ABC_CHECK(fileAppend(pending->data, path));
+        pending->data.clear();
+        pending->rewrite = false;
+        return Status();
+    });
     return Status();
 }
 
+DataChunk
+TxCache::snapshot() const
+{
+    ReadLock lock(mutex_);
+
+    DataChunk out;
+    logInt(out, logMagic, 4);
+    for (const auto &tx: txs_)
+        logRow(out, tx.first, tx.second);
+    for (const auto &height: heights_)
+        logHeightRecord(out, height.first, height.second.height,
+                        height.second.firstSeen);
+    return out;
+}
+
 Status
-TxCache::get(bc::transaction_type &result, const std::string &txid) const
+TxCache::loadSnapshot(DataSlice data)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto serial = bc::make_deserializer(data.begin(), data.end());
 
-    auto i = txs_.find(txid);
-    if (txs_.end() == i)
-        return ABC_ERROR(ABC_CC_Synchronizing, "Cannot find transaction");
+    // Parse everything before touching the cache:
+    TxidMap<DataChunk> txs;
+    TxidMap<DataChunk> summaries;
+    TxidMap<HeightInfo> heights;
+    try
+    {
+        if (logMagic != serial.read_4_bytes())
+            return ABC_ERROR(ABC_CC_ParseError,
+                             "Unknown transaction snapshot header");
+
+        while (data.end() != serial.iterator())
+        {
+            const auto type = serial.read_byte();
+            const size_t size = serial.read_4_bytes();
+            if (size_t(data.end() - serial.iterator()) < size ||
+                    size < sizeof(bc::hash_digest))
+                return ABC_ERROR(ABC_CC_ParseError,
+                                 "Truncated transaction snapshot");
+
+            const DataSlice body(serial.iterator(), serial.iterator() + size);
+            serial.set_iterator(body.end());
+
+            bc::hash_digest hash;
+            std::copy(body.begin(), body.begin() + hash.size(), hash.begin());
+            const DataSlice rest(body.begin() + hash.size(), body.end());
+
+            if (logTx == type)
+            {
+                txs[hash] = DataChunk(rest.begin(), rest.end());
+            }
+            else if (logSummary == type)
+            {
+                summaries[hash] = DataChunk(rest.begin(), rest.end());
+            }
+            else if (logHeight == type)
+            {
+                auto fields = bc::make_deserializer(rest.begin(), rest.end());
+                HeightInfo info;
+                info.height = fields.read_8_bytes();
+                info.firstSeen = fields.read_8_bytes();
+                heights[hash] = info;
+            }
+        }
+    }
+    catch (bc::end_of_stream)
+    {
+        return ABC_ERROR(ABC_CC_ParseError, "Truncated transaction snapshot");
+    }
+
+    WriteLock lock(mutex_);
+    for (auto &tx: txs)
+    {
+        if (txs_.count(tx.first))
+            continue;
+
+        const auto shared = txStoreShare(tx.first, std::move(tx.second));
+        TxView view;
+        if (!view.parse(*shared).log())
+            continue;
+
+        auto &row = txs_[tx.first];
+        rowMake(row, view, addressNames_);
+        row.rawSet(shared);
+    }
+    for (const auto &summary: summaries)
+    {
+        if (txs_.count(summary.first))
+            continue;
 
-    result = i->second;
+        TxRow row;
+        if (!rowParse(row, summary.second).log())
+            continue;
+        txs_[summary.first] = std::move(row);
+    }
+    for (const auto &height: heights)
+    {
+        if (heights_.count(height.first))
+            continue;
+        heights_[height.first] = height.second;
+        blocks_.headerNeededAdd(height.second.height);
+    }
+    infos_.clear();
+    indexRebuild();
+    logCompact_ = true;
+
+    return Status();
+}
+
+size_t
+TxCache::memoryUsed() const
+{
+    ReadLock lock(mutex_);
+
+    size_t out = journal_.capacity();
+    for (const auto &tx: txs_)
+    {
+        out += sizeof(tx) + tx.second.ntxid.capacity() +
+               tx.second.inputs.capacity() * sizeof(TxRow::Input) +
+               tx.second.outputs.capacity() * sizeof(TxRow::Output);
+        if (tx.second.data)
+            out += tx.second.data->size();
+    }
+    out += heights_.size() * sizeof(*heights_.begin());
+    out += expiry_.size() * (sizeof(*expiry_.begin()) +
+                             sizeof(*expiryDue_.begin()));
+    for (const auto &block: heightIndex_)
+        out += sizeof(block) + block.second.size() * sizeof(bc::hash_digest);
+    out += spenders_.size() * (sizeof(*spenders_.begin()) +
+                               sizeof(bc::hash_digest));
+
+    {
+        // Decoded transactions are about twice their serialized size:
+        std::lock_guard<std::mutex> decodedLock(decodedMutex_);
+        for (const auto &tx: decoded_)
+            out += sizeof(tx) + 2 * bc::satoshi_raw_size(tx.second);
+    }
+    {
+        std::lock_guard<std::mutex> infosLock(infosMutex_);
+        for (const auto &info: infos_)
+            out += sizeof(info) + info.second.ios.capacity() * sizeof(TxInOut);
+    }
+    return out;
+}
+
+void
+TxCache::trim()
+{
+    ReadLock lock(mutex_);
+    {
+        std::lock_guard<std::mutex> decodedLock(decodedMutex_);
+        decoded_.clear();
+        decodedIndex_.clear();
+    }
+    {
+        std::lock_guard<std::mutex> infosLock(infosMutex_);
+        infos_.clear();
+    }
+}
+
+Status
+TxCache::get(bc::transaction_type &result, const std::string &txid) const
+{
+    ReadLock lock(mutex_);
+    ABC_CHECK(getInternal(result, txidHash(txid)));
     return Status();
 }
 
 Status
 TxCache::info(TxInfo &result, const bc::transaction_type &tx) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    ABC_CHECK(infoInternal(result, tx));
+    ReadLock lock(mutex_);
+
+    // The stored row already knows its ntxid:
+    const auto i = txs_.find(bc::hash_transaction(tx));
+    if (txs_.end() != i)
+        ABC_CHECK(infoInternal(result, i->first, i->second));
+    else
+        ABC_CHECK(infoInternal(result, tx));
     return Status();
 }
 
 Status
 TxCache::info(TxInfo &result, const std::string &txid) const
 {
+    ReadLock lock(mutex_);
+
+    auto i = txs_.find(txidHash(txid));
+    if (txs_.end() == i)
+        return ABC_ERROR(ABC_CC_Synchronizing, "Cannot find transaction");
+
+    ABC_CHECK(infoInternal(result, i->first, i->second));
+    return Status();
+}
+
+Status
+TxCache::getInternal(bc::transaction_type &result,
+                     const bc::hash_digest &hash) const
+{
+    // Use the recently-decoded list if possible.
+    // Readers share the main lock, so the list needs its own:
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex_);
+        auto di = decodedIndex_.find(hash);
+        if (decodedIndex_.end() != di)
+        {
+            decoded_.splice(decoded_.begin(), decoded_, di->second);
+            result = di->second->second;
+            return Status();
+        }
+    }
+
+    auto i = txs_.find(hash);
+    if (txs_.end() == i)
+        return ABC_ERROR(ABC_CC_Synchronizing, "Cannot find transaction");
+    if (i->second.isPruned)
+    {
+        std::lock_guard<std::mutex> lock(refetchMutex_);
+        refetch_.insert(hash);
+        return ABC_ERROR(ABC_CC_Synchronizing, "Transaction has been pruned");
+    }
+
     bc::transaction_type tx;
-    ABC_CHECK(get(tx, txid));
-    ABC_CHECK(info(result, tx));
+    ABC_CHECK(decodeTx(tx, i->second.raw));
+
+    // Remember the decoded transaction, evicting the oldest one:
+    std::lock_guard<std::mutex> lock(decodedMutex_);
+    if (decodedIndex_.count(hash))
+    {
+        result = std::move(tx);
+        return Status();
+    }
+    decoded_.emplace_front(hash, tx);
+    decodedIndex_[hash] = decoded_.begin();
+    if (decodedMax < decoded_.size())
+    {
+        decodedIndex_.erase(decoded_.back().first);
+        decoded_.pop_back();
+    }
+
+    result = std::move(tx);
     return Status();
 }
 
@@ -293,22 +700,22 @@ TxCache::infoInternal(TxInfo &result, const bc::transaction_type &tx) const
     // Basic info:
     out.txid = bc::encode_hash(bc::hash_transaction(tx));
     out.ntxid = bc::encode_hash(makeNtxid(tx));
+    out.ios.reserve(tx.inputs.size() + tx.outputs.size());
 
     // Scan inputs:
     for (const auto &input: tx.inputs)
     {
-        const auto txid = bc::encode_hash(input.previous_output.hash);
-        auto i = txs_.find(txid);
+        auto i = txs_.find(input.previous_output.hash);
         if (txs_.end() == i)
-            return ABC_ERROR(ABC_CC_Synchronizing, "Missing input " + txid);
+            return ABC_ERROR(ABC_CC_Synchronizing, "Missing input " +
+                             bc::encode_hash(input.previous_output.hash));
         if (i->second.outputs.size() <= input.previous_output.index)
-            return ABC_ERROR(ABC_CC_Error, "Impossible input on " + txid);
+            return ABC_ERROR(ABC_CC_Error, "Impossible input on " +
+                             bc::encode_hash(input.previous_output.hash));
         auto &output = i->second.outputs[input.previous_output.index];
 
         totalIn += output.value;
-        bc::payment_address address;
-        bc::extract(address, output.script);
-        out.ios.push_back(TxInOut{true, output.value, address.encoded()});
+        out.ios.push_back(TxInOut{true, output.value, output.address});
     }
 
     // Scan outputs:
@@ -316,47 +723,109 @@ TxCache::infoInternal(TxInfo &result, const bc::transaction_type &tx) const
     {
         totalOut += output.value;
         bc::payment_address address;
-        bc::extract(address, output.script);
-        out.ios.push_back(TxInOut{false, output.value, address.encoded()});
+        out.ios.push_back(TxInOut
+        {
+            false, output.value,
+            bc::extract(address, output.script) ? address.encoded() : ""
+        });
     }
 
     out.fee = totalIn - totalOut;
 
-    result = out;
+    result = std::move(out);
+    return Status();
+}
+
+Status
+TxCache::infoInternal(TxInfo &result, const bc::hash_digest &hash,
+                      const TxRow &row) const
+{
+    {
+        std::lock_guard<std::mutex> lock(infosMutex_);
+        const auto i = infos_.find(hash);
+        if (infos_.end() != i)
+        {
+            result = i->second;
+            return Status();
+        }
+    }
+
+    TxInfo out;
+    int64_t totalIn = 0, totalOut = 0;
+
+    // Basic info:
+    out.txid = bc::encode_hash(hash);
+    out.ntxid = row.ntxid;
+    out.ios.reserve(row.inputs.size() + row.outputs.size());
+
+    // Scan inputs:
+    for (const auto &input: row.inputs)
+    {
+        auto i = txs_.find(input.point.hash);
+        if (txs_.end() == i)
+            return ABC_ERROR(ABC_CC_Synchronizing, "Missing input " +
+                             bc::encode_hash(input.point.hash));
+        if (i->second.outputs.size() <= input.point.index)
+            return ABC_ERROR(ABC_CC_Error, "Impossible input on " +
+                             bc::encode_hash(input.point.hash));
+        auto &output = i->second.outputs[input.point.index];
+
+        totalIn += output.value;
+        out.ios.push_back(TxInOut{true, output.value, output.address});
+    }
+
+    // Scan outputs:
+    for (const auto &output: row.outputs)
+    {
+        totalOut += output.value;
+        out.ios.push_back(TxInOut{false, output.value, output.address});
+    }
+
+    out.fee = totalIn - totalOut;
+
+    std::lock_guard<std::mutex> lock(infosMutex_);
+    infos_[hash] = out;
+    result = std::move(out);
     return Status();
 }
 
 bool
 TxCache::missing(const std::string &txid) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLock lock(mutex_);
 
     // Check the transaction:
-    auto i = txs_.find(txid);
+    auto i = txs_.find(txidHash(txid));
     if (txs_.end() == i)
         return true;
 
     // Check the inputs:
     for (const auto &input: i->second.inputs)
     {
-        const auto txid = bc::encode_hash(input.previous_output.hash);
-        if (!txs_.count(txid))
+        if (!txs_.count(input.point.hash))
             return true;
     }
 
     return false;
 }
 
+size_t
+TxCache::height(const std::string &txid) const
+{
+    ReadLock lock(mutex_);
+    return txidHeight(txidHash(txid));
+}
+
 TxidSet
 TxCache::missingTxids(const TxidSet &txids) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLock lock(mutex_);
     TxidSet out;
 
     for (const auto &txid: txids)
     {
         // Check the transaction:
-        auto i = txs_.find(txid);
+        auto i = txs_.find(txidHash(txid));
         if (txs_.end() == i)
         {
             out.insert(txid);
@@ -366,47 +835,94 @@ TxCache::missingTxids(const TxidSet &txids) const
         // Check the inputs:
         for (const auto &input: i->second.inputs)
         {
-            const auto txid = bc::encode_hash(input.previous_output.hash);
-            if (!txs_.count(txid))
-                out.insert(txid);
+            if (!txs_.count(input.point.hash))
+                out.insert(bc::encode_hash(input.point.hash));
         }
     }
 
     return out;
 }
 
-Status
+TxidSet
+TxCache::refetchTxids() const
+{
+    ReadLock lock(mutex_);
+    std::lock_guard<std::mutex> refetchLock(refetchMutex_);
+    TxidSet out;
+
+    for (auto i = refetch_.begin(); refetch_.end() != i; )
+    {
+        const auto row = txs_.find(*i);
+        if (txs_.end() == row || !row->second.isPruned)
+        {
+            i = refetch_.erase(i);
+            continue;
+        }
+        out.insert(bc::encode_hash(*i));
+        ++i;
+    }
+
+    return out;
+}
+
+TxidSet
+TxCache::expiredTake(time_t now)
+{
+    // This runs on every updater wakeup, so skip the write lock
+    // when nothing is due:
+    {
+        ReadLock lock(mutex_);
+        if (expiry_.empty() || now < expiry_.begin()->first)
+            return TxidSet();
+    }
+
+    WriteLock lock(mutex_);
+    TxidSet out;
+    while (!expiry_.empty() && expiry_.begin()->first <= now)
+    {
+        const auto hash = expiry_.begin()->second;
+        out.insert(bc::encode_hash(hash));
+
+        const auto firstSeen = heights_[hash].firstSeen;
+        expirySet(hash, now + std::max(now - firstSeen, dropAge));
+    }
+    return out;
+}
+
+Status
 TxCache::status(TxStatus &result, const std::string &txid) const
 {
-    TxGraph graph(*this);
+    ReadLock lock(mutex_);
+
+    const auto hash = txidHash(txid);
     TxStatus out;
-    out.height = txidHeight(txid);
-    const auto problems = graph.problems(txid);
-    out.isDoubleSpent = problems & TxGraph::doubleSpent;
-    out.isReplaceByFee = problems & TxGraph::replaceByFee;
+    out.height = txidHeight(hash);
+    const auto flags = problems(hash);
+    out.isDoubleSpent = flags & doubleSpent;
+    out.isReplaceByFee = flags & replaceByFee;
 
     result = out;
     return Status();
 }
 
-std::list<std::pair<TxInfo, TxStatus> >
+std::vector<std::pair<TxInfo, TxStatus>>
 TxCache::statuses(const TxidSet &txids) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::list<std::pair<TxInfo, TxStatus>> out;
+    ReadLock lock(mutex_);
+    std::vector<std::pair<TxInfo, TxStatus>> out;
+    out.reserve(txids.size());
 
-    TxGraph graph(*this);
     for (const auto &txid: txids)
     {
-        auto i = txs_.find(txid);
+        auto i = txs_.find(txidHash(txid));
         std::pair<TxInfo, TxStatus> pair;
-        if (txs_.end() != i && infoInternal(pair.first, i->second))
+        if (txs_.end() != i && infoInternal(pair.first, i->first, i->second))
         {
             pair.second.height = txidHeight(i->first);
-            const auto problems = graph.problems(i->first);
-            pair.second.isDoubleSpent = problems & TxGraph::doubleSpent;
-            pair.second.isReplaceByFee = problems & TxGraph::replaceByFee;
-            out.push_back(pair);
+            const auto flags = problems(i->first);
+            pair.second.isDoubleSpent = flags & doubleSpent;
+            pair.second.isReplaceByFee = flags & replaceByFee;
+            out.push_back(std::move(pair));
         }
     }
 
@@ -418,70 +934,214 @@ TxCache::statuses(const TxidSet &txids) const
 TxOutputList
 TxCache::utxos(const AddressSet &addresses) const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    ReadLock lock(mutex_);
 
-    // Build a list of spends:
-    TxGraph graph(*this);
+    // Look up each address in the index:
+    std::vector<const PointSet *> found;
+    size_t size = 0;
+    for (const auto &address: addresses)
+    {
+        auto i = unspent_.find(address);
+        if (unspent_.end() == i)
+            continue;
+        found.push_back(&i->second);
+        size += i->second.size();
+    }
 
-    // Check each output against the list:
     TxOutputList out;
-    for (auto &row: txs_)
+    out.reserve(size);
+    for (const auto *points: found)
     {
-        for (uint32_t i = 0; i < row.second.outputs.size(); ++i)
+        for (const auto &point: *points)
         {
-            bc::hash_digest hash;
-            bc::decode_hash(hash, row.first);
-
-            bc::output_point point = {hash, i};
-            const auto &output = row.second.outputs[i];
-            bc::payment_address address;
-            const auto txid = row.first;
-
-            // The output is interesting if it isn't spent and belongs to us:
-            if (!graph.isSpent(point) &&
-                    bc::extract(address, output.script) &&
-                    addresses.count(address.encoded()))
+            const auto &row = txs_.find(point.hash)->second;
+            out.push_back(TxOutput
             {
-                out.push_back(TxOutput
-                {
-                    point, output.value,
-                    !graph.problems(row.first),
-                    isIncoming(row.second, txid, addresses)
-                });
-            }
+                point, row.outputs[point.index].value,
+                !problems(point.hash),
+                isIncoming(row, point.hash, addresses)
+            });
         }
     }
 
     return out;
 }
 
+uint64_t
+TxCache::revision() const
+{
+    ReadLock lock(mutex_);
+    return changes_.revision();
+}
+
+TxidSet
+TxCache::changedSince(uint64_t revision) const
+{
+    ReadLock lock(mutex_);
+    return changes_.since(revision);
+}
+
+TxidSet
+TxCache::confirmationsChanged(size_t before, size_t after,
+                              size_t depth) const
+{
+    ReadLock lock(mutex_);
+    TxidSet out;
+
+    // A transaction at height h has after - h + 1 confirmations,
+    // so only blocks less than `depth` deep can still change:
+    const auto low = before ? std::min(before, after) : after;
+    const auto high = before ? std::max(before, after) : SIZE_MAX;
+    const auto start = depth < low + 2 ? low + 2 - depth : 1;
+    for (auto i = heightIndex_.lower_bound(start);
+            heightIndex_.end() != i && i->first <= high; ++i)
+    {
+        for (const auto &hash: i->second)
+            out.insert(bc::encode_hash(hash));
+    }
+
+    if (!before)
+    {
+        for (const auto &row: txs_)
+            if (!txidHeight(row.first))
+                out.insert(bc::encode_hash(row.first));
+    }
+
+    return out;
+}
+
+TxBalance
+TxCache::balance() const
+{
+    ReadLock lock(mutex_);
+    return balance_;
+}
+
+void
+TxCache::balanceAddressesSet(const AddressSet &addresses)
+{
+    WriteLock lock(mutex_);
+    if (addresses == balanceAddresses_)
+        return;
+
+    balanceAddresses_ = addresses;
+    balanceFilter_.assign(addresses);
+    balanceRebuild();
+}
+
 bool
 TxCache::drop(const std::string &txid, time_t now)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
+    return !dropMany(TxidSet{txid}, now).empty();
+}
 
-    // Do not drop if it is confirmed or less than an hour old:
-    const auto &info = heights_[txid];
-    if (info.height || now < info.firstSeen + 60*60)
-        return false;
+TxidSet
+TxCache::dropMany(const TxidSet &txids, time_t now)
+{
+    WriteLock lock(mutex_);
 
-    heights_.erase(txid);
-    txs_.erase(txid);
-    return true;
+    TxidSet out;
+    TxidHashSet dropped;
+    TxidHashSet parents;
+    TxidHashSet dirty;
+    for (const auto &txid: txids)
+    {
+        const auto hash = txidHash(txid);
+
+        // Do not drop if it is confirmed or less than an hour old:
+        const auto &info = heights_[hash];
+        if (info.height || now < info.firstSeen + dropAge)
+            continue;
+
+        heights_.erase(hash);
+        expirySet(hash, 0);
+        touch(hash);
+        auto i = txs_.find(hash);
+        if (txs_.end() != i)
+        {
+            touchSpenders(hash, i->second);
+            parents.insert(hash);
+            for (const auto &input: i->second.inputs)
+                parents.insert(input.point.hash);
+
+            indexErase(hash, i->second, dirty);
+            txs_.erase(i);
+            problems_.erase(hash);
+        }
+
+        auto di = decodedIndex_.find(hash);
+        if (decodedIndex_.end() != di)
+        {
+            decoded_.erase(di->second);
+            decodedIndex_.erase(di);
+        }
+
+        logRecord(journal_, logDrop, hash);
+        ++journalRecords_;
+        dropped.insert(hash);
+        out.insert(txid);
+    }
+    if (out.empty())
+        return out;
+
+    // The flags only matter for the transactions that are left:
+    for (const auto &hash: dropped)
+        dirty.erase(hash);
+    problemsUpdate(dirty);
+    balanceUpdate(parents);
+
+    // Any child's info could mention the dropped outputs.
+    // Drops are rare, so just start over:
+    infos_.clear();
+    return out;
 }
 
 bool
 TxCache::insert(const bc::transaction_type &tx, std::string txid)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
+    WriteLock lock(mutex_);
 
     // Do not stomp existing tx's:
-    if (txid == "")
-        txid = bc::encode_hash(bc::hash_transaction(tx));
+    const auto hash = txid.empty() ? bc::hash_transaction(tx) : txidHash(txid);
 
-    if (txs_.find(txid) == txs_.end())
+    // A pruned transaction only needs its raw bytes back,
+    // since the summary the queries use hasn't changed:
+    auto i = txs_.find(hash);
+    if (txs_.end() != i && i->second.isPruned)
+    {
+        i->second.rawSet(txShare(hash, tx));
+        i->second.isPruned = false;
+        logRecord(journal_, logTx, hash, i->second.raw);
+        ++journalRecords_;
+        return false;
+    }
+
+    if (txs_.end() == i)
     {
-        txs_[txid] = tx;
+        const auto data = txShare(hash, tx);
+
+        TxView view;
+        if (!view.parse(*data).log())
+            return false;
+
+        auto &row = txs_[hash];
+        rowMake(row, view, addressNames_);
+        row.rawSet(data);
+
+        touch(hash);
+        touchSpenders(hash, row);
+        TxidHashSet dirty;
+        indexInsert(hash, row, dirty);
+        problemsUpdate(dirty);
+
+        // Our inputs spend funds from our parents:
+        TxidHashSet parents{hash};
+        for (const auto &input: row.inputs)
+            parents.insert(input.point.hash);
+        balanceUpdate(parents);
+
+        logRecord(journal_, logTx, hash, row.raw);
+        ++journalRecords_;
         return true;
     }
 
@@ -491,38 +1151,556 @@ TxCache::insert(const bc::transaction_type &tx, std::string txid)
 void
 TxCache::confirmed(const std::string &txid, size_t height, time_t now)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    confirmedMany(TxidHeightMap{{txid, height}}, now);
+}
+
+void
+TxCache::confirmedMany(const TxidHeightMap &heights, time_t now)
+{
+    WriteLock lock(mutex_);
+
+    TxidHashSet changed;
+    for (const auto &row: heights)
+    {
+        const auto hash = txidHash(row.first);
+
+        auto &info = heights_[hash];
+        const auto old = info;
+        info.height = row.second;
+        blocks_.headerNeededAdd(row.second);
+        if (0 == info.firstSeen)
+            info.firstSeen = now;
+
+        if (old.height != info.height)
+        {
+            changed.insert(hash);
+            heightIndexMove(hash, old.height, info.height);
+        }
 
-    auto &info = heights_[txid];
-    info.height = height;
-    blocks_.headerNeededAdd(height);
-    if (0 == info.firstSeen)
-        info.firstSeen = now;
+        if (info.height)
+            expirySet(hash, 0);
+        else if (!expiryDue_.count(hash))
+            expirySet(hash, info.firstSeen + dropAge);
+
+        if (old.height != info.height || old.firstSeen != info.firstSeen)
+        {
+            touch(hash);
+            logHeightRecord(journal_, hash, info.height, info.firstSeen);
+            ++journalRecords_;
+        }
+    }
+
+    // Confirmed transactions are safe, so this can change the problem flags:
+    if (!changed.empty())
+    {
+        problemsUpdate(changed);
+        balanceUpdate(changed);
+    }
+}
+
+size_t
+TxCache::prune(size_t depth)
+{
+    WriteLock lock(mutex_);
+    return pruneInternal(depth);
+}
+
+size_t
+TxCache::pruneInternal(size_t depth)
+{
+    // Without knowing which outputs are ours, nothing is safe to prune:
+    const auto height = blocks_.height();
+    if (balanceAddresses_.empty() || height + 1 < depth)
+        return 0;
+
+    const auto deep = [this, height, depth](const bc::hash_digest &hash)
+    {
+        const auto txHeight = txidHeight(hash);
+        return txHeight && txHeight + depth <= height + 1;
+    };
+
+    size_t out = 0;
+    for (const auto &block: heightIndex_)
+    {
+        if (height + 1 < block.first + depth)
+            break;
+
+        for (const auto &hash: block.second)
+        {
+            auto i = txs_.find(hash);
+            if (txs_.end() == i || i->second.isPruned)
+                continue;
+            auto &row = i->second;
+
+            // Every output we own needs a spender that can't go away:
+            bool spent = true;
+            for (uint32_t n = 0; spent && n < row.outputs.size(); ++n)
+            {
+                if (!balanceAddresses_.count(row.outputs[n].address))
+                    continue;
+                const auto s = spenders_.find(bc::point_type{hash, n});
+                spent = spenders_.end() != s &&
+                        std::any_of(s->second.begin(), s->second.end(), deep);
+            }
+            if (!spent)
+                continue;
+
+            row.raw = DataSlice();
+            row.data.reset();
+            row.isPruned = true;
+            ++out;
+
+            std::lock_guard<std::mutex> decodedLock(decodedMutex_);
+            auto di = decodedIndex_.find(hash);
+            if (decodedIndex_.end() != di)
+            {
+                decoded_.erase(di->second);
+                decodedIndex_.erase(di);
+            }
+        }
+    }
+
+    // Rewriting the log drops the pruned raw bytes from the disk, too:
+    if (out)
+        logCompact_ = true;
+    return out;
 }
 
 bool
-TxCache::isIncoming(const bc::transaction_type &tx, const std::string &txid,
+TxCache::isIncoming(const TxRow &row, const bc::hash_digest &hash,
                     const AddressSet &addresses) const
 {
     // Confirmed transactions are no longer incoming:
-    if (txidHeight(txid))
+    if (txidHeight(hash))
         return false;
 
     // This is a spend if we control all the inputs:
-    for (auto &input: tx.inputs)
+    for (auto &input: row.inputs)
     {
-        bc::payment_address address;
-        if (!bc::extract(address, input.script) ||
-                !addresses.count(address.encoded()))
+        if (input.address.empty() || !addresses.count(input.address))
             return true;
     }
     return false;
 }
 
+void
+TxCache::rowMake(TxRow &result, const TxView &view, AddressNames &names)
+{
+    result.ntxid = bc::encode_hash(view.ntxid());
+    result.isReplaceByFee = view.isReplaceByFee();
+
+    result.inputs.clear();
+    result.inputs.reserve(view.inputs().size());
+    for (const auto &input: view.inputs())
+    {
+        // Coinbase inputs hold arbitrary data, not a script:
+        result.inputs.push_back(TxRow::Input
+        {
+            input.point,
+            previous_output_is_null(input.point) ? "" :
+            inputScriptAddress(input.script, &names)
+        });
+    }
+
+    result.outputs.clear();
+    result.outputs.reserve(view.outputs().size());
+    for (const auto &output: view.outputs())
+    {
+        result.outputs.push_back(TxRow::Output
+        {
+            output.value, outputScriptAddress(output.script, &names)
+        });
+    }
+}
+
+Status
+TxCache::rowParse(TxRow &result, DataSlice data)
+{
+    auto serial = bc::make_deserializer(data.begin(), data.end());
+    try
+    {
+        result.ntxid = bc::encode_hash(serial.read_hash());
+        result.isReplaceByFee = serial.read_byte() & 1;
+
+        result.inputs.resize(serial.read_4_bytes());
+        for (auto &input: result.inputs)
+        {
+            input.point.hash = serial.read_hash();
+            input.point.index = serial.read_4_bytes();
+            input.address = serial.read_fixed_string(serial.read_byte());
+        }
+
+        result.outputs.resize(serial.read_4_bytes());
+        for (auto &output: result.outputs)
+        {
+            output.value = serial.read_8_bytes();
+            output.address = serial.read_fixed_string(serial.read_byte());
+        }
+    }
+    catch (bc::end_of_stream)
+    {
+        return ABC_ERROR(ABC_CC_ParseError, "Truncated transaction summary");
+    }
+
+    result.isPruned = true;
+    return Status();
+}
+
+void
+TxCache::logRow(DataChunk &out, const bc::hash_digest &hash, const TxRow &row)
+{
+    if (!row.isPruned)
+    {
+        logRecord(out, logTx, hash, row.raw);
+        return;
+    }
+
+    DataChunk body;
+    const auto ntxid = txidHash(row.ntxid);
+    body.insert(body.end(), ntxid.begin(), ntxid.end());
+    body.push_back(row.isReplaceByFee ? 1 : 0);
+
+    logInt(body, row.inputs.size(), 4);
+    for (const auto &input: row.inputs)
+    {
+        body.insert(body.end(), input.point.hash.begin(),
+                    input.point.hash.end());
+        logInt(body, input.point.index, 4);
+        logString(body, input.address);
+    }
+
+    logInt(body, row.outputs.size(), 4);
+    for (const auto &output: row.outputs)
+    {
+        logInt(body, output.value, 8);
+        logString(body, output.address);
+    }
+
+    logRecord(out, logSummary, hash, body);
+}
+
+void
+TxCache::indexInsert(const bc::hash_digest &hash, const TxRow &row,
+                     TxidHashSet &dirty)
+{
+    dirty.insert(hash);
+
+    // Our inputs might spend outputs that used to be unspent:
+    for (const auto &input: row.inputs)
+    {
+        auto &spenders = spenders_[input.point];
+        spenders.insert(hash);
+
+        std::string address;
+        if (1 == spenders.size() && outputAddress(address, input.point))
+        {
+            auto i = unspent_.find(address);
+            if (unspent_.end() != i)
+            {
+                i->second.erase(input.point);
+                if (i->second.empty())
+                    unspent_.erase(i);
+            }
+        }
+
+        // The other spenders just became double-spends:
+        if (2 == spenders.size())
+            dirty.insert(spenders.begin(), spenders.end());
+    }
+
+    // Our own outputs might already be spent by other transactions:
+    for (uint32_t i = 0; i < row.outputs.size(); ++i)
+    {
+        bc::output_point point = {hash, i};
+        const auto &address = row.outputs[i].address;
+        if (!spenders_.count(point) && !address.empty())
+            unspent_[address].insert(point);
+    }
+}
+
+void
+TxCache::indexErase(const bc::hash_digest &hash, const TxRow &row,
+                    TxidHashSet &dirty)
+{
+    // Our own outputs go away, along with any problems we passed on:
+    for (uint32_t i = 0; i < row.outputs.size(); ++i)
+    {
+        const bc::output_point point{hash, i};
+        auto j = unspent_.find(row.outputs[i].address);
+        if (unspent_.end() != j)
+        {
+            j->second.erase(point);
+            if (j->second.empty())
+                unspent_.erase(j);
+        }
+
+        auto spenders = spenders_.find(point);
+        if (spenders_.end() != spenders)
+            dirty.insert(spenders->second.begin(), spenders->second.end());
+    }
+
+    // The outputs we used to spend might become unspent again:
+    for (const auto &input: row.inputs)
+    {
+        auto i = spenders_.find(input.point);
+        if (spenders_.end() == i)
+            continue;
+        i->second.erase(hash);
+
+        // A lone remaining spender is no longer a double-spend:
+        if (1 == i->second.size())
+            dirty.insert(*i->second.begin());
+        if (!i->second.empty())
+            continue;
+        spenders_.erase(i);
+
+        std::string address;
+        if (outputAddress(address, input.point))
+            unspent_[address].insert(input.point);
+    }
+    dirty.erase(hash);
+}
+
+void
+TxCache::indexRebuild()
+{
+    spenders_.clear();
+    unspent_.clear();
+    problems_.clear();
+
+    heightIndex_.clear();
+    expiry_.clear();
+    expiryDue_.clear();
+    for (const auto &height: heights_)
+    {
+        if (height.second.height)
+            heightIndex_[height.second.height].insert(height.first);
+        else
+            expirySet(height.first, height.second.firstSeen + dropAge);
+    }
+
+    TxidHashSet dirty;
+    for (const auto &row: txs_)
+    {
+        touch(row.first);
+        indexInsert(row.first, row.second, dirty);
+    }
+    problemsUpdate(dirty);
+    balanceRebuild();
+}
+
+void
+TxCache::heightIndexMove(const bc::hash_digest &hash, size_t from, size_t to)
+{
+    if (from)
+    {
+        auto i = heightIndex_.find(from);
+        if (heightIndex_.end() != i)
+        {
+            i->second.erase(hash);
+            if (i->second.empty())
+                heightIndex_.erase(i);
+        }
+    }
+    if (to)
+        heightIndex_[to].insert(hash);
+}
+
+void
+TxCache::expirySet(const bc::hash_digest &hash, time_t due)
+{
+    auto i = expiryDue_.find(hash);
+    if (expiryDue_.end() != i)
+    {
+        expiry_.erase(std::make_pair(i->second, hash));
+        expiryDue_.erase(i);
+    }
+    if (due)
+    {
+        expiry_.insert(std::make_pair(due, hash));
+        expiryDue_[hash] = due;
+    }
+}
+
+void
+TxCache::touch(const bc::hash_digest &hash)
+{
+    changes_.touch(bc::encode_hash(hash));
+}
+
+void
+TxCache::touchSpenders(const bc::hash_digest &hash, const TxRow &row)
+{
+    for (uint32_t i = 0; i < row.outputs.size(); ++i)
+    {
+        auto spenders = spenders_.find(bc::output_point{hash, i});
+        if (spenders_.end() != spenders)
+            for (const auto &spender: spenders->second)
+                touch(spender);
+    }
+}
+
+unsigned
+TxCache::problems(const bc::hash_digest &hash) const
+{
+    const auto i = problems_.find(hash);
+    if (problems_.end() == i)
+        return 0;
+    return i->second;
+}
+
+unsigned
+TxCache::problemsCompute(const bc::hash_digest &hash) const
+{
+    // We have to assume missing transactions are safe:
+    auto i = txs_.find(hash);
+    if (txs_.end() == i)
+        return 0;
+
+    // Confirmed transactions are also safe:
+    if (txidHeight(hash))
+        return 0;
+
+    // Check for the opt-in replace-by-fee flag:
+    unsigned out = 0;
+    if (i->second.isReplaceByFee)
+        out |= replaceByFee;
+
+    // Inherit problems from our inputs:
+    for (const auto &input: i->second.inputs)
+    {
+        out |= problems(input.point.hash);
+        auto spenders = spenders_.find(input.point);
+        if (spenders_.end() != spenders && 1 < spenders->second.size())
+            out |= doubleSpent;
+    }
+    return out;
+}
+
+void
+TxCache::problemsUpdate(const TxidHashSet &dirty)
+{
+    std::list<bc::hash_digest> queue(dirty.begin(), dirty.end());
+    while (!queue.empty())
+    {
+        const auto hash = queue.front();
+        queue.pop_front();
+
+        // Nothing downstream changes unless our flags do:
+        const auto flags = problemsCompute(hash);
+        if (flags == problems(hash))
+            continue;
+        if (flags)
+            problems_[hash] = flags;
+        else
+            problems_.erase(hash);
+        touch(hash);
+        balanceUpdate(TxidHashSet{hash});
+
+        // Revisit the transactions that spend our outputs:
+        auto i = txs_.find(hash);
+        if (txs_.end() == i)
+            continue;
+        for (uint32_t n = 0; n < i->second.outputs.size(); ++n)
+        {
+            auto spenders = spenders_.find(bc::output_point{hash, n});
+            if (spenders_.end() != spenders)
+                queue.insert(queue.end(), spenders->second.begin(),
+                             spenders->second.end());
+        }
+    }
+}
+
+TxBalance
+TxCache::balanceCompute(const bc::hash_digest &hash) const
+{
+    TxBalance out;
+    auto i = txs_.find(hash);
+    if (txs_.end() == i)
+        return out;
+
+    const bool confirmed = txidHeight(hash);
+    const bool spendable = !problems(hash) &&
+                           !isIncoming(i->second, hash, balanceAddresses_);
+
+    for (uint32_t n = 0; n < i->second.outputs.size(); ++n)
+    {
+        const auto &output = i->second.outputs[n];
+        if (!balanceFilter_.mayContain(output.address) ||
+                !balanceAddresses_.count(output.address) ||
+                spenders_.count(bc::output_point{hash, n}))
+            continue;
+
+        if (confirmed)
+            out.confirmed += output.value;
+        else
+            out.unconfirmed += output.value;
+        if (spendable)
+            out.spendable += output.value;
+    }
+    return out;
+}
+
+void
+TxCache::balanceUpdate(const TxidHashSet &txids)
+{
+    for (const auto &hash: txids)
+    {
+        TxBalance old;
+        auto i = txBalances_.find(hash);
+        if (txBalances_.end() != i)
+        {
+            old = i->second;
+            txBalances_.erase(i);
+        }
+
+        const auto share = balanceCompute(hash);
+        balance_.confirmed += share.confirmed - old.confirmed;
+        balance_.unconfirmed += share.unconfirmed - old.unconfirmed;
+        balance_.spendable += share.spendable - old.spendable;
+        if (share.confirmed || share.unconfirmed)
+            txBalances_[hash] = share;
+    }
+}
+
+void
+TxCache::balanceRebuild()
+{
+    balance_ = TxBalance();
+    txBalances_.clear();
+
+    // Only transactions with unspent outputs to our addresses count:
+    TxidHashSet txids;
+    for (const auto &address: balanceAddresses_)
+    {
+        auto i = unspent_.find(address);
+        if (unspent_.end() != i)
+            for (const auto &point: i->second)
+                txids.insert(point.hash);
+    }
+    balanceUpdate(txids);
+}
+
+bool
+TxCache::outputAddress(std::string &result,
+                       const bc::output_point &point) const
+{
+    auto i = txs_.find(point.hash);
+    if (txs_.end() == i || i->second.outputs.size() <= point.index)
+        return false;
+
+    const auto &address = i->second.outputs[point.index].address;
+    if (address.empty())
+        return false;
+
+    result = address;
+    return true;
+}
+
 size_t
-TxCache::txidHeight(const std::string &txid) const
+TxCache::txidHeight(const bc::hash_digest &hash) const
 {
-    const auto i = heights_.find(txid);
+    const auto i = heights_.find(hash);
     if (heights_.end() == i)
         return 0;
     return i->second.height;
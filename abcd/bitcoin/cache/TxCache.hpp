@@ -8,15 +8,56 @@
 #ifndef ABCD_BITCOIN_CACHE_TX_CACHE_HPP
 #define ABCD_BITCOIN_CACHE_TX_CACHE_HPP
 
+#include "TxStore.hpp"
+#include "../AddressFilter.hpp"
+#include "../TxView.hpp"
 #include "../Typedefs.hpp"
+#include "../../util/ChangeLog.hpp"
+#include "../../util/Data.hpp"
 #include <bitcoin/bitcoin.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace std {
+
+/**
+ * Allows `bc::point_type` to be used with `std::unordered_set`.
+ */
+template<> struct hash<bc::point_type>
+{
+    typedef bc::point_type argument_type;
+    typedef std::size_t result_type;
+
+    result_type
+    operator()(argument_type const &p) const
+    {
+        auto h = libbitcoin::from_little_endian_unsafe<result_type>(
+                     p.hash.begin());
+        return h ^ p.index;
+    }
+};
+
+} // namespace std
 
 namespace abcd {
 
 class BlockCache;
 class JsonObject;
+class MappedFile;
+
+/**
+ * Transactions with at least this many confirmations look the same
+ * to the user, so height changes stop mattering to them past this point.
+ */
+constexpr size_t confirmationsShallow = 6;
 
 /**
  * An input or an output of a transaction.
@@ -36,7 +77,7 @@ struct TxInfo
     std::string txid;
     std::string ntxid;
     int64_t fee;
-    std::list<TxInOut> ios;
+    std::vector<TxInOut> ios;
 };
 
 /**
@@ -60,7 +101,39 @@ struct TxOutput
     bool isIncoming; // Unconfirmed incoming funds.
 };
 
-typedef std::list<TxOutput> TxOutputList;
+typedef std::vector<TxOutput> TxOutputList;
+
+/**
+ * The unspent funds belonging to a set of addresses.
+ */
+struct TxBalance
+{
+    int64_t confirmed = 0;
+    int64_t unconfirmed = 0;
+    int64_t spendable = 0; // Not RBF, double-spent, or incoming.
+
+    int64_t
+    total() const { return confirmed + unconfirmed; }
+};
+
+typedef std::unordered_set<bc::point_type> PointSet;
+
+/**
+ * Hashes a binary txid for the standard unordered containers.
+ * Txids are already uniformly distributed, so the first bytes do fine.
+ */
+struct TxidHasher
+{
+    size_t
+    operator()(const bc::hash_digest &hash) const
+    {
+        return libbitcoin::from_little_endian_unsafe<size_t>(hash.begin());
+    }
+};
+
+template<typename T>
+using TxidMap = std::unordered_map<bc::hash_digest, T, TxidHasher>;
+typedef std::unordered_set<bc::hash_digest, TxidHasher> TxidHashSet;
 
 /**
  * Translates a list of `TxOutput` structures to the libbitcoin equivalent.
@@ -69,6 +142,14 @@ typedef std::list<TxOutput> TxOutputList;
 libbitcoin::output_info_list
 filterOutputs(const TxOutputList &utxos, bool filter=false);
 
+/**
+ * Sets how many confirmations a fully-spent transaction needs
+ * before `TxCache::save` prunes it, where 0 (the default)
+ * turns pruning off.
+ */
+void
+txCachePruneDepthSet(size_t depth);
+
 /**
  * A list of transactions.
  *
@@ -78,6 +159,16 @@ filterOutputs(const TxOutputList &utxos, bool filter=false);
  *
  * The fork-detection algorithm isn't perfect yet, since obelisk doesn't
  * provide the necessary information.
+ *
+ * Only a small summary of each transaction stays decoded in memory.
+ * The raw bytes for transactions loaded from disk stay in the
+ * memory-mapped cache file, and are only decoded when `get` needs them.
+ * Pruning drops the raw bytes of old, fully-spent transactions,
+ * leaving just the summary, which is all the balance and `info` need.
+ *
+ * The public interface takes hex txids, but everything inside
+ * is keyed by the binary hash, so following an input to its
+ * parent transaction never needs a string conversion.
  */
 class TxCache
 {
@@ -93,21 +184,62 @@ public:
     clear();
 
     /**
-     * Reads the database contents from the provided cache JSON object.
+     * Reads the database contents from the legacy cache JSON object.
+     * The next `save` will write the binary log from scratch.
      */
     Status
     load(JsonObject &json);
 
     /**
-     * Saves the database contents to the provided cache JSON object.
+     * Reads the database contents from a binary transaction log.
+     */
+    Status
+    loadLog(const std::string &path);
+
+    /**
+     * Writes any pending changes to the binary transaction log,
+     * compacting the log if it has grown too large.
+     * The records are gathered under the lock, but the disk write
+     * happens later, on the write-behind queue.
      */
     Status
-    save(JsonObject &json);
+    save(const std::string &path);
+
+    /**
+     * Packs every transaction and height into a compacted log,
+     * in the same format `loadLog` reads, for seeding another device.
+     */
+    DataChunk
+    snapshot() const;
+
+    /**
+     * Merges a `snapshot` from another device into the cache.
+     * Anything the cache already holds wins over the snapshot's copy.
+     * The next `save` rewrites the log with the merged contents.
+     */
+    Status
+    loadSnapshot(DataSlice data);
+
+    /**
+     * Roughly how much heap the cache is holding, in bytes.
+     * Raw transactions in the mapped log file are not counted.
+     */
+    size_t
+    memoryUsed() const;
+
+    /**
+     * Drops the decoded transactions and finished `TxInfo` results,
+     * which rebuild on demand, for when the system is low on memory.
+     */
+    void
+    trim();
 
     // Queries ------------------------------------------------------------
 
     /**
      * Obtains a transaction from the database.
+     * Pruned transactions fail with `ABC_CC_Synchronizing`,
+     * and are listed in `refetchTxids` until they come back.
      */
     Status
     get(bc::transaction_type &result, const std::string &txid) const;
@@ -139,6 +271,28 @@ public:
     TxidSet
     missingTxids(const TxidSet &txids) const;
 
+    /**
+     * Lists the pruned transactions that `get` has been asked for,
+     * so the updater can fetch their raw bytes again.
+     */
+    TxidSet
+    refetchTxids() const;
+
+    /**
+     * Lists the unconfirmed transactions that have grown old enough
+     * for `drop`, so the caller can check whether they are still around.
+     * Each one's next turn comes once its age has doubled,
+     * so a transaction stuck in the mempool isn't checked over and over.
+     */
+    TxidSet
+    expiredTake(time_t now=time(nullptr));
+
+    /**
+     * Returns a transaction's block height, or zero if it is unconfirmed.
+     */
+    size_t
+    height(const std::string &txid) const;
+
     /**
      * Looks up a transaction and returns its confirmation & safety state.
      */
@@ -149,7 +303,7 @@ public:
      * Lists all the transactions relevant to these addresses,
      * along with their information. Skips missing txids.
      */
-    std::list<std::pair<TxInfo, TxStatus> >
+    std::vector<std::pair<TxInfo, TxStatus>>
     statuses(const TxidSet &txids) const;
 
     /**
@@ -158,8 +312,48 @@ public:
     TxOutputList
     utxos(const AddressSet &addresses) const;
 
+    /**
+     * Returns the current change revision.
+     * Grab this before calling `changedSince`.
+     */
+    uint64_t
+    revision() const;
+
+    /**
+     * Lists the transactions whose information or status
+     * has changed after the given revision, including removed ones.
+     */
+    TxidSet
+    changedSince(uint64_t revision) const;
+
+    /**
+     * Lists the confirmed transactions whose confirmation count,
+     * counting no higher than `depth`, differs between two chain heights.
+     * Only the blocks near the tip get visited, so this is cheap
+     * to call on every new block.
+     * @param before the previous chain height, or 0 to list everything
+     * with fewer than `depth` confirmations at `after`,
+     * along with every unconfirmed transaction.
+     */
+    TxidSet
+    confirmationsChanged(size_t before, size_t after, size_t depth) const;
+
+    /**
+     * Returns the balance of the addresses passed to `balanceAddressesSet`.
+     * This is kept up to date as transactions come and go,
+     * so it is cheap to call.
+     */
+    TxBalance
+    balance() const;
+
     // Updates ------------------------------------------------------------
 
+    /**
+     * Chooses which addresses count towards `balance`.
+     */
+    void
+    balanceAddressesSet(const AddressSet &addresses);
+
     /**
      * Removes a transaction from the cache if it is old and unconfirmed.
      * @return true if the transaction was removed.
@@ -167,6 +361,14 @@ public:
     bool
     drop(const std::string &txid, time_t now=time(nullptr));
 
+    /**
+     * Same as `drop`, but for a whole batch under one lock,
+     * updating the problem flags and balance once at the end.
+     * @return the txids that were actually removed.
+     */
+    TxidSet
+    dropMany(const TxidSet &txids, time_t now=time(nullptr));
+
     /**
      * Insert a new transaction into the database.
      * @return true if the callback should be fired.
@@ -181,19 +383,269 @@ public:
     void
     confirmed(const std::string &txid, size_t height, time_t now=time(nullptr));
 
-private:
-    friend class TxGraph;
+    /**
+     * Same as `confirmed`, but for a whole address history under one lock,
+     * updating the problem flags and balance once at the end.
+     */
+    void
+    confirmedMany(const TxidHeightMap &heights, time_t now=time(nullptr));
 
+    /**
+     * Releases the raw bytes of transactions with at least `depth`
+     * confirmations whose outputs to the `balanceAddressesSet` addresses
+     * have all been spent by transactions just as deep.
+     * Inserting a pruned transaction again brings its raw bytes back.
+     * @return the number of transactions pruned.
+     */
+    size_t
+    prune(size_t depth);
+
+private:
     struct HeightInfo
     {
         size_t height = 0;
         time_t firstSeen = 0;
     };
 
-    mutable std::mutex mutex_;
-    std::map<std::string, bc::transaction_type> txs_;
-    std::map<std::string, HeightInfo> heights_;
+    /**
+     * The parts of a transaction the queries need.
+     */
+    struct TxRow
+    {
+        struct Input
+        {
+            bc::output_point point;
+            std::string address; // Blank if the script is non-standard
+        };
+
+        struct Output
+        {
+            uint64_t value;
+            std::string address; // Blank if the script is non-standard
+        };
+
+        std::string ntxid;
+        bool isReplaceByFee = false;
+        std::vector<Input> inputs;
+        std::vector<Output> outputs;
+        bool isPruned = false; // No raw bytes, just the fields above
+
+        // The serialized transaction.
+        // This points either into `data`, which other wallets may share,
+        // or into the mapped cache file, so rows should never be copied:
+        DataSlice raw;
+        SharedTxData data;
+
+        void
+        rawSet(SharedTxData chunk)
+        {
+            data = std::move(chunk);
+            raw = *data;
+        }
+
+        TxRow() = default;
+        TxRow(TxRow &&move) = default;
+        TxRow &operator=(TxRow &&move) = default;
+        TxRow(const TxRow &copy) = delete;
+        TxRow &operator=(const TxRow &copy) = delete;
+    };
+
+    // Queries take a shared lock, so they can run in parallel,
+    // but updates need exclusive access:
+    typedef boost::shared_lock<boost::shared_mutex> ReadLock;
+    typedef std::lock_guard<boost::shared_mutex> WriteLock;
+    mutable boost::shared_mutex mutex_;
+
+    TxidMap<TxRow> txs_;
+    TxidMap<HeightInfo> heights_;
+    std::map<size_t, TxidHashSet> heightIndex_; // Confirmed txids by height
+    std::shared_ptr<MappedFile> file_;
     BlockCache &blocks_;
+    AddressNames addressNames_; // Shared by the rows built under the lock
+
+    // Recently-decoded transactions, most recent first:
+    typedef std::list<std::pair<bc::hash_digest, bc::transaction_type>> TxList;
+    mutable std::mutex decodedMutex_;
+    mutable TxList decoded_;
+    mutable TxidMap<TxList::iterator> decodedIndex_;
+
+    // Finished `TxInfo` results, which never change once the inputs
+    // are all present, unless a drop takes one of them away:
+    mutable std::mutex infosMutex_;
+    mutable TxidMap<TxInfo> infos_;
+
+    // Pruned transactions someone wants to see again:
+    mutable std::mutex refetchMutex_;
+    mutable TxidHashSet refetch_;
+    size_t prunedHeight_ = 0; // Chain height at the last automatic prune
+
+    // Unconfirmed transactions, by the time they are due for a check:
+    std::set<std::pair<time_t, bc::hash_digest>> expiry_;
+    TxidMap<time_t> expiryDue_; // Keys into `expiry_`
+
+    /**
+     * Log bytes handed off to the write-behind queue,
+     * but not yet on disk.
+     */
+    struct LogPending
+    {
+        std::mutex mutex;
+        DataChunk data;
+        bool rewrite = false; // The data replaces the file, not extends it
+    };
+
+    // Binary log state:
+    std::mutex saveMutex_; // Taken before `mutex_`, never after
+    std::shared_ptr<LogPending> logPending_ = std::make_shared<LogPending>();
+    DataChunk journal_; // Records not yet written to disk
+    size_t journalRecords_ = 0;
+    size_t logRecords_ = 0; // Records already in the file
+    bool logCompact_ = true; // The file needs to be rewritten
+
+    // Spend graph, maintained as transactions come and go:
+    std::unordered_map<bc::point_type, TxidHashSet> spenders_;
+    std::map<std::string, PointSet> unspent_;
+    TxidMap<unsigned> problems_; // Only non-zero flags
+
+    // Transactions touched by each update, for incremental queries:
+    ChangeLog changes_;
+
+    // Running balance, along with each transaction's share of it:
+    AddressSet balanceAddresses_;
+    AddressFilter balanceFilter_;
+    TxBalance balance_;
+    TxidMap<TxBalance> txBalances_; // Only non-zero shares
+
+    /**
+     * Fills in a row's summary fields from an indexed transaction.
+     */
+    static void
+    rowMake(TxRow &result, const TxView &view, AddressNames &names);
+
+    /**
+     * Reads a pruned row's summary fields back from a log record.
+     */
+    static Status
+    rowParse(TxRow &result, DataSlice data);
+
+    /**
+     * Appends the log record that restores a row,
+     * which is just the summary fields once the row is pruned.
+     */
+    static void
+    logRow(DataChunk &out, const bc::hash_digest &hash, const TxRow &row);
+
+    /**
+     * Same as `prune`, but should be called with the write lock held.
+     */
+    size_t
+    pruneInternal(size_t depth);
+
+    /**
+     * Same as `get`, but should be called with at least a read lock held.
+     */
+    Status
+    getInternal(bc::transaction_type &result,
+                const bc::hash_digest &hash) const;
+
+    /**
+     * Records a change for the incremental queries.
+     */
+    void
+    touch(const bc::hash_digest &hash);
+
+    /**
+     * Adds a transaction's inputs and outputs to the spend graph.
+     * Should be called with the mutex held, after the row is in `txs_`.
+     * @param dirty Receives the txids whose problem flags might change.
+     */
+    void
+    indexInsert(const bc::hash_digest &hash, const TxRow &row,
+                TxidHashSet &dirty);
+
+    /**
+     * Removes a transaction's inputs and outputs from the spend graph.
+     * Should be called with the mutex held.
+     * @param dirty Receives the txids whose problem flags might change.
+     */
+    void
+    indexErase(const bc::hash_digest &hash, const TxRow &row,
+               TxidHashSet &dirty);
+
+    /**
+     * Marks the transactions spending from this one as changed,
+     * since their input information depends on our outputs.
+     * Should be called with the mutex held.
+     */
+    void
+    touchSpenders(const bc::hash_digest &hash, const TxRow &row);
+
+    /**
+     * Rebuilds the spend graph, problem flags,
+     * and expiry queue from scratch.
+     */
+    void
+    indexRebuild();
+
+    /**
+     * Moves a transaction between blocks in the height index,
+     * where a height of 0 means no block at all.
+     */
+    void
+    heightIndexMove(const bc::hash_digest &hash, size_t from, size_t to);
+
+    /**
+     * Puts a transaction in the expiry queue at the given time,
+     * or takes it out if the time is 0.
+     */
+    void
+    expirySet(const bc::hash_digest &hash, time_t due);
+
+    /**
+     * Returns the double-spend and replace-by-fee flags for a transaction.
+     */
+    unsigned
+    problems(const bc::hash_digest &hash) const;
+
+    /**
+     * Calculates a transaction's problem flags from its inputs.
+     */
+    unsigned
+    problemsCompute(const bc::hash_digest &hash) const;
+
+    /**
+     * Recalculates the problem flags for the given transactions,
+     * passing any changes on to the transactions that spend from them.
+     */
+    void
+    problemsUpdate(const TxidHashSet &dirty);
+
+    /**
+     * Calculates the funds a transaction contributes to the balance.
+     */
+    TxBalance
+    balanceCompute(const bc::hash_digest &hash) const;
+
+    /**
+     * Brings the running balance up to date for the given transactions.
+     * Should be called with the mutex held, after the spend graph
+     * and problem flags are current.
+     */
+    void
+    balanceUpdate(const TxidHashSet &txids);
+
+    /**
+     * Recalculates the running balance from scratch.
+     */
+    void
+    balanceRebuild();
+
+    /**
+     * Finds the address a cached output pays to.
+     * @return false if the output is missing or has no address.
+     */
+    bool
+    outputAddress(std::string &result, const bc::output_point &point) const;
 
     /**
      * Same as `txInfo`, but should be called with the mutex held.
@@ -201,18 +653,26 @@ private:
     Status
     infoInternal(TxInfo &result, const bc::transaction_type &tx) const;
 
+    /**
+     * Builds the input & output information for a cached transaction.
+     * Should be called with the mutex held.
+     */
+    Status
+    infoInternal(TxInfo &result, const bc::hash_digest &hash,
+                 const TxRow &row) const;
+
     /**
      * Returns true if the transaction has incoming non-change funds.
      */
     bool
-    isIncoming(const bc::transaction_type &tx, const std::string &txid,
+    isIncoming(const TxRow &row, const bc::hash_digest &hash,
                const AddressSet &addresses) const;
 
     /**
      * Returns a transaction's height, or zero if it is unconfirmed.
      */
     size_t
-    txidHeight(const std::string &txid) const;
+    txidHeight(const bc::hash_digest &hash) const;
 };
 
 } // namespace abcd
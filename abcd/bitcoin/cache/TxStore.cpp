@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TxStore.hpp"
+#include "TxCache.hpp"
+#include <algorithm>
+#include <mutex>
+
+namespace abcd {
+
+struct TxStoreSingleton
+{
+    std::mutex mutex;
+    TxidMap<std::weak_ptr<const DataChunk>> txs;
+    size_t pruneSize = 64; // Sweep out dead entries past this size
+};
+
+static TxStoreSingleton gTxStore;
+
+SharedTxData
+txStoreShare(const bc::hash_digest &hash, DataChunk &&raw)
+{
+    std::lock_guard<std::mutex> lock(gTxStore.mutex);
+
+    auto &slot = gTxStore.txs[hash];
+    auto out = slot.lock();
+    if (out)
+        return out;
+
+    out = std::make_shared<const DataChunk>(std::move(raw));
+    slot = out;
+
+    // Wallets drop their rows without telling us, so sweep now and then:
+    if (gTxStore.pruneSize < gTxStore.txs.size())
+    {
+        for (auto i = gTxStore.txs.begin(); gTxStore.txs.end() != i; )
+        {
+            if (i->second.expired())
+                i = gTxStore.txs.erase(i);
+            else
+                ++i;
+        }
+        gTxStore.pruneSize = std::max<size_t>(64, 2 * gTxStore.txs.size());
+    }
+    return out;
+}
+
+SharedTxData
+txStoreFind(const bc::hash_digest &hash)
+{
+    std::lock_guard<std::mutex> lock(gTxStore.mutex);
+
+    auto i = gTxStore.txs.find(hash);
+    if (gTxStore.txs.end() == i)
+        return SharedTxData();
+    return i->second.lock();
+}
+
+} // namespace abcd
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Transaction data shared between the wallets in this process.
+ */
+
+#ifndef ABCD_BITCOIN_CACHE_TX_STORE_HPP
+#define ABCD_BITCOIN_CACHE_TX_STORE_HPP
+
+#include "../../util/Data.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <memory>
+
+namespace abcd {
+
+typedef std::shared_ptr<const DataChunk> SharedTxData;
+
+/**
+ * Hands back the one shared copy of a serialized transaction.
+ * If another wallet already holds this transaction, `raw` is discarded
+ * and the caller gets the existing copy, so transfers between
+ * a user's own wallets only occupy memory once.
+ * The store only holds weak references, so a transaction goes away
+ * once the last wallet holding it lets go.
+ */
+SharedTxData
+txStoreShare(const bc::hash_digest &hash, DataChunk &&raw);
+
+/**
+ * Finds a transaction some wallet is holding, or returns null.
+ */
+SharedTxData
+txStoreFind(const bc::hash_digest &hash);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "ConnectionPool.hpp"
+#include "StratumConnection.hpp"
+#include "../../util/Debug.hpp"
+#include "../../../minilibs/libbitcoin-client/client.hpp"
+
+namespace abcd {
+
+ConnectionPool::~ConnectionPool()
+{
+    for (auto &parked: parked_)
+        delete parked.sc;
+}
+
+ConnectionPool::ConnectionPool(std::chrono::seconds grace):
+    grace_(grace)
+{
+}
+
+void
+ConnectionPool::park(StratumConnection *sc)
+{
+    ABC_DebugLog("Parking connection to %s", sc->uri().c_str());
+    const auto expires = std::chrono::steady_clock::now() + grace_;
+    parked_.push_back(Parked{ sc, expires });
+}
+
+std::list<StratumConnection *>
+ConnectionPool::takeAll()
+{
+    std::list<StratumConnection *> out;
+    for (auto &parked: parked_)
+    {
+        ABC_DebugLog("Reusing connection to %s", parked.sc->uri().c_str());
+        out.push_back(parked.sc);
+    }
+    parked_.clear();
+    return out;
+}
+
+std::chrono::milliseconds
+ConnectionPool::wakeup()
+{
+    const auto now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds nextWakeup(0);
+
+    auto i = parked_.begin();
+    while (parked_.end() != i)
+    {
+        SleepTime sleep;
+        if (i->expires <= now || !i->sc->wakeup(sleep).log())
+        {
+            ABC_DebugLog("Closing parked connection to %s",
+                         i->sc->uri().c_str());
+            delete i->sc;
+            i = parked_.erase(i);
+            continue;
+        }
+
+        // Round up, since a zero sleep means forever:
+        auto expires = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           i->expires - now) + std::chrono::milliseconds(1);
+        nextWakeup = bc::client::min_sleep(nextWakeup, sleep);
+        nextWakeup = bc::client::min_sleep(nextWakeup, expires);
+        ++i;
+    }
+
+    return nextWakeup;
+}
+
+void
+ConnectionPool::pollitems(std::vector<zmq_pollitem_t> &out)
+{
+    for (auto &parked: parked_)
+    {
+        if (parked.sc->pollfd() < 0)
+            continue;
+
+        zmq_pollitem_t pollitem =
+        {
+            nullptr, parked.sc->pollfd(), ZMQ_POLLIN, ZMQ_POLLOUT
+        };
+        out.push_back(pollitem);
+    }
+}
+
+} // namespace abcd
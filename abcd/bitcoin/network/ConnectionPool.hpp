@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Keeps server connections warm between disconnect and reconnect.
+ */
+
+#ifndef ABCD_BITCOIN_NETWORK_CONNECTION_POOL_HPP
+#define ABCD_BITCOIN_NETWORK_CONNECTION_POOL_HPP
+
+#include <zmq.h>
+#include <chrono>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace abcd {
+
+class StratumConnection;
+
+/**
+ * Holds on to healthy connections after the updater lets go of them.
+ * Parked connections keep their subscriptions and keep being serviced,
+ * so reconnecting within the grace period picks up right where
+ * things left off, without another round of subscribes.
+ */
+class ConnectionPool
+{
+public:
+    ~ConnectionPool();
+    ConnectionPool(std::chrono::seconds grace);
+
+    /**
+     * Takes ownership of a connection, keeping it warm until
+     * the grace period runs out.
+     */
+    void
+    park(StratumConnection *sc);
+
+    /**
+     * Hands back every parked connection, moving ownership to the caller.
+     */
+    std::list<StratumConnection *>
+    takeAll();
+
+    /**
+     * Services the parked connections, closing any that have failed
+     * or outlived the grace period.
+     * @return the number of ms until the next wakeup, or 0 for none.
+     */
+    std::chrono::milliseconds
+    wakeup();
+
+    /**
+     * Adds the parked connections' sockets to the main loop's poll list.
+     */
+    void
+    pollitems(std::vector<zmq_pollitem_t> &out);
+
+    size_t
+    size() const { return parked_.size(); }
+
+private:
+    struct Parked
+    {
+        StratumConnection *sc;
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::list<Parked> parked_;
+    std::chrono::seconds grace_;
+};
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "IBitcoinConnection.hpp"
+#include <bitcoin/bitcoin.hpp>
+#include <memory>
+
+namespace abcd {
+
+void
+IBitcoinConnection::blockHeadersFetch(const StatusCallback &onError,
+                                      const HeadersCallback &onReply,
+                                      size_t height, size_t count)
+{
+    struct Batch
+    {
+        HeaderList headers;
+        size_t left;
+        bool failed = false;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->headers.resize(count);
+    batch->left = count;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Only the first failure gets reported:
+        auto errorShim = [batch, onError](Status status)
+        {
+            if (batch->failed)
+                return;
+            batch->failed = true;
+            onError(status);
+        };
+
+        auto replyShim = [batch, onReply, i](
+                             const bc::block_header_type &header)
+        {
+            if (batch->failed)
+                return;
+            batch->headers[i] = header;
+            if (!--batch->left)
+                onReply(batch->headers);
+        };
+
+        blockHeaderFetch(errorShim, replyShim, height + i);
+    }
+}
+
+} // namespace abcd
@@ -10,7 +10,9 @@
 
 #include "../Typedefs.hpp"
 #include "../../util/Data.hpp"
+#include <chrono>
 #include <map>
+#include <vector>
 
 namespace abcd {
 
@@ -21,11 +23,35 @@ typedef std::map<std::string, size_t> AddressHistory;
 
 typedef std::function<void (unsigned height)> HeightCallback;
 typedef std::function<void (const AddressHistory &history)> AddressCallback;
+/**
+ * Receives an address's status hash, which changes along with its history.
+ * Servers that do not provide status hashes pass a blank string,
+ * which forces a history fetch.
+ */
 typedef std::function<void (const std::string &stateHash)>
 AddressUpdateCallback;
+
+/**
+ * Stands in for the null status an Electrum server gives an address
+ * with no history, so unused addresses can still compare clean.
+ */
+constexpr char addressStatusEmpty[] = "empty";
 typedef std::function<void (const libbitcoin::transaction_type &tx)> TxCallback;
 typedef std::function<void (const libbitcoin::block_header_type &header)>
 HeaderCallback;
+typedef std::vector<libbitcoin::block_header_type> HeaderList;
+typedef std::function<void (const HeaderList &headers)> HeadersCallback;
+
+/**
+ * Separates the requests a user is waiting on from background syncing.
+ * Interactive requests get a few slots beyond the connection's normal limit,
+ * so they never sit behind a queue of bulk history fetches.
+ */
+enum class RequestLane
+{
+    bulk,
+    interactive
+};
 
 /**
  * A connection to the Bitcoin network.
@@ -44,9 +70,16 @@ public:
 
     /**
      * Returns true if the connection is saturated with outstanding requests.
+     * @param lane interactive requests are allowed a little deeper.
      */
     virtual bool
-    queueFull() = 0;
+    queueFull(RequestLane lane=RequestLane::bulk) = 0;
+
+    /**
+     * Returns a pessimistic estimate of how long this server takes to reply.
+     */
+    virtual std::chrono::milliseconds
+    latencyHigh() = 0;
 
     /**
      * Begins watching for blockchain height changes.
@@ -72,11 +105,15 @@ public:
 
     /**
      * Fetches the transaction history for an address.
+     * @param fromHeight leave out history confirmed below this height.
+     * Servers that cannot do this send the full history instead,
+     * so callers must accept either.
      */
     virtual void
     addressHistoryFetch(const StatusCallback &onError,
                         const AddressCallback &onReply,
-                        const std::string &address) = 0;
+                        const std::string &address,
+                        size_t fromHeight) = 0;
 
     /**
      * Fetches the raw contents of a transaction.
@@ -93,6 +130,18 @@ public:
     blockHeaderFetch(const StatusCallback &onError,
                      const HeaderCallback &onReply,
                      size_t height) = 0;
+
+    /**
+     * Fetches the headers for a run of consecutive blocks.
+     * The default implementation pipelines one `blockHeaderFetch`
+     * per block, calling `onReply` once they have all arrived.
+     * @param onReply receives the headers in height order,
+     * which may stop short if the chain does not reach that far.
+     */
+    virtual void
+    blockHeadersFetch(const StatusCallback &onError,
+                      const HeadersCallback &onReply,
+                      size_t height, size_t count);
 };
 
 } // namespace abcd
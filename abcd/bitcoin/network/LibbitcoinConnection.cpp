@@ -7,13 +7,41 @@
 
 #include "LibbitcoinConnection.hpp"
 #include "../../util/Debug.hpp"
+#include "../../util/Trace.hpp"
 
 namespace abcd {
 
 using namespace std::placeholders;
 
+// Addresses sharing this many leading hash bits share a subscription.
+// Shorter prefixes mean fewer subscriptions, but the server then sends
+// more updates for other people's addresses, which we have to discard:
+constexpr unsigned prefixBits = 14;
+
+// One timer renews every subscription older than this,
+// so each one gets renewed before it is twice this old:
+constexpr auto renewPeriod = std::chrono::minutes(4);
+
+static uint32_t
+prefixKey(const bc::short_hash &hash)
+{
+    const uint32_t top = hash[0] << 24 | hash[1] << 16 | hash[2] << 8 | hash[3];
+    return top >> (32 - prefixBits);
+}
+
+static bc::binary_type
+prefixBinary(uint32_t key)
+{
+    const uint32_t top = key << (32 - prefixBits);
+    const bc::data_chunk blocks
+    {
+        uint8_t(top >> 24), uint8_t(top >> 16), uint8_t(top >> 8), uint8_t(top)
+    };
+    return bc::binary_type(prefixBits, blocks);
+}
+
 LibbitcoinConnection::LibbitcoinConnection(void *ctx):
-    queuedQueries_(0),
+    window_(10, 20),
     socket_(std::make_shared<bc::client::zeromq_socket>(ctx)),
     codec_(socket_,
            std::bind(&LibbitcoinConnection::onUpdate, this, _1, _2, _3, _4),
@@ -26,13 +54,30 @@ Status
 LibbitcoinConnection::connect(const std::string &uri, const std::string &key)
 {
     uri_ = uri;
+    traceId_ = traceId(uri);
 
     if(!socket_->connect(uri_, key))
         return ABC_ERROR(ABC_CC_Error, "Could not connect to " + uri_);
+    trace(TraceEvent::libbitcoinConnect, TracePhase::instant, traceId_);
 
     return Status();
 }
 
+uint64_t
+LibbitcoinConnection::traceBegin()
+{
+    const auto key = traceNext_++;
+    trace(TraceEvent::libbitcoinRequest, TracePhase::asyncBegin, traceId_, key);
+    return key;
+}
+
+void
+LibbitcoinConnection::traceEnd(uint64_t key, bool success)
+{
+    trace(TraceEvent::libbitcoinRequest, TracePhase::asyncEnd, traceId_,
+          key, success);
+}
+
 std::chrono::milliseconds
 LibbitcoinConnection::wakeup()
 {
@@ -54,16 +99,26 @@ LibbitcoinConnection::wakeup()
         nextWakeup = period - elapsed;
     }
 
-    // Renew any outdated subscriptions:
-    for (auto &sub: addressSubscribes_)
+    // Renew outdated subscriptions, all in one batch:
+    if (!prefixSubscribes_.empty())
     {
-        if (sub.second.lastRefresh + std::chrono::minutes(8) < now)
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           now - lastRenew_);
+        if (renewPeriod <= elapsed)
         {
-            sub.second.lastRefresh = std::chrono::steady_clock::now();
-            renewAddress(sub.first);
+            for (auto &prefix: prefixSubscribes_)
+            {
+                if (prefix.second.ready &&
+                        prefix.second.lastRefresh + renewPeriod <= now)
+                {
+                    prefix.second.lastRefresh = now;
+                    renewPrefix(prefix.first);
+                }
+            }
+            lastRenew_ = now;
+            elapsed = std::chrono::milliseconds::zero();
         }
-        // TODO: factor the time into nextWakeup. This isn't super-critical,
-        // since the height subscribes keep us awake.
+        nextWakeup = bc::client::min_sleep(nextWakeup, renewPeriod - elapsed);
     }
 
     // Handle the socket:
@@ -86,9 +141,15 @@ LibbitcoinConnection::uri()
 }
 
 bool
-LibbitcoinConnection::queueFull()
+LibbitcoinConnection::queueFull(RequestLane lane)
+{
+    return window_.full(RequestLane::interactive == lane);
+}
+
+std::chrono::milliseconds
+LibbitcoinConnection::latencyHigh()
 {
-    return 10 < queuedQueries_;
+    return window_.latencyHigh();
 }
 
 void
@@ -114,26 +175,53 @@ LibbitcoinConnection::addressSubscribe(const StatusCallback &onError,
     // Add the callback to our subscription list:
     if (addressSubscribes_.count(address))
         return;
-    addressSubscribes_[address] = AddressSubscribe
+    addressSubscribes_[address] = AddressSubscribe{onError, onReply};
+
+    // Another address may have already subscribed to this prefix:
+    const auto key = prefixKey(parsed.hash());
+    auto i = prefixSubscribes_.find(key);
+    if (prefixSubscribes_.end() != i)
     {
-        onReply, std::chrono::steady_clock::now()
-    };
+        i->second.addresses.push_back(address);
+        if (i->second.ready)
+            onReply("");
+        return;
+    }
+    auto &prefix = prefixSubscribes_[key];
+    prefix.lastRefresh = std::chrono::steady_clock::now();
+    prefix.addresses.push_back(address);
 
-    auto errorShim = [this, onError, address](const std::error_code &error)
+    const auto sent = window_.sent();
+
+    auto errorShim = [this, key](const std::error_code &error)
     {
-        --queuedQueries_;
-        addressSubscribes_.erase(address);
-        onError(ABC_ERROR(ABC_CC_Error, error.message()));
+        window_.failed();
+        const auto s = ABC_ERROR(ABC_CC_Error, error.message());
+        for (const auto &sub: prefixErase(key))
+            sub.onError(s);
     };
 
-    auto replyShim = [this, onReply]()
+    auto replyShim = [this, sent, key]()
     {
-        --queuedQueries_;
-        onReply("");
+        window_.done(sent);
+
+        auto i = prefixSubscribes_.find(key);
+        if (prefixSubscribes_.end() == i)
+            return;
+        i->second.ready = true;
+
+        // The callbacks might subscribe more addresses, so work on a copy:
+        const auto addresses = i->second.addresses;
+        for (const auto &address: addresses)
+        {
+            const auto sub = addressSubscribes_.find(address);
+            if (addressSubscribes_.end() != sub)
+                sub->second.onReply("");
+        }
     };
 
-    ++queuedQueries_;
-    codec_.subscribe(errorShim, replyShim, parsed);
+    codec_.subscribe(errorShim, replyShim, bc::client::subscribe_type::address,
+                     prefixBinary(key));
 }
 
 bool
@@ -145,34 +233,42 @@ LibbitcoinConnection::addressSubscribed(const std::string &address)
 void
 LibbitcoinConnection::addressHistoryFetch(const StatusCallback &onError,
         const AddressCallback &onReply,
-        const std::string &address)
+        const std::string &address,
+        size_t fromHeight)
 {
     bc::payment_address parsed;
     if (!parsed.set_encoded(address))
         return onError(ABC_ERROR(ABC_CC_ParseError, "Bad address " + address));
 
-    auto errorShim = [this, onError](const std::error_code &error)
+    const auto sent = window_.sent();
+    const auto key = traceBegin();
+
+    auto errorShim = [this, key, onError](const std::error_code &error)
     {
-        --queuedQueries_;
+        traceEnd(key, false);
+        window_.failed();
         onError(ABC_ERROR(ABC_CC_Error, error.message()));
     };
 
-    auto replyShim = [this, onReply](const bc::client::history_list &history)
+    auto replyShim = [this, key, sent, onReply]
+                     (const bc::client::history_list &history)
     {
-        --queuedQueries_;
+        traceEnd(key, true);
+        window_.done(sent);
 
         AddressHistory historyOut;
         for (const auto &row: history)
         {
-            historyOut[bc::encode_hash(row.output.hash)] = row.output_height;
+            // Partial histories can include spends of older outputs:
+            if (row.output.hash != bc::null_hash)
+                historyOut[bc::encode_hash(row.output.hash)] = row.output_height;
             if (row.spend.hash != bc::null_hash)
                 historyOut[bc::encode_hash(row.spend.hash)] = row.spend_height;
         }
         onReply(historyOut);
     };
 
-    ++queuedQueries_;
-    codec_.address_fetch_history(errorShim, replyShim, parsed);
+    codec_.address_fetch_history(errorShim, replyShim, parsed, fromHeight);
 }
 
 void
@@ -184,15 +280,20 @@ LibbitcoinConnection::txDataFetch(const StatusCallback &onError,
     if (!bc::decode_hash(parsed, txid))
         return onError(ABC_ERROR(ABC_CC_ParseError, "Bad txid " + txid));
 
-    auto errorShim = [this, onError](const std::error_code &error)
+    const auto sent = window_.sent();
+    const auto key = traceBegin();
+
+    auto errorShim = [this, key, onError](const std::error_code &error)
     {
-        --queuedQueries_;
+        traceEnd(key, false);
+        window_.failed();
         onError(ABC_ERROR(ABC_CC_Error, error.message()));
     };
 
-    auto replyShim = [this, onReply](const bc::transaction_type &tx)
+    auto replyShim = [this, key, sent, onReply](const bc::transaction_type &tx)
     {
-        --queuedQueries_;
+        traceEnd(key, true);
+        window_.done(sent);
         onReply(tx);
     };
 
@@ -203,7 +304,6 @@ LibbitcoinConnection::txDataFetch(const StatusCallback &onError,
         codec_.fetch_unconfirmed_transaction(errorShim, replyShim, parsed);
     };
 
-    ++queuedQueries_;
     codec_.fetch_transaction(onErrorRetry, replyShim, parsed);
 }
 
@@ -212,34 +312,41 @@ LibbitcoinConnection::blockHeaderFetch(const StatusCallback &onError,
                                        const HeaderCallback &onReply,
                                        size_t height)
 {
-    auto errorShim = [this, onError](const std::error_code &error)
+    const auto sent = window_.sent();
+    const auto key = traceBegin();
+
+    auto errorShim = [this, key, onError](const std::error_code &error)
     {
-        --queuedQueries_;
+        traceEnd(key, false);
+        window_.failed();
         onError(ABC_ERROR(ABC_CC_Error, error.message()));
     };
 
-    auto replyShim = [this, onReply](const bc::block_header_type &header)
+    auto replyShim = [this, key, sent, onReply]
+                     (const bc::block_header_type &header)
     {
-        --queuedQueries_;
+        traceEnd(key, true);
+        window_.done(sent);
         onReply(header);
     };
 
-    ++queuedQueries_;
     codec_.fetch_block_header(errorShim, replyShim, height);
 }
 
 void
 LibbitcoinConnection::fetchHeight()
 {
+    const auto sent = window_.sent();
+
     auto errorShim = [this](const std::error_code &error)
     {
-        --queuedQueries_;
+        window_.failed();
         heightError_(ABC_ERROR(ABC_CC_Error, error.message()));
     };
 
-    auto replyShim = [this](size_t height)
+    auto replyShim = [this, sent](size_t height)
     {
-        --queuedQueries_;
+        window_.done(sent);
         if (lastHeight_ < height)
         {
             lastHeight_ = height;
@@ -247,28 +354,51 @@ LibbitcoinConnection::fetchHeight()
         }
     };
 
-    ++queuedQueries_;
     codec_.fetch_last_height(errorShim, replyShim);
 }
 
 void
-LibbitcoinConnection::renewAddress(const std::string &address)
+LibbitcoinConnection::renewPrefix(uint32_t prefix)
 {
-    auto errorShim = [this, address](const std::error_code &error)
+    const auto sent = window_.sent();
+
+    auto errorShim = [this, prefix](const std::error_code &error)
     {
-        --queuedQueries_;
-        ABC_DebugLog("Subscribe renew failed for %s", address.c_str());
-        addressSubscribes_.erase(address);
+        window_.failed();
+        ABC_DebugLog("Subscribe renew failed for prefix %x", prefix);
+        prefixErase(prefix);
     };
 
-    auto replyShim = [this, address]()
+    auto replyShim = [this, sent, prefix]()
     {
-        --queuedQueries_;
-        ABC_DebugLog("Subscribe renew completed for %s", address.c_str());
+        window_.done(sent);
+        ABC_DebugLog("Subscribe renew completed for prefix %x", prefix);
     };
 
-    ++queuedQueries_;
-    codec_.renew(errorShim, replyShim, bc::payment_address(address));
+    codec_.renew(errorShim, replyShim, bc::client::subscribe_type::address,
+                 prefixBinary(prefix));
+}
+
+std::vector<LibbitcoinConnection::AddressSubscribe>
+LibbitcoinConnection::prefixErase(uint32_t prefix)
+{
+    std::vector<AddressSubscribe> out;
+
+    auto i = prefixSubscribes_.find(prefix);
+    if (prefixSubscribes_.end() == i)
+        return out;
+
+    for (const auto &address: i->second.addresses)
+    {
+        auto sub = addressSubscribes_.find(address);
+        if (addressSubscribes_.end() != sub)
+        {
+            out.push_back(sub->second);
+            addressSubscribes_.erase(sub);
+        }
+    }
+    prefixSubscribes_.erase(i);
+    return out;
 }
 
 void
@@ -276,6 +406,7 @@ LibbitcoinConnection::onUpdate(const bc::payment_address &address,
                                size_t height, const bc::hash_digest &blk_hash,
                                const bc::transaction_type &tx)
 {
+    // Prefix matches can include addresses that aren't ours:
     const auto i = addressSubscribes_.find(address.encoded());
     if (addressSubscribes_.end() != i)
         i->second.onReply("");
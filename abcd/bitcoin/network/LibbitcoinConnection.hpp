@@ -9,6 +9,7 @@
 #define ABCD_BITCOIN_NETWORK_LIBBITCOIN_CONNECTION_HPP
 
 #include "IBitcoinConnection.hpp"
+#include "RequestWindow.hpp"
 #include "../../../minilibs/libbitcoin-client/client.hpp"
 
 namespace abcd {
@@ -34,7 +35,10 @@ public:
     uri() override;
 
     bool
-    queueFull() override;
+    queueFull(RequestLane lane=RequestLane::bulk) override;
+
+    std::chrono::milliseconds
+    latencyHigh() override;
 
     void
     heightSubscribe(const StatusCallback &onError,
@@ -51,7 +55,8 @@ public:
     void
     addressHistoryFetch(const StatusCallback &onError,
                         const AddressCallback &onReply,
-                        const std::string &address) override;
+                        const std::string &address,
+                        size_t fromHeight) override;
 
     void
     txDataFetch(const StatusCallback &onError,
@@ -66,7 +71,17 @@ public:
 private:
     // Connection:
     std::string uri_;
-    int queuedQueries_;
+    RequestWindow window_;
+
+    // Tracing:
+    uint32_t traceId_ = 0;
+    uint64_t traceNext_ = 0;
+
+    uint64_t
+    traceBegin();
+
+    void
+    traceEnd(uint64_t key, bool success);
 
     // Height-check state:
     StatusCallback heightError_;
@@ -74,13 +89,23 @@ private:
     size_t lastHeight_ = 0;
     std::chrono::steady_clock::time_point lastHeightCheck_;
 
-    // Address-check state:
+    // Address-check state.
+    // Each address rides on a subscription to its hash prefix,
+    // which the server matches against every transaction it sees:
     struct AddressSubscribe
     {
+        StatusCallback onError;
         AddressUpdateCallback onReply;
+    };
+    struct PrefixSubscribe
+    {
+        bool ready = false; // The server has confirmed the subscription
         std::chrono::steady_clock::time_point lastRefresh;
+        std::vector<std::string> addresses;
     };
     std::map<std::string, AddressSubscribe> addressSubscribes_;
+    std::map<uint32_t, PrefixSubscribe> prefixSubscribes_;
+    std::chrono::steady_clock::time_point lastRenew_;
 
     // The actual obelisk connection (destructor called first):
     std::shared_ptr<bc::client::zeromq_socket> socket_;
@@ -90,7 +115,14 @@ private:
     fetchHeight();
 
     void
-    renewAddress(const std::string &address);
+    renewPrefix(uint32_t prefix);
+
+    /**
+     * Drops a prefix subscription along with its addresses,
+     * returning the callbacks so the caller can report the failure.
+     */
+    std::vector<AddressSubscribe>
+    prefixErase(uint32_t prefix);
 
     void
     onUpdate(const bc::payment_address &address,
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "RequestWindow.hpp"
+#include <algorithm>
+
+namespace abcd {
+
+constexpr size_t limitMin = 2;
+
+// Extra requests the interactive lane may have beyond the window:
+constexpr size_t interactiveReserve = 4;
+
+// Latency within this of the best we have seen still counts as flat:
+constexpr std::chrono::milliseconds rttSlack(20);
+
+// Assumed reply time before any measurements come in:
+constexpr std::chrono::milliseconds latencyDefault(2000);
+
+RequestWindow::RequestWindow(size_t limit, size_t limitMax):
+    limit_(limit),
+    limitMax_(limitMax)
+{
+}
+
+bool
+RequestWindow::full(bool interactive) const
+{
+    return limit_ + (interactive ? interactiveReserve : 0) <= inFlight_;
+}
+
+RequestWindow::TimePoint
+RequestWindow::sent()
+{
+    ++inFlight_;
+    return std::chrono::steady_clock::now();
+}
+
+void
+RequestWindow::done(TimePoint sent)
+{
+    if (inFlight_)
+        --inFlight_;
+
+    const auto rtt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - sent);
+    if (!rttSmooth_.count())
+    {
+        rttMin_ = rtt;
+        rttSmooth_ = rtt;
+        rttVariance_ = rtt / 2;
+    }
+    rttMin_ = std::min(rttMin_, rtt);
+    const auto error = rtt < rttSmooth_ ? rttSmooth_ - rtt : rtt - rttSmooth_;
+    rttVariance_ = (3 * rttVariance_ + error) / 4;
+    rttSmooth_ = (7 * rttSmooth_ + rtt) / 8;
+
+    if (rttSmooth_ <= 2 * rttMin_ + rttSlack)
+    {
+        // Latency is flat, so open up by one per window of replies:
+        if (limit_ <= ++credit_)
+        {
+            credit_ = 0;
+            limit_ = std::min(limit_ + 1, limitMax_);
+        }
+    }
+    else if (4 * rttMin_ + rttSlack < rttSmooth_)
+    {
+        // The server is queuing our requests:
+        credit_ = 0;
+        limit_ = std::max(limit_ - 1, limitMin);
+    }
+}
+
+void
+RequestWindow::failed()
+{
+    if (inFlight_)
+        --inFlight_;
+
+    credit_ = 0;
+    limit_ = std::max(limit_ / 2, limitMin);
+}
+
+std::chrono::milliseconds
+RequestWindow::latencyHigh() const
+{
+    if (!rttSmooth_.count())
+        return latencyDefault;
+    return rttSmooth_ + 2 * rttVariance_;
+}
+
+void
+RequestWindow::limitMaxSet(size_t limitMax)
+{
+    limitMax_ = limitMax;
+    limit_ = std::min(limit_, limitMax_);
+}
+
+} // namespace abcd
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Per-connection request limits, sized from measured round trips.
+ */
+
+#ifndef ABCD_BITCOIN_NETWORK_REQUEST_WINDOW_HPP
+#define ABCD_BITCOIN_NETWORK_REQUEST_WINDOW_HPP
+
+#include <chrono>
+
+namespace abcd {
+
+/**
+ * Decides how many requests a connection may have outstanding.
+ * The window grows by one each time a full window of replies comes
+ * back without the smoothed round-trip time rising above its floor,
+ * backs off by one when latency climbs, and halves on any failure.
+ */
+class RequestWindow
+{
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    RequestWindow(size_t limit, size_t limitMax);
+
+    /**
+     * Returns true if no more requests should be sent right now.
+     * @param interactive true to include the slots held back
+     * for requests the user is waiting on.
+     */
+    bool
+    full(bool interactive=false) const;
+
+    /**
+     * Records that a request went out.
+     * @return the send time, to be passed back to `done`.
+     */
+    TimePoint
+    sent();
+
+    /**
+     * Records a successful reply to a request sent at the given time.
+     */
+    void
+    done(TimePoint sent);
+
+    /**
+     * Records a request that timed out or failed.
+     */
+    void
+    failed();
+
+    /**
+     * A pessimistic estimate of the time this server takes to reply,
+     * roughly its 95th-percentile round trip.
+     */
+    std::chrono::milliseconds
+    latencyHigh() const;
+
+    /**
+     * Adjusts the largest window this connection can reach.
+     */
+    void
+    limitMaxSet(size_t limitMax);
+
+private:
+    size_t inFlight_ = 0;
+    size_t limit_;
+    size_t limitMax_;
+    size_t credit_ = 0;
+    std::chrono::milliseconds rttMin_{0};
+    std::chrono::milliseconds rttSmooth_{0};
+    std::chrono::milliseconds rttVariance_{0};
+};
+
+} // namespace abcd
+
+#endif
@@ -11,44 +11,37 @@
 #include "../../http/Uri.hpp"
 #include "../../json/JsonArray.hpp"
 #include "../../json/JsonObject.hpp"
+#include "../../json/JsonReader.hpp"
 #include "../../util/Debug.hpp"
+#include "../../util/Metrics.hpp"
+#include "../../util/Trace.hpp"
+#include <string.h>
 #include <algorithm>
 
 namespace abcd {
 
 constexpr std::chrono::seconds keepaliveTime(60);
 constexpr std::chrono::seconds timeout(30);
+constexpr std::chrono::seconds requestTimeout(20);
+constexpr std::chrono::milliseconds connectPoll(20);
 
-struct RequestJson:
-    public JsonObject
-{
-    ABC_JSON_INTEGER(id, "id", 0)
-    ABC_JSON_STRING(method, "method", nullptr)
-    ABC_JSON_VALUE(params, "params", JsonArray);
-};
+// Outstanding request window, with and without batch support:
+constexpr size_t windowStart = 10;
+constexpr size_t windowMax = 20;
+constexpr size_t batchWindowMax = 200;
+constexpr size_t batchSize = 50;
 
-struct HeaderJson:
-    public JsonObject
-{
-    ABC_JSON_CONSTRUCTORS(HeaderJson, JsonObject)
-
-    ABC_JSON_INTEGER(nonce, "nonce", 0);
-    ABC_JSON_STRING(prev_block_hash, "prev_block_hash", "");
-    ABC_JSON_INTEGER(timestamp, "timestamp", 0);
-    ABC_JSON_STRING(merkle_root, "merkle_root", "");
-    ABC_JSON_INTEGER(block_height, "block_height", 0);
-    ABC_JSON_INTEGER(version, "version", 0);
-    ABC_JSON_INTEGER(bits, "bits", 0);
-};
+// Serialized block header size:
+constexpr size_t headerSize = 80;
+
+// Server software known to accept JSON-RPC batches:
+constexpr auto batchServer = "ElectrumX";
 
-struct ReplyJson:
+struct RequestJson:
     public JsonObject
 {
     ABC_JSON_INTEGER(id, "id", 0)
-    ABC_JSON_VALUE(result, "result", JsonPtr);
-
-    // Only used on subscription updates:
-    ABC_JSON_STRING(method, "method", "");
+    ABC_JSON_STRING(method, "method", nullptr)
     ABC_JSON_VALUE(params, "params", JsonArray);
 };
 
@@ -58,6 +51,11 @@ StratumConnection::~StratumConnection()
         i.second.onError(ABC_ERROR(ABC_CC_Error, "Connection closed"));
 }
 
+StratumConnection::StratumConnection():
+    window_(windowStart, windowMax)
+{
+}
+
 void
 StratumConnection::version(const StatusCallback &onError,
                            const VersionHandler &onReply)
@@ -66,12 +64,25 @@ StratumConnection::version(const StatusCallback &onError,
     params.append(json_string("2.5.4")); // Our version
     params.append(json_string("0.10")); // Protocol version
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        if (!json_is_string(payload.get()))
+        // Newer servers reply with [software, protocol] instead:
+        std::string version;
+        if (payload.arrayBegin())
+        {
+            if (!payload.arrayItem() || !payload.readString(version))
+                return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+            while (payload.arrayItem())
+                payload.skip();
+            if (!payload.ok())
+                return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+        }
+        else if (!payload.readString(version))
+        {
             return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+        }
 
-        onReply(json_string_value(payload.get()));
+        onReply(version);
         return Status();
     };
 
@@ -86,16 +97,18 @@ StratumConnection::feeEstimateFetch(const StatusCallback &onError,
     JsonArray params;
     params.append(json_integer(blocks));
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        if (!json_is_number(payload.get()))
+        double fee;
+        if (!payload.readNumber(fee))
             return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
 
-        onReply(json_number_value(payload.get()));
+        onReply(fee);
         return Status();
     };
 
-    sendMessage("blockchain.estimatefee", params, onError, decoder);
+    sendMessage("blockchain.estimatefee", params, onError, decoder,
+                RequestLane::interactive);
 }
 
 void
@@ -105,12 +118,12 @@ StratumConnection::sendTx(const StatusCallback &onDone, DataSlice tx)
     params.append(json_string(base16Encode(tx).c_str()));
 
     const auto hash = bc::encode_hash(bc::bitcoin_hash(tx));
-    auto decoder = [onDone, hash](JsonPtr payload) -> Status
+    auto decoder = [onDone, hash](JsonReader &payload) -> Status
     {
-        if (!json_is_string(payload.get()))
+        std::string message;
+        if (!payload.readString(message))
             return ABC_ERROR(ABC_CC_Error, "Bad reply format");
 
-        const auto message = json_string_value(payload.get());
         if (message != hash)
             return ABC_ERROR(ABC_CC_Error, message);
 
@@ -118,19 +131,28 @@ StratumConnection::sendTx(const StatusCallback &onDone, DataSlice tx)
         return Status();
     };
 
-    sendMessage("blockchain.transaction.broadcast", params, onDone, decoder);
+    sendMessage("blockchain.transaction.broadcast", params, onDone, decoder,
+                RequestLane::interactive);
+}
+
+void
+StratumConnection::socketSet(ServerSocketPtr socket)
+{
+    socket_ = std::move(socket);
 }
 
 Status
 StratumConnection::connect(const std::string &rawUri)
 {
     uri_ = rawUri;
+    traceId_ = traceId(rawUri);
 
     Uri uri;
     if (!uri.decode(rawUri))
         return ABC_ERROR(ABC_CC_ParseError, "Bad URI - wrong format");
 
-    if (stratumScheme != uri.scheme())
+    const bool tls = stratumsScheme == uri.scheme();
+    if (stratumScheme != uri.scheme() && !tls)
         return ABC_ERROR(ABC_CC_ParseError, "Bad URI - wrong scheme");
 
     auto server = uri.authority();
@@ -141,8 +163,25 @@ StratumConnection::connect(const std::string &rawUri)
     auto serverPort = server.substr(last + 1, std::string::npos);
 
     // Connect to the server:
-    ABC_CHECK(connection_.connect(serverName, atoi(serverPort.c_str())));
+    // Start connecting to the server. Requests queue up until it's done:
+    ABC_CHECK(connection_.connect(serverName, atoi(serverPort.c_str()), tls));
+    connecting_ = true;
     lastKeepalive_ = std::chrono::steady_clock::now();
+    trace(TraceEvent::stratumConnect, TracePhase::instant, traceId_);
+
+    // Find out if the server can take batched requests:
+    auto onError = [](Status status) { };
+    auto onReply = [this](const std::string &version)
+    {
+        batching_ = !version.compare(0, strlen(batchServer), batchServer);
+        if (batching_)
+        {
+            ABC_DebugLog("%s accepts batched requests", uri_.c_str());
+            window_.limitMaxSet(batchWindowMax);
+            headerRanges_ = true;
+        }
+    };
+    version(onError, onReply);
 
     return Status();
 }
@@ -150,24 +189,37 @@ StratumConnection::connect(const std::string &rawUri)
 Status
 StratumConnection::wakeup(SleepTime &sleep)
 {
-    // Read any data available on the socket:
-    DataChunk buffer;
-    ABC_CHECK(connection_.read(buffer));
-    incoming_ += std::string(buffer.begin(), buffer.end());
-
-    // Extract any incoming messages:
-    while (true)
+    // Finish connecting before anything else:
+    if (connecting_)
     {
-        // Find the newline:
-        auto where = std::find(incoming_.begin(), incoming_.end(), '\n');
-        if (incoming_.end() == where)
-            break;
-
-        // Extract and process the message:
-        ABC_CHECK(handleMessage(std::string(incoming_.begin(), where + 1)));
-        incoming_.erase(incoming_.begin(), where + 1);
+        bool done;
+        ABC_CHECK(connection_.connectCheck(done));
+        if (!done)
+        {
+            sleep = connectPoll;
+            return Status();
+        }
+
+        ABC_DebugLog("%s: connected", uri_.c_str());
+        connecting_ = false;
+        ABC_CHECK(connection_.send(unsent_));
+        unsent_.clear();
+        lastProgress_ = lastKeepalive_ = std::chrono::steady_clock::now();
     }
 
+    // Read any data available on the socket:
+    size_t bytes;
+    ABC_CHECK(connection_.read(incoming_, bytes));
+
+    // A large reply still trickling in counts as progress:
+    if (bytes)
+        lastProgress_ = std::chrono::steady_clock::now();
+
+    // Extract and process any incoming messages:
+    DataSlice message;
+    while (incoming_.line(message))
+        ABC_CHECK(handleMessage(message));
+
     // We need to wake up every minute:
     auto now = std::chrono::steady_clock::now();
     if (lastKeepalive_ + keepaliveTime < now)
@@ -184,6 +236,18 @@ StratumConnection::wakeup(SleepTime &sleep)
     sleep = std::chrono::duration_cast<SleepTime>(
                 lastKeepalive_ + keepaliveTime - now);
 
+    // Fail any requests the server has sat on for too long.
+    // Ids go out in order with a fixed timeout, so the oldest comes first:
+    while (pending_.size() && pending_.begin()->second.deadline < now)
+    {
+        auto pending = std::move(pending_.begin()->second);
+        trace(TraceEvent::stratumRequest, TracePhase::asyncEnd, traceId_,
+              pending_.begin()->first, false);
+        pending_.erase(pending_.begin());
+        window_.failed();
+        pending.onError(ABC_ERROR(ABC_CC_ServerError, "Request timed out"));
+    }
+
     // Check the timeout:
     if (pending_.size())
     {
@@ -193,6 +257,10 @@ StratumConnection::wakeup(SleepTime &sleep)
                              lastProgress_ + timeout - now));
     }
 
+    // Come right back for data stuck inside the TLS layer:
+    if (connection_.buffered())
+        sleep = SleepTime(1);
+
     return Status();
 }
 
@@ -203,9 +271,15 @@ StratumConnection::uri()
 }
 
 bool
-StratumConnection::queueFull()
+StratumConnection::queueFull(RequestLane lane)
+{
+    return window_.full(RequestLane::interactive == lane);
+}
+
+std::chrono::milliseconds
+StratumConnection::latencyHigh()
 {
-    return 10 < pending_.size();
+    return window_.latencyHigh();
 }
 
 void
@@ -215,12 +289,13 @@ StratumConnection::heightSubscribe(const StatusCallback &onError,
     JsonPtr params;
     heightCallback_ = onReply;
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        if (!json_is_number(payload.get()))
+        int64_t height;
+        if (!payload.readInteger(height))
             return ABC_ERROR(ABC_CC_Error, "Bad reply format");
 
-        onReply(json_number_value(payload.get()));
+        onReply(height);
         return Status();
     };
 
@@ -246,11 +321,13 @@ StratumConnection::addressSubscribe(const StatusCallback &onError,
         onError(s);
     };
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
         std::string stateHash;
-        if (json_is_string(payload.get()))
-            stateHash = json_string_value(payload.get());
+        if (JsonReader::Type::null == payload.peek())
+            stateHash = addressStatusEmpty;
+        else
+            payload.readString(stateHash);
 
         onReply(stateHash);
         return Status();
@@ -268,38 +345,42 @@ StratumConnection::addressSubscribed(const std::string &address)
 void
 StratumConnection::addressHistoryFetch(const StatusCallback &onError,
                                        const AddressCallback &onReply,
-                                       const std::string &address)
+                                       const std::string &address,
+                                       size_t fromHeight)
 {
+    // Electrum servers always send the full history, so skip `fromHeight`:
     JsonArray params;
     params.append(json_string(address.c_str()));
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        JsonArray arrayJson(payload);
-
         AddressHistory history;
-        size_t size = arrayJson.size();
-        for (size_t i = 0; i < size; i++)
+        if (payload.arrayBegin())
         {
-            struct HistoryJson:
-                public JsonObject
+            std::string key;
+            std::string txid;
+            while (payload.arrayItem())
             {
-                ABC_JSON_CONSTRUCTORS(HistoryJson, JsonObject)
-                ABC_JSON_STRING(txid, "tx_hash", nullptr)
-                ABC_JSON_INTEGER(height, "height", 0)
-            };
-            HistoryJson json(arrayJson[i]);
-
-            if (!json.txidOk())
-                return ABC_ERROR(ABC_CC_Error, "Missing txid");
-
-            if (json.heightOk() && json.height() >= 0)
-            {
-                history[json.txid()] = json.height();
-            }
-            else
-            {
-                history[json.txid()] = 0;
+                txid.clear();
+                int64_t height = 0;
+
+                if (!payload.objectBegin())
+                    return ABC_ERROR(ABC_CC_Error, "Bad history format");
+                while (payload.objectKey(key))
+                {
+                    if ("tx_hash" == key && payload.readString(txid))
+                        continue;
+                    if ("height" == key && payload.readInteger(height))
+                        continue;
+                    payload.skip();
+                }
+                if (!payload.ok())
+                    return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+
+                if (txid.empty())
+                    return ABC_ERROR(ABC_CC_Error, "Missing txid");
+
+                history[txid] = 0 <= height ? height : 0;
             }
         }
 
@@ -318,13 +399,14 @@ StratumConnection::txDataFetch(const StatusCallback &onError,
     JsonArray params;
     params.append(json_string(txid.c_str()));
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        if (!json_is_string(payload.get()))
+        std::string hex;
+        if (!payload.readString(hex))
             return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
 
         DataChunk rawTx;
-        if (!base16Decode(rawTx, json_string_value(payload.get())))
+        if (!base16Decode(rawTx, hex))
             return ABC_ERROR(ABC_CC_ParseError, "Bad transaction format");
         bc::transaction_type tx;
         ABC_CHECK(decodeTx(tx, rawTx));
@@ -344,24 +426,53 @@ StratumConnection::blockHeaderFetch(const StatusCallback &onError,
     JsonArray params;
     params.append(json_integer(height));
 
-    auto decoder = [onReply](JsonPtr payload) -> Status
+    auto decoder = [onReply](JsonReader &payload) -> Status
     {
-        HeaderJson headerJson(payload);
+        std::string previousHex;
+        std::string merkleHex;
+        int64_t version = 0;
+        int64_t timestamp = 0;
+        int64_t bits = 0;
+        int64_t nonce = 0;
+
+        std::string key;
+        if (!payload.objectBegin())
+            return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+        while (payload.objectKey(key))
+        {
+            bool used = false;
+            if ("prev_block_hash" == key)
+                used = payload.readString(previousHex);
+            else if ("merkle_root" == key)
+                used = payload.readString(merkleHex);
+            else if ("version" == key)
+                used = payload.readInteger(version);
+            else if ("timestamp" == key)
+                used = payload.readInteger(timestamp);
+            else if ("bits" == key)
+                used = payload.readInteger(bits);
+            else if ("nonce" == key)
+                used = payload.readInteger(nonce);
+            if (!used)
+                payload.skip();
+        }
+        if (!payload.ok())
+            return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
 
         bc::hash_digest previous_block_hash;
         bc::hash_digest merkle;
-        if (!bc::decode_hash(previous_block_hash, headerJson.prev_block_hash()))
+        if (!bc::decode_hash(previous_block_hash, previousHex))
             return ABC_ERROR(ABC_CC_ParseError, "Bad hash");
-        if (!bc::decode_hash(merkle, headerJson.merkle_root()))
+        if (!bc::decode_hash(merkle, merkleHex))
             return ABC_ERROR(ABC_CC_ParseError, "Bad hash");
 
         bc::block_header_type header;
         header.previous_block_hash = previous_block_hash;
         header.merkle = merkle;
-        header.version = headerJson.version();
-        header.timestamp = headerJson.timestamp();
-        header.bits = headerJson.bits();
-        header.nonce = headerJson.nonce();
+        header.version = version;
+        header.timestamp = timestamp;
+        header.bits = bits;
+        header.nonce = nonce;
 
         onReply(header);
         return Status();
@@ -370,10 +481,77 @@ StratumConnection::blockHeaderFetch(const StatusCallback &onError,
     sendMessage("blockchain.block.get_header", params, onError, decoder);
 }
 
+void
+StratumConnection::blockHeadersFetch(const StatusCallback &onError,
+                                     const HeadersCallback &onReply,
+                                     size_t height, size_t count)
+{
+    if (!headerRanges_)
+        return IBitcoinConnection::blockHeadersFetch(onError, onReply,
+                height, count);
+
+    JsonArray params;
+    params.append(json_integer(height));
+    params.append(json_integer(count));
+
+    auto decoder = [onReply](JsonReader &payload) -> Status
+    {
+        std::string hex;
+        int64_t returned = 0;
+
+        std::string key;
+        if (!payload.objectBegin())
+            return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+        while (payload.objectKey(key))
+        {
+            bool used = false;
+            if ("hex" == key)
+                used = payload.readString(hex);
+            else if ("count" == key)
+                used = payload.readInteger(returned);
+            if (!used)
+                payload.skip();
+        }
+        if (!payload.ok())
+            return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+
+        DataChunk raw;
+        if (!base16Decode(raw, hex) ||
+                raw.size() != returned * headerSize)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad header data");
+
+        HeaderList headers(returned);
+        for (size_t i = 0; i < headers.size(); ++i)
+        {
+            const auto start = raw.data() + i * headerSize;
+            ABC_CHECK(decodeHeader(headers[i],
+                                   DataSlice(start, start + headerSize)));
+        }
+
+        onReply(headers);
+        return Status();
+    };
+
+    // Older servers reject this method, leaving us with an error
+    // object instead of a result. In that case, go one by one:
+    auto onErrorRetry = [this, onError, onReply, height, count](Status s)
+    {
+        if (!headerRanges_ || ABC_CC_JSONError != s.value())
+            return onError(s);
+
+        ABC_DebugLog("%s: header ranges failed (%s), fetching one by one",
+                     uri_.c_str(), s.message().c_str());
+        headerRanges_ = false;
+        IBitcoinConnection::blockHeadersFetch(onError, onReply, height, count);
+    };
+
+    sendMessage("blockchain.block.headers", params, onErrorRetry, decoder);
+}
+
 void
 StratumConnection::sendMessage(const std::string &method, JsonPtr params,
                                const StatusCallback &onError,
-                               const Decoder &decoder)
+                               const Decoder &decoder, RequestLane lane)
 {
     const auto id = lastId++;
 
@@ -382,31 +560,130 @@ StratumConnection::sendMessage(const std::string &method, JsonPtr params,
     query.methodSet(method);
     query.paramsSet(params);
 
-    auto s = connection_.send(query.encode(true) + '\n');
-    if (!s)
-        return onError(s);
+    if (batching_ && RequestLane::bulk == lane)
+    {
+        // Hold the request for the next batch:
+        outgoing_ += outgoingCount_ ? ',' : '[';
+        outgoing_ += query.encode(true);
+        ++outgoingCount_;
+    }
+    else
+    {
+        auto s = send(query.encode(true) + '\n');
+        if (!s)
+            return onError(s);
+    }
 
     // Start the timeout if this is the first message in the queue:
     if (pending_.empty())
         lastProgress_ = std::chrono::steady_clock::now();
 
     // The message has been sent, so save the decoder:
-    pending_[id] = Pending{ onError, decoder };
+    const auto sent = window_.sent();
+    pending_[id] = Pending{ onError, decoder, sent, sent + requestTimeout };
+    trace(TraceEvent::stratumRequest, TracePhase::asyncBegin, traceId_, id);
+
+    if (batchSize <= outgoingCount_)
+        flush().log();
+}
+
+Status
+StratumConnection::flush()
+{
+    if (!outgoingCount_)
+        return Status();
+
+    outgoing_ += "]\n";
+    auto s = send(outgoing_);
+    outgoing_.clear();
+    outgoingCount_ = 0;
+
+    // The destructor fails whatever is left in `pending_`:
+    return s;
 }
 
 Status
-StratumConnection::handleMessage(const std::string &message)
+StratumConnection::send(const std::string &data)
 {
-    ReplyJson json;
-    ABC_CHECK(json.decode(message));
-    if (json.idOk())
+    if (connecting_)
     {
-        auto i = pending_.find(json.id());
+        unsent_ += data;
+        return Status();
+    }
+    return connection_.send(data);
+}
+
+Status
+StratumConnection::handleMessage(DataSlice message)
+{
+    JsonReader reader(message);
+
+    // Batch replies arrive as an array of ordinary replies:
+    if (reader.arrayBegin())
+    {
+        while (reader.arrayItem())
+            ABC_CHECK(handleReply(reader));
+    }
+    else
+    {
+        ABC_CHECK(handleReply(reader));
+    }
+
+    // Anything after the message means the framing has gone wrong:
+    if (!reader.ok() || JsonReader::Type::end != reader.peek())
+        return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+    return Status();
+}
+
+Status
+StratumConnection::handleReply(JsonReader &reader)
+{
+    static auto &parsed = metricCounter("stratum.messages_parsed");
+
+    // Pick out the envelope, saving the payload for the decoders:
+    bool idOk = false;
+    int64_t id = 0;
+    std::string method;
+    DataSlice result;
+    DataSlice params;
+
+    std::string key;
+    if (!reader.objectBegin())
+        return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+    while (reader.objectKey(key))
+    {
+        bool used = false;
+        if ("id" == key)
+            used = idOk = reader.readInteger(id);
+        else if ("result" == key)
+            used = reader.skip(&result);
+        else if ("method" == key)
+            used = reader.readString(method);
+        else if ("params" == key)
+            used = reader.skip(&params);
+        if (!used)
+            reader.skip();
+    }
+    if (!reader.ok())
+        return ABC_ERROR(ABC_CC_JSONError, "Bad reply format");
+    parsed.add();
+
+    if (idOk)
+    {
+        auto i = pending_.find(id);
         if (pending_.end() != i)
         {
-            auto s = i->second.decoder(json.result());
-            if (!s)
+            JsonReader payload(result);
+            auto s = i->second.decoder(payload);
+            trace(TraceEvent::stratumRequest, TracePhase::asyncEnd, traceId_,
+                  id, !!s);
+            if (s)
+                window_.done(i->second.sent);
+            else
+            {
+                window_.failed();
                 i->second.onError(s);
+            }
             pending_.erase(i);
             return Status();
         }
@@ -418,25 +695,18 @@ StratumConnection::handleMessage(const std::string &message)
     else
     {
         // Handle subscription updates:
-        std::string method = json.method();
-        auto params = json.params();
+        JsonReader paramsReader(params);
+        const bool paramsArray = paramsReader.arrayBegin();
 
         if ("blockchain.numblocks.subscribe" == method)
         {
-            size_t height;
-            if (params.ok() && 1 <= params.size()
-                    && json_is_number(params[0].get()))
-            {
-                height = json_integer_value(params[0].get());
-            }
-            else if (json_is_number(params.get()))
-            {
-                height = json_integer_value(params.get());
-            }
-            else
+            int64_t height;
+            if (paramsArray)
+                paramsReader.arrayItem(); // Servers send [height] or height
+            if (!paramsReader.readInteger(height))
             {
                 return ABC_ERROR(ABC_CC_Error,
-                                 "Bad reply format" + json.encode());
+                                 "Bad reply format" + toString(params));
             }
 
             if (heightCallback_)
@@ -446,17 +716,14 @@ StratumConnection::handleMessage(const std::string &message)
         {
             std::string address;
             std::string stateHash;
-            if (params.ok() && 2 <= params.size()
-                    && json_is_string(params[0].get())
-                    && json_is_string(params[1].get()))
-            {
-                address = json_string_value(params[0].get());
-                stateHash = json_string_value(params[1].get());
-            }
-            else
+            if (!paramsArray ||
+                    !paramsReader.arrayItem() ||
+                    !paramsReader.readString(address) ||
+                    !paramsReader.arrayItem() ||
+                    !paramsReader.readString(stateHash))
             {
                 return ABC_ERROR(ABC_CC_Error,
-                                 "Bad reply format" + json.encode());
+                                 "Bad reply format" + toString(params));
             }
 
             const auto i = addressCallbacks_.find(address);
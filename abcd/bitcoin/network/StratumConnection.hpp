@@ -9,17 +9,22 @@
 #define ABCD_BITCOIN_NETWORK_STRATUM_CODEC_HPP
 
 #include "IBitcoinConnection.hpp"
+#include "RequestWindow.hpp"
 #include "TcpConnection.hpp"
+#include "../cache/ServerCache.hpp"
+#include "../../util/LineBuffer.hpp"
 #include <chrono>
 #include <map>
 
 namespace abcd {
 
 class JsonPtr;
+class JsonReader;
 typedef std::chrono::milliseconds SleepTime;
 
-// Scheme used for stratum URI's:
+// Schemes used for stratum URI's, plain and over TLS:
 constexpr auto stratumScheme = "stratum";
+constexpr auto stratumsScheme = "stratums";
 
 class StratumConnection:
     public IBitcoinConnection
@@ -29,6 +34,7 @@ public:
     typedef std::function<void (double fee)> FeeCallback;
 
     ~StratumConnection();
+    StratumConnection();
 
     /**
      * Requests the server version.
@@ -54,11 +60,20 @@ public:
     sendTx(const StatusCallback &onDone, DataSlice tx);
 
     /**
-     * Connects to the specified stratum server.
+     * Starts connecting to the specified stratum server.
+     * Requests can go out right away,
+     * and will be sent once `wakeup` finishes the connection.
      */
     Status
     connect(const std::string &uri);
 
+    /**
+     * Hands the connection its slot in the process-wide socket budget,
+     * which goes back once the connection closes.
+     */
+    void
+    socketSet(ServerSocketPtr socket);
+
     /**
      * Performs any pending work,
      * and returns the number of ms until the next time we need a wakeup.
@@ -66,17 +81,34 @@ public:
     Status
     wakeup(SleepTime &sleep);
 
+    /**
+     * Sends any requests that are waiting to go out as a batch.
+     * Call this once all the work for a wakeup has been handed out.
+     */
+    Status
+    flush();
+
     /**
      * Obtains the socket that the main loop should sleep on.
      */
     int pollfd() const { return connection_.pollfd(); }
 
+    /**
+     * Handles a message as if it had just arrived from the server.
+     * This lets benchmarks and fuzzers drive the parser without a socket.
+     */
+    Status
+    inject(DataSlice message) { return handleMessage(message); }
+
     // IBitcoinConnection interface:
     std::string
     uri() override;
 
     bool
-    queueFull() override;
+    queueFull(RequestLane lane=RequestLane::bulk) override;
+
+    std::chrono::milliseconds
+    latencyHigh() override;
 
     void
     heightSubscribe(const StatusCallback &onError,
@@ -93,7 +125,8 @@ public:
     void
     addressHistoryFetch(const StatusCallback &onError,
                         const AddressCallback &onReply,
-                        const std::string &address) override;
+                        const std::string &address,
+                        size_t fromHeight) override;
 
     void
     txDataFetch(const StatusCallback &onError,
@@ -105,23 +138,42 @@ public:
                      const HeaderCallback &onReply,
                      size_t height) override;
 
+    /**
+     * Uses `blockchain.block.headers` where the server supports it,
+     * falling back to one request per header otherwise.
+     */
+    void
+    blockHeadersFetch(const StatusCallback &onError,
+                      const HeadersCallback &onReply,
+                      size_t height, size_t count) override;
+
 private:
-    typedef std::function<Status (JsonPtr payload)> Decoder;
+    typedef std::function<Status (JsonReader &payload)> Decoder;
 
     // Socket:
+    ServerSocketPtr socket_;
     std::string uri_;
+    uint32_t traceId_ = 0;
     TcpConnection connection_;
-    std::string incoming_;
+    bool connecting_ = false;
+    std::string unsent_;
+    LineBuffer incoming_;
 
     // Sending:
     unsigned lastId = 0;
+    bool batching_ = false;
+    bool headerRanges_ = false;
+    std::string outgoing_;
+    size_t outgoingCount_ = 0;
     struct Pending
     {
         StatusCallback onError;
         Decoder decoder;
-        // TODO: Add timeout logic
+        RequestWindow::TimePoint sent;
+        std::chrono::steady_clock::time_point deadline;
     };
     std::map<unsigned, Pending> pending_;
+    RequestWindow window_;
 
     // Timeout:
     std::chrono::steady_clock::time_point lastProgress_;
@@ -137,16 +189,31 @@ private:
      * Sends a message and sets up the reply decoder.
      * If anything goes wrong (including errors returned by the decoder),
      * the error callback will be called.
+     * Interactive messages skip the batch and go out right away,
+     * ahead of any bulk requests still waiting there.
      */
     void
     sendMessage(const std::string &method, JsonPtr params,
-                const StatusCallback &onError, const Decoder &decoder);
+                const StatusCallback &onError, const Decoder &decoder,
+                RequestLane lane=RequestLane::bulk);
+
+    /**
+     * Writes to the socket, or holds the data until the socket connects.
+     */
+    Status
+    send(const std::string &data);
 
     /**
      * Decodes and handles a complete message from the server.
      */
     Status
-    handleMessage(const std::string &message);
+    handleMessage(DataSlice message);
+
+    /**
+     * Handles a single reply or notification object from the server.
+     */
+    Status
+    handleReply(JsonReader &reader);
 };
 
 } // namespace abcd
@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "StratumMock.hpp"
+#include "../Utility.hpp"
+#include "../../crypto/Encoding.hpp"
+#include "../../json/JsonArray.hpp"
+#include "../../json/JsonObject.hpp"
+#include "../../util/Debug.hpp"
+#include "../../util/LineBuffer.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <deque>
+#include <list>
+
+namespace abcd {
+
+constexpr int pollTimeout = 100; // ms, for noticing `stop`
+constexpr size_t readChunk = 65536;
+constexpr size_t headersMax = 2016;
+constexpr auto mockVersion = "ElectrumX 1.2 (mock)";
+
+// JSON-RPC error codes:
+constexpr json_int_t parseError = -32700;
+constexpr json_int_t methodError = -32601;
+constexpr json_int_t paramsError = -32602;
+
+StratumMock::~StratumMock()
+{
+    stop();
+}
+
+StratumMock::StratumMock(const SyntheticChain &chain):
+    chain_(chain),
+    done_(false),
+    requests_(0),
+    replyDelay_(std::chrono::milliseconds(0))
+{
+}
+
+Status
+StratumMock::start(unsigned port)
+{
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return ABC_ERROR(ABC_CC_SysError, "Cannot create socket");
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t size = sizeof(address);
+    if (bind(fd_, reinterpret_cast<struct sockaddr *>(&address), size) ||
+            listen(fd_, 16) ||
+            getsockname(fd_, reinterpret_cast<struct sockaddr *>(&address),
+                        &size))
+    {
+        close(fd_);
+        fd_ = -1;
+        return ABC_ERROR(ABC_CC_SysError, "Cannot listen on port " +
+                         std::to_string(port) + ": " + strerror(errno));
+    }
+    port_ = ntohs(address.sin_port);
+
+    done_ = false;
+    thread_ = std::thread([this]() { run(); });
+    return Status();
+}
+
+void
+StratumMock::stop()
+{
+    done_ = true;
+    if (thread_.joinable())
+        thread_.join();
+    if (0 <= fd_)
+        close(fd_);
+    fd_ = -1;
+}
+
+std::string
+StratumMock::uri() const
+{
+    return "stratum://127.0.0.1:" + std::to_string(port_);
+}
+
+void
+StratumMock::run()
+{
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    struct Client
+    {
+        int fd;
+        LineBuffer incoming;
+        std::string outgoing;
+        std::deque<std::pair<TimePoint, std::string>> delayed;
+    };
+    std::list<Client> clients;
+
+    while (!done_)
+    {
+        // Release any delayed replies that are due:
+        const auto now = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::milliseconds(pollTimeout);
+        for (auto &client: clients)
+        {
+            while (!client.delayed.empty() && client.delayed.front().first <= now)
+            {
+                client.outgoing += client.delayed.front().second;
+                client.delayed.pop_front();
+            }
+            if (!client.delayed.empty())
+                timeout = std::min(timeout,
+                                   std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       client.delayed.front().first - now) +
+                                   std::chrono::milliseconds(1));
+        }
+
+        std::vector<struct pollfd> fds;
+        fds.push_back(pollfd{fd_, POLLIN, 0});
+        for (const auto &client: clients)
+        {
+            short events = POLLIN;
+            if (!client.outgoing.empty())
+                events |= POLLOUT;
+            fds.push_back(pollfd{client.fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), timeout.count()) <= 0)
+            continue;
+
+        // New clients:
+        if (fds[0].revents & POLLIN)
+        {
+            const int fd = accept(fd_, nullptr, nullptr);
+            if (0 <= fd)
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                clients.push_back(Client{fd, LineBuffer(), "", {}});
+            }
+        }
+
+        // Existing clients:
+        size_t n = 1;
+        for (auto i = clients.begin(); i != clients.end(); ++n)
+        {
+            bool closed = false;
+            if (fds[n].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                auto *buffer = i->incoming.prepare(readChunk);
+                const auto size = read(i->fd, buffer, readChunk);
+                if (0 < size)
+                {
+                    i->incoming.commit(size);
+                    const auto delay = replyDelay_.load();
+                    const auto due = std::chrono::steady_clock::now() + delay;
+                    DataSlice line;
+                    while (i->incoming.line(line))
+                    {
+                        if (delay.count())
+                            i->delayed.emplace_back(due, reply(line));
+                        else
+                            i->outgoing += reply(line);
+                    }
+                }
+                else if (!size || EAGAIN != errno)
+                    closed = true;
+            }
+            if (!closed && !i->outgoing.empty())
+            {
+                const auto size = send(i->fd, i->outgoing.data(),
+                                       i->outgoing.size(), MSG_NOSIGNAL);
+                if (0 < size)
+                    i->outgoing.erase(0, size);
+                else if (EAGAIN != errno)
+                    closed = true;
+            }
+
+            if (closed)
+            {
+                close(i->fd);
+                i = clients.erase(i);
+            }
+            else
+                ++i;
+        }
+    }
+
+    for (const auto &client: clients)
+        close(client.fd);
+}
+
+std::string
+StratumMock::reply(DataSlice line)
+{
+    JsonPtr in;
+    if (!in.decode(reinterpret_cast<const char *>(line.data()), line.size()))
+        return "{\"id\": null, \"error\": {\"code\": -32700, "
+               "\"message\": \"Parse error\"}}\n";
+
+    // Answers a single request object:
+    auto answer = [this](json_t *request)
+    {
+        JsonObject out;
+        json_t *id = json_object_get(request, "id");
+        out.set("id", JsonPtr(id ? json_incref(id) : json_null()));
+
+        const char *method =
+            json_string_value(json_object_get(request, "method"));
+        json_t *params = json_object_get(request, "params");
+
+        JsonPtr result;
+        const auto s = json_is_object(request) && method ?
+                       this->result(result, method,
+                                    JsonPtr(params ? json_incref(params) :
+                                            json_array())) :
+                       ABC_ERROR(ABC_CC_JSONError, "Bad request");
+        if (s)
+        {
+            out.set("result", result);
+        }
+        else
+        {
+            JsonObject error;
+            error.set("code", ABC_CC_NotSupported == s.value() ? methodError :
+                      ABC_CC_JSONError == s.value() ? paramsError : parseError);
+            error.set("message", s.message());
+            out.set("error", error);
+        }
+        ++requests_;
+        return JsonPtr(out);
+    };
+
+    if (json_is_array(in.get()))
+    {
+        JsonArray batch;
+        for (size_t i = 0; i < json_array_size(in.get()); ++i)
+            batch.append(answer(json_array_get(in.get(), i)));
+        return batch.encode(true) + "\n";
+    }
+    return answer(in.get()).encode(true) + "\n";
+}
+
+Status
+StratumMock::result(JsonPtr &result, const std::string &method,
+                    JsonPtr params)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    json_t *p0 = json_array_get(params.get(), 0);
+    json_t *p1 = json_array_get(params.get(), 1);
+
+    if ("server.version" == method)
+    {
+        result.reset(json_string(mockVersion));
+    }
+    else if ("blockchain.numblocks.subscribe" == method)
+    {
+        result.reset(json_integer(chain_.height()));
+    }
+    else if ("blockchain.estimatefee" == method)
+    {
+        result.reset(json_real(0.0002));
+    }
+    else if ("blockchain.address.subscribe" == method)
+    {
+        if (!json_is_string(p0))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected an address");
+        const auto hash = chain_.statusHash(json_string_value(p0));
+        result.reset(hash.empty() ? json_null() : json_string(hash.c_str()));
+    }
+    else if ("blockchain.address.get_history" == method)
+    {
+        if (!json_is_string(p0))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected an address");
+
+        JsonArray out;
+        for (const auto &i: chain_.history(json_string_value(p0)))
+        {
+            JsonObject item;
+            ABC_CHECK(item.set("tx_hash", i.first));
+            ABC_CHECK(item.set("height", json_int_t(i.second)));
+            ABC_CHECK(out.append(item));
+        }
+        result = out;
+    }
+    else if ("blockchain.transaction.get" == method)
+    {
+        if (!json_is_string(p0))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected a txid");
+
+        DataChunk raw;
+        ABC_CHECK(chain_.txData(raw, json_string_value(p0)));
+        result.reset(json_string(base16Encode(raw).c_str()));
+    }
+    else if ("blockchain.transaction.broadcast" == method)
+    {
+        DataChunk raw;
+        bc::transaction_type tx;
+        if (!json_is_string(p0) || !base16Decode(raw, json_string_value(p0)))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected transaction hex");
+        ABC_CHECK(decodeTx(tx, raw));
+
+        chain_.insert(tx);
+        const auto txid = bc::encode_hash(bc::hash_transaction(tx));
+        result.reset(json_string(txid.c_str()));
+    }
+    else if ("blockchain.block.get_header" == method)
+    {
+        if (!json_is_integer(p0))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected a height");
+        const auto header = SyntheticChain::header(json_integer_value(p0));
+
+        JsonObject out;
+        ABC_CHECK(out.set("block_height", json_integer_value(p0)));
+        ABC_CHECK(out.set("version", json_int_t(header.version)));
+        ABC_CHECK(out.set("prev_block_hash",
+                          bc::encode_hash(header.previous_block_hash)));
+        ABC_CHECK(out.set("merkle_root", bc::encode_hash(header.merkle)));
+        ABC_CHECK(out.set("timestamp", json_int_t(header.timestamp)));
+        ABC_CHECK(out.set("bits", json_int_t(header.bits)));
+        ABC_CHECK(out.set("nonce", json_int_t(header.nonce)));
+        result = out;
+    }
+    else if ("blockchain.block.headers" == method)
+    {
+        if (!json_is_integer(p0) || !json_is_integer(p1))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected a height and count");
+        const size_t start = json_integer_value(p0);
+        size_t count = std::min<size_t>(json_integer_value(p1), headersMax);
+        count = start <= chain_.height() ?
+                std::min(count, chain_.height() + 1 - start) : 0;
+
+        DataChunk raw;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto header = SyntheticChain::header(start + i);
+            DataChunk bytes(satoshi_raw_size(header));
+            bc::satoshi_save(header, bytes.begin());
+            raw.insert(raw.end(), bytes.begin(), bytes.end());
+        }
+
+        JsonObject out;
+        ABC_CHECK(out.set("hex", base16Encode(raw)));
+        ABC_CHECK(out.set("count", json_int_t(count)));
+        ABC_CHECK(out.set("max", json_int_t(headersMax)));
+        result = out;
+    }
+    else
+    {
+        return ABC_ERROR(ABC_CC_NotSupported, "Unknown method " + method);
+    }
+
+    return Status();
+}
+
+} // namespace abcd
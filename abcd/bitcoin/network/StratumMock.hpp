@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A local Stratum server for tests and sync benchmarks.
+ */
+
+#ifndef ABCD_BITCOIN_NETWORK_STRATUM_MOCK_HPP
+#define ABCD_BITCOIN_NETWORK_STRATUM_MOCK_HPP
+
+#include "../SyntheticChain.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace abcd {
+
+class JsonPtr;
+
+/**
+ * A local Stratum server that answers from a `SyntheticChain`,
+ * speaking the subset of the Electrum protocol `StratumConnection` uses.
+ * It announces itself as ElectrumX, so clients batch their requests.
+ * Broadcast transactions join the chain as unconfirmed.
+ *
+ * The server runs on its own thread, listening on the loopback interface.
+ */
+class StratumMock
+{
+public:
+    ~StratumMock();
+    StratumMock(const SyntheticChain &chain);
+
+    /**
+     * Starts serving. A port of zero picks any free port.
+     */
+    Status
+    start(unsigned port=0);
+
+    void
+    stop();
+
+    /**
+     * The URI to hand to clients, once the server is running.
+     */
+    std::string
+    uri() const;
+
+    /**
+     * The number of requests answered so far.
+     */
+    uint64_t
+    requests() const { return requests_; }
+
+    /**
+     * Holds each reply back for this long, to stand in for a distant server.
+     * Requests still get answered in order.
+     */
+    void
+    replyDelaySet(std::chrono::milliseconds delay) { replyDelay_ = delay; }
+
+private:
+    std::mutex mutex_;
+    SyntheticChain chain_;
+    int fd_ = -1;
+    unsigned port_ = 0;
+    std::thread thread_;
+    std::atomic<bool> done_;
+    std::atomic<uint64_t> requests_;
+    std::atomic<std::chrono::milliseconds> replyDelay_;
+
+    void
+    run();
+
+    /**
+     * Answers one line of input, which is a request or a batch.
+     */
+    std::string
+    reply(DataSlice line);
+
+    Status
+    result(JsonPtr &result, const std::string &method, JsonPtr params);
+};
+
+} // namespace abcd
+
+#endif
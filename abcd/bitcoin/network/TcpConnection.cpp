@@ -6,64 +6,55 @@
  */
 
 #include "TcpConnection.hpp"
+#include "TlsClient.hpp"
+#include "../../util/Debug.hpp"
+#include "../../util/Metrics.hpp"
+#include <openssl/ssl.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 
 namespace abcd {
 
-static int
-timeoutConnect(int sock, struct sockaddr *addr,
-               socklen_t addr_len, struct timeval *tv)
-{
-    fd_set fdset;
-    int flags = 0;
-    int so_error;
-    socklen_t len = sizeof(so_error);
-
-    if ((flags = fcntl(sock, F_GETFL, 0)) < 0)
-        return -1;
-
-    if (fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0)
-        return -1;
-
-    if (connect(sock, addr, addr_len) == 0)
-        goto exit;
-
-    FD_ZERO(&fdset);
-    FD_SET(sock, &fdset);
+constexpr size_t chunkSizeMin = 4096;
+constexpr size_t chunkSizeMax = 65536;
+constexpr size_t readLimit = 1024 * 1024;
+constexpr size_t tlsChunkSize = 16384; // One TLS record
 
-    if (select(sock + 1, NULL, &fdset, NULL, tv) > 0)
-    {
-        getsockopt(sock, SOL_SOCKET, SO_ERROR, &so_error, &len);
-        if (so_error == 0)
-            goto exit;
-    }
-    return -1;
-
-exit:
-    if (fcntl(sock, F_SETFL, flags) < 0)
-        return -1;
-    return 0;
-}
+constexpr std::chrono::milliseconds attemptDelay(250);
+constexpr std::chrono::seconds attemptTimeout(10);
 
 TcpConnection::~TcpConnection()
 {
-    if (0 < fd_)
+    if (ssl_)
+        SSL_free(ssl_);
+    if (0 <= fd_)
         close(fd_);
+    if (0 <= handshakeFd_)
+        close(handshakeFd_);
+    attemptsClose();
 }
 
 TcpConnection::TcpConnection():
-    fd_(0)
+    fd_(-1),
+    chunkSize_(chunkSizeMin),
+    nextCandidate_(0)
 {
 }
 
 Status
-TcpConnection::connect(const std::string &hostname, unsigned port)
+TcpConnection::connect(const std::string &hostname, unsigned port, bool tls)
 {
+    hostname_ = hostname;
+    server_ = hostname + ":" + std::to_string(port);
+    tls_ = tls;
+
     // Do the DNS lookup:
     struct addrinfo hints {};
     struct addrinfo *list = nullptr;
@@ -72,29 +63,126 @@ TcpConnection::connect(const std::string &hostname, unsigned port)
     if (getaddrinfo(hostname.c_str(), std::to_string(port).c_str(), &hints, &list))
         return ABC_ERROR(ABC_CC_ServerError, "Cannot look up " + hostname);
 
-    // Try the returned DNS entries until one connects:
-    for (struct addrinfo *p = list; p; ++p)
+    // Interleave the address families, starting with the resolver's pick:
+    std::vector<struct addrinfo *> first, second;
+    for (struct addrinfo *p = list; p; p = p->ai_next)
     {
-        fd_ = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-        if (fd_ < 0)
+        if (p->ai_family == list->ai_family)
+            first.push_back(p);
+        else
+            second.push_back(p);
+    }
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i)
+    {
+        for (auto *family: {&first, &second})
         {
-            freeaddrinfo(list);
-            return ABC_ERROR(ABC_CC_ServerError, "Cannot create socket to " + hostname);
+            if (family->size() <= i)
+                continue;
+            const auto *p = (*family)[i];
+            sockaddr_storage address {};
+            memcpy(&address, p->ai_addr, p->ai_addrlen);
+            candidates_.push_back(address);
+            candidateSizes_.push_back(p->ai_addrlen);
         }
+    }
+    freeaddrinfo(list);
 
-        struct timeval sto;
-        sto.tv_sec = 10;
-        sto.tv_usec = 0;
-        if (0 == timeoutConnect(fd_, p->ai_addr, p->ai_addrlen, &sto))
-            break;
+    if (candidates_.empty())
+        return ABC_ERROR(ABC_CC_ServerError, "No addresses for " + hostname);
 
-        close(fd_);
-        fd_ = 0;
+    bool done;
+    return connectCheck(done);
+}
+
+Status
+TcpConnection::connectCheck(bool &done)
+{
+    done = 0 <= fd_;
+    if (done)
+        return Status();
+    if (ssl_)
+        return handshake(done);
+    const auto now = std::chrono::steady_clock::now();
+
+    // See if any attempts have finished:
+    auto i = attempts_.begin();
+    while (attempts_.end() != i)
+    {
+        struct pollfd item = { i->fd, POLLOUT, 0 };
+        if (0 < poll(&item, 1, 0))
+        {
+            int error = 0;
+            socklen_t size = sizeof(error);
+            if (getsockopt(i->fd, SOL_SOCKET, SO_ERROR, &error, &size) ||
+                    error)
+            {
+                close(i->fd);
+                i = attempts_.erase(i);
+                continue;
+            }
+
+            // We have a winner. TLS keeps the socket non-blocking:
+            if (tls_)
+            {
+                const int fd = i->fd;
+                attempts_.erase(i);
+                attemptsClose();
+                handshakeFd_ = fd;
+                handshakeStarted_ = now;
+                ABC_CHECK(tlsSessionNew(ssl_, fd, hostname_, server_));
+                return handshake(done);
+            }
+
+            // Otherwise, put the socket back in blocking mode:
+            int flags = fcntl(i->fd, F_GETFL, 0);
+            if (flags < 0 || fcntl(i->fd, F_SETFL, flags & ~O_NONBLOCK) < 0)
+            {
+                close(i->fd);
+                i = attempts_.erase(i);
+                continue;
+            }
+            fd_ = i->fd;
+            attempts_.erase(i);
+            attemptsClose();
+            done = true;
+            return Status();
+        }
+
+        if (i->started + attemptTimeout < now)
+        {
+            close(i->fd);
+            i = attempts_.erase(i);
+            continue;
+        }
+        ++i;
     }
-    freeaddrinfo(list);
 
-    if (fd_ < 0)
-        return ABC_ERROR(ABC_CC_ServerError, "Cannot connect to " + hostname);
+    // Add another address to the race if it's time:
+    while (nextCandidate_ < candidates_.size() &&
+            (attempts_.empty() || nextAttempt_ <= now))
+    {
+        const auto &address = candidates_[nextCandidate_];
+        const auto size = candidateSizes_[nextCandidate_];
+        ++nextCandidate_;
+
+        int fd = socket(address.ss_family, SOCK_STREAM, 0);
+        if (fd < 0)
+            continue;
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+                (::connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                           size) < 0 && EINPROGRESS != errno))
+        {
+            close(fd);
+            continue;
+        }
+
+        attempts_.push_back(Attempt{ fd, now });
+        nextAttempt_ = now + attemptDelay;
+    }
+
+    if (attempts_.empty())
+        return ABC_ERROR(ABC_CC_ServerError, "Cannot connect to " + hostname_);
 
     return Status();
 }
@@ -102,6 +190,18 @@ TcpConnection::connect(const std::string &hostname, unsigned port)
 Status
 TcpConnection::send(DataSlice data)
 {
+    while (ssl_ && data.size())
+    {
+        auto bytes = SSL_write(ssl_, data.data(), data.size());
+        if (bytes <= 0)
+        {
+            ABC_CHECK(tlsWait(SSL_get_error(ssl_, bytes)));
+            continue;
+        }
+
+        data = DataSlice(data.data() + bytes, data.end());
+    }
+
     while (data.size())
     {
         auto bytes = ::send(fd_, data.data(), data.size(), 0);
@@ -115,20 +215,112 @@ TcpConnection::send(DataSlice data)
 }
 
 Status
-TcpConnection::read(DataChunk &result)
+TcpConnection::read(LineBuffer &buffer, size_t &result)
 {
-    unsigned char data[1024];
-    auto bytes = recv(fd_, data, sizeof(data), MSG_DONTWAIT);
-    if (bytes < 0)
+    static auto &bytesRead = metricCounter("tcp.bytes_read");
+
+    result = 0;
+    while (ssl_ && result < readLimit)
+    {
+        auto bytes = SSL_read(ssl_, buffer.prepare(tlsChunkSize), tlsChunkSize);
+        if (bytes <= 0)
+        {
+            int error = SSL_get_error(ssl_, bytes);
+            if (SSL_ERROR_WANT_READ == error || SSL_ERROR_WANT_WRITE == error)
+                break;
+            if (SSL_ERROR_ZERO_RETURN == error && result)
+                break;
+            return ABC_ERROR(ABC_CC_ServerError, "TLS connection closed");
+        }
+        buffer.commit(bytes);
+        result += bytes;
+    }
+
+    while (!ssl_ && result < readLimit)
     {
-        if (EAGAIN != errno && EWOULDBLOCK != errno)
-            return ABC_ERROR(ABC_CC_ServerError, "Cannot read from socket");
+        auto bytes = recv(fd_, buffer.prepare(chunkSize_), chunkSize_,
+                          MSG_DONTWAIT);
+        if (bytes < 0)
+        {
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+                return ABC_ERROR(ABC_CC_ServerError, "Cannot read from socket");
+
+            // No more data, but that's fine:
+            break;
+        }
+        if (0 == bytes)
+        {
+            if (result)
+                break;
+            return ABC_ERROR(ABC_CC_ServerError, "Connection closed by server");
+        }
+        buffer.commit(bytes);
+        result += bytes;
 
-        // No data, but that's fine:
-        bytes = 0;
+        // Size the next read to match what the server is sending:
+        if (static_cast<size_t>(bytes) == chunkSize_)
+            chunkSize_ = std::min(2 * chunkSize_, chunkSizeMax);
+        else if (static_cast<size_t>(bytes) < chunkSize_ / 4)
+            chunkSize_ = std::max(chunkSize_ / 2, chunkSizeMin);
     }
 
-    result = DataChunk(data, data + bytes);
+    bytesRead.add(result);
+    return Status();
+}
+
+bool
+TcpConnection::buffered() const
+{
+    return ssl_ && 0 < SSL_pending(ssl_);
+}
+
+void
+TcpConnection::attemptsClose()
+{
+    for (const auto &attempt: attempts_)
+        close(attempt.fd);
+    attempts_.clear();
+}
+
+Status
+TcpConnection::handshake(bool &done)
+{
+    int status = SSL_do_handshake(ssl_);
+    if (1 == status)
+    {
+        ABC_DebugLog("%s: TLS %s", server_.c_str(),
+                     SSL_session_reused(ssl_) ? "resumed" : "negotiated");
+        fd_ = handshakeFd_;
+        handshakeFd_ = -1;
+        done = true;
+        return Status();
+    }
+
+    int error = SSL_get_error(ssl_, status);
+    if (SSL_ERROR_WANT_READ != error && SSL_ERROR_WANT_WRITE != error)
+        return ABC_ERROR(ABC_CC_ServerError,
+                         "TLS handshake failed with " + hostname_);
+    if (handshakeStarted_ + attemptTimeout < std::chrono::steady_clock::now())
+        return ABC_ERROR(ABC_CC_ServerError,
+                         "TLS handshake timed out with " + hostname_);
+
+    return Status();
+}
+
+Status
+TcpConnection::tlsWait(int error)
+{
+    struct pollfd item = { fd_, 0, 0 };
+    if (SSL_ERROR_WANT_READ == error)
+        item.events = POLLIN;
+    else if (SSL_ERROR_WANT_WRITE == error)
+        item.events = POLLOUT;
+    else
+        return ABC_ERROR(ABC_CC_ServerError, "Failed to send");
+
+    const int timeout = std::chrono::milliseconds(attemptTimeout).count();
+    if (poll(&item, 1, timeout) <= 0)
+        return ABC_ERROR(ABC_CC_ServerError, "Failed to send");
     return Status();
 }
 
@@ -10,6 +10,12 @@
 
 #include "../../util/Status.hpp"
 #include "../../util/Data.hpp"
+#include "../../util/LineBuffer.hpp"
+#include <sys/socket.h>
+#include <chrono>
+#include <vector>
+
+typedef struct ssl_st SSL;
 
 namespace abcd {
 
@@ -20,10 +26,22 @@ public:
     TcpConnection();
 
     /**
-     * Connect to the specified server.
+     * Starts connecting to the specified server without blocking.
+     * Use `connectCheck` to find out when the socket is ready.
+     * @param tls true to run a TLS handshake once the socket connects.
+     */
+    Status
+    connect(const std::string &hostname, unsigned port, bool tls=false);
+
+    /**
+     * Advances a connection in progress.
+     * The server's addresses are tried in parallel, alternating between
+     * IPv6 and IPv4, with a new attempt joining the race every 250ms.
+     * The first one to complete wins.
+     * @param done set to true once the socket is connected.
      */
     Status
-    connect(const std::string &hostname, unsigned port);
+    connectCheck(bool &done);
 
     /**
      * Send some data over the socket.
@@ -32,18 +50,61 @@ public:
     send(DataSlice data);
 
     /**
-     * Read all pending data from the socket (might not produce anything).
+     * Reads pending data into the buffer until the socket runs dry
+     * or a per-call limit is reached. This might not produce anything.
+     * @param result the number of bytes actually read.
      */
     Status
-    read(DataChunk &result);
+    read(LineBuffer &buffer, size_t &result);
 
     /**
-     * Obtains a list of sockets that the main loop should sleep on.
+     * True if the TLS layer is holding decrypted data that `read` left
+     * behind. The socket won't wake the main loop for this data.
+     */
+    bool
+    buffered() const;
+
+    /**
+     * Obtains the socket that the main loop should sleep on,
+     * or -1 if there is no connected socket yet.
      */
     int pollfd() const { return fd_; }
 
 private:
     int fd_;
+    size_t chunkSize_;
+
+    // Connection race:
+    std::string hostname_;
+    std::vector<sockaddr_storage> candidates_;
+    std::vector<socklen_t> candidateSizes_;
+    size_t nextCandidate_;
+    struct Attempt
+    {
+        int fd;
+        std::chrono::steady_clock::time_point started;
+    };
+    std::vector<Attempt> attempts_;
+    std::chrono::steady_clock::time_point nextAttempt_;
+
+    // TLS:
+    bool tls_ = false;
+    std::string server_;
+    SSL *ssl_ = nullptr;
+    int handshakeFd_ = -1;
+    std::chrono::steady_clock::time_point handshakeStarted_;
+
+    void
+    attemptsClose();
+
+    Status
+    handshake(bool &done);
+
+    /**
+     * Waits for the socket to become ready after TLS asks for I/O.
+     */
+    Status
+    tlsWait(int error);
 };
 
 } // namespace abcd
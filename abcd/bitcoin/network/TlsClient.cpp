@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TlsClient.hpp"
+#include "../../Context.hpp"
+#include "../../http/Http.hpp"
+#include "../../util/Debug.hpp"
+#include "../../util/FileIO.hpp"
+#include "../../util/WriteQueue.hpp"
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <map>
+#include <mutex>
+
+namespace abcd {
+
+/**
+ * The client context and session tickets, shared by every connection.
+ * Tickets hold the session's master secret, so they only live in memory.
+ */
+struct TlsSingleton
+{
+    std::mutex mutex;
+    SSL_CTX *ctx = nullptr;
+    std::map<std::string, DataChunk> sessions;
+};
+
+static TlsSingleton gTls;
+
+static int
+sessionNewCallback(SSL *ssl, SSL_SESSION *session)
+{
+    const auto *server = static_cast<const std::string *>(SSL_get_app_data(ssl));
+    if (!server)
+        return 0;
+
+    int size = i2d_SSL_SESSION(session, nullptr);
+    if (size <= 0)
+        return 0;
+    DataChunk data(size);
+    auto *p = data.data();
+    i2d_SSL_SESSION(session, &p);
+
+    std::lock_guard<std::mutex> lock(gTls.mutex);
+    gTls.sessions[*server] = data;
+
+    // We made our own copy, so OpenSSL keeps ownership:
+    return 0;
+}
+
+static Status
+contextGet(SSL_CTX *&result)
+{
+    if (!gTls.ctx)
+    {
+        // cURL's start-up also brings up OpenSSL:
+        ABC_CHECK(httpInit());
+
+        auto *ctx = SSL_CTX_new(SSLv23_client_method());
+        if (!ctx)
+            return ABC_ERROR(ABC_CC_Error, "Cannot create TLS context");
+        SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
+        SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                         SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+
+        const Status s = httpCertStoreAttach(ctx);
+        if (!s)
+        {
+            SSL_CTX_free(ctx);
+            return s;
+        }
+
+        // Hand new session tickets to us, rather than OpenSSL's own cache:
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                       SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, sessionNewCallback);
+
+        // Older versions saved tickets to disk in the clear:
+        if (gContext)
+        {
+            const auto path = gContext->paths.tlsSessionsPath();
+            writeQueueAdd(path, [path]()
+            {
+                if (fileExists(path))
+                    ABC_CHECK(fileDelete(path));
+                return Status();
+            });
+        }
+
+        gTls.ctx = ctx;
+    }
+
+    result = gTls.ctx;
+    return Status();
+}
+
+Status
+tlsSessionNew(SSL *&result, int fd, const std::string &hostname,
+              const std::string &server)
+{
+    std::lock_guard<std::mutex> lock(gTls.mutex);
+
+    SSL_CTX *ctx;
+    ABC_CHECK(contextGet(ctx));
+
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl)
+        return ABC_ERROR(ABC_CC_Error, "Cannot create TLS session");
+    SSL_set_app_data(ssl, const_cast<std::string *>(&server));
+    SSL_set_tlsext_host_name(ssl, hostname.c_str());
+    X509_VERIFY_PARAM_set1_host(SSL_get0_param(ssl), hostname.c_str(), 0);
+    if (!SSL_set_fd(ssl, fd))
+    {
+        SSL_free(ssl);
+        return ABC_ERROR(ABC_CC_Error, "Cannot attach TLS to socket");
+    }
+    SSL_set_connect_state(ssl);
+
+    // Resume an earlier session if we have one:
+    const auto i = gTls.sessions.find(server);
+    if (gTls.sessions.end() != i)
+    {
+        const unsigned char *p = i->second.data();
+        SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &p, i->second.size());
+        if (session)
+        {
+            SSL_set_session(ssl, session);
+            SSL_SESSION_free(session);
+        }
+    }
+
+    result = ssl;
+    return Status();
+}
+
+} // namespace abcd
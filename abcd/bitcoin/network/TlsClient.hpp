@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Shared OpenSSL state for TLS connections to bitcoin servers.
+ */
+
+#ifndef ABCD_BITCOIN_NETWORK_TLS_CLIENT_HPP
+#define ABCD_BITCOIN_NETWORK_TLS_CLIENT_HPP
+
+#include "../../util/Status.hpp"
+
+typedef struct ssl_st SSL;
+
+namespace abcd {
+
+/**
+ * Creates a client-side TLS session for a connected socket.
+ * The session verifies the given hostname against the same certificate
+ * bundle the HTTP code uses, and picks up any session ticket kept from an
+ * earlier connection to the same server in this process,
+ * so the handshake can skip the full key exchange.
+ * @param server the host:port key for remembering and resuming sessions.
+ * The string must outlive the returned SSL object.
+ */
+Status
+tlsSessionNew(SSL *&result, int fd, const std::string &hostname,
+              const std::string &server);
+
+} // namespace abcd
+
+#endif
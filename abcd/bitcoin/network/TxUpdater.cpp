@@ -9,9 +9,14 @@
 #include "LibbitcoinConnection.hpp"
 #include "StratumConnection.hpp"
 #include "../cache/Cache.hpp"
+#include "../../Context.hpp"
 #include "../../General.hpp"
 #include "../../util/Debug.hpp"
+#include "../../util/Metrics.hpp"
+#include "../../util/Trace.hpp"
 #include <sys/time.h>
+#include <algorithm>
+#include <mutex>
 
 namespace abcd {
 
@@ -19,17 +24,106 @@ constexpr auto NUM_CONNECT_SERVERS = 5;
 constexpr auto MINIMUM_AIRBITZ_SERVERS = 1;
 constexpr auto MINIMUM_STRATUM_SERVERS = 4;
 constexpr auto AIRBITZ_DOMAIN = ".airbitz.co:";
+constexpr std::chrono::seconds POOL_GRACE(120);
+constexpr auto HEADER_RANGE_MAX = 200;
+constexpr std::chrono::seconds CONNECT_RETRY(5);
+
+// Server replies that no amount of re-sending will fix:
+static const char *rejectReasons[] =
+{
+    "dust", "fee", "invalid", "bad-txns", "script-verify"
+};
+
+static std::mutex gActiveMutex;
+static std::string gActiveWallet;
+
+/**
+ * True if a server refused a transaction because of the transaction itself,
+ * rather than a network hiccup.
+ */
+static bool
+rejectedForGood(const Status &s)
+{
+    auto message = s.message();
+    std::transform(message.begin(), message.end(), message.begin(), ::tolower);
+    for (const auto reason: rejectReasons)
+        if (std::string::npos != message.find(reason))
+            return true;
+    return false;
+}
+
+void
+txUpdaterActiveSet(const std::string &walletId)
+{
+    std::lock_guard<std::mutex> lock(gActiveMutex);
+    gActiveWallet = walletId;
+}
 
 TxUpdater::~TxUpdater()
 {
     disconnect();
+
+    // Close these while the error callbacks still have somewhere to go:
+    for (auto *sc: pool_.takeAll())
+        delete sc;
 }
 
 TxUpdater::TxUpdater(Wallet &wallet, void *ctx):
-    cache_(wallet.cache),
+    blocks_(wallet.cache.blocks),
+    servers_(wallet.cache.servers),
+    pool_(POOL_GRACE),
+    engine_(false),
     overrideBitcoinServers_(wallet.bOverrideBitcoinServers),
     overrideBitcoinServerList_(wallet.overrideBitcoinServerList)
 {
+    // We are about to feed the block cache new headers:
+    gContext->blockCacheWait();
+
+    auto work = std::make_shared<WalletWork>(wallet.cache);
+    work->id = wallet.id();
+    work->traceId = traceId(wallet.id());
+    wallets_[wallet.id()] = work;
+}
+
+TxUpdater::TxUpdater(void *ctx):
+    blocks_(gContext->blockCache),
+    servers_(gContext->serverCache),
+    pool_(POOL_GRACE),
+    engine_(true),
+    overrideBitcoinServers_(false)
+{
+    // We are about to feed the block cache new headers:
+    gContext->blockCacheWait();
+}
+
+void
+TxUpdater::walletAdd(std::shared_ptr<Wallet> wallet)
+{
+    if (wallets_.count(wallet->id()))
+        return;
+
+    auto work = std::make_shared<WalletWork>(wallet->cache);
+    work->wallet = wallet;
+    work->id = wallet->id();
+    work->traceId = traceId(wallet->id());
+    wallets_[wallet->id()] = work;
+    ABC_DebugLog("Wallet %s joined the shared watcher", wallet->id().c_str());
+}
+
+void
+TxUpdater::walletRemove(const std::string &id)
+{
+    auto i = wallets_.find(id);
+    if (wallets_.end() == i)
+        return;
+
+    // Any replies still in flight will see this and do nothing:
+    auto work = i->second;
+    work->active = false;
+    if (work->cacheDirty)
+        work->cache.save().log(); // Failure is fine
+    wallets_.erase(i);
+    ABC_DebugLog("Wallet %s left the shared watcher", id.c_str());
 }
 
 void
@@ -37,12 +131,18 @@ TxUpdater::disconnect()
 {
     wantConnection = false;
 
+    // Keep healthy stratum connections around in case we come right back:
     auto i = connections_.begin();
     while (i != connections_.end())
     {
-        delete *i;
+        auto *sc = dynamic_cast<StratumConnection *>(*i);
+        if (sc && !failedServers_.count(sc->uri()))
+            pool_.park(sc);
+        else
+            delete *i;
         i = connections_.erase(i);
     }
+    due_.clear();
 
     ABC_DebugLog("Disconnected from all servers.");
 }
@@ -67,6 +167,20 @@ TxUpdater::connect()
 {
     wantConnection = true;
 
+    // Pick up where we left off, subscriptions and all:
+    for (auto *sc: pool_.takeAll())
+    {
+        if (connections_.size() < NUM_CONNECT_SERVERS)
+        {
+            connections_.push_back(sc);
+            outboxWake_ = true;
+        }
+        else
+        {
+            delete sc;
+        }
+    }
+
     if (overrideBitcoinServers_)
     {
         stratumServers_ = overrideBitcoinServerList_;
@@ -75,10 +189,10 @@ TxUpdater::connect()
     {
         // If we are out of fresh stratum servers, reload the list:
         if (stratumServers_.empty())
-            stratumServers_ = cache_.servers.getServers(ServerTypeStratum,
+            stratumServers_ = servers_.getServers(ServerTypeStratum,
                               MINIMUM_STRATUM_SERVERS * 2);
         if (airbitzServers_.empty())
-            airbitzServers_ = cache_.servers.getServers(ServerTypeAirbitz,
+            airbitzServers_ = servers_.getServers(ServerTypeAirbitz,
                               MINIMUM_AIRBITZ_SERVERS * 2);
     }
 
@@ -96,6 +210,9 @@ TxUpdater::connect()
             ++airbitzCount;
     }
 
+    // Everyone but the active wallet ramps up a socket at a time:
+    const bool urgent = priority();
+
     // Let's make some connections:
     srand(time(nullptr));
     while (connections_.size() < NUM_CONNECT_SERVERS && (stratumServers_.size()
@@ -112,8 +229,18 @@ TxUpdater::connect()
             serverList = &airbitzServers_;
         }
 
+        // The server cache hands us its list best-first,
+        // but spread the load over a user-supplied list:
         auto i = serverList->begin();
-        std::advance(i, rand() % serverList->size());
+        if (overrideBitcoinServers_)
+            std::advance(i, rand() % serverList->size());
+
+        // Don't double up on servers we got back from the pool:
+        if (connected(*i))
+        {
+            serverList->erase(i);
+            continue;
+        }
 
         bool bAirbitzServer = checkIfAirbitzServer(*i);
 
@@ -131,15 +258,29 @@ TxUpdater::connect()
                 }
             }
         }
-        if (connectTo(*i, ServerTypeStratum).log())
+
+        // Stay inside the process-wide socket budget:
+        auto socket = servers_.socketClaim(i->substr(0, i->find(' ')), urgent);
+        if (!socket)
+        {
+            serverList->erase(i);
+            continue;
+        }
+
+        if (connectTo(*i, ServerTypeStratum, std::move(socket)).log())
         {
             stratumCount++;
             if (bAirbitzServer)
                 airbitzCount++;
+            if (!urgent)
+            {
+                serverList->erase(i);
+                break;
+            }
         }
         else
         {
-            cache_.servers.serverScoreDown(*i);
+            servers_.serverScoreDown(*i);
         }
         serverList->erase(i);
     }
@@ -148,104 +289,191 @@ TxUpdater::connect()
 }
 
 std::chrono::milliseconds
-TxUpdater::wakeup()
+TxUpdater::wakeup(const zmq_pollitem_t *ready, size_t count)
 {
+    // Per-phase timings, for `watcher-profile`:
+    static auto &totalTime = metricHistogram("watcher.wakeup_us");
+    static auto &poolTime = metricHistogram("watcher.phase.pool_us");
+    static auto &scheduleTime = metricHistogram("watcher.phase.schedule_us");
+    static auto &hedgeTime = metricHistogram("watcher.phase.hedges_us");
+    static auto &headerTime = metricHistogram("watcher.phase.headers_us");
+    static auto &flushTime = metricHistogram("watcher.phase.flush_us");
+    static auto &saveTime = metricHistogram("watcher.phase.save_us");
+    static auto &pruneTime = metricHistogram("watcher.phase.prune_us");
+    MetricTimer totalTimer(totalTime);
+
+    const auto now = std::chrono::steady_clock::now();
+    auto until = [&now](const TimePoint &when)
+    {
+        // Round up, since a zero sleep means forever:
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   when - now) + std::chrono::milliseconds(1);
+    };
+
+    // Find the sockets that fired:
+    std::set<IBitcoinConnection *> fired;
+    bool poolFired = !ready || poolDue_ <= now;
+    for (size_t i = 0; ready && i < count && i < pollOwners_.size(); ++i)
+    {
+        if (!ready[i].revents)
+            continue;
+        if (pollOwners_[i])
+            fired.insert(pollOwners_[i]);
+        else
+            poolFired = true;
+    }
+
     // Handle any old work that has finished:
     std::chrono::milliseconds nextWakeup(0);
+    bool serviced = !ready || scheduleDue_ <= now || connectDue_ <= now ||
+                    outboxWake_;
     for (auto *bc: connections_)
     {
+        // Quiet connections just need to be back before their deadline:
+        const auto due = due_.find(bc);
+        if (ready && !fired.count(bc) && due_.end() != due && now < due->second)
+        {
+            nextWakeup = bc::client::min_sleep(nextWakeup, until(due->second));
+            continue;
+        }
+        serviced = true;
+
+        auto &histogram = wakeupMetrics_[bc->uri()];
+        if (!histogram)
+            histogram = &metricHistogram("watcher.connection_us." + bc->uri());
+        MetricTimer connectionTimer(*histogram);
+
+        std::chrono::milliseconds sleep(0);
         auto *sc = dynamic_cast<StratumConnection *>(bc);
         if (sc)
         {
-            SleepTime sleep;
             if (!sc->wakeup(sleep).log())
                 failedServers_.insert(bc->uri());
             else
-            {
-                cache_.servers.serverScoreUp(bc->uri(), 0);
-                nextWakeup = bc::client::min_sleep(nextWakeup, sleep);
-            }
+                servers_.serverScoreUp(bc->uri(), 0);
         }
 
         auto *lc = dynamic_cast<LibbitcoinConnection *>(bc);
         if (lc)
-            nextWakeup = bc::client::min_sleep(nextWakeup, lc->wakeup());
+            sleep = lc->wakeup();
+
+        nextWakeup = bc::client::min_sleep(nextWakeup, sleep);
+        if (sleep.count())
+            due_[bc] = now + sleep;
+        else
+            due_[bc] = TimePoint::max();
     }
 
-    // Fetch missing transactions:
-    time_t sleep;
-    const auto statuses = cache_.addresses.statuses(sleep);
-    nextWakeup = bc::client::min_sleep(nextWakeup, std::chrono::seconds(sleep));
-    for (const auto &status: statuses)
+    // Keep parked connections alive:
+    if (poolFired)
     {
-        for (const auto &txid: status.missingTxids)
-        {
-            // Try to use the same server:
-            auto *bc = pickServer(addressServers_[status.address]);
-            if (!bc)
-                break;
+        MetricTimer timer(poolTime);
+        const auto sleep = pool_.wakeup();
+        poolDue_ = sleep.count() ? now + sleep : TimePoint::max();
+    }
+    if (TimePoint::max() != poolDue_)
+        nextWakeup = bc::client::min_sleep(nextWakeup, until(poolDue_));
 
-            fetchTx(txid, bc);
-        }
+    // Nothing has changed since the wallets were last scheduled:
+    if (!serviced)
+    {
+        if (TimePoint::max() != scheduleDue_)
+            nextWakeup = bc::client::min_sleep(nextWakeup, until(scheduleDue_));
+        if (TimePoint::max() != connectDue_)
+            nextWakeup = bc::client::min_sleep(nextWakeup, until(connectDue_));
+        return nextWakeup;
     }
 
-    // Schedule new address work:
-    for (const auto &status: statuses)
+    // Hand out address & transaction work:
+    std::chrono::milliseconds scheduleWakeup(0);
     {
-        if (status.dirty)
+        MetricTimer timer(scheduleTime);
+        if (outboxWake_)
         {
-            // Try to use the same server that made us dirty:
-            auto *bc = pickServer(addressServers_[status.address]);
-            if (!bc)
-                break;
+            for (const auto &wallet: wallets_)
+                wallet.second->cache.outbox.wake();
+            outboxWake_ = false;
+        }
+        for (const auto &wallet: wallets_)
+            walletWakeup(wallet.second, scheduleWakeup);
+    }
 
-            if (bc->addressSubscribed(status.address))
-                fetchAddress(status.address, bc);
-            else
-                subscribeAddress(status.address, bc);
+    // Race a second server for urgent fetches that are running late:
+    MetricTimer hedgeTimer(hedgeTime);
+    auto hedge = hedges_.begin();
+    while (hedges_.end() != hedge)
+    {
+        const auto &work = hedge->work;
+        if (!work->active || !work->wipTxids.count(hedge->txid))
+        {
+            hedge = hedges_.erase(hedge);
         }
-        else if (status.needsCheck)
+        else if (hedge->when <= now)
         {
-            // Try to use a different server than last time:
-            auto *bc = pickOtherServer(addressServers_[status.address]);
+            auto *bc = pickOtherServer(hedge->uri);
             if (!bc)
-                break;
-
-            subscribeAddress(status.address, bc);
+            {
+                ++hedge; // Everyone is busy, so try again later
+                continue;
+            }
+            if (hedge->uri != bc->uri())
+            {
+                ABC_DebugLog("%s: tx %s hedged from %s", bc->uri().c_str(),
+                             hedge->txid.c_str(), hedge->uri.c_str());
+                fetchTxFrom(work, hedge->txid, bc);
+            }
+            hedge = hedges_.erase(hedge);
+        }
+        else
+        {
+            scheduleWakeup = bc::client::min_sleep(scheduleWakeup,
+                                                   until(hedge->when));
+            ++hedge;
         }
     }
+    scheduleDue_ = scheduleWakeup.count() ? now + scheduleWakeup :
+                   TimePoint::max();
+    nextWakeup = bc::client::min_sleep(nextWakeup, scheduleWakeup);
+
+    hedgeTimer.stop();
 
-    // Grab block headers that we don't have:
+    // Grab block headers that we don't have, a run at a time:
+    MetricTimer headerTimer(headerTime);
     while (true)
     {
-        size_t headerNeeded = cache_.blocks.headerNeeded();
-        if (!headerNeeded)
-            break;
-
         auto *bc = pickOtherServer();
         if (!bc)
             break;
 
-        blockHeaderFetch(headerNeeded, bc);
+        size_t height, count;
+        if (!blocks_.headersNeeded(height, count, HEADER_RANGE_MAX))
+            break;
+
+        blockHeadersFetch(height, count, bc);
     }
-    cache_.blocks.save();
-    cache_.blocks.onHeaderInvoke();
-    cache_.servers.serverCacheSave();
 
-    // Save the cache if it is dirty and enough time has elapsed:
-    if (cacheDirty)
-    {
-        time_t now = time(nullptr);
+    headerTimer.stop();
 
-        if (10 <= now - cacheLastSave)
+    // Send out any batched requests:
+    {
+        MetricTimer timer(flushTime);
+        for (auto *bc: connections_)
         {
-            cache_.save().log(); // Failure is fine
-            cacheLastSave = now;
-            cacheDirty = false;
+            auto *sc = dynamic_cast<StratumConnection *>(bc);
+            if (sc && !sc->flush().log())
+                failedServers_.insert(bc->uri());
         }
     }
 
+    {
+        MetricTimer timer(saveTime);
+        blocks_.save();
+        blocks_.onHeaderInvoke();
+        servers_.serverCacheSave();
+    }
+
     // Prune failed servers:
+    MetricTimer pruneTimer(pruneTime);
     for (const auto &uri: failedServers_)
     {
         auto i = connections_.begin();
@@ -255,7 +483,8 @@ TxUpdater::wakeup()
             if (uri == bc->uri())
             {
                 ABC_DebugLog("Disconnecting from %s", bc->uri().c_str());
-                cache_.servers.serverScoreDown(bc->uri());
+                servers_.serverScoreDown(bc->uri());
+                due_.erase(bc);
                 delete bc;
                 i = connections_.erase(i);
             }
@@ -266,35 +495,220 @@ TxUpdater::wakeup()
         }
     }
     failedServers_.clear();
+    pruneTimer.stop();
 
     // Connect to more servers:
+    connectDue_ = TimePoint::max();
     if (wantConnection && connections_.size() < NUM_CONNECT_SERVERS)
+    {
         connect().log();
 
+        // The socket budget may have held us back, so check again later:
+        if (connections_.size() < NUM_CONNECT_SERVERS)
+        {
+            connectDue_ = now + CONNECT_RETRY;
+            nextWakeup = bc::client::min_sleep(nextWakeup, until(connectDue_));
+        }
+    }
+
     return nextWakeup;
 }
 
-std::list<zmq_pollitem_t>
-TxUpdater::pollitems()
+void
+TxUpdater::walletWakeup(const WorkPtr &work,
+                        std::chrono::milliseconds &nextWakeup)
 {
-    std::list<zmq_pollitem_t> out;
+    auto &cache = work->cache;
+
+    // Old unconfirmed transactions need their addresses checked again:
+    cache.addresses.expiredCheck();
+
+    // Re-send transactions that never made it out:
+    if (cache.outbox.size() && !connections_.empty())
+    {
+        const auto known = cache.addresses.txidsSnapshot();
+        for (const auto &txid: cache.outbox.txids())
+        {
+            // A server has already told us about this one:
+            if (known->count(txid))
+            {
+                cache.outbox.remove(txid);
+                work->cacheDirty = true;
+            }
+        }
+
+        time_t sleep;
+        for (const auto &entry: cache.outbox.due(sleep))
+        {
+            const auto txid = entry.txid;
+            sendTx([work, txid](Status s)
+            {
+                if (s)
+                {
+                    // Keep it until it shows up in a history:
+                    ABC_DebugLog("Outbox tx %s sent", txid.c_str());
+                }
+                else if (rejectedForGood(s))
+                {
+                    ABC_DebugLog("Outbox tx %s rejected: %s",
+                                 txid.c_str(), s.message().c_str());
+                    work->cache.outbox.remove(txid);
+                    work->cacheDirty = true;
+                }
+                else
+                {
+                    s.log();
+                }
+            }, entry.tx);
+        }
+        if (sleep)
+            nextWakeup = bc::client::min_sleep(nextWakeup,
+                                               std::chrono::seconds(sleep));
+    }
+
+    // Fetch missing transactions:
+    time_t sleep;
+    const auto statuses = cache.addresses.statuses(sleep);
+    nextWakeup = bc::client::min_sleep(nextWakeup, std::chrono::seconds(sleep));
+    // Once the bulk lane fills up, keep going only for interactive work,
+    // which has a few slots of its own on each connection:
+    bool bulkFull = false;
+    for (const auto &status: statuses)
+    {
+        if (bulkFull && !status.priority)
+            continue;
+        const auto lane = status.priority ? RequestLane::interactive :
+                          RequestLane::bulk;
+
+        for (const auto &txid: status.missingTxids)
+        {
+            // Try to use the same server:
+            auto *bc = pickServer(addressServers_[status.address], lane);
+            if (!bc)
+            {
+                bulkFull |= RequestLane::bulk == lane;
+                break;
+            }
+
+            fetchTx(work, txid, bc, status.priority);
+        }
+    }
+
+    // Someone wants the raw bytes of a pruned transaction:
+    for (const auto &txid: cache.txs.refetchTxids())
+    {
+        auto *bc = pickServer("", RequestLane::interactive);
+        if (!bc)
+            break;
+        fetchTx(work, txid, bc, true);
+    }
+
+    // Until every address has been checked once, we are in a bulk sync,
+    // so shard the addresses over all the servers instead of piling
+    // onto whichever one answered first:
+    const auto progress = cache.addresses.progress();
+    const bool bulk = progress.first < progress.second;
+
+    // Schedule new address work:
+    bulkFull = false;
+    for (const auto &status: statuses)
+    {
+        if (bulkFull && !status.priority)
+            continue;
+        const auto lane = status.priority ? RequestLane::interactive :
+                          RequestLane::bulk;
+
+        bool homeless = !addressServers_.count(status.address);
+
+        // After a restart, go back to the server behind the saved hash,
+        // since a matching hash from it means the history is still good:
+        const bool restored = homeless && !status.server.empty() &&
+                              serverConnected(status.server);
+        if (restored)
+        {
+            addressServers_[status.address] = status.server;
+            homeless = false;
+        }
+
+        if (status.dirty)
+        {
+            // Try to use the same server that made us dirty:
+            auto *bc = bulk && homeless ? pickShard(status.address, lane) :
+                       pickServer(addressServers_[status.address], lane);
+            if (!bc)
+            {
+                // During a bulk sync, other servers may still have room:
+                if (bulk && !homeless && pickShard(status.address, lane))
+                    continue;
+                bulkFull |= RequestLane::bulk == lane;
+                continue;
+            }
+
+            if (bc->addressSubscribed(status.address))
+                fetchAddress(work, status.address, bc);
+            else
+                subscribeAddress(work, status.address, bc);
+        }
+        else if (status.needsCheck)
+        {
+            // Try to use a different server than last time,
+            // unless we are checking the saved hash:
+            auto *bc = bulk && homeless ? pickShard(status.address, lane) :
+                       restored ? pickServer(status.server, lane) :
+                       pickOtherServer(addressServers_[status.address], lane);
+            if (!bc)
+            {
+                bulkFull |= RequestLane::bulk == lane;
+                continue;
+            }
+
+            subscribeAddress(work, status.address, bc);
+        }
+    }
+
+    // Save the cache if it is dirty and enough time has elapsed:
+    if (work->cacheDirty)
+    {
+        time_t now = time(nullptr);
+
+        if (10 <= now - work->cacheLastSave)
+        {
+            cache.save().log(); // Failure is fine
+            work->cacheLastSave = now;
+            work->cacheDirty = false;
+        }
+    }
+}
+
+void
+TxUpdater::pollitems(std::vector<zmq_pollitem_t> &out)
+{
+    pollOwners_.clear();
     for (auto *bc: connections_)
     {
+        // Connections still being set up have no socket to sleep on:
         auto *sc = dynamic_cast<StratumConnection *>(bc);
-        if (sc)
+        if (sc && 0 <= sc->pollfd())
         {
             zmq_pollitem_t pollitem =
             {
-                nullptr, sc->pollfd(), ZMQ_POLLIN, ZMQ_POLLOUT
+                nullptr, sc->pollfd(), ZMQ_POLLIN, 0
             };
             out.push_back(pollitem);
+            pollOwners_.push_back(bc);
         }
 
         auto *lc = dynamic_cast<LibbitcoinConnection *>(bc);
         if (lc)
+        {
             out.push_back(lc->pollitem());
+            pollOwners_.push_back(bc);
+        }
     }
-    return out;
+
+    const auto before = out.size();
+    pool_.pollitems(out);
+    pollOwners_.resize(pollOwners_.size() + out.size() - before, nullptr);
 }
 
 void
@@ -316,7 +730,8 @@ TxUpdater::sendTx(StatusCallback status, DataSlice tx)
 }
 
 Status
-TxUpdater::connectTo(std::string server, ServerType serverType)
+TxUpdater::connectTo(std::string server, ServerType serverType,
+                     ServerSocketPtr socket)
 {
     std::string key;
 
@@ -334,6 +749,7 @@ TxUpdater::connectTo(std::string server, ServerType serverType)
     {
         // Stratum server:
         std::unique_ptr<StratumConnection> sc(new StratumConnection());
+        sc->socketSet(std::move(socket));
         ABC_CHECK(sc->connect(server));
         bc.reset(sc.release());
     }
@@ -348,42 +764,68 @@ TxUpdater::connectTo(std::string server, ServerType serverType)
     // Check for mining fees:
     auto sc = dynamic_cast<StratumConnection *>(bc.get());
     if (generalEstimateFeesNeedUpdate() && sc)
-    {
-        fetchFeeEstimate(1, sc);
-        fetchFeeEstimate(2, sc);
-        fetchFeeEstimate(3, sc);
-        fetchFeeEstimate(4, sc);
-        fetchFeeEstimate(5, sc);
-        fetchFeeEstimate(6, sc);
-        fetchFeeEstimate(7, sc);
-    }
+        fetchFeeEstimates(sc);
 
     connections_.push_back(bc.release());
-    ABC_DebugLog("Connected to %s as %d", server.c_str(), index);
+    ABC_DebugLog("Connecting to %s as %d", server.c_str(), index);
+
+    // Anything stuck in an outbox goes out on the next wakeup:
+    outboxWake_ = true;
 
     return Status();
 }
 
+bool
+TxUpdater::priority()
+{
+    if (engine_)
+        return true;
+
+    std::lock_guard<std::mutex> lock(gActiveMutex);
+    if (gActiveWallet.empty() && !wallets_.empty())
+        gActiveWallet = wallets_.begin()->first;
+    return wallets_.count(gActiveWallet);
+}
+
+bool
+TxUpdater::connected(const std::string &server) const
+{
+    const auto uri = server.substr(0, server.find(' '));
+    for (auto *bc: connections_)
+        if (uri == bc->uri())
+            return true;
+    return false;
+}
+
 IBitcoinConnection *
-TxUpdater::pickServer(const std::string &name)
+TxUpdater::pickServer(const std::string &name, RequestLane lane)
 {
     // If the requested server is connected, only consider that:
     for (auto *bc: connections_)
         if (name == bc->uri() && !failedServers_.count(bc->uri()))
-            return bc->queueFull() ? nullptr : bc;
+            return bc->queueFull(lane) ? nullptr : bc;
 
     // Otherwise, use any server:
-    return pickOtherServer();
+    return pickOtherServer("", lane);
+}
+
+bool
+TxUpdater::serverConnected(const std::string &name) const
+{
+    for (auto *bc: connections_)
+        if (name == bc->uri())
+            return !failedServers_.count(name);
+    return false;
 }
 
 IBitcoinConnection *
-TxUpdater::pickOtherServer(const std::string &name)
+TxUpdater::pickOtherServer(const std::string &name, RequestLane lane)
 {
     IBitcoinConnection *fallback = nullptr;
 
     for (auto *bc: connections_)
     {
-        if (!bc->queueFull() && !failedServers_.count(bc->uri()))
+        if (!bc->queueFull(lane) && !failedServers_.count(bc->uri()))
         {
             if (name != bc->uri())
                 return bc; // Just what we want!
@@ -395,6 +837,26 @@ TxUpdater::pickOtherServer(const std::string &name)
     return fallback;
 }
 
+IBitcoinConnection *
+TxUpdater::pickShard(const std::string &address, RequestLane lane)
+{
+    std::vector<IBitcoinConnection *> healthy;
+    for (auto *bc: connections_)
+        if (!failedServers_.count(bc->uri()))
+            healthy.push_back(bc);
+    if (healthy.empty())
+        return nullptr;
+
+    const auto home = std::hash<std::string>()(address) % healthy.size();
+    for (size_t i = 0; i < healthy.size(); ++i)
+    {
+        auto *bc = healthy[(home + i) % healthy.size()];
+        if (!bc->queueFull(lane))
+            return bc;
+    }
+    return nullptr;
+}
+
 void
 TxUpdater::subscribeHeight(IBitcoinConnection *bc)
 {
@@ -408,40 +870,53 @@ TxUpdater::subscribeHeight(IBitcoinConnection *bc)
 
     unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
 
-    auto onReply = [this, uri, queryTime](size_t height)
+    auto onReply = [this, uri, queryTime, bc](size_t height)
     {
         // Set the response time in the cache
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        servers_.setResponseTime(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: height %d returned %d ms", uri.c_str(), height,
                      responseTime - queryTime);
-        size_t oldHeight = cache_.blocks.heightSet(height);
+        size_t oldHeight = blocks_.heightSet(height);
 
         if (oldHeight > height + 2)
         {
             // This server is behind in block height. Disconnect then penalize it a lot
-            cache_.servers.serverScoreDown(uri, 20);
+            servers_.serverScoreDown(uri, 20);
         }
         else if (oldHeight <= height)
         {
-            cache_.servers.serverScoreUp(uri); // Point for returning a valid height
+            servers_.serverScoreUp(uri); // Point for returning a valid height
             if (oldHeight < height)
             {
-                cache_.servers.serverScoreUp(uri); // Point for returning a newer height
+                servers_.serverScoreUp(uri); // Point for returning a newer height
 
+                // Fee estimates move with each block, so refresh them from
+                // whichever server told us about it first:
+                auto sc = dynamic_cast<StratumConnection *>(bc);
+                if (sc && oldHeight)
+                {
+                    generalEstimateFeesNewBlock().log();
+                    fetchFeeEstimates(sc);
+                }
 
                 // Update addresses with unconfirmed txs:
-                const auto statuses = cache_.txs.statuses(cache_.addresses.txids());
-                for (const auto status: statuses)
+                for (const auto &wallet: wallets_)
                 {
-                    if (!status.second.height)
+                    auto &cache = wallet.second->cache;
+                    const auto statuses =
+                        cache.txs.statuses(cache.addresses.txids());
+                    for (const auto status: statuses)
                     {
-                        for (const auto &io: status.first.ios)
+                        if (!status.second.height)
                         {
-                            ABC_DebugLog("Marking %s dirty (tx height check)",
-                                         io.address.c_str());
-                            cache_.addresses.updateStratumHash(io.address);
+                            for (const auto &io: status.first.ios)
+                            {
+                                ABC_DebugLog("Marking %s dirty (tx height check)",
+                                             io.address.c_str());
+                                cache.addresses.updateStratumHash(io.address);
+                            }
                         }
                     }
                 }
@@ -453,12 +928,13 @@ TxUpdater::subscribeHeight(IBitcoinConnection *bc)
 }
 
 void
-TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
+TxUpdater::subscribeAddress(const WorkPtr &work, const std::string &address,
+                            IBitcoinConnection *bc)
 {
     // If we are already subscribed, mark the address as up-to-date:
     if (bc->addressSubscribed(address))
     {
-        cache_.addresses.updateSubscribe(address);
+        work->cache.addresses.updateSubscribe(address);
         return;
     }
 
@@ -470,12 +946,21 @@ TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
         failedServers_.insert(uri);
     };
 
-    auto onReply = [this, address, uri](const std::string &stateHash)
+    // The subscription outlives this wallet work if the wallet leaves
+    // and comes back, so look the wallet up again on each notification:
+    const auto walletId = work->id;
+    auto onReply = [this, walletId, address, uri](const std::string &stateHash)
     {
-        if (cache_.addresses.updateStratumHash(address, stateHash))
+        const auto i = wallets_.find(walletId);
+        if (wallets_.end() == i)
+            return;
+        auto &cache = i->second->cache;
+
+        if (cache.addresses.updateStratumHash(address, stateHash))
         {
-            cache_.servers.serverScoreUp(uri); // Point for returning a new hash
+            servers_.serverScoreUp(uri); // Point for returning a new hash
             addressServers_[address] = uri;
+            cache.addresses.updateServer(address, uri);
             ABC_DebugLog("%s: %s subscribe reply (dirty) %s",
                          uri.c_str(), address.c_str(), stateHash.c_str());
         }
@@ -490,105 +975,222 @@ TxUpdater::subscribeAddress(const std::string &address, IBitcoinConnection *bc)
 }
 
 void
-TxUpdater::fetchAddress(const std::string &address, IBitcoinConnection *bc)
+TxUpdater::requestStart()
+{
+    static auto &inflight = metricCounter("txupdater.requests_inflight");
+    inflight.add(1);
+}
+
+void
+TxUpdater::requestDone(const std::string &uri, int64_t latency)
+{
+    static auto &inflight = metricCounter("txupdater.requests_inflight");
+    inflight.add(-1);
+    if (latency < 0)
+        return;
+
+    auto &histogram = latencyMetrics_[uri];
+    if (!histogram)
+        histogram = &metricHistogram("txupdater.latency_ms." + uri);
+    histogram->record(latency);
+}
+
+void
+TxUpdater::fetchAddress(const WorkPtr &work, const std::string &address,
+                        IBitcoinConnection *bc)
 {
-    if (wipAddresses_.count(address))
+    if (work->wipAddresses.count(address))
         return;
-    wipAddresses_.insert(address);
+    work->wipAddresses.insert(address);
 
     const auto uri = bc->uri();
-    auto onError = [this, address, uri](Status s)
+    const auto key = traceNext_++;
+    trace(TraceEvent::addressFetch, TracePhase::asyncBegin, work->traceId, key);
+    requestStart();
+    auto onError = [this, work, address, uri, key](Status s)
     {
+        trace(TraceEvent::addressFetch, TracePhase::asyncEnd, work->traceId,
+              key, -1);
+        requestDone(uri);
         ABC_DebugLog("%s: %s fetch failed (%s)",
                      uri.c_str(), address.c_str(), s.message().c_str());
         failedServers_.insert(uri);
-        wipAddresses_.erase(address);
+        work->wipAddresses.erase(address);
     };
 
+    // Only ask for what is newer than the history we already have:
+    const auto fromHeight = work->cache.addresses.historyHeight(address);
     unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
 
-    auto onReply = [this, address, uri, queryTime](const AddressHistory &history)
+    auto onReply = [this, work, address, uri, fromHeight, key,
+                          queryTime](const AddressHistory &history)
     {
+        trace(TraceEvent::addressFetch, TracePhase::asyncEnd, work->traceId,
+              key, history.size());
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        servers_.setResponseTime(uri, responseTime - queryTime);
+        requestDone(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: %s fetched %d TXIDs %d ms", uri.c_str(), address.c_str(),
                      history.size(), responseTime - queryTime);
-        wipAddresses_.erase(address);
+        work->wipAddresses.erase(address);
+        if (!work->active)
+            return;
         addressServers_[address] = uri;
+        auto &cache = work->cache;
+        cache.addresses.updateServer(address, uri);
 
-        TxidSet txids;
-        for (auto &row: history)
-        {
-            cache_.txs.confirmed(row.first, row.second);
-            txids.insert(row.first);
-        }
-
-        if (!history.empty())
+        std::string hash;
+        if (history.empty() && !fromHeight)
+            hash = cache.addresses.getStratumHash(address);
+        if (hash.empty() || addressStatusEmpty == hash)
         {
-            cache_.addresses.update(address, txids);
-            cache_.servers.serverScoreUp(uri);
-
+            AddressHistoryUpdate update;
+            update.address = address;
+            update.history = history;
+            update.fromHeight = fromHeight;
+            cache.addresses.historyApply({update});
+            servers_.serverScoreUp(uri);
         }
         else
         {
-            std::string hash = cache_.addresses.getStratumHash(address);
-            if (hash.empty())
-            {
-
-                cache_.addresses.update(address, txids);
-                cache_.servers.serverScoreUp(uri);
-            }
-            else
-            {
-                ABC_DebugLog("%s: %s SERVER ERROR EMPTY TXIDs with hash %s", uri.c_str(),
-                             address.c_str(), hash.c_str());
-                // Do not trust current server. Force a new server.
-                failedServers_.insert(uri);
-                cache_.servers.serverScoreDown(uri, 20);
-            }
+            ABC_DebugLog("%s: %s SERVER ERROR EMPTY TXIDs with hash %s", uri.c_str(),
+                         address.c_str(), hash.c_str());
+            // Do not trust current server. Force a new server.
+            failedServers_.insert(uri);
+            servers_.serverScoreDown(uri, 20);
         }
     };
 
-    bc->addressHistoryFetch(onError, onReply, address);
+    bc->addressHistoryFetch(onError, onReply, address, fromHeight);
 }
 
 void
-TxUpdater::fetchTx(const std::string &txid, IBitcoinConnection *bc)
+TxUpdater::fetchTx(const WorkPtr &work, const std::string &txid,
+                   IBitcoinConnection *bc, bool hedge)
 {
-    if (wipTxids_.count(txid))
+    if (work->wipTxids.count(txid))
         return;
-    wipTxids_.insert(txid);
+    if (fetchTxShared(work, txid))
+        return;
+    work->wipTxids.insert(txid);
 
+    if (hedge)
+    {
+        const auto when = std::chrono::steady_clock::now() + bc->latencyHigh();
+        hedges_.push_back(Hedge{ work, txid, bc->uri(), when });
+    }
+
+    fetchTxFrom(work, txid, bc);
+}
+
+void
+TxUpdater::fetchTxFrom(const WorkPtr &work, const std::string &txid,
+                       IBitcoinConnection *bc)
+{
     const auto uri = bc->uri();
-    auto onError = [this, txid, uri](Status s)
+    const auto key = traceNext_++;
+    trace(TraceEvent::txFetch, TracePhase::asyncBegin, work->traceId, key);
+    requestStart();
+    auto onError = [this, work, txid, uri, key](Status s)
     {
+        trace(TraceEvent::txFetch, TracePhase::asyncEnd, work->traceId,
+              key, -1);
+        requestDone(uri);
         ABC_DebugLog("%s: tx %s fetch failed (%s)",
                      uri.c_str(), txid.c_str(), s.message().c_str());
         failedServers_.insert(uri);
-        wipTxids_.erase(txid);
+        work->wipTxids.erase(txid);
+        fetchTxFollowers(txid, nullptr);
     };
 
     unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
 
-    auto onReply = [this, txid, uri, queryTime](const bc::transaction_type &tx)
+    auto onReply = [this, work, txid, uri, key,
+                          queryTime](const bc::transaction_type &tx)
     {
+        trace(TraceEvent::txFetch, TracePhase::asyncEnd, work->traceId,
+              key, 1);
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        servers_.setResponseTime(uri, responseTime - queryTime);
+        requestDone(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: tx %s fetched", uri.c_str(), txid.c_str());
-        wipTxids_.erase(txid);
+        if (!work->wipTxids.erase(txid))
+            return; // Another server beat this one
+        fetchTxFollowers(txid, &tx);
+        if (!work->active)
+            return;
 
-        cache_.txs.insert(tx, txid);
-        cache_.addresses.update();
-        cacheDirty = true;
-        cache_.servers.serverScoreUp(uri);
+        txInsert(work, txid, tx);
+        servers_.serverScoreUp(uri);
     };
 
     ABC_DebugLog("%s: tx %s requested", uri.c_str(), txid.c_str());
     bc->txDataFetch(onError, onReply, txid);
 }
 
+bool
+TxUpdater::fetchTxShared(const WorkPtr &work, const std::string &txid)
+{
+    for (const auto &wallet: wallets_)
+    {
+        const auto &other = wallet.second;
+        if (other == work || !other->active)
+            continue;
+
+        bc::transaction_type tx;
+        if (other->cache.txs.get(tx, txid))
+        {
+            ABC_DebugLog("tx %s shared from another wallet", txid.c_str());
+            txInsert(work, txid, tx);
+            return true;
+        }
+
+        if (other->wipTxids.count(txid))
+        {
+            work->wipTxids.insert(txid);
+            txFollowers_[txid].push_back(work);
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+TxUpdater::fetchTxFollowers(const std::string &txid,
+                            const bc::transaction_type *tx)
+{
+    auto i = txFollowers_.find(txid);
+    if (txFollowers_.end() == i)
+        return;
+    const auto followers = std::move(i->second);
+    txFollowers_.erase(i);
+
+    for (const auto &follower: followers)
+    {
+        if (follower->wipTxids.erase(txid) && follower->active && tx)
+            txInsert(follower, txid, *tx);
+    }
+}
+
+void
+TxUpdater::txInsert(const WorkPtr &work, const std::string &txid,
+                    const bc::transaction_type &tx)
+{
+    work->cache.txs.insert(tx, txid);
+    work->cache.addresses.update();
+    work->cacheDirty = true;
+}
+
+void
+TxUpdater::fetchFeeEstimates(StratumConnection *sc)
+{
+    // The connection pipelines these, so they go out in one burst:
+    for (size_t blocks = 1; blocks <= 7; ++blocks)
+        fetchFeeEstimate(blocks, sc);
+}
+
 void
 TxUpdater::fetchFeeEstimate(size_t blocks, StratumConnection *sc)
 {
@@ -603,7 +1205,7 @@ TxUpdater::fetchFeeEstimate(size_t blocks, StratumConnection *sc)
     auto onReply = [this, blocks, uri, queryTime](double fee)
     {
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        servers_.setResponseTime(uri, responseTime - queryTime);
 
         ABC_DebugLog("%s: returned fee %lf for %d blocks %d ms",
                      uri.c_str(), fee, blocks, responseTime - queryTime);
@@ -614,32 +1216,45 @@ TxUpdater::fetchFeeEstimate(size_t blocks, StratumConnection *sc)
 }
 
 void
-TxUpdater::blockHeaderFetch(size_t height, IBitcoinConnection *bc)
+TxUpdater::blockHeadersFetch(size_t height, size_t count,
+                             IBitcoinConnection *bc)
 {
     const auto uri = bc->uri();
-    auto onError = [this, height, uri](Status s)
+    const auto id = traceId(uri);
+    const auto key = traceNext_++;
+    trace(TraceEvent::headersFetch, TracePhase::asyncBegin, id, key, count);
+    requestStart();
+    auto onError = [this, height, count, uri, id, key](Status s)
     {
-        ABC_DebugLog("%s: header %d fetch failed (%s)",
-                     uri.c_str(), height, s.message().c_str());
+        trace(TraceEvent::headersFetch, TracePhase::asyncEnd, id, key, -1);
+        requestDone(uri);
+        ABC_DebugLog("%s: headers %d+%d fetch failed (%s)",
+                     uri.c_str(), height, count, s.message().c_str());
         failedServers_.insert(uri);
+
+        // Put the run back so another server can try:
+        for (size_t i = 0; i < count; ++i)
+            blocks_.headerNeededAdd(height + i);
     };
 
     unsigned long long queryTime = ServerCache::getCurrentTimeMilliSeconds();
-    auto onReply = [this, height, uri,
-                          queryTime](const bc::block_header_type &header)
+    auto onReply = [this, height, count, uri, id, key,
+                          queryTime](const HeaderList &headers)
     {
+        trace(TraceEvent::headersFetch, TracePhase::asyncEnd, id, key,
+              headers.size());
         unsigned long long responseTime = ServerCache::getCurrentTimeMilliSeconds();
-        cache_.servers.setResponseTime(uri, responseTime - queryTime);
+        servers_.setResponseTime(uri, responseTime - queryTime);
+        requestDone(uri, responseTime - queryTime);
 
-        ABC_DebugLog("%s: header %d fetched %d ms",
-                     uri.c_str(), height, responseTime - queryTime);
+        ABC_DebugLog("%s: headers %d+%d fetched %d ms", uri.c_str(),
+                     height, headers.size(), responseTime - queryTime);
 
-        bool didInsert = cache_.blocks.headerInsert(height, header);
-        if (didInsert)
-            cache_.servers.serverScoreUp(uri);
+        if (blocks_.headersInsert(height, headers))
+            servers_.serverScoreUp(uri);
     };
 
-    bc->blockHeaderFetch(onError, onReply, height);
+    bc->blockHeadersFetch(onError, onReply, height, count);
 }
 
 } // namespace abcd
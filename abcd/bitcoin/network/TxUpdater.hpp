@@ -8,22 +8,43 @@
 #ifndef ABCD_BITCOIN_NETWORK_TX_UPDATER_HPP
 #define ABCD_BITCOIN_NETWORK_TX_UPDATER_HPP
 
+#include "ConnectionPool.hpp"
+#include "IBitcoinConnection.hpp"
 #include "../Typedefs.hpp"
 #include "../../util/Data.hpp"
 #include "../cache/ServerCache.hpp"
 #include "../../wallet/Wallet.hpp"
 #include <zmq.h>
 #include <chrono>
+#include <list>
 #include <map>
+#include <memory>
+#include <set>
+#include <vector>
 
 namespace abcd {
 
+class BlockCache;
 class Cache;
-class IBitcoinConnection;
+class MetricHistogram;
 class StratumConnection;
 
+/**
+ * Marks the wallet the user is looking at.
+ * Its updater gets first pick of the process-wide socket budget,
+ * while the others connect a socket at a time as room allows.
+ * Until this is called, the first updater to connect takes the spot.
+ */
+void
+txUpdaterActiveSet(const std::string &walletId);
+
 /**
  * Syncs a set of transactions with the bitcoin server.
+ *
+ * An updater normally serves a single wallet, but the shared network
+ * engine uses one updater for every loaded wallet. In that case,
+ * the wallets share the server connections, while the height and
+ * block headers are only fetched once.
  */
 class TxUpdater
 {
@@ -31,21 +52,44 @@ public:
     ~TxUpdater();
     TxUpdater(Wallet &wallet, void *ctx);
 
+    /**
+     * Creates an updater for the shared network engine.
+     * Wallets join and leave using `walletAdd` and `walletRemove`.
+     */
+    TxUpdater(void *ctx);
+
+    /**
+     * Begins syncing another wallet over the existing connections.
+     */
+    void
+    walletAdd(std::shared_ptr<Wallet> wallet);
+
+    /**
+     * Stops syncing a wallet, saving its cache if needed.
+     */
+    void
+    walletRemove(const std::string &id);
+
     void disconnect();
     Status connect();
 
     /**
      * Performs any pending work.
      * Returns the number of milliseconds until the next work will be ready.
+     * @param ready The results of polling the last `pollitems` list.
+     * Only the connections that fired or came due get serviced,
+     * and the wallets are only scheduled if something could have changed.
+     * Pass null after anything else touches the updater.
      */
     std::chrono::milliseconds
-    wakeup();
+    wakeup(const zmq_pollitem_t *ready=nullptr, size_t count=0);
 
     /**
-     * Obtains a list of sockets that the main loop should sleep on.
+     * Appends the sockets that the main loop should sleep on,
+     * so the caller can keep reusing the same vector.
      */
-    std::list<zmq_pollitem_t>
-    pollitems();
+    void
+    pollitems(std::vector<zmq_pollitem_t> &out);
 
     /**
      * Broadcasts a transaction.
@@ -55,28 +99,79 @@ public:
     sendTx(StatusCallback status, DataSlice tx);
 
 private:
-    Status connectTo(std::string server, ServerType serverType);
+    /**
+     * The sync state for one wallet.
+     * Network callbacks hold a reference to this,
+     * so a wallet can leave while its requests are still in flight.
+     */
+    struct WalletWork
+    {
+        WalletWork(Cache &cache): cache(cache) {}
+
+        std::shared_ptr<Wallet> wallet; // Keeps shared-engine wallets alive
+        Cache &cache;
+        std::string id; // The key in `wallets_`
+        uint32_t traceId = 0;
+        bool active = true;
+        bool cacheDirty = false;
+        time_t cacheLastSave = 0;
+
+        // Fetches currently in progress:
+        AddressSet wipAddresses;
+        TxidSet wipTxids;
+    };
+    typedef std::shared_ptr<WalletWork> WorkPtr;
 
-    Cache &cache_;
+    Status connectTo(std::string server, ServerType serverType,
+                     ServerSocketPtr socket);
 
+    /**
+     * Returns true if this updater serves the active wallet,
+     * or is the shared engine, which serves them all.
+     */
+    bool priority();
+
+    /**
+     * Returns true if we already have a connection to the given server.
+     */
+    bool connected(const std::string &server) const;
+
+    BlockCache &blocks_;
+    ServerCache &servers_;
+    std::map<std::string, WorkPtr> wallets_;
+
+    const bool engine_; // True for the shared engine
     bool wantConnection = false;
-    bool cacheDirty = false;
-    time_t cacheLastSave = 0;
+    bool outboxWake_ = false; // A new connection can take the outboxes
 
     bool overrideBitcoinServers_;
     std::vector<std::string> overrideBitcoinServerList_;
 
     std::vector<IBitcoinConnection *> connections_;
+
+    // What the last `pollitems` list holds, and when things come due,
+    // so `wakeup` can leave quiet connections alone:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+    std::vector<IBitcoinConnection *> pollOwners_; // Null for the pool
+    std::map<IBitcoinConnection *, TimePoint> due_;
+    TimePoint poolDue_;
+    TimePoint scheduleDue_;
+    TimePoint connectDue_; // Another try at a budget that turned us away
+    uint64_t traceNext_ = 0;
+    std::map<std::string, MetricHistogram *> latencyMetrics_;
+    std::map<std::string, MetricHistogram *> wakeupMetrics_;
+
+    /**
+     * Connections left over from the last `disconnect`,
+     * ready to be picked back up by the next `connect`.
+     */
+    ConnectionPool pool_;
 //    std::vector<std::string> serverList_;
 //    std::set<int> untriedLibbitcoin_;
 //    std::set<int> untriedStratum_;
     std::vector<std::string> stratumServers_;
     std::vector<std::string> airbitzServers_;
 
-    // Fetches currently in progress:
-    AddressSet wipAddresses_;
-    TxidSet wipTxids_;
-
     /**
      * The last server used to query the address.
      * Used to avoid reusing the same server over and over,
@@ -84,18 +179,35 @@ private:
      */
     std::map<std::string, std::string> addressServers_;
 
+    // Wallets waiting on another wallet's fetch of the same transaction:
+    std::map<std::string, std::vector<WorkPtr>> txFollowers_;
+
     /**
      * A list of servers that have failed.
      */
     std::set<std::string> failedServers_;
 
+    /**
+     * An urgent transaction fetch to re-issue to a second server
+     * if the first one has not answered by the given time.
+     */
+    struct Hedge
+    {
+        WorkPtr work;
+        std::string txid;
+        std::string uri;
+        std::chrono::steady_clock::time_point when;
+    };
+    std::list<Hedge> hedges_;
+
     /**
      * Finds the requested server, assuming it is even connected and ready.
      * @return The best available server,
      * or a null pointer if the server is busy.
      */
     IBitcoinConnection *
-    pickServer(const std::string &name);
+    pickServer(const std::string &name,
+               RequestLane lane=RequestLane::bulk);
 
     /**
      * Tries to pick a different server than the one provided.
@@ -103,25 +215,105 @@ private:
      * or a null pointer if there are no free servers.
      */
     IBitcoinConnection *
-    pickOtherServer(const std::string &name="");
+    pickOtherServer(const std::string &name="",
+                    RequestLane lane=RequestLane::bulk);
+
+    /**
+     * Spreads addresses evenly over the healthy servers,
+     * so a restore keeps every connection busy.
+     * Each address has a home server, but moves along if that one is busy.
+     * @return The best available server,
+     * or a null pointer if there are no free servers.
+     */
+    IBitcoinConnection *
+    pickShard(const std::string &address,
+              RequestLane lane=RequestLane::bulk);
+
+    /**
+     * Returns true if the named server is connected and working.
+     */
+    bool
+    serverConnected(const std::string &name) const;
+
+    /**
+     * Hands out the pending address and transaction work for one wallet.
+     */
+    void
+    walletWakeup(const WorkPtr &work, std::chrono::milliseconds &nextWakeup);
 
     void
     subscribeHeight(IBitcoinConnection *bc);
 
     void
-    subscribeAddress(const std::string &address, IBitcoinConnection *bc);
+    subscribeAddress(const WorkPtr &work, const std::string &address,
+                     IBitcoinConnection *bc);
 
+    /**
+     * Counts a request going out, for the metrics.
+     */
+    void
+    requestStart();
+
+    /**
+     * Counts a request coming back, with its latency in milliseconds,
+     * or -1 if it failed.
+     */
     void
-    fetchAddress(const std::string &address, IBitcoinConnection *bc);
+    requestDone(const std::string &uri, int64_t latency=-1);
 
     void
-    fetchTx(const std::string &txid, IBitcoinConnection *bc);
+    fetchAddress(const WorkPtr &work, const std::string &address,
+                 IBitcoinConnection *bc);
+
+    /**
+     * Fetches a transaction unless it is already on its way.
+     * @param hedge true to race a second server if this one is slow.
+     */
+    void
+    fetchTx(const WorkPtr &work, const std::string &txid,
+            IBitcoinConnection *bc, bool hedge=false);
+
+    /**
+     * Sends a transaction request to the given server.
+     * Whichever reply arrives first fills the cache.
+     */
+    void
+    fetchTxFrom(const WorkPtr &work, const std::string &txid,
+                IBitcoinConnection *bc);
+
+    /**
+     * Fills a transaction request from the other wallets, if possible,
+     * either by copying their cached copy or by joining their fetch.
+     * Transfers between a user's own wallets then only download once.
+     */
+    bool
+    fetchTxShared(const WorkPtr &work, const std::string &txid);
+
+    /**
+     * Hands a finished fetch to the wallets waiting on it,
+     * or releases them to try again if `tx` is null.
+     */
+    void
+    fetchTxFollowers(const std::string &txid, const bc::transaction_type *tx);
+
+    void
+    txInsert(const WorkPtr &work, const std::string &txid,
+             const bc::transaction_type &tx);
+
+    /**
+     * Asks a stratum server for the fee at every confirmation target.
+     */
+    void
+    fetchFeeEstimates(StratumConnection *sc);
 
     void
     fetchFeeEstimate(size_t blocks, StratumConnection *sc);
 
+    /**
+     * Fetches a run of consecutive block headers.
+     */
     void
-    blockHeaderFetch(size_t height, IBitcoinConnection *bc);
+    blockHeadersFetch(size_t height, size_t count, IBitcoinConnection *bc);
 };
 
 } // namespace abcd
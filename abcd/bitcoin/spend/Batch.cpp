@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Batch.hpp"
+#include "Outputs.hpp"
+#include "Spend.hpp"
+#include "../../util/Debug.hpp"
+
+namespace abcd {
+
+// Outputs per transaction, which keeps even a full set of inputs
+// well under the 100KB standard transaction size:
+constexpr size_t batchOutputs = 250;
+
+/**
+ * Sends one group of payments as a single transaction,
+ * splitting the group if there is not enough money to fund it.
+ */
+static void
+batchSend(Wallet &wallet, const std::vector<BatchPayment> &payments,
+          const std::vector<size_t> &group,
+          tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi,
+          const BatchCallback &callback)
+{
+    Spend spend(wallet);
+    for (auto i: group)
+        spend.addAddress(payments[i].address, payments[i].amount);
+    spend.feeSet(feeLevel, customFeeSatoshi);
+
+    DataChunk rawTx;
+    Status s = spend.signTx(rawTx);
+    if (!s && ABC_CC_InsufficientFunds == s.value() && 1 < group.size())
+    {
+        const auto middle = group.begin() + group.size() / 2;
+        batchSend(wallet, payments, std::vector<size_t>(group.begin(), middle),
+                  feeLevel, customFeeSatoshi, callback);
+        batchSend(wallet, payments, std::vector<size_t>(middle, group.end()),
+                  feeLevel, customFeeSatoshi, callback);
+        return;
+    }
+
+    std::string txid;
+    if (s)
+        s = spend.broadcastTx(rawTx);
+    if (s)
+        s = spend.saveTx(rawTx, txid);
+    s.log();
+
+    ABC_DebugLog("Batch: %d payments, txid %s", group.size(), txid.c_str());
+    for (auto i: group)
+        callback(i, s, txid);
+}
+
+Status
+batchSpend(Wallet &wallet, const std::vector<BatchPayment> &payments,
+           tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi,
+           const BatchCallback &callback)
+{
+    // Turn away bad payments up front, so they don't sink a whole group:
+    std::vector<size_t> good;
+    for (size_t i = 0; i < payments.size(); ++i)
+    {
+        bc::script_type script;
+        Status s = outputScriptForAddress(script, payments[i].address);
+        if (s && outputIsDust(payments[i].amount))
+            s = ABC_ERROR(ABC_CC_SpendDust, "Trying to send dust");
+
+        if (s)
+            good.push_back(i);
+        else
+            callback(i, s, "");
+    }
+
+    for (size_t start = 0; start < good.size(); start += batchOutputs)
+    {
+        const auto end = std::min(good.size(), start + batchOutputs);
+        batchSend(wallet, payments,
+                  std::vector<size_t>(good.begin() + start, good.begin() + end),
+                  feeLevel, customFeeSatoshi, callback);
+    }
+
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Sends many payments at once, packed into as few transactions as possible.
+ */
+
+#ifndef ABCD_BITCOIN_SPEND_BATCH_HPP
+#define ABCD_BITCOIN_SPEND_BATCH_HPP
+
+#include "../../util/Status.hpp"
+#include <functional>
+#include <vector>
+
+namespace abcd {
+
+class Wallet;
+
+/**
+ * One payment in a batch.
+ */
+struct BatchPayment
+{
+    std::string address;
+    uint64_t amount;
+};
+
+/**
+ * Reports how one payment turned out.
+ * @param index the payment's position in the list passed to `batchSpend`.
+ * @param txid the transaction carrying the payment, if it went out.
+ */
+typedef std::function<void (size_t index, const Status &status,
+                            const std::string &txid)> BatchCallback;
+
+/**
+ * Sends a list of payments, several hundred outputs to a transaction.
+ * A transaction that cannot be funded gets split in half and retried,
+ * so one oversized group does not hold up the payments that can go out.
+ * The callback fires once for every payment,
+ * as soon as its transaction has been broadcast and saved.
+ */
+Status
+batchSpend(Wallet &wallet, const std::vector<BatchPayment> &payments,
+           tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi,
+           const BatchCallback &callback);
+
+} // namespace abcd
+
+#endif
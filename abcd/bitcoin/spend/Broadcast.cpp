@@ -7,17 +7,23 @@
 
 #include "Broadcast.hpp"
 #include "../Testnet.hpp"
+#include "../Utility.hpp"
 #include "../WatcherBridge.hpp"
+#include "../cache/Cache.hpp"
 #include "../../Context.hpp"
 #include "../../crypto/Encoding.hpp"
 #include "../../http/HttpRequest.hpp"
 #include "../../json/JsonObject.hpp"
 #include "../../util/Debug.hpp"
 #include "../../wallet/Wallet.hpp"
+#include <algorithm>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace abcd {
 
@@ -54,102 +60,293 @@ blockchainPostTx(DataSlice tx)
     return Status();
 }
 
+// Worker threads shared by every broadcast:
+constexpr size_t broadcastWorkers = 4;
+
+// How long each endpoint gets before the next-best one joins in:
+constexpr std::chrono::milliseconds broadcastHeadStart(1500);
+
+// Scoreboard tuning, matching the sync server health tracking:
+constexpr double latencyWeight = 0.3;
+constexpr double failureWeight = 0.3;
+constexpr double failureRateMax = 0.9;
+
+typedef std::chrono::steady_clock Clock;
+
 /**
- * Contains a condition variable and its associated mutex.
- * The mutex protects access to some piece of shared data,
- * and the condition variable triggers a wakeup when the data is modified.
+ * A web service that accepts raw transactions.
  */
-struct Syncer
+struct BroadcastEndpoint
 {
-    std::condition_variable cv;
-    std::mutex mutex;
+    const char *name;
+    Status (*post)(DataSlice tx);
 };
 
+static const BroadcastEndpoint gEndpoints[] =
+{
+    {"blockchain.info", blockchainPostTx},
+    {"insight", insightPostTx}
+};
+constexpr size_t endpointCount = sizeof(gEndpoints) / sizeof(gEndpoints[0]);
+
 /**
- * Holds the return value from a long-running background task,
- * and a flag indicating if the task is done yet.
+ * How well an endpoint has been doing lately.
  */
-struct DelayedStatus
+struct EndpointScore
 {
+    /** Exponentially-weighted average response time, in ms. */
+    double latency = 0;
+    /** Decaying fraction of recent broadcasts that failed. */
+    double failureRate = 0;
+};
+
+static std::mutex gScoreMutex;
+static EndpointScore gScores[endpointCount];
+
+// The worker pool and its timed job queue:
+static std::mutex gPoolMutex;
+static std::condition_variable gPoolReady;
+static std::multimap<Clock::time_point, std::function<void ()>> gPoolJobs;
+static size_t gPoolThreads = 0;
+
+/**
+ * One transaction's trip through the endpoints.
+ */
+struct BroadcastJob
+{
+    std::mutex mutex;
+    DataChunk tx;
+    StatusCallback callback;
+
+    std::vector<size_t> order;
+    size_t launched = 0;
+    size_t total = 0;
+    size_t failures = 0;
     bool done = false;
-    Status status;
+    Status error;
 };
 
+static void
+broadcastWorker()
+{
+    std::unique_lock<std::mutex> lock(gPoolMutex);
+    while (true)
+    {
+        if (gPoolJobs.empty())
+        {
+            gPoolReady.wait(lock);
+            continue;
+        }
+
+        auto i = gPoolJobs.begin();
+        if (Clock::now() < i->first)
+        {
+            gPoolReady.wait_until(lock, i->first);
+            continue;
+        }
+
+        auto work = std::move(i->second);
+        gPoolJobs.erase(i);
+        lock.unlock();
+        work();
+        lock.lock();
+    }
+}
+
 /**
- * A long-running broadcast task.
- * @param condition Guards access to the status,
- * and signals when the task is done.
- * @param status Holds the status of the task.
+ * Runs a function on the worker pool after the given delay.
  */
-template<Status (*f)(DataSlice tx)> static void
-broadcastTask(std::shared_ptr<Syncer> syncer,
-              std::shared_ptr<DelayedStatus> status, DataChunk tx)
+static void
+broadcastSchedule(std::function<void ()> work,
+                  Clock::duration delay=Clock::duration::zero())
+{
+    std::lock_guard<std::mutex> lock(gPoolMutex);
+    for (; gPoolThreads < broadcastWorkers; ++gPoolThreads)
+        std::thread(broadcastWorker).detach();
+
+    gPoolJobs.emplace(Clock::now() + delay, std::move(work));
+    gPoolReady.notify_all();
+}
+
+static double
+endpointCost(const EndpointScore &score)
+{
+    return score.latency / (1 - std::min(score.failureRate, failureRateMax));
+}
+
+static void
+endpointReport(size_t endpoint, bool ok, unsigned long ms)
 {
-    auto result = f(tx);
+    std::lock_guard<std::mutex> lock(gScoreMutex);
 
+    auto &score = gScores[endpoint];
+    if (ok)
     {
-        std::lock_guard<std::mutex> lock(syncer->mutex);
-        status->status = result;
-        status->done = true;
+        score.latency = score.latency ?
+                        (1 - latencyWeight) * score.latency +
+                        latencyWeight * ms : ms;
+        score.failureRate *= 1 - failureWeight;
     }
-    syncer->cv.notify_all();
+    else
+    {
+        score.failureRate += failureWeight * (1 - score.failureRate);
+    }
+    ABC_DebugLog("Broadcast %s: %s in %lu ms (%.0f ms, %.0f%% failures)",
+                 gEndpoints[endpoint].name, ok ? "ok" : "failed", ms,
+                 score.latency, 100 * score.failureRate);
 }
 
-Status
-broadcastTx(Wallet &self, DataSlice rawTx)
+/**
+ * Lists the endpoints, cheapest first.
+ */
+static std::vector<size_t>
+endpointsRanked()
 {
-    // Create communication resources:
-    auto syncer = std::make_shared<Syncer>();
-    auto s1 = std::make_shared<DelayedStatus>();
-    auto s2 = std::make_shared<DelayedStatus>();
-    auto s3 = std::make_shared<DelayedStatus>();
+    std::lock_guard<std::mutex> lock(gScoreMutex);
 
-    // Launch the broadcasts:
-    DataChunk tx(rawTx.begin(), rawTx.end());
+    std::vector<size_t> out;
+    for (size_t i = 0; i < endpointCount; ++i)
+        out.push_back(i);
+    std::stable_sort(out.begin(), out.end(), [](size_t a, size_t b)
+    {
+        return endpointCost(gScores[a]) < endpointCost(gScores[b]);
+    });
+    return out;
+}
 
-    if (!self.bOverrideBitcoinServers)
+/**
+ * Records one attempt's outcome, firing the callback on the first success,
+ * or once every attempt has failed.
+ */
+static void
+broadcastFinish(std::shared_ptr<BroadcastJob> job, Status status)
+{
+    StatusCallback callback;
     {
-        std::thread(broadcastTask<blockchainPostTx>, syncer, s1, tx).detach();
-        std::thread(broadcastTask<insightPostTx>, syncer, s2, tx).detach();
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (job->done)
+            return;
+
+        if (!status)
+        {
+            if (!job->failures++)
+                job->error = status;
+            if (job->failures < job->total)
+                return;
+            status = job->error;
+        }
+        job->done = true;
+        callback = std::move(job->callback);
     }
+    callback(status);
+}
 
-    // Queue up an async broadcast over the TxUpdater:
-    auto updaterDone = [syncer, s3](Status s)
+/**
+ * Starts the next endpoint in line, if there is one
+ * and the transaction has not gone out yet.
+ */
+static void
+broadcastLaunch(std::shared_ptr<BroadcastJob> job)
+{
+    size_t endpoint;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        if (job->done || job->order.size() <= job->launched)
+            return;
+        endpoint = job->order[job->launched++];
+    }
+
+    broadcastSchedule([job, endpoint]()
     {
+        const auto start = Clock::now();
+        Status s = gEndpoints[endpoint].post(job->tx);
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            Clock::now() - start).count();
+        endpointReport(endpoint, !!s, ms);
+
+        // Don't make the next endpoint wait out its head start:
+        if (!s)
+            broadcastLaunch(job);
+        broadcastFinish(job, s);
+    });
+}
+
+void
+broadcastTxAsync(Wallet &self, DataSlice rawTx, StatusCallback callback)
+{
+    // Once some server takes the transaction, keep it on disk until
+    // it shows up in an address history, so the watcher can re-send it
+    // if that server never passes it along. A transaction nobody takes
+    // fails outright, so the caller never sees a half-sent spend:
+    bc::transaction_type tx;
+    if (decodeTx(tx, rawTx))
+    {
+        const auto txid = bc::encode_hash(bc::hash_transaction(tx));
+        const auto raw = DataChunk(rawTx.begin(), rawTx.end());
+        auto &cache = self.cache;
+        callback = [&cache, txid, raw, callback](Status s)
         {
-            std::lock_guard<std::mutex> lock(syncer->mutex);
-            s3->status = s;
-            s3->done = true;
             if (s)
-                ABC_DebugLog("Stratum broadcast OK");
-            else
-                s.log();
-        }
-        syncer->cv.notify_all();
+            {
+                cache.outbox.add(txid, raw);
+                cache.save().log(); // Failure is fine
+            }
+            callback(s);
+        };
+    }
+
+    auto job = std::make_shared<BroadcastJob>();
+    job->tx = DataChunk(rawTx.begin(), rawTx.end());
+    job->callback = std::move(callback);
+    if (!self.bOverrideBitcoinServers)
+        job->order = endpointsRanked();
+    job->total = job->order.size() + 1;
+
+    // The TxUpdater's stratum connection is already open, so it goes now:
+    auto updaterDone = [job](Status s)
+    {
+        if (s)
+            ABC_DebugLog("Stratum broadcast OK");
+        else
+            s.log();
+        broadcastFinish(job, s);
     };
-    watcherSend(self, updaterDone, rawTx).log();
+    Status s = watcherSend(self, updaterDone, rawTx);
+    if (!s)
+        broadcastFinish(job, s.log());
 
-    // Loop as long as any thread is still running:
-    while (true)
+    // The best web endpoint goes now, and the rest follow at intervals:
+    broadcastLaunch(job);
+    for (size_t i = 1; i < job->order.size(); ++i)
+        broadcastSchedule([job]() { broadcastLaunch(job); },
+                          i * broadcastHeadStart);
+}
+
+Status
+broadcastTx(Wallet &self, DataSlice rawTx)
+{
+    struct Result
     {
-        // Wait for the condition variable, which also acquires the lock:
-        std::unique_lock<std::mutex> lock(syncer->mutex);
-        syncer->cv.wait(lock);
-
-        // Stop waiting if any broadcast has succeeded:
-        if (s1->done && s1->status)
-            break;
-        if (s2->done && s2->status)
-            break;
-        if (s3->done && s3->status)
-            break;
-
-        // If they are all done, we have an error:
-        if (s1->done && s2->done && s3->done)
-            return s1->status;
-    }
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        Status status;
+    };
+    auto result = std::make_shared<Result>();
 
-    return Status();
+    broadcastTxAsync(self, rawTx, [result](Status s)
+    {
+        {
+            std::lock_guard<std::mutex> lock(result->mutex);
+            result->status = s;
+            result->done = true;
+        }
+        result->cv.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(result->mutex);
+    result->cv.wait(lock, [result]() { return result->done; });
+    return result->status;
 }
 
 } // namespace abcd
@@ -8,6 +8,7 @@
 #ifndef ABCD_BITCOIN_BROADCAST_HPP
 #define ABCD_BITCOIN_BROADCAST_HPP
 
+#include "../Typedefs.hpp"
 #include "../../util/Data.hpp"
 #include "../../util/Status.hpp"
 
@@ -16,7 +17,22 @@ namespace abcd {
 class Wallet;
 
 /**
- * Sends a transaction out to the Bitcoin network.
+ * Sends a transaction out to the Bitcoin network without waiting.
+ * The transaction goes over the wallet's stratum connection right away,
+ * and to the web endpoints one at a time, best-scoring first,
+ * each getting a short head start before the next one joins in.
+ * The callback fires once, on a worker thread, with the first success
+ * or, if every attempt fails, the first failure.
+ * After a success, the transaction waits in the wallet's outbox
+ * until it appears in an address history, so the watcher can re-send it
+ * if the accepting server drops it.
+ */
+void
+broadcastTxAsync(Wallet &self, DataSlice rawTx, StatusCallback callback);
+
+/**
+ * Sends a transaction out to the Bitcoin network,
+ * waiting for the first endpoint to accept it.
  */
 Status
 broadcastTx(Wallet &self, DataSlice rawTx);
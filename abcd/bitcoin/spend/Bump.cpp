@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bump.hpp"
+#include "Broadcast.hpp"
+#include "Inputs.hpp"
+#include "Outputs.hpp"
+#include "../cache/Cache.hpp"
+#include "../../Context.hpp"
+#include "../../General.hpp"
+#include "../../exchange/ExchangeCache.hpp"
+#include "../../util/Debug.hpp"
+#include "../../wallet/Wallet.hpp"
+
+namespace abcd {
+
+/**
+ * Signs, sends, and saves the child transaction.
+ */
+static Status
+bumpSend(std::string &txid, Wallet &wallet, bc::transaction_type &tx,
+         const std::string &parentTxid)
+{
+    AddressSet addresses;
+    ABC_CHECK(inputsAddresses(addresses, tx, wallet.cache.txs));
+    KeyTable keys = wallet.addresses.keyTable(addresses);
+    ABC_CHECK(signTx(tx, wallet.cache.txs, keys));
+
+    bc::data_chunk rawTx(satoshi_raw_size(tx));
+    bc::satoshi_save(tx, rawTx.begin());
+    ABC_CHECK(broadcastTx(wallet, rawTx));
+
+    // Calculate transaction information:
+    TxInfo info;
+    ABC_CHECK(wallet.cache.txs.info(info, tx));
+    const auto balance = wallet.addresses.balance(info);
+
+    // Update the transaction cache:
+    wallet.cache.txs.insert(tx, info.txid);
+    wallet.cache.addresses.updateSpend(info);
+    wallet.cache.save().log(); // Failure is fine
+
+    // Save the transaction metadata:
+    TxMeta meta;
+    meta.ntxid = info.ntxid;
+    meta.txid = info.txid;
+    meta.timeCreation = time(nullptr);
+    meta.internal = true;
+    meta.airbitzFeeWanted = 0;
+    meta.airbitzFeeSent = 0;
+    meta.metadata.notes = "Speeding up " + parentTxid;
+    gContext->exchangeCache.satoshiToCurrency(
+        meta.metadata.amountCurrency, balance,
+        static_cast<Currency>(wallet.currency())).log();
+    ABC_CHECK(wallet.txs.save(meta, balance, info.fee));
+
+    txid = info.txid;
+    return Status();
+}
+
+Status
+bumpFee(std::string &txid, Wallet &wallet, const std::string &parentTxid,
+        tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi)
+{
+    TxStatus status;
+    ABC_CHECK(wallet.cache.txs.status(status, parentTxid));
+    if (status.height)
+        return ABC_ERROR(ABC_CC_Error, "The transaction is already confirmed");
+    if (status.isDoubleSpent)
+        return ABC_ERROR(ABC_CC_Error, "The transaction is double-spent");
+
+    bc::transaction_type parent;
+    TxInfo parentInfo;
+    ABC_CHECK(wallet.cache.txs.get(parent, parentTxid));
+    ABC_CHECK(wallet.cache.txs.info(parentInfo, parent));
+
+    // Find the parent's outputs that still belong to us:
+    bc::output_info_list utxos;
+    const auto all = wallet.cache.txs.utxos(*wallet.addresses.snapshot());
+    for (const auto &utxo: filterOutputs(all))
+        if (bc::encode_hash(utxo.point.hash) == parentTxid)
+            utxos.push_back(utxo);
+    if (utxos.empty())
+        return ABC_ERROR(ABC_CC_InsufficientFunds,
+                         "The transaction has no outputs in this wallet");
+
+    // Send them back to ourselves with the extra fee:
+    bc::transaction_type tx;
+    tx.version = 1;
+    tx.locktime = 0;
+    AddressMeta address;
+    ABC_CHECK(wallet.addresses.getNew(address));
+    bc::transaction_output_type output;
+    ABC_CHECK(outputScriptForAddress(output.script, address.address));
+    tx.outputs.push_back(output);
+
+    uint64_t fee, funds;
+    ABC_CHECK(inputsPickBump(fee, funds, tx, utxos,
+                             satoshi_raw_size(parent), parentInfo.fee,
+                             generalBitcoinFeeInfo(),
+                             feeLevel, customFeeSatoshi));
+    tx.outputs[0].value = funds;
+
+    ABC_CHECK(bumpSend(txid, wallet, tx, parentTxid));
+    ABC_DebugLog("Bump: %s pays %d for %s",
+                 txid.c_str(), fee, parentTxid.c_str());
+
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Speeds up stuck wallet transactions.
+ */
+
+#ifndef ABCD_BITCOIN_SPEND_BUMP_HPP
+#define ABCD_BITCOIN_SPEND_BUMP_HPP
+
+#include "../../util/Status.hpp"
+
+namespace abcd {
+
+class Wallet;
+
+/**
+ * Raises the effective fee of an unconfirmed wallet transaction
+ * by sending its outputs back into the wallet with a child
+ * that pays for both (CPFP).
+ * @param txid receives the id of the child transaction.
+ */
+Status
+bumpFee(std::string &txid, Wallet &wallet, const std::string &parentTxid,
+        tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "CoinSelect.hpp"
+#include <algorithm>
+
+namespace abcd {
+
+// How many steps the changeless search may take before giving up:
+constexpr size_t searchTries = 100000;
+
+/**
+ * A coin worth spending, with its position in the caller's list.
+ */
+struct Coin
+{
+    size_t index;
+    uint64_t value;
+    uint64_t effective;
+};
+
+static std::vector<Coin>
+coinsSorted(const std::vector<uint64_t> &values, uint64_t inputCost)
+{
+    std::vector<Coin> out;
+    out.reserve(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        if (inputCost < values[i])
+            out.push_back(Coin{i, values[i], values[i] - inputCost});
+
+    std::stable_sort(out.begin(), out.end(),
+                     [](const Coin &a, const Coin &b)
+    {
+        return a.value > b.value;
+    });
+    return out;
+}
+
+/**
+ * Depth-first search for a set of coins that covers the target
+ * with less than the change limit left over.
+ * The search walks the coins largest-first, trying each one with and
+ * then without, and cuts off any branch that has already overshot
+ * or can no longer reach the target.
+ * @return false if no such set turned up.
+ */
+static bool
+coinSearch(CoinSelection &result, const std::vector<Coin> &coins,
+           const CoinSelectParams &params)
+{
+    // Bounds on the effective total, which already has the input fees out:
+    const uint64_t lower = params.target + params.fee(0);
+    const uint64_t upper = lower + params.changeLimit;
+
+    uint64_t remaining = 0;
+    for (const auto &coin: coins)
+        remaining += coin.effective;
+    if (remaining < lower)
+        return false;
+
+    std::vector<bool> picked(coins.size(), false);
+    size_t depth = 0;
+    size_t count = 0;
+    uint64_t sum = 0;
+    uint64_t sumValue = 0;
+
+    bool found = false;
+    uint64_t bestWaste = 0;
+    std::vector<bool> best;
+
+    for (size_t tries = 0; tries < searchTries; ++tries)
+    {
+        bool back = false;
+        if (sum + remaining < lower || upper <= sum || params.maxInputs < count)
+        {
+            back = true;
+        }
+        else if (lower <= sum)
+        {
+            // The real fee rounds, so check it exactly:
+            const auto fee = params.fee(count);
+            if (params.target + fee <= sumValue &&
+                    sumValue - params.target - fee < params.changeLimit)
+            {
+                const auto waste = sumValue - params.target - fee;
+                if (!found || waste < bestWaste)
+                {
+                    found = true;
+                    bestWaste = waste;
+                    best = picked;
+                }
+                if (!waste)
+                    break;
+            }
+            back = true;
+        }
+
+        if (back)
+        {
+            // Rewind to the last coin we put in, and try leaving it out:
+            while (depth && !picked[depth - 1])
+            {
+                --depth;
+                remaining += coins[depth].effective;
+            }
+            if (!depth)
+                break;
+            picked[depth - 1] = false;
+            sum -= coins[depth - 1].effective;
+            sumValue -= coins[depth - 1].value;
+            --count;
+        }
+        else
+        {
+            remaining -= coins[depth].effective;
+            picked[depth] = true;
+            sum += coins[depth].effective;
+            sumValue += coins[depth].value;
+            ++count;
+            ++depth;
+        }
+    }
+    if (!found)
+        return false;
+
+    result.inputs.clear();
+    uint64_t total = 0;
+    for (size_t i = 0; i < coins.size(); ++i)
+    {
+        if (best[i])
+        {
+            result.inputs.push_back(coins[i].index);
+            total += coins[i].value;
+        }
+    }
+    result.fee = params.fee(result.inputs.size());
+    result.change = total - params.target - result.fee;
+    return true;
+}
+
+Status
+coinSelect(CoinSelection &result, const std::vector<uint64_t> &values,
+           const CoinSelectParams &params)
+{
+    const auto coins = coinsSorted(values, params.inputCost);
+
+    if (coinSearch(result, coins, params))
+        return Status();
+
+    // Take the biggest coins until they cover the target:
+    size_t count = 0;
+    uint64_t total = 0;
+    while (count < coins.size() && total < params.target + params.fee(count))
+        total += coins[count++].value;
+    const auto fee = params.fee(count);
+    if (!count || total < params.target + fee)
+        return ABC_ERROR(ABC_CC_InsufficientFunds, "Insufficient funds");
+    if (params.maxInputs < count)
+        return ABC_ERROR(ABC_CC_InsufficientFunds, "Too many inputs");
+
+    // Swap the last one for the smallest coin that still does the job:
+    const uint64_t rest = total - coins[count - 1].value;
+    const uint64_t need = params.target + fee - rest;
+    size_t last = count - 1;
+    for (size_t i = coins.size() - 1; last < i; --i)
+    {
+        if (need <= coins[i].value)
+        {
+            last = i;
+            break;
+        }
+    }
+
+    result.inputs.clear();
+    for (size_t i = 0; i + 1 < count; ++i)
+        result.inputs.push_back(coins[i].index);
+    result.inputs.push_back(coins[last].index);
+    result.fee = fee;
+    result.change = rest + coins[last].value - params.target - fee;
+    return Status();
+}
+
+Status
+coinSelectMaximum(CoinSelection &result, const std::vector<uint64_t> &values,
+                  const CoinSelectParams &params)
+{
+    const auto coins = coinsSorted(values, params.inputCost);
+    const auto count = std::min(coins.size(), params.maxInputs);
+
+    uint64_t total = 0;
+    result.inputs.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        result.inputs.push_back(coins[i].index);
+        total += coins[i].value;
+    }
+
+    result.fee = params.fee(count);
+    if (!count || total < result.fee)
+        return ABC_ERROR(ABC_CC_InsufficientFunds, "Insufficient funds");
+    result.change = total - result.fee;
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Picks which unspent outputs fund a transaction.
+ */
+
+#ifndef ABCD_BITCOIN_SPEND_COIN_SELECT_HPP
+#define ABCD_BITCOIN_SPEND_COIN_SELECT_HPP
+
+#include "../../util/Status.hpp"
+#include <functional>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * Everything the selector needs to know about the transaction
+ * besides the values of the coins themselves.
+ */
+struct CoinSelectParams
+{
+    /** The total going to the outputs, before fees. */
+    uint64_t target;
+    /** The exact miner fee for a transaction with this many inputs. */
+    std::function<uint64_t (size_t inputs)> fee;
+    /** The fee each extra input adds, used for effective values. */
+    uint64_t inputCost;
+    /** Leftovers below this amount are dropped rather than sent as change. */
+    uint64_t changeLimit;
+    /** The most inputs a transaction can have. */
+    size_t maxInputs;
+};
+
+/**
+ * The selector's answer.
+ */
+struct CoinSelection
+{
+    /** Indices into the list of coin values, largest coin first. */
+    std::vector<size_t> inputs;
+    uint64_t fee;
+    uint64_t change;
+};
+
+/**
+ * Chooses coins to cover a target plus fees in a single pass.
+ * Coins are ranked by their effective value, meaning their value
+ * minus what it costs to spend them, and coins worth less than that
+ * are never used.
+ * A branch-and-bound search looks for a set that lands close enough
+ * to the target to need no change output.
+ * Failing that, coins go in largest-first, and the last one is swapped
+ * for the smallest coin that still covers the remainder.
+ */
+Status
+coinSelect(CoinSelection &result, const std::vector<uint64_t> &values,
+           const CoinSelectParams &params);
+
+/**
+ * Chooses every coin worth spending, largest first,
+ * up to the input limit, for sending an entire balance.
+ * Only the fee and input limit parts of the parameters are used,
+ * and the change field holds the usable total after fees.
+ */
+Status
+coinSelectMaximum(CoinSelection &result, const std::vector<uint64_t> &values,
+                  const CoinSelectParams &params);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Consolidate.hpp"
+#include "Broadcast.hpp"
+#include "Inputs.hpp"
+#include "Outputs.hpp"
+#include "../cache/Cache.hpp"
+#include "../../Context.hpp"
+#include "../../General.hpp"
+#include "../../exchange/ExchangeCache.hpp"
+#include "../../util/Debug.hpp"
+#include "../../wallet/Wallet.hpp"
+#include <algorithm>
+
+namespace abcd {
+
+// Inputs per transaction, safely under the limit in `Inputs.cpp`:
+constexpr size_t consolidateBatch = 200;
+
+/**
+ * Signs, sends, and saves one consolidation transaction.
+ */
+static Status
+consolidateSend(std::string &txid, Wallet &wallet, bc::transaction_type &tx)
+{
+    AddressSet addresses;
+    ABC_CHECK(inputsAddresses(addresses, tx, wallet.cache.txs));
+    KeyTable keys = wallet.addresses.keyTable(addresses);
+    ABC_CHECK(signTx(tx, wallet.cache.txs, keys));
+
+    bc::data_chunk rawTx(satoshi_raw_size(tx));
+    bc::satoshi_save(tx, rawTx.begin());
+    ABC_CHECK(broadcastTx(wallet, rawTx));
+
+    // Calculate transaction information:
+    TxInfo info;
+    ABC_CHECK(wallet.cache.txs.info(info, tx));
+    const auto balance = wallet.addresses.balance(info);
+
+    // Update the transaction cache:
+    wallet.cache.txs.insert(tx, info.txid);
+    wallet.cache.addresses.updateSpend(info);
+    wallet.cache.save().log(); // Failure is fine
+
+    // Save the transaction metadata:
+    TxMeta meta;
+    meta.ntxid = info.ntxid;
+    meta.txid = info.txid;
+    meta.timeCreation = time(nullptr);
+    meta.internal = true;
+    meta.airbitzFeeWanted = 0;
+    meta.airbitzFeeSent = 0;
+    meta.metadata.notes = "Combined " + std::to_string(tx.inputs.size()) +
+                          " small outputs";
+    gContext->exchangeCache.satoshiToCurrency(
+        meta.metadata.amountCurrency, balance,
+        static_cast<Currency>(wallet.currency())).log();
+    ABC_CHECK(wallet.txs.save(meta, balance, info.fee));
+
+    txid = info.txid;
+    return Status();
+}
+
+Status
+consolidateUtxos(std::vector<std::string> &txids, Wallet &wallet,
+                 const ConsolidateOptions &options)
+{
+    txids.clear();
+
+    // Only bother when the network is quiet:
+    const auto feeInfo = generalBitcoinFeeInfo();
+    const auto rate = feeInfo.confirmFees[feeInfo.lowFeeBlock];
+    if (options.maxFeeRate < rate)
+    {
+        ABC_DebugLog("Consolidate: fee rate %.0f is above %.0f, skipping",
+                     rate, options.maxFeeRate);
+        return Status();
+    }
+
+    // Gather the small confirmed outputs, smallest first:
+    const auto utxos = wallet.cache.txs.utxos(*wallet.addresses.snapshot());
+    bc::output_info_list small;
+    for (const auto &utxo: filterOutputs(utxos, true))
+        if (utxo.value < options.smallSatoshi)
+            small.push_back(utxo);
+    std::sort(small.begin(), small.end(),
+              [](const bc::output_info_type &a, const bc::output_info_type &b)
+    {
+        return a.value < b.value;
+    });
+
+    uint64_t feeTotal = 0;
+    size_t remaining = small.size();
+    auto next = small.begin();
+    while (options.targetCount < remaining && 1 < small.end() - next)
+    {
+        const auto count = std::min<size_t>(consolidateBatch,
+                                            small.end() - next);
+        bc::output_info_list batch(next, next + count);
+        next += count;
+        remaining -= count;
+
+        // Send the batch back to ourselves:
+        bc::transaction_type tx;
+        tx.version = 1;
+        tx.locktime = 0;
+        AddressMeta address;
+        ABC_CHECK(wallet.addresses.getNew(address));
+        bc::transaction_output_type output;
+        ABC_CHECK(outputScriptForAddress(output.script, address.address));
+        tx.outputs.push_back(output);
+
+        uint64_t fee, funds;
+        if (!inputsPickAll(fee, funds, tx, batch, rate) || outputIsDust(funds))
+            continue;
+        if (1 == tx.inputs.size())
+            continue;
+        if (options.feeBudget < feeTotal + fee)
+            break;
+        tx.outputs[0].value = funds;
+
+        std::string txid;
+        ABC_CHECK(consolidateSend(txid, wallet, tx));
+        feeTotal += fee;
+        txids.push_back(txid);
+
+        ABC_DebugLog("Consolidate: %d outputs into %s, fee %d",
+                     tx.inputs.size(), txid.c_str(), fee);
+    }
+
+    return Status();
+}
+
+} // namespace abcd
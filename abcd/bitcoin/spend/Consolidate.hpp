@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Merges a wallet's small unspent outputs into larger ones.
+ */
+
+#ifndef ABCD_BITCOIN_SPEND_CONSOLIDATE_HPP
+#define ABCD_BITCOIN_SPEND_CONSOLIDATE_HPP
+
+#include "../../util/Status.hpp"
+#include <vector>
+
+namespace abcd {
+
+class Wallet;
+
+/**
+ * Limits on how much consolidation to do in one run.
+ */
+struct ConsolidateOptions
+{
+    /** Outputs below this value are candidates for merging. */
+    uint64_t smallSatoshi;
+    /** Stop once no more than this many small outputs remain. */
+    size_t targetCount;
+    /** Do nothing unless the low-priority fee rate, in satoshis per KB,
+     * is at or below this. */
+    double maxFeeRate;
+    /** The most to spend on fees across all the transactions. */
+    uint64_t feeBudget;
+};
+
+/**
+ * Sweeps the wallet's small confirmed outputs back into the wallet,
+ * a batch at a time, while the low-priority fee rate is cheap enough.
+ * Does nothing if fees are too high, so callers can simply run this
+ * on a timer.
+ * @param txids receives the ids of the transactions sent, if any.
+ */
+Status
+consolidateUtxos(std::vector<std::string> &txids, Wallet &wallet,
+                 const ConsolidateOptions &options);
+
+} // namespace abcd
+
+#endif
@@ -6,67 +6,199 @@
  */
 
 #include "Inputs.hpp"
+#include "CoinSelect.hpp"
 #include "Outputs.hpp"
 #include "../Utility.hpp"
 #include "../cache/TxCache.hpp"
 #include "../../General.hpp"
+#include "../../util/Parallel.hpp"
 #include "../../wallet/Wallet.hpp"
 #include <unistd.h>
+#include <cmath>
 #include <bitcoin/bitcoin.hpp>
 
 namespace abcd {
 
 static std::map<bc::data_chunk, std::string> address_map;
 
+/**
+ * Looks up the output script and address for an input's utxo.
+ */
+static Status
+inputUtxo(bc::script_type &script, std::string &address,
+          const bc::transaction_input_type &input, const TxCache &txCache)
+{
+    // Find the utxo this input refers to:
+    const bc::input_point &point = input.previous_output;
+    bc::transaction_type tx;
+    ABC_CHECK(txCache.get(tx, bc::encode_hash(point.hash)));
+    if (tx.outputs.size() <= point.index)
+        return ABC_ERROR(ABC_CC_Error, "Invalid utxo");
+
+    // Find the address for that utxo:
+    bc::payment_address pa;
+    script = tx.outputs[point.index].script;
+    bc::extract(pa, script);
+    if (bc::payment_address::invalid_version == pa.version())
+        return ABC_ERROR(ABC_CC_Error, "Invalid address");
+
+    address = pa.encoded();
+    return Status();
+}
+
+Status
+inputsAddresses(AddressSet &result, const bc::transaction_type &tx,
+                const TxCache &txCache)
+{
+    AddressSet out;
+    for (const auto &input: tx.inputs)
+    {
+        bc::script_type script;
+        std::string address;
+        ABC_CHECK(inputUtxo(script, address, input, txCache));
+        out.insert(address);
+    }
+
+    result = std::move(out);
+    return Status();
+}
+
+/**
+ * Builds the SIGHASH_ALL hash for each input of a transaction.
+ * Every one of these hashes covers the same bytes, apart from
+ * the one input script, so we serialize the transaction once
+ * with blank scripts and splice each script in,
+ * rather than copying and re-serializing the transaction per input.
+ */
+class SighashCache
+{
+public:
+    explicit SighashCache(const bc::transaction_type &tx)
+    {
+        auto blank = tx;
+        for (auto &input: blank.inputs)
+            input.script = bc::script_type();
+        blank_.resize(satoshi_raw_size(blank));
+        bc::satoshi_save(blank, blank_.begin());
+
+        // The version, then the input count:
+        const auto count = tx.inputs.size();
+        inputsStart_ = 4 + (count < 0xfd ? 1 : count <= 0xffff ? 3 : 5);
+    }
+
+    bc::hash_digest
+    hash(size_t index, const bc::script_type &script) const
+    {
+        // Each blank input is a 36-byte outpoint, a zero script length,
+        // and a 4-byte sequence number:
+        const auto at = blank_.begin() + inputsStart_ + 41 * index + 36;
+        const auto raw = save_script(script);
+
+        DataChunk data;
+        data.reserve(blank_.size() + raw.size() + 13);
+        data.insert(data.end(), blank_.begin(), at);
+        varintAppend(data, raw.size());
+        data.insert(data.end(), raw.begin(), raw.end());
+        data.insert(data.end(), at + 1, blank_.end());
+        const uint32_t hashType = bc::sighash::all;
+        for (size_t i = 0; i < 4; ++i)
+            data.push_back(hashType >> (8 * i));
+        return bc::bitcoin_hash(data);
+    }
+
+private:
+    DataChunk blank_;
+    size_t inputsStart_;
+
+    static void
+    varintAppend(DataChunk &data, uint64_t value)
+    {
+        size_t size = 1;
+        if (value < 0xfd)
+        {
+            data.push_back(value);
+            return;
+        }
+        else if (value <= 0xffff)
+        {
+            data.push_back(0xfd);
+            size = 2;
+        }
+        else
+        {
+            data.push_back(0xfe);
+            size = 4;
+        }
+        for (size_t i = 0; i < size; ++i)
+            data.push_back(value >> (8 * i));
+    }
+};
+
 Status
 signTx(bc::transaction_type &result, const TxCache &txCache,
        const KeyTable &keys)
 {
-    for (size_t i = 0; i < result.inputs.size(); ++i)
+    // Find the utxo script and elliptic curve key for each input:
+    const auto count = result.inputs.size();
+    std::vector<bc::script_type> scripts(count);
+    std::vector<const std::string *> wifs(count);
+    for (size_t i = 0; i < count; ++i)
     {
-        // Find the utxo this input refers to:
-        bc::input_point &point = result.inputs[i].previous_output;
-        bc::transaction_type tx;
-        ABC_CHECK(txCache.get(tx, bc::encode_hash(point.hash)));
-
-        // Find the address for that utxo:
-        bc::payment_address pa;
-        bc::script_type &script = tx.outputs[point.index].script;
-        bc::extract(pa, script);
-        if (bc::payment_address::invalid_version == pa.version())
-            return ABC_ERROR(ABC_CC_Error, "Invalid address");
-
-        // Find the elliptic curve key for this input:
-        auto key = keys.find(pa.encoded());
+        std::string address;
+        ABC_CHECK(inputUtxo(scripts[i], address, result.inputs[i], txCache));
+
+        auto key = keys.find(address);
         if (key == keys.end())
             return ABC_ERROR(ABC_CC_Error, "Missing signing key");
-        bc::ec_secret secret = bc::wif_to_secret(key->second);
-        bc::ec_point pubkey = bc::secret_to_public_key(secret,
-                              bc::is_wif_compressed(key->second));
-
-        // Generate the signature for this input:
-        auto sig_hash = bc::script_type::generate_signature_hash(
-                            result, i, script, bc::sighash::all);
-        if (sig_hash == bc::null_hash)
-            return ABC_ERROR(ABC_CC_Error, "Unable to sign");
-        bc::data_chunk signature = bc::sign(secret, sig_hash,
-                                            bc::create_nonce(secret, sig_hash));
-        signature.push_back(0x01);
-
-        // Create out scriptsig:
-        bc::script_type scriptsig;
-        scriptsig.push_operation(makePushOperation(signature));
-        scriptsig.push_operation(makePushOperation(pubkey));
-        result.inputs[i].script = scriptsig;
+        wifs[i] = &key->second;
     }
 
+    // The signatures are independent, so spread them over the cores.
+    // Each one hashes the unsigned transaction,
+    // so the new scripts only go in once they are all done:
+    const SighashCache sighashes(result);
+    std::vector<bc::script_type> scriptsigs(count);
+    auto work = [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            const auto &wif = *wifs[i];
+            bc::ec_secret secret = bc::wif_to_secret(wif);
+            bc::ec_point pubkey = bc::secret_to_public_key(secret,
+                                  bc::is_wif_compressed(wif));
+
+            // Generate the signature for this input:
+            auto sig_hash = sighashes.hash(i, scripts[i]);
+            bc::data_chunk signature = bc::sign(secret, sig_hash,
+                                                bc::create_nonce(secret, sig_hash));
+            signature.push_back(0x01);
+
+            // Create out scriptsig:
+            scriptsigs[i].push_operation(makePushOperation(signature));
+            scriptsigs[i].push_operation(makePushOperation(pubkey));
+        }
+    };
+    parallelFor(count, work, 4);
+
+    for (size_t i = 0; i < count; ++i)
+        result.inputs[i].script = scriptsigs[i];
+
     return Status();
 }
 
-static uint64_t
-minerFee(const bc::transaction_type &tx, uint64_t amountSatoshi,
-         const BitcoinFeeInfo &feeInfo,
-         tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi)
+// Each unsigned input is 41 bytes, and signing adds a 72-byte signature
+// plus a 32-byte pubkey:
+constexpr size_t inputSize = 41 + 104;
+
+// The most inputs we will put in one transaction:
+constexpr size_t inputsMax = 247;
+
+/**
+ * Picks the satoshi-per-KB rate for a fee level.
+ */
+static double
+minerRate(uint64_t amountSatoshi, const BitcoinFeeInfo &feeInfo,
+          tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi)
 {
     double rate;
 
@@ -95,11 +227,12 @@ minerFee(const bc::transaction_type &tx, uint64_t amountSatoshi,
         break;
     }
 
-    // Signature scripts have a 72-byte signature plus a 32-byte pubkey:
-    size_t size = satoshi_raw_size(tx);
-    size += (104 * tx.inputs.size());
-    size += 35; // For one extra output for change.
+    return rate;
+}
 
+static uint64_t
+minerFee(size_t size, double rate)
+{
     // Scale the rate by the size of the transaction:
     auto out = static_cast<uint64_t>(size * (rate / 1000));
 
@@ -113,41 +246,62 @@ minerFee(const bc::transaction_type &tx, uint64_t amountSatoshi,
     return out;
 }
 
+/**
+ * Sets up the coin selector to price inputs for the given transaction,
+ * which must not have any inputs yet.
+ */
+static CoinSelectParams
+inputsParams(const bc::transaction_type &tx, uint64_t target, double rate)
+{
+    // Leave room for one extra output for change:
+    const size_t size = satoshi_raw_size(tx) + 35;
+    auto fee = [size, rate](size_t inputs)
+    {
+        return minerFee(size + inputSize * inputs, rate);
+    };
+
+    return CoinSelectParams
+    {
+        target, fee, static_cast<uint64_t>(std::ceil(inputSize * rate / 1000)),
+        MINIMUM_DUST_THRESHOLD, inputsMax
+    };
+}
+
+static void
+inputsSet(bc::transaction_type &tx, const bc::output_info_list &utxos,
+          const CoinSelection &chosen)
+{
+    tx.inputs.clear();
+    for (auto i: chosen.inputs)
+    {
+        bc::transaction_input_type input;
+        input.sequence = 0xffffffff;
+        input.previous_output = utxos[i].point;
+        tx.inputs.push_back(input);
+    }
+}
+
 Status
 inputsPickOptimal(uint64_t &resultFee, uint64_t &resultChange,
                   bc::transaction_type &tx, const bc::output_info_list &utxos,
+                  const BitcoinFeeInfo &feeInfo,
                   tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi)
 {
-    auto totalOut = outputsTotal(tx.outputs);
+    const auto totalOut = outputsTotal(tx.outputs);
+    const auto rate = minerRate(totalOut, feeInfo, feeLevel, customFeeSatoshi);
 
-    const auto feeInfo = generalBitcoinFeeInfo();
-    uint64_t sourced = 0;
-    uint64_t fee = 0;
-    do
-    {
-        // Select a collection of outputs that satisfies our requirements:
-        auto chosen = select_outputs(utxos, totalOut + fee);
-        if (!chosen.points.size())
-            return ABC_ERROR(ABC_CC_InsufficientFunds, "Insufficient funds");
-        if (248 <= chosen.points.size())
-            return ABC_ERROR(ABC_CC_InsufficientFunds, "Too many inputs");
-        sourced = totalOut + fee + chosen.change;
-
-        // Calculate the fees for this input combination:
-        tx.inputs.clear();
-        for (auto &point: chosen.points)
-        {
-            bc::transaction_input_type input;
-            input.sequence = 0xffffffff;
-            input.previous_output = point;
-            tx.inputs.push_back(input);
-        }
-        fee = minerFee(tx, totalOut, feeInfo, feeLevel, customFeeSatoshi);
-    }
-    while (sourced < totalOut + fee);
+    std::vector<uint64_t> values;
+    values.reserve(utxos.size());
+    for (const auto &utxo: utxos)
+        values.push_back(utxo.value);
 
-    resultFee = fee;
-    resultChange = sourced - (totalOut + fee);
+    tx.inputs.clear();
+    CoinSelection chosen;
+    ABC_CHECK(coinSelect(chosen, values, inputsParams(tx, totalOut, rate)));
+    inputsSet(tx, utxos, chosen);
+
+    resultFee = chosen.fee;
+    resultChange = chosen.change;
     return Status();
 }
 
@@ -155,30 +309,71 @@ Status
 inputsPickMaximum(uint64_t &resultFee, uint64_t &resultUsable,
                   bc::transaction_type &tx, const bc::output_info_list &utxos)
 {
-    // Calculate the fees for this input combination:
-    tx.inputs.clear();
-    uint64_t sourced = 0;
-    for (auto &utxo: utxos)
+    uint64_t totalIn = 0;
+    for (const auto &utxo: utxos)
+        totalIn += utxo.value;
+    const auto rate = minerRate(totalIn, generalBitcoinFeeInfo(),
+                                ABC_SpendFeeLevelStandard, 0);
+
+    ABC_CHECK(inputsPickAll(resultFee, resultUsable, tx, utxos, rate));
+    return Status();
+}
+
+Status
+inputsPickBump(uint64_t &resultFee, uint64_t &resultUsable,
+               bc::transaction_type &tx, const bc::output_info_list &utxos,
+               size_t parentSize, uint64_t parentFee,
+               const BitcoinFeeInfo &feeInfo,
+               tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi)
+{
+    if (inputsMax < utxos.size())
+        return ABC_ERROR(ABC_CC_Error, "Too many outputs to spend at once");
+
+    uint64_t totalIn = 0;
+    CoinSelection chosen;
+    for (size_t i = 0; i < utxos.size(); ++i)
     {
-        bc::transaction_input_type input;
-        input.sequence = 0xffffffff;
-        input.previous_output = utxo.point;
-        tx.inputs.push_back(input);
-        sourced += utxo.value;
+        totalIn += utxos[i].value;
+        chosen.inputs.push_back(i);
     }
-    const auto feeInfo = generalBitcoinFeeInfo();
-    uint64_t fee = minerFee(tx, sourced, feeInfo, ABC_SpendFeeLevelStandard, 0);
+    const auto rate = minerRate(totalIn, feeInfo, feeLevel, customFeeSatoshi);
 
-    // Verify that we have enough:
-    uint64_t totalIn = 0;
-    for (auto &utxo: utxos)
-        totalIn += utxo.value;
-    if (totalIn < fee)
-        return ABC_ERROR(ABC_CC_InsufficientFunds, "Insufficient funds");
+    // The parent and child confirm as a package,
+    // so the child makes up whatever the parent is missing:
+    tx.inputs.clear();
+    const size_t size = satoshi_raw_size(tx) + inputSize * utxos.size();
+    if (minerFee(parentSize, rate) <= parentFee)
+        return ABC_ERROR(ABC_CC_Error, "The transaction already pays this fee");
+    const auto packageFee = minerFee(parentSize + size, rate);
+    const auto fee = std::max(packageFee - parentFee, minerFee(size, rate));
+    if (totalIn < fee + MINIMUM_DUST_THRESHOLD)
+        return ABC_ERROR(ABC_CC_InsufficientFunds,
+                         "Not enough funds to raise the fee");
+    inputsSet(tx, utxos, chosen);
 
     resultFee = fee;
     resultUsable = totalIn - fee;
     return Status();
 }
 
+Status
+inputsPickAll(uint64_t &resultFee, uint64_t &resultUsable,
+              bc::transaction_type &tx, const bc::output_info_list &utxos,
+              double rate)
+{
+    std::vector<uint64_t> values;
+    values.reserve(utxos.size());
+    for (const auto &utxo: utxos)
+        values.push_back(utxo.value);
+
+    tx.inputs.clear();
+    CoinSelection chosen;
+    ABC_CHECK(coinSelectMaximum(chosen, values, inputsParams(tx, 0, rate)));
+    inputsSet(tx, utxos, chosen);
+
+    resultFee = chosen.fee;
+    resultUsable = chosen.change;
+    return Status();
+}
+
 } // namespace abcd
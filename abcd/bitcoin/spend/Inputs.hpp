@@ -8,6 +8,7 @@
 #ifndef ABCD_BITCOIN_INPUTS_HPP
 #define ABCD_BITCOIN_INPUTS_HPP
 
+#include "../Typedefs.hpp"
 #include "../../util/Status.hpp"
 #include <bitcoin/bitcoin.hpp>
 #include <map>
@@ -15,6 +16,7 @@
 
 namespace abcd {
 
+struct BitcoinFeeInfo;
 class TxCache;
 
 /**
@@ -22,6 +24,13 @@ class TxCache;
  */
 typedef std::map<const std::string, std::string> KeyTable;
 
+/**
+ * Finds the addresses that the transaction's inputs spend from.
+ */
+Status
+inputsAddresses(AddressSet &result, const bc::transaction_type &tx,
+                const TxCache &txCache);
+
 /**
  * Fills the transaction's inputs with signatures.
  */
@@ -36,6 +45,7 @@ signTx(bc::transaction_type &result, const TxCache &txCache,
 Status
 inputsPickOptimal(uint64_t &resultFee, uint64_t &resultChange,
                   bc::transaction_type &tx, const bc::output_info_list &utxos,
+                  const BitcoinFeeInfo &feeInfo,
                   tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi);
 
 /**
@@ -46,6 +56,27 @@ Status
 inputsPickMaximum(uint64_t &resultFee, uint64_t &resultUsable,
                   bc::transaction_type &tx, const bc::output_info_list &utxos);
 
+/**
+ * Populate the transaction's input list with every utxo worth spending
+ * at a fixed satoshi-per-KB fee rate, and calculate the mining fee.
+ */
+Status
+inputsPickAll(uint64_t &resultFee, uint64_t &resultUsable,
+              bc::transaction_type &tx, const bc::output_info_list &utxos,
+              double rate);
+
+/**
+ * Populate the transaction's input list with all the given utxos,
+ * which come from an unconfirmed parent, and calculate a mining fee
+ * that brings the parent and child together up to the fee level.
+ */
+Status
+inputsPickBump(uint64_t &resultFee, uint64_t &resultUsable,
+               bc::transaction_type &tx, const bc::output_info_list &utxos,
+               size_t parentSize, uint64_t parentFee,
+               const BitcoinFeeInfo &feeInfo,
+               tABC_SpendFeeLevel feeLevel, uint64_t customFeeSatoshi);
+
 } // namespace abcd
 
 #endif
@@ -11,8 +11,6 @@
 #include "../../General.hpp"
 #include <iterator>
 
-#define MINIMUM_DUST_THRESHOLD 4000 // was 546
-
 namespace abcd {
 
 static bool
@@ -11,6 +11,8 @@
 #include "../../util/Status.hpp"
 #include <bitcoin/bitcoin.hpp>
 
+#define MINIMUM_DUST_THRESHOLD 4000 // was 546
+
 namespace abcd {
 
 /**
@@ -8,11 +8,19 @@
 #include "PaymentProto.hpp"
 #include "../Testnet.hpp"
 #include "../../Context.hpp"
+#include "../../General.hpp"
+#include "../../http/Http.hpp"
 #include "../../http/HttpRequest.hpp"
 #include "../../http/Uri.hpp"
 #include "../../util/AutoFree.hpp"
+#include "../../util/Debug.hpp"
+#include <future>
+#include <map>
+#include <mutex>
 #include <regex>
+#include <thread>
 
+#include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <openssl/x509_vfy.h>
 #include <time.h>
@@ -29,6 +37,33 @@ const char *BIP71_MIMETYPE_PAYMENTACK = "application/bitcoin-paymentack";
 const char *BIP71_MIMETYPE_PAYMENTREQUEST =
     "application/bitcoin-paymentrequest";
 
+constexpr time_t prefetchLifetime = 60; // Seconds before a prefetch goes stale
+constexpr size_t prefetchMax = 8;
+constexpr time_t chainLifetime = 60 * 60; // Seconds to trust a verified chain
+
+/**
+ * A payment request download running in the background.
+ */
+struct Prefetch
+{
+    time_t started;
+    std::shared_future<std::pair<Status, std::string>> body;
+};
+
+static std::mutex gPrefetchMutex;
+static std::map<std::string, Prefetch> gPrefetches; // By URL
+
+/**
+ * The certificate chains that have already passed.
+ */
+struct TrustCache
+{
+    std::mutex mutex;
+    std::map<std::string, std::pair<time_t, std::string>> chains;
+};
+
+static TrustCache gTrust;
+
 class AutoX509:
     public std::vector<X509 *>
 {
@@ -41,7 +76,7 @@ public:
 };
 
 static bool
-loadCerts(payments::X509Certificates certChain, AutoX509 &certs)
+loadCerts(const payments::X509Certificates &certChain, AutoX509 &certs)
 {
     for (int i = 0; i < certChain.certificate_size(); i++)
     {
@@ -54,13 +89,20 @@ loadCerts(payments::X509Certificates certChain, AutoX509 &certs)
     return certs.size() > 0;
 }
 
+/**
+ * Checks the request signature against the signing certificate.
+ * The signature covers the request with an empty signature field,
+ * so this blanks the field while serializing, rather than copying
+ * the whole request and its certificate chain.
+ */
 static bool
-isValidSignature(X509 *cert, const EVP_MD *alg, payments::PaymentRequest req)
+isValidSignature(X509 *cert, const EVP_MD *alg, payments::PaymentRequest &req)
 {
-    payments::PaymentRequest rcopy(req);
-    rcopy.set_signature(std::string(""));
+    std::string signature;
+    req.mutable_signature()->swap(signature);
     std::string data;
-    rcopy.SerializeToString(&data);
+    req.SerializeToString(&data);
+    req.mutable_signature()->swap(signature);
 
     EVP_MD_CTX ctx;
     EVP_PKEY *pubkey = X509_get_pubkey(cert);
@@ -70,14 +112,14 @@ isValidSignature(X509 *cert, const EVP_MD *alg, payments::PaymentRequest req)
     if (!EVP_VerifyUpdate(&ctx, data.data(), data.size()))
         return false;
     if (!EVP_VerifyFinal(&ctx,
-                         (const unsigned char *) req.signature().data(),
-                         (unsigned int) req.signature().size(), pubkey))
+                         (const unsigned char *) signature.data(),
+                         (unsigned int) signature.size(), pubkey))
         return false;
     return true;
 }
 
-Status
-PaymentRequest::fetch(const std::string &url)
+static Status
+fetchBody(std::string &result, const std::string &url)
 {
     HttpReply reply;
 
@@ -87,15 +129,106 @@ PaymentRequest::fetch(const std::string &url)
               .get(reply, url));
     ABC_CHECK(reply.codeOk());
 
-    if (!request_.ParseFromString(reply.body))
+    result = reply.body;
+    return Status();
+}
+
+/**
+ * Claims the prefetched download for a URL, if there is a fresh one.
+ */
+static bool
+prefetchTake(std::shared_future<std::pair<Status, std::string>> &result,
+             const std::string &url)
+{
+    std::lock_guard<std::mutex> lock(gPrefetchMutex);
+    auto i = gPrefetches.find(url);
+    if (gPrefetches.end() == i)
+        return false;
+
+    const bool fresh = time(nullptr) < i->second.started + prefetchLifetime;
+    result = i->second.body;
+    gPrefetches.erase(i);
+    return fresh;
+}
+
+void
+paymentRequestPrefetch(const std::string &url)
+{
+    std::promise<std::pair<Status, std::string>> promise;
+    {
+        std::lock_guard<std::mutex> lock(gPrefetchMutex);
+
+        // Drop anything stale, and make room for this one:
+        const auto now = time(nullptr);
+        for (auto i = gPrefetches.begin(); i != gPrefetches.end();)
+        {
+            if (i->second.started + prefetchLifetime <= now)
+                i = gPrefetches.erase(i);
+            else
+                ++i;
+        }
+        if (gPrefetches.count(url) || prefetchMax <= gPrefetches.size())
+            return;
+
+        gPrefetches[url] = Prefetch{now, promise.get_future().share()};
+    }
+
+    auto thread = [url](std::promise<std::pair<Status, std::string>> promise)
+    {
+        std::string body;
+        const auto status = fetchBody(body, url);
+        promise.set_value(std::make_pair(status, body));
+        if (!status)
+            return;
+
+        // Get the slow checks out of the way while the user looks
+        // at the request, so the foreground calls hit warm caches:
+        PaymentRequest request;
+        std::string domain;
+        if (request.parse(body))
+            request.signatureOk(domain, url).log();
+        generalBitcoinFeeInfo();
+    };
+    std::thread(thread, std::move(promise)).detach();
+}
+
+PaymentRequest::PaymentRequest():
+    request_(google::protobuf::Arena::CreateMessage<payments::PaymentRequest>(
+                 &arena_)),
+    details_(google::protobuf::Arena::CreateMessage<payments::PaymentDetails>(
+                 &arena_))
+{}
+
+Status
+PaymentRequest::fetch(const std::string &url)
+{
+    std::string body;
+    std::shared_future<std::pair<Status, std::string>> prefetch;
+    if (prefetchTake(prefetch, url) && prefetch.get().first)
+    {
+        ABC_DebugLog("Using prefetched payment request for %s", url.c_str());
+        body = prefetch.get().second;
+    }
+    else
+    {
+        ABC_CHECK(fetchBody(body, url));
+    }
+
+    return parse(body);
+}
+
+Status
+PaymentRequest::parse(const std::string &body)
+{
+    if (!request_->ParseFromString(body))
         return ABC_ERROR(ABC_CC_Error, "Failed to parse PaymentRequest");
 
-    if (!details_.ParseFromString(request_.serialized_payment_details()))
+    if (!details_->ParseFromString(request_->serialized_payment_details()))
         return ABC_ERROR(ABC_CC_Error, "Failed to parse details");
 
     // Are we on the right network?
-    if ((isTestnet() && "test" != details_.network())
-            || (!isTestnet() && "main" != details_.network()))
+    if ((isTestnet() && "test" != details_->network())
+            || (!isTestnet() && "main" != details_->network()))
         return ABC_ERROR(ABC_CC_Error, "Unsupported network");
 
     return Status();
@@ -104,15 +237,15 @@ PaymentRequest::fetch(const std::string &url)
 bool
 PaymentRequest::signatureExists()
 {
-    return (request_.pki_type() == "x509+sha256")
-           || (request_.pki_type() == "x509+sha1");
+    return (request_->pki_type() == "x509+sha256")
+           || (request_->pki_type() == "x509+sha1");
 }
 
 Status
 PaymentRequest::signatureOk(std::string &result, const std::string &uri)
 {
     // If there is no signature, we don't need to do anything:
-    if (request_.pki_type() == "none")
+    if (request_->pki_type() == "none")
     {
         Uri parsed;
         if (!parsed.decode(uri) || !parsed.authorityOk())
@@ -123,21 +256,41 @@ PaymentRequest::signatureOk(std::string &result, const std::string &uri)
     }
 
     const EVP_MD *alg = NULL;
-    if (request_.pki_type() == "x509+sha256")
+    if (request_->pki_type() == "x509+sha256")
         alg = EVP_sha256();
-    else if (request_.pki_type() == "x509+sha1")
+    else if (request_->pki_type() == "x509+sha1")
         alg = EVP_sha1();
     else
         return ABC_ERROR(ABC_CC_Error, "Unknown pki_type");
 
-    payments::X509Certificates certChain;
-    if (!certChain.ParseFromString(request_.pki_data()))
+    auto &certChain =
+        *google::protobuf::Arena::CreateMessage<payments::X509Certificates>(
+            &arena_);
+    if (!certChain.ParseFromString(request_->pki_data()))
         return ABC_ERROR(ABC_CC_Error, "Error parsing pki_data");
 
     AutoX509 certs;
     if (!loadCerts(certChain, certs))
         return ABC_ERROR(ABC_CC_Error, "Error loading certs");
 
+    // Skip the chain verification if we have seen this exact chain pass:
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char *>(request_->pki_data().data()),
+           request_->pki_data().size(), digest);
+    const std::string fingerprint(reinterpret_cast<char *>(digest),
+                                  sizeof(digest));
+    {
+        std::lock_guard<std::mutex> lock(gTrust.mutex);
+        auto i = gTrust.chains.find(fingerprint);
+        if (gTrust.chains.end() != i && time(nullptr) < i->second.first)
+        {
+            if (!isValidSignature(certs[0], alg, *request_))
+                return ABC_ERROR(ABC_CC_Error, "Bad signature");
+            result = i->second.second;
+            return Status();
+        }
+    }
+
     // The first cert is the signing cert,
     // the rest are untrusted certs that chain
     // to a valid root authority. OpenSSL needs them separately.
@@ -152,21 +305,19 @@ PaymentRequest::signatureOk(std::string &result, const std::string &uri)
     if (!store_ctx.get())
         return ABC_ERROR(ABC_CC_Error, "Error creating X509_STORE_CTX");
 
-    AutoFree<SSL_CTX, SSL_CTX_free> sslContext(SSL_CTX_new(SSLv23_client_method()));
-    if (!SSL_CTX_load_verify_locations(sslContext.get(),
-                                       gContext->paths.certPath().c_str(),
-                                       nullptr))
-        return ABC_ERROR(ABC_CC_Error, "Unable to load caCerts");
+    // The CA bundle is the same one the HTTPS requests use:
+    X509_STORE *store;
+    ABC_CHECK(httpCertStore(store));
 
-    if (!X509_STORE_CTX_init(store_ctx.get(),
-                             SSL_CTX_get_cert_store(sslContext.get()), signing_cert, chain))
+    std::lock_guard<std::mutex> lock(gTrust.mutex);
+    if (!X509_STORE_CTX_init(store_ctx.get(), store, signing_cert, chain))
         return SSL_ERROR(ABC_CC_Error, store_ctx.get());
 
     if (1 != X509_verify_cert(store_ctx.get()))
-        return SSL_ERROR(ABC_CC_Error, store_ctx.get())
+        return SSL_ERROR(ABC_CC_Error, store_ctx.get());
 
-               if (!isValidSignature(signing_cert, alg, request_))
-                   return ABC_ERROR(ABC_CC_Error, "Bad signature");
+    if (!isValidSignature(signing_cert, alg, *request_))
+        return ABC_ERROR(ABC_CC_Error, "Bad signature");
 
     X509_NAME *certname = X509_get_subject_name(signing_cert);
     int textlen = X509_NAME_get_text_by_NID(certname, NID_commonName, NULL, 0);
@@ -176,6 +327,8 @@ PaymentRequest::signatureOk(std::string &result, const std::string &uri)
         return ABC_ERROR(ABC_CC_Error, "Missing common name");
 
     result = website.data();
+    gTrust.chains[fingerprint] =
+        std::make_pair(time(nullptr) + chainLifetime, result);
     return Status();
 }
 
@@ -183,7 +336,7 @@ std::list<PaymentOutput>
 PaymentRequest::outputs() const
 {
     std::list<PaymentOutput> out;
-    for (auto &i: details_.outputs())
+    for (auto &i: details_->outputs())
     {
         PaymentOutput o =
         {
@@ -195,11 +348,24 @@ PaymentRequest::outputs() const
     return out;
 }
 
+void
+PaymentRequest::outputsAppend(bc::transaction_output_list &result) const
+{
+    result.reserve(result.size() + details_->outputs_size());
+    for (auto &i: details_->outputs())
+    {
+        bc::transaction_output_type output;
+        output.value = i.amount();
+        output.script = bc::parse_script(DataSlice(i.script()));
+        result.push_back(std::move(output));
+    }
+}
+
 uint64_t
 PaymentRequest::amount() const
 {
     uint64_t out = 0;
-    for (auto &i: details_.outputs())
+    for (auto &i: details_->outputs())
         out += i.amount();
     return out;
 }
@@ -207,12 +373,13 @@ PaymentRequest::amount() const
 std::string
 PaymentRequest::merchant(const std::string &fallback) const
 {
-    if (!details_.has_memo())
+    if (!details_->has_memo())
         return fallback;
 
-    std::regex re("Payment request for BitPay invoice [^ ]* for merchant (.*)");
+    static const std::regex re(
+        "Payment request for BitPay invoice [^ ]* for merchant (.*)");
     std::smatch match;
-    if (!std::regex_match(details_.memo(), match, re))
+    if (!std::regex_match(details_->memo(), match, re))
         return fallback;
 
     return match[1];
@@ -221,20 +388,21 @@ PaymentRequest::merchant(const std::string &fallback) const
 bool
 PaymentRequest::memoOk() const
 {
-    return details_.has_memo();
+    return details_->has_memo();
 }
 
 std::string
 PaymentRequest::memo(const std::string &fallback) const
 {
-    return details_.has_memo() ? details_.memo() : fallback;
+    return details_->has_memo() ? details_->memo() : fallback;
 }
 
 Status
 PaymentRequest::pay(PaymentReceipt &result, DataSlice tx, DataSlice refund)
 {
-    payments::Payment payment;
-    payment.set_merchant_data(details_.merchant_data());
+    auto &payment =
+        *google::protobuf::Arena::CreateMessage<payments::Payment>(&arena_);
+    payment.set_merchant_data(details_->merchant_data());
     payment.add_transactions(tx.data(), tx.size());
 
     // Added refund address
@@ -246,17 +414,17 @@ PaymentRequest::pay(PaymentReceipt &result, DataSlice tx, DataSlice refund)
 
     // Check request expiration
     time_t now = time(NULL);
-    if (details_.has_expires() && (time_t)details_.expires() < now)
+    if (details_->has_expires() && (time_t)details_->expires() < now)
         return ABC_ERROR(ABC_CC_Error, "Payment request has expired");
 
     HttpReply reply;
-    if (details_.has_payment_url())
+    if (details_->has_payment_url())
     {
         ABC_CHECK(HttpRequest()
                   .header("Accept", BIP71_MIMETYPE_PAYMENTACK)
                   .header("Content-Type", BIP71_MIMETYPE_PAYMENT)
                   .header("User-Agent", USER_AGENT)
-                  .post(reply, details_.payment_url(), response));
+                  .post(reply, details_->payment_url(), response));
         ABC_CHECK(reply.codeOk());
 
         if (!result.ack.ParseFromString(reply.body))
@@ -12,6 +12,8 @@
 #include "../../util/Status.hpp"
 #include "../../../codegen/paymentrequest.pb.h"
 
+#include <bitcoin/bitcoin.hpp>
+#include <google/protobuf/arena.h>
 #include <list>
 
 namespace abcd {
@@ -27,18 +29,40 @@ struct PaymentReceipt
     payments::PaymentACK ack;
 };
 
+/**
+ * Starts downloading a payment request in the background,
+ * so a later `PaymentRequest::fetch` for the same URL can skip the wait.
+ * The background thread also verifies the signature and loads the fee table,
+ * warming those caches for the spend that usually follows.
+ */
+void
+paymentRequestPrefetch(const std::string &url);
+
 /**
  * Represents a request from the bip70 payment protocol.
+ * All the decoded messages live on one protobuf arena,
+ * which goes away in a single step along with the request.
  */
 class PaymentRequest
 {
 public:
+    PaymentRequest();
+    PaymentRequest(const PaymentRequest &) = delete;
+    PaymentRequest &operator=(const PaymentRequest &) = delete;
+
     /**
-     * Fetches the initial payment request from the server.
+     * Fetches the initial payment request from the server,
+     * or picks up the download `paymentRequestPrefetch` started.
      */
     Status
     fetch(const std::string &url);
 
+    /**
+     * Decodes a serialized payment request.
+     */
+    Status
+    parse(const std::string &body);
+
     /**
      * Returns true if the payment request is signed.
      */
@@ -59,6 +83,13 @@ public:
     std::list<PaymentOutput>
     outputs() const;
 
+    /**
+     * Appends the requested outputs straight onto a transaction's list,
+     * with no intermediate copies of the scripts.
+     */
+    void
+    outputsAppend(bc::transaction_output_list &result) const;
+
     /**
      * Obtain the total of all outputs.
      */
@@ -91,8 +122,9 @@ public:
     pay(PaymentReceipt &result, DataSlice tx, DataSlice refund);
 
 private:
-    payments::PaymentRequest request_;
-    payments::PaymentDetails details_;
+    google::protobuf::Arena arena_;
+    payments::PaymentRequest *request_;
+    payments::PaymentDetails *details_;
 };
 
 } // namespace abcd
@@ -97,9 +97,10 @@ Spend::calculateFees(uint64_t &totalFees, bool skipUnconfirmede)
 Status
 Spend::calculateMax(uint64_t &maxSatoshi, bool skipUnconfirmed)
 {
-    const auto addresses = wallet_.addresses.list();
-    const auto utxos = wallet_.cache.txs.utxos(addresses);
-    const auto info = generalAirbitzFeeInfo();
+    sessionUpdate();
+    const auto &utxos = skipUnconfirmed ?
+                        session_.utxosConfirmed : session_.utxosAll;
+    const auto &info = session_.airbitzFeeInfo;
 
     // Set up a fake transaction:
     bc::transaction_type tx;
@@ -129,8 +130,7 @@ Spend::calculateMax(uint64_t &maxSatoshi, bool skipUnconfirmed)
 
     logInfo("Max spend search: min: " + std::to_string(min) +
             ", max: " + std::to_string(max) +
-            ", utxo count: " + std::to_string(utxos.size()) +
-            ", address count: " + std::to_string(addresses.size()));
+            ", utxo count: " + std::to_string(utxos.size()));
 
     // Do the binary search:
     while (min + 1 < max)
@@ -141,7 +141,7 @@ Spend::calculateMax(uint64_t &maxSatoshi, bool skipUnconfirmed)
         ABC_CHECK(addAirbitzFeeOutput(tx.outputs, info));
 
         uint64_t fee, change;
-        if (inputsPickOptimal(fee, change, tx, filterOutputs(utxos, skipUnconfirmed),
+        if (inputsPickOptimal(fee, change, tx, utxos, session_.bitcoinFeeInfo,
                               feeLevel_, customFeeSatoshi_))
             min = guess;
         else
@@ -155,6 +155,9 @@ Spend::calculateMax(uint64_t &maxSatoshi, bool skipUnconfirmed)
 Status
 Spend::signTx(DataChunk &result, bool skipUnconfirmed)
 {
+    if (wallet_.watchOnly())
+        return ABC_ERROR(ABC_CC_Error, "Watch-only wallets cannot spend");
+
     // Make an unsigned transaction:
     AddressMeta changeAddress;
     ABC_CHECK(wallet_.addresses.getNew(changeAddress));
@@ -162,7 +165,9 @@ Spend::signTx(DataChunk &result, bool skipUnconfirmed)
     ABC_CHECK(makeTx(tx, changeAddress.address, skipUnconfirmed));
 
     // Sign the transaction:
-    KeyTable keys = wallet_.addresses.keyTable();
+    AddressSet addresses;
+    ABC_CHECK(inputsAddresses(addresses, tx, wallet_.cache.txs));
+    KeyTable keys = wallet_.addresses.keyTable(addresses);
     ABC_CHECK(abcd::signTx(tx, wallet_.cache.txs, keys));
     result.resize(satoshi_raw_size(tx));
     bc::satoshi_save(tx, result.begin());
@@ -281,15 +286,7 @@ Spend::makeOutputs(bc::transaction_output_list &result)
 
     // Read in BIP 70 outputs:
     for (auto request: paymentRequests_)
-    {
-        for (auto &a: request->outputs())
-        {
-            bc::transaction_output_type output;
-            output.value = a.amount;
-            output.script = bc::parse_script(bc::to_data_chunk(a.script));
-            out.push_back(output);
-        }
-    }
+        request->outputsAppend(out);
 
     result = std::move(out);
     return Status();
@@ -324,35 +321,84 @@ Spend::addAirbitzFeeOutput(bc::transaction_output_list &outputs,
     return Status();
 }
 
+void
+Spend::sessionUpdate()
+{
+    // Read the revisions first, so a change that lands
+    // while we are loading gets picked up next time:
+    const auto txsRevision = wallet_.cache.txs.revision();
+    const auto feeRevision = generalFeeRevision();
+    if (session_.valid && txsRevision == session_.txsRevision &&
+            feeRevision == session_.feeRevision)
+        return;
+
+    const auto utxos = wallet_.cache.txs.utxos(*wallet_.addresses.snapshot());
+    session_.utxosConfirmed = filterOutputs(utxos, true);
+    session_.utxosAll = filterOutputs(utxos);
+    session_.bitcoinFeeInfo = generalBitcoinFeeInfo();
+    session_.airbitzFeeInfo = generalAirbitzFeeInfo();
+
+    session_.valid = true;
+    session_.txsRevision = txsRevision;
+    session_.feeRevision = feeRevision;
+    session_.picked = false;
+}
+
 Status
 Spend::makeTx(libbitcoin::transaction_type &result,
               const std::string &changeAddress, bool skipUnconfirmed)
 {
+    sessionUpdate();
+
     bc::transaction_type tx;
     tx.version = 1;
     tx.locktime = 0;
     ABC_CHECK(makeOutputs(tx.outputs));
-    const auto info = generalAirbitzFeeInfo();
-    ABC_CHECK(addAirbitzFeeOutput(tx.outputs, info));
 
-    // Check if enough confirmed inputs are available:
-    uint64_t fee, change;
-    auto utxos = wallet_.cache.txs.utxos(wallet_.addresses.list());
-    const auto s = inputsPickOptimal(fee, change, tx, filterOutputs(utxos, true),
-                                     feeLevel_, customFeeSatoshi_);
+    // The selection only depends on the outputs and fee settings:
+    DataChunk key(satoshi_raw_size(tx));
+    bc::satoshi_save(tx, key.begin());
+    key.push_back(skipUnconfirmed);
+    key.push_back(feeLevel_);
+    for (int i = 0; i < 8; ++i)
+        key.push_back(customFeeSatoshi_ >> (8 * i));
 
-    // Otherwise use unconfirmed inputs too:
-    if (!s && !skipUnconfirmed)
+    if (!session_.picked || key != session_.pickKey)
     {
-        ABC_CHECK(inputsPickOptimal(fee, change, tx, filterOutputs(utxos),
-                                    feeLevel_, customFeeSatoshi_));
-    }
-    else if (!s)
-    {
-        return s;
+        session_.picked = false;
+        ABC_CHECK(addAirbitzFeeOutput(tx.outputs, session_.airbitzFeeInfo));
+
+        // Check if enough confirmed inputs are available:
+        uint64_t fee, change;
+        const auto s = inputsPickOptimal(fee, change, tx,
+                                         session_.utxosConfirmed,
+                                         session_.bitcoinFeeInfo,
+                                         feeLevel_, customFeeSatoshi_);
+
+        // Otherwise use unconfirmed inputs too:
+        if (!s && !skipUnconfirmed)
+        {
+            ABC_CHECK(inputsPickOptimal(fee, change, tx, session_.utxosAll,
+                                        session_.bitcoinFeeInfo,
+                                        feeLevel_, customFeeSatoshi_));
+        }
+        else if (!s)
+        {
+            return s;
+        }
+
+        session_.picked = true;
+        session_.pickKey = key;
+        session_.pickTx = tx;
+        session_.pickChange = change;
+        session_.pickAirbitzFeeWanted = airbitzFeeWanted_;
+        session_.pickAirbitzFeeSent = airbitzFeeSent_;
     }
 
-    ABC_CHECK(outputsFinalize(tx.outputs, change, changeAddress));
+    tx = session_.pickTx;
+    airbitzFeeWanted_ = session_.pickAirbitzFeeWanted;
+    airbitzFeeSent_ = session_.pickAirbitzFeeSent;
+    ABC_CHECK(outputsFinalize(tx.outputs, session_.pickChange, changeAddress));
 
     result = std::move(tx);
     return Status();
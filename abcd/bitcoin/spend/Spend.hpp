@@ -8,6 +8,7 @@
 #ifndef ABCD_SPEND_SPEND_HPP
 #define ABCD_SPEND_SPEND_HPP
 
+#include "../../General.hpp"
 #include "../../util/Data.hpp"
 #include "../../util/Status.hpp"
 #include "../../wallet/Metadata.hpp"
@@ -17,7 +18,6 @@
 
 namespace abcd {
 
-struct AirbitzFeeInfo;
 class PaymentRequest;
 class Wallet;
 
@@ -105,6 +105,37 @@ private:
     tABC_SpendFeeLevel feeLevel_;
     uint64_t customFeeSatoshi_;
 
+    /**
+     * Wallet and fee state kept between calls, since the GUI
+     * recalculates fees on every keystroke in the amount field.
+     */
+    struct Session
+    {
+        bool valid = false;
+        uint64_t txsRevision = 0;
+        uint64_t feeRevision = 0;
+        bc::output_info_list utxosConfirmed;
+        bc::output_info_list utxosAll;
+        BitcoinFeeInfo bitcoinFeeInfo;
+        AirbitzFeeInfo airbitzFeeInfo;
+
+        // The last input selection, before adding change:
+        bool picked = false;
+        DataChunk pickKey;
+        bc::transaction_type pickTx;
+        uint64_t pickChange = 0;
+        uint64_t pickAirbitzFeeWanted = 0;
+        uint64_t pickAirbitzFeeSent = 0;
+    };
+    Session session_;
+
+    /**
+     * Refreshes the session if the wallet's transactions
+     * or the fee tables have changed since it was filled in.
+     */
+    void
+    sessionUpdate();
+
     Status
     makeOutputs(bc::transaction_output_list &result);
 
@@ -21,13 +21,13 @@ namespace abcd {
  * Performs the actual sweep.
  */
 static Status
-sweepSend(Wallet &wallet,
-          const std::string &address, const std::string &wif,
+sweepSend(Wallet &wallet, const KeyTable &keys,
           tABC_BitCoin_Event_Callback fCallback, void *pData)
 {
-    // Find utxos for this address:
+    // Find utxos for these addresses:
     AddressSet addresses;
-    addresses.insert(address);
+    for (const auto &key: keys)
+        addresses.insert(key.first);
     auto utxos = wallet.cache.txs.utxos(addresses);
 
     // Bail out if there are no funds to sweep:
@@ -42,6 +42,8 @@ sweepSend(Wallet &wallet,
         info.szWalletUUID = wallet.id().c_str();
         info.szTxID = nullptr;
         info.sweepSatoshi = 0;
+        info.aszTxIDs = nullptr;
+        info.countTxIDs = 0;
         fCallback(&info);
 
         return Status();
@@ -67,8 +69,6 @@ sweepSend(Wallet &wallet,
     tx.outputs[0].value = funds;
 
     // Now sign that:
-    KeyTable keys;
-    keys[address] = wif;
     ABC_CHECK(signTx(tx, wallet.cache.txs, keys));
 
     // Send:
@@ -109,17 +109,18 @@ sweepSend(Wallet &wallet,
     async.szWalletUUID = wallet.id().c_str();
     async.szTxID = info.txid.c_str();
     async.sweepSatoshi = balance;
+    async.aszTxIDs = &async.szTxID;
+    async.countTxIDs = 1;
     fCallback(&async);
 
     return Status();
 }
 
 void
-sweepOnComplete(Wallet &wallet,
-                const std::string &address, const std::string &wif,
+sweepOnComplete(Wallet &wallet, const KeyTable &keys,
                 tABC_BitCoin_Event_Callback fCallback, void *pData)
 {
-    auto s = sweepSend(wallet, address, wif, fCallback, pData).log();
+    auto s = sweepSend(wallet, keys, fCallback, pData).log();
     if (!s)
     {
         ABC_DebugLog("IncomingSweep callback: wallet %s, status: %d",
@@ -131,6 +132,8 @@ sweepOnComplete(Wallet &wallet,
         info.szWalletUUID = wallet.id().c_str();
         info.szTxID = nullptr;
         info.sweepSatoshi = 0;
+        info.aszTxIDs = nullptr;
+        info.countTxIDs = 0;
         fCallback(&info);
     }
 }
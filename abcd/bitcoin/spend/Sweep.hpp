@@ -8,6 +8,7 @@
 #ifndef ABCD_SPEND_SPEND_HPP
 #define ABCD_SPEND_SPEND_HPP
 
+#include "Inputs.hpp"
 #include "../../util/Status.hpp"
 
 namespace abcd {
@@ -15,12 +16,13 @@ namespace abcd {
 class Wallet;
 
 /**
- * Sweeps the funds from an address into the wallet.
- * Requires that the address has been fully synced into the cache.
+ * Sweeps the funds from a group of addresses into the wallet,
+ * using a single transaction.
+ * Requires that the addresses have been fully synced into the cache.
+ * @param keys a map from addresses to their WIF keys.
  */
 void
-sweepOnComplete(Wallet &wallet,
-                const std::string &address, const std::string &wif,
+sweepOnComplete(Wallet &wallet, const KeyTable &keys,
                 tABC_BitCoin_Event_Callback fCallback, void *pData);
 
 } // namespace abcd
@@ -9,6 +9,8 @@
 #include "Encoding.hpp"
 #include "Random.hpp"
 #include "../json/JsonPtr.hpp"
+#include "../util/Metrics.hpp"
+#include "../util/Parallel.hpp"
 #include "../util/Util.hpp"
 #include <bitcoin/bitcoin.hpp> // wow! such slow, very compile time
 #include <openssl/evp.h>
@@ -21,19 +23,6 @@ namespace abcd {
 #define JSON_ENC_IV_FIELD       "iv_hex"
 #define JSON_ENC_DATA_FIELD     "data_base64"
 
-static
-tABC_CC ABC_CryptoEncryptAES256(const tABC_U08Buf Data,
-                                const tABC_U08Buf Key,
-                                const tABC_U08Buf IV,
-                                tABC_U08Buf       *pEncData,
-                                tABC_Error        *pError);
-static
-tABC_CC ABC_CryptoDecryptAES256(const tABC_U08Buf EncData,
-                                const tABC_U08Buf Key,
-                                const tABC_U08Buf IV,
-                                tABC_U08Buf       *pData,
-                                tABC_Error        *pError);
-
 /**
  * A constant-time alternative to memcmp.
  */
@@ -47,18 +36,116 @@ cryptoCompare(const uint8_t *a, const uint8_t *b, size_t size)
     return !out;
 }
 
+HmacKey::~HmacKey()
+{
+    OPENSSL_cleanse(&inner_, sizeof(inner_));
+    OPENSSL_cleanse(&outer_, sizeof(outer_));
+}
+
+HmacKey::HmacKey(DataSlice key)
+{
+    // Keys longer than a block get hashed down first:
+    unsigned char block[SHA256_CBLOCK] = {0};
+    if (SHA256_CBLOCK < key.size())
+        SHA256(key.data(), key.size(), block);
+    else
+        memcpy(block, key.data(), key.size());
+
+    unsigned char pad[SHA256_CBLOCK];
+    for (size_t i = 0; i < SHA256_CBLOCK; ++i)
+        pad[i] = block[i] ^ 0x36;
+    SHA256_Init(&inner_);
+    SHA256_Update(&inner_, pad, sizeof(pad));
+
+    for (size_t i = 0; i < SHA256_CBLOCK; ++i)
+        pad[i] = block[i] ^ 0x5c;
+    SHA256_Init(&outer_);
+    SHA256_Update(&outer_, pad, sizeof(pad));
+
+    OPENSSL_cleanse(block, sizeof(block));
+    OPENSSL_cleanse(pad, sizeof(pad));
+}
+
+DataChunk
+HmacKey::hash(DataSlice data) const
+{
+    DataChunk out(SHA256_DIGEST_LENGTH);
+
+    SHA256_CTX ctx = inner_;
+    SHA256_Update(&ctx, data.data(), data.size());
+    SHA256_Final(out.data(), &ctx);
+
+    ctx = outer_;
+    SHA256_Update(&ctx, out.data(), out.size());
+    SHA256_Final(out.data(), &ctx);
+
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
+    return out;
+}
+
+std::string
+HmacKey::filename(const std::string &name) const
+{
+    return bc::encode_base58(hash(DataSlice(name)));
+}
+
+std::vector<std::string>
+HmacKey::filenames(const std::vector<std::string> &names) const
+{
+    std::vector<std::string> out(names.size());
+    parallelFor(names.size(), [this, &names, &out](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+            out[i] = filename(names[i]);
+    }, 256);
+    return out;
+}
+
 DataChunk
 hmacSha256(DataSlice data, DataSlice key)
 {
-    const auto hash = bc::hmac_sha256_hash(data, key);
-    return DataChunk(hash.begin(), hash.end());
+    return HmacKey(key).hash(data);
 }
 
 std::string
 cryptoFilename(DataSlice key, const std::string &name)
 {
-    return bc::encode_base58(bc::to_data_chunk(
-                                 bc::hmac_sha256_hash(DataSlice(name), key)));
+    return HmacKey(key).filename(name);
+}
+
+/**
+ * Copies a key or IV into a fixed-size, zero-padded buffer,
+ * truncating anything too long.
+ */
+static void
+cryptoPad(unsigned char *out, size_t size, DataSlice in)
+{
+    memset(out, 0, size);
+    memcpy(out, in.data(), std::min(size, in.size()));
+}
+
+/**
+ * Owns an OpenSSL cipher context.
+ */
+struct CipherContext
+{
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    ~CipherContext() { EVP_CIPHER_CTX_free(ctx); }
+};
+
+/**
+ * Feeds one piece of plaintext to the cipher,
+ * advancing the output pointer past whatever it writes.
+ */
+static bool
+cryptoEncryptUpdate(EVP_CIPHER_CTX *ctx, unsigned char *&out,
+                    const unsigned char *data, size_t size)
+{
+    int length = 0;
+    if (!EVP_EncryptUpdate(ctx, out, &length, data, size))
+        return false;
+    out += length;
+    return true;
 }
 
 /**
@@ -71,104 +158,90 @@ cryptoFilename(DataSlice key, const std::string &name)
  *   1 byte:     f (the number of random footer bytes)
  *   f bytes:    f random header bytes
  *   32 bytes:   32 bytes SHA256 of all data up to this point
+ *
+ * The header and footer are assembled on the stack and streamed through
+ * the hash and cipher around the caller's data, so the plaintext package
+ * never exists as a buffer of its own.
  */
 tABC_CC ABC_CryptoEncryptAES256Package(DataSlice         Data,
                                        DataSlice         Key,
-                                       tABC_U08Buf       *pEncData,
+                                       DataChunk         &EncData,
                                        DataChunk         &IV,
                                        tABC_Error        *pError)
 {
+    static auto &duration = metricHistogram("crypto.aes_encrypt_us");
+    MetricTimer timer(duration);
     tABC_CC cc = ABC_CC_Ok;
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
 
-    DataChunk headerData;
-    DataChunk footerData;
-    AutoU08Buf UnencryptedData;
+    DataChunk random;
     unsigned char nRandomHeaderBytes;
     unsigned char nRandomFooterBytes;
-    unsigned long totalSizeUnencrypted = 0;
-    unsigned char *pCurUnencryptedData = NULL;
-    unsigned char nSizeByte = 0;
-    unsigned char sha256Output[SHA256_DIGEST_LENGTH];
-
-    ABC_CHECK_NULL(pEncData);
-
-    // create a random IV
-    ABC_CHECK_NEW(randomData(IV, AES_256_IV_LENGTH));
-
-    // create a random number of header bytes 0-255
-    {
-        DataChunk r;
-        ABC_CHECK_NEW(randomData(r, 1));
-        nRandomHeaderBytes = r[0] & 0x0f;
-    }
-    //printf("rand header count: %d\n", nRandomHeaderBytes);
-    ABC_CHECK_NEW(randomData(headerData, nRandomHeaderBytes));
-
-    // create a random number of footer bytes 0-255
-    {
-        DataChunk r;
-        ABC_CHECK_NEW(randomData(r, 1));
-        nRandomFooterBytes = r[0] & 0x0f;
-    }
-    //printf("rand footer count: %d\n", nRandomFooterBytes);
-    ABC_CHECK_NEW(randomData(footerData, nRandomFooterBytes));
-
-    // calculate the size of our unencrypted buffer
-    totalSizeUnencrypted += 1; // header count
-    totalSizeUnencrypted += nRandomHeaderBytes; // header
-    totalSizeUnencrypted += 4; // space to hold data size
-    totalSizeUnencrypted += Data.size(); // data
-    totalSizeUnencrypted += 1; // footer count
-    totalSizeUnencrypted += nRandomFooterBytes; // footer
-    totalSizeUnencrypted += SHA256_DIGEST_LENGTH; // sha256
-    //printf("total size unencrypted: %lu\n", (unsigned long) totalSizeUnencrypted);
-
-    // allocate the unencrypted buffer
-    ABC_BUF_NEW(UnencryptedData, totalSizeUnencrypted);
-    pCurUnencryptedData = UnencryptedData.data();
-
-    // add the random header count and bytes
-    memcpy(pCurUnencryptedData, &nRandomHeaderBytes, 1);
-    pCurUnencryptedData += 1;
-    memcpy(pCurUnencryptedData, headerData.data(), headerData.size());
-    pCurUnencryptedData += nRandomHeaderBytes;
-
-    // add the size of the data
-    nSizeByte = (Data.size() >> 24) & 0xff;
-    memcpy(pCurUnencryptedData, &nSizeByte, 1);
-    pCurUnencryptedData += 1;
-    nSizeByte = (Data.size() >> 16) & 0xff;
-    memcpy(pCurUnencryptedData, &nSizeByte, 1);
-    pCurUnencryptedData += 1;
-    nSizeByte = (Data.size() >> 8) & 0xff;
-    memcpy(pCurUnencryptedData, &nSizeByte, 1);
-    pCurUnencryptedData += 1;
-    nSizeByte = (Data.size() >> 0) & 0xff;
-    memcpy(pCurUnencryptedData, &nSizeByte, 1);
-    pCurUnencryptedData += 1;
-
-    // add the data
-    memcpy(pCurUnencryptedData, Data.data(), Data.size());
-    pCurUnencryptedData += Data.size();
-
-    // add the random footer count and bytes
-    memcpy(pCurUnencryptedData, &nRandomFooterBytes, 1);
-    pCurUnencryptedData += 1;
-    memcpy(pCurUnencryptedData, footerData.data(), footerData.size());
-    pCurUnencryptedData += nRandomFooterBytes;
-
-    // add the sha256
-    SHA256(UnencryptedData.data(), totalSizeUnencrypted - SHA256_DIGEST_LENGTH,
-           sha256Output);
-    memcpy(pCurUnencryptedData, sha256Output, SHA256_DIGEST_LENGTH);
-    pCurUnencryptedData += SHA256_DIGEST_LENGTH;
-
-    // encrypted our new unencrypted package
-    ABC_CHECK_RET(ABC_CryptoEncryptAES256(UnencryptedData, Key, U08Buf(IV),
-                                          pEncData, pError));
+    unsigned char header[1 + 0x0f + 4];
+    unsigned char footer[1 + 0x0f + SHA256_DIGEST_LENGTH];
+    size_t headerSize;
+    size_t footerSize;
+    unsigned char aKey[AES_256_KEY_LENGTH];
+    unsigned char aIV[AES_256_IV_LENGTH];
+    SHA256_CTX sha;
+    CipherContext e;
+    unsigned char *pOut;
+    int outLength = 0;
+
+    ABC_CHECK_ASSERT(Key.size(), ABC_CC_NULLPtr, "No encryption key");
+    ABC_CHECK_ASSERT(e.ctx, ABC_CC_EncryptError, "Cannot create cipher");
+
+    // create a random IV, random header & footer sizes (0-15),
+    // and enough random bytes to fill them, all in one go
+    ABC_CHECK_NEW(randomData(random, AES_256_IV_LENGTH + 2 + 2 * 0x0f));
+    IV = DataChunk(random.begin(), random.begin() + AES_256_IV_LENGTH);
+    nRandomHeaderBytes = random[AES_256_IV_LENGTH] & 0x0f;
+    nRandomFooterBytes = random[AES_256_IV_LENGTH + 1] & 0x0f;
+
+    // random header count and bytes, then the size of the data
+    headerSize = 0;
+    header[headerSize++] = nRandomHeaderBytes;
+    memcpy(header + headerSize, random.data() + AES_256_IV_LENGTH + 2,
+           nRandomHeaderBytes);
+    headerSize += nRandomHeaderBytes;
+    header[headerSize++] = (Data.size() >> 24) & 0xff;
+    header[headerSize++] = (Data.size() >> 16) & 0xff;
+    header[headerSize++] = (Data.size() >> 8) & 0xff;
+    header[headerSize++] = (Data.size() >> 0) & 0xff;
+
+    // random footer count and bytes
+    footerSize = 0;
+    footer[footerSize++] = nRandomFooterBytes;
+    memcpy(footer + footerSize, random.data() + AES_256_IV_LENGTH + 2 + 0x0f,
+           nRandomFooterBytes);
+    footerSize += nRandomFooterBytes;
+
+    // the sha256 of everything so far
+    SHA256_Init(&sha);
+    SHA256_Update(&sha, header, headerSize);
+    SHA256_Update(&sha, Data.data(), Data.size());
+    SHA256_Update(&sha, footer, footerSize);
+    SHA256_Final(footer + footerSize, &sha);
+    footerSize += SHA256_DIGEST_LENGTH;
+
+    // encrypt the pieces straight into the output,
+    // which needs room for at most one extra block of padding
+    cryptoPad(aKey, sizeof(aKey), Key);
+    cryptoPad(aIV, sizeof(aIV), IV);
+    EncData.resize(headerSize + Data.size() + footerSize + AES_256_BLOCK_LENGTH);
+    pOut = EncData.data();
+    ABC_CHECK_ASSERT(EVP_EncryptInit_ex(e.ctx, EVP_aes_256_cbc(), NULL,
+                                        aKey, aIV) &&
+                     cryptoEncryptUpdate(e.ctx, pOut, header, headerSize) &&
+                     cryptoEncryptUpdate(e.ctx, pOut, Data.data(), Data.size()) &&
+                     cryptoEncryptUpdate(e.ctx, pOut, footer, footerSize) &&
+                     EVP_EncryptFinal_ex(e.ctx, pOut, &outLength),
+                     ABC_CC_EncryptError, "Encryption failed");
+    pOut += outLength;
+    EncData.resize(pOut - EncData.data());
 
 exit:
+    OPENSSL_cleanse(aKey, sizeof(aKey));
     return cc;
 }
 
@@ -184,6 +257,9 @@ exit:
  *   1 byte:     f (the number of random footer bytes)
  *   f bytes:    f random header bytes
  *   32 bytes:   32 bytes SHA256 of all data up to this point
+ *
+ * The package is decrypted into the result buffer itself,
+ * and the data is then shifted down over the header in place.
  */
 tABC_CC ABC_CryptoDecryptAES256Package(DataChunk &result,
                                        DataSlice EncData,
@@ -191,10 +267,17 @@ tABC_CC ABC_CryptoDecryptAES256Package(DataChunk &result,
                                        DataSlice IV,
                                        tABC_Error *pError)
 {
+    static auto &duration = metricHistogram("crypto.aes_decrypt_us");
+    MetricTimer timer(duration);
     tABC_CC cc = ABC_CC_Ok;
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
 
-    AutoU08Buf Data;
+    DataChunk Data;
+    unsigned char aKey[AES_256_KEY_LENGTH];
+    unsigned char aIV[AES_256_IV_LENGTH];
+    CipherContext d;
+    int p_len = 0;
+    int f_len = 0;
     unsigned char headerLength;
     unsigned int minSize;
     unsigned char *pDataLengthPos;
@@ -203,24 +286,31 @@ tABC_CC ABC_CryptoDecryptAES256Package(DataChunk &result,
     unsigned int shaCheckLength;
     unsigned char *pSHALoc;
     unsigned char sha256Output[SHA256_DIGEST_LENGTH];
-    unsigned char *pFinalDataPos;
 
-    // start by decrypting the pacakge
-    if (ABC_CC_Ok != ABC_CryptoDecryptAES256(EncData, Key, IV, &Data, pError))
-    {
-        cc = ABC_CC_DecryptFailure;
-        if (pError)
-        {
-            pError->code = cc;
-        }
-        goto exit;
-    }
+    ABC_CHECK_ASSERT(EncData.size() && Key.size() && IV.size(),
+                     ABC_CC_DecryptFailure, "Missing decryption inputs");
+    ABC_CHECK_ASSERT(d.ctx, ABC_CC_DecryptFailure, "Cannot create cipher");
+
+    // start by decrypting the package,
+    // leaving room for the extra block padding mode may write
+    cryptoPad(aKey, sizeof(aKey), Key);
+    cryptoPad(aIV, sizeof(aIV), IV);
+    Data.resize(EncData.size() + AES_256_BLOCK_LENGTH);
+    ABC_CHECK_ASSERT(EVP_DecryptInit_ex(d.ctx, EVP_aes_256_cbc(), NULL,
+                                        aKey, aIV) &&
+                     EVP_DecryptUpdate(d.ctx, Data.data(), &p_len,
+                                       EncData.data(), EncData.size()) &&
+                     EVP_DecryptFinal_ex(d.ctx, Data.data() + p_len, &f_len),
+                     ABC_CC_DecryptFailure, "Decryption failed");
+    Data.resize(p_len + f_len);
+    ABC_CHECK_ASSERT(Data.size(), ABC_CC_DecryptFailure,
+                     "Decrypted data is empty");
 
     // get the size of the random header section
     headerLength = *Data.data();
 
     // check that we have enough data based upon this info
-    minSize = 1 + headerLength + 4 + 1 + 1 +
+    minSize = 1 + headerLength + 4 + 1 +
               SHA256_DIGEST_LENGTH; // decrypted package must be at least this big
     ABC_CHECK_ASSERT(Data.size() >= minSize, ABC_CC_DecryptFailure,
                      "Decrypted data is not long enough");
@@ -266,149 +356,13 @@ tABC_CC ABC_CryptoDecryptAES256Package(DataChunk &result,
                       "Decrypted data failed checksum (SHA) check");
     }
 
-    // all is good, so create the final data
-    pFinalDataPos = Data.data() + 1 + headerLength + 4;
-    result = DataChunk(pFinalDataPos, pFinalDataPos + dataSecLength);
-
-exit:
-    return cc;
-}
-
-/**
- * Encrypts the given data with AES256
- */
-static
-tABC_CC ABC_CryptoEncryptAES256(const tABC_U08Buf Data,
-                                const tABC_U08Buf Key,
-                                const tABC_U08Buf IV,
-                                tABC_U08Buf       *pEncData,
-                                tABC_Error        *pError)
-{
-    tABC_CC cc = ABC_CC_Ok;
-    ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
-
-    unsigned char aKey[AES_256_KEY_LENGTH];
-    unsigned int keyLength = Key.size();
-    unsigned char aIV[AES_256_IV_LENGTH];
-    unsigned int IVLength;
-    int c_len;
-    int f_len = 0;
-    unsigned char *pTmpEncData = NULL;
-
-    ABC_CHECK_NULL_BUF(Data);
-    ABC_CHECK_NULL_BUF(Key);
-    ABC_CHECK_NULL_BUF(IV);
-    ABC_CHECK_NULL(pEncData);
-
-    // create the final key
-    memset(aKey, 0, AES_256_KEY_LENGTH);
-    if (keyLength > AES_256_KEY_LENGTH)
-    {
-        keyLength = AES_256_KEY_LENGTH;
-    }
-    memcpy(aKey, Key.data(), keyLength);
-
-    // create the IV
-    memset(aIV, 0, AES_256_IV_LENGTH);
-    IVLength = IV.size();
-    if (IVLength > AES_256_IV_LENGTH)
-    {
-        IVLength = AES_256_IV_LENGTH;
-    }
-    memcpy(aIV, IV.data(), IVLength);
-
-    // init our cipher text struct
-    EVP_CIPHER_CTX e_ctx;
-    EVP_CIPHER_CTX_init(&e_ctx);
-    EVP_EncryptInit_ex(&e_ctx, EVP_aes_256_cbc(), NULL, aKey, aIV);
-
-    // max ciphertext len for a n bytes of plaintext is n + AES_256_BLOCK_LENGTH -1 bytes
-    c_len = Data.size() + AES_256_BLOCK_LENGTH;
-    ABC_ARRAY_NEW(pTmpEncData, c_len, unsigned char);
-
-    // allows reusing of 'e' for multiple encryption cycles
-    EVP_EncryptInit_ex(&e_ctx, NULL, NULL, NULL, NULL);
-
-    // update pTmpEncData, c_len is filled with the length of pTmpEncData generated, dataLength is the size of plaintext in bytes
-    EVP_EncryptUpdate(&e_ctx, pTmpEncData, &c_len, Data.data(), Data.size());
-
-    // update pTmpEncData with the final remaining bytes
-    EVP_EncryptFinal_ex(&e_ctx, pTmpEncData + c_len, &f_len);
-
-    // set final values
-    *pEncData = U08Buf(pTmpEncData, c_len + f_len);
-
-    EVP_CIPHER_CTX_cleanup(&e_ctx);
-
-exit:
-
-    return cc;
-}
-
-/**
- * Decrypts the given data with AES256
- */
-static
-tABC_CC ABC_CryptoDecryptAES256(const tABC_U08Buf EncData,
-                                const tABC_U08Buf Key,
-                                const tABC_U08Buf IV,
-                                tABC_U08Buf       *pData,
-                                tABC_Error        *pError)
-{
-    tABC_CC cc = ABC_CC_Ok;
-    ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
-
-    unsigned char *pTmpData = NULL;
-    int p_len, f_len;
-    unsigned int IVLength;
-    unsigned int keyLength;
-
-    ABC_CHECK_NULL_BUF(EncData);
-    ABC_CHECK_NULL_BUF(Key);
-    ABC_CHECK_NULL_BUF(IV);
-    ABC_CHECK_NULL(pData);
-
-    // create the final key
-    unsigned char aKey[AES_256_KEY_LENGTH];
-    memset(aKey, 0, AES_256_KEY_LENGTH);
-    keyLength = Key.size();
-    if (keyLength > AES_256_KEY_LENGTH)
-    {
-        keyLength = AES_256_KEY_LENGTH;
-    }
-    memcpy(aKey, Key.data(), keyLength);
-
-    // create the IV
-    unsigned char aIV[AES_256_IV_LENGTH];
-    memset(aIV, 0, AES_256_IV_LENGTH);
-    IVLength = IV.size();
-    if (IVLength > AES_256_IV_LENGTH)
-    {
-        IVLength = AES_256_IV_LENGTH;
-    }
-    memcpy(aIV, IV.data(), IVLength);
-
-    // init our cipher text struct
-    EVP_CIPHER_CTX d_ctx;
-    EVP_CIPHER_CTX_init(&d_ctx);
-    EVP_DecryptInit_ex(&d_ctx, EVP_aes_256_cbc(), NULL, aKey, aIV);
-
-    /* because we have padding ON, we must allocate an extra cipher block size of memory */
-    p_len = EncData.size();
-    f_len = 0;
-    ABC_ARRAY_NEW(pTmpData, p_len + AES_256_BLOCK_LENGTH, unsigned char);
-
-    // decrypt
-    EVP_DecryptInit_ex(&d_ctx, NULL, NULL, NULL, NULL);
-    EVP_DecryptUpdate(&d_ctx, pTmpData, &p_len, EncData.data(), EncData.size());
-    EVP_DecryptFinal_ex(&d_ctx, pTmpData + p_len, &f_len);
-
-    EVP_CIPHER_CTX_cleanup(&d_ctx);
-
-    // set final values
-    *pData = U08Buf(pTmpData, p_len + f_len);
+    // all is good, so slide the data down over the header
+    memmove(Data.data(), Data.data() + 1 + headerLength + 4, dataSecLength);
+    Data.resize(dataSecLength);
+    result = std::move(Data);
 
 exit:
+    OPENSSL_cleanse(aKey, sizeof(aKey));
     return cc;
 }
 
@@ -15,6 +15,8 @@
 #include "../util/U08Buf.hpp"
 #include "../../src/ABC.h"
 #include <jansson.h>
+#include <openssl/sha.h>
+#include <vector>
 
 namespace abcd {
 
@@ -22,6 +24,37 @@ namespace abcd {
 #define AES_256_BLOCK_LENGTH    16
 #define AES_256_KEY_LENGTH      32
 
+/**
+ * An HMAC-SHA256 key with its inner and outer pads already absorbed,
+ * so each message only pays for hashing the message itself.
+ * Keep one of these around when hashing many things with the same key.
+ */
+class HmacKey
+{
+public:
+    ~HmacKey();
+    explicit HmacKey(DataSlice key);
+
+    DataChunk
+    hash(DataSlice data) const;
+
+    /**
+     * Same as `cryptoFilename`, but without the key setup.
+     */
+    std::string
+    filename(const std::string &name) const;
+
+    /**
+     * Hashes a whole batch of names, spread across the available cores.
+     */
+    std::vector<std::string>
+    filenames(const std::vector<std::string> &names) const;
+
+private:
+    SHA256_CTX inner_;
+    SHA256_CTX outer_;
+};
+
 DataChunk
 hmacSha256(DataSlice data, DataSlice key);
 
@@ -36,7 +69,7 @@ cryptoFilename(DataSlice key, const std::string &name);
 
 tABC_CC ABC_CryptoEncryptAES256Package(DataSlice         Data,
                                        DataSlice         Key,
-                                       tABC_U08Buf       *pEncData,
+                                       DataChunk         &EncData,
                                        DataChunk         &IV,
                                        tABC_Error        *pError);
 
@@ -7,7 +7,13 @@
 
 #include "Encoding.hpp"
 #include <bitcoin/bitcoin.hpp>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 #include <algorithm>
+#include <array>
 
 namespace abcd {
 
@@ -145,16 +151,99 @@ base64Decode(char c)
     return -1;
 }
 
+/**
+ * Builds a 256-entry lookup table from a character-decoding function.
+ */
+template<int Decode(char c)>
+std::array<int8_t, 256>
+decodeTable()
+{
+    std::array<int8_t, 256> out;
+    for (unsigned i = 0; i < out.size(); ++i)
+        out[i] = Decode(static_cast<char>(i));
+    return out;
+}
+
+static const char base16Chars[] = "0123456789abcdef";
+static const char base64Chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
 std::string
 base16Encode(DataSlice data)
 {
-    return chunkEncode<1, 2>(data, "0123456789abcdef");
+    std::string out(2 * data.size(), 0);
+    const uint8_t *in = data.data();
+    char *p = &out[0];
+    size_t i = 0;
+
+    // Split 16 bytes into nibbles, add '0' to each nibble,
+    // plus 'a' - '0' - 10 for the ones above 9, then interleave:
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+    for (; i + 16 <= data.size(); i += 16, p += 32)
+    {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+        __m128i lo = _mm_and_si128(x, mask);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, zero),
+                          _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, zero),
+                          _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p),
+                         _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p + 16),
+                         _mm_unpackhi_epi8(hi, lo));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t zero = vdupq_n_u8('0');
+    const uint8x16_t letter = vdupq_n_u8('a' - '0' - 10);
+    for (; i + 16 <= data.size(); i += 16, p += 32)
+    {
+        const uint8x16_t x = vld1q_u8(in + i);
+        uint8x16x2_t nibbles;
+        nibbles.val[0] = vshrq_n_u8(x, 4);
+        nibbles.val[1] = vandq_u8(x, mask);
+        for (auto &n: nibbles.val)
+            n = vaddq_u8(vaddq_u8(n, zero), vandq_u8(vcgtq_u8(n, nine), letter));
+        vst2q_u8(reinterpret_cast<uint8_t *>(p), nibbles);
+    }
+#endif
+
+    for (; i < data.size(); ++i)
+    {
+        *p++ = base16Chars[in[i] >> 4];
+        *p++ = base16Chars[in[i] & 0x0f];
+    }
+    return out;
 }
 
 Status
 base16Decode(DataChunk &result, const std::string &in)
 {
-    return chunkDecode<1, 2, base16Decode>(result, in);
+    static const auto table = decodeTable<base16Decode>();
+
+    // Hex has no padding, so every character must be a digit:
+    if (in.size() % 2)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+
+    DataChunk out(in.size() / 2);
+    const auto *s = reinterpret_cast<const uint8_t *>(in.data());
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        const int hi = table[s[2 * i]];
+        const int lo = table[s[2 * i + 1]];
+        if ((hi | lo) < 0)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+        out[i] = hi << 4 | lo;
+    }
+
+    result = std::move(out);
+    return Status();
 }
 
 std::string
@@ -187,14 +276,89 @@ base58Decode(DataChunk &result, const std::string &in)
 std::string
 base64Encode(DataSlice data)
 {
-    return chunkEncode<3, 4>(data,
-                             "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+    const size_t whole = data.size() / 3;
+    const size_t extra = data.size() % 3;
+    std::string out(4 * (whole + !!extra), '=');
+    const uint8_t *in = data.data();
+    char *p = &out[0];
+
+    // Four characters for every three bytes:
+    for (size_t i = 0; i < whole; ++i, in += 3, p += 4)
+    {
+        const uint32_t chunk = in[0] << 16 | in[1] << 8 | in[2];
+        p[0] = base64Chars[chunk >> 18];
+        p[1] = base64Chars[chunk >> 12 & 0x3f];
+        p[2] = base64Chars[chunk >> 6 & 0x3f];
+        p[3] = base64Chars[chunk & 0x3f];
+    }
+
+    // The last one or two bytes leave the '=' padding in place:
+    if (extra)
+    {
+        const uint32_t chunk = in[0] << 16 | (2 == extra ? in[1] << 8 : 0);
+        p[0] = base64Chars[chunk >> 18];
+        p[1] = base64Chars[chunk >> 12 & 0x3f];
+        if (2 == extra)
+            p[2] = base64Chars[chunk >> 6 & 0x3f];
+    }
+    return out;
 }
 
 Status
 base64Decode(DataChunk &result, const std::string &in)
 {
-    return chunkDecode<3, 4, base64Decode>(result, in);
+    static const auto table = decodeTable<base64Decode>();
+
+    // The string must be a multiple of the chunk size,
+    // with at most two padding characters:
+    if (in.size() % 4)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+    size_t size = in.size();
+    size_t padding = 0;
+    while (padding < 3 && size && '=' == in[size - 1])
+    {
+        --size;
+        ++padding;
+    }
+    if (2 < padding)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+
+    DataChunk out(3 * (size / 4) + (size % 4 ? size % 4 - 1 : 0));
+    const auto *s = reinterpret_cast<const uint8_t *>(in.data());
+    uint8_t *p = out.data();
+
+    // Three bytes for every four characters:
+    const size_t whole = size / 4;
+    for (size_t i = 0; i < whole; ++i, s += 4, p += 3)
+    {
+        const int a = table[s[0]];
+        const int b = table[s[1]];
+        const int c = table[s[2]];
+        const int d = table[s[3]];
+        if ((a | b | c | d) < 0)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+        const uint32_t chunk = a << 18 | b << 12 | c << 6 | d;
+        p[0] = chunk >> 16;
+        p[1] = chunk >> 8;
+        p[2] = chunk;
+    }
+
+    // The padded chunk, if any, has two or three characters.
+    // Any extra bits must be 0 (but rfc4648 decoders can be liberal here):
+    if (size % 4)
+    {
+        const int a = table[s[0]];
+        const int b = table[s[1]];
+        const int c = 3 == size % 4 ? table[s[2]] : 0;
+        if ((a | b | c) < 0)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad encoding");
+        p[0] = a << 2 | b >> 4;
+        if (3 == size % 4)
+            p[1] = b << 4 | c >> 2;
+    }
+
+    result = std::move(out);
+    return Status();
 }
 
 } // namespace abcd
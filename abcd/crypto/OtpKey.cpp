@@ -8,23 +8,57 @@
 #include "OtpKey.hpp"
 #include "Encoding.hpp"
 #include "Random.hpp"
-#include <openssl/hmac.h>
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+#include <string.h>
 #include <time.h>
-#include <sstream>
 
 namespace abcd {
 
+/**
+ * The SHA-1 states after absorbing the HMAC key pads,
+ * so each code only hashes the counter and the inner digest.
+ */
+struct OtpKey::HmacState
+{
+    SHA_CTX inner;
+    SHA_CTX outer;
+
+    ~HmacState()
+    {
+        OPENSSL_cleanse(&inner, sizeof(inner));
+        OPENSSL_cleanse(&outer, sizeof(outer));
+    }
+};
+
+OtpKey::OtpKey()
+{
+    hmacInit();
+}
+
+OtpKey::OtpKey(DataSlice key):
+    key_(key.begin(), key.end())
+{
+    hmacInit();
+}
+
 Status
 OtpKey::create(size_t keySize)
 {
-    ABC_CHECK(randomData(key_, keySize));
+    DataChunk key;
+    ABC_CHECK(randomData(key, keySize));
+    secureAssign(key_, key);
+    hmacInit();
     return Status();
 }
 
 Status
 OtpKey::decodeBase32(const std::string &key)
 {
-    ABC_CHECK(base32Decode(key_, key));
+    DataChunk out;
+    ABC_CHECK(base32Decode(out, key));
+    secureAssign(key_, out);
+    hmacInit();
     return Status();
 }
 
@@ -46,35 +80,86 @@ OtpKey::hotp(uint64_t counter, unsigned digits) const
             static_cast<uint8_t>(counter)
         }
     };
-    HMAC(EVP_sha1(), key_.data(), key_.size(), cb.data(), cb.size(),
-         hmac.data(), nullptr);
+    SHA_CTX ctx = hmac_->inner;
+    SHA1_Update(&ctx, cb.data(), cb.size());
+    SHA1_Final(hmac.data(), &ctx);
+    ctx = hmac_->outer;
+    SHA1_Update(&ctx, hmac.data(), hmac.size());
+    SHA1_Final(hmac.data(), &ctx);
+    OPENSSL_cleanse(&ctx, sizeof(ctx));
 
     // Calculate the truncated output:
     unsigned offset = hmac[19] & 0xf;
     uint32_t p = (hmac[offset] << 24) | (hmac[offset + 1] << 16) |
                  (hmac[offset + 2] << 8) | hmac[offset + 3];
     p &= 0x7fffffff;
+    OPENSSL_cleanse(hmac.data(), hmac.size());
 
-    // Format as a fixed-width decimal number:
-    std::stringstream ss;
-    ss.width(digits);
-    ss.fill('0');
-    ss << p;
-    auto s = ss.str();
-    s.erase(0, s.size() - digits);
+    // Format as a fixed-width decimal number,
+    // always doing the same work no matter what the digits are:
+    std::string s(digits, '0');
+    for (unsigned i = digits; i--; )
+    {
+        s[i] = '0' + p % 10;
+        p /= 10;
+    }
     return s;
 }
 
+std::vector<std::string>
+OtpKey::hotpRange(uint64_t first, size_t count, unsigned digits) const
+{
+    std::vector<std::string> out;
+    out.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+        out.push_back(hotp(first + i, digits));
+    return out;
+}
+
 std::string
 OtpKey::totp(uint64_t timeStep, unsigned digits) const
 {
     return hotp(time(nullptr) / timeStep, digits);
 }
 
+std::vector<std::string>
+OtpKey::totpWindow(unsigned before, unsigned after,
+                   uint64_t timeStep, unsigned digits) const
+{
+    const uint64_t now = time(nullptr) / timeStep;
+    const uint64_t first = now < before ? 0 : now - before;
+    return hotpRange(first, now - first + after + 1, digits);
+}
+
 std::string
 OtpKey::encodeBase32() const
 {
     return base32Encode(key_);
 }
 
+void
+OtpKey::hmacInit()
+{
+    // Keys longer than a block get hashed down first:
+    SecureChunk block(SHA_CBLOCK, 0);
+    if (SHA_CBLOCK < key_.size())
+        SHA1(key_.data(), key_.size(), block.data());
+    else if (key_.size())
+        memcpy(block.data(), key_.data(), key_.size());
+
+    auto out = std::allocate_shared<HmacState>(SecureAllocator<HmacState>());
+    SecureChunk pad(SHA_CBLOCK);
+    for (size_t i = 0; i < SHA_CBLOCK; ++i)
+        pad[i] = block[i] ^ 0x36;
+    SHA1_Init(&out->inner);
+    SHA1_Update(&out->inner, pad.data(), pad.size());
+
+    for (size_t i = 0; i < SHA_CBLOCK; ++i)
+        pad[i] = block[i] ^ 0x5c;
+    SHA1_Init(&out->outer);
+    SHA1_Update(&out->outer, pad.data(), pad.size());
+
+    hmac_ = out;
+}
+
 } // namespace abcd
@@ -9,18 +9,23 @@
 #define ABCD_CRYPTO_OTPKEY_HPP
 
 #include "../util/Data.hpp"
+#include "../util/SecureData.hpp"
 #include "../util/Status.hpp"
+#include <memory>
+#include <vector>
 
 namespace abcd {
 
 /**
  * Implements the TOTP algorithm defined by rfc6238.
+ * The key and its precomputed HMAC state live in locked memory,
+ * and copies of the key share the same HMAC state.
  */
 class OtpKey
 {
 public:
-    OtpKey() {}
-    OtpKey(DataSlice key): key_(key.begin(), key.end()) {}
+    OtpKey();
+    OtpKey(DataSlice key);
 
     /**
      * Initializes the key with random data.
@@ -40,12 +45,28 @@ public:
     std::string
     hotp(uint64_t counter, unsigned digits=6) const;
 
+    /**
+     * Produces the counter-based passwords for `count` counters,
+     * starting with `first`.
+     */
+    std::vector<std::string>
+    hotpRange(uint64_t first, size_t count, unsigned digits=6) const;
+
     /**
      * Produces a time-based password.
      */
     std::string
     totp(uint64_t timeStep=30, unsigned digits=6) const;
 
+    /**
+     * Produces the time-based passwords for the current time window,
+     * plus `before` windows back and `after` windows ahead, oldest first.
+     * This covers clock drift between the device and the server.
+     */
+    std::vector<std::string>
+    totpWindow(unsigned before, unsigned after,
+               uint64_t timeStep=30, unsigned digits=6) const;
+
     /**
      * Encodes the key as a base32 string.
      */
@@ -59,7 +80,16 @@ public:
     key() const { return key_; }
 
 private:
-    DataChunk key_;
+    struct HmacState;
+
+    SecureChunk key_;
+    std::shared_ptr<const HmacState> hmac_;
+
+    /**
+     * Rebuilds the HMAC state after the key changes.
+     */
+    void
+    hmacInit();
 };
 
 } // namespace abcd
@@ -8,12 +8,17 @@
 #include "Random.hpp"
 #include "../Context.hpp"
 #include "../util/U08Buf.hpp"
+#include <openssl/crypto.h>
 #include <openssl/rand.h>
+#include <pthread.h>
 #ifndef __ANDROID__
 #include <sys/statvfs.h>
 #endif
 #include <sys/time.h>
+#include <string.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include "Scrypt.hpp"
 
 namespace abcd {
@@ -22,6 +27,137 @@ namespace abcd {
 #define UUID_BYTE_COUNT         16
 #define UUID_STR_LENGTH         (UUID_BYTE_COUNT * 2) + 4
 
+constexpr size_t chachaBlocks = 16; // Keystream blocks per refill
+constexpr size_t chachaSeedSize = 40; // 256-bit key + 64-bit nonce
+constexpr size_t reseedInterval = 1 << 20; // Bytes between reseeds
+
+/**
+ * A per-thread ChaCha20 generator, seeded from OpenSSL.
+ * Every refill starts by replacing the key with fresh keystream,
+ * so a later compromise of the state cannot reveal earlier output.
+ */
+struct RandomState
+{
+    uint32_t input[16];
+    uint8_t buffer[64 * chachaBlocks];
+    size_t available; // Unused bytes at the end of the buffer
+    size_t sinceSeed;
+    unsigned generation; // Matches gRandomGeneration when up to date
+
+    ~RandomState()
+    {
+        OPENSSL_cleanse(this, sizeof(*this));
+    }
+};
+
+// Bumped when the OpenSSL pool gets new seed data, or after a fork,
+// so every thread pulls a fresh seed before its next use:
+static std::atomic<unsigned> gRandomGeneration(1);
+static thread_local RandomState tRandom;
+
+static void
+randomAtFork()
+{
+    ++gRandomGeneration;
+}
+
+#define CHACHA_ROTATE(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define CHACHA_QUARTER(a, b, c, d) \
+    a += b; d ^= a; d = CHACHA_ROTATE(d, 16); \
+    c += d; b ^= c; b = CHACHA_ROTATE(b, 12); \
+    a += b; d ^= a; d = CHACHA_ROTATE(d, 8); \
+    c += d; b ^= c; b = CHACHA_ROTATE(b, 7);
+
+/**
+ * Produces one 64-byte ChaCha20 keystream block.
+ */
+static void
+chachaBlock(uint8_t *out, const uint32_t input[16])
+{
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    for (int i = 0; i < 10; ++i)
+    {
+        CHACHA_QUARTER(x[0], x[4], x[8], x[12])
+        CHACHA_QUARTER(x[1], x[5], x[9], x[13])
+        CHACHA_QUARTER(x[2], x[6], x[10], x[14])
+        CHACHA_QUARTER(x[3], x[7], x[11], x[15])
+        CHACHA_QUARTER(x[0], x[5], x[10], x[15])
+        CHACHA_QUARTER(x[1], x[6], x[11], x[12])
+        CHACHA_QUARTER(x[2], x[7], x[8], x[13])
+        CHACHA_QUARTER(x[3], x[4], x[9], x[14])
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        const uint32_t v = x[i] + input[i];
+        out[4 * i + 0] = v;
+        out[4 * i + 1] = v >> 8;
+        out[4 * i + 2] = v >> 16;
+        out[4 * i + 3] = v >> 24;
+    }
+    OPENSSL_cleanse(x, sizeof(x));
+}
+
+/**
+ * Loads a new key and nonce, resetting the block counter.
+ */
+static void
+chachaKey(RandomState &state, const uint8_t *seed)
+{
+    static const uint8_t sigma[] = "expand 32-byte k";
+    const uint8_t *p[16] =
+    {
+        sigma, sigma + 4, sigma + 8, sigma + 12,
+        seed, seed + 4, seed + 8, seed + 12,
+        seed + 16, seed + 20, seed + 24, seed + 28,
+        nullptr, nullptr, seed + 32, seed + 36
+    };
+    for (int i = 0; i < 16; ++i)
+        state.input[i] = !p[i] ? 0 :
+                         p[i][0] | p[i][1] << 8 | p[i][2] << 16 |
+                         static_cast<uint32_t>(p[i][3]) << 24;
+}
+
+/**
+ * Refills the output buffer, keeping the first bytes as the next key.
+ */
+static void
+chachaRefill(RandomState &state)
+{
+    for (size_t i = 0; i < chachaBlocks; ++i)
+    {
+        chachaBlock(state.buffer + 64 * i, state.input);
+        if (!++state.input[12])
+            ++state.input[13];
+    }
+    chachaKey(state, state.buffer);
+    OPENSSL_cleanse(state.buffer, chachaSeedSize);
+    state.available = sizeof(state.buffer) - chachaSeedSize;
+}
+
+/**
+ * Keys the calling thread's generator from the OpenSSL pool.
+ */
+static Status
+randomSeed(RandomState &state, unsigned generation)
+{
+    // The child of a fork must not repeat its parent's stream:
+    static const int atFork = pthread_atfork(nullptr, nullptr, randomAtFork);
+    (void)atFork;
+
+    uint8_t seed[chachaSeedSize];
+    if (!RAND_bytes(seed, sizeof(seed)))
+        return ABC_ERROR(ABC_CC_Error, "Random data generation failed");
+
+    chachaKey(state, seed);
+    OPENSSL_cleanse(seed, sizeof(seed));
+    OPENSSL_cleanse(state.buffer, sizeof(state.buffer));
+    state.available = 0;
+    state.sinceSeed = 0;
+    state.generation = generation;
+    return Status();
+}
+
 /**
  * Sets the seed for the random number generator
  */
@@ -74,6 +210,7 @@ randomInitialize(DataSlice seed)
 
     // seed it
     RAND_seed(NewSeed.data(), NewSeed.size());
+    ++gRandomGeneration;
 
     // XXX Remove for production. Used to test performance of scrypt on various devices on startup
 #if DO_STARTUP_SCRYPT_TIMING
@@ -106,11 +243,26 @@ randomInitialize(DataSlice seed)
 Status
 randomData(DataChunk &result, size_t size)
 {
-    DataChunk out;
-    out.resize(size);
+    auto &state = tRandom;
+    const unsigned generation = gRandomGeneration;
+    if (state.generation != generation || reseedInterval <= state.sinceSeed)
+        ABC_CHECK(randomSeed(state, generation));
 
-    if (!RAND_bytes(out.data(), out.size()))
-        return ABC_ERROR(ABC_CC_Error, "Random data generation failed");
+    DataChunk out(size);
+    for (size_t i = 0; i < size;)
+    {
+        if (!state.available)
+            chachaRefill(state);
+
+        // Hand out bytes from the buffer, wiping them as they go:
+        const size_t n = std::min(state.available, size - i);
+        uint8_t *p = state.buffer + sizeof(state.buffer) - state.available;
+        memcpy(out.data() + i, p, n);
+        OPENSSL_cleanse(p, n);
+        state.available -= n;
+        i += n;
+    }
+    state.sinceSeed += size;
 
     result = std::move(out);
     return Status();
@@ -24,6 +24,8 @@ randomInitialize(DataSlice seed);
 
 /**
  * Generates cryptographically-secure random data.
+ * Each thread runs its own generator, seeded from OpenSSL,
+ * so this never waits on a lock.
  */
 Status
 randomData(DataChunk &result, size_t size);
@@ -7,11 +7,20 @@
 
 #include "Scrypt.hpp"
 #include "Random.hpp"
-#include "../util/Debug.hpp"
+#include "../Context.hpp"
 #include "../bitcoin/Testnet.hpp"
+#include "../json/JsonObject.hpp"
+#include "../util/Debug.hpp"
+#include "../util/Metrics.hpp"
+#include "../util/TaskPool.hpp"
+#include "../util/Trace.hpp"
 #include "../../minilibs/scrypt/crypto_scrypt.h"
 #include <sys/time.h>
 #include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace abcd {
 
@@ -29,6 +38,145 @@ namespace abcd {
 
 #define SCRYPT_DEFAULT_SALT_LENGTH 32
 
+// Calibration sweep, from cache-sized to phone-RAM-sized scratch buffers:
+constexpr struct
+{
+    uint64_t n;
+    uint32_t r;
+} calibrationCandidates[] =
+{
+    {1 << 14, 1}, {1 << 12, 8}, {1 << 14, 8}
+};
+constexpr unsigned calibrationRuns = 3; // Per candidate, after the warm-up
+constexpr time_t calibrationLifetime = 7 * 24 * 60 * 60;
+
+struct ScryptProfileJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(ScryptProfileJson, JsonObject)
+
+    ABC_JSON_NUMBER(blockTime, "blockTime", 0) // Microseconds per N * r
+    ABC_JSON_NUMBER(bandwidth, "bandwidth", 0) // Bytes per second
+    ABC_JSON_INTEGER(created, "created", 0)
+};
+
+/**
+ * Times one hash, in microseconds.
+ */
+static Status
+calibrationTime(unsigned long &result, uint64_t n, uint32_t r)
+{
+    ScryptSnrp snrp;
+    ABC_CHECK(randomData(snrp.salt, SCRYPT_DEFAULT_SALT_LENGTH));
+    snrp.n = n;
+    snrp.r = r;
+    snrp.p = 1;
+
+    DataChunk temp;
+    ABC_CHECK(snrp.hash(temp, snrp.salt, &result));
+    return Status();
+}
+
+/**
+ * Runs the calibration sweep, returning the cost per unit of N * r.
+ * The slowest candidate sets the figure, which is usually the one
+ * that spills out of the caches the way real parameters will.
+ */
+static Status
+calibrate(ScryptProfileJson &result)
+{
+    // Warm up the caches and clocks:
+    unsigned long ignored;
+    ABC_CHECK(calibrationTime(ignored, SCRYPT_DEFAULT_CLIENT_N, 1));
+
+    double blockTime = 0;
+    double bandwidth = 0;
+    for (const auto &candidate: calibrationCandidates)
+    {
+        std::vector<unsigned long> times;
+        for (unsigned i = 0; i < calibrationRuns; ++i)
+        {
+            unsigned long time;
+            ABC_CHECK(calibrationTime(time, candidate.n, candidate.r));
+            times.push_back(time ? time : 1);
+        }
+        std::sort(times.begin(), times.end());
+        const double median = times[times.size() / 2];
+
+        // Each V block is written once and read once:
+        const double units = candidate.n * candidate.r;
+        blockTime = std::max(blockTime, median / units);
+        const double rate = 2 * 128 * units / (median / 1000000);
+        bandwidth = bandwidth ? std::min(bandwidth, rate) : rate;
+        ABC_DebugLevel(1, "Scrypt calibration Nr=%llu %lu median=%.0fus",
+                       (unsigned long long)candidate.n,
+                       (unsigned long)candidate.r, median);
+    }
+
+    ScryptProfileJson out;
+    ABC_CHECK(out.blockTimeSet(blockTime));
+    ABC_CHECK(out.bandwidthSet(bandwidth));
+    ABC_CHECK(out.createdSet(time(nullptr)));
+    result = out;
+    return Status();
+}
+
+static std::mutex profileMutex;
+static std::atomic<bool> profileCalibrating{false};
+
+/**
+ * Runs the calibration sweep on the task pool and saves the result,
+ * unless a sweep is already under way.
+ */
+static void
+scryptProfileRefresh(const std::string &path)
+{
+    if (profileCalibrating.exchange(true))
+        return;
+
+    taskPoolRun([path]()
+    {
+        ScryptProfileJson profile;
+        if (calibrate(profile).log())
+        {
+            ABC_DebugLog("Scrypt profile: %.4fus per block, %.0fMB/s",
+                         profile.blockTime(), profile.bandwidth() / 1000000);
+            std::lock_guard<std::mutex> lock(profileMutex);
+            profile.save(path).log();
+        }
+        profileCalibrating = false;
+    });
+}
+
+/**
+ * Returns the device's saved scrypt speed.
+ * If the profile is missing or stale, this fails,
+ * but starts a fresh calibration in the background for next time.
+ */
+static Status
+scryptProfile(ScryptProfileJson &result)
+{
+    const auto path = gContext ? gContext->paths.scryptProfilePath() : "";
+    if (path.empty())
+        return ABC_ERROR(ABC_CC_FileDoesNotExist, "No scrypt profile");
+
+    ScryptProfileJson profile;
+    const auto now = time(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(profileMutex);
+        if (profile.load(path) && 0 < profile.blockTime() &&
+                now < profile.created() + calibrationLifetime &&
+                profile.created() <= now)
+        {
+            result = profile;
+            return Status();
+        }
+    }
+
+    scryptProfileRefresh(path);
+    return ABC_ERROR(ABC_CC_FileDoesNotExist, "No scrypt profile");
+}
+
 void
 ScryptSnrp::createSnrpFromTime(unsigned long totalTime)
 {
@@ -152,12 +300,20 @@ ScryptSnrp::create()
     r = SCRYPT_DEFAULT_CLIENT_R;
     p = SCRYPT_DEFAULT_CLIENT_P;
 
-    // Benchmark the CPU:
+    // Estimate a 16384-1-1 hash from the calibrated device profile,
+    // which is steadier than timing a single hash:
+    ScryptProfileJson profile;
+    if (scryptProfile(profile))
+    {
+        createSnrpFromTime(static_cast<unsigned long>(
+                               profile.blockTime() * SCRYPT_DEFAULT_CLIENT_N));
+        return Status();
+    }
+
+    // Until the profile exists, benchmark the CPU the old way:
     DataChunk temp;
     unsigned long totalTime;
-
     ABC_CHECK(hash(temp, salt, &totalTime));
-
     createSnrpFromTime(totalTime);
 
     return Status();
@@ -172,8 +328,12 @@ ScryptSnrp::hash(DataChunk &result, DataSlice data, unsigned long *time,
     struct timeval timerStart;
     struct timeval timerEnd;
     gettimeofday(&timerStart, nullptr);
-    int rc = crypto_scrypt(data.data(), data.size(),
+    int rc;
+    {
+        TraceScope scope(TraceEvent::scryptHash, 0, n, r);
+        rc = crypto_scrypt(data.data(), data.size(),
                            salt.data(), salt.size(), n, r, p, out.data(), size);
+    }
     gettimeofday(&timerEnd, nullptr);
 
     // Find the time in microseconds:
@@ -184,6 +344,8 @@ ScryptSnrp::hash(DataChunk &result, DataSlice data, unsigned long *time,
     ABC_DebugLevel(1, "ScryptSnrp::hash Nrp=%llu %lu %lu time=%lu",
                    (unsigned long long) n, (unsigned long) r, (unsigned long) p, totalTime);
 
+    static auto &duration = metricHistogram("scrypt.hash_us");
+    duration.record(totalTime);
     if (time)
         *time = totalTime;
 
@@ -194,6 +356,35 @@ ScryptSnrp::hash(DataChunk &result, DataSlice data, unsigned long *time,
     return Status();
 }
 
+Status
+scryptHashAll(const std::vector<ScryptJob> &jobs)
+{
+    std::vector<Status> results(jobs.size());
+    auto work = [&jobs, &results](size_t i)
+    {
+        results[i] = jobs[i].snrp.hash(*jobs[i].result, jobs[i].data);
+    };
+
+    // The calling thread does the first job itself:
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < jobs.size(); ++i)
+        threads.emplace_back(work, i);
+    if (!jobs.empty())
+        work(0);
+    for (auto &thread: threads)
+        thread.join();
+
+    for (const auto &s: results)
+        ABC_CHECK(s);
+    return Status();
+}
+
+void
+scryptArenaFree()
+{
+    crypto_scrypt_arena_free();
+}
+
 const ScryptSnrp &
 usernameSnrp()
 {
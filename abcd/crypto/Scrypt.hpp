@@ -10,6 +10,7 @@
 
 #include "../util/Data.hpp"
 #include "../util/Status.hpp"
+#include <vector>
 
 namespace abcd {
 
@@ -27,7 +28,9 @@ struct ScryptSnrp
 
     /**
      * Initializes the parameters with a random salt and
-     * benchmarked difficulty settings.
+     * difficulty settings from the device's calibrated scrypt profile.
+     * Until that profile exists, this times a single hash instead,
+     * and calibrates in the background for next time.
      */
     Status
     create();
@@ -50,6 +53,30 @@ struct ScryptSnrp
 /**
  * Returns the fixed SNRP value used for the username.
  */
+/**
+ * One of several independent hashes for `scryptHashAll`.
+ */
+struct ScryptJob
+{
+    ScryptSnrp snrp;
+    DataSlice data;
+    DataChunk *result;
+};
+
+/**
+ * Computes several independent scrypt hashes at once,
+ * each on its own thread, so a login's keys cost
+ * about as much wall time as the slowest one.
+ */
+Status
+scryptHashAll(const std::vector<ScryptJob> &jobs);
+
+/**
+ * Frees the scratch memory scrypt keeps around between hashes.
+ */
+void
+scryptArenaFree();
+
 const ScryptSnrp &
 usernameSnrp();
 
@@ -9,85 +9,202 @@
 #include "../RootPaths.hpp"
 #include "../json/JsonArray.hpp"
 #include "../json/JsonObject.hpp"
+#include "../json/JsonSchema.hpp"
 #include "../util/Debug.hpp"
+#include "../util/Metrics.hpp"
+#include <chrono>
+#include <thread>
 
 namespace abcd {
 
 #define SATOSHI_PER_BITCOIN 100000000
 
+// How long to wait on another process's fetch before doing our own:
+constexpr auto fetchWaitMax = std::chrono::seconds(10);
+constexpr auto fetchWaitPoll = std::chrono::milliseconds(100);
+
+/**
+ * Finds a currency's row in the table, or returns null.
+ */
+template<typename Table> static const typename Table::value_type *
+cacheRow(const Table &table, Currency currency)
+{
+    const auto index = static_cast<size_t>(currency);
+    if (table.size() <= index || !table[index].rate)
+        return nullptr;
+    return &table[index];
+}
+
 struct CacheJson:
     public JsonObject
 {
     ABC_JSON_VALUE(rates, "rates", JsonArray)
 };
 
-struct CacheJsonRow:
-    public JsonObject
+struct CacheJsonRow
 {
-    ABC_JSON_CONSTRUCTORS(CacheJsonRow, JsonObject)
-    ABC_JSON_STRING(code, "code", nullptr)
-    ABC_JSON_NUMBER(rate, "rate", 1)
-    ABC_JSON_INTEGER(timestamp, "timestamp", 0)
+    std::string code;
+    double rate = 1;
+    time_t timestamp = 0;
 };
 
-ExchangeCache::ExchangeCache(const std::string &path):
-    path_(path)
+static const auto rowSchema = jsonSchema(
+    jsonField("code", &CacheJsonRow::code, jsonRequired),
+    jsonField("rate", &CacheJsonRow::rate, jsonRequired),
+    jsonField("timestamp", &CacheJsonRow::timestamp, jsonRequired));
+
+ExchangeCache::~ExchangeCache()
+{
+    // The background load and fetches point back at us:
+    loaded_.wait();
+    std::unique_lock<std::mutex> lock(fetchMutex_);
+    fetchDone_.wait(lock, [this]()
+    {
+        return !fetching_;
+    });
+}
+
+ExchangeCache::ExchangeCache(const std::string &path,
+                             const std::string &historyPath,
+                             std::shared_ptr<SharedState> shared):
+    path_(path),
+    history_(historyPath),
+    shared_(shared),
+    seen_(shared->get(SharedSlot::exchangeRates)),
+    cache_(std::make_shared<CacheTable>(CacheTable()))
 {
-    load(); // Nothing bad happens if this fails
+    loaded_ = std::async(std::launch::async, [this]()
+    {
+        load(); // Nothing bad happens if this fails
+    }).share();
 }
 
 Status
 ExchangeCache::update(Currencies currencies, const ExchangeSources &sources)
 {
-    // No mutex, since we are making network calls.
-    // We only call member functions that provide their own mutexes.
+    // The saved rates may be fresh enough to skip the fetch:
+    loaded_.wait();
+    follow();
 
     time_t now = time(nullptr);
     if (fresh(currencies, now))
         return Status();
 
-    ExchangeRates allRates;
-    for (auto source: sources)
+    // Let one process do the fetching, while the others wait for its save:
+    auto writer = shared_->writerTry(SharedSlot::exchangeRates);
+    if (!writer)
     {
-        // Stop if the todo list is empty:
-        if (currencies.empty())
-            break;
+        const auto version = shared_->get(SharedSlot::exchangeRates);
+        const auto deadline = std::chrono::steady_clock::now() + fetchWaitMax;
+        while (version == shared_->get(SharedSlot::exchangeRates) &&
+                std::chrono::steady_clock::now() < deadline)
+            std::this_thread::sleep_for(fetchWaitPoll);
+
+        follow();
+        now = time(nullptr);
+        if (fresh(currencies, now))
+            return Status();
+    }
 
-        ABC_DebugLevel(1, "ExchangeCache::update() %s", source.c_str());
+    // Join a round that is already running, if there is one,
+    // since every source returns every currency it knows:
+    std::shared_ptr<FetchRound> round;
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex_);
+        round = round_.lock();
+        if (round)
+        {
+            std::lock_guard<std::mutex> roundLock(round->mutex);
+            if (round->pending)
+            {
+                for (auto currency: currencies)
+                    if (!round->rank.count(currency))
+                        round->todo.insert(currency);
+            }
+            else
+            {
+                round.reset();
+            }
+        }
+        if (!round)
+        {
+            round = std::make_shared<FetchRound>();
+            round->now = now;
+            round->todo = currencies;
+            round->pending = sources.size();
+            round->writer = std::move(writer);
+            round_ = round;
+
+            size_t rank = 0;
+            for (const auto &source: sources)
+            {
+                ++fetching_;
+                std::thread thread(&ExchangeCache::fetch, this,
+                                   round, source, rank++);
+                thread.detach();
+            }
+        }
+    }
 
-        // Grab the rates from the server:
-        ExchangeRates rates;
-        ExchangeRates ratesWanted;
-        if (!exchangeSourceFetch(rates, source))
-            continue; // Just skip the failed ones
+    // Wait for the first answer to each currency:
+    std::unique_lock<std::mutex> lock(round->mutex);
+    round->done.wait(lock, [&round]()
+    {
+        return round->todo.empty() || !round->pending;
+    });
+
+    return Status();
+}
+
+void
+ExchangeCache::fetch(std::shared_ptr<FetchRound> round,
+                     const std::string &source, size_t rank)
+{
+    ABC_DebugLevel(1, "ExchangeCache::update() %s", source.c_str());
+
+    // Grab the rates from the server, skipping the failed ones:
+    ExchangeRates rates;
+    if (exchangeSourceFetch(rates, source).log())
+    {
+        std::lock_guard<std::mutex> lock(round->mutex);
 
-        // Remove any new rates from the todo list:
+        // Keep the rates that beat what earlier arrivals gave us:
+        ExchangeRates better;
         for (auto rate: rates)
         {
-            auto i = currencies.find(rate.first);
-            if (currencies.end() != i)
-            {
-                currencies.erase(i);
-                ratesWanted.insert(rate);
-
-                std::string code;
-                ABC_CHECK(currencyCode(code, rate.first));
-                ABC_DebugLevel(1, "ExchangeCache::update() %s %s %.2f", source.c_str(),
-                               code.c_str(), rate.second);
-            }
+            auto i = round->rank.find(rate.first);
+            if (round->rank.end() != i && i->second < rank)
+                continue;
+            round->rank[rate.first] = rank;
+            round->todo.erase(rate.first);
+            better.insert(rate);
+
+            std::string code;
+            if (currencyCode(code, rate.first))
+                ABC_DebugLevel(1, "ExchangeCache::update() %s %s %.2f",
+                               source.c_str(), code.c_str(), rate.second);
         }
 
-        // Add any new rates to the allRates list:
-        ratesWanted.insert(allRates.begin(), allRates.end());
-        allRates = std::move(ratesWanted);
+        // Add the rates to the cache:
+        if (!better.empty())
+        {
+            update(better, round->now);
+            save().log();
+            for (auto rate: better)
+                history_.insert(rate.first, round->now, rate.second);
+            history_.save().log(); // Failure is fine
+        }
     }
 
-    // Add the rates to the cache:
-    for (auto rate: allRates)
-        ABC_CHECK(update(rate.first, rate.second, now));
-    ABC_CHECK(save());
+    {
+        std::lock_guard<std::mutex> lock(round->mutex);
+        --round->pending;
+        round->done.notify_all();
+    }
 
-    return Status();
+    std::lock_guard<std::mutex> lock(fetchMutex_);
+    --fetching_;
+    fetchDone_.notify_all();
 }
 
 Status
@@ -102,6 +219,19 @@ ExchangeCache::satoshiToCurrency(double &result, int64_t in, Currency currency)
     return Status();
 }
 
+Status
+ExchangeCache::satoshiToCurrency(double *result, const int64_t *in,
+                                 size_t count, Currency currency)
+{
+    double r;
+    ABC_CHECK(rate(r, currency));
+
+    const double scale = r / SATOSHI_PER_BITCOIN;
+    for (size_t i = 0; i < count; ++i)
+        result[i] = in[i] * scale;
+    return Status();
+}
+
 Status
 ExchangeCache::currencyToSatoshi(int64_t &result, double in, Currency currency)
 {
@@ -114,57 +244,129 @@ ExchangeCache::currencyToSatoshi(int64_t &result, double in, Currency currency)
     return Status();
 }
 
+Status
+ExchangeCache::satoshiToCurrencyAt(std::vector<double> &result,
+                                   const std::vector<int64_t> &satoshi,
+                                   const std::vector<time_t> &times,
+                                   Currency currency)
+{
+    if (satoshi.size() != times.size())
+        return ABC_ERROR(ABC_CC_Error, "Mismatched amounts and times");
+
+    std::vector<double> rates;
+    history_.rates(rates, times, currency);
+
+    // Fill any holes with today's rate:
+    double current = 0;
+    const bool currentOk = !!rate(current, currency);
+    for (auto &r: rates)
+    {
+        if (r)
+            continue;
+        if (!currentOk)
+            return ABC_ERROR(ABC_CC_Error, "Currency not in cache");
+        r = current;
+    }
+
+    result.resize(satoshi.size());
+    for (size_t i = 0; i < satoshi.size(); ++i)
+        result[i] = satoshi[i] * (rates[i] / SATOSHI_PER_BITCOIN);
+    return Status();
+}
+
+Status
+ExchangeCache::historyInsert(Currency currency,
+                             const std::vector<time_t> &times,
+                             const std::vector<double> &rates)
+{
+    if (rates.size() != times.size())
+        return ABC_ERROR(ABC_CC_Error, "Mismatched rates and times");
+
+    for (size_t i = 0; i < rates.size(); ++i)
+        history_.insert(currency, times[i], rates[i]);
+    ABC_CHECK(history_.save());
+    return Status();
+}
+
 Status
 ExchangeCache::load()
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
+    auto cache = std::make_shared<CacheTable>(CacheTable());
     CacheJson json;
-    ABC_CHECK(json.load(path_));
+    ABC_CHECK(json.loadChecked(path_));
 
     auto arrayJson = json.rates();
     auto size = arrayJson.size();
     for (size_t i = 0; i < size; i++)
     {
-        CacheJsonRow row(arrayJson[i]);
-        ABC_CHECK(row.codeOk());
-        ABC_CHECK(row.rateOk());
-        ABC_CHECK(row.timestampOk());
+        CacheJsonRow row;
+        ABC_CHECK(rowSchema.decode(row, json_array_get(arrayJson.get(), i)));
 
         Currency currency;
-        ABC_CHECK(currencyNumber(currency, row.code()));
-        cache_[currency] =
-            CacheRow{row.rate(), static_cast<time_t>(row.timestamp())};
+        ABC_CHECK(currencyNumber(currency, row.code));
+        const auto index = static_cast<size_t>(currency);
+        if (cache->size() <= index)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad currency number");
+        (*cache)[index] = CacheRow{row.rate, row.timestamp};
     }
 
+    const auto current = std::atomic_load(&cache_);
+    for (size_t i = 0; i < cache->size(); ++i)
+        if ((*cache)[i].timestamp < (*current)[i].timestamp)
+            (*cache)[i] = (*current)[i];
+
+    std::atomic_store(&cache_, std::shared_ptr<const CacheTable>(cache));
     return Status();
 }
 
 Status
 ExchangeCache::save()
 {
+    static auto &duration = metricHistogram("exchangecache.save_us");
+    MetricTimer timer(duration);
     std::lock_guard<std::mutex> lock(mutex_);
 
+    const auto cache = std::atomic_load(&cache_);
     JsonArray rates;
-    for (const auto &i: cache_)
+    for (size_t i = 0; i < cache->size(); ++i)
     {
-        std::string code;
-        ABC_CHECK(currencyCode(code, i.first));
+        const auto &entry = (*cache)[i];
+        if (!entry.rate)
+            continue;
 
         CacheJsonRow row;
-        ABC_CHECK(row.codeSet(code));
-        ABC_CHECK(row.rateSet(i.second.rate));
-        ABC_CHECK(row.timestampSet(i.second.timestamp));
-        ABC_CHECK(rates.append(row));
+        ABC_CHECK(currencyCode(row.code, static_cast<Currency>(i)));
+        row.rate = entry.rate;
+        row.timestamp = entry.timestamp;
+
+        JsonPtr rowJson;
+        ABC_CHECK(rowSchema.encode(rowJson, row));
+        ABC_CHECK(rates.append(rowJson));
     }
 
     CacheJson json;
     ABC_CHECK(json.ratesSet(rates));
-    ABC_CHECK(json.save(path_));
+    ABC_CHECK(json.saveChecked(path_));
+
+    // Tell the other processes, but keep our own save from looking new.
+    // If someone else saved in between, leave that for `follow` to load:
+    auto seen = seen_.load();
+    if (shared_->bump(SharedSlot::exchangeRates) == seen + 1)
+        seen_.compare_exchange_strong(seen, seen + 1);
 
     return Status();
 }
 
+void
+ExchangeCache::follow()
+{
+    const auto version = shared_->get(SharedSlot::exchangeRates);
+    if (seen_.exchange(version) != version)
+        load().log();
+}
+
 // Do not use the cached exchage rate value if it is older than the specified
 // number of seconds
 #define ABC_EXCHANGE_RATE_EXPIRE_INTERVAL_SECONDS 86400 // 24 hours
@@ -172,40 +374,61 @@ ExchangeCache::save()
 Status
 ExchangeCache::rate(double &result, Currency currency)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-
+    static auto &hits = metricCounter("exchangecache.rate_hit");
+    static auto &misses = metricCounter("exchangecache.rate_miss");
     time_t now = time(nullptr);
+    follow();
 
-    const auto &i = cache_.find(currency);
-    if (cache_.end() == i)
+    auto cache = std::atomic_load(&cache_);
+    auto row = cacheRow(*cache, currency);
+    if (!row)
+    {
+        // The rate could still be on its way in from disk:
+        loaded_.wait();
+        cache = std::atomic_load(&cache_);
+        row = cacheRow(*cache, currency);
+    }
+    if (!row)
+    {
+        misses.add();
         return ABC_ERROR(ABC_CC_Error, "Currency not in cache");
-    if (i->second.timestamp + ABC_EXCHANGE_RATE_EXPIRE_INTERVAL_SECONDS < now)
+    }
+    if (row->timestamp + ABC_EXCHANGE_RATE_EXPIRE_INTERVAL_SECONDS < now)
+    {
+        misses.add();
         return ABC_ERROR(ABC_CC_Error, "Currency expired. Need to update");
+    }
 
-    result = i->second.rate;
+    hits.add();
+    result = row->rate;
     return Status();
 }
 
-Status
-ExchangeCache::update(Currency currency, double rate, time_t now)
+void
+ExchangeCache::update(const ExchangeRates &rates, time_t now)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    cache_[currency] = CacheRow{rate, now};
-    return Status();
+    auto cache = std::make_shared<CacheTable>(*std::atomic_load(&cache_));
+    for (auto rate: rates)
+    {
+        const auto index = static_cast<size_t>(rate.first);
+        if (index < cache->size() && rate.second)
+            (*cache)[index] = CacheRow{rate.second, now};
+    }
+    std::atomic_store(&cache_, std::shared_ptr<const CacheTable>(cache));
 }
 
 bool
 ExchangeCache::fresh(const Currencies &currencies, time_t now)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-
+    const auto cache = std::atomic_load(&cache_);
     for (auto currency: currencies)
     {
-        auto i = cache_.find(currency);
-        if (cache_.end() == i)
+        const auto row = cacheRow(*cache, currency);
+        if (!row)
             return false;
-        if (i->second.timestamp + ABC_EXCHANGE_RATE_REFRESH_INTERVAL_SECONDS < now)
+        if (row->timestamp + ABC_EXCHANGE_RATE_REFRESH_INTERVAL_SECONDS < now)
             return false;
     }
     return true;
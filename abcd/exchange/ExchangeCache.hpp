@@ -9,23 +9,45 @@
 #define ABCD_EXCHANGE_EXCHANGE_CACHE_H
 
 #include "Currency.hpp"
+#include "ExchangeHistory.hpp"
 #include "ExchangeSource.hpp"
+#include "../util/SharedState.hpp"
 #include <time.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <future>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace abcd {
 
 /**
  * A cache for Bitcoin rates.
+ * Readers see an immutable rate table that gets swapped out whole,
+ * so lookups never wait on an update.
+ * The table is a flat array indexed by ISO 4217 number,
+ * so a lookup is a single load.
+ * Processes sharing the root take turns fetching,
+ * and pick up each other's saved rates.
  */
 class ExchangeCache
 {
 public:
-    ExchangeCache(const std::string &path);
+    ~ExchangeCache();
+    ExchangeCache(const std::string &path, const std::string &historyPath,
+                  std::shared_ptr<SharedState> shared);
 
     /**
-     * Updates the exchange rates, trying the sources in the given order.
+     * Updates the exchange rates, asking every source at once.
+     * Returns as soon as each requested currency has an answer,
+     * while slower sources keep running in the background.
+     * Sources earlier in the list win over later ones,
+     * even if their answer arrives after a later source's.
+     * If another process is already fetching, this waits a little while
+     * for its rates before fetching on its own.
      */
     Status
     update(Currencies currencies, const ExchangeSources &sources);
@@ -33,26 +55,92 @@ public:
     Status
     satoshiToCurrency(double &result, int64_t in, Currency currency);
 
+    /**
+     * Converts `count` amounts at the current rate,
+     * looking the rate up only once.
+     */
+    Status
+    satoshiToCurrency(double *result, const int64_t *in, size_t count,
+                      Currency currency);
+
     Status
     currencyToSatoshi(int64_t &result, double in, Currency currency);
 
+    /**
+     * Converts many amounts at once, each at the rate in effect
+     * at its own timestamp.
+     * Times the history cannot cover use the current rate.
+     */
+    Status
+    satoshiToCurrencyAt(std::vector<double> &result,
+                        const std::vector<int64_t> &satoshi,
+                        const std::vector<time_t> &times, Currency currency);
+
+    /**
+     * Adds past rates from an outside source to the history.
+     */
+    Status
+    historyInsert(Currency currency, const std::vector<time_t> &times,
+                  const std::vector<double> &rates);
+
 private:
-    mutable std::mutex mutex_;
+    mutable std::mutex mutex_; // Serializes writers only
     const std::string path_;
+    ExchangeHistory history_;
+    const std::shared_ptr<SharedState> shared_;
+    std::atomic<uint64_t> seen_; // The last shared save we have loaded
 
     struct CacheRow
     {
-        double rate;
+        double rate; // Zero for missing rows
         time_t timestamp;
     };
-    std::map<Currency, CacheRow> cache_;
+    typedef std::array<CacheRow, 1000> CacheTable;
+    std::shared_ptr<const CacheTable> cache_;
+
+    /**
+     * One round of fetches, shared between the caller
+     * and the threads talking to each source.
+     */
+    struct FetchRound
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        time_t now;
+        Currencies todo;
+        std::map<Currency, size_t> rank; // Source index behind each rate
+        size_t pending;
+        SharedWriterPtr writer; // Keeps other processes from fetching
+    };
+    std::mutex fetchMutex_;
+    std::condition_variable fetchDone_;
+    size_t fetching_ = 0;
+    std::weak_ptr<FetchRound> round_;
+
+    // The disk load runs in the background, so construction is cheap:
+    std::shared_future<void> loaded_;
+
+    /**
+     * Fetches one source and merges its answer into the cache.
+     * Runs on its own thread.
+     */
+    void
+    fetch(std::shared_ptr<FetchRound> round, const std::string &source,
+          size_t rank);
 
     /**
      * Loads the cache from disk.
+     * Rows fetched while the load was running win over the disk copies.
      */
     Status
     load();
 
+    /**
+     * Re-loads the cache if another process has saved since we last looked.
+     */
+    void
+    follow();
+
     /**
      * Flushes the cache to disk.
      */
@@ -66,10 +154,10 @@ private:
     rate(double &result, Currency currency);
 
     /**
-     * Adds a rate to the cache.
+     * Swaps in a new rate table with the given rates added.
      */
-    Status
-    update(Currency currency, double rate, time_t now);
+    void
+    update(const ExchangeRates &rates, time_t now);
 
     /**
      * Returns true if all the listed rates are fresh in the cache.
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "ExchangeHistory.hpp"
+#include "../util/Data.hpp"
+#include "../util/FileIO.hpp"
+#include <string.h>
+#include <algorithm>
+
+namespace abcd {
+
+constexpr time_t bucketSize = 60 * 60; // One hour
+constexpr size_t entriesMax = 24 * 366 * 5; // Five years per currency
+
+// On disk, each entry is a 2-byte currency, a 4-byte bucket,
+// and an 8-byte rate, all in host byte order:
+constexpr size_t recordSize = 2 + 4 + 8;
+
+ExchangeHistory::ExchangeHistory(const std::string &path):
+    path_(path)
+{
+    load(); // Nothing bad happens if this fails
+}
+
+void
+ExchangeHistory::insert(Currency currency, time_t time, double rate)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const uint32_t bucket = time / bucketSize;
+    auto &list = entries_[currency];
+    auto i = std::lower_bound(list.begin(), list.end(), bucket,
+                              [](const Entry &entry, uint32_t bucket)
+    {
+        return entry.bucket < bucket;
+    });
+    if (list.end() != i && bucket == i->bucket)
+        i->rate = rate;
+    else
+        list.insert(i, Entry{bucket, rate});
+
+    if (entriesMax < list.size())
+        list.erase(list.begin(), list.end() - entriesMax);
+    dirty_ = true;
+}
+
+void
+ExchangeHistory::rates(std::vector<double> &result,
+                       const std::vector<time_t> &times,
+                       Currency currency) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    result.assign(times.size(), 0);
+    auto list = entries_.find(currency);
+    if (entries_.end() == list || list->second.empty())
+        return;
+    const auto &entries = list->second;
+
+    for (size_t i = 0; i < times.size(); ++i)
+    {
+        const uint32_t bucket = times[i] / bucketSize;
+        auto j = std::upper_bound(entries.begin(), entries.end(), bucket,
+                                  [](uint32_t bucket, const Entry &entry)
+        {
+            return bucket < entry.bucket;
+        });
+        if (entries.begin() != j)
+            --j;
+        result[i] = j->rate;
+    }
+}
+
+Status
+ExchangeHistory::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_)
+        return Status();
+
+    DataChunk data;
+    for (const auto &list: entries_)
+    {
+        const uint16_t currency = static_cast<uint16_t>(list.first);
+        for (const auto &entry: list.second)
+        {
+            const auto size = data.size();
+            data.resize(size + recordSize);
+            memcpy(&data[size], &currency, 2);
+            memcpy(&data[size + 2], &entry.bucket, 4);
+            memcpy(&data[size + 6], &entry.rate, 8);
+        }
+    }
+
+    ABC_CHECK(fileSaveChecked(data, path_));
+    dirty_ = false;
+    return Status();
+}
+
+Status
+ExchangeHistory::load()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DataChunk data;
+    ABC_CHECK(fileLoadChecked(data, path_));
+    if (data.size() % recordSize)
+        return ABC_ERROR(ABC_CC_ParseError, "Bad exchange history size");
+
+    // The file is written in order, so the lists come out sorted:
+    entries_.clear();
+    for (size_t i = 0; i < data.size(); i += recordSize)
+    {
+        uint16_t currency;
+        Entry entry;
+        memcpy(&currency, &data[i], 2);
+        memcpy(&entry.bucket, &data[i + 2], 4);
+        memcpy(&entry.rate, &data[i + 6], 8);
+        entries_[static_cast<Currency>(currency)].push_back(entry);
+    }
+
+    return Status();
+}
+
+} // namespace abcd
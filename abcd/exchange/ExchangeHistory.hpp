@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A compact record of past exchange rates.
+ */
+
+#ifndef ABCD_EXCHANGE_EXCHANGE_HISTORY_HPP
+#define ABCD_EXCHANGE_EXCHANGE_HISTORY_HPP
+
+#include "Currency.hpp"
+#include <time.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * Keeps one exchange rate per currency per hour,
+ * so old transactions can be valued at the rate of their day
+ * without asking a server.
+ */
+class ExchangeHistory
+{
+public:
+    ExchangeHistory(const std::string &path);
+
+    /**
+     * Records a rate, replacing anything already in that hour.
+     */
+    void
+    insert(Currency currency, time_t time, double rate);
+
+    /**
+     * Looks up the rate in effect at each of the given times,
+     * using the closest earlier hour, or the earliest known one
+     * for times before the history starts.
+     * Leaves a zero wherever the currency has no history at all.
+     */
+    void
+    rates(std::vector<double> &result, const std::vector<time_t> &times,
+          Currency currency) const;
+
+    /**
+     * Writes the history to disk, if it has changed.
+     */
+    Status
+    save();
+
+private:
+    struct Entry
+    {
+        uint32_t bucket;
+        double rate;
+    };
+
+    mutable std::mutex mutex_;
+    const std::string path_;
+    std::map<Currency, std::vector<Entry>> entries_; // Sorted by bucket
+    bool dirty_ = false;
+
+    Status
+    load();
+};
+
+} // namespace abcd
+
+#endif
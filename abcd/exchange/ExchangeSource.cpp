@@ -6,9 +6,11 @@
  */
 
 #include "ExchangeSource.hpp"
+#include "../Context.hpp"
 #include "../http/HttpRequest.hpp"
 #include "../json/JsonArray.hpp"
 #include "../json/JsonObject.hpp"
+#include "../util/FileIO.hpp"
 #include <string.h>
 #include <stdlib.h>
 
@@ -59,17 +61,13 @@ doubleDecode(double &result, const char *in)
 }
 
 /**
- * Fetches exchange rates from the Bitstamp source.
+ * Decodes exchange rates from the Bitstamp source.
  */
 static Status
-fetchBitstamp(ExchangeRates &result)
+decodeBitstamp(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply, "https://www.bitstamp.net/api/ticker/"));
-    ABC_CHECK(reply.codeOk());
-
     BitstampJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     ABC_CHECK(json.rateOk());
 
     double rate;
@@ -82,18 +80,13 @@ fetchBitstamp(ExchangeRates &result)
 }
 
 /**
- * Fetches exchange rates from the Bitfinex source.
+ * Decodes exchange rates from the Bitfinex source.
  */
 static Status
-fetchBitfinex(ExchangeRates &result)
+decodeBitfinex(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://api.bitfinex.com/v1/pubticker/btcusd"));
-    ABC_CHECK(reply.codeOk());
-
     BitfinexJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     ABC_CHECK(json.rateOk());
 
     double rate;
@@ -106,17 +99,13 @@ fetchBitfinex(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the BraveNewCoin source.
+ * Decodes exchange rates from the BraveNewCoin source.
  */
 static Status
-fetchBraveNewCoin(ExchangeRates &result)
+decodeBraveNewCoin(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply, "http://api.bravenewcoin.com/rates.json"));
-    ABC_CHECK(reply.codeOk());
-
     BraveNewCoinJson json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
     auto rates = json.rates();
 
     // Break apart the array:
@@ -157,18 +146,13 @@ fetchBraveNewCoin(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the Coinbase source.
+ * Decodes exchange rates from the Coinbase source.
  */
 static Status
-fetchCoinbase(ExchangeRates &result)
+decodeCoinbase(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://coinbase.com/api/v1/currencies/exchange_rates"));
-    ABC_CHECK(reply.codeOk());
-
     JsonObject json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
 
     // Check for usable rates:
     ExchangeRates out;
@@ -204,18 +188,13 @@ fetchCoinbase(ExchangeRates &result)
 }
 
 /**
- * Fetches and decodes exchange rates from the BitcoinAverage source.
+ * Decodes exchange rates from the BitcoinAverage source.
  */
 static Status
-fetchBitcoinAverage(ExchangeRates &result)
+decodeBitcoinAverage(ExchangeRates &result, const std::string &body)
 {
-    HttpReply reply;
-    ABC_CHECK(HttpRequest().get(reply,
-                                "https://api.bitcoinaverage.com/ticker/global/all"));
-    ABC_CHECK(reply.codeOk());
-
     JsonObject json;
-    ABC_CHECK(json.decode(reply.body));
+    ABC_CHECK(json.decode(body));
 
     // Check for usable rates:
     ExchangeRates out;
@@ -254,15 +233,57 @@ fetchBitcoinAverage(ExchangeRates &result)
     return Status();
 }
 
+/**
+ * Where each source keeps its rates, and how to read them.
+ */
+struct ExchangeSourceInfo
+{
+    const char *name;
+    const char *url;
+    Status (*decode)(ExchangeRates &result, const std::string &body);
+};
+
+static const ExchangeSourceInfo sourceInfos[] =
+{
+    {"Bitstamp", "https://www.bitstamp.net/api/ticker/", decodeBitstamp},
+    {"Bitfinex", "https://api.bitfinex.com/v1/pubticker/btcusd", decodeBitfinex},
+    {
+        "BitcoinAverage", "https://api.bitcoinaverage.com/ticker/global/all",
+        decodeBitcoinAverage
+    },
+    {"BraveNewCoin", "http://api.bravenewcoin.com/rates.json", decodeBraveNewCoin},
+    {
+        "Coinbase", "https://coinbase.com/api/v1/currencies/exchange_rates",
+        decodeCoinbase
+    },
+};
 
 Status
 exchangeSourceFetch(ExchangeRates &result, const std::string &source)
 {
-    if (source == "Bitstamp")       return fetchBitstamp(result);
-    if (source == "Bitfinex")       return fetchBitfinex(result);
-    if (source == "BitcoinAverage") return fetchBitcoinAverage(result);
-    if (source == "BraveNewCoin")   return fetchBraveNewCoin(result);
-    if (source == "Coinbase")       return fetchCoinbase(result);
+    for (const auto &info: sourceInfos)
+    {
+        if (source != info.name)
+            continue;
+
+        // Rate tables often sit unchanged between app starts,
+        // so keep the last one around to answer 304 replies:
+        const auto path = gContext->paths.exchangeSourcePath(source);
+        HttpReply reply;
+        ABC_CHECK(HttpRequest().ifChanged(path).get(reply, info.url));
+        if (reply.notModified())
+        {
+            DataChunk data;
+            ABC_CHECK(fileLoad(data, path));
+            return info.decode(result, toString(data));
+        }
+        ABC_CHECK(reply.codeOk());
+
+        ABC_CHECK(info.decode(result, reply.body));
+        if (fileSave(reply.body, path).log())
+            httpValidatorsSave(path, reply).log();
+        return Status();
+    }
     return ABC_ERROR(ABC_CC_ParseError, "No exchange-rate source " + source);
 }
 
@@ -6,14 +6,18 @@
  */
 
 #include "Http.hpp"
+#include "../Context.hpp"
 #include <curl/curl.h>
 #include <openssl/ssl.h>
 #include <pthread.h>
 #include <memory>
 #include <mutex>
+#include <vector>
 
 namespace abcd {
 
+constexpr size_t idleHandlesMax = 8;
+
 /**
  * Manages the cURL library global memory lifetime.
  */
@@ -24,6 +28,17 @@ struct HttpSingleton
 
     std::unique_ptr<std::mutex[]> mutexes;
     Status status;
+
+    // Connection, DNS, and TLS session caches for every handle:
+    CURLSH *share = nullptr;
+    std::mutex shareMutexes[CURL_LOCK_DATA_LAST];
+
+    std::mutex idleMutex;
+    std::vector<CURL *> idle;
+
+    // The parsed CA bundle, shared by every TLS context:
+    std::mutex storeMutex;
+    X509_STORE *store = nullptr;
 };
 
 // Global variables:
@@ -48,8 +63,27 @@ sslThreadIdCallback(CRYPTO_THREADID *id)
 #endif
 }
 
+static void
+shareLockCallback(CURL *handle, curl_lock_data data, curl_lock_access access,
+                  void *userp)
+{
+    gSingleton.shareMutexes[data].lock();
+}
+
+static void
+shareUnlockCallback(CURL *handle, curl_lock_data data, void *userp)
+{
+    gSingleton.shareMutexes[data].unlock();
+}
+
 HttpSingleton::~HttpSingleton()
 {
+    for (auto handle: idle)
+        curl_easy_cleanup(handle);
+    if (share)
+        curl_share_cleanup(share);
+    if (store)
+        X509_STORE_free(store);
     curl_global_cleanup();
 }
 
@@ -62,7 +96,23 @@ HttpSingleton::HttpSingleton()
 
     // Initialize cURL:
     if (curl_global_init(CURL_GLOBAL_DEFAULT))
+    {
         status = ABC_ERROR(ABC_CC_Error, "Cannot initialize cURL");
+        return;
+    }
+
+    // Without the share, handles simply keep their own caches:
+    share = curl_share_init();
+    if (share)
+    {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, shareLockCallback);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, shareUnlockCallback);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    }
 }
 
 Status
@@ -71,4 +121,88 @@ httpInit()
     return gSingleton.status;
 }
 
+Status
+httpHandleGet(CURL *&result)
+{
+    ABC_CHECK(gSingleton.status);
+
+    CURL *handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(gSingleton.idleMutex);
+        if (!gSingleton.idle.empty())
+        {
+            handle = gSingleton.idle.back();
+            gSingleton.idle.pop_back();
+        }
+    }
+    if (!handle)
+        handle = curl_easy_init();
+    if (!handle)
+        return ABC_ERROR(ABC_CC_Error, "cURL failed create handle");
+
+    if (gSingleton.share)
+        curl_easy_setopt(handle, CURLOPT_SHARE, gSingleton.share);
+
+    result = handle;
+    return Status();
+}
+
+void
+httpHandleRelease(CURL *handle)
+{
+    // Clear out the last request's options, but keep its connections:
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(gSingleton.idleMutex);
+    if (gSingleton.idle.size() < idleHandlesMax)
+        gSingleton.idle.push_back(handle);
+    else
+        curl_easy_cleanup(handle);
+}
+
+Status
+httpCertStore(X509_STORE *&result)
+{
+    ABC_CHECK(gSingleton.status);
+
+    std::lock_guard<std::mutex> lock(gSingleton.storeMutex);
+    if (!gSingleton.store)
+    {
+        X509_STORE *store = X509_STORE_new();
+        if (!store)
+            return ABC_ERROR(ABC_CC_Error, "Cannot create certificate store");
+
+        const auto certPath = gContext ? gContext->paths.certPath() : "";
+        const int ok = certPath.empty() ?
+                       X509_STORE_set_default_paths(store) :
+                       X509_STORE_load_locations(store, certPath.c_str(),
+                                                 nullptr);
+        if (1 != ok)
+        {
+            X509_STORE_free(store);
+            return ABC_ERROR(ABC_CC_Error, "Unable to load caCerts");
+        }
+        gSingleton.store = store;
+    }
+
+    result = gSingleton.store;
+    return Status();
+}
+
+Status
+httpCertStoreAttach(SSL_CTX *ctx)
+{
+    X509_STORE *store;
+    ABC_CHECK(httpCertStore(store));
+
+    // The context frees its store, so it needs a reference of its own:
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    X509_STORE_up_ref(store);
+#else
+    CRYPTO_add(&store->references, 1, CRYPTO_LOCK_X509_STORE);
+#endif
+    SSL_CTX_set_cert_store(ctx, store);
+    return Status();
+}
+
 } // namespace abcd
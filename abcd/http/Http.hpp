@@ -10,6 +10,10 @@
 
 #include "../util/Status.hpp"
 
+typedef void CURL;
+typedef struct ssl_ctx_st SSL_CTX;
+typedef struct x509_store_st X509_STORE;
+
 namespace abcd {
 
 /**
@@ -18,6 +22,35 @@ namespace abcd {
 Status
 httpInit();
 
+/**
+ * Hands out a cURL easy handle, re-using an idle one if possible.
+ * Every handle shares one DNS cache, TLS session cache,
+ * and connection pool, so back-to-back requests to the same host
+ * skip the lookup and handshake.
+ */
+Status
+httpHandleGet(CURL *&result);
+
+/**
+ * Returns a handle to the idle pool once its request is done.
+ */
+void
+httpHandleRelease(CURL *handle);
+
+/**
+ * Returns the certificate store for the CA bundle, loading it on first use.
+ * The store belongs to the library, so callers must not free it.
+ */
+Status
+httpCertStore(X509_STORE *&result);
+
+/**
+ * Points an OpenSSL context at the shared certificate store,
+ * so the context can verify peers without reading the CA bundle again.
+ */
+Status
+httpCertStoreAttach(SSL_CTX *ctx);
+
 } // namespace abcd
 
 #endif
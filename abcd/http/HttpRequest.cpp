@@ -6,13 +6,51 @@
  */
 
 #include "HttpRequest.hpp"
+#include "Http.hpp"
 #include "../Context.hpp"
+#include "../json/JsonObject.hpp"
 #include "../util/Debug.hpp"
+#include "../util/FileIO.hpp"
+#include <openssl/ssl.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace abcd {
 
 #define TIMEOUT 10
 
+constexpr size_t uploadBufferSize = 16 * 1024;
+
+// Stored next to each cache file that has validators:
+constexpr char validatorsExtension[] = ".http";
+
+/**
+ * A GET on its way to the server, which identical GETs can wait on.
+ */
+struct HttpFlight
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    bool finished = false;
+    Status status;
+    HttpReply reply;
+};
+
+static std::mutex gFlightsMutex;
+static std::map<std::string, std::shared_ptr<HttpFlight>> gFlights;
+
+struct HttpValidatorsJson:
+    public JsonObject
+{
+    ABC_JSON_STRING(etag, "etag", nullptr)
+    ABC_JSON_STRING(lastModified, "lastModified", nullptr)
+};
+
 static Status curlOk(CURLcode code)
 {
     if (code)
@@ -53,6 +91,14 @@ curlDebugCallback(CURL *handle, curl_infotype type, char *data, size_t size,
     }
 }
 
+static CURLcode
+curlSslContextCallback(CURL *handle, void *sslContext, void *userp)
+{
+    if (!httpCertStoreAttach(static_cast<SSL_CTX *>(sslContext)).log())
+        return CURLE_SSL_CACERT_BADFILE;
+    return CURLE_OK;
+}
+
 static size_t
 curlDataCallback(void *data, size_t memberSize, size_t numMembers,
                  void *userData)
@@ -65,6 +111,137 @@ curlDataCallback(void *data, size_t memberSize, size_t numMembers,
     return size;
 }
 
+/**
+ * Picks the validators out of the response headers.
+ */
+static size_t
+curlHeaderCallback(char *data, size_t memberSize, size_t numMembers,
+                   void *userData)
+{
+    const auto size = numMembers * memberSize;
+    auto reply = static_cast<HttpReply *>(userData);
+
+    std::string line(data, size);
+    const auto colon = line.find(':');
+    if (std::string::npos == colon)
+        return size;
+    const auto start = line.find_first_not_of(" \t", colon + 1);
+    const auto end = line.find_last_not_of(" \t\r\n");
+    const auto value = std::string::npos == start || end < start ? std::string() :
+                       line.substr(start, end + 1 - start);
+
+    const auto name = line.substr(0, colon);
+    if (!strcasecmp(name.c_str(), "ETag"))
+        reply->etag = value;
+    else if (!strcasecmp(name.c_str(), "Last-Modified"))
+        reply->lastModified = value;
+    return size;
+}
+
+/**
+ * State for a streaming upload, shared with the cURL read callback.
+ */
+struct HttpUpload
+{
+    HttpBodySource source;
+    bool gzip;
+    bool sourceDone = false;
+    bool done = false;
+    z_stream z;
+    DataChunk pending;
+    size_t offset = 0;
+    Status status;
+
+    HttpUpload(HttpBodySource source, bool gzip):
+        source(source),
+        gzip(gzip)
+    {
+        memset(&z, 0, sizeof(z));
+    }
+
+    ~HttpUpload()
+    {
+        if (gzip)
+            deflateEnd(&z);
+    }
+
+    Status
+    init()
+    {
+        // 16 extra window bits selects the gzip wrapper:
+        if (gzip && Z_OK != deflateInit2(&z, Z_DEFAULT_COMPRESSION,
+                                         Z_DEFLATED, 15 + 16, 8,
+                                         Z_DEFAULT_STRATEGY))
+            return ABC_ERROR(ABC_CC_Error, "Cannot start compression");
+        return Status();
+    }
+
+    /**
+     * Refills the pending buffer, returning false at the end of the body.
+     */
+    Status
+    fill()
+    {
+        pending.clear();
+        offset = 0;
+        while (pending.empty() && !done)
+        {
+            DataChunk piece;
+            if (!sourceDone)
+            {
+                ABC_CHECK(source(piece));
+                sourceDone = piece.empty();
+            }
+
+            if (!gzip)
+            {
+                pending = std::move(piece);
+                done = sourceDone;
+                continue;
+            }
+
+            // Compress the piece, or flush the stream at the end:
+            z.next_in = piece.data();
+            z.avail_in = piece.size();
+            int code = Z_OK;
+            do
+            {
+                uint8_t out[uploadBufferSize];
+                z.next_out = out;
+                z.avail_out = sizeof(out);
+                code = deflate(&z, sourceDone ? Z_FINISH : Z_NO_FLUSH);
+                if (Z_STREAM_ERROR == code)
+                    return ABC_ERROR(ABC_CC_Error, "Compression failed");
+                pending.insert(pending.end(), out, z.next_out);
+            }
+            while (!z.avail_out || z.avail_in);
+            done = Z_STREAM_END == code;
+        }
+        return Status();
+    }
+};
+
+static size_t
+curlReadCallback(char *data, size_t memberSize, size_t numMembers,
+                 void *userData)
+{
+    auto upload = static_cast<HttpUpload *>(userData);
+    const auto size = memberSize * numMembers;
+
+    if (upload->pending.size() <= upload->offset)
+    {
+        upload->status = upload->fill();
+        if (!upload->status)
+            return CURL_READFUNC_ABORT;
+    }
+
+    const auto left = upload->pending.size() - upload->offset;
+    const auto count = size < left ? size : left;
+    memcpy(data, upload->pending.data() + upload->offset, count);
+    upload->offset += count;
+    return count;
+}
+
 Status
 HttpReply::codeOk() const
 {
@@ -74,9 +251,30 @@ HttpReply::codeOk() const
     return Status();
 }
 
+Status
+httpValidatorsSave(const std::string &cachePath, const HttpReply &reply)
+{
+    const auto path = cachePath + validatorsExtension;
+    if (reply.etag.empty() && reply.lastModified.empty())
+    {
+        // Old validators no longer describe the file:
+        if (fileExists(path))
+            ABC_CHECK(fileDelete(path));
+        return Status();
+    }
+
+    HttpValidatorsJson json;
+    if (!reply.etag.empty())
+        ABC_CHECK(json.etagSet(reply.etag));
+    if (!reply.lastModified.empty())
+        ABC_CHECK(json.lastModifiedSet(reply.lastModified));
+    ABC_CHECK(json.save(path));
+    return Status();
+}
+
 HttpRequest::~HttpRequest()
 {
-    if (handle_) curl_easy_cleanup(handle_);
+    if (handle_) httpHandleRelease(handle_);
     if (headers_) curl_slist_free_all(headers_);
 }
 
@@ -114,16 +312,79 @@ HttpRequest::header(const std::string &key, const std::string &value)
     return *this;
 }
 
+HttpRequest &
+HttpRequest::ifChanged(const std::string &cachePath)
+{
+    // Without the cached copy, a 304 would leave us with nothing:
+    HttpValidatorsJson json;
+    if (!status_ || !fileExists(cachePath) ||
+            !json.load(cachePath + validatorsExtension))
+        return *this;
+
+    if (json.etagOk())
+        header("If-None-Match", json.etag());
+    if (json.lastModifiedOk())
+        header("If-Modified-Since", json.lastModified());
+    return *this;
+}
+
 Status
 HttpRequest::get(HttpReply &result, const std::string &url)
 {
     if (!status_)
         return status_;
 
+    // Requests with the same URL and headers get the same answer:
+    std::string key = url;
+    for (auto header = headers_; header; header = header->next)
+        key += std::string("\n") + header->data;
+
+    std::shared_ptr<HttpFlight> flight;
+    bool leader = false;
+    {
+        std::lock_guard<std::mutex> lock(gFlightsMutex);
+        auto &slot = gFlights[key];
+        if (!slot)
+        {
+            slot = std::make_shared<HttpFlight>();
+            leader = true;
+        }
+        flight = slot;
+    }
+
+    if (!leader)
+    {
+        std::unique_lock<std::mutex> lock(flight->mutex);
+        flight->done.wait(lock, [&flight]() { return flight->finished; });
+        result = flight->reply;
+        return flight->status;
+    }
+
+    const auto s = perform(result, url);
+    {
+        std::lock_guard<std::mutex> lock(gFlightsMutex);
+        gFlights.erase(key);
+    }
+    {
+        std::lock_guard<std::mutex> lock(flight->mutex);
+        flight->status = s;
+        flight->reply = result;
+        flight->finished = true;
+    }
+    flight->done.notify_all();
+    return s;
+}
+
+Status
+HttpRequest::perform(HttpReply &result, const std::string &url)
+{
     // Final options:
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEDATA, &result.body));
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_WRITEFUNCTION,
                                     curlDataCallback));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_HEADERDATA, &result));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_HEADERFUNCTION,
+                                    curlHeaderCallback));
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_URL, url.c_str()));
     if (headers_)
         ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, headers_));
@@ -132,7 +393,7 @@ HttpRequest::get(HttpReply &result, const std::string &url)
     ABC_CHECK_CURL(curl_easy_perform(handle_));
     ABC_CHECK_CURL(curl_easy_getinfo(handle_, CURLINFO_RESPONSE_CODE,
                                      &result.code));
-    if (result.codeOk())
+    if (result.codeOk() || result.notModified())
         ABC_DebugLog("%s (%d)", url.c_str(), result.code);
     else
         ABC_DebugLog("%s (%d)\n%s", url.c_str(), result.code,
@@ -150,7 +411,29 @@ HttpRequest::post(HttpReply &result, const std::string &url,
 
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_POSTFIELDSIZE, body.size()));
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_POSTFIELDS, body.c_str()));
-    return get(result, url);
+    return perform(result, url);
+}
+
+Status
+HttpRequest::postStream(HttpReply &result, const std::string &url,
+                        HttpBodySource source, bool gzip)
+{
+    if (!status_)
+        return status_;
+
+    HttpUpload upload(source, gzip);
+    ABC_CHECK(upload.init());
+    if (gzip)
+        header("Content-Encoding", "gzip");
+
+    // With no size given, cURL sends the body in chunks:
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_POST, 1L));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_READDATA, &upload));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_READFUNCTION,
+                                    curlReadCallback));
+    const Status s = perform(result, url);
+    ABC_CHECK(upload.status);
+    return s;
 }
 
 Status
@@ -167,18 +450,33 @@ HttpRequest::request(HttpReply &result, const std::string &url,
 Status
 HttpRequest::init()
 {
-    handle_ = curl_easy_init();
-    if (!handle_)
-        return ABC_ERROR(ABC_CC_Error, "cURL failed create handle");
+    ABC_CHECK(httpHandleGet(handle_));
 
     // Basic options:
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_NOSIGNAL, 1));
     ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CONNECTTIMEOUT, TIMEOUT));
+    ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_TCP_KEEPALIVE, 1L));
+
+    // Prefer HTTP/2 over TLS, but older cURL builds may not have it:
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    curl_easy_setopt(handle_, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
 
-    const auto certPath = gContext->paths.certPath();
-    if (!certPath.empty())
-        ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CAINFO,
-                                        certPath.c_str()));
+    // Hand each TLS context the parsed CA bundle, rather than having
+    // cURL read the file again. Only the OpenSSL backend can do this:
+    if (CURLE_OK == curl_easy_setopt(handle_, CURLOPT_SSL_CTX_FUNCTION,
+                                     curlSslContextCallback))
+    {
+        ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CAINFO, nullptr));
+        ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CAPATH, nullptr));
+    }
+    else
+    {
+        const auto certPath = gContext->paths.certPath();
+        if (!certPath.empty())
+            ABC_CHECK_CURL(curl_easy_setopt(handle_, CURLOPT_CAINFO,
+                                            certPath.c_str()));
+    }
 
     return Status();
 }
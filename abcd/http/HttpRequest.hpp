@@ -8,8 +8,10 @@
 #ifndef ABCD_HTTP_HTTP_REQUEST_HPP
 #define ABCD_HTTP_HTTP_REQUEST_HPP
 
+#include "../util/Data.hpp"
 #include "../util/Status.hpp"
 #include <curl/curl.h>
+#include <functional>
 
 namespace abcd {
 
@@ -19,14 +21,37 @@ struct HttpReply
     int code;
     /** The returned message body. */
     std::string body;
+    /** The validators for conditional requests, if the server sent any. */
+    std::string etag;
+    std::string lastModified;
 
     /**
      * Verifies that the response code is in the 200 range.
      */
     Status
     codeOk() const;
+
+    /**
+     * Returns true if a conditional request found nothing new,
+     * in which case the body is empty.
+     */
+    bool
+    notModified() const { return 304 == code; }
 };
 
+/**
+ * Stores a reply's validators next to the file its body was cached in,
+ * for `HttpRequest::ifChanged` to use next time.
+ */
+Status
+httpValidatorsSave(const std::string &cachePath, const HttpReply &reply);
+
+/**
+ * Produces a request body a piece at a time.
+ * Returning an empty piece marks the end of the body.
+ */
+typedef std::function<Status (DataChunk &result)> HttpBodySource;
+
 /**
  * A class for building up and making HTTP requests.
  */
@@ -48,8 +73,19 @@ public:
     HttpRequest &
     header(const std::string &key, const std::string &value);
 
+    /**
+     * Asks the server to skip the body, replying with a 304,
+     * if the resource has not changed since it was cached at `cachePath`.
+     * This uses the validators `httpValidatorsSave` stored for the file,
+     * and has no effect if the file itself is missing.
+     */
+    HttpRequest &
+    ifChanged(const std::string &cachePath);
+
     /**
      * Performs an HTTP GET operation.
+     * If an identical GET is already on its way, this waits for that one
+     * and shares its reply, rather than making a second request.
      */
     Status
     get(HttpReply &result, const std::string &url);
@@ -61,6 +97,16 @@ public:
     post(HttpReply &result, const std::string &url,
          const std::string body="");
 
+    /**
+     * Performs an HTTP POST operation, pulling the body from a source
+     * as the connection can take it, so the whole body is never in memory.
+     * @param gzip true to compress the body on the fly,
+     * marking it with a `Content-Encoding: gzip` header.
+     */
+    Status
+    postStream(HttpReply &result, const std::string &url,
+               HttpBodySource source, bool gzip=false);
+
     /**
      * Performs an arbitrary HTTP operation.
      */
@@ -76,6 +122,12 @@ private:
     struct curl_slist *headers_;
 
     Status init();
+
+    /**
+     * Sends the request as configured so far.
+     */
+    Status
+    perform(HttpReply &result, const std::string &url);
 };
 
 } // namespace abcd
@@ -6,7 +6,6 @@
  */
 
 #include "Uri.hpp"
-#include "../crypto/Encoding.hpp"
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
@@ -58,19 +57,38 @@ static bool is_qchar(const char c)
     return is_query(c) && '&' != c && '=' != c;
 }
 
+static int
+hexValue(const char c)
+{
+    if ('0' <= c && c <= '9')
+        return c - '0';
+    if ('A' <= c && c <= 'F')
+        return c - 'A' + 10;
+    return c - 'a' + 10;
+}
+
+/**
+ * Returns true if a valid escape sequence starts at the given position.
+ */
+static bool
+isEscape(const char *i, const char *end)
+{
+    return '%' == *i && 2 < end - i && is_base16(i[1]) && is_base16(i[2]);
+}
+
 /**
  * Verifies that all RFC 3986 escape sequences in a string are valid,
  * and that all characters belong to the given class.
  */
 static bool
-validate(const std::string &in, bool (*is_valid)(const char))
+validate(UriSlice in, bool (*is_valid)(const char))
 {
     auto i = in.begin();
     while (in.end() != i)
     {
         if ('%' == *i)
         {
-            if (!(2 < in.end() - i && is_base16(i[1]) && is_base16(i[2])))
+            if (!isEscape(i, in.end()))
                 return false;
             i += 3;
         }
@@ -85,103 +103,124 @@ validate(const std::string &in, bool (*is_valid)(const char))
 }
 
 /**
- * Decodes all RFC 3986 escape sequences in a string.
+ * Decodes all RFC 3986 escape sequences in a string, in place.
  */
-static std::string
-unescape(const std::string &in)
+static void
+unescapeInPlace(std::string &s)
 {
-    // Do the conversion:
-    std::string out;
-    out.reserve(in.size());
-
-    auto i = in.begin();
-    while (in.end() != i)
+    const char *i = s.data();
+    const char *end = i + s.size();
+    size_t out = 0;
+    while (end != i)
     {
-        if ('%' == *i &&
-                2 < in.end() - i && is_base16(i[1]) && is_base16(i[2]))
+        if (isEscape(i, end))
         {
-            const char temp[] = {i[1], i[2], 0};
-            DataChunk value;
-            base16Decode(value, temp);
-            out.push_back(value[0]);
+            s[out++] = static_cast<char>(hexValue(i[1]) << 4 | hexValue(i[2]));
             i += 3;
         }
         else
         {
-            out.push_back(*i);
+            s[out++] = *i;
             i += 1;
         }
     }
-    return out;
+    s.resize(out);
 }
 
-/**
- * Percent-encodes a string.
- * @param is_valid a function returning true for acceptable characters.
- */
 static std::string
-escape(const std::string &in, bool (*is_valid)(char))
+unescape(const std::string &in)
 {
-    std::ostringstream stream;
-    stream << std::hex << std::uppercase << std::setfill('0');
-    for (auto c: in)
+    auto out = in;
+    unescapeInPlace(out);
+    return out;
+}
+
+void
+UriSlice::unescape(std::string &result) const
+{
+    result.assign(begin_, end_);
+    unescapeInPlace(result);
+}
+
+std::string
+UriSlice::unescape() const
+{
+    std::string out;
+    unescape(out);
+    return out;
+}
+
+bool
+UriSlice::unescapedEquals(const char *text) const
+{
+    auto i = begin_;
+    while (end_ != i)
     {
-        if (is_valid(c))
-            stream << c;
+        char c = *i;
+        if (isEscape(i, end_))
+        {
+            c = static_cast<char>(hexValue(i[1]) << 4 | hexValue(i[2]));
+            i += 3;
+        }
         else
-            stream << '%' << std::setw(2) << +c;
+        {
+            i += 1;
+        }
+        if (!*text || c != *text)
+            return false;
+        ++text;
     }
-    return stream.str();
+    return !*text;
 }
 
 bool
-Uri::decode(const std::string &in, bool strict)
+UriView::decode(const char *begin, const char *end, bool strict)
 {
-    auto i = in.begin();
+    auto i = begin;
 
     // Store the scheme:
     auto start = i;
-    while (in.end() != i && ':' != *i)
+    while (end != i && ':' != *i)
         ++i;
-    scheme_ = std::string(start, i);
-    if (scheme_.empty() || !is_alpha(scheme_[0]))
+    scheme_ = UriSlice(start, i);
+    if (scheme_.empty() || !is_alpha(*scheme_.begin()))
         return false;
     if (!std::all_of(scheme_.begin(), scheme_.end(), is_scheme))
         return false;
 
     // Consume ':':
-    if (in.end() == i)
+    if (end == i)
         return false;
     ++i;
 
     // Consume "//":
-    authority_.clear();
+    authority_ = UriSlice(i, i);
     authorityOk_ = false;
-    if (1 < in.end() - i && '/' == i[0] && '/' == i[1])
+    if (1 < end - i && '/' == i[0] && '/' == i[1])
     {
         authorityOk_ = true;
         i += 2;
 
         // Store authority part:
         start = i;
-        while (in.end() != i && '#' != *i && '?' != *i && '/' != *i)
+        while (end != i && '#' != *i && '?' != *i && '/' != *i)
             ++i;
-        authority_ = std::string(start, i);
+        authority_ = UriSlice(start, i);
         if (strict && !validate(authority_, is_pchar))
             return false;
     }
 
     // Store the path part:
     start = i;
-    while (in.end() != i && '#' != *i && '?' != *i)
+    while (end != i && '#' != *i && '?' != *i)
         ++i;
-    path_ = std::string(start, i);
+    path_ = UriSlice(start, i);
     if (strict && !validate(path_, is_path))
         return false;
 
     // Consume '?':
     queryOk_ = false;
-    if (in.end() != i && '#' != *i)
+    if (end != i && '#' != *i)
     {
         queryOk_ = true;
         ++i;
@@ -189,28 +228,145 @@ Uri::decode(const std::string &in, bool strict)
 
     // Store the query part:
     start = i;
-    while (in.end() != i && '#' != *i)
+    while (end != i && '#' != *i)
         ++i;
-    query_ = std::string(start, i);
+    query_ = UriSlice(start, i);
     if (strict && !validate(query_, is_query))
         return false;
 
     // Consume '#':
     fragmentOk_ = false;
-    if (in.end() != i)
+    if (end != i)
     {
         fragmentOk_ = true;
         ++i;
     }
 
     // Store the fragment part:
-    fragment_ = std::string(i, in.end());
+    fragment_ = UriSlice(i, end);
     if (strict && !validate(fragment_, is_query))
         return false;
 
     return true;
 }
 
+bool
+UriView::decode(const std::string &in, bool strict)
+{
+    return decode(in.data(), in.data() + in.size(), strict);
+}
+
+bool
+UriView::schemeIs(const char *lowercase) const
+{
+    for (auto c: scheme_)
+    {
+        if ('A' <= c && c <= 'Z')
+            c = c - 'A' + 'a';
+        if (!*lowercase || c != *lowercase)
+            return false;
+        ++lowercase;
+    }
+    return !*lowercase;
+}
+
+UriSlice
+UriView::opaquePath() const
+{
+    // The authority sits right before the path in the original string:
+    if (authorityOk_)
+        return UriSlice(authority_.begin(), path_.end());
+    return path_;
+}
+
+UriView::QueryIterator::QueryIterator(UriSlice query):
+    i_(query.begin()),
+    end_(query.end())
+{}
+
+bool
+UriView::QueryIterator::next(UriSlice &key, UriSlice &value)
+{
+    if (end_ == i_)
+        return false;
+
+    // Read the key:
+    auto begin = i_;
+    while (end_ != i_ && '&' != *i_ && '=' != *i_)
+        ++i_;
+    key = UriSlice(begin, i_);
+
+    // Consume '=':
+    if (end_ != i_ && '&' != *i_)
+        ++i_;
+
+    // Read the value:
+    begin = i_;
+    while (end_ != i_ && '&' != *i_)
+        ++i_;
+    value = UriSlice(begin, i_);
+
+    // Consume '&':
+    if (end_ != i_)
+        ++i_;
+
+    return true;
+}
+
+bool
+UriView::queryFind(UriSlice &result, const char *key) const
+{
+    bool found = false;
+    auto query = queryIterator();
+    UriSlice k, v;
+    while (query.next(k, v))
+    {
+        if (k.unescapedEquals(key))
+        {
+            result = v;
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * Percent-encodes a string.
+ * @param is_valid a function returning true for acceptable characters.
+ */
+static std::string
+escape(const std::string &in, bool (*is_valid)(char))
+{
+    std::ostringstream stream;
+    stream << std::hex << std::uppercase << std::setfill('0');
+    for (auto c: in)
+    {
+        if (is_valid(c))
+            stream << c;
+        else
+            stream << '%' << std::setw(2) << +c;
+    }
+    return stream.str();
+}
+
+bool
+Uri::decode(const std::string &in, bool strict)
+{
+    UriView view;
+    if (!view.decode(in, strict))
+        return false;
+
+    scheme_ = view.scheme().raw();
+    authority_ = view.authority().raw();
+    path_ = view.path().raw();
+    query_ = view.query().raw();
+    fragment_ = view.fragment().raw();
+    authorityOk_ = view.authorityOk();
+    queryOk_ = view.queryOk();
+    fragmentOk_ = view.fragmentOk();
+    return true;
+}
+
 std::string
 Uri::encode() const
 {
@@ -346,29 +502,11 @@ Uri::queryDecode() const
 {
     QueryMap out;
 
-    auto i = query_.begin();
-    while (query_.end() != i)
-    {
-        // Read the key:
-        auto begin = i;
-        while (query_.end() != i && '&' != *i && '=' != *i)
-            ++i;
-        auto key = unescape(std::string(begin, i));
-
-        // Consume '=':
-        if (query_.end() != i && '&' != *i)
-            ++i;
-
-        // Read the value:
-        begin = i;
-        while (query_.end() != i && '&' != *i)
-            ++i;
-        out[key] = unescape(std::string(begin, i));
-
-        // Consume '&':
-        if (query_.end() != i)
-            ++i;
-    }
+    UriView::QueryIterator query(UriSlice(query_.data(),
+                                          query_.data() + query_.size()));
+    UriSlice key, value;
+    while (query.next(key, value))
+        value.unescape(out[key.unescape()]);
 
     return out;
 }
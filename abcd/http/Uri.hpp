@@ -13,8 +13,129 @@
 
 namespace abcd {
 
+/**
+ * A non-owning piece of a URI string, with its original escaping.
+ * The string it points into must outlive the slice.
+ */
+class UriSlice
+{
+public:
+    UriSlice() {}
+    UriSlice(const char *begin, const char *end):
+        begin_(begin), end_(end)
+    {}
+
+    const char *begin() const { return begin_; }
+    const char *end() const { return end_; }
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+    /**
+     * Returns a copy of the text, still escaped.
+     */
+    std::string raw() const { return std::string(begin_, end_); }
+
+    /**
+     * Unescapes the text into a caller-provided buffer,
+     * reusing whatever space it already has.
+     */
+    void unescape(std::string &result) const;
+    std::string unescape() const;
+
+    /**
+     * Compares the unescaped text with a plain string,
+     * without building the unescaped copy.
+     */
+    bool unescapedEquals(const char *text) const;
+
+private:
+    const char *begin_ = nullptr;
+    const char *end_ = nullptr;
+};
+
+/**
+ * Splits a URI into its RFC 3986 parts without copying anything.
+ * This is meant for hot paths like QR code scanning,
+ * where most inputs are read once and thrown away.
+ * The string being parsed must outlive the view.
+ */
+class UriView
+{
+public:
+    /**
+     * Splits a URI into parts.
+     * @param strict Set to false to tolerate unescaped special characters.
+     */
+    bool decode(const char *begin, const char *end, bool strict=true);
+    bool decode(const std::string &in, bool strict=true);
+
+    /**
+     * Returns the scheme, in its original case.
+     */
+    UriSlice scheme() const { return scheme_; }
+
+    /**
+     * Compares the scheme with a lowercase name, ignoring case.
+     */
+    bool schemeIs(const char *lowercase) const;
+
+    UriSlice authority() const { return authority_; }
+    bool authorityOk() const { return authorityOk_; }
+    UriSlice path() const { return path_; }
+    UriSlice query() const { return query_; }
+    bool queryOk() const { return queryOk_; }
+    UriSlice fragment() const { return fragment_; }
+    bool fragmentOk() const { return fragmentOk_; }
+
+    /**
+     * Returns the path with any authority folded back in,
+     * like `Uri::deauthorize` followed by `Uri::path`.
+     */
+    UriSlice opaquePath() const;
+
+    /**
+     * Steps through a query string one key-value pair at a time,
+     * following the same rules as `Uri::queryDecode`.
+     */
+    class QueryIterator
+    {
+    public:
+        explicit QueryIterator(UriSlice query);
+
+        /**
+         * Reads the next pair, returning false once there are no more.
+         * The slices are still escaped.
+         */
+        bool next(UriSlice &key, UriSlice &value);
+
+    private:
+        const char *i_;
+        const char *end_;
+    };
+
+    QueryIterator queryIterator() const { return QueryIterator(query_); }
+
+    /**
+     * Finds the value for a query key.
+     * If the key appears more than once, the final one wins.
+     */
+    bool queryFind(UriSlice &result, const char *key) const;
+
+private:
+    UriSlice scheme_;
+    UriSlice authority_;
+    UriSlice path_;
+    UriSlice query_;
+    UriSlice fragment_;
+
+    bool authorityOk_ = false;
+    bool queryOk_ = false;
+    bool fragmentOk_ = false;
+};
+
 /**
  * A parsed URI according to RFC 3986.
+ * Unlike `UriView`, this owns its parts and can edit them.
  */
 class Uri
 {
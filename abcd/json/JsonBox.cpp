@@ -8,23 +8,93 @@
 #include "JsonBox.hpp"
 #include "../crypto/Crypto.hpp"
 #include "../crypto/Encoding.hpp"
+#include <zlib.h>
+#include <atomic>
 
 namespace abcd {
 
 enum CryptoType
 {
     AES256_CBC_AIRBITZ = 0,
+    AES256_CBC_AIRBITZ_ZLIB = 1, // Size prefix plus zlib stream, then AES
 };
 
+// Refuse to inflate anything claiming to be bigger than this:
+constexpr size_t compressSizeMax = 64 * 1024 * 1024;
+
+static std::atomic<size_t> gCompressThreshold(0);
+
+void
+jsonBoxCompressionSet(size_t threshold)
+{
+    gCompressThreshold = threshold;
+}
+
+/**
+ * Deflates data, with a big-endian size prefix for the reader.
+ */
+static Status
+compressData(DataChunk &result, DataSlice data)
+{
+    uLongf size = compressBound(data.size());
+    DataChunk out(4 + size);
+    out[0] = (data.size() >> 24) & 0xff;
+    out[1] = (data.size() >> 16) & 0xff;
+    out[2] = (data.size() >> 8) & 0xff;
+    out[3] = (data.size() >> 0) & 0xff;
+    if (Z_OK != compress2(out.data() + 4, &size, data.data(), data.size(),
+                          Z_DEFAULT_COMPRESSION))
+        return ABC_ERROR(ABC_CC_Error, "Cannot compress data");
+
+    out.resize(4 + size);
+    result = std::move(out);
+    return Status();
+}
+
+static Status
+uncompressData(DataChunk &result, DataSlice data)
+{
+    if (data.size() < 4)
+        return ABC_ERROR(ABC_CC_DecryptError, "Compressed data is truncated");
+    const size_t size = data.data()[0] << 24 | data.data()[1] << 16 |
+                        data.data()[2] << 8 | data.data()[3];
+    if (compressSizeMax < size)
+        return ABC_ERROR(ABC_CC_DecryptError, "Compressed data is too big");
+
+    DataChunk out(size);
+    uLongf outSize = size;
+    if (Z_OK != uncompress(out.data(), &outSize,
+                           data.data() + 4, data.size() - 4) ||
+            size != outSize)
+        return ABC_ERROR(ABC_CC_DecryptError, "Cannot decompress data");
+
+    result = std::move(out);
+    return Status();
+}
+
 Status
 JsonBox::encrypt(DataSlice data, DataSlice key)
 {
+    // Small values are not worth the trouble:
+    auto type = AES256_CBC_AIRBITZ;
+    DataChunk compressed;
+    const size_t threshold = gCompressThreshold;
+    if (threshold && threshold <= data.size())
+    {
+        ABC_CHECK(compressData(compressed, data));
+        if (compressed.size() < data.size())
+        {
+            type = AES256_CBC_AIRBITZ_ZLIB;
+            data = compressed;
+        }
+    }
+
     DataChunk nonce;
-    AutoU08Buf cyphertext;
+    DataChunk cyphertext;
     ABC_CHECK_OLD(ABC_CryptoEncryptAES256Package(data, key,
-                  &cyphertext, nonce, &error));
+                  cyphertext, nonce, &error));
 
-    ABC_CHECK(typeSet(AES256_CBC_AIRBITZ));
+    ABC_CHECK(typeSet(type));
     ABC_CHECK(nonceSet(base16Encode(nonce)));
     ABC_CHECK(cyphertextSet(base64Encode(cyphertext)));
 
@@ -52,6 +122,16 @@ JsonBox::decrypt(DataChunk &result, DataSlice key)
         return Status();
     }
 
+    case AES256_CBC_AIRBITZ_ZLIB:
+    {
+        DataChunk compressed;
+        ABC_CHECK_OLD(ABC_CryptoDecryptAES256Package(compressed,
+                      cyphertext, key, nonce,
+                      &error));
+        ABC_CHECK(uncompressData(result, compressed));
+        return Status();
+    }
+
     default:
         return ABC_ERROR(ABC_CC_DecryptError, "Unknown encryption type");
     }
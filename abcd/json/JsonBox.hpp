@@ -24,6 +24,8 @@ public:
 
     /**
      * Puts a value into the box, encrypting it with the given key.
+     * Values at or above the compression threshold get deflated first,
+     * if that makes them smaller.
      */
     Status
     encrypt(DataSlice data, DataSlice key);
@@ -40,6 +42,17 @@ private:
     ABC_JSON_STRING(cyphertext, "data_base64", nullptr)
 };
 
+/**
+ * Sets the smallest value `JsonBox::encrypt` will compress,
+ * where 0 turns compression off.
+ * Compressed boxes use their own encryption type,
+ * which older readers reject rather than misread,
+ * so only turn this on once every device on the account can read them.
+ * Reading compressed boxes always works.
+ */
+void
+jsonBoxCompressionSet(size_t threshold);
+
 } // namespace abcd
 
 #endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "JsonPack.hpp"
+#include "JsonObject.hpp"
+#include "../util/Debug.hpp"
+#include "../util/FileIO.hpp"
+#include "../util/Parallel.hpp"
+#include "../util/WriteQueue.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <vector>
+
+namespace abcd {
+
+struct PackEntryJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(PackEntryJson, JsonObject)
+
+    ABC_JSON_INTEGER(size, "size", -1)
+    ABC_JSON_INTEGER(time, "time", -1)
+    ABC_JSON_VALUE(json, "json", JsonPtr)
+};
+
+struct PackJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(PackJson, JsonObject)
+
+    ABC_JSON_VALUE(files, "files", JsonObject)
+};
+
+JsonPack::JsonPack(const std::string &path, DataSlice dataKey):
+    path_(path),
+    dataKey_(dataKey)
+{
+}
+
+void
+JsonPack::load()
+{
+    entries_.clear();
+    dirty_ = false;
+    loadTime_ = time(nullptr);
+
+    PackJson pack;
+    if (!pack.load(path_, dataKey_))
+        return;
+
+    auto files = pack.files();
+    for (void *i = json_object_iter(files.get());
+            i;
+            i = json_object_iter_next(files.get(), i))
+    {
+        PackEntryJson entryJson(json_incref(json_object_iter_value(i)));
+        auto json = entryJson.json();
+        if (!json)
+            continue;
+
+        Entry entry{entryJson.size(), entryJson.time(), json, false};
+        entries_[json_object_iter_key(i)] = entry;
+    }
+}
+
+std::map<std::string, JsonPtr>
+JsonPack::loadDir(const std::string &dir)
+{
+    std::map<std::string, JsonPtr> out;
+
+    // Use the packed copies of any files that have not changed:
+    struct Miss
+    {
+        std::string name;
+        json_int_t size;
+        json_int_t time;
+        JsonPtr json;
+        Status status;
+    };
+    std::vector<Miss> misses;
+    writeQueueFlush(dir).log();
+    DIR *dirp = opendir(dir.c_str());
+    if (!dirp)
+        return out;
+    struct dirent *de;
+    while (nullptr != (de = readdir(dirp)))
+    {
+        const std::string name = de->d_name;
+        if (!fileIsJson(name))
+            continue;
+
+        struct stat statInfo;
+        if (0 != stat((dir + name).c_str(), &statInfo))
+            continue;
+        const json_int_t size = statInfo.st_size;
+        const json_int_t mtime = statInfo.st_mtime;
+
+        auto i = entries_.find(name);
+        if (entries_.end() != i && size == i->second.size &&
+                mtime == i->second.time)
+        {
+            i->second.seen = true;
+            out[name] = i->second.json;
+        }
+        else
+        {
+            misses.push_back(Miss{name, size, mtime, JsonPtr(), Status()});
+        }
+    }
+    closedir(dirp);
+
+    // Decrypt and parse the rest in parallel:
+    const auto dataKey = dataKey_;
+    auto work = [&dir, &misses, dataKey](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+            misses[i].status = misses[i].json.load(dir + misses[i].name, dataKey);
+    };
+    parallelFor(misses.size(), work);
+
+    for (auto &miss: misses)
+    {
+        if (!miss.status.log())
+            continue;
+        out[miss.name] = miss.json;
+        dirty_ = true;
+
+        // A file written in the same second as we looked at it could change
+        // again without its time or size changing, so leave it loose for now:
+        if (loadTime_ <= miss.time)
+            entries_.erase(miss.name);
+        else
+            entries_[miss.name] = Entry{miss.size, miss.time, miss.json, true};
+    }
+
+    return out;
+}
+
+Status
+JsonPack::save()
+{
+    // Drop files that have gone away:
+    for (auto i = entries_.begin(); i != entries_.end();)
+    {
+        if (!i->second.seen)
+        {
+            i = entries_.erase(i);
+            dirty_ = true;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    if (!dirty_)
+        return Status();
+
+    JsonObject files;
+    for (const auto &i: entries_)
+    {
+        PackEntryJson entryJson;
+        ABC_CHECK(entryJson.sizeSet(i.second.size));
+        ABC_CHECK(entryJson.timeSet(i.second.time));
+        ABC_CHECK(entryJson.jsonSet(i.second.json));
+        ABC_CHECK(files.set(i.first.c_str(), entryJson));
+    }
+
+    PackJson pack;
+    ABC_CHECK(pack.filesSet(files));
+    ABC_CHECK(pack.save(path_, dataKey_));
+    dirty_ = false;
+
+    ABC_DebugLog("Packed %d files into %s", entries_.size(), path_.c_str());
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A single-file cache for directories full of small encrypted JSON files.
+ */
+
+#ifndef ABCD_JSON_JSON_PACK_HPP
+#define ABCD_JSON_JSON_PACK_HPP
+
+#include "JsonPtr.hpp"
+#include <time.h>
+#include <map>
+
+namespace abcd {
+
+/**
+ * Keeps decrypted copies of a directory's encrypted JSON files
+ * in one encrypted container, so loading the directory costs
+ * a single decryption plus a `stat` per file.
+ * This class has no locking of its own.
+ *
+ * The loose files stay authoritative, since they are what gets synced.
+ * A packed copy is only used while the file's size and modification time
+ * still match, so edits from this device or from sync simply fall through
+ * to the slow path and get re-packed on the next save.
+ */
+class JsonPack
+{
+public:
+    /**
+     * @param dataKey the key used for both the pack and the loose files.
+     * Must outlive this object.
+     */
+    JsonPack(const std::string &path, DataSlice dataKey);
+
+    /**
+     * Reads the pack off disk.
+     * A missing or damaged pack simply starts out empty.
+     */
+    void
+    load();
+
+    /**
+     * Loads every encrypted JSON file in the directory.
+     * Files that are not in the pack get decrypted and parsed
+     * on a pool of worker threads.
+     * Files that fail to load are logged and left out.
+     * @return a map from file names to their contents.
+     */
+    std::map<std::string, JsonPtr>
+    loadDir(const std::string &dir);
+
+    /**
+     * Writes the pack back to disk if anything has changed,
+     * dropping any files that `loadDir` has not seen since `load`.
+     * Call this before modifying any of the returned JSON values.
+     */
+    Status
+    save();
+
+private:
+    struct Entry
+    {
+        json_int_t size;
+        json_int_t time;
+        JsonPtr json;
+        bool seen;
+    };
+
+    const std::string path_;
+    DataSlice dataKey_;
+    std::map<std::string, Entry> entries_;
+    bool dirty_ = false;
+    time_t loadTime_ = 0;
+};
+
+} // namespace abcd
+
+#endif
@@ -8,9 +8,10 @@
 #include "JsonPtr.hpp"
 #include "JsonBox.hpp"
 #include "../crypto/Crypto.hpp"
-#include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
 #include "../util/Util.hpp"
+#include "../util/WriteQueue.hpp"
+#include <string.h>
 #include <new>
 
 namespace abcd {
@@ -20,6 +21,37 @@ constexpr size_t saveFlags = JSON_INDENT(1) | JSON_SORT_KEYS | JSON_ENCODE_ANY;
 constexpr size_t saveFlagsCompact = JSON_COMPACT | JSON_SORT_KEYS |
                                     JSON_ENCODE_ANY;
 
+/**
+ * Per-thread space for encoding files before they are written out,
+ * so saving a file does not need fresh buffers every time.
+ * The contents are plaintext, so they are wiped after each use.
+ */
+class JsonScratch
+{
+public:
+    ~JsonScratch()
+    {
+        memset(data.data(), 0, data.size());
+        data.clear();
+    }
+
+    JsonScratch():
+        data(buffer())
+    {
+        data.clear();
+    }
+
+    DataChunk &data;
+
+private:
+    static DataChunk &
+    buffer()
+    {
+        static thread_local DataChunk out;
+        return out;
+    }
+};
+
 /**
  * Overrides the jansson malloc function so we can clear the memory on free.
  * https://github.com/akheron/jansson/blob/master/doc/apiref.rst#id97
@@ -112,6 +144,9 @@ JsonPtr::clone() const
 Status
 JsonPtr::load(const std::string &path)
 {
+    if (writeQueuePending(path))
+        ABC_CHECK(writeQueueFlush(path));
+
     json_error_t error;
     json_t *root = json_load_file(path.c_str(), loadFlags, &error);
     if (!root)
@@ -128,16 +163,31 @@ JsonPtr::load(const std::string &path, DataSlice dataKey)
 
     DataChunk data;
     ABC_CHECK(box.decrypt(data, dataKey));
-    ABC_CHECK(decode(toString(data)));
+    ABC_CHECK(decode(reinterpret_cast<const char *>(data.data()), data.size()));
 
     return Status();
 }
 
+Status
+JsonPtr::loadChecked(const std::string &path)
+{
+    DataChunk data;
+    ABC_CHECK(fileLoadChecked(data, path));
+    ABC_CHECK(decode(reinterpret_cast<const char *>(data.data()), data.size()));
+    return Status();
+}
+
 Status
 JsonPtr::decode(const std::string &data)
+{
+    return decode(data.data(), data.size());
+}
+
+Status
+JsonPtr::decode(const char *data, size_t size)
 {
     json_error_t error;
-    json_t *root = json_loadb(data.data(), data.size(), loadFlags, &error);
+    json_t *root = json_loadb(data, size, loadFlags, &error);
     if (!root)
         return ABC_ERROR(ABC_CC_JSONError, error.text);
     reset(root);
@@ -147,16 +197,18 @@ JsonPtr::decode(const std::string &data)
 Status
 JsonPtr::save(const std::string &path) const
 {
-    ABC_DebugLog("Writing JSON file %s", path.c_str());
-
-    const auto pathTmp = path + ".tmp";
-    if (json_dump_file(root_, pathTmp.c_str(), saveFlags))
-        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot write " + pathTmp);
-
-    if (rename(pathTmp.c_str(), path.c_str()))
-        return ABC_ERROR(ABC_CC_FileWriteError,
-                         "Cannot rename " + pathTmp + " to " + path);
+    JsonScratch scratch;
+    encode(scratch.data);
+    ABC_CHECK(fileSave(scratch.data, path));
+    return Status();
+}
 
+Status
+JsonPtr::saveChecked(const std::string &path) const
+{
+    JsonScratch scratch;
+    encode(scratch.data);
+    ABC_CHECK(fileSaveChecked(scratch.data, path));
     return Status();
 }
 
@@ -166,12 +218,46 @@ JsonPtr::save(const std::string &path, DataSlice dataKey) const
     // Some downstream decoders forgot to null-terminate their input.
     // This is a bug, but we can save old versions of the app from crashing
     // by including a null byte in the encrypted data.
+    JsonBox box;
+    {
+        JsonScratch scratch;
+        encode(scratch.data);
+        scratch.data.push_back(0);
+        ABC_CHECK(box.encrypt(scratch.data, dataKey));
+    }
+    ABC_CHECK(box.save(path));
+
+    return Status();
+}
+
+Status
+JsonPtr::saveQueued(const std::string &path) const
+{
+    // Freeze the contents now, since the caller may keep editing them:
+    const auto data = encode();
+    writeQueueAdd(path, [path, data]()
+    {
+        return fileSave(data, path);
+    });
+
+    return Status();
+}
+
+Status
+JsonPtr::saveQueued(const std::string &path, DataSlice dataKey) const
+{
+    // Freeze the contents now, since the caller may keep editing them:
     auto data = encode();
     data.push_back(0);
 
-    JsonBox box;
-    ABC_CHECK(box.encrypt(data, dataKey));
-    ABC_CHECK(box.save(path));
+    DataChunk key(dataKey.begin(), dataKey.end());
+    writeQueueAdd(path, [path, data, key]()
+    {
+        JsonBox box;
+        ABC_CHECK(box.encrypt(data, key));
+        ABC_CHECK(box.save(path));
+        return Status();
+    });
 
     return Status();
 }
@@ -189,4 +275,35 @@ JsonPtr::encode(bool compact) const
     return out;
 }
 
+void
+JsonPtr::encode(DataChunk &result, bool compact) const
+{
+    result.clear();
+    if (!root_)
+    {
+        const std::string null = "null";
+        result.assign(null.begin(), null.end());
+        return;
+    }
+
+    auto append = [](const char *buffer, size_t size, void *data) -> int
+    {
+        auto &out = *static_cast<DataChunk *>(data);
+        if (out.capacity() < out.size() + size)
+        {
+            // Grow by hand, so the old copy can be wiped:
+            DataChunk bigger;
+            bigger.reserve(2 * (out.size() + size));
+            bigger.assign(out.begin(), out.end());
+            memset(out.data(), 0, out.size());
+            out.swap(bigger);
+        }
+        out.insert(out.end(), buffer, buffer + size);
+        return 0;
+    };
+    if (json_dump_callback(root_, append, &result,
+                           compact ? saveFlagsCompact : saveFlags))
+        throw std::bad_alloc();
+}
+
 } // namespace abcd
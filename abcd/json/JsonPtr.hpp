@@ -63,12 +63,24 @@ public:
     Status
     load(const std::string &path, DataSlice dataKey);
 
+    /**
+     * Loads the JSON object from a file written by `saveChecked`.
+     */
+    Status
+    loadChecked(const std::string &path);
+
     /**
      * Loads the JSON object from an in-memory string.
      */
     Status
     decode(const std::string &data);
 
+    /**
+     * Loads the JSON object from an in-memory buffer.
+     */
+    Status
+    decode(const char *data, size_t size);
+
     /**
      * Saves the JSON object to disk.
      */
@@ -81,12 +93,43 @@ public:
     Status
     save(const std::string &path, DataSlice dataKey) const;
 
+    /**
+     * Saves the JSON object to disk with a checksum trailer,
+     * for caches that are big enough to be worth checking before parsing.
+     */
+    Status
+    saveChecked(const std::string &path) const;
+
+    /**
+     * Saves the JSON object to disk,
+     * but leaves the disk write to the write-behind queue.
+     * Later loads of the same path will still see the new contents.
+     */
+    Status
+    saveQueued(const std::string &path) const;
+
+    /**
+     * Saves the JSON object to disk using encryption,
+     * but leaves the encryption and disk write to the write-behind queue.
+     * Later loads of the same path will still see the new contents.
+     */
+    Status
+    saveQueued(const std::string &path, DataSlice dataKey) const;
+
     /**
      * Saves the JSON object to an in-memory string.
      */
     std::string
     encode(bool compact=false) const;
 
+    /**
+     * Saves the JSON object into a caller-provided buffer,
+     * reusing whatever space it already has.
+     * Any space left behind by growing the buffer is wiped first.
+     */
+    void
+    encode(DataChunk &result, bool compact=false) const;
+
 protected:
     json_t *root_;
 };
@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "JsonReader.hpp"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace abcd {
+
+static bool
+isNumberChar(uint8_t c)
+{
+    return ('0' <= c && c <= '9') ||
+           '-' == c || '+' == c || '.' == c || 'e' == c || 'E' == c;
+}
+
+static int
+hexValue(uint8_t c)
+{
+    if ('0' <= c && c <= '9')
+        return c - '0';
+    if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+    if ('A' <= c && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static void
+appendUtf8(std::string &out, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        out += static_cast<char>(c);
+    }
+    else if (c < 0x800)
+    {
+        out += static_cast<char>(0xc0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000)
+    {
+        out += static_cast<char>(0xe0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+    else
+    {
+        out += static_cast<char>(0xf0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+}
+
+JsonReader::JsonReader(DataSlice data):
+    p_(data.begin()),
+    end_(data.end())
+{
+}
+
+JsonReader::Type
+JsonReader::peek()
+{
+    space();
+    if (!ok_)
+        return Type::error;
+    if (end_ == p_)
+        return Type::end;
+
+    switch (*p_)
+    {
+    case '{':
+        return Type::object;
+    case '[':
+        return Type::array;
+    case '"':
+        return Type::string;
+    case 't':
+    case 'f':
+        return Type::boolean;
+    case 'n':
+        return Type::null;
+    default:
+        if ('-' == *p_ || ('0' <= *p_ && *p_ <= '9'))
+            return Type::number;
+        return Type::error;
+    }
+}
+
+bool
+JsonReader::objectBegin()
+{
+    if (Type::object != peek())
+        return false;
+    ++p_;
+    return true;
+}
+
+bool
+JsonReader::objectKey(std::string &result)
+{
+    space();
+    if (end_ == p_)
+        return fail();
+    if ('}' == *p_)
+    {
+        ++p_;
+        return false;
+    }
+    if (',' == *p_)
+        ++p_;
+
+    if (!readString(result))
+        return fail();
+    space();
+    if (end_ == p_ || ':' != *p_)
+        return fail();
+    ++p_;
+    return true;
+}
+
+bool
+JsonReader::arrayBegin()
+{
+    if (Type::array != peek())
+        return false;
+    ++p_;
+    return true;
+}
+
+bool
+JsonReader::arrayItem()
+{
+    space();
+    if (end_ == p_)
+        return fail();
+    if (']' == *p_)
+    {
+        ++p_;
+        return false;
+    }
+    if (',' == *p_)
+        ++p_;
+
+    space();
+    if (end_ == p_)
+        return fail();
+    return true;
+}
+
+bool
+JsonReader::readString(std::string &result)
+{
+    if (Type::string != peek())
+        return false;
+    ++p_;
+
+    result.clear();
+    while (end_ != p_)
+    {
+        // Copy runs of plain characters in one go:
+        auto run = p_;
+        while (end_ != p_ && '"' != *p_ && '\\' != *p_)
+            ++p_;
+        result.append(reinterpret_cast<const char *>(run), p_ - run);
+        if (end_ == p_)
+            break;
+
+        if ('"' == *p_)
+        {
+            ++p_;
+            return true;
+        }
+
+        // Escape sequences:
+        if (end_ - p_ < 2)
+            break;
+        ++p_;
+        switch (*p_++)
+        {
+        case '"':
+            result += '"';
+            break;
+        case '\\':
+            result += '\\';
+            break;
+        case '/':
+            result += '/';
+            break;
+        case 'b':
+            result += '\b';
+            break;
+        case 'f':
+            result += '\f';
+            break;
+        case 'n':
+            result += '\n';
+            break;
+        case 'r':
+            result += '\r';
+            break;
+        case 't':
+            result += '\t';
+            break;
+        case 'u':
+        {
+            uint32_t c = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                int digit = end_ != p_ ? hexValue(*p_++) : -1;
+                if (digit < 0)
+                    return fail();
+                c = c << 4 | digit;
+            }
+
+            // Surrogate pairs:
+            if (0xd800 <= c && c < 0xdc00 && 6 <= end_ - p_ &&
+                    '\\' == p_[0] && 'u' == p_[1])
+            {
+                uint32_t low = 0;
+                for (int i = 2; i < 6; ++i)
+                {
+                    int digit = hexValue(p_[i]);
+                    if (digit < 0)
+                        return fail();
+                    low = low << 4 | digit;
+                }
+                if (0xdc00 <= low && low < 0xe000)
+                {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                    p_ += 6;
+                }
+            }
+            appendUtf8(result, c);
+            break;
+        }
+        default:
+            return fail();
+        }
+    }
+
+    // Unterminated string:
+    return fail();
+}
+
+bool
+JsonReader::readInteger(int64_t &result)
+{
+    if (Type::number != peek())
+        return false;
+
+    auto start = p_;
+    bool negative = '-' == *p_;
+    if (negative)
+        ++p_;
+
+    // The magnitude can reach one past the largest positive value:
+    const uint64_t limit = negative ?
+                           uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+    uint64_t value = 0;
+    auto digits = p_;
+    while (end_ != p_ && '0' <= *p_ && *p_ <= '9')
+    {
+        const unsigned digit = *p_++ - '0';
+        if ((limit - digit) / 10 < value)
+            return fail();
+        value = 10 * value + digit;
+    }
+    if (digits == p_)
+        return fail();
+
+    // Fractions and exponents go the slow way:
+    if (end_ != p_ && isNumberChar(*p_))
+    {
+        p_ = start;
+        double number;
+        if (!readNumber(number))
+            return false;
+        if (!(-9.2e18 < number && number < 9.2e18))
+            return fail();
+        result = static_cast<int64_t>(number);
+        return true;
+    }
+
+    if (!negative)
+        result = value;
+    else if (value)
+        result = -static_cast<int64_t>(value - 1) - 1; // Reaches INT64_MIN
+    else
+        result = 0;
+    return true;
+}
+
+bool
+JsonReader::readNumber(double &result)
+{
+    if (Type::number != peek())
+        return false;
+
+    char buffer[64];
+    size_t size = 0;
+    while (end_ != p_ && isNumberChar(*p_))
+    {
+        if (sizeof(buffer) - 1 <= size)
+            return fail();
+        buffer[size++] = *p_++;
+    }
+    buffer[size] = 0;
+
+    char *last;
+    result = strtod(buffer, &last);
+    if (buffer + size != last)
+        return fail();
+    return true;
+}
+
+bool
+JsonReader::skip(DataSlice *raw)
+{
+    auto type = peek();
+    auto start = p_;
+
+    bool success = false;
+    std::string ignored;
+    switch (type)
+    {
+    case Type::null:
+        success = literal("null");
+        break;
+    case Type::boolean:
+        success = literal("true") || literal("false");
+        break;
+    case Type::number:
+        success = skipNumber();
+        break;
+    case Type::string:
+        success = readString(ignored);
+        break;
+    case Type::array:
+    case Type::object:
+        success = skipContainer();
+        break;
+    default:
+        break;
+    }
+    if (!success)
+        return fail();
+
+    if (raw)
+        *raw = DataSlice(start, p_);
+    return true;
+}
+
+void
+JsonReader::space()
+{
+    while (end_ != p_ &&
+            (' ' == *p_ || '\t' == *p_ || '\r' == *p_ || '\n' == *p_))
+        ++p_;
+}
+
+bool
+JsonReader::fail()
+{
+    ok_ = false;
+    return false;
+}
+
+bool
+JsonReader::literal(const char *text)
+{
+    const size_t size = strlen(text);
+    if (static_cast<size_t>(end_ - p_) < size || memcmp(p_, text, size))
+        return false;
+    p_ += size;
+    return true;
+}
+
+bool
+JsonReader::skipNumber()
+{
+    while (end_ != p_ && isNumberChar(*p_))
+        ++p_;
+    return true;
+}
+
+bool
+JsonReader::skipContainer()
+{
+    size_t depth = 0;
+    while (end_ != p_)
+    {
+        switch (*p_++)
+        {
+        case '{':
+        case '[':
+            ++depth;
+            break;
+        case '}':
+        case ']':
+            if (!--depth)
+                return true;
+            break;
+        case '"':
+            // Step over the string, escapes and all:
+            while (end_ != p_ && '"' != *p_)
+            {
+                if ('\\' == *p_ && end_ != p_ + 1)
+                    ++p_;
+                ++p_;
+            }
+            if (end_ == p_)
+                return false;
+            ++p_;
+            break;
+        }
+    }
+    return false;
+}
+
+} // namespace abcd
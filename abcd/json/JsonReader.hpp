@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A pull parser for reading known JSON shapes without building a tree.
+ */
+
+#ifndef ABCD_JSON_JSON_READER_HPP
+#define ABCD_JSON_JSON_READER_HPP
+
+#include "../util/Data.hpp"
+#include <stdint.h>
+#include <string>
+
+namespace abcd {
+
+/**
+ * A forward-only JSON parser that works directly on a buffer.
+ * Unlike JsonPtr, this never builds a tree, so callers that know
+ * the shape of their input can pull fields out without allocating.
+ *
+ * The read methods return false without consuming anything
+ * if the next value has a different type. Malformed input also
+ * returns false, and makes `ok` return false from then on.
+ */
+class JsonReader
+{
+public:
+    enum class Type
+    {
+        end, error, null, boolean, number, string, array, object
+    };
+
+    explicit JsonReader(DataSlice data);
+
+    /**
+     * False if the input turned out to be malformed.
+     */
+    bool
+    ok() const { return ok_; }
+
+    /**
+     * Returns the type of the next value without consuming it.
+     */
+    Type
+    peek();
+
+    /**
+     * Enters an object. Use `objectKey` to walk its members.
+     */
+    bool
+    objectBegin();
+
+    /**
+     * Reads the next member key, leaving the reader on its value.
+     * @return false once the object is done.
+     */
+    bool
+    objectKey(std::string &result);
+
+    /**
+     * Enters an array. Use `arrayItem` to walk its elements.
+     */
+    bool
+    arrayBegin();
+
+    /**
+     * Moves to the next array element.
+     * @return false once the array is done.
+     */
+    bool
+    arrayItem();
+
+    bool
+    readString(std::string &result);
+
+    bool
+    readInteger(int64_t &result);
+
+    bool
+    readNumber(double &result);
+
+    /**
+     * Skips over the next value, whatever it is.
+     * @param raw if given, receives the text of the skipped value.
+     */
+    bool
+    skip(DataSlice *raw=nullptr);
+
+private:
+    const uint8_t *p_;
+    const uint8_t *end_;
+    bool ok_ = true;
+
+    void
+    space();
+
+    bool
+    fail();
+
+    bool
+    literal(const char *text);
+
+    bool
+    skipNumber();
+
+    bool
+    skipContainer();
+};
+
+} // namespace abcd
+
+#endif
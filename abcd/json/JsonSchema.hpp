@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Binds a plain C++ struct to its JSON layout,
+ * for rows that show up by the thousand in cache files.
+ *
+ * Unlike the `ABC_JSON_*` accessors, which look up their key on every call,
+ * a schema reads an object in one pass over its keys,
+ * writing each value straight into the struct.
+ */
+
+#ifndef ABCD_JSON_JSON_SCHEMA_HPP
+#define ABCD_JSON_JSON_SCHEMA_HPP
+
+#include "JsonPtr.hpp"
+#include <stdint.h>
+#include <string.h>
+#include <set>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace abcd {
+
+// Field flags:
+constexpr unsigned jsonRequired = 1 << 0; // Decoding fails if it is missing
+constexpr unsigned jsonSkipEmpty = 1 << 1; // Encoding leaves out defaults
+
+/**
+ * Ties one JSON key to one struct member.
+ */
+template<typename Struct, typename Member>
+struct JsonField
+{
+    const char *key;
+    Member Struct::*member;
+    unsigned flags;
+};
+
+template<typename Struct, typename Member>
+constexpr JsonField<Struct, Member>
+jsonField(const char *key, Member Struct::*member, unsigned flags=0)
+{
+    return JsonField<Struct, Member> {key, member, flags};
+}
+
+// Conversions for each supported member type.
+// The readers return false if the JSON value has the wrong type.
+
+inline bool
+jsonValueRead(std::string &result, json_t *value)
+{
+    if (!json_is_string(value))
+        return false;
+    result = json_string_value(value);
+    return true;
+}
+
+inline json_t *
+jsonValueMake(const std::string &value)
+{
+    return json_string(value.c_str());
+}
+
+inline bool
+jsonValueRead(bool &result, json_t *value)
+{
+    if (!json_is_boolean(value))
+        return false;
+    result = json_is_true(value);
+    return true;
+}
+
+inline json_t *
+jsonValueMake(bool value)
+{
+    return json_boolean(value);
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, bool>::type
+jsonValueRead(T &result, json_t *value)
+{
+    if (!json_is_integer(value))
+        return false;
+    result = static_cast<T>(json_integer_value(value));
+    return true;
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, json_t *>::type
+jsonValueMake(T value)
+{
+    return json_integer(static_cast<json_int_t>(value));
+}
+
+inline bool
+jsonValueRead(double &result, json_t *value)
+{
+    if (!json_is_number(value))
+        return false;
+    result = json_number_value(value);
+    return true;
+}
+
+inline json_t *
+jsonValueMake(double value)
+{
+    return json_real(value);
+}
+
+/**
+ * Passes the value through untouched.
+ * The pointer is borrowed, so it is only good while the source lives.
+ */
+inline bool
+jsonValueRead(json_t *&result, json_t *value)
+{
+    result = value;
+    return true;
+}
+
+inline json_t *
+jsonValueMake(json_t *value)
+{
+    return value ? json_incref(value) : json_null();
+}
+
+/**
+ * Reads an array of strings, skipping any items that are not strings.
+ */
+template<typename Container> bool
+jsonStringsRead(Container &result, json_t *value)
+{
+    if (!json_is_array(value))
+        return false;
+
+    result.clear();
+    const size_t size = json_array_size(value);
+    for (size_t i = 0; i < size; ++i)
+    {
+        json_t *item = json_array_get(value, i);
+        if (json_is_string(item))
+            result.insert(result.end(), json_string_value(item));
+    }
+    return true;
+}
+
+template<typename Container> json_t *
+jsonStringsMake(const Container &value)
+{
+    json_t *out = json_array();
+    for (const auto &item: value)
+        json_array_append_new(out, json_string(item.c_str()));
+    return out;
+}
+
+inline bool
+jsonValueRead(std::vector<std::string> &result, json_t *value)
+{
+    return jsonStringsRead(result, value);
+}
+
+inline json_t *
+jsonValueMake(const std::vector<std::string> &value)
+{
+    return jsonStringsMake(value);
+}
+
+inline bool
+jsonValueRead(std::set<std::string> &result, json_t *value)
+{
+    return jsonStringsRead(result, value);
+}
+
+inline json_t *
+jsonValueMake(const std::set<std::string> &value)
+{
+    return jsonStringsMake(value);
+}
+
+/**
+ * A list of fields describing how a struct maps onto a JSON object.
+ * Build these once, using `jsonSchema`, and keep them around.
+ */
+template<typename Struct, typename... Members>
+class JsonSchema
+{
+public:
+    JsonSchema(JsonField<Struct, Members>... fields):
+        fields_(fields...)
+    {
+        static_assert(sizeof...(Members) <= 64, "Too many fields");
+    }
+
+    /**
+     * Fills in the struct from a JSON object.
+     * Members with no matching key keep whatever value they had.
+     */
+    Status
+    decode(Struct &result, json_t *object) const
+    {
+        if (!json_is_object(object))
+            return ABC_ERROR(ABC_CC_JSONError, "Expected a JSON object");
+
+        uint64_t found = 0;
+        for (void *i = json_object_iter(object);
+                i;
+                i = json_object_iter_next(object, i))
+        {
+            found |= read(result, json_object_iter_key(i),
+                          json_object_iter_value(i), Index<0>());
+        }
+
+        return check(found, Index<0>());
+    }
+
+    /**
+     * Builds a JSON object from the struct.
+     */
+    Status
+    encode(JsonPtr &result, const Struct &in) const
+    {
+        JsonPtr out(json_object());
+        if (!out)
+            return ABC_ERROR(ABC_CC_JSONError, "Cannot create JSON object");
+        ABC_CHECK(write(out.get(), in, Index<0>()));
+
+        result = out;
+        return Status();
+    }
+
+private:
+    template<size_t I> using Index = std::integral_constant<size_t, I>;
+    typedef Index<sizeof...(Members)> End;
+
+    std::tuple<JsonField<Struct, Members>...> fields_;
+
+    /**
+     * Stores the value in the field with a matching key, if any.
+     * @return The matching field's bit, or zero if there is none.
+     */
+    template<size_t I> uint64_t
+    read(Struct &result, const char *key, json_t *value, Index<I>) const
+    {
+        const auto &field = std::get<I>(fields_);
+        if (strcmp(key, field.key))
+            return read(result, key, value, Index<I + 1>());
+        return jsonValueRead(result.*field.member, value) ?
+               uint64_t(1) << I : 0;
+    }
+
+    uint64_t
+    read(Struct &result, const char *key, json_t *value, End) const
+    {
+        return 0;
+    }
+
+    template<size_t I> Status
+    check(uint64_t found, Index<I>) const
+    {
+        const auto &field = std::get<I>(fields_);
+        if ((field.flags & jsonRequired) && !(found & uint64_t(1) << I))
+            return ABC_ERROR(ABC_CC_JSONError,
+                             std::string("Missing JSON field ") + field.key);
+        return check(found, Index<I + 1>());
+    }
+
+    Status
+    check(uint64_t found, End) const
+    {
+        return Status();
+    }
+
+    template<size_t I> Status
+    write(json_t *object, const Struct &in, Index<I>) const
+    {
+        const auto &field = std::get<I>(fields_);
+        const auto &value = in.*field.member;
+        typedef typename std::decay<decltype(value)>::type Member;
+
+        if (!(field.flags & jsonSkipEmpty) || !(value == Member()))
+        {
+            if (json_object_set_new(object, field.key, jsonValueMake(value)) < 0)
+                return ABC_ERROR(ABC_CC_JSONError,
+                                 std::string("Cannot set ") + field.key);
+        }
+        return write(object, in, Index<I + 1>());
+    }
+
+    Status
+    write(json_t *object, const Struct &in, End) const
+    {
+        return Status();
+    }
+};
+
+/**
+ * Builds a schema, working out the types from the fields.
+ */
+template<typename Struct, typename... Members>
+JsonSchema<Struct, Members...>
+jsonSchema(JsonField<Struct, Members>... fields)
+{
+    return JsonSchema<Struct, Members...>(fields...);
+}
+
+} // namespace abcd
+
+#endif
@@ -13,11 +13,15 @@
 #include "../http/HttpRequest.hpp"
 #include "../http/Uri.hpp"
 #include "../json/JsonObject.hpp"
+#include "../util/Parallel.hpp"
 #include "../wallet/Wallet.hpp"
 #include <bitcoin/bitcoin.hpp>
 
 namespace abcd {
 
+// Enough for any real login, while keeping a runaway caller in check:
+constexpr size_t bitidKeysMax = 64;
+
 static bc::hd_private_key
 bitidDerivedKey(const bc::hd_private_key &root,
                 const std::string &callbackUri, uint32_t index)
@@ -75,8 +79,85 @@ bitidSign(DataSlice rootKey, const std::string &message,
     return out;
 }
 
+BitidKeys::BitidKeys(DataSlice rootKey):
+    root_(rootKey)
+{}
+
+BitidSignature
+BitidKeys::sign(const std::string &message, const std::string &callbackUri,
+                uint32_t index)
+{
+    bc::ec_secret secret;
+    BitidSignature out;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto &key = siteKey(callbackUri, index);
+        secret = key.secret;
+        out.address = key.address;
+    }
+
+    const auto signature = bc::sign_message(DataSlice(message), secret, true);
+    out.signature = base64Encode(signature);
+    return out;
+}
+
+std::vector<BitidSignature>
+BitidKeys::sign(const std::vector<BitidChallenge> &challenges)
+{
+    std::vector<bc::ec_secret> secrets;
+    std::vector<BitidSignature> out(challenges.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < challenges.size(); ++i)
+        {
+            const auto &key = siteKey(challenges[i].callbackUri,
+                                      challenges[i].index);
+            secrets.push_back(key.secret);
+            out[i].address = key.address;
+        }
+    }
+
+    parallelFor(challenges.size(), [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            const auto signature = bc::sign_message(
+                                       DataSlice(challenges[i].message), secrets[i], true);
+            out[i].signature = base64Encode(signature);
+        }
+    }, 4);
+    return out;
+}
+
+const BitidKeys::SiteKey &
+BitidKeys::siteKey(const std::string &callbackUri, uint32_t index)
+{
+    const auto id = std::make_pair(callbackUri, index);
+    auto i = keys_.find(id);
+    if (keys_.end() != i)
+        return i->second;
+
+    if (bitidKeysMax <= keys_.size())
+        keys_.clear();
+
+    const auto key = bitidDerivedKey(root_, callbackUri, index);
+    SiteKey out;
+    out.secret = key.private_key();
+    out.address = key.address().encoded();
+    return keys_[id] = out;
+}
+
+std::shared_ptr<BitidKeys>
+bitidKeys(Login &login)
+{
+    std::lock_guard<std::mutex> lock(login.bitidMutex);
+    if (!login.bitidKeys)
+        login.bitidKeys = std::make_shared<BitidKeys>(login.rootKey());
+    return login.bitidKeys;
+}
+
 Status
-bitidLogin(DataSlice rootKey, const std::string &bitidUri, uint32_t index,
+bitidLogin(Login &login, const std::string &bitidUri, uint32_t index,
            Wallet *wallet, const std::string &kycUri)
 {
     Uri callbackUri;
@@ -84,7 +165,8 @@ bitidLogin(DataSlice rootKey, const std::string &bitidUri, uint32_t index,
     const auto callback = callbackUri.encode();
     const auto domain = callbackUri.authority();
 
-    const auto signature = bitidSign(rootKey, bitidUri, callback, index);
+    const auto keys = bitidKeys(login);
+    const auto signature = keys->sign(bitidUri, callback, index);
 
     struct BitidJson:
         public JsonObject
@@ -122,7 +204,7 @@ bitidLogin(DataSlice rootKey, const std::string &bitidUri, uint32_t index,
     // Create a second signature signed by private key derived from specified kycUri:
     if (parsedUri.bitidKycRequest)
     {
-        const auto signatureKyc = bitidSign(rootKey, bitidUri, kycUri);
+        const auto signatureKyc = keys->sign(bitidUri, kycUri);
         ABC_CHECK(json.idaddrSet(signatureKyc.address));
         ABC_CHECK(json.idsigSet(signatureKyc.signature));
     }
@@ -11,9 +11,13 @@
 #include "../util/Data.hpp"
 #include "../util/Status.hpp"
 #include <bitcoin/bitcoin.hpp>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace abcd {
 
+class Login;
 class Uri;
 class Wallet;
 
@@ -40,11 +44,70 @@ BitidSignature
 bitidSign(DataSlice rootKey, const std::string &message,
           const std::string &callbackUri, uint32_t index=0);
 
+/**
+ * One message to sign, along with the site that wants it.
+ */
+struct BitidChallenge
+{
+    std::string message;
+    std::string callbackUri;
+    uint32_t index;
+};
+
+/**
+ * Remembers the keys derived for each site,
+ * so repeat logins skip the hashing and HD derivation.
+ * Only the final signature happens on every request.
+ */
+class BitidKeys
+{
+public:
+    explicit BitidKeys(DataSlice rootKey);
+
+    /**
+     * Signs a message, like the stand-alone `bitidSign`.
+     */
+    BitidSignature
+    sign(const std::string &message, const std::string &callbackUri,
+         uint32_t index=0);
+
+    /**
+     * Signs several messages at once, spreading the work over the cores.
+     * The results come back in the same order as the challenges.
+     */
+    std::vector<BitidSignature>
+    sign(const std::vector<BitidChallenge> &challenges);
+
+private:
+    struct SiteKey
+    {
+        bc::ec_secret secret;
+        std::string address;
+    };
+
+    std::mutex mutex_;
+    const bc::hd_private_key root_;
+    std::map<std::pair<std::string, uint32_t>, SiteKey> keys_;
+
+    /**
+     * Finds or derives the key for a site.
+     * The caller must hold the mutex.
+     */
+    const SiteKey &
+    siteKey(const std::string &callbackUri, uint32_t index);
+};
+
+/**
+ * Obtains the site key cache for a login, creating it if needed.
+ */
+std::shared_ptr<BitidKeys>
+bitidKeys(Login &login);
+
 /**
  * Performs a BitID login to the specified URI.
  */
 Status
-bitidLogin(DataSlice rootKey, const std::string &bitidUri, uint32_t index=0,
+bitidLogin(Login &login, const std::string &bitidUri, uint32_t index=0,
            Wallet *wallet=nullptr, const std::string &kycUri="");
 
 } // namespace abcd
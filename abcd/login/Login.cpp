@@ -6,6 +6,7 @@
  */
 
 #include "Login.hpp"
+#include "LoginKeyCache.hpp"
 #include "LoginStore.hpp"
 #include "json/AuthJson.hpp"
 #include "json/KeyJson.hpp"
@@ -21,6 +22,7 @@
 #include "../util/Sync.hpp"
 #include <bitcoin/bitcoin.hpp>
 #include <ctype.h>
+#include <thread>
 
 namespace abcd {
 
@@ -83,8 +85,11 @@ Login::passwordAuth() const
 Status
 Login::passwordAuthSet(DataSlice passwordAuth)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    passwordAuth_ = DataChunk(passwordAuth.begin(), passwordAuth.end());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        passwordAuth_ = DataChunk(passwordAuth.begin(), passwordAuth.end());
+    }
+    keysCache();
     return Status();
 }
 
@@ -303,6 +308,41 @@ Login::Login(LoginStore &store, DataSlice dataKey):
 
 Status
 Login::createNew(const char *password)
+{
+    // The rootKey doesn't depend on anything else, so start on it now:
+    JsonBox rootKeyBox, mnemonicBox, dataKeyBox;
+    Status rootKeyStatus;
+    std::thread rootKeyThread([&]()
+    {
+        rootKeyStatus = rootKeyCreate(rootKeyBox, mnemonicBox, dataKeyBox);
+    });
+    Status s = createPackages(password);
+    rootKeyThread.join();
+    ABC_CHECK(s);
+    ABC_CHECK(rootKeyStatus);
+
+    // The server needs the account before either of these,
+    // but they don't need each other:
+    Status upgradeStatus;
+    std::thread upgradeThread([&]()
+    {
+        upgradeStatus = loginServerAccountUpgrade(*this, rootKeyBox,
+                        mnemonicBox, dataKeyBox);
+    });
+    s = loginServerActivate(*this);
+    upgradeThread.join();
+    ABC_CHECK(upgradeStatus);
+    ABC_CHECK(rootKeyBox.save(paths.rootKeyPath()));
+
+    // Latch the account:
+    ABC_CHECK(s);
+    keysCache();
+
+    return Status();
+}
+
+Status
+Login::createPackages(const char *password)
 {
     LoginPackage loginPackage;
     JsonSnrp snrp;
@@ -324,13 +364,18 @@ Login::createNew(const char *password)
     {
         std::string LP = store.username() + password;
 
-        // Generate passwordAuth:
-        ABC_CHECK(usernameSnrp().hash(passwordAuth_, LP));
+        // Generate passwordAuth and passwordKey side by side:
+        ScryptSnrp passwordKeySnrp;
+        DataChunk passwordKey;
+        ABC_CHECK(carePackage.passwordKeySnrp().snrpGet(passwordKeySnrp));
+        ABC_CHECK(scryptHashAll(
+        {
+            {usernameSnrp(), LP, &passwordAuth_},
+            {passwordKeySnrp, LP, &passwordKey}
+        }));
 
         // We have a password, so use it to encrypt dataKey:
-        DataChunk passwordKey;
         JsonBox passwordBox;
-        ABC_CHECK(carePackage.passwordKeySnrp().hash(passwordKey, LP));
         ABC_CHECK(passwordBox.encrypt(dataKey_, passwordKey));
         ABC_CHECK(loginPackage.passwordBoxSet(passwordBox));
     }
@@ -351,7 +396,6 @@ Login::createNew(const char *password)
     ABC_CHECK(store.paths(paths, true));
     ABC_CHECK(carePackage.save(paths.carePackagePath()));
     ABC_CHECK(loginPackage.save(paths.loginPackagePath()));
-    ABC_CHECK(rootKeyUpgrade());
 
     // Save the bare minimum needed to access the Airbitz account:
     LoginStashJson stashJson;
@@ -359,9 +403,6 @@ Login::createNew(const char *password)
     ABC_CHECK(stashJson.syncKeyBoxSet(syncKeyBox));
     stashJson.save(paths.stashPath());
 
-    // Latch the account:
-    ABC_CHECK(loginServerActivate(*this));
-
     return Status();
 }
 
@@ -370,6 +411,17 @@ Login::loadOffline()
 {
     ABC_CHECK(store.paths(paths, true));
 
+    // Skip the decryption if this login has already unpacked its keys:
+    time_t loginPackageTime = 0;
+    LoginKeys keys;
+    if (fileTime(loginPackageTime, paths.loginPackagePath()) &&
+            loginKeysFind(keys, store.username(), dataKey_, loginPackageTime))
+    {
+        passwordAuth_.assign(keys.passwordAuth.begin(), keys.passwordAuth.end());
+        rootKey_ = keys.rootKey;
+        return Status();
+    }
+
     LoginPackage loginPackage;
     ABC_CHECK(loginPackage.load(paths.loginPackagePath()));
     ABC_CHECK(loginPackage.passwordAuthBox().decrypt(passwordAuth_, dataKey_));
@@ -394,9 +446,10 @@ Login::loadOffline()
 
     // Extract the rootKey:
     if (rootKeyBox.ok())
-        ABC_CHECK(rootKeyBox.decrypt(rootKey_, dataKey_));
+        ABC_CHECK(rootKeyDecrypt(rootKeyBox));
     else
         ABC_CHECK(rootKeyUpgrade());
+    keysCache();
 
     return Status();
 }
@@ -415,31 +468,64 @@ Login::loadOnline(LoginReplyJson loginJson)
         return ABC_ERROR(ABC_CC_Error,
                          "The account has a rootKey, but it's not on the server.");
     if (rootKeyBox.ok())
-        ABC_CHECK(rootKeyBox.decrypt(rootKey_, dataKey_));
+        ABC_CHECK(rootKeyDecrypt(rootKeyBox));
     else
         ABC_CHECK(rootKeyUpgrade());
+    keysCache();
 
     return Status();
 }
 
+void
+Login::keysCache()
+{
+    LoginKeys keys;
+    if (!fileTime(keys.loginPackageTime, paths.loginPackagePath()))
+        return;
+    keys.dataKey = dataKey_;
+    keys.rootKey = rootKey_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keys.passwordAuth.assign(passwordAuth_.begin(), passwordAuth_.end());
+    }
+    loginKeysSave(store.username(), keys);
+}
+
 Status
-Login::rootKeyUpgrade()
+Login::rootKeyDecrypt(JsonBox &rootKeyBox)
+{
+    DataChunk rootKey;
+    ABC_CHECK(rootKeyBox.decrypt(rootKey, dataKey_));
+    secureAssign(rootKey_, rootKey);
+    return Status();
+}
+
+Status
+Login::rootKeyCreate(JsonBox &rootKeyBox, JsonBox &mnemonicBox,
+                     JsonBox &dataKeyBox)
 {
     // Create a BIP39 mnemonic, and use it to derive the rootKey:
     DataChunk entropy;
     ABC_CHECK(randomData(entropy, 256/8));
     auto mnemonic = bc::create_mnemonic(entropy, bc::language::en);
     auto rootKeyRaw = bc::decode_mnemonic(mnemonic);
-    rootKey_ = DataChunk(rootKeyRaw.begin(), rootKeyRaw.end());
+    rootKey_.assign(rootKeyRaw.begin(), rootKeyRaw.end());
 
     // Pack the keys into various boxes:
-    JsonBox rootKeyBox;
     ABC_CHECK(rootKeyBox.encrypt(rootKey_, dataKey_));
-    JsonBox mnemonicBox, dataKeyBox;
     auto infoKey = bc::hmac_sha256_hash(rootKey_, DataSlice(infoKeyHmacKey));
     ABC_CHECK(mnemonicBox.encrypt(bc::join(mnemonic), infoKey));
     ABC_CHECK(dataKeyBox.encrypt(dataKey_, infoKey));
 
+    return Status();
+}
+
+Status
+Login::rootKeyUpgrade()
+{
+    JsonBox rootKeyBox, mnemonicBox, dataKeyBox;
+    ABC_CHECK(rootKeyCreate(rootKeyBox, mnemonicBox, dataKeyBox));
+
     // Upgrade the account on the server:
     ABC_CHECK(loginServerAccountUpgrade(*this,
                                         rootKeyBox, mnemonicBox, dataKeyBox));
@@ -10,12 +10,15 @@
 
 #include "../AccountPaths.hpp"
 #include "../util/Data.hpp"
+#include "../util/SecureData.hpp"
 #include "../util/Status.hpp"
 #include <memory>
 #include <mutex>
 
 namespace abcd {
 
+class BitidKeys;
+class JsonBox;
 class JsonPtr;
 class LoginStore;
 struct LoginPackage;
@@ -88,13 +91,17 @@ public:
     makeEdgeLogin(JsonPtr &result, const std::string &appId,
                   const std::string &pin);
 
+    // The derived BitID site keys, managed by Bitid.cpp:
+    std::mutex bitidMutex;
+    std::shared_ptr<BitidKeys> bitidKeys;
+
 private:
     mutable std::mutex mutex_;
     const std::shared_ptr<LoginStore> parent_;
 
     // Keys:
-    const DataChunk dataKey_;
-    DataChunk rootKey_;
+    const SecureChunk dataKey_;
+    SecureChunk rootKey_;
     DataChunk passwordAuth_;
 
     Login(LoginStore &store, DataSlice dataKey);
@@ -108,6 +115,13 @@ private:
     Status
     createNew(const char *password);
 
+    /**
+     * Builds the login packages, creates the account on the server,
+     * and saves the packages to disk.
+     */
+    Status
+    createPackages(const char *password);
+
     /**
      * Unpacks the keys from the loginPackage.
      */
@@ -117,6 +131,25 @@ private:
     Status
     loadOnline(LoginReplyJson loginJson);
 
+    /**
+     * Saves the unpacked keys to the login key cache,
+     * so the next offline login can skip the decryption.
+     */
+    void
+    keysCache();
+
+    Status
+    rootKeyDecrypt(JsonBox &rootKeyBox);
+
+    /**
+     * Makes a fresh rootKey, along with the boxes the server keeps it in.
+     * This touches nothing but the rootKey, so it can run
+     * alongside the rest of the signup work.
+     */
+    Status
+    rootKeyCreate(JsonBox &rootKeyBox, JsonBox &mnemonicBox,
+                  JsonBox &dataKeyBox);
+
     Status
     rootKeyUpgrade();
 };
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "LoginKeyCache.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace abcd {
+
+/**
+ * The cached keys, shared by every session.
+ * These outlive the sessions themselves, so a session dropped to make room
+ * for another user can log back in without touching the disk,
+ * but they go away on an explicit logout.
+ */
+struct LoginKeySingleton
+{
+    std::mutex mutex;
+    std::map<std::string, LoginKeys> keys;
+};
+
+static LoginKeySingleton gLoginKeys;
+
+bool
+loginKeysFind(LoginKeys &result, const std::string &username,
+              DataSlice dataKey, time_t loginPackageTime)
+{
+    std::lock_guard<std::mutex> lock(gLoginKeys.mutex);
+
+    const auto i = gLoginKeys.keys.find(username);
+    if (gLoginKeys.keys.end() == i)
+        return false;
+
+    const auto &keys = i->second;
+    if (keys.loginPackageTime != loginPackageTime ||
+            keys.dataKey.size() != dataKey.size() ||
+            !std::equal(dataKey.begin(), dataKey.end(), keys.dataKey.begin()))
+        return false;
+
+    result = keys;
+    return true;
+}
+
+void
+loginKeysSave(const std::string &username, const LoginKeys &keys)
+{
+    std::lock_guard<std::mutex> lock(gLoginKeys.mutex);
+    gLoginKeys.keys[username] = keys;
+}
+
+void
+loginKeysClear(const std::string &username)
+{
+    std::lock_guard<std::mutex> lock(gLoginKeys.mutex);
+    gLoginKeys.keys.erase(username);
+}
+
+void
+loginKeysClear()
+{
+    std::lock_guard<std::mutex> lock(gLoginKeys.mutex);
+    gLoginKeys.keys.clear();
+}
+
+} // namespace abcd
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Remembers the decrypted keys of recent logins.
+ */
+
+#ifndef ABCD_LOGIN_LOGIN_KEY_CACHE_HPP
+#define ABCD_LOGIN_LOGIN_KEY_CACHE_HPP
+
+#include "../util/Data.hpp"
+#include "../util/SecureData.hpp"
+#include <time.h>
+#include <string>
+
+namespace abcd {
+
+/**
+ * The keys a login unpacks from its account directory.
+ */
+struct LoginKeys
+{
+    SecureChunk dataKey;
+    SecureChunk passwordAuth;
+    SecureChunk rootKey;
+    time_t loginPackageTime = 0; // The cache is stale if this changes
+};
+
+/**
+ * Finds the cached keys for a user, if the caller has the right dataKey
+ * and the login package has not changed on disk since they were cached.
+ * Having the dataKey already proves the caller could decrypt the rest,
+ * so a hit just skips the file reads and decryption.
+ */
+bool
+loginKeysFind(LoginKeys &result, const std::string &username,
+              DataSlice dataKey, time_t loginPackageTime);
+
+/**
+ * Stores the keys for a user, replacing anything already there.
+ * The keys live in locked memory, and are wiped on replacement.
+ */
+void
+loginKeysSave(const std::string &username, const LoginKeys &keys);
+
+/**
+ * Forgets the keys for one user.
+ */
+void
+loginKeysClear(const std::string &username);
+
+/**
+ * Forgets every cached key.
+ */
+void
+loginKeysClear();
+
+} // namespace abcd
+
+#endif
@@ -13,7 +13,9 @@
 #include "json/LoginPackages.hpp"
 #include "server/LoginServer.hpp"
 #include "../Context.hpp"
+#include "../General.hpp"
 #include "../json/JsonBox.hpp"
+#include "../util/Parallel.hpp"
 
 namespace abcd {
 
@@ -52,6 +54,10 @@ loginPasswordServer(std::shared_ptr<Login> &result,
 {
     const auto LP = store.username() + password;
 
+    // A fresh device will want the general info as soon as it logs in,
+    // and fetching it depends on nothing here, so overlap it with the login:
+    ParallelTask general([]() { generalUpdate().log(); });
+
     // Create passwordAuth:
     DataChunk passwordAuth;
     ABC_CHECK(usernameSnrp().hash(passwordAuth, LP));
@@ -90,18 +96,25 @@ loginPasswordSet(Login &login, const std::string &password)
 {
     std::string LP = login.store.username() + password;
 
-    // Create passwordBox:
+    // Make passwordKey and passwordAuth side by side:
     JsonSnrp passwordKeySnrp;
+    ScryptSnrp snrp;
     DataChunk passwordKey;
-    JsonBox passwordBox;
+    DataChunk passwordAuth;
     ABC_CHECK(passwordKeySnrp.create());
-    ABC_CHECK(passwordKeySnrp.hash(passwordKey, LP));
+    ABC_CHECK(passwordKeySnrp.snrpGet(snrp));
+    ABC_CHECK(scryptHashAll(
+    {
+        {snrp, LP, &passwordKey},
+        {usernameSnrp(), LP, &passwordAuth}
+    }));
+
+    // Create passwordBox:
+    JsonBox passwordBox;
     ABC_CHECK(passwordBox.encrypt(login.dataKey(), passwordKey));
 
     // Create passwordAuth:
-    DataChunk passwordAuth;
     JsonBox passwordAuthBox;
-    ABC_CHECK(usernameSnrp().hash(passwordAuth, LP));
     ABC_CHECK(passwordAuthBox.encrypt(passwordAuth, login.dataKey()));
 
     // Change the server login:
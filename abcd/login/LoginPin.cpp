@@ -81,20 +81,27 @@ loginPin(std::shared_ptr<Login> &result,
     DataChunk pinAuthId;
     ABC_CHECK(local.pinAuthIdDecode(pinAuthId));
 
+    // Neither key depends on the server, so make them side by side:
+    ScryptSnrp pinKeyKeySnrp;
+    DataChunk pinAuthKey;       // Unlocks the server
+    DataChunk pinKeyKey;        // Unlocks pinKey
+    ABC_CHECK(carePackage.passwordKeySnrp().snrpGet(pinKeyKeySnrp));
+    ABC_CHECK(scryptHashAll(
+    {
+        {usernameSnrp(), LPIN, &pinAuthKey},
+        {pinKeyKeySnrp, LPIN, &pinKeyKey}
+    }));
+
     // Get EPINK from the server:
     std::string EPINK;
-    DataChunk pinAuthKey;       // Unlocks the server
     JsonBox pinKeyBox;          // Holds pinKey
-    ABC_CHECK(usernameSnrp().hash(pinAuthKey, LPIN));
     ABC_CHECK(loginServerGetPinPackage(pinAuthId, pinAuthKey, EPINK,
                                        authError));
     ABC_CHECK(pinKeyBox.decode(EPINK));
 
     // Decrypt dataKey:
-    DataChunk pinKeyKey;        // Unlocks pinKey
     DataChunk pinKey;           // Unlocks dataKey
     DataChunk dataKey;          // Unlocks the account
-    ABC_CHECK(carePackage.passwordKeySnrp().hash(pinKeyKey, LPIN));
     ABC_CHECK(pinKeyBox.decrypt(pinKey, pinKeyKey));
     ABC_CHECK(local.pinBox().decrypt(dataKey, pinKey));
 
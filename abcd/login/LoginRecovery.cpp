@@ -12,13 +12,49 @@
 #include "json/LoginJson.hpp"
 #include "json/LoginPackages.hpp"
 #include "server/LoginServer.hpp"
+#include "../crypto/Scrypt.hpp"
 #include "../json/JsonBox.hpp"
+#include "../util/Parallel.hpp"
 
 namespace abcd {
 
+static bool
+snrpSame(const ScryptSnrp &a, const ScryptSnrp &b)
+{
+    return a.salt == b.salt && a.n == b.n && a.r == b.r && a.p == b.p;
+}
+
+/**
+ * Reads the recovery parameters from the care package on this device, if any.
+ * These usually match the server's copy, so the keys they make
+ * can be started before the server has answered.
+ */
+static bool
+recoverySnrpLocal(ScryptSnrp &questionKeySnrp, ScryptSnrp &recoveryKeySnrp,
+                  LoginStore &store)
+{
+    AccountPaths paths;
+    CarePackage carePackage;
+    return store.paths(paths) &&
+           carePackage.load(paths.carePackagePath()) &&
+           carePackage.questionKeySnrp().snrpGet(questionKeySnrp) &&
+           carePackage.recoveryKeySnrp().snrpGet(recoveryKeySnrp);
+}
+
 Status
 loginRecoveryQuestions(std::string &result, LoginStore &store)
 {
+    // Start on questionKey while the server request is out:
+    ScryptSnrp localSnrp, unused;
+    const bool local = recoverySnrpLocal(localSnrp, unused, store);
+    DataChunk localKey;
+    Status localStatus;
+    ParallelTask hash([&]()
+    {
+        if (local)
+            localStatus = localSnrp.hash(localKey, store.username());
+    });
+
     // Grab the login information from the server:
     AuthJson authJson;
     LoginReplyJson loginJson;
@@ -29,10 +65,16 @@ loginRecoveryQuestions(std::string &result, LoginStore &store)
     if (!loginJson.questionBox())
         return ABC_ERROR(ABC_CC_NoRecoveryQuestions, "No recovery questions");
 
-    // Decrypt:
+    // Decrypt, re-hashing only if the parameters have changed:
+    ScryptSnrp questionKeySnrp;
     DataChunk questionKey;
     DataChunk questions;
-    ABC_CHECK(loginJson.questionKeySnrp().hash(questionKey, store.username()));
+    ABC_CHECK(loginJson.questionKeySnrp().snrpGet(questionKeySnrp));
+    hash.wait();
+    if (local && localStatus && snrpSame(localSnrp, questionKeySnrp))
+        questionKey = std::move(localKey);
+    else
+        ABC_CHECK(questionKeySnrp.hash(questionKey, store.username()));
     ABC_CHECK(loginJson.questionBox().decrypt(questions, questionKey));
 
     result = toString(questions);
@@ -46,9 +88,20 @@ loginRecovery(std::shared_ptr<Login> &result,
 {
     const auto LRA = store.username() + recoveryAnswers;
 
-    // Create recoveryAuth:
+    // Create recoveryAuth, and recoveryKey too if the device has its
+    // parameters, since the server would just hand back the same ones:
+    ScryptSnrp unused, localSnrp;
+    const bool local = recoverySnrpLocal(unused, localSnrp, store);
     DataChunk recoveryAuth;
-    ABC_CHECK(usernameSnrp().hash(recoveryAuth, LRA));
+    DataChunk localKey;
+    if (local)
+        ABC_CHECK(scryptHashAll(
+    {
+        {usernameSnrp(), LRA, &recoveryAuth},
+        {localSnrp, LRA, &localKey}
+    }));
+    else
+        ABC_CHECK(usernameSnrp().hash(recoveryAuth, LRA));
 
     // Grab the login information from the server:
     AuthJson authJson;
@@ -56,10 +109,15 @@ loginRecovery(std::shared_ptr<Login> &result,
     ABC_CHECK(authJson.recoverySet(store, recoveryAuth));
     ABC_CHECK(loginServerLogin(loginJson, authJson, &authError));
 
-    // Unlock recoveryBox:
+    // Unlock recoveryBox, re-hashing only if the parameters have changed:
+    ScryptSnrp recoveryKeySnrp;
     DataChunk recoveryKey;
     DataChunk dataKey;
-    ABC_CHECK(loginJson.recoveryKeySnrp().hash(recoveryKey, LRA));
+    ABC_CHECK(loginJson.recoveryKeySnrp().snrpGet(recoveryKeySnrp));
+    if (local && snrpSame(localSnrp, recoveryKeySnrp))
+        recoveryKey = std::move(localKey);
+    else
+        ABC_CHECK(recoveryKeySnrp.hash(recoveryKey, LRA));
     ABC_CHECK(loginJson.recoveryBox().decrypt(dataKey, recoveryKey));
 
     // Create the Login object:
@@ -90,29 +148,33 @@ loginRecoverySet(Login &login,
     ABC_CHECK(snrp.create());
     ABC_CHECK(carePackage.questionKeySnrpSet(snrp));
 
-    // Make questionKey (unlocks questions):
+    // Make questionKey (unlocks questions), recoveryKey (unlocks dataKey),
+    // and recoveryAuth (unlocks the server) side by side:
+    ScryptSnrp questionKeySnrp;
+    ScryptSnrp recoveryKeySnrp;
     DataChunk questionKey;
-    ABC_CHECK(carePackage.questionKeySnrp().hash(questionKey,
-              login.store.username()));
+    DataChunk recoveryKey;
+    DataChunk recoveryAuth;
+    const auto &username = login.store.username();
+    ABC_CHECK(carePackage.questionKeySnrp().snrpGet(questionKeySnrp));
+    ABC_CHECK(carePackage.recoveryKeySnrp().snrpGet(recoveryKeySnrp));
+    ABC_CHECK(scryptHashAll(
+    {
+        {questionKeySnrp, username, &questionKey},
+        {recoveryKeySnrp, LRA, &recoveryKey},
+        {usernameSnrp(), LRA, &recoveryAuth}
+    }));
 
     // Encrypt the questions:
     JsonBox questionBox;
     ABC_CHECK(questionBox.encrypt(recoveryQuestions, questionKey));
     ABC_CHECK(carePackage.questionBoxSet(questionBox));
 
-    // Make recoveryKey (unlocks dataKey):
-    DataChunk recoveryKey;
-    ABC_CHECK(carePackage.recoveryKeySnrp().hash(recoveryKey, LRA));
-
     // Encrypt dataKey:
     JsonBox recoveryBox;
     ABC_CHECK(recoveryBox.encrypt(login.dataKey(), recoveryKey));
     ABC_CHECK(loginPackage.recoveryBoxSet(recoveryBox));
 
-    // Make recoveryAuth (unlocks the server):
-    DataChunk recoveryAuth;
-    ABC_CHECK(usernameSnrp().hash(recoveryAuth, LRA));
-
     // Change the server login:
     ABC_CHECK(loginServerChangePassword(login, passwordAuth, recoveryAuth,
                                         carePackage, loginPackage));
@@ -6,6 +6,7 @@
  */
 
 #include "LoginStore.hpp"
+#include "UserIdCache.hpp"
 #include "json/LoginPackages.hpp"
 #include "server/LoginServer.hpp"
 #include "../Context.hpp"
@@ -125,7 +126,7 @@ LoginStore::init(const std::string &username)
     gContext->paths.accountDir(paths_, username_);
 
     // Create userId:
-    ABC_CHECK(usernameSnrp().hash(userId_, username_));
+    ABC_CHECK(userIdGet(userId_, username_));
     ABC_DebugLog("userId: %s", base64Encode(userId()).c_str());
 
     // Load the OTP key, if possible:
@@ -8,10 +8,51 @@
 #include "Otp.hpp"
 #include "Login.hpp"
 #include "LoginStore.hpp"
+#include "UserIdCache.hpp"
 #include "server/LoginServer.hpp"
+#include "../Context.hpp"
+#include "../json/JsonObject.hpp"
+#include <time.h>
+#include <mutex>
 
 namespace abcd {
 
+// Reset timers run for days, so a few minutes of staleness is harmless:
+constexpr time_t otpPendingTtl = 10 * 60;
+
+/**
+ * The last reset-pending answers from the server, by fixed username.
+ */
+struct OtpPendingJson:
+    public JsonObject
+{
+    ABC_JSON_INTEGER(time, "time", 0)
+    ABC_JSON_VALUE(users, "users", JsonObject)
+};
+
+static std::mutex gOtpPendingMutex;
+
+/**
+ * Records a known reset state for one user, if the cache has them.
+ * Failure is fine, since the cache expires anyway.
+ */
+static void
+otpPendingNote(const std::string &username, bool pending)
+{
+    if (!gContext)
+        return;
+    std::lock_guard<std::mutex> lock(gOtpPendingMutex);
+
+    OtpPendingJson json;
+    if (!json.load(gContext->paths.otpPendingPath()))
+        return;
+    auto users = json.users();
+    if (!json_object_get(users.get(), username.c_str()))
+        return;
+    users.set(username.c_str(), pending).log();
+    json.save(gContext->paths.otpPendingPath()).log();
+}
+
 Status
 otpAuthGet(Login &login, bool &enabled, long &timeout)
 {
@@ -45,14 +86,53 @@ Status
 otpResetGet(std::list<std::string> &result,
             const std::list<std::string> &usernames)
 {
-    // List the users:
-    std::list<DataChunk> userIds;
+    std::lock_guard<std::mutex> lock(gOtpPendingMutex);
+    const auto path = gContext->paths.otpPendingPath();
+    const time_t now = time(nullptr);
+
+    std::list<std::string> fixed;
     for (const auto &i: usernames)
     {
-        std::shared_ptr<LoginStore> store;
-        ABC_CHECK(LoginStore::create(store, i));
-        auto userId = store->userId();
-        userIds.emplace_back(userId.begin(), userId.end());
+        std::string username;
+        ABC_CHECK(LoginStore::fixUsername(username, i));
+        fixed.push_back(username);
+    }
+
+    // Answer from the cache if it is fresh and knows everyone:
+    OtpPendingJson cacheJson;
+    if (cacheJson.load(path) && cacheJson.time() <= now &&
+            now < cacheJson.time() + otpPendingTtl)
+    {
+        auto users = cacheJson.users();
+        bool complete = true;
+        std::list<std::string> out;
+        auto j = usernames.begin();
+        for (const auto &username: fixed)
+        {
+            json_t *value = json_object_get(users.get(), username.c_str());
+            if (!json_is_boolean(value))
+            {
+                complete = false;
+                break;
+            }
+            if (json_is_true(value))
+                out.push_back(*j);
+            ++j;
+        }
+        if (complete)
+        {
+            result = std::move(out);
+            return Status();
+        }
+    }
+
+    // List the users. The userIds are memoized, so this is cheap:
+    std::list<DataChunk> userIds;
+    for (const auto &username: fixed)
+    {
+        DataChunk userId;
+        ABC_CHECK(userIdGet(userId, username));
+        userIds.push_back(std::move(userId));
     }
 
     // Make the request:
@@ -60,30 +140,43 @@ otpResetGet(std::list<std::string> &result,
     ABC_CHECK(loginServerOtpPending(userIds, flags));
 
     // Smush the results:
+    JsonObject users;
     result.clear();
     auto i = flags.begin();
     auto j = usernames.begin();
+    auto k = fixed.begin();
     while (i != flags.end() && j != usernames.end())
     {
         if (*i)
             result.push_back(*j);
+        users.set(k->c_str(), *i).log();
         ++i;
         ++j;
+        ++k;
     }
 
+    OtpPendingJson json;
+    json.timeSet(now).log();
+    json.usersSet(users).log();
+    json.save(path).log(); // Failure is fine
+
     return Status();
 }
 
 Status
 otpResetSet(LoginStore &store, const std::string &token)
 {
-    return loginServerOtpReset(store, token);
+    ABC_CHECK(loginServerOtpReset(store, token));
+    otpPendingNote(store.username(), true);
+    return Status();
 }
 
 Status
 otpResetRemove(Login &login)
 {
-    return loginServerOtpResetCancelPending(login);
+    ABC_CHECK(loginServerOtpResetCancelPending(login));
+    otpPendingNote(login.store.username(), false);
+    return Status();
 }
 
 } // namespace abcd
@@ -43,7 +43,9 @@ Status
 otpAuthRemove(Login &login);
 
 /**
- * Returns the reset status for a group of accounts.
+ * Returns the accounts in the group that have a reset pending.
+ * The answers are cached in the root directory for a few minutes,
+ * so repeated checks over the same accounts cost no requests.
  */
 Status
 otpResetGet(std::list<std::string> &result,
@@ -28,6 +28,17 @@ struct QuestionsFile:
     ABC_JSON_VALUE(questions, "questions", JsonPtr);
 };
 
+static Status
+questionsUpdate(const std::string &path)
+{
+    JsonPtr resultsJson;
+    QuestionsFile file;
+    ABC_CHECK(loginServerGetQuestions(resultsJson));
+    ABC_CHECK(file.questionsSet(resultsJson));
+    ABC_CHECK(file.save(path));
+    return Status();
+}
+
 /**
  * Free question choices.
  *
@@ -81,14 +92,15 @@ tABC_CC ABC_GeneralGetQuestionChoices(tABC_QuestionChoices
 
     ABC_CHECK_NULL(ppQuestionChoices);
 
-    // Update the file if it is too old or does not exist:
-    if (!fileTime(lastTime, path) ||
-            lastTime + GENERAL_ACCEPTABLE_INFO_FILE_AGE_SECS < time(nullptr))
+    // Update the file if it is too old or does not exist,
+    // but a stale list beats no list if the server is out of reach:
+    if (!fileTime(lastTime, path))
+    {
+        ABC_CHECK_NEW(questionsUpdate(path));
+    }
+    else if (lastTime + GENERAL_ACCEPTABLE_INFO_FILE_AGE_SECS < time(nullptr))
     {
-        JsonPtr resultsJson;
-        ABC_CHECK_NEW(loginServerGetQuestions(resultsJson));
-        ABC_CHECK_NEW(file.questionsSet(resultsJson));
-        ABC_CHECK_NEW(file.save(path));
+        questionsUpdate(path).log();
     }
 
     // Read in the recovery question choices json object
@@ -14,6 +14,7 @@
 #include "../crypto/Random.hpp"
 #include "../json/JsonArray.hpp"
 #include "../json/JsonBox.hpp"
+#include "../util/Parallel.hpp"
 #include <bitcoin/bitcoin.hpp>
 
 namespace abcd {
@@ -142,6 +143,21 @@ lobbyFetch(Lobby &result, const std::string &id)
     return Status();
 }
 
+void
+lobbyFetchMany(std::vector<Lobby> &results, std::vector<Status> &statuses,
+               const std::vector<std::string> &ids)
+{
+    results.assign(ids.size(), Lobby());
+    statuses.assign(ids.size(), Status());
+
+    // Each slot belongs to one worker, so nothing here needs a lock:
+    parallelFor(ids.size(), [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+            statuses[i] = lobbyFetch(results[i], ids[i]);
+    }, 2);
+}
+
 Status
 loginRequestLoad(LoginRequest &result, const Lobby &lobby)
 {
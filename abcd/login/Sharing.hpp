@@ -11,6 +11,7 @@
 #include "../util/Status.hpp"
 #include "../json/JsonPtr.hpp"
 #include <memory>
+#include <vector>
 
 namespace abcd {
 
@@ -32,6 +33,16 @@ struct Lobby
 Status
 lobbyFetch(Lobby &result, const std::string &id);
 
+/**
+ * Fetches several lobbies at once, running the requests side by side
+ * over the pooled HTTP connections instead of one after another.
+ * @param results receives one lobby per id, in the same order.
+ * @param statuses receives the outcome for each id, in the same order.
+ */
+void
+lobbyFetchMany(std::vector<Lobby> &results, std::vector<Status> &statuses,
+               const std::vector<std::string> &ids);
+
 /**
  * A login request, parsed out of a lobby.
  */
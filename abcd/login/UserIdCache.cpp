@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "UserIdCache.hpp"
+#include "../Context.hpp"
+#include "../crypto/Encoding.hpp"
+#include "../crypto/Scrypt.hpp"
+#include "../json/JsonObject.hpp"
+#include <map>
+#include <mutex>
+
+namespace abcd {
+
+struct UserIdsJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(UserIdsJson, JsonObject)
+
+    // The userIds are only good for the salt that made them:
+    ABC_JSON_STRING(salt, "salt", "")
+    ABC_JSON_VALUE(users, "users", JsonObject)
+};
+
+/**
+ * The memoized userIds, shared by every login.
+ */
+struct UserIdSingleton
+{
+    std::mutex mutex;
+    bool loaded = false;
+    std::map<std::string, DataChunk> userIds;
+};
+
+static UserIdSingleton gUserIds;
+
+static void
+userIdsLoad()
+{
+    if (gUserIds.loaded)
+        return;
+    gUserIds.loaded = true;
+
+    UserIdsJson json;
+    if (!gContext || !json.load(gContext->paths.userIdsPath()))
+        return;
+    if (base16Encode(usernameSnrp().salt) != json.salt())
+        return;
+
+    auto users = json.users();
+    for (void *i = json_object_iter(users.get());
+            i;
+            i = json_object_iter_next(users.get(), i))
+    {
+        const auto value = json_object_iter_value(i);
+        DataChunk userId;
+        if (json_is_string(value) &&
+                base64Decode(userId, json_string_value(value)))
+            gUserIds.userIds[json_object_iter_key(i)] = userId;
+    }
+}
+
+static Status
+userIdsSave()
+{
+    if (!gContext)
+        return Status();
+
+    JsonObject users;
+    for (const auto &i: gUserIds.userIds)
+        ABC_CHECK(users.set(i.first.c_str(), base64Encode(i.second)));
+
+    UserIdsJson json;
+    ABC_CHECK(json.saltSet(base16Encode(usernameSnrp().salt)));
+    ABC_CHECK(json.usersSet(users));
+    ABC_CHECK(json.save(gContext->paths.userIdsPath()));
+    return Status();
+}
+
+Status
+userIdGet(DataChunk &result, const std::string &username)
+{
+    {
+        std::lock_guard<std::mutex> lock(gUserIds.mutex);
+        userIdsLoad();
+
+        const auto i = gUserIds.userIds.find(username);
+        if (gUserIds.userIds.end() != i)
+        {
+            result = i->second;
+            return Status();
+        }
+    }
+
+    // Hash without holding the lock, so other usernames can proceed:
+    DataChunk userId;
+    ABC_CHECK(usernameSnrp().hash(userId, username));
+
+    std::lock_guard<std::mutex> lock(gUserIds.mutex);
+    gUserIds.userIds[username] = userId;
+    userIdsSave().log();
+
+    result = std::move(userId);
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Remembers the userIds of usernames this device has seen.
+ */
+
+#ifndef ABCD_LOGIN_USER_ID_CACHE_HPP
+#define ABCD_LOGIN_USER_ID_CACHE_HPP
+
+#include "../util/Data.hpp"
+#include "../util/Status.hpp"
+
+namespace abcd {
+
+/**
+ * Finds the userId for a fixed username.
+ * The userId is the username's scrypt hash under `usernameSnrp`,
+ * which is public, so the results are memoized in memory and
+ * in the root directory, and only a new username costs a full hash.
+ */
+Status
+userIdGet(DataChunk &result, const std::string &username);
+
+} // namespace abcd
+
+#endif
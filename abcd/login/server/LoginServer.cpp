@@ -18,7 +18,9 @@
 #include "../../util/Debug.hpp"
 #include "../../util/AutoFree.hpp"
 #include "../../account/AccountSettings.hpp"
+#include <stdio.h>
 #include <map>
+#include <vector>
 
 // For debug upload:
 #include "../../WalletPaths.hpp"
@@ -528,17 +530,192 @@ loginServerOtpResetCancelPending(const Login &login)
     return Status();
 }
 
+/**
+ * Streams the debug upload body, reading and base64-encoding
+ * the files a block at a time.
+ * The files are opened and measured up front, so the total stays exact
+ * even while the log keeps growing or rolls over.
+ */
+class LogUploadBody
+{
+public:
+    ~LogUploadBody()
+    {
+        for (auto &file: files_)
+            if (file.f)
+                fclose(file.f);
+    }
+
+    LogUploadBody(UploadProgress progress):
+        progress_(progress)
+    {}
+
+    /**
+     * Adds literal JSON text to the body.
+     */
+    void
+    text(const std::string &text)
+    {
+        Piece piece;
+        piece.text = text;
+        total_ += text.size();
+        pieces_.push_back(piece);
+    }
+
+    /**
+     * Adds the base64 encoding of several files run together.
+     */
+    void
+    files(const std::vector<std::string> &paths)
+    {
+        Piece piece;
+        uint64_t size = 0;
+        for (const auto &path: paths)
+        {
+            File file;
+            file.f = fopen(path.c_str(), "rb");
+            if (file.f && !fseek(file.f, 0, SEEK_END))
+            {
+                const long end = ftell(file.f);
+                file.left = 0 < end ? end : 0;
+                rewind(file.f);
+            }
+            size += file.left;
+            piece.files.push_back(files_.size());
+            files_.push_back(file);
+        }
+        piece.base64 = true;
+        total_ += (size + 2) / 3 * 4;
+        pieces_.push_back(piece);
+    }
+
+    uint64_t
+    total() const { return total_; }
+
+    Status
+    read(DataChunk &result)
+    {
+        result.clear();
+        while (result.empty() && next_ < pieces_.size())
+        {
+            auto &piece = pieces_[next_];
+            if (!piece.base64)
+            {
+                result.assign(piece.text.begin(), piece.text.end());
+                ++next_;
+                continue;
+            }
+
+            // Gather a block of raw bytes, keeping it a multiple of 3:
+            DataChunk raw = std::move(carry_);
+            carry_.clear();
+            bool end = true;
+            for (auto i: piece.files)
+            {
+                auto &file = files_[i];
+                while (file.left && raw.size() < blockSize)
+                {
+                    uint8_t buffer[blockSize];
+                    size_t want = blockSize - raw.size();
+                    if (file.left < want)
+                        want = file.left;
+                    const auto got = fread(buffer, 1, want, file.f);
+                    if (!got)
+                        file.left = 0; // Truncated underneath us
+                    else
+                        file.left -= got;
+                    raw.insert(raw.end(), buffer, buffer + got);
+                }
+                if (file.left)
+                {
+                    end = false;
+                    break;
+                }
+            }
+
+            if (!end)
+            {
+                const auto whole = raw.size() / 3 * 3;
+                carry_.assign(raw.begin() + whole, raw.end());
+                raw.resize(whole);
+            }
+            else
+            {
+                ++next_;
+            }
+
+            const auto encoded = base64Encode(raw);
+            result.assign(encoded.begin(), encoded.end());
+        }
+
+        sent_ += result.size();
+        if (progress_)
+            progress_(sent_, total_);
+        return Status();
+    }
+
+private:
+    static constexpr size_t blockSize = 12 * 1024;
+
+    struct File
+    {
+        FILE *f = nullptr;
+        uint64_t left = 0;
+    };
+
+    struct Piece
+    {
+        bool base64 = false;
+        std::string text;
+        std::vector<size_t> files;
+    };
+
+    UploadProgress progress_;
+    std::vector<File> files_;
+    std::vector<Piece> pieces_;
+    size_t next_ = 0;
+    DataChunk carry_;
+    uint64_t total_ = 0;
+    uint64_t sent_ = 0;
+};
+
+/**
+ * Lays out the debug upload, giving the same JSON as a plain upload
+ * with the "watchers" and "log" fields filled in.
+ */
+static void
+logUploadSetup(LogUploadBody &body, const std::string &authJson,
+               const std::vector<std::string> &watchers)
+{
+    // Splice the big fields into the end of the small JSON object:
+    auto prefix = authJson.substr(0, authJson.rfind('}'));
+    if (std::string::npos != prefix.find('"'))
+        prefix += ",";
+    body.text(prefix + "\"watchers\":[");
+
+    for (size_t i = 0; i < watchers.size(); ++i)
+    {
+        body.text(i ? ",\"" : "\"");
+        body.files({watchers[i]});
+        body.text("\"");
+    }
+
+    body.text("],\"log\":\"");
+    body.files(debugLogPaths());
+    body.text("\"}");
+}
+
 Status
-loginServerUploadLogs(Account *account)
+loginServerUploadLogs(Account *account, UploadProgress progress)
 {
     const auto url = ABC_SERVER_ROOT "/v1/account/debug";
     ServerRequestJson json;
+    std::vector<std::string> watchers;
 
     if (account)
     {
         json.setup(account->login); // Failure is fine
 
-        JsonArray jsonArray;
         auto ids = account->wallets.list();
         for (const auto &id: ids)
         {
@@ -548,22 +725,17 @@ loginServerUploadLogs(Account *account)
                 const auto name = wallet->name();
                 logInfo("Wallet '" + name + "' " + id);
 
-                const auto addresses = wallet->addresses.list();
-                for (const auto &address: addresses)
+                const auto addresses = wallet->addresses.snapshot();
+                for (const auto &address: *addresses)
                     logInfo(address);
             }
 
-            DataChunk watchData;
-            if (fileLoad(watchData, WalletPaths(id).cachePath()))
-            {
-                jsonArray.append(
-                    json_string(base64Encode(watchData).c_str()));
-            }
+            const auto watchPath = WalletPaths(id).cachePath();
+            if (fileExists(watchPath))
+                watchers.push_back(watchPath);
         }
-        json.set("watchers", jsonArray); // Failure is fine
 
-        AutoFree<tABC_AccountSettings, accountSettingsFree> settings;
-        settings.get() = accountSettingsLoad(*account);
+        const auto settings = accountSettingsShared(*account);
         std::string servers(settings->szOverrideBitcoinServerList);
         std::string strOverride = (settings->bOverrideBitcoinServers ? "true" :
                                    "false");
@@ -571,12 +743,23 @@ loginServerUploadLogs(Account *account)
         logInfo("bOverrideBitcoinServers:" + strOverride);
         logInfo("szOverrideBitcoinServerList:" + servers);
     }
+    const auto authJson = json.encode();
 
-    DataChunk logData = debugLogLoad();
-    json.set("log", base64Encode(logData)); // Failure is fine
+    // Compress if the server takes it, but fall back on a plain upload:
+    for (bool gzip: {true, false})
+    {
+        LogUploadBody body(progress);
+        logUploadSetup(body, authJson, watchers);
+        auto source = [&body](DataChunk &result)
+        {
+            return body.read(result);
+        };
 
-    HttpReply reply;
-    ABC_CHECK(AirbitzRequest().post(reply, url, json.encode()));
+        HttpReply reply;
+        ABC_CHECK(AirbitzRequest().postStream(reply, url, source, gzip));
+        if (415 != reply.code)
+            break;
+    }
 
     return Status();
 }
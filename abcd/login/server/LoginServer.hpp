@@ -15,6 +15,7 @@
 #include "../../util/Data.hpp"
 #include "../../util/Status.hpp"
 #include <time.h>
+#include <functional>
 #include <list>
 
 namespace abcd {
@@ -141,11 +142,18 @@ loginServerOtpPending(std::list<DataChunk> users, std::list<bool> &isPending);
 Status
 loginServerOtpResetCancelPending(const Login &login);
 
+/**
+ * Reports how many bytes of an upload have gone out so far.
+ */
+typedef std::function<void (uint64_t sent, uint64_t total)> UploadProgress;
+
 /**
  * Upload files to auth server for debugging.
+ * The logs stream from disk, compressed, so memory use stays bounded.
  */
 Status
-loginServerUploadLogs(Account *account);
+loginServerUploadLogs(Account *account,
+                      UploadProgress progress=UploadProgress());
 
 /**
  * Accesses the v2 login endpoint.
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "ChangeLog.hpp"
+
+namespace abcd {
+
+void
+ChangeLog::touch(const std::string &key)
+{
+    auto i = keys_.find(key);
+    if (keys_.end() != i)
+    {
+        order_.erase(i->second);
+        i->second = ++revision_;
+    }
+    else
+    {
+        keys_[key] = ++revision_;
+    }
+    order_[revision_] = key;
+}
+
+std::set<std::string>
+ChangeLog::since(uint64_t revision) const
+{
+    std::set<std::string> out;
+    for (auto i = order_.upper_bound(revision); order_.end() != i; ++i)
+        out.insert(i->second);
+    return out;
+}
+
+} // namespace abcd
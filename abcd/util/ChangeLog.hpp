@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Revision tracking for incremental queries.
+ */
+
+#ifndef ABCD_UTIL_CHANGE_LOG_HPP
+#define ABCD_UTIL_CHANGE_LOG_HPP
+
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <string>
+
+namespace abcd {
+
+/**
+ * Remembers the order in which keys were last modified,
+ * so callers can ask for everything that changed after a given revision.
+ * This class has no locking of its own,
+ * so the owning class should protect it with its mutex.
+ */
+class ChangeLog
+{
+public:
+    /**
+     * Returns the current revision.
+     * This starts at zero and increases with each change.
+     */
+    uint64_t
+    revision() const { return revision_; }
+
+    /**
+     * Records a change to the given key.
+     */
+    void
+    touch(const std::string &key);
+
+    /**
+     * Lists the keys that have changed after the given revision.
+     */
+    std::set<std::string>
+    since(uint64_t revision) const;
+
+private:
+    uint64_t revision_ = 0;
+    std::map<std::string, uint64_t> keys_;
+    std::map<uint64_t, std::string> order_;
+};
+
+} // namespace abcd
+
+#endif
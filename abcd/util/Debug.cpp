@@ -9,24 +9,78 @@
 #include "FileIO.hpp"
 #include "../Context.hpp"
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #ifdef ANDROID
 #include <android/log.h>
 #endif
-#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
-#include <sstream>
+#include <thread>
 #include <vector>
 
 namespace abcd {
 
 #define MAX_LOG_SIZE (1 << 19) // Max size 512 KiB
 
+constexpr size_t ringSlots = 1024;
+constexpr size_t slotText = 500;
+constexpr size_t lineMax = 2048; // Longer lines go through the heap
+constexpr auto writerIdle = std::chrono::milliseconds(20);
+
+static std::atomic<int> gDebugLevel(DEBUG_LEVEL);
+
 static std::mutex gDebugMutex;
 static FILE *gLogFile = nullptr;
+static long gLogSize = 0;
+static std::string gLogPath;
+static std::string gLogPrevPath;
 
-Status
+/**
+ * A bounded multi-producer, single-consumer byte queue.
+ * Each log line claims a run of consecutive slots with one
+ * compare-and-swap, so logging threads never take a lock.
+ * The writer thread drains the slots in order, so a slot is free
+ * exactly when its sequence number has come back around to its position.
+ */
+struct LogSlot
+{
+    std::atomic<size_t> sequence;
+    size_t size;
+    char text[slotText];
+};
+
+struct LogRing
+{
+    LogRing()
+    {
+        for (size_t i = 0; i < ringSlots; ++i)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LogSlot slots[ringSlots];
+    std::atomic<size_t> head{0}; // Next position to claim
+    std::atomic<size_t> tail{0}; // Next position to write out
+};
+
+static LogRing gRing;
+
+// The background writer:
+static std::thread gWriter;
+static std::atomic<bool> gWriterRunning(false);
+static std::mutex gWriterMutex;
+static std::condition_variable gWriterWake;
+static bool gWriterStop = false;
+
+/**
+ * Should be called with `gDebugMutex` held.
+ */
+static Status
 debugLogRotate()
 {
     if (gLogFile)
@@ -35,23 +89,171 @@ debugLogRotate()
         gLogFile = nullptr;
     }
 
-    auto path = gContext->paths.logPath();
-    if (fileExists(path))
-        rename(path.c_str(), gContext->paths.logPrevPath().c_str());
+    if (fileExists(gLogPath))
+        rename(gLogPath.c_str(), gLogPrevPath.c_str());
 
-    gLogFile = fopen(path.c_str(), "w");
+    gLogSize = 0;
+    gLogFile = fopen(gLogPath.c_str(), "w");
     if (!gLogFile)
-        return ABC_ERROR(ABC_CC_SysError, "Cannot open " + path);
+        return ABC_ERROR(ABC_CC_SysError, "Cannot open " + gLogPath);
 
     return Status();
 }
 
+/**
+ * Sends a batch of complete lines to the console and the log file.
+ */
+static void
+debugWrite(const char *data, size_t size)
+{
+#ifdef ANDROID
+    // Logcat wants one line per call:
+    const char *end = data + size;
+    for (const char *p = data; p < end;)
+    {
+        const char *line = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!line)
+            line = end;
+        __android_log_print(ANDROID_LOG_DEBUG, "ABC", "%.*s",
+                            static_cast<int>(line - p), p);
+        p = line + 1;
+    }
+#else
+    fwrite(data, 1, size, stderr);
+#endif
+
+    std::lock_guard<std::mutex> lock(gDebugMutex);
+    if (gLogFile && MAX_LOG_SIZE < gLogSize)
+        debugLogRotate().log();
+
+    if (gLogFile)
+    {
+        fwrite(data, 1, size, gLogFile);
+        fflush(gLogFile);
+        gLogSize += size;
+    }
+}
+
+/**
+ * Copies a line into the ring.
+ * @return false if the writer is not running to make room.
+ */
+static bool
+ringPush(const char *data, size_t size)
+{
+    const size_t count = std::min((size + slotText - 1) / slotText, ringSlots);
+    size = std::min(size, count * slotText);
+
+    size_t position = gRing.head.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // If the last slot we need is free, so are the ones before it:
+        const size_t last = position + count - 1;
+        const size_t sequence =
+            gRing.slots[last % ringSlots].sequence.load(std::memory_order_acquire);
+        const auto lag = static_cast<ptrdiff_t>(sequence - last);
+
+        if (0 == lag)
+        {
+            if (gRing.head.compare_exchange_weak(position, position + count,
+                                                 std::memory_order_relaxed))
+                break;
+        }
+        else if (lag < 0)
+        {
+            // The ring is full, so wait for the writer:
+            if (!gWriterRunning)
+                return false;
+            std::this_thread::yield();
+            position = gRing.head.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            position = gRing.head.load(std::memory_order_relaxed);
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto &slot = gRing.slots[(position + i) % ringSlots];
+        slot.size = std::min(slotText, size - i * slotText);
+        memcpy(slot.text, data + i * slotText, slot.size);
+        slot.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+/**
+ * Moves everything that is ready out of the ring.
+ */
+static void
+ringDrain(std::string &batch)
+{
+    size_t position = gRing.tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+        auto &slot = gRing.slots[position % ringSlots];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+            break;
+
+        batch.append(slot.text, slot.size);
+        slot.sequence.store(position + ringSlots, std::memory_order_release);
+        gRing.tail.store(++position, std::memory_order_release);
+    }
+}
+
+static void
+writerLoop()
+{
+    std::string batch;
+    batch.reserve(ringSlots * slotText);
+
+    while (true)
+    {
+        batch.clear();
+        ringDrain(batch);
+        if (batch.size())
+        {
+            debugWrite(batch.data(), batch.size());
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(gWriterMutex);
+        if (gWriterStop && gRing.head.load() == gRing.tail.load())
+            return;
+        gWriterWake.wait_for(lock, writerIdle);
+    }
+}
+
+/**
+ * Waits for the writer to catch up with everything logged so far.
+ */
+static void
+debugFlush()
+{
+    const size_t head = gRing.head.load();
+    while (gWriterRunning &&
+            static_cast<ptrdiff_t>(gRing.tail.load() - head) < 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
 Status
 debugInitialize()
 {
 #ifdef DEBUG
-    std::lock_guard<std::mutex> lock(gDebugMutex);
-    ABC_CHECK(debugLogRotate());
+    {
+        std::lock_guard<std::mutex> lock(gDebugMutex);
+        gLogPath = gContext->paths.logPath();
+        gLogPrevPath = gContext->paths.logPrevPath();
+        ABC_CHECK(debugLogRotate());
+    }
+
+    if (!gWriterRunning)
+    {
+        gWriterStop = false;
+        gWriter = std::thread(writerLoop);
+        gWriterRunning = true;
+    }
 #endif
 
     return Status();
@@ -60,6 +262,23 @@ debugInitialize()
 void
 debugTerminate()
 {
+    if (gWriterRunning)
+    {
+        {
+            std::lock_guard<std::mutex> lock(gWriterMutex);
+            gWriterStop = true;
+            gWriterWake.notify_all();
+        }
+        gWriter.join();
+        gWriterRunning = false;
+
+        // Anything that slipped in after the writer's last look:
+        std::string batch;
+        ringDrain(batch);
+        if (batch.size())
+            debugWrite(batch.data(), batch.size());
+    }
+
     std::lock_guard<std::mutex> lock(gDebugMutex);
     if (gLogFile)
     {
@@ -68,9 +287,23 @@ debugTerminate()
     }
 }
 
+void
+debugLevelSet(int level)
+{
+    gDebugLevel = level;
+}
+
+bool
+debugLevelEnabled(int level)
+{
+    return level <= gDebugLevel.load(std::memory_order_relaxed);
+}
+
 DataChunk
 debugLogLoad()
 {
+    debugFlush();
+
     DataChunk out1;
     fileLoad(out1, gContext->paths.logPrevPath()).log();
 
@@ -80,57 +313,67 @@ debugLogLoad()
     return buildData({out1, out2});
 }
 
+std::vector<std::string>
+debugLogPaths()
+{
+    debugFlush();
+    return {gContext->paths.logPrevPath(), gContext->paths.logPath()};
+}
+
 void ABC_DebugLog(const char *format, ...)
 {
 #ifdef DEBUG
+    if (!debugLevelEnabled(1))
+        return;
+
+    // The date only changes once a second, so keep it around:
+    static thread_local time_t lastTime = -1;
+    static thread_local char line[lineMax];
+    static thread_local size_t prefixSize = 0;
+
     time_t t = time(nullptr);
-    struct tm *utc = gmtime(&t);
-
-    std::stringstream date;
-    date << std::setfill('0');
-    date << std::setw(4) << utc->tm_year + 1900 << '-';
-    date << std::setw(2) << utc->tm_mon + 1 << '-';
-    date << std::setw(2) << utc->tm_mday << ' ';
-    date << std::setw(2) << utc->tm_hour << ':';
-    date << std::setw(2) << utc->tm_min << ':';
-    date << std::setw(2) << utc->tm_sec << " ABC_Log: ";
-
-    // Get the message length:
+    if (t != lastTime)
+    {
+        struct tm utc;
+        gmtime_r(&t, &utc);
+        prefixSize = snprintf(line, sizeof(line),
+                              "%04d-%02d-%02d %02d:%02d:%02d ABC_Log: ",
+                              utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                              utc.tm_hour, utc.tm_min, utc.tm_sec);
+        lastTime = t;
+    }
+
+    // Format the message straight after the date,
+    // leaving room for a final newline:
+    const size_t room = sizeof(line) - prefixSize - 1;
     va_list args;
     va_start(args, format);
-    char temp[1];
-    int size = vsnprintf(temp, sizeof(temp), format, args);
+    int size = vsnprintf(line + prefixSize, room, format, args);
     va_end(args);
     if (size < 0)
         return;
 
-    // Format the message:
-    va_start(args, format);
-    std::vector<char> message(size + 1);
-    vsnprintf(message.data(), message.size(), format, args);
-    va_end(args);
-
-    // Put the pieces together:
-    std::string out = date.str();
-    out.append(message.begin(), message.end() - 1);
-    if (out.back() != '\n')
-        out.append(1, '\n');
-
-#ifdef ANDROID
-    __android_log_print(ANDROID_LOG_DEBUG, "ABC", "%s", out.c_str());
-#else
-    fprintf(stderr, "%s", out.c_str());
-#endif
-
-    std::lock_guard<std::mutex> lock(gDebugMutex);
-    if (gLogFile && MAX_LOG_SIZE < ftell(gLogFile))
-        debugLogRotate().log();
-
-    if (gLogFile)
+    const char *out = line;
+    std::vector<char> big;
+    if (room <= static_cast<size_t>(size))
     {
-        fwrite(out.c_str(), 1, out.size(), gLogFile);
-        fflush(gLogFile);
+        // Too long for the buffer, so do it again on the heap:
+        big.resize(prefixSize + size + 2);
+        memcpy(big.data(), line, prefixSize);
+        va_start(args, format);
+        vsnprintf(big.data() + prefixSize, size + 1, format, args);
+        va_end(args);
+        out = big.data();
     }
+
+    char *end = const_cast<char *>(out) + prefixSize + size;
+    if (end[-1] != '\n')
+        *end++ = '\n';
+    const size_t total = end - out;
+
+    // Before start-up and after shutdown, just write it ourselves:
+    if (!gWriterRunning || !ringPush(out, total))
+        debugWrite(out, total);
 #endif
 }
 
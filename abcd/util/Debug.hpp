@@ -13,9 +13,14 @@
 
 #define DEBUG_LEVEL 1
 
+/**
+ * Logs at a particular level.
+ * Levels above `DEBUG_LEVEL` compile away,
+ * and levels above the runtime setting skip the formatting.
+ */
 #define ABC_DebugLevel(level, ...)  \
 {                                   \
-    if (DEBUG_LEVEL >= level)       \
+    if (DEBUG_LEVEL >= level && abcd::debugLevelEnabled(level)) \
     {                               \
         ABC_DebugLog(__VA_ARGS__);  \
     }                               \
@@ -23,7 +28,7 @@
 
 #define ABC_Debug(level, STR)  \
 {                                   \
-    if (DEBUG_LEVEL >= level)       \
+    if (DEBUG_LEVEL >= level && abcd::debugLevelEnabled(level)) \
     {                               \
         logInfo(STR);  \
     }                               \
@@ -39,6 +44,23 @@ debugTerminate();
 DataChunk
 debugLogLoad();
 
+/**
+ * Lists the log files, oldest first,
+ * once everything logged so far has reached them.
+ */
+std::vector<std::string>
+debugLogPaths();
+
+/**
+ * Sets the most detailed level that gets logged at runtime.
+ * Zero turns logging off entirely.
+ */
+void
+debugLevelSet(int level);
+
+bool
+debugLevelEnabled(int level);
+
 void ABC_DebugLog(const char *format, ...);
 
 /**
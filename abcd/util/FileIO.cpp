@@ -7,15 +7,76 @@
 
 #include "FileIO.hpp"
 #include "Debug.hpp"
+#include "WriteQueue.hpp"
 #include <dirent.h>
+#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <map>
 #include <mutex>
+#include <set>
 
 namespace abcd {
 
+// Marks the end of a checksummed file, after the CRC-32:
+constexpr uint32_t checkedMagic = 0xabc0c4c5;
+constexpr size_t checkedTrailerSize = 8;
+
+/**
+ * The changes under one watched directory.
+ */
+struct JournalEntry
+{
+    std::set<std::string> paths;
+    time_t lastWrite = 0;
+};
+
+static std::mutex gJournalMutex;
+static std::map<std::string, JournalEntry> gJournal;
+
+static std::mutex gDirsMutex;
+static std::set<std::string> gDirs;
+
+static uint32_t
+fileChecksum(DataSlice data)
+{
+    static const auto table = []()
+    {
+        std::vector<uint32_t> out(256);
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            out[i] = c;
+        }
+        return out;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    for (auto byte: data)
+        crc = table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+static void
+fileTrailerWrite(uint8_t *p, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = value >> (8 * i);
+}
+
+static uint32_t
+fileTrailerRead(const uint8_t *p)
+{
+    uint32_t out = 0;
+    for (int i = 0; i < 4; ++i)
+        out |= static_cast<uint32_t>(p[i]) << (8 * i);
+    return out;
+}
+
 std::string
 fileSlashify(const std::string &path)
 {
@@ -51,12 +112,15 @@ fileEnsureDir(const std::string &dir)
 bool
 fileExists(const std::string &path)
 {
-    return 0 == access(path.c_str(), F_OK);
+    return 0 == access(path.c_str(), F_OK) || writeQueuePending(path);
 }
 
 Status
 fileLoad(DataChunk &result, const std::string &path)
 {
+    if (writeQueuePending(path))
+        ABC_CHECK(writeQueueFlush(path));
+
     FILE *fp = fopen(path.c_str(), "rb");
     if (!fp)
         return ABC_ERROR(ABC_CC_FileOpenError,
@@ -82,6 +146,7 @@ Status
 fileSave(DataSlice data, const std::string &path)
 {
     ABC_DebugLog("Writing file %s", path.c_str());
+    writeQueueCancel(path);
 
     const auto pathTmp = path + ".tmp";
     FILE *fp = fopen(pathTmp.c_str(), "wb");
@@ -89,7 +154,8 @@ fileSave(DataSlice data, const std::string &path)
         return ABC_ERROR(ABC_CC_FileOpenError,
                          "Cannot open " + pathTmp + " for writing");
 
-    if (1 != fwrite(data.data(), data.size(), 1, fp))
+    if ((data.size() && 1 != fwrite(data.data(), data.size(), 1, fp)) ||
+            fflush(fp) || fsync(fileno(fp)))
     {
         fclose(fp);
         return ABC_ERROR(ABC_CC_FileWriteError, "Cannot write " + pathTmp);
@@ -99,6 +165,91 @@ fileSave(DataSlice data, const std::string &path)
     if (rename(pathTmp.c_str(), path.c_str()))
         return ABC_ERROR(ABC_CC_FileWriteError,
                          "Cannot rename " + pathTmp + " to " + path);
+    fileJournalNote(path);
+
+    const auto slash = path.rfind('/');
+    if (std::string::npos != slash)
+    {
+        std::lock_guard<std::mutex> lock(gDirsMutex);
+        gDirs.insert(path.substr(0, slash + 1));
+    }
+
+    return Status();
+}
+
+Status
+fileSyncDirs()
+{
+    std::set<std::string> dirs;
+    {
+        std::lock_guard<std::mutex> lock(gDirsMutex);
+        dirs.swap(gDirs);
+    }
+
+    Status out;
+    for (const auto &dir: dirs)
+    {
+        // Not every platform can open a directory for syncing:
+        int fd = open(dir.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        if (fsync(fd) && out)
+            out = ABC_ERROR(ABC_CC_FileWriteError, "Cannot flush " + dir);
+        close(fd);
+    }
+    return out;
+}
+
+Status
+fileSaveChecked(DataSlice data, const std::string &path)
+{
+    DataChunk out(data.begin(), data.end());
+    out.resize(data.size() + checkedTrailerSize);
+    fileTrailerWrite(out.data() + data.size(), fileChecksum(data));
+    fileTrailerWrite(out.data() + data.size() + 4, checkedMagic);
+    return fileSave(out, path);
+}
+
+Status
+fileLoadChecked(DataChunk &result, const std::string &path)
+{
+    ABC_CHECK(fileLoad(result, path));
+
+    if (result.size() < checkedTrailerSize)
+        return Status();
+    const auto *trailer = result.data() + result.size() - checkedTrailerSize;
+    if (checkedMagic != fileTrailerRead(trailer + 4))
+        return Status();
+
+    const auto checksum = fileTrailerRead(trailer);
+    result.resize(result.size() - checkedTrailerSize);
+    if (fileChecksum(result) != checksum)
+        return ABC_ERROR(ABC_CC_ParseError, "Checksum mismatch in " + path);
+
+    return Status();
+}
+
+Status
+fileAppend(DataSlice data, const std::string &path)
+{
+    if (data.empty())
+        return Status();
+
+    FILE *fp = fopen(path.c_str(), "ab");
+    if (!fp)
+        return ABC_ERROR(ABC_CC_FileOpenError,
+                         "Cannot open " + path + " for appending");
+
+    // Note the old end, so a failed write can be undone:
+    const long start = fseek(fp, 0, SEEK_END) ? -1 : ftell(fp);
+    bool ok = 0 <= start && 1 == fwrite(data.data(), data.size(), 1, fp);
+    if (fclose(fp))
+        ok = false;
+    if (!ok && 0 <= start && truncate(path.c_str(), start))
+        ABC_DebugLog("Cannot cut %s back after a failed append", path.c_str());
+    fileJournalNote(path);
+    if (!ok)
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot append to " + path);
 
     return Status();
 }
@@ -149,7 +300,10 @@ Status
 fileDelete(const std::string &path)
 {
     ABC_DebugLog("Deleting %s", path.c_str());
-    return fileDeleteRecursive(path);
+    writeQueueCancel(path);
+    Status s = fileDeleteRecursive(path);
+    fileJournalNote(path);
+    return s;
 }
 
 Status
@@ -163,5 +317,86 @@ fileTime(time_t &result, const std::string &path)
     return Status();
 }
 
+Status
+fileTimeExact(int64_t &result, const std::string &path)
+{
+    struct stat statInfo;
+    if (0 != stat(path.c_str(), &statInfo))
+        return ABC_ERROR(ABC_CC_Error, "Could not stat file " + path);
+
+#ifdef __APPLE__
+    const auto &mtime = statInfo.st_mtimespec;
+#else
+    const auto &mtime = statInfo.st_mtim;
+#endif
+    result = int64_t(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+    return Status();
+}
+
+void
+fileJournalNote(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(gJournalMutex);
+
+    const auto parent = fileSlashify(path);
+    for (auto i = gJournal.begin(); i != gJournal.end();)
+    {
+        const auto &dir = i->first;
+        if (dir.size() < path.size() && !path.compare(0, dir.size(), dir))
+        {
+            i->second.paths.insert(path.substr(dir.size()));
+            i->second.lastWrite = time(nullptr);
+            ++i;
+        }
+        else if (!dir.compare(0, parent.size(), parent))
+        {
+            // The whole directory has changed, so its history is no good:
+            i = gJournal.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+bool
+fileJournalTake(std::vector<std::string> &result, const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(gJournalMutex);
+
+    result.clear();
+    auto i = gJournal.find(fileSlashify(dir));
+    if (gJournal.end() == i)
+    {
+        gJournal[fileSlashify(dir)];
+        return false;
+    }
+
+    result.assign(i->second.paths.begin(), i->second.paths.end());
+    i->second.paths.clear();
+    return true;
+}
+
+bool
+fileJournalPending(time_t &lastWrite, const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(gJournalMutex);
+
+    auto i = gJournal.find(fileSlashify(dir));
+    if (gJournal.end() == i || i->second.paths.empty())
+        return false;
+
+    lastWrite = i->second.lastWrite;
+    return true;
+}
+
+void
+fileJournalReset(const std::string &dir)
+{
+    std::lock_guard<std::mutex> lock(gJournalMutex);
+    gJournal.erase(fileSlashify(dir));
+}
+
 } // namespace abcd
 
@@ -15,6 +15,7 @@
 #include "Data.hpp"
 #include "Status.hpp"
 #include <time.h>
+#include <vector>
 
 namespace abcd {
 
@@ -50,10 +51,45 @@ fileLoad(DataChunk &result, const std::string &path);
 
 /**
  * Writes a file to disk.
+ * The data goes into a temporary file, which is flushed to disk
+ * and then renamed over the original, so a crash leaves either
+ * the old contents or the new ones, never a mix.
+ * Flushing the renamed directory entry is left to `fileSyncDirs`,
+ * so a burst of saves only pays for that once.
  */
 Status
 fileSave(DataSlice data, const std::string &path);
 
+/**
+ * Flushes the directories touched by `fileSave` since the last call,
+ * making the renames themselves durable.
+ */
+Status
+fileSyncDirs();
+
+/**
+ * Writes a file with a checksum trailer, for large caches where
+ * a damaged file should be caught before anyone tries to parse it.
+ */
+Status
+fileSaveChecked(DataSlice data, const std::string &path);
+
+/**
+ * Reads a file written by `fileSaveChecked`, stripping the trailer.
+ * Files saved before the trailer existed load as-is.
+ * @return ABC_CC_ParseError if the checksum does not match.
+ */
+Status
+fileLoadChecked(DataChunk &result, const std::string &path);
+
+/**
+ * Adds data to the end of a file, creating the file if necessary.
+ * If the write fails partway, the file is cut back to its old length,
+ * so retrying the same data never leaves a torn copy behind.
+ */
+Status
+fileAppend(DataSlice data, const std::string &path);
+
 /**
  * Deletes a file recursively.
  */
@@ -66,6 +102,47 @@ fileDelete(const std::string &path);
 Status
 fileTime(time_t &result, const std::string &path);
 
+/**
+ * Determines a file's last-modification time in nanoseconds,
+ * for spotting changes that land within the same second.
+ */
+Status
+fileTimeExact(int64_t &result, const std::string &path);
+
+/**
+ * Records that a file or directory has just been written or deleted,
+ * so `fileJournalTake` can report it.
+ * The functions in this module call this on their own,
+ * but anything else that writes into a synced directory must too.
+ */
+void
+fileJournalNote(const std::string &path);
+
+/**
+ * Collects the paths that have changed under a directory
+ * since the last call, relative to the directory.
+ * The first call for a directory has no history to go on,
+ * so it returns false and starts keeping track from then on.
+ */
+bool
+fileJournalTake(std::vector<std::string> &result, const std::string &dir);
+
+/**
+ * Returns true if anything has changed under a watched directory
+ * since the last `fileJournalTake`.
+ * @param lastWrite set to the time of the most recent change.
+ */
+bool
+fileJournalPending(time_t &lastWrite, const std::string &dir);
+
+/**
+ * Throws away any history for a directory, such as when a caller
+ * could not finish processing the paths it took.
+ * The next `fileJournalTake` will return false.
+ */
+void
+fileJournalReset(const std::string &dir);
+
 } // namespace abcd
 
 #endif
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "LineBuffer.hpp"
+#include <string.h>
+
+namespace abcd {
+
+LineBuffer::LineBuffer(size_t capacity):
+    data_(capacity)
+{
+}
+
+uint8_t *
+LineBuffer::prepare(size_t size)
+{
+    if (data_.size() - end_ < size)
+    {
+        // Move the partial line to the front:
+        if (begin_)
+        {
+            memmove(data_.data(), data_.data() + begin_, end_ - begin_);
+            scan_ -= begin_;
+            end_ -= begin_;
+            begin_ = 0;
+        }
+
+        // Grow if that still isn't enough:
+        if (data_.size() - end_ < size)
+        {
+            auto capacity = data_.size() ? data_.size() : size;
+            while (capacity - end_ < size)
+                capacity *= 2;
+            data_.resize(capacity);
+        }
+    }
+
+    return data_.data() + end_;
+}
+
+void
+LineBuffer::commit(size_t size)
+{
+    end_ += size;
+}
+
+bool
+LineBuffer::line(DataSlice &result)
+{
+    const auto base = data_.data();
+    const auto where = static_cast<const uint8_t *>(
+                           memchr(base + scan_, '\n', end_ - scan_));
+    if (!where)
+    {
+        scan_ = end_;
+        return false;
+    }
+
+    result = DataSlice(base + begin_, where + 1);
+    begin_ = scan_ = where + 1 - base;
+
+    // Wrap around once everything is consumed:
+    if (begin_ == end_)
+        begin_ = scan_ = end_ = 0;
+
+    return true;
+}
+
+} // namespace abcd
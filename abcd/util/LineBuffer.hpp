@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Receive buffer for newline-delimited network protocols.
+ */
+
+#ifndef ABCD_UTIL_LINE_BUFFER_HPP
+#define ABCD_UTIL_LINE_BUFFER_HPP
+
+#include "Data.hpp"
+
+namespace abcd {
+
+/**
+ * A receive buffer that hands out complete lines in place.
+ * Network data is written directly into the buffer's free space,
+ * and lines come back as slices pointing into the buffer,
+ * so nothing is copied or allocated per message.
+ * Consumed data is reclaimed by wrapping back to the front
+ * once the buffer drains, or by moving the one partial line
+ * when more space is needed.
+ */
+class LineBuffer
+{
+public:
+    explicit LineBuffer(size_t capacity=4096);
+
+    /**
+     * Returns a place to write at least `size` bytes of new data.
+     * This invalidates any slices returned by `line`.
+     */
+    uint8_t *
+    prepare(size_t size);
+
+    /**
+     * Marks `size` bytes written into the `prepare` area as valid.
+     */
+    void
+    commit(size_t size);
+
+    /**
+     * Extracts the next complete line, including its newline.
+     * The slice remains valid until the next call to `prepare`.
+     * @return false if there is no complete line in the buffer.
+     */
+    bool
+    line(DataSlice &result);
+
+    /**
+     * The number of bytes received but not yet returned as lines.
+     */
+    size_t
+    size() const { return end_ - begin_; }
+
+private:
+    DataChunk data_;
+    size_t begin_ = 0;  // Start of the unconsumed data
+    size_t scan_ = 0;   // Where the next newline search picks up
+    size_t end_ = 0;    // End of the valid data
+};
+
+} // namespace abcd
+
+#endif
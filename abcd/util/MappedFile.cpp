@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace abcd {
+
+MappedFile::~MappedFile()
+{
+    if (data_)
+        munmap(const_cast<uint8_t *>(data_), size_);
+}
+
+Status
+MappedFile::create(std::shared_ptr<MappedFile> &result,
+                   const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError,
+                         "Cannot open " + path + " for reading");
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf))
+    {
+        close(fd);
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot stat " + path);
+    }
+
+    // Empty files cannot be mapped, but are still valid:
+    const size_t size = statbuf.st_size;
+    void *data = nullptr;
+    if (size)
+    {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data)
+        {
+            close(fd);
+            return ABC_ERROR(ABC_CC_FileReadError, "Cannot map " + path);
+        }
+    }
+    close(fd);
+
+    result.reset(new MappedFile(static_cast<const uint8_t *>(data), size));
+    return Status();
+}
+
+MappedFile::MappedFile(const uint8_t *data, size_t size):
+    data_(data),
+    size_(size)
+{
+}
+
+} // namespace abcd
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Read-only memory-mapped files.
+ */
+
+#ifndef ABCD_UTIL_MAPPED_FILE_HPP
+#define ABCD_UTIL_MAPPED_FILE_HPP
+
+#include "Data.hpp"
+#include "Status.hpp"
+#include <memory>
+
+namespace abcd {
+
+/**
+ * A read-only view of a file's contents, mapped into memory.
+ * The mapping stays valid even if the file is later replaced or deleted,
+ * so slices into it can outlive the file on disk.
+ */
+class MappedFile
+{
+public:
+    ~MappedFile();
+
+    /**
+     * Maps the entire contents of a file into memory.
+     */
+    static Status
+    create(std::shared_ptr<MappedFile> &result, const std::string &path);
+
+    /**
+     * The file's contents.
+     */
+    DataSlice
+    data() const { return DataSlice(data_, data_ + size_); }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+
+    MappedFile(const uint8_t *data, size_t size);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+};
+
+} // namespace abcd
+
+#endif
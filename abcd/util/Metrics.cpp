@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Metrics.hpp"
+#include "Debug.hpp"
+#include "Workload.hpp"
+#include "../json/JsonArray.hpp"
+#include "../json/JsonObject.hpp"
+#include <time.h>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace abcd {
+
+// Entries are never removed, so references to them stay good:
+static std::mutex gMetricsMutex;
+static std::map<std::string, std::unique_ptr<MetricCounter>> gCounters;
+static std::map<std::string, std::unique_ptr<MetricHistogram>> gHistograms;
+
+// Slow-call log:
+constexpr size_t slowCallsMax = 32;
+constexpr std::chrono::microseconds slowThresholdDefault(250000);
+
+struct SlowCall
+{
+    std::string function;
+    std::string wallet;
+    time_t time;
+    uint64_t totalTime;
+    uint64_t lockTime;
+};
+
+static std::atomic<int64_t> gSlowThreshold(slowThresholdDefault.count());
+static std::deque<SlowCall> gSlowCalls;
+static thread_local MetricCall *tCall = nullptr;
+
+static uint64_t
+microsecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
+void
+MetricHistogram::record(uint64_t value)
+{
+    size_t bucket = 0;
+    while (bucket < metricBuckets - 1 && (uint64_t(1) << bucket) <= value)
+        ++bucket;
+
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+Status
+MetricHistogram::save(JsonPtr &result) const
+{
+    // Leave off the empty buckets at the top end:
+    size_t used = metricBuckets;
+    while (used && !buckets_[used - 1].load(std::memory_order_relaxed))
+        --used;
+
+    JsonArray buckets;
+    for (size_t i = 0; i < used; ++i)
+    {
+        const json_int_t n = buckets_[i].load(std::memory_order_relaxed);
+        ABC_CHECK(buckets.append(json_integer(n)));
+    }
+
+    JsonObject json;
+    ABC_CHECK(json.set("count", json_int_t(count_.load())));
+    ABC_CHECK(json.set("sum", json_int_t(sum_.load())));
+    ABC_CHECK(json.set("buckets", buckets));
+
+    result = json;
+    return Status();
+}
+
+MetricTimer::~MetricTimer()
+{
+    stop();
+}
+
+MetricTimer::MetricTimer(MetricHistogram &histogram):
+    histogram_(histogram),
+    start_(std::chrono::steady_clock::now())
+{
+}
+
+void
+MetricTimer::stop()
+{
+    if (!running_)
+        return;
+    running_ = false;
+
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    histogram_.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                          elapsed).count());
+}
+
+MetricCall::~MetricCall()
+{
+    tCall = outer_;
+
+    const auto elapsed = microsecondsSince(start_);
+    histogram_.record(elapsed);
+
+    // Replaying the outer call repeats the inner ones:
+    if (!outer_ && workloadRecording())
+        workloadRecord(function_, wallet_, shape_, start_, elapsed);
+
+    const auto threshold = gSlowThreshold.load(std::memory_order_relaxed);
+    if (!threshold || elapsed < uint64_t(threshold))
+        return;
+
+    ABC_DebugLog("Slow call: %s took %llu us (%llu us waiting on locks)",
+                 function_, (unsigned long long)elapsed,
+                 (unsigned long long)lockWait_);
+    std::lock_guard<std::mutex> lock(gMetricsMutex);
+    gSlowCalls.push_back(SlowCall
+    {
+        function_, wallet_, time(nullptr), elapsed, lockWait_
+    });
+    if (slowCallsMax < gSlowCalls.size())
+        gSlowCalls.pop_front();
+}
+
+MetricCall::MetricCall(const char *function, MetricHistogram &histogram):
+    function_(function),
+    histogram_(histogram),
+    start_(std::chrono::steady_clock::now()),
+    outer_(tCall)
+{
+    tCall = this;
+}
+
+void
+MetricCall::walletSet(const std::string &wallet)
+{
+    wallet_ = wallet;
+}
+
+void
+MetricCall::shapeSet(int64_t shape)
+{
+    shape_ = shape;
+}
+
+MetricLockGuard::~MetricLockGuard()
+{
+    mutex_.unlock();
+}
+
+MetricLockGuard::MetricLockGuard(std::mutex &mutex,
+                                 MetricHistogram &waitTime):
+    mutex_(mutex)
+{
+    // Skip the clock when nobody is in the way:
+    if (mutex_.try_lock())
+    {
+        waitTime.record(0);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    mutex_.lock();
+    const auto elapsed = microsecondsSince(start);
+    waitTime.record(elapsed);
+    if (tCall)
+        tCall->lockWait_ += elapsed;
+}
+
+void
+metricSlowThresholdSet(std::chrono::microseconds threshold)
+{
+    gSlowThreshold = threshold.count();
+}
+
+MetricCounter &
+metricCounter(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(gMetricsMutex);
+    auto &slot = gCounters[name];
+    if (!slot)
+        slot.reset(new MetricCounter());
+    return *slot;
+}
+
+MetricHistogram &
+metricHistogram(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(gMetricsMutex);
+    auto &slot = gHistograms[name];
+    if (!slot)
+        slot.reset(new MetricHistogram());
+    return *slot;
+}
+
+Status
+metricsJson(JsonPtr &result)
+{
+    std::lock_guard<std::mutex> lock(gMetricsMutex);
+
+    JsonObject counters;
+    for (const auto &i: gCounters)
+        ABC_CHECK(counters.set(i.first.c_str(), json_int_t(i.second->value())));
+
+    JsonObject histograms;
+    for (const auto &i: gHistograms)
+    {
+        JsonPtr histogram;
+        ABC_CHECK(i.second->save(histogram));
+        ABC_CHECK(histograms.set(i.first.c_str(), histogram));
+    }
+
+    JsonArray slowCalls;
+    for (const auto &call: gSlowCalls)
+    {
+        JsonObject entry;
+        ABC_CHECK(entry.set("function", call.function));
+        if (!call.wallet.empty())
+            ABC_CHECK(entry.set("wallet", call.wallet));
+        ABC_CHECK(entry.set("time", json_int_t(call.time)));
+        ABC_CHECK(entry.set("total_us", json_int_t(call.totalTime)));
+        ABC_CHECK(entry.set("lock_us", json_int_t(call.lockTime)));
+        ABC_CHECK(entry.set("work_us",
+                            json_int_t(call.totalTime - call.lockTime)));
+        ABC_CHECK(slowCalls.append(entry));
+    }
+
+    JsonObject json;
+    ABC_CHECK(json.set("counters", counters));
+    ABC_CHECK(json.set("histograms", histograms));
+    ABC_CHECK(json.set("slowCalls", slowCalls));
+
+    result = json;
+    return Status();
+}
+
+} // namespace abcd
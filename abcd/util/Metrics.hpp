@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Counters and histograms for watching the core from outside.
+ */
+
+#ifndef ABCD_UTIL_METRICS_HPP
+#define ABCD_UTIL_METRICS_HPP
+
+#include "../json/JsonPtr.hpp"
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+namespace abcd {
+
+constexpr size_t metricBuckets = 32;
+
+/**
+ * A number that only ever moves by atomic adds,
+ * such as a running total or a count of things in flight.
+ */
+class MetricCounter
+{
+public:
+    void
+    add(int64_t n=1) { value_.fetch_add(n, std::memory_order_relaxed); }
+
+    int64_t
+    value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+/**
+ * Counts values into power-of-two buckets,
+ * where bucket `i` holds values below 2^i.
+ */
+class MetricHistogram
+{
+public:
+    void
+    record(uint64_t value);
+
+    /**
+     * Adds the values to a JSON object.
+     */
+    Status
+    save(JsonPtr &result) const;
+
+private:
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> buckets_[metricBuckets] = {};
+};
+
+/**
+ * Records the microseconds between construction and destruction,
+ * or between construction and `stop`.
+ */
+class MetricTimer
+{
+public:
+    ~MetricTimer();
+    MetricTimer(MetricHistogram &histogram);
+
+    /**
+     * Records the time now, for phases that end before the scope does.
+     */
+    void
+    stop();
+
+private:
+    MetricHistogram &histogram_;
+    std::chrono::steady_clock::time_point start_;
+    bool running_ = true;
+};
+
+/**
+ * Times one C API call into its histogram, and logs it as a slow call
+ * if it runs past the threshold.
+ * Calls made from inside other calls get timed on their own.
+ * Top-level calls also go into the workload recording, if one is running.
+ */
+class MetricCall
+{
+public:
+    ~MetricCall();
+    MetricCall(const char *function, MetricHistogram &histogram);
+
+    /**
+     * Notes which wallet the call is working on, for the slow-call log.
+     */
+    void
+    walletSet(const std::string &wallet);
+
+    /**
+     * Notes the size of the call's work, such as a query length,
+     * for the workload recording.
+     */
+    void
+    shapeSet(int64_t shape);
+
+private:
+    friend class MetricLockGuard;
+
+    const char *function_;
+    MetricHistogram &histogram_;
+    std::string wallet_;
+    int64_t shape_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t lockWait_ = 0; // Microseconds spent waiting on locks
+    MetricCall *outer_;
+};
+
+/**
+ * Holds a mutex like `std::lock_guard`, recording the time spent
+ * waiting for it, and charging that time to the current API call.
+ */
+class MetricLockGuard
+{
+public:
+    ~MetricLockGuard();
+    MetricLockGuard(std::mutex &mutex, MetricHistogram &waitTime);
+
+    MetricLockGuard(const MetricLockGuard &copy) = delete;
+    MetricLockGuard &operator=(const MetricLockGuard &copy) = delete;
+
+private:
+    std::mutex &mutex_;
+};
+
+/**
+ * Sets how long an API call can take before it goes in the slow-call log.
+ * Zero turns the log off.
+ */
+void
+metricSlowThresholdSet(std::chrono::microseconds threshold);
+
+/**
+ * Finds or creates the named counter.
+ * The lookup takes a lock, but the result lives forever,
+ * so hot paths should look things up once and hold on to them.
+ */
+MetricCounter &
+metricCounter(const std::string &name);
+
+/**
+ * Finds or creates the named histogram,
+ * with the same rules as `metricCounter`.
+ */
+MetricHistogram &
+metricHistogram(const std::string &name);
+
+/**
+ * Returns every metric as a JSON object, with a "counters" section,
+ * a "histograms" section, and a "slowCalls" list of the latest slow calls.
+ */
+Status
+metricsJson(JsonPtr &result);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A lock-free queue for handing work to a single thread.
+ */
+
+#ifndef ABCD_UTIL_MPSC_QUEUE_HPP
+#define ABCD_UTIL_MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <utility>
+
+namespace abcd {
+
+/**
+ * A linked-list queue that any number of threads can push onto,
+ * but only one thread can pop from.
+ * Pushing is a single atomic exchange, so producers never wait
+ * on each other or on the consumer.
+ *
+ * A push that is still in progress hides anything pushed after it,
+ * so `pop` can briefly come up empty while another thread is pushing.
+ * Producers should wake the consumer after `push` returns,
+ * which guarantees the consumer sees their item.
+ */
+template<typename T>
+class MpscQueue
+{
+public:
+    MpscQueue():
+        head_(new Node()),
+        tail_(head_.load())
+    {
+    }
+
+    ~MpscQueue()
+    {
+        while (tail_)
+        {
+            auto next = tail_->next.load(std::memory_order_relaxed);
+            delete tail_;
+            tail_ = next;
+        }
+    }
+
+    /**
+     * Adds an item to the back of the queue. Safe from any thread.
+     */
+    void
+    push(T value)
+    {
+        auto node = new Node();
+        node->value = std::move(value);
+        auto prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * Takes an item off the front of the queue.
+     * Only the consumer thread may call this.
+     * @return false if the queue is empty.
+     */
+    bool
+    pop(T &result)
+    {
+        // The tail is always a spent node, holding no value:
+        auto next = tail_->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+
+        result = std::move(next->value);
+        next->value = T();
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+    MpscQueue(const MpscQueue &copy) = delete;
+    MpscQueue &operator=(const MpscQueue &copy) = delete;
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node *> head_; // Newest node, shared by the producers
+    Node *tail_; // Oldest node, only touched by the consumer
+};
+
+} // namespace abcd
+
+#endif
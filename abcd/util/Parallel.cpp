@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+namespace abcd {
+
+constexpr unsigned threadsMax = 8;
+
+// Helper threads running across every `parallelFor` in the process:
+static std::atomic<unsigned> gHelpers{0};
+
+/**
+ * Claims up to `want` helper threads from the process-wide budget.
+ * @return the number claimed, which may be zero.
+ */
+static unsigned
+helpersClaim(unsigned want)
+{
+    const unsigned cores =
+        std::max(1u, std::min(std::thread::hardware_concurrency(), threadsMax));
+    const unsigned limit = cores - 1;
+    unsigned used = gHelpers.load();
+    unsigned take;
+    do
+    {
+        if (limit <= used)
+            return 0;
+        take = std::min(want, limit - used);
+    }
+    while (!gHelpers.compare_exchange_weak(used, used + take));
+    return take;
+}
+
+void
+parallelFor(size_t size, const std::function<void (size_t, size_t)> &work,
+            size_t minSize)
+{
+    // Nested calls find the budget spent, and run on their own thread:
+    const unsigned helpers =
+        size < minSize ? 0 : helpersClaim(threadsMax - 1);
+    if (!helpers)
+    {
+        if (size)
+            work(0, size);
+        return;
+    }
+
+    std::vector<std::thread> pool;
+    const size_t chunk = (size + helpers) / (helpers + 1);
+    for (size_t start = chunk; start < size; start += chunk)
+        pool.emplace_back(work, start, std::min(size, start + chunk));
+
+    // The calling thread takes the first chunk itself:
+    work(0, chunk);
+    for (auto &thread: pool)
+        thread.join();
+    gHelpers -= helpers;
+}
+
+ParallelTask::~ParallelTask()
+{
+    wait();
+}
+
+ParallelTask::ParallelTask(std::function<void ()> work):
+    thread_(std::move(work))
+{
+}
+
+void
+ParallelTask::wait()
+{
+    if (thread_.joinable())
+        thread_.join();
+}
+
+} // namespace abcd
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Helpers for spreading CPU-bound loops over several cores,
+ * and for overlapping independent blocking work.
+ */
+
+#ifndef ABCD_UTIL_PARALLEL_HPP
+#define ABCD_UTIL_PARALLEL_HPP
+
+#include <stddef.h>
+#include <functional>
+#include <thread>
+
+namespace abcd {
+
+/**
+ * Splits the range [0, size) into one chunk per core,
+ * runs the chunks on a bounded set of worker threads,
+ * and returns once they are all done.
+ * The worker threads come from one budget for the whole process,
+ * so nested or concurrent calls never add up to more threads
+ * than there are cores. Calls that find the budget spent,
+ * along with ranges shorter than `minSize`,
+ * run on the calling thread.
+ * The work function must not touch shared state without locking.
+ */
+void
+parallelFor(size_t size, const std::function<void (size_t, size_t)> &work,
+            size_t minSize=16);
+
+/**
+ * Runs a function on its own thread, such as a network request
+ * that nothing else is waiting on yet.
+ * The destructor waits for the function to finish,
+ * so early returns can never leave the thread running.
+ */
+class ParallelTask
+{
+public:
+    ~ParallelTask();
+    explicit ParallelTask(std::function<void ()> work);
+
+    /**
+     * Waits for the function to finish.
+     */
+    void
+    wait();
+
+private:
+    std::thread thread_;
+};
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "SearchIndex.hpp"
+#include <ctype.h>
+
+namespace abcd {
+
+constexpr size_t gramSize = 3;
+
+static std::string
+lowercase(const std::string &s)
+{
+    std::string out = s;
+    for (auto &c: out)
+        c = tolower(c);
+    return out;
+}
+
+static std::set<std::string>
+trigrams(const std::string &s)
+{
+    std::set<std::string> out;
+    for (size_t i = 0; i + gramSize <= s.size(); ++i)
+        out.insert(s.substr(i, gramSize));
+    return out;
+}
+
+void
+SearchIndex::insert(const std::string &key,
+                    const std::vector<std::string> &fields)
+{
+    erase(key);
+
+    auto &record = records_[key];
+    for (const auto &field: fields)
+    {
+        record.push_back(lowercase(field));
+        for (const auto &gram: trigrams(record.back()))
+            trigrams_[gram].insert(key);
+    }
+}
+
+void
+SearchIndex::erase(const std::string &key)
+{
+    auto i = records_.find(key);
+    if (records_.end() == i)
+        return;
+
+    for (const auto &field: i->second)
+    {
+        for (const auto &gram: trigrams(field))
+        {
+            auto j = trigrams_.find(gram);
+            if (trigrams_.end() == j)
+                continue;
+            j->second.erase(key);
+            if (j->second.empty())
+                trigrams_.erase(j);
+        }
+    }
+    records_.erase(i);
+}
+
+void
+SearchIndex::clear()
+{
+    records_.clear();
+    trigrams_.clear();
+}
+
+std::set<std::string>
+SearchIndex::search(const std::string &query) const
+{
+    std::set<std::string> out;
+    const auto needle = lowercase(query);
+    if (needle.empty())
+        return out;
+
+    // Short queries have no trigrams, so check every record:
+    if (needle.size() < gramSize)
+    {
+        for (const auto &record: records_)
+            if (matches(record.second, needle))
+                out.insert(record.first);
+        return out;
+    }
+
+    // Start from the rarest trigram, since it has the fewest candidates:
+    const std::set<std::string> *rarest = nullptr;
+    for (const auto &gram: trigrams(needle))
+    {
+        auto i = trigrams_.find(gram);
+        if (trigrams_.end() == i)
+            return out;
+        if (!rarest || i->second.size() < rarest->size())
+            rarest = &i->second;
+    }
+
+    // The trigrams might come from different places, so verify each match:
+    for (const auto &key: *rarest)
+    {
+        auto i = records_.find(key);
+        if (records_.end() != i && matches(i->second, needle))
+            out.insert(key);
+    }
+    return out;
+}
+
+bool
+SearchIndex::matches(const std::vector<std::string> &fields,
+                     const std::string &query)
+{
+    for (const auto &field: fields)
+        if (std::string::npos != field.find(query))
+            return true;
+    return false;
+}
+
+} // namespace abcd
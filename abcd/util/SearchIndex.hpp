@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Substring search over a collection of text records.
+ */
+
+#ifndef ABCD_UTIL_SEARCH_INDEX_HPP
+#define ABCD_UTIL_SEARCH_INDEX_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * A case-insensitive substring index over a set of keyed records.
+ * Each record holds several text fields, and a query matches a record
+ * if it appears inside any one of the fields.
+ *
+ * Queries of three or more characters only look at the records sharing
+ * all of the query's trigrams, so they never need to scan everything.
+ * This class has no locking of its own.
+ */
+class SearchIndex
+{
+public:
+    /**
+     * Adds a record to the index, replacing any existing one.
+     */
+    void
+    insert(const std::string &key, const std::vector<std::string> &fields);
+
+    /**
+     * Removes a record from the index.
+     */
+    void
+    erase(const std::string &key);
+
+    void
+    clear();
+
+    /**
+     * Returns the keys of all records containing the query text.
+     * An empty query matches nothing.
+     */
+    std::set<std::string>
+    search(const std::string &query) const;
+
+private:
+    std::map<std::string, std::vector<std::string>> records_; // Lowercase
+    std::map<std::string, std::set<std::string>> trigrams_;
+
+    /**
+     * Returns true if the lowercase query is inside one of the fields.
+     */
+    static bool
+    matches(const std::vector<std::string> &fields, const std::string &query);
+};
+
+} // namespace abcd
+
+#endif
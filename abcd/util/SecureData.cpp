@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "SecureData.hpp"
+#include "Debug.hpp"
+#include "Util.hpp"
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+namespace abcd {
+
+constexpr size_t secureArenaSize = 64 * 1024;
+constexpr size_t secureClassMin = 32;
+constexpr size_t secureClasses = 6; // 32 bytes up to 1 KiB
+
+/**
+ * Pool blocks are carved out of locked arenas,
+ * and freed blocks go onto a list for their size class.
+ * Arenas are never handed back, since keys come and go all the time.
+ */
+struct SecureBlock
+{
+    SecureBlock *next;
+};
+
+static std::mutex gSecureMutex;
+static SecureBlock *gSecureFree[secureClasses];
+static uint8_t *gSecureArena = nullptr;
+static size_t gSecureArenaUsed = secureArenaSize;
+
+/**
+ * Maps fresh pages and keeps them out of swap and core dumps.
+ * Locking can fail if the process is over its limit,
+ * in which case the memory is still wiped on free.
+ */
+static void *
+securePages(size_t size)
+{
+    void *out = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (MAP_FAILED == out)
+        throw std::bad_alloc();
+
+    static std::atomic<bool> warned(false);
+    if (mlock(out, size) && !warned.exchange(true))
+        ABC_DebugLog("secureAlloc: cannot lock memory, errno %d", errno);
+#ifdef MADV_DONTDUMP
+    madvise(out, size, MADV_DONTDUMP);
+#endif
+    return out;
+}
+
+static size_t
+securePageRound(size_t size)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+/**
+ * Finds the size class for a block, or returns `secureClasses`
+ * if the block is too big for the pool.
+ */
+static size_t
+secureClass(size_t size)
+{
+    size_t i = 0;
+    while (i < secureClasses && (secureClassMin << i) < size)
+        ++i;
+    return i;
+}
+
+void *
+secureAlloc(size_t size)
+{
+    if (!size)
+        size = 1;
+
+    const auto i = secureClass(size);
+    if (secureClasses <= i)
+        return securePages(securePageRound(size));
+
+    std::lock_guard<std::mutex> lock(gSecureMutex);
+    if (gSecureFree[i])
+    {
+        auto block = gSecureFree[i];
+        gSecureFree[i] = block->next;
+        block->next = nullptr;
+        return block;
+    }
+
+    const size_t blockSize = secureClassMin << i;
+    if (secureArenaSize < gSecureArenaUsed + blockSize)
+    {
+        gSecureArena = static_cast<uint8_t *>(securePages(secureArenaSize));
+        gSecureArenaUsed = 0;
+    }
+    void *out = gSecureArena + gSecureArenaUsed;
+    gSecureArenaUsed += blockSize;
+    return out;
+}
+
+void
+secureFree(void *p, size_t size)
+{
+    if (!p)
+        return;
+    if (!size)
+        size = 1;
+
+    const auto i = secureClass(size);
+    if (secureClasses <= i)
+    {
+        const auto pages = securePageRound(size);
+        ABC_UtilGuaranteedMemset(p, 0, pages);
+        munlock(p, pages);
+        munmap(p, pages);
+        return;
+    }
+
+    ABC_UtilGuaranteedMemset(p, 0, secureClassMin << i);
+
+    std::lock_guard<std::mutex> lock(gSecureMutex);
+    auto block = static_cast<SecureBlock *>(p);
+    block->next = gSecureFree[i];
+    gSecureFree[i] = block;
+}
+
+void
+secureAssign(SecureChunk &result, DataChunk &source)
+{
+    result.assign(source.begin(), source.end());
+    ABC_UtilGuaranteedMemset(source.data(), 0, source.size());
+    source.clear();
+}
+
+} // namespace abcd
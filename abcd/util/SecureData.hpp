@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Storage for long-lived key material.
+ */
+
+#ifndef ABCD_UTIL_SECURE_DATA_HPP
+#define ABCD_UTIL_SECURE_DATA_HPP
+
+#include "Data.hpp"
+#include <stddef.h>
+
+namespace abcd {
+
+/**
+ * Allocates memory from a pool of locked pages,
+ * which the operating system will not write out to swap.
+ * Small blocks come from per-size free lists,
+ * so keys do not churn the general-purpose heap.
+ */
+void *
+secureAlloc(size_t size);
+
+/**
+ * Wipes a block from `secureAlloc` and returns it to the pool.
+ * The size must match the one passed to `secureAlloc`.
+ */
+void
+secureFree(void *p, size_t size);
+
+/**
+ * A standard allocator that draws from the secure pool.
+ */
+template<typename T>
+struct SecureAllocator
+{
+    typedef T value_type;
+
+    SecureAllocator() {}
+    template<typename U> SecureAllocator(const SecureAllocator<U> &) {}
+
+    T *
+    allocate(size_t n)
+    {
+        return static_cast<T *>(secureAlloc(n * sizeof(T)));
+    }
+
+    void
+    deallocate(T *p, size_t n)
+    {
+        secureFree(p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U> bool
+operator ==(const SecureAllocator<T> &, const SecureAllocator<U> &)
+{
+    return true;
+}
+
+template<typename T, typename U> bool
+operator !=(const SecureAllocator<T> &, const SecureAllocator<U> &)
+{
+    return false;
+}
+
+/**
+ * A block of key material with a run-time variable size.
+ */
+typedef std::vector<uint8_t, SecureAllocator<uint8_t>> SecureChunk;
+
+/**
+ * Moves data into secure storage, wiping the original.
+ */
+void
+secureAssign(SecureChunk &result, DataChunk &source);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "SharedState.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace abcd {
+
+// The file starts with a magic number and layout version,
+// followed by one 64-bit counter per slot, with room to grow:
+constexpr uint32_t sharedMagic = 0x41424353; // "ABCS"
+constexpr uint32_t sharedLayout = 1;
+constexpr size_t sharedHeaderSize = 8;
+constexpr size_t sharedSlotsMax = 32;
+constexpr size_t sharedFileSize = sharedHeaderSize + 8 * sharedSlotsMax;
+
+// Writer locks are byte-range locks past the end of the counters,
+// followed by one more lock that guards stamping the header:
+constexpr off_t sharedLockOffset = sharedFileSize;
+constexpr off_t sharedInitOffset = sharedLockOffset + sharedSlotsMax;
+
+static_assert(static_cast<size_t>(SharedSlot::count) <= sharedSlotsMax,
+              "Too many shared slots");
+static_assert(sizeof(std::atomic<uint64_t>) == 8,
+              "Shared counters must be plain 64-bit words");
+static_assert(sizeof(std::atomic<uint32_t>) == 4,
+              "Shared header must be plain 32-bit words");
+
+/**
+ * Takes or drops a slot's lock, without waiting.
+ */
+static bool
+sharedLock(int fd, SharedSlot slot, short type)
+{
+    struct flock lock = {};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = sharedLockOffset + static_cast<off_t>(slot);
+    lock.l_len = 1;
+    return !fcntl(fd, F_SETLK, &lock);
+}
+
+/**
+ * Takes or drops the header lock, waiting for it if need be.
+ */
+static bool
+sharedInitLock(int fd, short type)
+{
+    struct flock lock = {};
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = sharedInitOffset;
+    lock.l_len = 1;
+    while (fcntl(fd, F_SETLKW, &lock))
+        if (EINTR != errno)
+            return false;
+    return true;
+}
+
+SharedWriter::~SharedWriter()
+{
+    state_.writerRelease(slot_);
+}
+
+SharedWriter::SharedWriter(SharedState &state, SharedSlot slot):
+    state_(state),
+    slot_(slot)
+{
+}
+
+SharedState::~SharedState()
+{
+    if (data_)
+        munmap(data_, sharedFileSize);
+    if (0 <= fd_)
+        close(fd_);
+}
+
+SharedState::SharedState()
+{
+    for (auto &value: local_)
+        value = 0;
+    writers_.fill(0);
+}
+
+Status
+SharedState::open(const std::string &path)
+{
+    if (!std::atomic<uint64_t>().is_lock_free())
+        return ABC_ERROR(ABC_CC_SysError, "No lock-free 64-bit atomics");
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Cannot open " + path);
+
+    // Growing to the same size is safe even if another process got here
+    // first, since it never touches existing contents:
+    if (ftruncate(fd, sharedFileSize))
+    {
+        close(fd);
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot size " + path);
+    }
+
+    void *data = mmap(nullptr, sharedFileSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (MAP_FAILED == data)
+    {
+        close(fd);
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot map " + path);
+    }
+
+    // Stamp a fresh file, or check that an existing one matches.
+    // The lock keeps other processes from seeing a half-stamped header:
+    if (!sharedInitLock(fd, F_WRLCK))
+    {
+        munmap(data, sharedFileSize);
+        close(fd);
+        return ABC_ERROR(ABC_CC_SysError, "Cannot lock " + path);
+    }
+    auto header = static_cast<std::atomic<uint32_t> *>(data);
+    if (!header[0])
+    {
+        header[1] = sharedLayout;
+        header[0] = sharedMagic;
+    }
+    const bool match = sharedMagic == header[0] && sharedLayout == header[1];
+    sharedInitLock(fd, F_UNLCK);
+    if (!match)
+    {
+        munmap(data, sharedFileSize);
+        close(fd);
+        return ABC_ERROR(ABC_CC_ParseError, "Unknown layout in " + path);
+    }
+
+    fd_ = fd;
+    data_ = static_cast<uint8_t *>(data);
+    return Status();
+}
+
+uint64_t
+SharedState::get(SharedSlot slot) const
+{
+    return counter(slot).load();
+}
+
+uint64_t
+SharedState::bump(SharedSlot slot)
+{
+    return ++counter(slot);
+}
+
+uint64_t
+SharedState::raise(SharedSlot slot, uint64_t value)
+{
+    auto &target = counter(slot);
+    uint64_t old = target.load();
+    while (old < value && !target.compare_exchange_weak(old, value))
+        ;
+    return old < value ? value : old;
+}
+
+void
+SharedState::set(SharedSlot slot, uint64_t value)
+{
+    counter(slot) = value;
+}
+
+SharedWriterPtr
+SharedState::writerTry(SharedSlot slot)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto &count = writers_[static_cast<size_t>(slot)];
+    if (!count && 0 <= fd_ && !sharedLock(fd_, slot, F_WRLCK))
+        return SharedWriterPtr();
+
+    ++count;
+    return SharedWriterPtr(new SharedWriter(*this, slot));
+}
+
+std::atomic<uint64_t> &
+SharedState::counter(SharedSlot slot) const
+{
+    const auto index = static_cast<size_t>(slot);
+    if (!data_)
+        return local_[index];
+
+    auto counters = reinterpret_cast<std::atomic<uint64_t> *>(
+                        data_ + sharedHeaderSize);
+    return counters[index];
+}
+
+void
+SharedState::writerRelease(SharedSlot slot)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto &count = writers_[static_cast<size_t>(slot)];
+    if (!--count && 0 <= fd_)
+        sharedLock(fd_, slot, F_UNLCK);
+}
+
+} // namespace abcd
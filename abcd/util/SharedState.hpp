@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Counters shared by every process using the same root directory.
+ */
+
+#ifndef ABCD_UTIL_SHARED_STATE_HPP
+#define ABCD_UTIL_SHARED_STATE_HPP
+
+#include "Status.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace abcd {
+
+/**
+ * The root-level caches that coordinate through the shared file.
+ */
+enum class SharedSlot
+{
+    blockHeight,    // The highest block any process has seen
+    serverScores,   // Bumped after each save of the server scores
+    exchangeRates,  // Bumped after each save of the exchange rates
+    count
+};
+
+class SharedState;
+
+/**
+ * Holds a slot's writer lock, and releases it when this goes away.
+ */
+class SharedWriter
+{
+public:
+    ~SharedWriter();
+    SharedWriter(SharedState &state, SharedSlot slot);
+
+    SharedWriter(const SharedWriter &copy) = delete;
+    SharedWriter &operator=(const SharedWriter &copy) = delete;
+
+private:
+    SharedState &state_;
+    const SharedSlot slot_;
+};
+typedef std::unique_ptr<SharedWriter> SharedWriterPtr;
+
+/**
+ * A small memory-mapped file of counters, so the app, its extensions
+ * and its widgets can see each other's cache updates without
+ * re-reading files or talking to the network.
+ * Each slot also has a writer lock, so only one process at a time
+ * does the work of refreshing that cache.
+ * If the file cannot be opened, this keeps working for the
+ * current process alone.
+ */
+class SharedState
+{
+public:
+    ~SharedState();
+    SharedState();
+
+    /**
+     * Opens or creates the shared file.
+     */
+    Status
+    open(const std::string &path);
+
+    /**
+     * Reads a slot's value.
+     */
+    uint64_t
+    get(SharedSlot slot) const;
+
+    /**
+     * Adds one to a slot, to announce a change.
+     * @return the new value.
+     */
+    uint64_t
+    bump(SharedSlot slot);
+
+    /**
+     * Raises a slot to at least the given value.
+     * @return the slot's value afterwards.
+     */
+    uint64_t
+    raise(SharedSlot slot, uint64_t value);
+
+    /**
+     * Overwrites a slot, for throwing a cache away.
+     */
+    void
+    set(SharedSlot slot, uint64_t value);
+
+    /**
+     * Claims a slot's writer lock, if no other process holds it.
+     * Threads within one process share the lock.
+     * @return null if another process is already writing.
+     */
+    SharedWriterPtr
+    writerTry(SharedSlot slot);
+
+private:
+    friend class SharedWriter;
+
+    int fd_ = -1;
+    uint8_t *data_ = nullptr;
+
+    // Stand-ins for when the file is not open:
+    mutable std::array<std::atomic<uint64_t>,
+            static_cast<size_t>(SharedSlot::count)>
+    local_;
+
+    // Writer locks held in this process:
+    std::mutex mutex_;
+    std::array<size_t, static_cast<size_t>(SharedSlot::count)> writers_;
+
+    std::atomic<uint64_t> &
+    counter(SharedSlot slot) const;
+
+    void
+    writerRelease(SharedSlot slot);
+
+    SharedState(const SharedState &) = delete;
+    SharedState &operator=(const SharedState &) = delete;
+};
+
+} // namespace abcd
+
+#endif
@@ -18,24 +18,34 @@ std::ostream &operator<<(std::ostream &output, const ErrorLocation &s)
     return output;
 }
 
-Status::Status() :
-    value_(ABC_CC_Ok)
+Status::Status(tABC_CC value, std::string message, ErrorLocation here)
 {
+    if (ABC_CC_Ok == value)
+        return;
+
+    error_.reset(new Error{value, std::move(message), {}});
+    error_->backtrace.push_back(here);
+}
+
+std::string
+Status::message() const
+{
+    return error_ ? error_->message : std::string();
 }
 
-Status::Status(tABC_CC value, std::string message, ErrorLocation here):
-    value_(value),
-    message_(message)
+const std::list<ErrorLocation> &
+Status::backtrace() const
 {
-    backtrace_.push_back(here);
+    static const std::list<ErrorLocation> empty;
+    return error_ ? error_->backtrace : empty;
 }
 
 void Status::toError(tABC_Error &error, ErrorLocation here) const
 {
     log();
 
-    error.code = value_;
-    strncpy(error.szDescription, message_.c_str(), ABC_MAX_STRING_LENGTH);
+    error.code = value();
+    strncpy(error.szDescription, message().c_str(), ABC_MAX_STRING_LENGTH);
     strncpy(error.szSourceFunc, here.function, ABC_MAX_STRING_LENGTH);
     strncpy(error.szSourceFile, here.file, ABC_MAX_STRING_LENGTH);
     error.nSourceLine = here.line;
@@ -73,7 +83,8 @@ Status::log() const
 Status &
 Status::at(ErrorLocation here)
 {
-    backtrace_.push_back(here);
+    if (error_)
+        error_->backtrace.push_back(here);
     return *this;
 }
 
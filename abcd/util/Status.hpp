@@ -11,6 +11,7 @@
 // We need tABC_CC and tABC_Error:
 #include "../../src/ABC.h"
 #include <list>
+#include <memory>
 #include <ostream>
 #include <string>
 
@@ -35,6 +36,10 @@ std::ostream &operator<<(std::ostream &output, const ErrorLocation &s);
 /**
  * Describes the results of calling a core function,
  * which can be either success or failure.
+ *
+ * A success status is just a null pointer,
+ * so creating, checking, and returning one never allocates.
+ * The error details live on the heap, and only exist on failure.
  */
 class Status
 {
@@ -42,22 +47,37 @@ public:
     /**
      * Constructs a success status.
      */
-    Status();
+    Status() {}
 
     /**
      * Constructs an error status.
+     * Passing ABC_CC_Ok produces a success status, dropping the message.
      */
     Status(tABC_CC value, std::string message, ErrorLocation here);
 
+    Status(const Status &copy):
+        error_(copy.error_ ? new Error(*copy.error_) : nullptr)
+    {}
+    Status(Status &&move) = default;
+
+    Status &
+    operator=(const Status &copy)
+    {
+        error_.reset(copy.error_ ? new Error(*copy.error_) : nullptr);
+        return *this;
+    }
+    Status &
+    operator=(Status &&move) = default;
+
     // Read accessors:
-    tABC_CC value()             const { return value_; }
-    std::string message()       const { return message_; }
-    const std::list<ErrorLocation> &backtrace() const { return backtrace_; }
+    tABC_CC value()             const { return error_ ? error_->value : ABC_CC_Ok; }
+    std::string message()       const;
+    const std::list<ErrorLocation> &backtrace() const;
 
     /**
      * Returns true if the status code represents success.
      */
-    explicit operator bool() const { return value_ == ABC_CC_Ok; }
+    explicit operator bool() const { return !error_; }
 
     /**
      * Unpacks this status into a tABC_Error structure.
@@ -82,11 +102,15 @@ public:
     at(ErrorLocation here);
 
 private:
-    // Error information:
-    tABC_CC value_;
-    std::string message_;
-
-    std::list<ErrorLocation> backtrace_;
+    struct Error
+    {
+        tABC_CC value;
+        std::string message;
+        std::list<ErrorLocation> backtrace;
+    };
+
+    // Null on success:
+    std::unique_ptr<Error> error_;
 };
 
 std::ostream &operator<<(std::ostream &output, const Status &s);
@@ -9,22 +9,130 @@
 #include "AutoFree.hpp"
 #include "Debug.hpp"
 #include "FileIO.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
+#include "WriteQueue.hpp"
 #include "../Context.hpp"
 #include "../General.hpp"
+#include "../http/HttpRequest.hpp"
 #include "../../minilibs/git-sync/sync.h"
 #include <assert.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
 
 namespace abcd {
 
-std::recursive_mutex gSyncMutex;
+constexpr size_t syncThreadsMax = 4;
+
+// Server health tracking:
+constexpr size_t syncRaceWidth = 2;
+constexpr double syncLatencyWeight = 0.2;
+constexpr double syncFailureWeight = 0.3;
+constexpr double syncFailureRateMax = 0.9;
+constexpr time_t syncFailurePenalty = 5 * 60;
+
+// Repository maintenance, using the same limits as `git gc --auto`:
+constexpr size_t syncLooseLimit = 1024;
+constexpr size_t syncPackLimit = 16;
+
+// Repos kept open between syncs, and the memory libgit2 may spend on them:
+constexpr size_t syncReposMax = 32;
+constexpr size_t syncWindowSize = 1024 * 1024;
+constexpr size_t syncObjectCacheDefault = 16 * 1024 * 1024;
+constexpr size_t syncMappedLimitDefault = 64 * 1024 * 1024;
+
+// These must match the refs used in minilibs/git-sync:
+constexpr char syncRefMaster[] = "refs/heads/master";
+constexpr char syncRefIncoming[] = "refs/heads/incoming";
+
+// Library and server-rotation state, shared by every repo:
+static std::mutex gSyncMutex;
 static bool gbInitialized = false;
 static int syncServerIndex;
-static std::string syncServerName;
 static std::vector<std::string> syncServers;
 
-typedef std::lock_guard<std::recursive_mutex> AutoSyncLock;
+/**
+ * What we have seen from one sync server during this run.
+ */
+struct SyncServerHealth
+{
+    /** Exponentially-weighted average response time, in ms. */
+    double latency = 0;
+    /** Decaying fraction of recent requests that failed. */
+    double failureRate = 0;
+    time_t failTime = 0;
+};
+static std::map<std::string, SyncServerHealth> gSyncHealth;
+
+// Preflight requests still running after their race was decided:
+static std::mutex gRacersMutex;
+static std::condition_variable gRacersDone;
+static size_t gRacers = 0;
+
+// One lock per repo directory, so different repos sync side by side:
+static std::mutex gRepoLocksMutex;
+static std::map<std::string, std::shared_ptr<std::mutex>> gRepoLocks;
+
+// libgit2 memory limits, applied at `syncInit`:
+static std::atomic<size_t> gObjectCache(syncObjectCacheDefault);
+static std::atomic<size_t> gMappedLimit(syncMappedLimitDefault);
+
+/**
+ * A repo kept open between syncs, so libgit2 holds on to its parsed
+ * config, refs, pack indexes and object cache.
+ * Only used while holding the directory's `RepoLock`.
+ */
+struct SyncRepoHandle
+{
+    std::shared_ptr<git_repository> repo;
+    dev_t device; // Identifies the directory, in case it gets replaced
+    ino_t inode;
+    uint64_t lastUse;
+};
+static std::mutex gReposMutex;
+static std::map<std::string, SyncRepoHandle> gRepos;
+static uint64_t gReposClock = 0;
+
+typedef std::lock_guard<std::mutex> AutoSyncLock;
+
+/**
+ * Holds the lock for one repo directory.
+ */
+class RepoLock
+{
+public:
+    RepoLock(const std::string &syncDir)
+    {
+        {
+            std::lock_guard<std::mutex> lock(gRepoLocksMutex);
+            auto &mutex = gRepoLocks[fileSlashify(syncDir)];
+            if (!mutex)
+                mutex.reset(new std::mutex());
+            mutex_ = mutex;
+        }
+        mutex_->lock();
+    }
+
+    ~RepoLock()
+    {
+        mutex_->unlock();
+    }
+
+private:
+    std::shared_ptr<std::mutex> mutex_;
+};
 
 #define ABC_CHECK_GIT(f) \
     do { \
@@ -50,23 +158,529 @@ syncGitError(int e)
 }
 
 /**
- * Builds a URL for the current git server.
+ * Applies the memory limits to libgit2.
+ * The caller must hold the sync mutex, with the library initialized.
+ */
+static Status
+syncLimitsApply()
+{
+    ABC_CHECK_GIT(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE,
+                                   static_cast<ssize_t>(gObjectCache.load())));
+    ABC_CHECK_GIT(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, syncWindowSize));
+    ABC_CHECK_GIT(git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT,
+                                   gMappedLimit.load()));
+    return Status();
+}
+
+/**
+ * Finds the open repo for a directory, or opens it.
+ * The caller must hold the repo lock.
+ */
+static Status
+syncRepoOpen(std::shared_ptr<git_repository> &result,
+             const std::string &syncDir)
+{
+    const auto key = fileSlashify(syncDir);
+    struct stat info;
+    const bool found = !stat(syncDir.c_str(), &info);
+    {
+        std::lock_guard<std::mutex> lock(gReposMutex);
+        auto i = gRepos.find(key);
+        if (gRepos.end() != i)
+        {
+            if (found && i->second.device == info.st_dev &&
+                    i->second.inode == info.st_ino)
+            {
+                i->second.lastUse = ++gReposClock;
+                result = i->second.repo;
+                return Status();
+            }
+            gRepos.erase(i);
+        }
+    }
+
+    git_repository *repo = nullptr;
+    ABC_CHECK_GIT(git_repository_open(&repo, syncDir.c_str()));
+    result.reset(repo, git_repository_free);
+    if (!found)
+        return Status();
+
+    // Anybody still using an evicted repo keeps it alive until they finish:
+    std::lock_guard<std::mutex> lock(gReposMutex);
+    while (syncReposMax <= gRepos.size())
+    {
+        auto oldest = gRepos.begin();
+        for (auto i = gRepos.begin(); i != gRepos.end(); ++i)
+            if (i->second.lastUse < oldest->second.lastUse)
+                oldest = i;
+        gRepos.erase(oldest);
+    }
+    gRepos[key] = SyncRepoHandle
+    {
+        result, info.st_dev, info.st_ino, ++gReposClock
+    };
+    return Status();
+}
+
+/**
+ * Closes a directory's open repo, if it has one.
+ */
+static void
+syncRepoForget(const std::string &syncDir)
+{
+    std::lock_guard<std::mutex> lock(gReposMutex);
+    gRepos.erase(fileSlashify(syncDir));
+}
+
+/**
+ * Returns the time since the given start, in ms.
+ */
+static unsigned long
+syncMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Names a repo for the metrics, using the account or wallet directory
+ * that holds its "sync/" directory.
+ */
+static std::string
+syncMetricName(const std::string &syncDir)
+{
+    std::string dir = fileSlashify(syncDir);
+    dir.erase(dir.size() - 1);
+    if (dir.size() > 5 && !dir.compare(dir.size() - 5, 5, "/sync"))
+        dir.erase(dir.size() - 5);
+
+    const auto slash = dir.rfind('/');
+    return std::string::npos == slash ? dir : dir.substr(slash + 1);
+}
+
+/**
+ * The expected cost of using a server: its average latency,
+ * stretched by the retries its recent failure rate implies.
+ * Servers we have never heard from cost nothing, so they get tried.
+ */
+static double
+syncServerCost(const SyncServerHealth &health)
+{
+    return health.latency /
+           (1 - std::min(health.failureRate, syncFailureRateMax));
+}
+
+/**
+ * Records the outcome of talking to a sync server.
+ */
+static void
+syncServerReport(const std::string &server, bool ok, unsigned long ms)
+{
+    AutoSyncLock lock(gSyncMutex);
+
+    auto &health = gSyncHealth[server];
+    if (ok)
+    {
+        health.latency = health.latency ?
+                         (1 - syncLatencyWeight) * health.latency +
+                         syncLatencyWeight * ms : ms;
+        health.failureRate *= 1 - syncFailureWeight;
+        health.failTime = 0;
+    }
+    else
+    {
+        health.failureRate += syncFailureWeight * (1 - health.failureRate);
+        health.failTime = time(nullptr);
+        ABC_DebugLog("Sync server failed: %s", server.c_str());
+    }
+}
+
+/**
+ * Lists the git servers, best first.
+ * Servers that failed recently go to the back of the line,
+ * and the rest are ordered by their expected cost.
+ * Ties keep a per-run random rotation, to spread the load.
  */
 static Status
-syncUrl(std::string &result, const std::string &syncKey, bool rotate=false)
+syncServersRanked(std::vector<std::string> &result)
 {
+    AutoSyncLock lock(gSyncMutex);
+
     if (syncServers.size() == 0)
     {
         syncServers = generalSyncServers();
     }
-    if (rotate || syncServerName.empty())
+    if (syncServers.size() == 0)
+        return ABC_ERROR(ABC_CC_SysError, "No sync servers");
+
+    result.clear();
+    for (size_t i = 0; i < syncServers.size(); ++i)
+        result.push_back(fileSlashify(
+                             syncServers[(syncServerIndex + i) % syncServers.size()]));
+
+    const time_t now = time(nullptr);
+    auto penalized = [now](const std::string &server)
+    {
+        const auto &health = gSyncHealth[server];
+        return health.failTime && now - health.failTime < syncFailurePenalty;
+    };
+    std::stable_sort(result.begin(), result.end(),
+                     [&](const std::string &a, const std::string &b)
+    {
+        const bool pa = penalized(a), pb = penalized(b);
+        if (pa != pb)
+            return pb;
+        return syncServerCost(gSyncHealth[a]) < syncServerCost(gSyncHealth[b]);
+    });
+
+    return Status();
+}
+
+/**
+ * Reads a local ref, leaving the result zeroed if it does not exist.
+ */
+static Status
+syncLocalRef(git_oid &result, git_repository *repo, const char *name)
+{
+    memset(&result, 0, sizeof(result));
+    int e = git_reference_name_to_id(&result, repo, name);
+    if (GIT_ENOTFOUND == e)
+    {
+        giterr_clear();
+        return Status();
+    }
+    ABC_CHECK_GIT(e);
+    return Status();
+}
+
+/**
+ * Asks the server for its master commit using the smart-HTTP
+ * ref advertisement, which is a single small GET request
+ * on the shared HTTP connection pool.
+ * This is far cheaper than a full libgit2 fetch negotiation.
+ * Leaves the result zeroed if the server repo is still empty.
+ */
+static Status
+syncRemoteHead(git_oid &result, const std::string &url)
+{
+    HttpReply reply;
+    ABC_CHECK(HttpRequest()
+              .header("User-Agent", "git/2.0 (airbitz-core)")
+              .get(reply, url + "/info/refs?service=git-upload-pack"));
+    ABC_CHECK(reply.codeOk());
+
+    // Only a smart-HTTP server starts with this service announcement:
+    const std::string service = "001e# service=git-upload-pack\n";
+    const auto &body = reply.body;
+    if (body.compare(0, service.size(), service))
+        return ABC_ERROR(ABC_CC_ParseError, "Not a smart-HTTP git server");
+
+    // Walk the pkt-lines, each with a 4-digit hex length prefix:
+    memset(&result, 0, sizeof(result));
+    size_t i = service.size();
+    while (i + 4 <= body.size())
+    {
+        const auto size = strtoul(body.substr(i, 4).c_str(), nullptr, 16);
+        if (!size)
+        {
+            i += 4; // Flush packet
+            continue;
+        }
+        if (size < 4 || body.size() < i + size)
+            return ABC_ERROR(ABC_CC_ParseError, "Bad ref advertisement");
+
+        // Lines look like "<hex id> <ref name>[\0capabilities]\n":
+        std::string line = body.substr(i + 4, size - 4);
+        line = line.substr(0, line.find_first_of(std::string("\0\n", 2)));
+        if (GIT_OID_HEXSZ + 1 < line.size() &&
+                line.substr(GIT_OID_HEXSZ + 1) == syncRefMaster)
+        {
+            ABC_CHECK_GIT(git_oid_fromstrn(&result, line.data(), GIT_OID_HEXSZ));
+            return Status();
+        }
+        i += size;
+    }
+
+    return Status();
+}
+
+/**
+ * Reads the tree out of a commit, leaving the result null
+ * (which libgit2 treats as empty) if the commit id is zero.
+ */
+static Status
+syncCommitTree(AutoFree<git_tree, git_tree_free> &result,
+               git_repository *repo, const git_oid &id)
+{
+    if (git_oid_iszero(&id))
+        return Status();
+
+    AutoFree<git_commit, git_commit_free> commit;
+    ABC_CHECK_GIT(git_commit_lookup(&commit.get(), repo, &id));
+    ABC_CHECK_GIT(git_commit_tree(&result.get(), commit));
+    return Status();
+}
+
+/**
+ * Lists the files that differ between two commits,
+ * as full paths under the sync directory.
+ */
+static Status
+syncChanges(std::vector<std::string> &result, git_repository *repo,
+            const std::string &syncDir, const git_oid &from, const git_oid &to)
+{
+    AutoFree<git_tree, git_tree_free> fromTree, toTree;
+    ABC_CHECK(syncCommitTree(fromTree, repo, from));
+    ABC_CHECK(syncCommitTree(toTree, repo, to));
+
+    AutoFree<git_diff, git_diff_free> diff;
+    ABC_CHECK_GIT(git_diff_tree_to_tree(&diff.get(), repo,
+                                        fromTree, toTree, nullptr));
+
+    result.clear();
+    for (size_t i = 0; i < git_diff_num_deltas(diff); ++i)
+    {
+        const git_diff_delta *delta = git_diff_get_delta(diff, i);
+        result.push_back(fileSlashify(syncDir) + delta->new_file.path);
+    }
+    return Status();
+}
+
+static bool
+syncIsHex(const char *s, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        if (!isxdigit(static_cast<unsigned char>(s[i])))
+            return false;
+    return !s[size];
+}
+
+/**
+ * Lists the non-hidden entries in a directory.
+ */
+static std::vector<std::string>
+syncListDir(const std::string &dir)
+{
+    std::vector<std::string> out;
+    DIR *dirp = opendir(dir.c_str());
+    if (!dirp)
+        return out;
+    struct dirent *de;
+    while (nullptr != (de = readdir(dirp)))
+        if ('.' != de->d_name[0])
+            out.push_back(de->d_name);
+    closedir(dirp);
+    return out;
+}
+
+/**
+ * Reads the object count out of a version-2 pack index,
+ * which is the last entry of its fan-out table.
+ */
+static size_t
+syncPackCount(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp)
+        return 0;
+
+    unsigned char header[8 + 256 * 4];
+    size_t out = 0;
+    if (sizeof(header) == fread(header, 1, sizeof(header), fp) &&
+            !memcmp(header, "\377tOc\0\0\0\2", 8))
+    {
+        const unsigned char *p = header + sizeof(header) - 4;
+        out = (size_t(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+    fclose(fp);
+    return out;
+}
+
+static void
+syncObjectStats(SyncRepoStats &result, const std::string &objectsDir)
+{
+    result = SyncRepoStats();
+    for (const auto &dir: syncListDir(objectsDir))
+    {
+        if (!syncIsHex(dir.c_str(), 2))
+            continue;
+        for (const auto &name: syncListDir(objectsDir + dir))
+            if (syncIsHex(name.c_str(), GIT_OID_HEXSZ - 2))
+                ++result.looseObjects;
+    }
+
+    const auto packDir = objectsDir + "pack/";
+    for (const auto &name: syncListDir(packDir))
+    {
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".idx"))
+            continue;
+        ++result.packs;
+        result.packedObjects += syncPackCount(packDir + name);
+    }
+}
+
+/**
+ * Returns true if the repo has enough loose objects or packs to be
+ * worth repacking.
+ * Like `git gc --auto`, this guesses the loose-object count
+ * by sampling a single fan-out directory.
+ */
+static bool
+syncNeedsRepack(const std::string &objectsDir)
+{
+    size_t loose = 0;
+    for (const auto &name: syncListDir(objectsDir + "17"))
+        if (syncIsHex(name.c_str(), GIT_OID_HEXSZ - 2))
+            ++loose;
+    if (syncLooseLimit < 256 * loose)
+        return true;
+
+    size_t packs = 0;
+    for (const auto &name: syncListDir(objectsDir + "pack"))
+        if (4 <= name.size() && !name.compare(name.size() - 4, 4, ".idx"))
+            ++packs;
+    return syncPackLimit < packs;
+}
+
+/**
+ * Packs everything reachable from the sync branches or the index
+ * into a single new pack, then deletes the old packs and loose objects.
+ * This also prunes anything unreachable.
+ * The caller must hold the repo lock.
+ */
+static Status
+syncRepack(git_repository *repo)
+{
+    const std::string objectsDir =
+        fileSlashify(git_repository_path(repo)) + "objects/";
+    SyncRepoStats before;
+    syncObjectStats(before, objectsDir);
+
+    AutoFree<git_packbuilder, git_packbuilder_free> pb;
+    ABC_CHECK_GIT(git_packbuilder_new(&pb.get(), repo));
+
+    // Everything in the history of our branches:
+    AutoFree<git_revwalk, git_revwalk_free> walk;
+    ABC_CHECK_GIT(git_revwalk_new(&walk.get(), repo));
+    size_t heads = 0;
+    for (const char *name: {syncRefMaster, syncRefIncoming})
+    {
+        git_oid id;
+        ABC_CHECK(syncLocalRef(id, repo, name));
+        if (git_oid_iszero(&id))
+            continue;
+        ABC_CHECK_GIT(git_revwalk_push(walk, &id));
+        ++heads;
+    }
+    if (!heads)
+        return Status();
+    git_oid id;
+    int e;
+    while (0 == (e = git_revwalk_next(&id, walk)))
+        ABC_CHECK_GIT(git_packbuilder_insert_commit(pb, &id));
+    if (GIT_ITEROVER != e)
+        ABC_CHECK_GIT(e);
+
+    // Anything staged, in case it is not committed yet:
+    AutoFree<git_index, git_index_free> index;
+    ABC_CHECK_GIT(git_repository_index(&index.get(), repo));
+    for (size_t i = 0; i < git_index_entrycount(index); ++i)
+    {
+        const git_index_entry *entry = git_index_get_byindex(index, i);
+        ABC_CHECK_GIT(git_packbuilder_insert(pb, &entry->id, entry->path));
+    }
+
+    const auto packDir = objectsDir + "pack/";
+    ABC_CHECK(fileEnsureDir(packDir));
+    ABC_CHECK_GIT(git_packbuilder_write(pb, packDir.c_str(), 0,
+                                        nullptr, nullptr));
+    char hex[GIT_OID_HEXSZ + 1];
+    git_oid_tostr(hex, sizeof(hex), git_packbuilder_hash(pb));
+    const std::string keep = std::string("pack-") + hex + ".";
+
+    // The new pack has it all, so the rest can go:
+    for (const auto &name: syncListDir(packDir))
+        if (!name.compare(0, 5, "pack-") && name.compare(0, keep.size(), keep))
+            fileDelete(packDir + name).log();
+    for (const auto &dir: syncListDir(objectsDir))
+        if (syncIsHex(dir.c_str(), 2))
+            fileDelete(objectsDir + dir).log();
+
+    SyncRepoStats after;
+    syncObjectStats(after, objectsDir);
+    ABC_DebugLog("Repacked %s: %d loose objects and %d packs "
+                 "down to %d objects in %d packs",
+                 git_repository_path(repo),
+                 before.looseObjects, before.packs,
+                 after.packedObjects, after.packs);
+    return Status();
+}
+
+/**
+ * Asks the top few servers for their master commit at once,
+ * and goes with whichever answers first.
+ * The slower requests finish in the background,
+ * where they still update the server health.
+ * @param server the winning server.
+ */
+static Status
+syncRace(git_oid &remote, std::string &server,
+         const std::vector<std::string> &servers, const std::string &syncKey)
+{
+    struct Race
     {
-        syncServerIndex++;
-        syncServerIndex %= syncServers.size();
-        syncServerName = fileSlashify(syncServers[syncServerIndex]);
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t pending;
+        bool won = false;
+        std::string server;
+        git_oid remote;
+    };
+    auto race = std::make_shared<Race>();
+    race->pending = std::min(servers.size(), syncRaceWidth);
+
+    for (size_t i = 0; i < race->pending; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(gRacersMutex);
+            ++gRacers;
+        }
+        const auto name = servers[i];
+        const auto url = name + syncKey;
+        std::thread([race, name, url]()
+        {
+            const auto start = std::chrono::steady_clock::now();
+            git_oid head;
+            const bool ok = !!syncRemoteHead(head, url).log();
+            syncServerReport(name, ok, syncMilliseconds(start));
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                if (ok && !race->won)
+                {
+                    race->won = true;
+                    race->server = name;
+                    race->remote = head;
+                }
+                --race->pending;
+            }
+            race->done.notify_all();
+
+            std::lock_guard<std::mutex> lock(gRacersMutex);
+            --gRacers;
+            gRacersDone.notify_all();
+        }).detach();
     }
 
-    result = syncServerName + syncKey;
+    std::unique_lock<std::mutex> lock(race->mutex);
+    race->done.wait(lock, [&race]()
+    {
+        return race->won || !race->pending;
+    });
+    if (!race->won)
+        return ABC_ERROR(ABC_CC_ServerError, "No sync server answered");
+
+    server = race->server;
+    remote = race->remote;
     return Status();
 }
 
@@ -85,6 +699,7 @@ syncInit(const char *szCaCertPath)
     if (szCaCertPath)
         ABC_CHECK_GIT(git_libgit2_opts(GIT_OPT_SET_SSL_CERT_LOCATIONS, szCaCertPath,
                                        nullptr));
+    ABC_CHECK(syncLimitsApply());
 
     // Choose a random server to start with:
     syncServerIndex = time(nullptr);
@@ -95,6 +710,15 @@ syncInit(const char *szCaCertPath)
 void
 syncTerminate()
 {
+    {
+        std::unique_lock<std::mutex> lock(gRacersMutex);
+        gRacersDone.wait(lock, []()
+        {
+            return !gRacers;
+        });
+    }
+
+    syncRepoCacheClear();
     AutoSyncLock lock(gSyncMutex);
 
     if (gbInitialized)
@@ -107,7 +731,7 @@ syncTerminate()
 Status
 syncMakeRepo(const std::string &syncDir)
 {
-    AutoSyncLock lock(gSyncMutex);
+    RepoLock lock(syncDir);
 
     git_repository_init_options opts = GIT_REPOSITORY_INIT_OPTIONS_INIT;
     opts.flags |= GIT_REPOSITORY_INIT_MKDIR;
@@ -123,7 +747,7 @@ Status
 syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
                const std::string &syncKey)
 {
-    AutoSyncLock lock(gSyncMutex);
+    RepoLock lock(syncDir);
 
     if (!fileExists(syncDir))
     {
@@ -132,6 +756,8 @@ syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
         ABC_CHECK(syncMakeRepo(tempDir));
         bool dirty = false;
         ABC_CHECK(syncRepo(tempDir, syncKey, dirty));
+        fileJournalReset(tempDir);
+        syncRepoForget(tempDir);
         if (rename(tempDir.c_str(), syncDir.c_str()))
             return ABC_ERROR(ABC_CC_SysError, "rename failed");
     }
@@ -142,19 +768,51 @@ syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
 Status
 syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty)
 {
-    AutoSyncLock lock(gSyncMutex);
-
-    AutoFree<git_repository, git_repository_free> repo;
-    ABC_CHECK_GIT(git_repository_open(&repo.get(), syncDir.c_str()));
+    std::vector<std::string> changes;
+    return syncRepo(syncDir, syncKey, dirty, changes);
+}
 
-    std::string url;
+Status
+syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty,
+         std::vector<std::string> &changes)
+{
+    RepoLock lock(syncDir);
+    TraceScope scope(TraceEvent::syncRepo, traceId(syncDir));
+    MetricTimer timer(metricHistogram("sync.repo_us." +
+                                      syncMetricName(syncDir)));
+
+    std::shared_ptr<git_repository> handle;
+    ABC_CHECK(syncRepoOpen(handle, syncDir));
+    git_repository *repo = handle.get();
+
+    std::vector<std::string> servers;
+    ABC_CHECK(syncServersRanked(servers));
+
+    // Skip the fetch if the fastest server has nothing we haven't seen:
+    git_oid incoming, remote;
+    std::string winner;
+    ABC_CHECK(syncLocalRef(incoming, repo, syncRefIncoming));
+    bool unchanged = false;
+    if (syncRace(remote, winner, servers, syncKey).log())
+    {
+        unchanged = git_oid_equal(&incoming, &remote);
+        servers.erase(std::find(servers.begin(), servers.end(), winner));
+        servers.insert(servers.begin(), winner);
+    }
 
-    ABC_CHECK(syncUrl(url, syncKey));
+    std::string url = servers.front() + syncKey;
+    if (unchanged)
+        ABC_DebugLog("No remote changes: %s", url.c_str());
 
-    for (int i = 0; i < syncServers.size(); i++)
+    for (size_t i = 0; !unchanged && i < servers.size(); i++)
     {
-        ABC_CHECK(syncUrl(url, syncKey, true));
-        if (sync_fetch(repo, url.c_str()) >= 0)
+        url = servers[i] + syncKey;
+        const auto start = std::chrono::steady_clock::now();
+        TraceScope fetchScope(TraceEvent::syncFetch, traceId(servers[i]), i);
+        const bool ok = sync_fetch(repo, url.c_str()) >= 0;
+        fetchScope.bSet(ok);
+        syncServerReport(servers[i], ok, syncMilliseconds(start));
+        if (ok)
         {
             ABC_DebugLog("Syncing to: %s", url.c_str());
             break;
@@ -165,18 +823,128 @@ syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty)
         }
     }
 
+    // The file journal lets us skip scanning the whole working directory,
+    // once we have seen it in full at least once:
+    // Anything still in the write-behind queue needs to be on disk first:
+    ABC_CHECK(writeQueueFlush(syncDir));
+
+    std::vector<std::string> journal;
+    const bool journaled = fileJournalTake(journal, syncDir);
+    std::vector<char *> paths;
+    for (auto &path: journal)
+        paths.push_back(&path[0]);
+    git_strarray pathArray = {paths.data(), paths.size()};
+
+    git_oid before;
+    ABC_CHECK(syncLocalRef(before, repo, syncRefMaster));
+
     int files_changed, need_push;
-    ABC_CHECK_GIT(sync_master(repo, &files_changed, &need_push));
+    int e = journaled ?
+            sync_master_paths(repo, &pathArray, &files_changed, &need_push) :
+            sync_master(repo, &files_changed, &need_push);
+    if (e < 0)
+        fileJournalReset(syncDir);
+    ABC_CHECK_GIT(e);
+    scope.bSet(files_changed);
 
     if (need_push)
+    {
+        TraceScope pushScope(TraceEvent::syncPush, traceId(syncDir));
         ABC_CHECK_GIT(sync_push(repo, url.c_str()));
 
+        // The server now has our master, so remember that
+        // to keep the next preflight from seeing a change:
+        git_oid master;
+        ABC_CHECK(syncLocalRef(master, repo, syncRefMaster));
+        AutoFree<git_reference, git_reference_free> ref;
+        ABC_CHECK_GIT(git_reference_create(&ref.get(), repo, syncRefIncoming,
+                                           &master, 1, "push"));
+    }
+
     // If this fails, the app has been shut down, leaving us for dead.
     // We will crash anyhow, but this at least makes it official:
     assert(gContext);
 
+    changes.clear();
+    if (files_changed)
+    {
+        git_oid after;
+        ABC_CHECK(syncLocalRef(after, repo, syncRefMaster));
+        ABC_CHECK(syncChanges(changes, repo, syncDir, before, after));
+    }
+
+    // New commits mean new loose objects, so see if it's time to tidy up:
+    if (files_changed || need_push)
+    {
+        const std::string objectsDir =
+            fileSlashify(git_repository_path(repo)) + "objects/";
+        if (syncNeedsRepack(objectsDir))
+        {
+            syncRepack(repo).log();
+
+            // Reopen next time, rather than hold on to the deleted packs:
+            syncRepoForget(syncDir);
+        }
+    }
+
     dirty = !!files_changed;
     return Status();
 }
 
+Status
+syncRepoStats(SyncRepoStats &result, const std::string &syncDir)
+{
+    RepoLock lock(syncDir);
+
+    std::shared_ptr<git_repository> repo;
+    ABC_CHECK(syncRepoOpen(repo, syncDir));
+    syncObjectStats(result, fileSlashify(git_repository_path(repo.get())) +
+                    "objects/");
+
+    return Status();
+}
+
+void
+syncAll(std::vector<Status> &results,
+        const std::vector<std::function<Status ()>> &jobs)
+{
+    results.assign(jobs.size(), Status());
+
+    // Each worker takes the next job until they run out:
+    std::atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for (size_t i; (i = next++) < jobs.size();)
+            results[i] = jobs[i]();
+    };
+
+    std::vector<std::thread> pool;
+    const size_t threads = std::min(jobs.size(), syncThreadsMax);
+    for (size_t i = 1; i < threads; ++i)
+        pool.emplace_back(work);
+    work();
+    for (auto &thread: pool)
+        thread.join();
+}
+
+void
+syncCacheLimitsSet(size_t objectCache, size_t mappedLimit)
+{
+    AutoSyncLock lock(gSyncMutex);
+    gObjectCache = objectCache;
+    gMappedLimit = mappedLimit;
+    if (gbInitialized)
+        syncLimitsApply().log();
+}
+
+void
+syncRepoCacheClear()
+{
+    std::map<std::string, SyncRepoHandle> repos;
+    {
+        std::lock_guard<std::mutex> lock(gReposMutex);
+        repos.swap(gRepos);
+    }
+}
+
 } // namespace abcd
@@ -13,6 +13,8 @@
 #define ABC_Sync_h
 
 #include "Status.hpp"
+#include <functional>
+#include <vector>
 
 #define SYNC_KEY_LENGTH 20
 
@@ -60,6 +62,62 @@ syncEnsureRepo(const std::string &syncDir, const std::string &tempDir,
 Status
 syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty);
 
+/**
+ * Synchronizes the directory with the server,
+ * also reporting which files the sync has modified,
+ * so the caller can reload just those.
+ * @param changes the full paths of every file the sync has added,
+ * modified, or deleted. Only meaningful when `dirty` is true.
+ */
+Status
+syncRepo(const std::string &syncDir, const std::string &syncKey, bool &dirty,
+         std::vector<std::string> &changes);
+
+/**
+ * Object-storage figures for a sync repo.
+ */
+struct SyncRepoStats
+{
+    size_t looseObjects = 0;
+    size_t packs = 0;
+    size_t packedObjects = 0;
+};
+
+/**
+ * Counts the objects in a sync repo's object store.
+ * Packed objects are counted once per pack they appear in.
+ */
+Status
+syncRepoStats(SyncRepoStats &result, const std::string &syncDir);
+
+/**
+ * Runs several sync jobs at once, such as an account and its wallets,
+ * on a small pool of threads.
+ * Syncs of the same repo still wait on each other,
+ * but different repos proceed in parallel.
+ * @param results the outcome of each job, in the same order as the jobs.
+ */
+void
+syncAll(std::vector<Status> &results,
+        const std::vector<std::function<Status ()>> &jobs);
+
+/**
+ * Limits the memory libgit2 spends on the repos kept open between syncs.
+ * @param objectCache the most bytes of parsed objects to keep around.
+ * @param mappedLimit the most bytes of pack files to map at once.
+ * Can be called before `syncInit`, which applies them.
+ */
+void
+syncCacheLimitsSet(size_t objectCache, size_t mappedLimit);
+
+/**
+ * Closes the repos kept open between syncs,
+ * releasing their caches and pack mappings.
+ * They reopen on their next sync.
+ */
+void
+syncRepoCacheClear();
+
 } // namespace abcd
 
 #endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "SyncScheduler.hpp"
+#include "FileIO.hpp"
+#include "Sync.hpp"
+#include <time.h>
+#include <algorithm>
+#include <memory>
+
+namespace abcd {
+
+constexpr std::chrono::seconds syncIntervalMin(30);
+constexpr std::chrono::seconds syncIntervalMax(30 * 60);
+constexpr time_t syncDebounce = 3;
+
+// How often to look for local writes:
+constexpr std::chrono::seconds syncTick(1);
+
+void
+SyncScheduler::run(const RepoLister &repos, const DoneCallback &done)
+{
+    while (true)
+    {
+        const auto list = repos();
+
+        // Pick out the repos that are due:
+        std::vector<Repo> due;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopping_)
+            {
+                stopping_ = false;
+                break;
+            }
+
+            const auto now = Clock::now();
+            for (const auto &repo: list)
+            {
+                auto i = states_.find(repo.dir);
+                if (states_.end() == i)
+                    i = states_.emplace(repo.dir,
+                                        State{syncIntervalMin, now}).first;
+
+                time_t lastWrite;
+                const bool written = fileJournalPending(lastWrite, repo.dir) &&
+                                     lastWrite + syncDebounce <= time(nullptr);
+                const bool timely = !repo.dormant &&
+                                    (wakeupAll_ || i->second.next <= now);
+                if (written || timely)
+                    due.push_back(repo);
+            }
+            wakeupAll_ = false;
+
+            if (due.empty())
+            {
+                wakeup_.wait_for(lock, syncTick, [this]()
+                {
+                    return stopping_ || wakeupAll_;
+                });
+                continue;
+            }
+        }
+
+        // Sync them all at once:
+        std::unique_ptr<bool[]> dirty(new bool[due.size()]());
+        std::vector<std::function<Status ()>> jobs;
+        for (size_t i = 0; i < due.size(); ++i)
+            jobs.push_back([&, i]() { return due[i].sync(dirty[i]); });
+        std::vector<Status> results;
+        syncAll(results, jobs);
+
+        // Busy repos stay on the short interval, and quiet ones back off:
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto now = Clock::now();
+            for (size_t i = 0; i < due.size(); ++i)
+            {
+                auto &state = states_[due[i].dir];
+                if (results[i] && dirty[i])
+                    state.interval = syncIntervalMin;
+                else
+                    state.interval = std::min<Clock::duration>(
+                                         2 * state.interval, syncIntervalMax);
+                state.next = now + state.interval;
+            }
+        }
+
+        for (size_t i = 0; i < due.size(); ++i)
+            done(due[i], results[i], dirty[i]);
+    }
+}
+
+void
+SyncScheduler::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    wakeup_.notify_all();
+}
+
+void
+SyncScheduler::wakeup()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeupAll_ = true;
+    wakeup_.notify_all();
+}
+
+} // namespace abcd
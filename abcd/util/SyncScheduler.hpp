@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Decides when each sync repo is due for a sync.
+ */
+
+#ifndef ABCD_UTIL_SYNC_SCHEDULER_HPP
+#define ABCD_UTIL_SYNC_SCHEDULER_HPP
+
+#include "Status.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * Keeps a set of sync repos fresh from a single long-running loop.
+ *
+ * Each repo has its own polling interval, which snaps back to the minimum
+ * whenever a sync brings in changes, and doubles after every quiet one.
+ * Local writes (as seen by the file journal) trigger a sync
+ * a few seconds after the writing stops, whatever the interval.
+ * Dormant repos only sync for local writes.
+ */
+class SyncScheduler
+{
+public:
+    struct Repo
+    {
+        /** The sync directory, which also identifies the repo. */
+        std::string dir;
+        /** Passed back to the done callback, such as a wallet id. */
+        std::string id;
+        std::function<Status (bool &dirty)> sync;
+        bool dormant;
+    };
+
+    /**
+     * Lists the repos to keep in sync.
+     * Called once per pass, so the set can change as the loop runs.
+     */
+    typedef std::function<std::vector<Repo> ()> RepoLister;
+
+    /**
+     * Receives the outcome of each sync, on the loop's thread.
+     */
+    typedef std::function<void (const Repo &repo, const Status &status,
+                                bool dirty)> DoneCallback;
+
+    /**
+     * Runs the scheduler on the calling thread until `stop` is called.
+     */
+    void
+    run(const RepoLister &repos, const DoneCallback &done);
+
+    /**
+     * Makes `run` return once any syncs in progress finish.
+     * If `run` has not started yet, it will return right away.
+     */
+    void
+    stop();
+
+    /**
+     * Makes every non-dormant repo due right away,
+     * such as when the app comes back to the foreground.
+     */
+    void
+    wakeup();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct State
+    {
+        Clock::duration interval;
+        Clock::time_point next;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stopping_ = false;
+    bool wakeupAll_ = false;
+    std::map<std::string, State> states_;
+};
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TaskPool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace abcd {
+
+// Most of these tasks wait on the network, not the CPU,
+// so the pool can be bigger than the core count:
+constexpr size_t taskPoolThreadsMin = 4;
+constexpr size_t taskPoolThreadsMax = 16;
+
+typedef std::shared_ptr<std::atomic<bool>> CancelFlag;
+
+struct TaskEntry
+{
+    TaskId id;
+    TaskFunction task;
+    CancelFlag cancelled;
+    TaskPriority priority;
+};
+
+static std::mutex gPoolMutex;
+static std::condition_variable gPoolReady;
+static std::list<TaskEntry> gInteractive;
+static std::list<TaskEntry> gBackground;
+static std::map<TaskId, CancelFlag> gLive; // Queued or running
+static std::vector<std::thread> gThreads;
+static size_t gBackgroundRunning = 0;
+static bool gStopping = false;
+static TaskId gLastId = 0;
+
+static size_t
+taskPoolThreads()
+{
+    const size_t cores = std::thread::hardware_concurrency();
+    return std::min(std::max(2 * cores, taskPoolThreadsMin),
+                    taskPoolThreadsMax);
+}
+
+/**
+ * Picks the queue the next task should come from,
+ * or returns null if nothing can run yet.
+ * Should be called with the mutex held.
+ */
+static std::list<TaskEntry> *
+taskPoolNext()
+{
+    if (!gInteractive.empty())
+        return &gInteractive;
+
+    // Keep a thread free for interactive work, unless we are draining:
+    const bool room = gBackgroundRunning + 1 < gThreads.size() || gStopping;
+    if (!gBackground.empty() && room)
+        return &gBackground;
+    return nullptr;
+}
+
+static void
+taskPoolWorker()
+{
+    while (true)
+    {
+        TaskEntry entry;
+        {
+            std::unique_lock<std::mutex> lock(gPoolMutex);
+            gPoolReady.wait(lock, []()
+            {
+                return taskPoolNext() || gStopping;
+            });
+
+            // Stopping still drains the queues, so every task reports back:
+            auto queue = taskPoolNext();
+            if (!queue)
+                return;
+            entry = std::move(queue->front());
+            queue->pop_front();
+            if (TaskPriority::background == entry.priority)
+                ++gBackgroundRunning;
+        }
+
+        entry.task(entry.id, *entry.cancelled);
+
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        gLive.erase(entry.id);
+        if (TaskPriority::background == entry.priority)
+        {
+            --gBackgroundRunning;
+            gPoolReady.notify_one();
+        }
+    }
+}
+
+TaskId
+taskPoolAdd(TaskFunction task, TaskPriority priority)
+{
+    std::lock_guard<std::mutex> lock(gPoolMutex);
+
+    if (!++gLastId)
+        ++gLastId;
+    CancelFlag cancelled = std::make_shared<std::atomic<bool>>(gStopping);
+    gLive[gLastId] = cancelled;
+    auto &queue = TaskPriority::background == priority ?
+                  gBackground : gInteractive;
+    queue.push_back(TaskEntry{gLastId, std::move(task), cancelled, priority});
+
+    if (gThreads.empty() && !gStopping)
+    {
+        const auto threads = taskPoolThreads();
+        for (size_t i = 0; i < threads; ++i)
+            gThreads.emplace_back(taskPoolWorker);
+    }
+    gPoolReady.notify_one();
+
+    return gLastId;
+}
+
+void
+taskPoolRun(std::function<void ()> work, TaskPriority priority)
+{
+    taskPoolAdd([work](TaskId, const std::atomic<bool> &)
+    {
+        work();
+    }, priority);
+}
+
+bool
+taskPoolCancel(TaskId id)
+{
+    std::lock_guard<std::mutex> lock(gPoolMutex);
+    auto i = gLive.find(id);
+    if (gLive.end() == i)
+        return false;
+
+    *i->second = true;
+    return true;
+}
+
+void
+taskPoolStop()
+{
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(gPoolMutex);
+        gStopping = true;
+        for (auto &task: gLive)
+            *task.second = true;
+        threads.swap(gThreads);
+    }
+    gPoolReady.notify_all();
+
+    for (auto &thread: threads)
+        thread.join();
+
+    std::lock_guard<std::mutex> lock(gPoolMutex);
+    gStopping = false;
+}
+
+} // namespace abcd
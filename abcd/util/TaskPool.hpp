@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * The core's shared pool of threads for blocking API calls
+ * and one-shot background work.
+ */
+
+#ifndef ABCD_UTIL_TASK_POOL_HPP
+#define ABCD_UTIL_TASK_POOL_HPP
+
+#include <atomic>
+#include <functional>
+
+namespace abcd {
+
+typedef unsigned int TaskId;
+
+/**
+ * Which queue a task waits in.
+ * Background tasks never take the last free thread,
+ * so they can't hold up a call someone is waiting on.
+ */
+enum class TaskPriority
+{
+    interactive,
+    background
+};
+
+/**
+ * The work a task does.
+ * The flag goes true once someone cancels the task,
+ * and is already true if that happened before the task started.
+ */
+typedef std::function<void (TaskId id, const std::atomic<bool> &cancelled)>
+TaskFunction;
+
+/**
+ * Queues a task to run on one of the pool's threads,
+ * which start on the first call.
+ * Tasks run in the order they were added, interactive ones first.
+ * A cancelled task still runs, so it can report back to its caller.
+ * Tasks must not wait on other pool tasks,
+ * since the pool has a fixed number of threads.
+ * @return the id to pass to `taskPoolCancel`, which is never 0.
+ */
+TaskId
+taskPoolAdd(TaskFunction task,
+            TaskPriority priority=TaskPriority::interactive);
+
+/**
+ * Same as `taskPoolAdd`, for work that nobody needs to cancel.
+ */
+void
+taskPoolRun(std::function<void ()> work,
+            TaskPriority priority=TaskPriority::background);
+
+/**
+ * Marks a task as cancelled.
+ * @return false if the task has already finished, or never existed.
+ */
+bool
+taskPoolCancel(TaskId id);
+
+/**
+ * Cancels every task, lets them all finish, and stops the threads.
+ * Adding another task starts the pool back up.
+ * This must not be called from inside a task.
+ */
+void
+taskPoolStop();
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Trace.hpp"
+#include "Debug.hpp"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace abcd {
+
+constexpr char traceMagic[8] = {'A', 'B', 'C', 'T', 'R', 'A', 'C', 'E'};
+constexpr uint32_t traceVersion = 1;
+constexpr size_t recordCapacity = 32768; // 1.5 MiB of records
+constexpr size_t nameCapacity = 256;
+constexpr size_t nameSize = 60;
+
+/**
+ * One event. The sequence number goes in last,
+ * so the decoder can tell a finished record from a torn one.
+ */
+struct TraceRecord
+{
+    std::atomic<uint64_t> sequence; // Position + 1, or 0 while being written
+    uint64_t time; // Nanoseconds on the monotonic clock
+    uint64_t duration; // Nanoseconds, for complete events
+    uint32_t id;
+    uint16_t event;
+    uint8_t phase;
+    uint8_t pad;
+    int64_t a;
+    int64_t b;
+};
+
+struct TraceName
+{
+    uint32_t id;
+    char text[nameSize];
+};
+
+/**
+ * The layout of the trace file.
+ * Everything is in host byte order, since the file never leaves the device
+ * without going through the decoder first.
+ */
+struct TraceFile
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t records;
+    uint32_t names;
+    uint32_t pad;
+    std::atomic<uint64_t> next; // Next record position to hand out
+    TraceName nameTable[nameCapacity];
+    TraceRecord recordTable[recordCapacity];
+};
+
+static std::atomic<TraceFile *> gTraceFile(nullptr);
+static std::mutex gTraceNamesMutex;
+static std::map<std::string, uint32_t> gTraceNames;
+
+static uint64_t
+traceNow(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               time.time_since_epoch()).count();
+}
+
+/**
+ * Copies a name into the file's table.
+ * Should be called with the names mutex held.
+ */
+static void
+traceNameWrite(TraceFile *file, const std::string &name, uint32_t id)
+{
+    if (!file || nameCapacity < id)
+        return;
+
+    auto &entry = file->nameTable[id - 1];
+    memset(entry.text, 0, sizeof(entry.text));
+    strncpy(entry.text, name.c_str(), sizeof(entry.text) - 1);
+    entry.id = id;
+}
+
+Status
+traceInitialize(const std::string &path, const std::string &prevPath)
+{
+    if (gTraceFile)
+        return Status();
+
+    rename(path.c_str(), prevPath.c_str());
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Cannot open " + path);
+    if (ftruncate(fd, sizeof(TraceFile)))
+    {
+        close(fd);
+        return ABC_ERROR(ABC_CC_FileWriteError, "Cannot size " + path);
+    }
+    void *data = mmap(nullptr, sizeof(TraceFile), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == data)
+        return ABC_ERROR(ABC_CC_FileReadError, "Cannot map " + path);
+
+    // The new file is all zeros, which is a valid empty ring:
+    auto *file = static_cast<TraceFile *>(data);
+    memcpy(file->magic, traceMagic, sizeof(file->magic));
+    file->version = traceVersion;
+    file->records = recordCapacity;
+    file->names = nameCapacity;
+
+    std::lock_guard<std::mutex> lock(gTraceNamesMutex);
+    for (const auto &name: gTraceNames)
+        traceNameWrite(file, name.first, name.second);
+    gTraceFile = file;
+
+    return Status();
+}
+
+void
+traceTerminate()
+{
+    // Writers may still be running, so leave the mapping in place:
+    auto *file = gTraceFile.load();
+    if (file)
+        msync(file, sizeof(TraceFile), MS_ASYNC);
+}
+
+uint32_t
+traceId(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(gTraceNamesMutex);
+    auto i = gTraceNames.find(name);
+    if (gTraceNames.end() != i)
+        return i->second;
+
+    if (nameCapacity <= gTraceNames.size())
+        return 0;
+    const uint32_t id = gTraceNames.size() + 1;
+    gTraceNames[name] = id;
+    traceNameWrite(gTraceFile, name, id);
+    return id;
+}
+
+static void
+traceWrite(TraceEvent event, TracePhase phase, uint32_t id,
+           uint64_t time, uint64_t duration, int64_t a, int64_t b)
+{
+    auto *file = gTraceFile.load(std::memory_order_acquire);
+    if (!file)
+        return;
+
+    const auto position = file->next.fetch_add(1, std::memory_order_relaxed);
+    auto &record = file->recordTable[position % recordCapacity];
+    record.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    record.time = time;
+    record.duration = duration;
+    record.id = id;
+    record.event = static_cast<uint16_t>(event);
+    record.phase = static_cast<uint8_t>(phase);
+    record.a = a;
+    record.b = b;
+    record.sequence.store(position + 1, std::memory_order_release);
+}
+
+void
+trace(TraceEvent event, TracePhase phase, uint32_t id, int64_t a, int64_t b)
+{
+    traceWrite(event, phase, id, traceNow(std::chrono::steady_clock::now()), 0,
+               a, b);
+}
+
+TraceScope::~TraceScope()
+{
+    const auto end = std::chrono::steady_clock::now();
+    traceWrite(event_, TracePhase::complete, id_, traceNow(start_),
+               traceNow(end) - traceNow(start_), a_, b_);
+}
+
+TraceScope::TraceScope(TraceEvent event, uint32_t id, int64_t a, int64_t b):
+    start_(std::chrono::steady_clock::now()),
+    event_(event),
+    id_(id),
+    a_(a),
+    b_(b)
+{
+}
+
+// Decoder ----------------------------------------------------------------
+
+static const char *
+traceEventName(uint16_t event)
+{
+    switch (static_cast<TraceEvent>(event))
+    {
+    case TraceEvent::scryptHash:
+        return "scrypt";
+    case TraceEvent::syncRepo:
+        return "syncRepo";
+    case TraceEvent::syncFetch:
+        return "syncFetch";
+    case TraceEvent::syncPush:
+        return "syncPush";
+    case TraceEvent::stratumConnect:
+        return "stratumConnect";
+    case TraceEvent::stratumRequest:
+        return "stratumRequest";
+    case TraceEvent::libbitcoinConnect:
+        return "libbitcoinConnect";
+    case TraceEvent::libbitcoinRequest:
+        return "libbitcoinRequest";
+    case TraceEvent::addressFetch:
+        return "addressFetch";
+    case TraceEvent::txFetch:
+        return "txFetch";
+    case TraceEvent::headersFetch:
+        return "headersFetch";
+    }
+    return "unknown";
+}
+
+static std::string
+traceEscape(const char *text)
+{
+    std::string out;
+    for (; *text; ++text)
+    {
+        const auto c = static_cast<unsigned char>(*text);
+        if ('"' == c || '\\' == c)
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (c < 0x20)
+        {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out;
+}
+
+Status
+traceDecode(std::string &result, DataSlice file)
+{
+    if (file.size() < sizeof(TraceFile))
+        return ABC_ERROR(ABC_CC_ParseError, "Trace file is too short");
+
+    // Copy out, since the mapped layout may not be aligned in the slice:
+    std::unique_ptr<TraceFile> copy(new TraceFile);
+    memcpy(static_cast<void *>(copy.get()), file.data(), sizeof(TraceFile));
+    const auto *trace = copy.get();
+    if (memcmp(trace->magic, traceMagic, sizeof(traceMagic)) ||
+            traceVersion != trace->version ||
+            recordCapacity != trace->records ||
+            nameCapacity != trace->names)
+        return ABC_ERROR(ABC_CC_ParseError, "Not a trace file");
+
+    std::string out = "{\"traceEvents\":[\n";
+    bool first = true;
+    auto add = [&out, &first](const std::string &event)
+    {
+        if (!first)
+            out += ",\n";
+        out += event;
+        first = false;
+    };
+    char buffer[512];
+
+    // Thread names, so each server and wallet gets its own row:
+    for (const auto &name: trace->nameTable)
+    {
+        if (!name.id)
+            continue;
+        char text[nameSize + 1] = {0};
+        memcpy(text, name.text, nameSize);
+        snprintf(buffer, sizeof(buffer),
+                 "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                 "\"args\":{\"name\":\"%s\"}}",
+                 name.id, traceEscape(text).c_str());
+        add(buffer);
+    }
+
+    // Walk the ring from oldest to newest, skipping torn records:
+    const uint64_t next = trace->next;
+    const uint64_t start = recordCapacity < next ? next - recordCapacity : 0;
+    uint64_t base = 0;
+    for (uint64_t position = start; position < next; ++position)
+    {
+        const auto &record = trace->recordTable[position % recordCapacity];
+        if (record.sequence != position + 1)
+            continue;
+        if (!base)
+            base = record.time;
+
+        const double ts = (static_cast<int64_t>(record.time - base)) / 1000.0;
+        const char *name = traceEventName(record.event);
+        switch (static_cast<TracePhase>(record.phase))
+        {
+        case TracePhase::complete:
+            snprintf(buffer, sizeof(buffer),
+                     "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"pid\":1,\"tid\":%u,\"args\":{\"a\":%lld,\"b\":%lld}}",
+                     name, ts, record.duration / 1000.0, record.id,
+                     (long long)record.a, (long long)record.b);
+            break;
+        case TracePhase::asyncBegin:
+        case TracePhase::asyncEnd:
+            snprintf(buffer, sizeof(buffer),
+                     "{\"name\":\"%s\",\"cat\":\"abc\",\"ph\":\"%s\",\"ts\":%.3f,"
+                     "\"pid\":1,\"tid\":%u,\"id\":\"%u-%lld\",\"args\":{\"b\":%lld}}",
+                     name, TracePhase::asyncBegin ==
+                     static_cast<TracePhase>(record.phase) ? "b" : "e",
+                     ts, record.id, record.id, (long long)record.a,
+                     (long long)record.b);
+            break;
+        default:
+            snprintf(buffer, sizeof(buffer),
+                     "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                     "\"pid\":1,\"tid\":%u,\"args\":{\"a\":%lld,\"b\":%lld}}",
+                     name, ts, record.id,
+                     (long long)record.a, (long long)record.b);
+            break;
+        }
+        add(buffer);
+    }
+
+    out += "\n]}\n";
+    result = std::move(out);
+    return Status();
+}
+
+} // namespace abcd
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A compact binary event trace, for seeing where the time goes
+ * without wading through text logs.
+ */
+
+#ifndef ABCD_UTIL_TRACE_HPP
+#define ABCD_UTIL_TRACE_HPP
+
+#include "Data.hpp"
+#include "Status.hpp"
+#include <stdint.h>
+#include <chrono>
+
+namespace abcd {
+
+enum class TraceEvent: uint16_t
+{
+    scryptHash,
+    syncRepo,
+    syncFetch,
+    syncPush,
+    stratumConnect,
+    stratumRequest,
+    libbitcoinConnect,
+    libbitcoinRequest,
+    addressFetch,
+    txFetch,
+    headersFetch,
+};
+
+enum class TracePhase: uint8_t
+{
+    instant,
+    complete,
+    asyncBegin, // The first payload pairs this with its `asyncEnd`
+    asyncEnd,
+};
+
+/**
+ * Starts tracing into a memory-mapped ring file,
+ * moving the previous process's trace out of the way.
+ */
+Status
+traceInitialize(const std::string &path, const std::string &prevPath);
+
+/**
+ * Pushes the ring out to disk.
+ */
+void
+traceTerminate();
+
+/**
+ * Returns a small number that stands for a string in the trace,
+ * such as a server or wallet.
+ * The string itself lands in the trace file's name table.
+ */
+uint32_t
+traceId(const std::string &name);
+
+/**
+ * Records one event.
+ * This takes no locks, and does nothing if tracing is not running.
+ * @param id the wallet or server this belongs to, from `traceId`.
+ */
+void
+trace(TraceEvent event, TracePhase phase, uint32_t id,
+      int64_t a=0, int64_t b=0);
+
+/**
+ * Records a complete event covering this object's lifetime.
+ */
+class TraceScope
+{
+public:
+    ~TraceScope();
+    TraceScope(TraceEvent event, uint32_t id, int64_t a=0, int64_t b=0);
+
+    /**
+     * Replaces the second payload, such as with a result.
+     */
+    void
+    bSet(int64_t b) { b_ = b; }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+    TraceEvent event_;
+    uint32_t id_;
+    int64_t a_;
+    int64_t b_;
+};
+
+/**
+ * Converts a trace file into Chrome's trace-event JSON,
+ * which chrome://tracing and similar tools can display.
+ */
+Status
+traceDecode(std::string &result, DataSlice file);
+
+} // namespace abcd
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Workload.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace abcd {
+
+// Each line after the header is a tab-separated call:
+// start, thread, function, wallet, shape, duration.
+constexpr auto workloadHeader = "# abc-workload 1";
+
+std::atomic<bool> gWorkloadRecording(false);
+
+static std::mutex gMutex;
+static FILE *gFile = nullptr;
+static std::chrono::steady_clock::time_point gStart;
+static std::map<std::string, int> gWallets;
+static std::map<std::thread::id, unsigned> gThreads;
+
+Status
+workloadRecordStart(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Cannot open " + path);
+    fprintf(file, "%s\n", workloadHeader);
+
+    if (gFile)
+        fclose(gFile);
+    gFile = file;
+    gStart = std::chrono::steady_clock::now();
+    gWallets.clear();
+    gThreads.clear();
+    gWorkloadRecording = true;
+
+    return Status();
+}
+
+void
+workloadRecordStop()
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+
+    gWorkloadRecording = false;
+    if (gFile)
+        fclose(gFile);
+    gFile = nullptr;
+}
+
+void
+workloadRecord(const char *function, const std::string &wallet,
+               int64_t shape, std::chrono::steady_clock::time_point start,
+               uint64_t duration)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    if (!gFile)
+        return;
+
+    // Calls that began before the recording are from an earlier run:
+    if (start < gStart)
+        return;
+    const uint64_t offset = std::chrono::duration_cast<
+                                std::chrono::microseconds>(start - gStart).count();
+
+    int walletNumber = -1;
+    if (!wallet.empty())
+        walletNumber = gWallets.emplace(wallet, gWallets.size()).first->second;
+    const auto thread = gThreads.emplace(std::this_thread::get_id(),
+                                         gThreads.size()).first->second;
+
+    fprintf(gFile, "%llu\t%u\t%s\t%d\t%lld\t%llu\n",
+            static_cast<unsigned long long>(offset), thread, function,
+            walletNumber, static_cast<long long>(shape),
+            static_cast<unsigned long long>(duration));
+}
+
+Status
+workloadLoad(std::vector<WorkloadCall> &result, const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return ABC_ERROR(ABC_CC_FileOpenError, "Cannot open " + path);
+
+    std::string line;
+    if (!std::getline(file, line) || workloadHeader != line)
+        return ABC_ERROR(ABC_CC_ParseError, "Not a workload file: " + path);
+
+    std::vector<WorkloadCall> out;
+    while (std::getline(file, line))
+    {
+        if (line.empty())
+            continue;
+
+        std::istringstream in(line);
+        WorkloadCall call;
+        if (!(in >> call.start >> call.thread >> call.function >>
+                call.wallet >> call.shape >> call.duration))
+            return ABC_ERROR(ABC_CC_ParseError, "Bad workload line: " + line);
+        out.push_back(std::move(call));
+    }
+
+    // Each call lands in the file when it finishes, not when it starts:
+    std::stable_sort(out.begin(), out.end(),
+                     [](const WorkloadCall &a, const WorkloadCall &b)
+    {
+        return a.start < b.start;
+    });
+
+    result = std::move(out);
+    return Status();
+}
+
+} // namespace abcd
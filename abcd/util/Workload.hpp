@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * An opt-in log of the C API calls an app makes, with their timing,
+ * so real usage patterns can be replayed against a test root.
+ */
+
+#ifndef ABCD_UTIL_WORKLOAD_HPP
+#define ABCD_UTIL_WORKLOAD_HPP
+
+#include "Status.hpp"
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace abcd {
+
+/**
+ * One recorded API call.
+ * Nothing here identifies the user: wallets become small numbers
+ * in the order they first appear, and no other arguments are kept
+ * beyond a size hint.
+ */
+struct WorkloadCall
+{
+    uint64_t start;     // Microseconds since the recording began
+    unsigned thread;    // Calling thread, numbered from 0
+    std::string function;
+    int wallet;         // Anonymous wallet number, or -1 for none
+    int64_t shape;      // Such as a query length or page size
+    uint64_t duration;  // Microseconds
+};
+
+extern std::atomic<bool> gWorkloadRecording;
+
+/**
+ * Starts writing each top-level API call to a file,
+ * replacing any recording already in progress.
+ */
+Status
+workloadRecordStart(const std::string &path);
+
+/**
+ * Finishes the current recording, if any.
+ */
+void
+workloadRecordStop();
+
+/**
+ * True if calls are being recorded right now.
+ */
+inline bool
+workloadRecording()
+{
+    return gWorkloadRecording.load(std::memory_order_relaxed);
+}
+
+/**
+ * Adds a finished call to the recording.
+ */
+void
+workloadRecord(const char *function, const std::string &wallet,
+               int64_t shape, std::chrono::steady_clock::time_point start,
+               uint64_t duration);
+
+/**
+ * Reads a recording back in, ordered by start time.
+ */
+Status
+workloadLoad(std::vector<WorkloadCall> &result, const std::string &path);
+
+} // namespace abcd
+
+#endif
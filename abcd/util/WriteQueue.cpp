@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "WriteQueue.hpp"
+#include "FileIO.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace abcd {
+
+// How long to wait for more writes before flushing a batch:
+constexpr std::chrono::milliseconds writeQueueDelay(100);
+
+typedef std::function<Status ()> WriteFunction;
+
+// The waiting writes, by path:
+static std::mutex gQueueMutex;
+static std::condition_variable gQueueReady;
+static std::map<std::string, WriteFunction> gQueue;
+static bool gWorkerStarted = false;
+
+// Held while running writes, so a write taken off the queue is always
+// on disk before a newer write to the same path, or a cancel, can proceed:
+static std::mutex gWriteMutex;
+
+// Set while this thread is running queued writes,
+// whose own file saves must not try to cancel anything:
+static thread_local bool tFlushing = false;
+
+/**
+ * Returns true if the path is the prefix itself or lies under it.
+ */
+static bool
+writeQueueUnder(const std::string &path, const std::string &prefix)
+{
+    if (prefix.empty())
+        return true;
+    if (path.compare(0, prefix.size(), prefix))
+        return false;
+    return path.size() == prefix.size() || '/' == prefix.back() ||
+           '/' == path[prefix.size()];
+}
+
+/**
+ * Removes the matching writes from the queue.
+ * The caller must hold the queue lock.
+ */
+static std::vector<WriteFunction>
+writeQueueTake(const std::string &prefix)
+{
+    std::vector<WriteFunction> out;
+    for (auto i = gQueue.begin(); i != gQueue.end();)
+    {
+        if (writeQueueUnder(i->first, prefix))
+        {
+            out.push_back(std::move(i->second));
+            i = gQueue.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    return out;
+}
+
+static void
+writeQueueWorker()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(gQueueMutex);
+            gQueueReady.wait(lock, []() { return !gQueue.empty(); });
+        }
+
+        // Give the caller a moment to pile up more writes:
+        std::this_thread::sleep_for(writeQueueDelay);
+        writeQueueFlush().log();
+    }
+}
+
+void
+writeQueueAdd(const std::string &path, WriteFunction write)
+{
+    std::lock_guard<std::mutex> lock(gQueueMutex);
+    gQueue[path] = std::move(write);
+
+    // The worker never exits, so the process can end without joining it.
+    // Anything still waiting then is lost, so shutdown should flush first:
+    if (!gWorkerStarted)
+    {
+        std::thread(writeQueueWorker).detach();
+        gWorkerStarted = true;
+    }
+    gQueueReady.notify_one();
+}
+
+bool
+writeQueuePending(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(gQueueMutex);
+    return gQueue.count(path);
+}
+
+void
+writeQueueCancel(const std::string &path)
+{
+    if (tFlushing)
+        return;
+
+    std::lock_guard<std::mutex> writeLock(gWriteMutex);
+    std::lock_guard<std::mutex> lock(gQueueMutex);
+    writeQueueTake(path);
+}
+
+Status
+writeQueueFlush(const std::string &path)
+{
+    if (tFlushing)
+        return Status();
+
+    std::lock_guard<std::mutex> writeLock(gWriteMutex);
+
+    std::vector<WriteFunction> writes;
+    {
+        std::lock_guard<std::mutex> lock(gQueueMutex);
+        writes = writeQueueTake(path);
+    }
+
+    Status out;
+    tFlushing = true;
+    for (const auto &write: writes)
+    {
+        Status s = write();
+        if (out && !s)
+            out = s;
+        else
+            s.log();
+    }
+    tFlushing = false;
+
+    // One directory flush covers the whole batch:
+    if (!writes.empty())
+    {
+        Status s = fileSyncDirs();
+        if (out && !s)
+            out = s;
+    }
+    return out;
+}
+
+} // namespace abcd
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Write-behind queue for small files.
+ */
+
+#ifndef ABCD_UTIL_WRITE_QUEUE_HPP
+#define ABCD_UTIL_WRITE_QUEUE_HPP
+
+#include "Status.hpp"
+#include <functional>
+
+namespace abcd {
+
+/**
+ * Queues a file write to happen shortly on a worker thread.
+ * A newer write to the same path replaces any older one still waiting,
+ * so bursts of saves to the same file only hit the disk once.
+ * The write function must not depend on caller state that could change,
+ * since it runs later, on another thread.
+ */
+void
+writeQueueAdd(const std::string &path, std::function<Status ()> write);
+
+/**
+ * Returns true if a write to the path is still waiting.
+ */
+bool
+writeQueuePending(const std::string &path);
+
+/**
+ * Throws away any waiting writes to the path or anything under it,
+ * such as before deleting or directly overwriting it.
+ * Waits for a write already in progress to finish.
+ * Has no effect when called from inside a queued write.
+ */
+void
+writeQueueCancel(const std::string &path);
+
+/**
+ * Durability barrier.
+ * Performs every waiting write to the path or anything under it before
+ * returning, or every waiting write at all if the path is empty.
+ * @return the first write error, if any.
+ */
+Status
+writeQueueFlush(const std::string &path="");
+
+} // namespace abcd
+
+#endif
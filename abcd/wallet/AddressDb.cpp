@@ -10,14 +10,21 @@
 #include "../bitcoin/cache/Cache.hpp"
 #include "../crypto/Crypto.hpp"
 #include "../json/JsonObject.hpp"
+#include "../json/JsonPack.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
+#include "../util/Parallel.hpp"
 #include <bitcoin/bitcoin.hpp>
-#include <dirent.h>
 #include <time.h>
+#include <algorithm>
 
 namespace abcd {
 
+// Unused addresses to keep ahead of the last used one:
+constexpr size_t lookaheadMin = 5;
+constexpr size_t lookaheadRestore = 20;
+constexpr size_t lookaheadMax = 320;
+
 struct AddressMetaJson:
     public JsonObject
 {
@@ -102,51 +109,156 @@ AddressJson::unpack(AddressMeta &result)
 static bc::hd_private_key
 mainBranch(const Wallet &wallet)
 {
-    return bc::hd_private_key(wallet.bitcoinKey()).
+    const auto key = wallet.bitcoinKey();
+    return bc::hd_private_key(DataChunk(key.begin(), key.end())).
            generate_private_key(0).
            generate_private_key(0);
 }
 
+/**
+ * Derives m/0/0 from the m/0 public key, for watch-only wallets.
+ */
+static bc::hd_public_key
+mainPublicBranch(Wallet &wallet)
+{
+    bc::hd_public_key m0;
+    m0.set_encoded(wallet.bitcoinXPub());
+    return m0.generate_public_key(0);
+}
+
+/**
+ * Derives the addresses at the given indices, spreading the work
+ * over several threads when there is enough of it.
+ * Invalid keys come back as blank addresses.
+ */
+static std::vector<std::string>
+deriveAddresses(const bc::hd_public_key &branch,
+                const std::vector<size_t> &indices)
+{
+    std::vector<std::string> out(indices.size());
+    auto work = [&branch, &indices, &out](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+        {
+            const auto key = branch.generate_public_key(indices[i]);
+            if (key.valid())
+                out[i] = key.address().encoded();
+        }
+    };
+    parallelFor(indices.size(), work);
+    return out;
+}
+
+AddressDb::~AddressDb()
+{
+}
+
 AddressDb::AddressDb(Wallet &wallet):
     wallet_(wallet),
-    dir_(wallet.paths.addressesDir())
+    dir_(wallet.paths.addressesDir()),
+    lookahead_(lookaheadMin)
 {
 }
 
 Status
 AddressDb::load()
 {
+    // Read the files before taking the lock:
+    JsonPack pack(wallet_.paths.addressPackPath(), wallet_.dataKey());
+    pack.load();
+    auto files = pack.loadDir(dir_);
+    pack.save().log();
+
     std::lock_guard<std::mutex> lock(mutex_);
 
     addresses_.clear();
-    files_.clear();
+    filter_.clear();
+    snapshot_.reset();
+    ++version_;
+    recyclable_.clear();
+    verified_.clear();
+
+    std::vector<std::string> loaded;
+    std::vector<std::string> names;
+    for (const auto &file: files)
+    {
+        // Try to load the address:
+        AddressMeta address;
+        AddressJson json(file.second);
+        if (json.unpack(address).log())
+        {
+            // Payments seen since the last write still count:
+            if (unsaved_.count(address.address))
+                address.recyclable = false;
+            insert(address);
+            loaded.push_back(file.first);
+            names.push_back(address.address);
+
+            wallet_.cache.addresses.insert(address.address);
+        }
+    }
+
+    // Check the file names in one batch:
+    const auto hashes = filenameKey().filenames(names);
+    for (size_t i = 0; i < loaded.size(); ++i)
+    {
+        const auto &address = addresses_[names[i]];
+        if (std::to_string(address.index) + "-" + hashes[i] + ".json" !=
+                loaded[i])
+            ABC_DebugLog("Filename %s does not match address",
+                         loaded[i].c_str());
+    }
+
+    // Without any used addresses on disk, we are starting from scratch:
+    restoring_ = true;
+    for (const auto &address: addresses_)
+        if (!address.second.recyclable)
+            restoring_ = false;
+    lookahead_ = restoring_ ? lookaheadRestore : lookaheadMin;
+    lastUsed_ = 0;
+
+    ABC_CHECK(stockpile());
+    return Status();
+}
+
+Status
+AddressDb::reload(const std::vector<std::string> &paths)
+{
+    // Read the files before taking the lock:
+    std::vector<JsonPtr> files;
+    for (const auto &path: paths)
+    {
+        if (path.compare(0, dir_.size(), dir_) ||
+                !fileIsJson(path.substr(dir_.size())))
+            continue;
+        if (!fileExists(path))
+            return load();
+
+        JsonPtr json;
+        if (json.load(path, wallet_.dataKey()).log())
+            files.push_back(json);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
 
-    // Open the directory:
-    DIR *dir = opendir(dir_.c_str());
-    if (dir)
+    for (const auto &file: files)
     {
-        struct dirent *de;
-        while (nullptr != (de = readdir(dir)))
+        AddressMeta address;
+        AddressJson json(file);
+        if (!json.unpack(address).log())
+            continue;
+
+        if (unsaved_.count(address.address))
+            address.recyclable = false;
+        insert(address);
+        wallet_.cache.addresses.insert(address.address);
+
+        // A used address on disk means we are not restoring, as in `load`:
+        if (restoring_ && !address.recyclable)
         {
-            if (!fileIsJson(de->d_name))
-                continue;
-
-            // Try to load the address:
-            AddressMeta address;
-            AddressJson json;
-            if (json.load(dir_ + de->d_name, wallet_.dataKey()).log() &&
-                    json.unpack(address).log())
-            {
-                if (path(address) != dir_ + de->d_name)
-                    ABC_DebugLog("Filename %s does not match address", de->d_name);
-
-                addresses_[address.address] = address;
-                files_[address.address] = json;
-
-                wallet_.cache.addresses.insert(address.address);
-            }
+            restoring_ = false;
+            lookahead_ = lookaheadMin;
         }
-        closedir(dir);
     }
 
     ABC_CHECK(stockpile());
@@ -161,14 +273,19 @@ AddressDb::save(const AddressMeta &address)
     auto i = addresses_.find(address.address);
     if (i == addresses_.end())
         return ABC_ERROR(ABC_CC_NoAvailableAddress, "No address: " + address.address);
-    addresses_[address.address] = address;
-
-    AddressJson json(files_[address.address]);
+    insert(address);
+
+    const auto filename = path(address);
+    // Start from the file on disk, so fields we don't know about survive.
+    // Only the item being edited gets read, so nothing stays resident:
+    JsonPtr file;
+    if (fileExists(filename))
+        file.load(filename, wallet_.dataKey()).log();
+    AddressJson json(file);
     if (!json)
         json = JsonObject();
     ABC_CHECK(json.pack(address));
-    ABC_CHECK(json.save(path(address), wallet_.dataKey()));
-    files_[address.address] = json;
+    ABC_CHECK(json.saveQueued(filename, wallet_.dataKey()));
 
     ABC_CHECK(stockpile());
     return Status();
@@ -181,35 +298,75 @@ AddressDb::balance(const TxInfo &info) const
 
     int64_t out = 0;
     for (const auto &io: info.ios)
-        if (addresses_.count(io.address))
+        if (filter_.mayContain(io.address) && addresses_.count(io.address))
             out += io.input ? -io.value : io.value;
 
     return out;
 }
 
-AddressSet
-AddressDb::list() const
+std::shared_ptr<const AddressSet>
+AddressDb::snapshot() const
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    return snapshotInternal();
+}
 
-    AddressSet out;
-    for (const auto &i: addresses_)
-        out.insert(i.first);
+uint64_t
+AddressDb::version() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return version_;
+}
 
+size_t
+AddressDb::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    size_t out = 0;
+    for (const auto &address: addresses_)
+        out += sizeof(address) + address.first.capacity() +
+               address.second.metadata.name.capacity() +
+               address.second.metadata.category.capacity() +
+               address.second.metadata.notes.capacity();
+    for (const auto &key: keys_)
+        out += sizeof(key) + key.second.capacity();
     return out;
 }
 
+void
+AddressDb::trim()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    keys_.clear();
+    branch_.reset();
+    publicBranch_.reset();
+    verified_.clear();
+}
+
 KeyTable
-AddressDb::keyTable()
+AddressDb::keyTable(const AddressSet &addresses)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    auto m00 = mainBranch(wallet_);
     KeyTable out;
-    for (const auto &i: addresses_)
+    if (wallet_.watchOnly())
+        return out;
+    for (const auto &address: addresses)
     {
-        out[i.first] = bc::secret_to_wif(
-                           m00.generate_private_key(i.second.index).private_key());
+        const auto i = addresses_.find(address);
+        if (addresses_.end() == i)
+            continue;
+
+        const auto index = i->second.index;
+        auto key = keys_.find(index);
+        if (keys_.end() == key)
+        {
+            const auto secret =
+                branch().generate_private_key(index).private_key();
+            key = keys_.emplace(index, bc::secret_to_wif(secret)).first;
+        }
+        out[address] = key->second;
     }
 
     return out;
@@ -220,7 +377,8 @@ AddressDb::has(const std::string &address)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    return addresses_.end() != addresses_.find(address);
+    return filter_.mayContain(address) &&
+           addresses_.end() != addresses_.find(address);
 }
 
 Status
@@ -241,23 +399,26 @@ AddressDb::getNew(AddressMeta &result)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    // Use a set to find the lowest available index:
-    std::set<size_t> indices;
-    for (auto &address: addresses_)
-        if (address.second.recyclable)
-            indices.insert(address.second.index);
-
     // The stockpile should prevent this from ever happening:
-    if (indices.empty())
+    if (recyclable_.empty())
         return ABC_ERROR(ABC_CC_NoAvailableAddress, "Address stockpile depleted!");
-    size_t index = *indices.begin();
+    const auto &lowest = *recyclable_.begin();
 
-    // Verify that we can still re-derive the address:
-    auto i = addresses_.find(mainBranch(wallet_).generate_private_key(index).
-                             address().encoded());
-    if (addresses_.end() == i)
-        return ABC_ERROR(ABC_CC_Error,
-                         "Address corruption at index " + std::to_string(index));
+    // Verify that we can still re-derive the address,
+    // unless we just did that for the same one:
+    auto i = addresses_.find(lowest.second);
+    if (verified_ != lowest.second)
+    {
+        i = addresses_.find(publicBranch().generate_public_key(lowest.first).
+                            address().encoded());
+        if (addresses_.end() == i)
+            return ABC_ERROR(ABC_CC_Error, "Address corruption at index " +
+                             std::to_string(lowest.first));
+        verified_ = i->first;
+    }
+
+    // The user is about to see this one, so watch it closely:
+    wallet_.cache.addresses.touch(i->first);
 
     result = i->second;
     return Status();
@@ -277,6 +438,26 @@ AddressDb::recycleSet(const std::string &address, bool recycle)
     return Status();
 }
 
+void
+AddressDb::markOutputsUsed(const TxInfo &info)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &io: info.ios)
+    {
+        if (io.input)
+            continue;
+        auto i = addresses_.find(io.address);
+        if (addresses_.end() == i || !i->second.recyclable)
+            continue;
+
+        auto address = i->second;
+        address.recyclable = false;
+        insert(address);
+        unsaved_.insert(io.address);
+    }
+}
+
 /**
  * Marks a transaction's output addresses as having received money.
  */
@@ -285,13 +466,103 @@ AddressDb::markOutputs(const TxInfo &info)
 {
     for (const auto &io: info.ios)
     {
-        if (!io.input)
+        if (io.input)
+            continue;
+
+        bool unsaved;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            unsaved = unsaved_.erase(io.address);
+        }
+
+        // Addresses marked in memory still need their files written:
+        AddressMeta address;
+        if (unsaved && get(address, io.address))
+            save(address).log();
+        else
             recycleSet(io.address, false); // Failure is fine
     }
 
     return Status();
 }
 
+void
+AddressDb::restoreDone()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (restoring_)
+        ABC_DebugLog("Restore finished with %d addresses", addresses_.size());
+    restoring_ = false;
+    lookahead_ = lookaheadMin;
+}
+
+const bc::hd_private_key &
+AddressDb::branch()
+{
+    if (!branch_)
+        branch_.reset(new bc::hd_private_key(mainBranch(wallet_)));
+    return *branch_;
+}
+
+void
+AddressDb::insert(const AddressMeta &address)
+{
+    auto i = addresses_.find(address.address);
+    if (addresses_.end() == i)
+    {
+        filter_.insert(address.address);
+        snapshot_.reset();
+        ++version_;
+    }
+    else
+    {
+        auto old = recyclable_.find(i->second.index);
+        if (recyclable_.end() != old && old->second == address.address)
+            recyclable_.erase(old);
+        if (i->second.index != address.index && verified_ == address.address)
+            verified_.clear();
+    }
+
+    addresses_[address.address] = address;
+    if (address.recyclable)
+        recyclable_[address.index] = address.address;
+}
+
+std::shared_ptr<const AddressSet>
+AddressDb::snapshotInternal() const
+{
+    if (!snapshot_)
+    {
+        auto out = std::make_shared<AddressSet>();
+        for (const auto &i: addresses_)
+            out->insert(out->end(), i.first);
+        snapshot_ = out;
+    }
+    return snapshot_;
+}
+
+const bc::hd_public_key &
+AddressDb::publicBranch()
+{
+    if (!publicBranch_)
+    {
+        if (wallet_.watchOnly())
+            publicBranch_.reset(new bc::hd_public_key(mainPublicBranch(wallet_)));
+        else
+            publicBranch_.reset(new bc::hd_public_key(branch()));
+    }
+    return *publicBranch_;
+}
+
+const HmacKey &
+AddressDb::filenameKey()
+{
+    if (!filenameKey_)
+        filenameKey_.reset(new HmacKey(wallet_.dataKey()));
+    return *filenameKey_;
+}
+
 Status
 AddressDb::stockpile()
 {
@@ -299,39 +570,51 @@ AddressDb::stockpile()
 
     // Build a list of used indices:
     std::map<size_t, bool> indices;
+    size_t lastUsed = 0;
     for (const auto &i: addresses_)
+    {
         indices[i.second.index] = i.second.recyclable;
+        if (!i.second.recyclable)
+            lastUsed = std::max(lastUsed, i.second.index);
+    }
+
+    // During a restore, each hit past the old frontier widens the window:
+    if (restoring_ && lastUsed_ < lastUsed)
+        lookahead_ = std::min(2 * lookahead_, lookaheadMax);
+    lastUsed_ = lastUsed;
 
     // Check for gaps:
-    size_t lastUsed = 0;
-    for (size_t i = 0; i < addresses_.size() || i < lastUsed + 5; ++i)
+    size_t end = lastUsed + lookahead_;
+    if (!indices.empty())
+        end = std::max(end, indices.rbegin()->first + 1);
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < end; ++i)
+        if (!indices.count(i))
+            missing.push_back(i);
+
+    // Create the missing addresses:
+    const auto addresses = deriveAddresses(publicBranch(), missing);
+    const auto now = time(nullptr);
+    for (size_t i = 0; i < missing.size(); ++i)
     {
-        auto index = indices.find(i);
-        if (index == indices.end())
-        {
-            // Create the missing address:
-            auto m00n = mainBranch(wallet_).generate_private_key(i);
-            if (m00n.valid())
-            {
-                AddressMeta address;
-                address.index = i;
-                address.address = m00n.address().encoded();
-                address.recyclable = true;
-                address.time = time(nullptr);
-                addresses_[address.address] = address;
-
-                AddressJson json;
-                ABC_CHECK(json.pack(address));
-                ABC_CHECK(json.save(path(address), wallet_.dataKey()));
-                files_[address.address] = json;
-
-                wallet_.cache.addresses.insert(address.address);
-            }
-        }
-        else if (!index->second)
-        {
-            lastUsed = i;
-        }
+        if (addresses[i].empty())
+            continue;
+
+        AddressMeta address;
+        address.index = missing[i];
+        address.address = addresses[i];
+        address.recyclable = true;
+        address.time = now;
+        insert(address);
+
+        wallet_.cache.addresses.insert(address.address);
+    }
+
+    // Let the transaction cache know which funds are ours:
+    if (balanceVersion_ != version_)
+    {
+        wallet_.cache.txs.balanceAddressesSet(*snapshotInternal());
+        balanceVersion_ = version_;
     }
 
     return Status();
@@ -341,7 +624,7 @@ std::string
 AddressDb::path(const AddressMeta &address)
 {
     return dir_ + std::to_string(address.index) + "-" +
-           cryptoFilename(wallet_.dataKey(), address.address) + ".json";
+           filenameKey().filename(address.address) + ".json";
 }
 
 } // namespace abcd
@@ -9,14 +9,25 @@
 #define ABCD_WALLET_ADDRESS_DB_HPP
 
 #include "Metadata.hpp"
+#include "../bitcoin/AddressFilter.hpp"
 #include "../bitcoin/Typedefs.hpp"
-#include "../json/JsonPtr.hpp"
 #include <list>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
+#include <vector>
+
+namespace libbitcoin {
+
+class hd_private_key;
+class hd_public_key;
+
+} // namespace libbitcoin
 
 namespace abcd {
 
+class HmacKey;
 class Wallet;
 struct TxInfo;
 typedef std::map<const std::string, std::string> KeyTable;
@@ -37,6 +48,7 @@ struct AddressMeta
 class AddressDb
 {
 public:
+    ~AddressDb();
     AddressDb(Wallet &wallet);
 
     /**
@@ -45,6 +57,14 @@ public:
     Status
     load();
 
+    /**
+     * Re-reads just the given files after a sync,
+     * ignoring any paths outside the address directory.
+     * Falls back on a full `load` if any of the files have gone away.
+     */
+    Status
+    reload(const std::vector<std::string> &paths);
+
     /**
      * Updates a particular address in the database.
      */
@@ -59,15 +79,25 @@ public:
 
     /**
      * Lists all the addresses in the wallet.
+     * The set is shared and never changes once published,
+     * so callers can hold onto it for as long as they like.
+     */
+    std::shared_ptr<const AddressSet>
+    snapshot() const;
+
+    /**
+     * Goes up each time an address joins the list,
+     * so callers can tell whether their last `snapshot` is still current.
      */
-    AddressSet
-    list() const;
+    uint64_t
+    version() const;
 
     /**
-     * Returns the private keys for the wallet's addresses.
+     * Returns the private keys for the given addresses,
+     * skipping any that are not in the wallet.
      */
     KeyTable
-    keyTable();
+    keyTable(const AddressSet &addresses);
 
     /**
      * Returns true if the database contains the given address.
@@ -93,23 +123,103 @@ public:
     Status
     recycleSet(const std::string &address, bool recycle);
 
+    /**
+     * Takes a transaction's output addresses out of the recycling pool,
+     * in memory only, so `getNew` can never hand out a paid address.
+     * `markOutputs` writes the change out later.
+     */
+    void
+    markOutputsUsed(const TxInfo &info);
+
     /**
      * Marks a transaction's output addresses as having received money.
      */
     Status
     markOutputs(const TxInfo &info);
 
+    /**
+     * Leaves restore mode, once every address has been checked.
+     */
+    void
+    restoreDone();
+
+    /**
+     * Roughly how much heap the database is holding, in bytes.
+     */
+    size_t
+    memoryUsed() const;
+
+    /**
+     * Forgets the derived private keys, which come back on the next spend,
+     * for when the system is low on memory.
+     */
+    void
+    trim();
+
 private:
     mutable std::mutex mutex_;
     Wallet &wallet_;
     const std::string dir_;
 
     std::map<std::string, AddressMeta> addresses_;
-    std::map<std::string, JsonPtr> files_;
+    AddressFilter filter_; // Mirrors the keys of `addresses_`
+
+    // The keys of `addresses_` once more, rebuilt after any additions:
+    mutable std::shared_ptr<const AddressSet> snapshot_;
+    uint64_t version_ = 1;
+    uint64_t balanceVersion_ = 0; // What the TxCache last heard about
+
+    // Recyclable addresses by index, so `getNew` can take the lowest:
+    std::map<size_t, std::string> recyclable_;
+    std::string verified_; // The last address `getNew` re-derived
+    std::set<std::string> unsaved_; // Marked used, but not written out
+
+    // The m/0/0 keys, derived on first use.
+    // Watch-only wallets only have the public one:
+    std::unique_ptr<libbitcoin::hd_private_key> branch_;
+    std::unique_ptr<libbitcoin::hd_public_key> publicBranch_;
+
+    // The file name key, set up on first use:
+    std::unique_ptr<HmacKey> filenameKey_;
+
+    // WIF keys by index, filled in as spends need them:
+    std::map<size_t, std::string> keys_;
+
+    // Lookahead window past the last used address.
+    // A wallet with no used addresses on disk is being restored,
+    // so its window starts wider and doubles with every hit:
+    bool restoring_ = false;
+    size_t lookahead_;
+    size_t lastUsed_ = 0;
+
+    const libbitcoin::hd_private_key &
+    branch();
+
+    /**
+     * The key addresses come from, which works for watch-only wallets.
+     */
+    const libbitcoin::hd_public_key &
+    publicBranch();
+
+    /**
+     * Adds or replaces an address, keeping the filter and indices in step.
+     */
+    void
+    insert(const AddressMeta &address);
+
+    /**
+     * Same as `snapshot`, but with the mutex already held.
+     */
+    std::shared_ptr<const AddressSet>
+    snapshotInternal() const;
+
+    const HmacKey &
+    filenameKey();
 
     /**
      * Ensures that there are no gaps in the address list,
      * and at there are several extra addresses ready to go.
+     * New addresses live in memory until they are used.
      */
     Status
     stockpile();
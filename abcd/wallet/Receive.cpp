@@ -20,8 +20,8 @@ Status
 onReceive(Wallet &wallet, const TxInfo &info,
           tABC_BitCoin_Event_Callback fCallback, void *pData)
 {
-    wallet.balanceDirty();
-    ABC_CHECK(wallet.addresses.markOutputs(info));
+    // The next receive request must not show an address that was just paid:
+    wallet.addresses.markOutputsUsed(info);
 
     // Does the transaction already exist?
     TxMeta meta;
@@ -54,7 +54,8 @@ onReceive(Wallet &wallet, const TxInfo &info,
                       meta.metadata.amountCurrency, balance,
                       static_cast<Currency>(wallet.currency())));
 
-        // Save the metadata:
+        // Save the metadata, which lands in memory before the GUI looks,
+        // while the encrypted file goes out on the write queue:
         ABC_CHECK(wallet.txs.save(meta, balance, info.fee));
 
         // Update the GUI:
@@ -67,6 +68,8 @@ onReceive(Wallet &wallet, const TxInfo &info,
         async.szWalletUUID = wallet.id().c_str();
         async.szTxID = info.txid.c_str();
         async.sweepSatoshi = 0;
+        async.aszTxIDs = &async.szTxID;
+        async.countTxIDs = 1;
         fCallback(&async);
     }
     else
@@ -81,10 +84,19 @@ onReceive(Wallet &wallet, const TxInfo &info,
         async.szWalletUUID = wallet.id().c_str();
         async.szTxID = info.txid.c_str();
         async.sweepSatoshi = 0;
+        async.aszTxIDs = &async.szTxID;
+        async.countTxIDs = 1;
         fCallback(&async);
     }
 
     return Status();
 }
 
+Status
+onReceiveFinish(Wallet &wallet, const TxInfo &info)
+{
+    ABC_CHECK(wallet.addresses.markOutputs(info));
+    return Status();
+}
+
 } // namespace abcd
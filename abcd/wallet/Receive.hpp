@@ -17,11 +17,23 @@ class Wallet;
 
 /**
  * Updates the wallet when a new transaction comes in from the network.
+ * This only does what the GUI needs to show the payment,
+ * plus taking the paid addresses out of the recycling pool in memory,
+ * so the callback goes out as soon as possible.
+ * The caller should follow up with `onReceiveFinish`.
  */
 Status
 onReceive(Wallet &wallet, const TxInfo &info,
           tABC_BitCoin_Event_Callback fCallback, void *pData);
 
+/**
+ * Writes out the used flags `onReceive` set on the output addresses,
+ * which can mean deriving and saving replacement addresses.
+ * Nothing the GUI shows depends on this, so it can run later.
+ */
+Status
+onReceiveFinish(Wallet &wallet, const TxInfo &info);
+
 } // namespace abcd
 
 #endif
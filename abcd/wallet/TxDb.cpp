@@ -9,9 +9,9 @@
 #include "Wallet.hpp"
 #include "../crypto/Crypto.hpp"
 #include "../json/JsonObject.hpp"
+#include "../json/JsonPack.hpp"
 #include "../util/Debug.hpp"
 #include "../util/FileIO.hpp"
-#include <dirent.h>
 
 namespace abcd {
 
@@ -106,6 +106,10 @@ TxJson::unpack(TxMeta &result)
     return Status();
 }
 
+TxDb::~TxDb()
+{
+}
+
 TxDb::TxDb(const Wallet &wallet):
     wallet_(wallet),
     dir_(wallet.paths.txsDir())
@@ -115,49 +119,91 @@ TxDb::TxDb(const Wallet &wallet):
 Status
 TxDb::load()
 {
+    // Read the files before taking the lock:
+    JsonPack pack(wallet_.paths.txPackPath(), wallet_.dataKey());
+    pack.load();
+    auto files = pack.loadDir(dir_);
+    pack.save().log();
+
     std::lock_guard<std::mutex> lock(mutex_);
 
+    for (const auto &i: txs_)
+        changes_.touch(i.first);
     txs_.clear();
-    files_.clear();
+    search_.clear();
+    feeWanted_ = 0;
+    feeSent_ = 0;
+    feeSentTimes_.clear();
 
-    // Open the directory:
-    DIR *dir = opendir(dir_.c_str());
-    if (dir)
+    for (const auto &file: files)
     {
-        struct dirent *de;
-        while (nullptr != (de = readdir(dir)))
+        // Try to load the transaction:
+        TxMeta tx;
+        TxJson json(file.second);
+        if (json.unpack(tx).log())
         {
-            if (!fileIsJson(de->d_name))
-                continue;
-
-            // Try to load the address:
-            TxMeta tx;
-            TxJson json;
-            if (json.load(dir_ + de->d_name, wallet_.dataKey()).log() &&
-                    json.unpack(tx).log())
+            if (path(tx) != dir_ + file.first)
+                ABC_DebugLog("Filename %s does not match transaction",
+                             file.first.c_str());
+
+            // Delete duplicate transactions, if any:
+            auto i = txs_.find(tx.ntxid);
+            if (i != txs_.end())
             {
-                if (path(tx) != dir_ + de->d_name)
-                    ABC_DebugLog("Filename %s does not match transaction", de->d_name);
-
-                // Delete duplicate transactions, if any:
-                auto i = txs_.find(tx.ntxid);
-                if (i != txs_.end())
-                {
-                    if (tx.internal)
-                        fileDelete(path(i->second)).log();
-                    else
-                        fileDelete(dir_ + de->d_name).log();
-                }
-
-                // Save this transaction if is unique or internal:
-                if (i == txs_.end() || tx.internal)
-                {
-                    txs_[tx.ntxid] = tx;
-                    files_[tx.ntxid] = json;
-                }
+                if (tx.internal)
+                    fileDelete(path(i->second)).log();
+                else
+                    fileDelete(dir_ + file.first).log();
+            }
+
+            // Save this transaction if is unique or internal:
+            if (i == txs_.end() || tx.internal)
+            {
+                txInsert(tx);
+                changes_.touch(tx.ntxid);
+                searchInsert(tx, json.metadata().balance());
             }
         }
-        closedir(dir);
+    }
+
+    return Status();
+}
+
+Status
+TxDb::reload(const std::vector<std::string> &paths)
+{
+    // Read the files before taking the lock:
+    std::vector<JsonPtr> files;
+    for (const auto &path: paths)
+    {
+        if (path.compare(0, dir_.size(), dir_) ||
+                !fileIsJson(path.substr(dir_.size())))
+            continue;
+        if (!fileExists(path))
+            return load();
+
+        JsonPtr json;
+        if (json.load(path, wallet_.dataKey()).log())
+            files.push_back(json);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &file: files)
+    {
+        TxMeta tx;
+        TxJson json(file);
+        if (!json.unpack(tx).log())
+            continue;
+
+        // An internal copy always beats an external one, as in `load`:
+        auto i = txs_.find(tx.ntxid);
+        if (i == txs_.end() || tx.internal || !i->second.internal)
+        {
+            txInsert(tx);
+            changes_.touch(tx.ntxid);
+            searchInsert(tx, json.metadata().balance());
+        }
     }
 
     return Status();
@@ -168,15 +214,22 @@ TxDb::save(const TxMeta &tx, int64_t balance, int64_t fee)
 {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    txs_[tx.ntxid] = tx;
+    txInsert(tx);
+    changes_.touch(tx.ntxid);
+    searchInsert(tx, balance);
 
     ABC_CHECK(fileEnsureDir(dir_));
-    TxJson json(files_[tx.ntxid]);
+    const auto filename = path(tx);
+    // Start from the file on disk, so fields we don't know about survive.
+    // Only the item being edited gets read, so nothing stays resident:
+    JsonPtr file;
+    if (fileExists(filename))
+        file.load(filename, wallet_.dataKey()).log();
+    TxJson json(file);
     if (!json)
         json = JsonObject();
     ABC_CHECK(json.pack(tx, balance, fee));
-    ABC_CHECK(json.save(path(tx), wallet_.dataKey()));
-    files_[tx.ntxid] = json;
+    ABC_CHECK(json.saveQueued(filename, wallet_.dataKey()));
 
     return Status();
 }
@@ -194,46 +247,109 @@ TxDb::get(TxMeta &result, const std::string &ntxid)
     return Status();
 }
 
+bool
+TxDb::has(const std::string &ntxid) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return txs_.count(ntxid);
+}
+
 int64_t
 TxDb::airbitzFeePending()
 {
     std::lock_guard<std::mutex> lock(mutex_);
-
-    int64_t totalWanted = 0;
-    int64_t totalSent = 0;
-    for (const auto &i: txs_)
-    {
-        totalWanted += i.second.airbitzFeeWanted;
-        totalSent += i.second.airbitzFeeSent;
-    }
-
-    return totalWanted - totalSent;
+    return feeWanted_ - feeSent_;
 }
 
 time_t
 TxDb::airbitzFeeLastSent()
 {
     std::lock_guard<std::mutex> lock(mutex_);
-    time_t out = 0;
+    return feeSentTimes_.empty() ? 0 : *feeSentTimes_.rbegin();
+}
 
-    for (const auto &i: txs_)
-        if (i.second.airbitzFeeSent && out < i.second.timeCreation)
-            out = i.second.timeCreation;
+std::set<std::string>
+TxDb::search(const std::string &query) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return search_.search(query);
+}
+
+size_t
+TxDb::memoryUsed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
 
+    size_t out = 0;
+    for (const auto &tx: txs_)
+        out += sizeof(tx) + tx.first.capacity() + tx.second.txid.capacity() +
+               tx.second.metadata.name.capacity() +
+               tx.second.metadata.category.capacity() +
+               tx.second.metadata.notes.capacity();
     return out;
 }
 
+void
+TxDb::txInsert(const TxMeta &tx)
+{
+    auto &slot = txs_[tx.ntxid];
+
+    // Back out the old copy's fees, if any, then add the new ones:
+    feeWanted_ -= slot.airbitzFeeWanted;
+    feeSent_ -= slot.airbitzFeeSent;
+    if (slot.airbitzFeeSent)
+        feeSentTimes_.erase(feeSentTimes_.find(slot.timeCreation));
+
+    slot = tx;
+    feeWanted_ += tx.airbitzFeeWanted;
+    feeSent_ += tx.airbitzFeeSent;
+    if (tx.airbitzFeeSent)
+        feeSentTimes_.insert(tx.timeCreation);
+}
+
+void
+TxDb::searchInsert(const TxMeta &tx, int64_t balance)
+{
+    // The same fields the wallet search box has always matched:
+    search_.insert(tx.ntxid,
+    {
+        std::to_string(balance),
+        std::to_string(tx.metadata.amountCurrency),
+        tx.metadata.name,
+        tx.metadata.category,
+        tx.metadata.notes
+    });
+}
+
 std::string
 TxDb::path(const TxMeta &tx)
 {
-    return dir_ + cryptoFilename(wallet_.dataKey(), tx.ntxid) +
+    if (!filenameKey_)
+        filenameKey_.reset(new HmacKey(wallet_.dataKey()));
+    return dir_ + filenameKey_->filename(tx.ntxid) +
            (tx.internal ? "-int.json" : "-ext.json");
 }
 
-std::map<std::string,TxMeta>
-TxDb::getTxs()
+void
+TxDb::visit(const std::function<void (const TxMeta &tx)> &f) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto &i: txs_)
+        f(i.second);
+}
+
+uint64_t
+TxDb::revision() const
 {
-    return txs_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return changes_.revision();
+}
+
+std::set<std::string>
+TxDb::changedSince(uint64_t revision) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return changes_.since(revision);
 }
 
 }
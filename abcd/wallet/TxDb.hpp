@@ -8,15 +8,20 @@
 #ifndef ABCD_WALLET_TX_DB_HPP
 #define ABCD_WALLET_TX_DB_HPP
 
-#include "../json/JsonPtr.hpp"
+#include "../util/ChangeLog.hpp"
+#include "../util/SearchIndex.hpp"
 #include "../util/Status.hpp"
 #include "Metadata.hpp"
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <vector>
 
 namespace abcd {
 
+class HmacKey;
 class Wallet;
 
 struct TxMeta
@@ -36,6 +41,7 @@ struct TxMeta
 class TxDb
 {
 public:
+    ~TxDb();
     TxDb(const Wallet &wallet);
 
     /**
@@ -44,6 +50,14 @@ public:
     Status
     load();
 
+    /**
+     * Re-reads just the given files after a sync,
+     * ignoring any paths outside the transaction directory.
+     * Falls back on a full `load` if any of the files have gone away.
+     */
+    Status
+    reload(const std::vector<std::string> &paths);
+
     /**
      * Updates a particular transaction in the database.
      * Can also be used to insert new transactions into the database.
@@ -57,6 +71,13 @@ public:
     Status
     get(TxMeta &result, const std::string &ntxid);
 
+    /**
+     * Returns true if the transaction has a metadata record,
+     * without copying it out.
+     */
+    bool
+    has(const std::string &ntxid) const;
+
     /**
      * Determine how many satoshis of unpaid Airbitz fees are in the wallet.
      */
@@ -70,10 +91,41 @@ public:
     airbitzFeeLastSent();
 
     /**
-     * Get all known txs
+     * Calls a function on each transaction, in ntxid order,
+     * without copying anything out of the database.
+     * The database stays locked throughout, so the visitor sees
+     * a consistent view, but must not call back into the database.
+     * Pair this with `revision` to skip the walk when nothing has changed.
      */
-    std::map<std::string, TxMeta>
-    getTxs();
+    void
+    visit(const std::function<void (const TxMeta &tx)> &f) const;
+
+    /**
+     * Returns the current change revision.
+     * Grab this before calling `changedSince`.
+     */
+    uint64_t
+    revision() const;
+
+    /**
+     * Lists the ntxids whose metadata has changed after the given revision.
+     */
+    std::set<std::string>
+    changedSince(uint64_t revision) const;
+
+    /**
+     * Finds the transactions whose amounts, name, category, or notes
+     * contain the query text, ignoring case.
+     * @return A set of ntxids.
+     */
+    std::set<std::string>
+    search(const std::string &query) const;
+
+    /**
+     * Roughly how much heap the database is holding, in bytes.
+     */
+    size_t
+    memoryUsed() const;
 
 private:
     mutable std::mutex mutex_;
@@ -81,10 +133,31 @@ private:
     const std::string dir_;
 
     std::map<std::string, TxMeta> txs_;
-    std::map<std::string, JsonPtr> files_;
+
+    // Running fee totals over `txs_`:
+    int64_t feeWanted_ = 0;
+    int64_t feeSent_ = 0;
+    std::multiset<time_t> feeSentTimes_; // Creation times of fee payments
+    ChangeLog changes_;
+    SearchIndex search_;
+
+    // The file name key, set up on first use:
+    std::unique_ptr<HmacKey> filenameKey_;
 
     std::string
     path(const TxMeta &tx);
+
+    /**
+     * Adds or replaces a transaction, keeping the fee totals current.
+     */
+    void
+    txInsert(const TxMeta &tx);
+
+    /**
+     * Updates the search index with a transaction's metadata.
+     */
+    void
+    searchInsert(const TxMeta &tx, int64_t balance);
 };
 
 } // namespace abcd
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "TxIndex.hpp"
+#include "TxDb.hpp"
+#include "Wallet.hpp"
+#include "../bitcoin/cache/Cache.hpp"
+#include <algorithm>
+
+namespace abcd {
+
+TxIndex::TxIndex(Wallet &wallet):
+    wallet_(wallet)
+{
+}
+
+TxIndexPage
+TxIndex::page(size_t offset, size_t limit, uint64_t since)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    update();
+
+    TxIndexPage out;
+    out.revision = changes_.revision();
+    if (!limit)
+        limit = items_.size();
+
+    // The full history comes straight out of the sorted index:
+    if (!since)
+    {
+        auto i = order_.begin();
+        for (size_t n = 0; n < offset && order_.end() != i; ++n)
+            ++i;
+        for (; order_.end() != i && out.items.size() < limit; ++i)
+            out.items.push_back(items_[i->second]);
+        return out;
+    }
+
+    // Otherwise, just sort the changes:
+    std::vector<std::pair<time_t, std::string>> changed;
+    for (const auto &id: changes_.since(since))
+    {
+        auto i = items_.find(id);
+        if (items_.end() != i)
+            changed.push_back(std::make_pair(i->second.time, id));
+        else
+            out.removed.push_back(id);
+    }
+    std::sort(changed.begin(), changed.end());
+
+    for (size_t n = offset; n < changed.size() && out.items.size() < limit; ++n)
+        out.items.push_back(items_[changed[n].second]);
+    return out;
+}
+
+std::vector<TxIndexItem>
+TxIndex::range(time_t start, time_t end)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    update();
+
+    std::vector<TxIndexItem> out;
+    auto i = order_.lower_bound(std::make_pair(start, std::string()));
+    auto last = order_.lower_bound(std::make_pair(end, std::string()));
+    for (; last != i; ++i)
+        out.push_back(items_[i->second]);
+    return out;
+}
+
+bool
+TxIndex::prefetch()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    update();
+
+    auto &cache = wallet_.cache;
+    for (const auto &txid: undated_)
+    {
+        TxStatus status;
+        if (cache.txs.status(status, txid) && status.height)
+            cache.blocks.headerNeededAdd(status.height);
+    }
+    return !undated_.empty();
+}
+
+void
+TxIndex::update()
+{
+    auto &cache = wallet_.cache;
+    TxidSet txids = undated_;
+    std::set<std::string> ntxids;
+
+    // Grab the revisions first, so we never miss a change:
+    const auto cacheRevision = cache.txs.revision();
+    const auto dbRevision = wallet_.txs.revision();
+
+    // Transactions joining or leaving the wallet:
+    const auto known = cache.addresses.txidsSnapshot();
+    if (known != known_)
+    {
+        static const TxidSet empty;
+        const auto &before = known_ ? *known_ : empty;
+        const auto &after = known ? *known : empty;
+        std::set_symmetric_difference(before.begin(), before.end(),
+                                      after.begin(), after.end(),
+                                      std::inserter(txids, txids.end()));
+        known_ = known;
+    }
+
+    // Transactions with new information or status:
+    for (const auto &txid: cache.txs.changedSince(cacheRevision_))
+        txids.insert(txid);
+    cacheRevision_ = cacheRevision;
+
+    // Transactions with new metadata:
+    for (const auto &ntxid: wallet_.txs.changedSince(dbRevision_))
+    {
+        ntxids.insert(ntxid);
+        auto i = ntxids_.find(ntxid);
+        if (ntxids_.end() != i)
+            txids.insert(i->second.begin(), i->second.end());
+    }
+    dbRevision_ = dbRevision;
+
+    for (const auto &txid: txids)
+        updateCached(txid, ntxids);
+    for (const auto &ntxid: ntxids)
+        updateMetaOnly(ntxid);
+}
+
+void
+TxIndex::updateCached(const std::string &txid, std::set<std::string> &ntxids)
+{
+    auto &cache = wallet_.cache;
+    undated_.erase(txid);
+
+    // Forget about the old ntxid, since the new one might differ:
+    auto old = items_.find(txid);
+    if (items_.end() != old && old->second.cached)
+    {
+        const auto &ntxid = old->second.ntxid;
+        ntxids.insert(ntxid);
+        auto i = ntxids_.find(ntxid);
+        if (ntxids_.end() != i)
+        {
+            i->second.erase(txid);
+            if (i->second.empty())
+                ntxids_.erase(i);
+        }
+    }
+
+    TxInfo info;
+    TxStatus status;
+    if (!known_ || !known_->count(txid) ||
+            !cache.txs.info(info, txid) || !cache.txs.status(status, txid))
+    {
+        if (items_.end() != old && old->second.cached)
+            itemErase(txid);
+        return;
+    }
+
+    // Best-effort timestamp, matching `makeTxInfo`.
+    // Unconfirmed transactions keep the time we first saw them:
+    time_t timestamp = time(nullptr);
+    if (items_.end() != old && old->second.cached && !status.height)
+        timestamp = old->second.time;
+    if (status.height && !cache.blocks.headerTime(timestamp, status.height))
+        undated_.insert(txid);
+
+    TxMeta meta;
+    if (wallet_.txs.get(meta, info.ntxid))
+        timestamp = std::min(timestamp, meta.timeCreation);
+
+    TxIndexItem item;
+    item.id = txid;
+    item.ntxid = info.ntxid;
+    item.time = timestamp;
+    item.cached = true;
+    itemSet(item);
+
+    ntxids_[info.ntxid].insert(txid);
+    ntxids.insert(info.ntxid);
+}
+
+void
+TxIndex::updateMetaOnly(const std::string &ntxid)
+{
+    auto old = metaOnly_.find(ntxid);
+    if (metaOnly_.end() != old)
+    {
+        itemErase(old->second);
+        metaOnly_.erase(old);
+    }
+
+    // Transactions only show up once, preferring the cached version:
+    if (ntxids_.count(ntxid))
+        return;
+
+    TxMeta meta;
+    if (!wallet_.txs.get(meta, ntxid))
+        return;
+
+    TxIndexItem item;
+    item.id = meta.txid.empty() ? ntxid : meta.txid;
+    item.ntxid = ntxid;
+    item.time = meta.timeCreation;
+    item.cached = false;
+    itemSet(item);
+    metaOnly_[ntxid] = item.id;
+}
+
+void
+TxIndex::itemSet(const TxIndexItem &item)
+{
+    auto i = items_.find(item.id);
+    if (items_.end() != i)
+        order_.erase(std::make_pair(i->second.time, item.id));
+
+    items_[item.id] = item;
+    order_.insert(std::make_pair(item.time, item.id));
+    changes_.touch(item.id);
+}
+
+void
+TxIndex::itemErase(const std::string &id)
+{
+    auto i = items_.find(id);
+    if (items_.end() == i)
+        return;
+
+    order_.erase(std::make_pair(i->second.time, id));
+    items_.erase(i);
+    changes_.touch(id);
+}
+
+} // namespace abcd
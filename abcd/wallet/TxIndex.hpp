@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A time-sorted index of a wallet's transactions, for paging through history.
+ */
+
+#ifndef ABCD_WALLET_TX_INDEX_HPP
+#define ABCD_WALLET_TX_INDEX_HPP
+
+#include "../bitcoin/Typedefs.hpp"
+#include "../util/ChangeLog.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace abcd {
+
+class Wallet;
+
+/**
+ * One row of the wallet's transaction history.
+ */
+struct TxIndexItem
+{
+    std::string id; // The txid, or the ntxid if the txid is not known
+    std::string ntxid;
+    time_t time;
+    bool cached; // False if only the metadata is available
+};
+
+/**
+ * A page of transaction history, along with the changes needed to
+ * bring an older copy of the history up to date.
+ */
+struct TxIndexPage
+{
+    uint64_t revision; // Pass this as `since` to get the next changes.
+    std::vector<TxIndexItem> items;
+    std::vector<std::string> removed; // Ids that have left the history
+};
+
+/**
+ * Keeps the wallet's transactions sorted by time.
+ * This follows the change revisions in the transaction cache and
+ * metadata database, so refreshing the history only touches the
+ * transactions that have actually changed.
+ */
+class TxIndex
+{
+public:
+    TxIndex(Wallet &wallet);
+
+    /**
+     * Returns the transactions that have changed
+     * after the `since` revision, sorted by time.
+     * Passing 0 for `since` returns the entire history.
+     * @param offset The number of matching items to skip.
+     * @param limit The maximum number of items to return, or 0 for all.
+     */
+    TxIndexPage
+    page(size_t offset, size_t limit, uint64_t since=0);
+
+    /**
+     * Returns the transactions falling in the given time range,
+     * sorted by time.
+     */
+    std::vector<TxIndexItem>
+    range(time_t start, time_t end);
+
+    /**
+     * Brings the index up to date ahead of time,
+     * so the next history request finds everything ready,
+     * and asks the block cache for any headers the index is still missing.
+     * @return true if some headers were requested.
+     */
+    bool
+    prefetch();
+
+private:
+    mutable std::mutex mutex_;
+    Wallet &wallet_;
+
+    std::map<std::string, TxIndexItem> items_;
+    std::set<std::pair<time_t, std::string>> order_;
+    std::map<std::string, TxidSet> ntxids_; // ntxid to cached txids
+    std::map<std::string, std::string> metaOnly_; // ntxid to metadata id
+    TxidSet undated_; // Confirmed txids without a block header yet
+    ChangeLog changes_;
+
+    // Source revisions we have caught up to:
+    std::shared_ptr<const TxidSet> known_;
+    uint64_t cacheRevision_ = 0;
+    uint64_t dbRevision_ = 0;
+
+    /**
+     * Pulls in any changes from the wallet.
+     * Should be called with the mutex held.
+     */
+    void
+    update();
+
+    /**
+     * Refreshes the row for a cached transaction,
+     * removing it if it no longer belongs to the wallet.
+     * @param ntxids Receives the ntxids whose metadata rows need checking.
+     */
+    void
+    updateCached(const std::string &txid, std::set<std::string> &ntxids);
+
+    /**
+     * Adds or removes the metadata-only row for a transaction,
+     * depending on whether the transaction is in the cache.
+     */
+    void
+    updateMetaOnly(const std::string &ntxid);
+
+    void
+    itemSet(const TxIndexItem &item);
+
+    void
+    itemErase(const std::string &id);
+};
+
+} // namespace abcd
+
+#endif
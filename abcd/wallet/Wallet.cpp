@@ -8,27 +8,43 @@
 #include "Wallet.hpp"
 #include "../Context.hpp"
 #include "../account/Account.hpp"
+#include "../account/AccountSummary.hpp"
 #include "../bitcoin/cache/Cache.hpp"
 #include "../crypto/Encoding.hpp"
 #include "../crypto/Random.hpp"
+#include "../json/JsonBox.hpp"
 #include "../json/JsonObject.hpp"
 #include "../login/Login.hpp"
 #include "../login/server/LoginServer.hpp"
 #include "../util/FileIO.hpp"
 #include "../util/Sync.hpp"
+#include "../util/TaskPool.hpp"
 #include "../account/AccountSettings.hpp"
 #include "../util/AutoFree.hpp"
+#include "../util/Debug.hpp"
 #include <assert.h>
 #include <sstream>
+#include <thread>
 
 namespace abcd {
 
 struct WalletJson:
     public JsonObject
 {
-    ABC_JSON_STRING(bitcoinKey, "BitcoinSeed", nullptr)
-    ABC_JSON_STRING(dataKey,    "MK",          nullptr)
-    ABC_JSON_STRING(syncKey,    "SyncKey",     nullptr)
+    ABC_JSON_STRING(bitcoinKey,  "BitcoinSeed", nullptr)
+    ABC_JSON_STRING(dataKey,     "MK",          nullptr)
+    ABC_JSON_STRING(syncKey,     "SyncKey",     nullptr)
+    ABC_JSON_STRING(bitcoinXPub, "BitcoinXPub", nullptr) // Watch-only
+};
+
+// Snapshots are big, and every one stays in the repo history:
+constexpr time_t snapshotPeriod = 7 * 24 * 60 * 60;
+
+struct TxSnapshotJson:
+    public JsonObject
+{
+    ABC_JSON_INTEGER(time, "time", 0)
+    ABC_JSON_VALUE(box, "txs", JsonBox)
 };
 
 struct CurrencyJson:
@@ -69,8 +85,7 @@ overrideServers(Account &account, std::shared_ptr<Wallet> &wallet)
     bool bOverrideBitcoinServers = false;
     std::vector<std::string> serversVector;
 
-    AutoFree<tABC_AccountSettings, accountSettingsFree> settings;
-    settings.get() = accountSettingsLoad(account);
+    const auto settings = accountSettingsShared(account);
 
     if (settings->bOverrideBitcoinServers
             && settings->szOverrideBitcoinServerList != NULL)
@@ -85,17 +100,64 @@ overrideServers(Account &account, std::shared_ptr<Wallet> &wallet)
 
 }
 
+/**
+ * Clones the sync repos for every wallet in the account
+ * that is not on this device yet, several at once.
+ * On a new device, this makes the first wallet load pay for
+ * one round of parallel clones, rather than one clone per wallet load.
+ */
+static Status
+walletsBootstrap(Account &account)
+{
+    std::vector<std::function<Status ()>> jobs;
+    for (const auto &id: account.wallets.list())
+    {
+        const WalletPaths paths(gContext->paths.walletDir(id));
+        if (fileExists(paths.syncDir()))
+            continue;
+
+        WalletJson json;
+        if (!account.wallets.json(json, id) || !json.syncKeyOk())
+            continue;
+        const std::string syncKey = json.syncKey();
+
+        jobs.push_back([paths, syncKey]()
+        {
+            ABC_CHECK(fileEnsureDir(gContext->paths.walletsDir()));
+            ABC_CHECK(fileEnsureDir(paths.dir()));
+            ABC_CHECK(syncEnsureRepo(paths.syncDir(), paths.dir() + "tmp/",
+                                     syncKey));
+            return Status();
+        });
+    }
+    if (jobs.empty())
+        return Status();
+
+    ABC_DebugLog("Bootstrapping %d wallet repos", jobs.size());
+    std::vector<Status> results;
+    syncAll(results, jobs);
+    for (const auto &result: results)
+        result.log(); // Each wallet retries on its own load
+
+    return Status();
+}
+
 Status
 Wallet::create(std::shared_ptr<Wallet> &result, Account &account,
                const std::string &id)
 {
     std::shared_ptr<Wallet> out(new Wallet(account, id));
+    if (!fileExists(out->paths.syncDir()))
+        walletsBootstrap(account).log();
     ABC_CHECK(out->loadKeys());
     ABC_CHECK(out->loadSync());
 
-    // Load the transaction cache (failure is fine):
-    if (!out->cache.load().log())
-        out->cache.loadLegacy(out->paths.cachePathOld());
+    // Load the transaction cache (failure is fine),
+    // falling back on another device's snapshot:
+    if (!out->cache.load().log() &&
+            !out->cache.loadLegacy(out->paths.cachePathOld()) &&
+            fileExists(out->paths.txSnapshotPath()))
+        out->snapshotLoad().log();
 
     result = std::move(out);
 
@@ -122,7 +184,26 @@ Wallet::createNew(std::shared_ptr<Wallet> &result, Account &account,
     return Status();
 }
 
-const DataChunk &
+Status
+Wallet::createWatchOnly(std::shared_ptr<Wallet> &result, Account &account,
+                        const std::string &name, int currency,
+                        const std::string &xpub)
+{
+    std::string id;
+    ABC_CHECK(randomUuid(id));
+    std::shared_ptr<Wallet> out(new Wallet(account, id));
+    ABC_CHECK(out->createWatchOnly(name, currency, xpub));
+
+    // Load the transaction cache (failure is fine):
+    out->cache.load().log();
+
+    result = std::move(out);
+
+    overrideServers(account, result);
+    return Status();
+}
+
+DataSlice
 Wallet::bitcoinKey() const
 {
     // We do not want memory corruption here.
@@ -183,41 +264,28 @@ Wallet::nameSet(const std::string &name)
 Status
 Wallet::balance(int64_t &result)
 {
-    // We cannot put a mutex in `balanceDirty()`, since that will deadlock
-    // the transaction database during the balance calculation.
-    // Instead, we access `balanceDirty_` atomically outside the mutex:
-    bool dirty = balanceDirty_;
-    balanceDirty_ = false;
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (dirty)
-    {
-        const auto utxos = cache.txs.utxos(addresses.list());
-
-        balance_ = 0;
-        for (const auto &utxo: utxos)
-            balance_ += utxo.value;
-    }
-
-    result = balance_;
+    // The transaction cache keeps this up to date:
+    result = cache.txs.balance().total();
     return Status();
 }
 
-void
-Wallet::balanceDirty()
-{
-    balanceDirty_ = true;
-}
-
 Status
 Wallet::sync(bool &dirty)
 {
-    ABC_CHECK(syncRepo(paths.syncDir(), syncKey_, dirty));
+    // Watch-only wallets have no repo:
+    dirty = false;
+    if (watchOnly())
+        return Status();
+
+    snapshotPublish().log();
+    std::vector<std::string> changes;
+    ABC_CHECK(syncRepo(paths.syncDir(), syncKey_, dirty, changes));
     if (dirty)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        ABC_CHECK(loadSync());
+        ABC_CHECK(reloadSync(changes));
     }
+    accountSummaryUpdate(*this).log();
 
     return Status();
 }
@@ -227,47 +295,107 @@ Wallet::Wallet(Account &account, const std::string &id):
     paths(gContext->paths.walletDir(id)),
     parent_(account.shared_from_this()),
     id_(id),
-    balanceDirty_(true),
     addresses(*this),
     txs(*this),
-    cache(*new Cache(paths.cachePath(), gContext->blockCache,
-                     gContext->serverCache))
+    cache(*new Cache(paths.cachePath(), paths.txCachePath(),
+                     gContext->blockCache, gContext->serverCache)),
+    txIndex(*this)
 {}
 
 Status
 Wallet::createNew(const std::string &name, int currency)
 {
     // Set up the keys:
-    ABC_CHECK(randomData(bitcoinKey_, BITCOIN_SEED_LENGTH));
+    DataChunk key;
+    ABC_CHECK(randomData(key, BITCOIN_SEED_LENGTH));
+    secureAssign(bitcoinKey_, key);
     bitcoinKeyBackup_ = bitcoinKey_;
-    ABC_CHECK(randomData(dataKey_, DATA_KEY_LENGTH));
+    ABC_CHECK(randomData(key, DATA_KEY_LENGTH));
+    secureAssign(dataKey_, key);
     DataChunk syncKey;
     ABC_CHECK(randomData(syncKey, SYNC_KEY_LENGTH));
     syncKey_ = base16Encode(syncKey);
 
-    // Create the sync directory:
+    // Ask the server for a repo while we fill in the local one:
+    Status created;
+    std::thread create([this, &created]()
+    {
+        created = loginServerWalletCreate(account.login, syncKey_);
+    });
+    auto prepare = [this, &name, currency]() -> Status
+    {
+        // Create the sync directory:
+        ABC_CHECK(fileEnsureDir(gContext->paths.walletsDir()));
+        ABC_CHECK(fileEnsureDir(paths.dir()));
+        ABC_CHECK(syncMakeRepo(paths.syncDir()));
+
+        // Populate the sync directory:
+        ABC_CHECK(currencySet(currency));
+        ABC_CHECK(nameSet(name));
+        ABC_CHECK(addresses.load());
+        return Status();
+    };
+    const Status prepared = prepare();
+    create.join();
+    ABC_CHECK(prepared);
+    ABC_CHECK(created);
+
+    // Push the wallet to the server, activating it at the same time:
+    Status activated;
+    std::thread activate([this, &activated]()
+    {
+        activated = loginServerWalletActivate(account.login, syncKey_);
+    });
+    bool dirty = false;
+    const Status pushed = syncRepo(paths.syncDir(), syncKey_, dirty);
+    activate.join();
+    ABC_CHECK(pushed);
+    ABC_CHECK(activated);
+
+    // If everything worked, add the wallet to the account:
+    WalletJson json;
+    ABC_CHECK(json.bitcoinKeySet(base16Encode(bitcoinKey_)));
+    ABC_CHECK(json.dataKeySet(base16Encode(dataKey_)));
+    ABC_CHECK(json.syncKeySet(syncKey_));
+    ABC_CHECK(account.wallets.insert(id_, json));
+
+    // The wallet is usable now, so back up the account in the background:
+    const auto parent = parent_;
+    taskPoolRun([parent]()
+    {
+        bool dirty = false;
+        parent->sync(dirty).log();
+    });
+
+    return Status();
+}
+
+Status
+Wallet::createWatchOnly(const std::string &name, int currency,
+                        const std::string &xpub)
+{
+    bc::hd_public_key m0;
+    if (!m0.set_encoded(xpub))
+        return ABC_ERROR(ABC_CC_ParseError, "Bad extended public key");
+    bitcoinXPub_ = xpub;
+    bitcoinXPubBackup_ = bitcoinXPub_;
+    DataChunk key;
+    ABC_CHECK(randomData(key, DATA_KEY_LENGTH));
+    secureAssign(dataKey_, key);
+
+    // Set up the data directory, which never syncs:
     ABC_CHECK(fileEnsureDir(gContext->paths.walletsDir()));
     ABC_CHECK(fileEnsureDir(paths.dir()));
-    ABC_CHECK(syncMakeRepo(paths.syncDir()));
-
-    // Populate the sync directory:
+    ABC_CHECK(fileEnsureDir(paths.syncDir()));
     ABC_CHECK(currencySet(currency));
     ABC_CHECK(nameSet(name));
     ABC_CHECK(addresses.load());
 
-    // Push the wallet to the server:
-    bool dirty = false;
-    ABC_CHECK(loginServerWalletCreate(account.login, syncKey_));
-    ABC_CHECK(syncRepo(paths.syncDir(), syncKey_, dirty));
-    ABC_CHECK(loginServerWalletActivate(account.login, syncKey_));
-
-    // If everything worked, add the wallet to the account:
+    // Add the wallet to the account, which does sync:
     WalletJson json;
-    ABC_CHECK(json.bitcoinKeySet(base16Encode(bitcoinKey_)));
+    ABC_CHECK(json.bitcoinXPubSet(bitcoinXPub_));
     ABC_CHECK(json.dataKeySet(base16Encode(dataKey_)));
-    ABC_CHECK(json.syncKeySet(syncKey_));
     ABC_CHECK(account.wallets.insert(id_, json));
-    ABC_CHECK(account.sync(dirty));
 
     return Status();
 }
@@ -277,16 +405,28 @@ Wallet::loadKeys()
 {
     WalletJson json;
     ABC_CHECK(account.wallets.json(json, id()));
-    ABC_CHECK(json.bitcoinKeyOk());
     ABC_CHECK(json.dataKeyOk());
+
+    DataChunk key;
+    ABC_CHECK(base16Decode(key, json.dataKey()));
+    secureAssign(dataKey_, key);
+
+    // Watch-only wallets just have the public key:
+    if (!json.bitcoinKeyOk())
+    {
+        ABC_CHECK(json.bitcoinXPubOk());
+        bitcoinXPub_ = json.bitcoinXPub();
+        bitcoinXPubBackup_ = bitcoinXPub_;
+        return Status();
+    }
     ABC_CHECK(json.syncKeyOk());
 
-    ABC_CHECK(base16Decode(bitcoinKey_, json.bitcoinKey()));
+    ABC_CHECK(base16Decode(key, json.bitcoinKey()));
+    const auto m0 = bc::hd_private_key(key).generate_public_key(0);
+    secureAssign(bitcoinKey_, key);
     bitcoinKeyBackup_ = bitcoinKey_;
-    ABC_CHECK(base16Decode(dataKey_, json.dataKey()));
     syncKey_ = json.syncKey();
 
-    const auto m0 = bc::hd_private_key(bitcoinKey_).generate_public_key(0);
     bitcoinXPub_ = m0.encoded();
     bitcoinXPubBackup_ = bitcoinXPub_;
 
@@ -298,8 +438,78 @@ Wallet::loadSync()
 {
     ABC_CHECK(fileEnsureDir(gContext->paths.walletsDir()));
     ABC_CHECK(fileEnsureDir(paths.dir()));
-    ABC_CHECK(syncEnsureRepo(paths.syncDir(), paths.dir() + "tmp/", syncKey_));
+    if (watchOnly())
+        ABC_CHECK(fileEnsureDir(paths.syncDir()));
+    else
+        ABC_CHECK(syncEnsureRepo(paths.syncDir(), paths.dir() + "tmp/",
+                                 syncKey_));
+    loadDetails();
+
+    // Load the databases:
+    ABC_CHECK(addresses.load());
+    ABC_CHECK(txs.load());
+
+    return Status();
+}
+
+Status
+Wallet::reloadSync(const std::vector<std::string> &changes)
+{
+    for (const auto &path: changes)
+    {
+        if (paths.currencyPath() == path || paths.namePath() == path)
+        {
+            loadDetails();
+            break;
+        }
+    }
+
+    // The databases skip any paths that are not theirs:
+    ABC_CHECK(addresses.reload(changes));
+    ABC_CHECK(txs.reload(changes));
+
+    return Status();
+}
 
+Status
+Wallet::snapshotLoad()
+{
+    TxSnapshotJson json;
+    ABC_CHECK(json.load(paths.txSnapshotPath()));
+    DataChunk data;
+    ABC_CHECK(json.box().decrypt(data, dataKey()));
+    ABC_CHECK(cache.txs.loadSnapshot(data));
+
+    ABC_DebugLog("Wallet %s: seeded cache from a %d-byte snapshot",
+                 id().c_str(), data.size());
+    return Status();
+}
+
+Status
+Wallet::snapshotPublish()
+{
+    // Only a finished address check makes for a complete snapshot:
+    if (!cache.addressCheckDoneGet())
+        return Status();
+
+    const auto now = time(nullptr);
+    TxSnapshotJson json;
+    if (json.load(paths.txSnapshotPath()) && now < json.time() + snapshotPeriod)
+        return Status();
+
+    JsonBox box;
+    ABC_CHECK(box.encrypt(cache.txs.snapshot(), dataKey()));
+    json = TxSnapshotJson();
+    ABC_CHECK(json.timeSet(now));
+    ABC_CHECK(json.boxSet(box));
+    ABC_CHECK(json.save(paths.txSnapshotPath()));
+
+    return Status();
+}
+
+void
+Wallet::loadDetails()
+{
     // Load the currency:
     CurrencyJson currencyJson;
     currencyJson.load(paths.currencyPath(), dataKey());
@@ -309,12 +519,6 @@ Wallet::loadSync()
     NameJson json;
     json.load(paths.namePath(), dataKey());
     name_ = json.name();
-
-    // Load the databases:
-    ABC_CHECK(addresses.load());
-    ABC_CHECK(txs.load());
-
-    return Status();
 }
 
 } // namespace abcd
@@ -10,10 +10,11 @@
 
 #include "../WalletPaths.hpp"
 #include "../util/Data.hpp"
+#include "../util/SecureData.hpp"
 #include "../util/Status.hpp"
 #include "AddressDb.hpp"
 #include "TxDb.hpp"
-#include <atomic>
+#include "TxIndex.hpp"
 #include <memory>
 #include <mutex>
 
@@ -42,17 +43,27 @@ public:
     createNew(std::shared_ptr<Wallet> &result, Account &account,
               const std::string &name, int currency);
 
+    /**
+     * Creates a watch-only wallet from the m/0 extended public key,
+     * as `bitcoinXPub` returns it.
+     * The wallet never holds private keys, so it cannot spend,
+     * and its data stays on this device rather than in a sync repo.
+     */
+    static Status
+    createWatchOnly(std::shared_ptr<Wallet> &result, Account &account,
+                    const std::string &name, int currency,
+                    const std::string &xpub);
+
     const std::string &id() const { return id_; }
-    const DataChunk &bitcoinKey() const;
-    const DataChunk &dataKey() const { return dataKey_; }
+    DataSlice bitcoinKey() const;
+    bool watchOnly() const { return bitcoinKey_.empty(); }
+    DataSlice dataKey() const { return dataKey_; }
 
     int currency() const;
     std::string name() const;
     Status nameSet(const std::string &name);
 
-    // Balance cache:
     Status balance(int64_t &result);
-    void balanceDirty();
 
     // Override Servers
     bool bOverrideBitcoinServers;
@@ -77,11 +88,11 @@ private:
     const std::string id_;
 
     // Account data:
-    DataChunk bitcoinKey_;
-    DataChunk bitcoinKeyBackup_;
+    SecureChunk bitcoinKey_;
+    SecureChunk bitcoinKeyBackup_;
     std::string bitcoinXPub_;
     std::string bitcoinXPubBackup_;
-    DataChunk dataKey_;
+    SecureChunk dataKey_;
     std::string syncKey_;
 
     // Sync dir data:
@@ -89,15 +100,15 @@ private:
     std::string name_;
     Status currencySet(int currency);
 
-    // Balance cache:
-    int64_t balance_;
-    std::atomic<bool> balanceDirty_;
-
     Wallet(Account &account, const std::string &id);
 
     Status
     createNew(const std::string &name, int currency);
 
+    Status
+    createWatchOnly(const std::string &name, int currency,
+                    const std::string &xpub);
+
     Status
     loadKeys();
 
@@ -107,11 +118,38 @@ private:
     Status
     loadSync();
 
+    /**
+     * Reloads only the synced data living at the given paths.
+     */
+    Status
+    reloadSync(const std::vector<std::string> &changes);
+
+    /**
+     * Loads the wallet currency and name.
+     */
+    void
+    loadDetails();
+
+    /**
+     * Seeds an empty transaction cache from the snapshot
+     * another device left in the sync directory.
+     */
+    Status
+    snapshotLoad();
+
+    /**
+     * Leaves a fresh transaction cache snapshot in the sync directory,
+     * if the last one is old enough, for the next sync to push.
+     */
+    Status
+    snapshotPublish();
+
 public:
     AddressDb addresses;
     TxDb txs;
 
     Cache &cache;
+    TxIndex txIndex;
 };
 
 } // namespace abcd
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A tiny microbenchmark harness, in the style of google-benchmark.
+ *
+ * Each benchmark runs its timed loop with a growing iteration count
+ * until the loop takes long enough to measure. Setup done before the
+ * first call to `keepRunning` is not timed.
+ */
+
+#ifndef ABCD_BENCH_BENCH_HPP
+#define ABCD_BENCH_BENCH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+
+namespace abcd {
+
+class BenchState
+{
+public:
+    BenchState(size_t iterations, size_t arg):
+        arg_(arg),
+        left_(iterations),
+        iterations_(iterations)
+    {}
+
+    /**
+     * Returns true while the loop should keep going.
+     * The clock starts on the first call and stops on the last one.
+     */
+    bool
+    keepRunning()
+    {
+        if (!started_)
+        {
+            started_ = true;
+            start_ = std::chrono::steady_clock::now();
+        }
+        if (left_)
+        {
+            --left_;
+            return true;
+        }
+        if (!stopped_)
+        {
+            stopped_ = true;
+            elapsed_ = std::chrono::steady_clock::now() - start_;
+        }
+        return false;
+    }
+
+    /**
+     * The size parameter the benchmark was registered with.
+     */
+    size_t
+    arg() const { return arg_; }
+
+    size_t
+    iterations() const { return iterations_; }
+
+    /**
+     * Reports how much work each iteration does,
+     * so the results include a rate.
+     */
+    void
+    itemsSet(uint64_t perIteration) { items_ = perIteration; }
+
+    void
+    bytesSet(uint64_t perIteration) { bytes_ = perIteration; }
+
+    uint64_t
+    items() const { return items_; }
+
+    uint64_t
+    bytes() const { return bytes_; }
+
+    double
+    seconds() const { return elapsed_.count(); }
+
+private:
+    size_t arg_;
+    size_t left_;
+    size_t iterations_;
+    bool started_ = false;
+    bool stopped_ = false;
+    uint64_t items_ = 0;
+    uint64_t bytes_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::duration<double> elapsed_{0};
+};
+
+typedef std::function<void (BenchState &state)> BenchFunction;
+
+/**
+ * Adds a benchmark to the suite, once for each size argument.
+ * An empty argument list registers a single run with an argument of 0.
+ */
+bool
+benchRegister(const char *name, BenchFunction f,
+              std::initializer_list<size_t> args={});
+
+/**
+ * Stops the optimizer from throwing away a value the loop computed.
+ */
+template<typename T> void
+benchKeep(T &&value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Defines and registers a benchmark function.
+ * Any extra arguments become the list of sizes to run it at.
+ */
+#define ABC_BENCH(name, ...) \
+    static void name##Bench(abcd::BenchState &state); \
+    static const bool name##Registered = \
+        abcd::benchRegister(#name, name##Bench, {__VA_ARGS__}); \
+    static void name##Bench(abcd::BenchState &state)
+
+} // namespace abcd
+
+#endif
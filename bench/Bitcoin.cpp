@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/General.hpp"
+#include "../abcd/bitcoin/Text.hpp"
+#include "../abcd/bitcoin/cache/BlockCache.hpp"
+#include "../abcd/bitcoin/cache/TxCache.hpp"
+#include "../abcd/bitcoin/spend/Inputs.hpp"
+#include "../abcd/bitcoin/spend/Outputs.hpp"
+#include "../abcd/json/JsonReader.hpp"
+#include "../abcd/util/Parallel.hpp"
+#include <map>
+#include <memory>
+
+using namespace abcd;
+
+constexpr size_t benchAddresses = 16;
+
+/**
+ * A batch of made-up transactions paying to a handful of our addresses.
+ * Every fourth transaction spends from the one before it,
+ * so the spend graph has something to do.
+ */
+struct TxFixture
+{
+    AddressSet addresses;
+    TxidSet txids;
+    std::vector<bc::transaction_type> txs;
+
+    TxFixture(size_t size)
+    {
+        std::vector<bc::script_type> ours;
+        for (size_t i = 0; i < benchAddresses; ++i)
+        {
+            bc::ec_secret secret{{static_cast<uint8_t>(i + 1)}};
+            bc::payment_address address(bc::payment_address::pubkey_version,
+                                        bc::bitcoin_short_hash(
+                                            bc::secret_to_public_key(secret)));
+            addresses.insert(address.encoded());
+
+            bc::script_type script;
+            outputScriptForAddress(script, address.encoded());
+            ours.push_back(script);
+        }
+
+        bc::script_type other;
+        outputScriptForAddress(other, "1QLbz7JHiBTspS962RLKV8GndWFwi5j6Qr");
+
+        bc::hash_digest previous{};
+        txs.reserve(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            bc::hash_digest fake{};
+            for (size_t j = 0; j < sizeof(i); ++j)
+                fake[j] = static_cast<uint8_t>(i >> 8 * j);
+
+            bc::transaction_type tx
+            {
+                0, 0,
+                {
+                    {{i % 4 ? fake : previous, 0}, {}, 0xffffffff}
+                },
+                {
+                    {10000 + i, ours[i % benchAddresses]},
+                    {50000, other}
+                }
+            };
+            previous = bc::hash_transaction(tx);
+            txids.insert(bc::encode_hash(previous));
+            txs.push_back(tx);
+        }
+    }
+};
+
+/**
+ * Building the bigger fixtures takes a while,
+ * so keep them around between calibration runs.
+ */
+static const TxFixture &
+txFixture(size_t size)
+{
+    static std::map<size_t, std::unique_ptr<TxFixture>> fixtures;
+    auto &slot = fixtures[size];
+    if (!slot)
+        slot.reset(new TxFixture(size));
+    return *slot;
+}
+
+ABC_BENCH(txCacheInsert, 1000, 10000, 100000)
+{
+    const auto &fixture = txFixture(state.arg());
+    state.itemsSet(fixture.txs.size());
+
+    while (state.keepRunning())
+    {
+        BlockCache blockCache("", "");
+        TxCache txCache(blockCache);
+        for (const auto &tx: fixture.txs)
+            txCache.insert(tx);
+        txCache.balanceAddressesSet(fixture.addresses);
+        benchKeep(txCache);
+    }
+}
+
+ABC_BENCH(txCacheUtxos, 1000, 10000, 100000)
+{
+    const auto &fixture = txFixture(state.arg());
+    BlockCache blockCache("", "");
+    TxCache txCache(blockCache);
+    for (const auto &tx: fixture.txs)
+        txCache.insert(tx);
+
+    while (state.keepRunning())
+    {
+        auto utxos = txCache.utxos(fixture.addresses);
+        benchKeep(utxos);
+    }
+}
+
+ABC_BENCH(txCacheStatuses, 1000, 10000, 100000)
+{
+    const auto &fixture = txFixture(state.arg());
+    BlockCache blockCache("", "");
+    TxCache txCache(blockCache);
+    for (const auto &tx: fixture.txs)
+        txCache.insert(tx);
+    state.itemsSet(fixture.txids.size());
+
+    while (state.keepRunning())
+    {
+        auto statuses = txCache.statuses(fixture.txids);
+        benchKeep(statuses);
+    }
+}
+
+/**
+ * The key derivation that dominates `AddressDb::stockpile`,
+ * split across threads the same way.
+ */
+ABC_BENCH(addressDerive, 20, 200)
+{
+    const bc::hd_private_key root(DataChunk(32, 0x42));
+    const auto branch = root.generate_private_key(0);
+    state.itemsSet(state.arg());
+
+    std::vector<std::string> out(state.arg());
+    while (state.keepRunning())
+    {
+        parallelFor(out.size(), [&](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; ++i)
+                out[i] = branch.generate_private_key(i).address().encoded();
+        });
+        benchKeep(out);
+    }
+}
+
+/**
+ * Walks a `blockchain.address.get_history` reply
+ * the way the Stratum decoders do.
+ */
+ABC_BENCH(stratumParse, 10, 1000)
+{
+    std::string message = "{\"id\": 7, \"jsonrpc\": \"2.0\", \"result\": [";
+    for (size_t i = 0; i < state.arg(); ++i)
+    {
+        if (i)
+            message += ", ";
+        message += "{\"tx_hash\": \"" + std::string(64, 'a' + i % 6) +
+                   "\", \"height\": " + std::to_string(400000 + i) + "}";
+    }
+    message += "]}\n";
+    const DataSlice data(reinterpret_cast<const uint8_t *>(message.data()),
+                         reinterpret_cast<const uint8_t *>(message.data()) +
+                         message.size());
+    state.bytesSet(data.size());
+    state.itemsSet(state.arg());
+
+    std::string key, txid;
+    int64_t height;
+    while (state.keepRunning())
+    {
+        JsonReader reader(data);
+        reader.objectBegin();
+        while (reader.objectKey(key))
+        {
+            if ("result" != key)
+            {
+                reader.skip();
+                continue;
+            }
+            reader.arrayBegin();
+            while (reader.arrayItem())
+            {
+                reader.objectBegin();
+                while (reader.objectKey(key))
+                {
+                    if ("tx_hash" == key)
+                        reader.readString(txid);
+                    else if ("height" == key)
+                        reader.readInteger(height);
+                    else
+                        reader.skip();
+                }
+            }
+        }
+        benchKeep(txid);
+        benchKeep(height);
+    }
+}
+
+ABC_BENCH(inputsPickOptimal, 100, 1000)
+{
+    std::string address = "1QLbz7JHiBTspS962RLKV8GndWFwi5j6Qr";
+    bc::script_type script;
+    outputScriptForAddress(script, address);
+
+    bc::output_info_list utxos;
+    for (uint32_t i = 0; i < state.arg(); ++i)
+    {
+        bc::hash_digest hash{};
+        hash[0] = static_cast<uint8_t>(i);
+        hash[1] = static_cast<uint8_t>(i >> 8);
+        utxos.push_back(bc::output_info_type{{hash, i}, 5000 + 37 * i % 90000});
+    }
+
+    BitcoinFeeInfo feeInfo;
+    for (size_t i = 0; i < MAX_FEES_BLOCKS; ++i)
+        feeInfo.confirmFees[i] = 100000 - 5000 * i;
+    feeInfo.lowFeeBlock = 6;
+    feeInfo.standardFeeBlockLow = 3;
+    feeInfo.standardFeeBlockHigh = 2;
+    feeInfo.highFeeBlock = 1;
+    feeInfo.targetFeePercentage = 0.1;
+
+    bc::transaction_type tx;
+    tx.version = 1;
+    tx.locktime = 0;
+    tx.outputs.push_back(bc::transaction_output_type{200000, script});
+
+    uint64_t fee, change;
+    while (state.keepRunning())
+    {
+        inputsPickOptimal(fee, change, tx, utxos, feeInfo,
+                          ABC_SpendFeeLevelStandard, 0);
+        benchKeep(tx);
+    }
+}
+
+/**
+ * Feeds a mix of typical camera-frame decodes through `parseUri`,
+ * most of which are not bitcoin data at all.
+ */
+ABC_BENCH(parseScanned)
+{
+    const std::vector<std::string> frames =
+    {
+        "bitcoin:113Pfw4sFqN1T5kXUnKbqZHMJHN9oyjtgD?amount=0.1&label=Coffee",
+        "113Pfw4sFqN1T5kXUnKbqZHMJHN9oyjtgD",
+        "https://example.com/menu",
+        "Table 12, please",
+        "WIFI:S:guest;T:WPA;P:hunter22;;",
+        "4006381333931"
+    };
+    state.itemsSet(frames.size());
+
+    while (state.keepRunning())
+    {
+        for (const auto &frame: frames)
+        {
+            ParsedUri result;
+            benchKeep(parseUri(result, frame));
+        }
+    }
+}
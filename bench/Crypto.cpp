@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/crypto/Crypto.hpp"
+#include "../abcd/crypto/Encoding.hpp"
+#include "../abcd/crypto/Scrypt.hpp"
+
+using namespace abcd;
+
+static DataChunk
+benchData(size_t size)
+{
+    DataChunk out(size);
+    for (size_t i = 0; i < size; ++i)
+        out[i] = i * 2654435761u >> 24;
+    return out;
+}
+
+ABC_BENCH(scryptHash, 1024, 16384)
+{
+    const ScryptSnrp snrp{benchData(32), state.arg(), 8, 1};
+    const auto password = benchData(16);
+
+    DataChunk result;
+    while (state.keepRunning())
+    {
+        snrp.hash(result, password);
+        benchKeep(result);
+    }
+}
+
+ABC_BENCH(aesEncrypt, 256, 65536)
+{
+    const auto data = benchData(state.arg());
+    const auto key = benchData(32);
+    state.bytesSet(data.size());
+
+    DataChunk encrypted, iv;
+    tABC_Error error;
+    while (state.keepRunning())
+    {
+        ABC_CryptoEncryptAES256Package(data, key, encrypted, iv, &error);
+        benchKeep(encrypted);
+    }
+}
+
+ABC_BENCH(aesDecrypt, 256, 65536)
+{
+    const auto data = benchData(state.arg());
+    const auto key = benchData(32);
+    state.bytesSet(data.size());
+
+    DataChunk encrypted, iv, result;
+    tABC_Error error;
+    ABC_CryptoEncryptAES256Package(data, key, encrypted, iv, &error);
+    while (state.keepRunning())
+    {
+        ABC_CryptoDecryptAES256Package(result, encrypted, key, iv, &error);
+        benchKeep(result);
+    }
+}
+
+ABC_BENCH(base16, 1048576)
+{
+    const auto data = benchData(state.arg());
+    state.bytesSet(2 * data.size());
+
+    DataChunk result;
+    while (state.keepRunning())
+    {
+        base16Decode(result, base16Encode(data));
+        benchKeep(result);
+    }
+}
+
+ABC_BENCH(base58, 32, 1024)
+{
+    const auto data = benchData(state.arg());
+    state.bytesSet(2 * data.size());
+
+    DataChunk result;
+    while (state.keepRunning())
+    {
+        base58Decode(result, base58Encode(data));
+        benchKeep(result);
+    }
+}
+
+ABC_BENCH(base64, 1048576)
+{
+    const auto data = benchData(state.arg());
+    state.bytesSet(2 * data.size());
+
+    DataChunk result;
+    while (state.keepRunning())
+    {
+        base64Decode(result, base64Encode(data));
+        benchKeep(result);
+    }
+}
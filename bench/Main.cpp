@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/json/JsonArray.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include "../src/Version.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace abcd;
+
+struct BenchEntry
+{
+    std::string name;
+    BenchFunction f;
+    size_t arg;
+};
+
+/**
+ * Registration happens during static initialization,
+ * so the list has to be built on first use.
+ */
+static std::vector<BenchEntry> &
+benchList()
+{
+    static std::vector<BenchEntry> list;
+    return list;
+}
+
+bool
+abcd::benchRegister(const char *name, BenchFunction f,
+                    std::initializer_list<size_t> args)
+{
+    if (!args.size())
+        benchList().push_back(BenchEntry{name, f, 0});
+    for (auto arg: args)
+        benchList().push_back(
+            BenchEntry{std::string(name) + "/" + std::to_string(arg), f, arg});
+    return true;
+}
+
+/**
+ * Runs one benchmark with a growing iteration count,
+ * until a run lasts at least `minTime` seconds.
+ */
+static Status
+benchRun(JsonPtr &result, const BenchEntry &entry, double minTime)
+{
+    size_t iterations = 1;
+    while (true)
+    {
+        BenchState state(iterations, entry.arg);
+        entry.f(state);
+
+        if (minTime <= state.seconds() || 1000000000 <= iterations)
+        {
+            const double ns = 1e9 * state.seconds() / iterations;
+            fprintf(stderr, "%-36s %12zu %14.1f ns\n",
+                    entry.name.c_str(), iterations, ns);
+
+            JsonObject json;
+            ABC_CHECK(json.set("name", entry.name));
+            ABC_CHECK(json.set("iterations", json_int_t(iterations)));
+            ABC_CHECK(json.set("real_time", ns));
+            ABC_CHECK(json.set("time_unit", "ns"));
+            if (state.items() && state.seconds())
+                ABC_CHECK(json.set("items_per_second",
+                                   state.items() * iterations / state.seconds()));
+            if (state.bytes() && state.seconds())
+                ABC_CHECK(json.set("bytes_per_second",
+                                   state.bytes() * iterations / state.seconds()));
+            result = json;
+            return Status();
+        }
+
+        // Aim a bit past the target, without jumping more than 10x:
+        size_t next = 10 * iterations;
+        if (0 < state.seconds())
+            next = std::min(next, static_cast<size_t>(
+                                1.4 * minTime / state.seconds() * iterations));
+        iterations = std::max(iterations + 1, next);
+    }
+}
+
+static Status
+run(int argc, char *argv[])
+{
+    double minTime = 0.5;
+    int c;
+    while (0 <= (c = getopt(argc, argv, "t:")))
+    {
+        if ('t' == c)
+            minTime = atof(optarg);
+        else
+            return ABC_ERROR(ABC_CC_Error,
+                             "usage: abc-bench [-t <seconds>] [<filter>]");
+    }
+    const std::string filter = optind < argc ? argv[optind] : "";
+
+    JsonArray benchmarks;
+    for (const auto &entry: benchList())
+    {
+        if (std::string::npos == entry.name.find(filter))
+            continue;
+
+        JsonPtr json;
+        ABC_CHECK(benchRun(json, entry, minTime));
+        ABC_CHECK(benchmarks.append(json));
+    }
+
+    char date[32];
+    const time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    JsonObject context;
+    ABC_CHECK(context.set("date", date));
+    ABC_CHECK(context.set("version", ABC_VERSION));
+
+    JsonObject json;
+    ABC_CHECK(json.set("context", context));
+    ABC_CHECK(json.set("benchmarks", benchmarks));
+    std::cout << json.encode() << std::endl;
+    return Status();
+}
+
+int
+main(int argc, char *argv[])
+{
+    Status s = run(argc, argv);
+    if (!s)
+        std::cerr << s << std::endl;
+    return s ? 0 : 1;
+}
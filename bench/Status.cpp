@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/util/Status.hpp"
+
+namespace abcd {
+
+static int __attribute__((noinline))
+intCheck(int i)
+{
+    return i < 0;
+}
+
+static Status __attribute__((noinline))
+statusCheck(int i)
+{
+    if (i < 0)
+        return ABC_ERROR(ABC_CC_Error, "negative");
+    return Status();
+}
+
+static Status
+statusNested(int i)
+{
+    ABC_CHECK(statusCheck(i));
+    return Status();
+}
+
+} // namespace abcd
+
+/**
+ * The baseline for the Status benchmark.
+ */
+ABC_BENCH(intReturn)
+{
+    int failures = 0;
+    int i = 0;
+    while (state.keepRunning())
+        failures += abcd::intCheck(i++);
+    abcd::benchKeep(failures);
+}
+
+ABC_BENCH(statusReturn)
+{
+    int failures = 0;
+    int i = 0;
+    while (state.keepRunning())
+        failures += !abcd::statusNested(i++);
+    abcd::benchKeep(failures);
+}
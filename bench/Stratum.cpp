@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/bitcoin/SyntheticChain.hpp"
+#include "../abcd/bitcoin/network/StratumConnection.hpp"
+#include "../abcd/bitcoin/network/StratumMock.hpp"
+#include "../abcd/util/Debug.hpp"
+#include <poll.h>
+#include <map>
+#include <memory>
+
+using namespace abcd;
+
+constexpr size_t stratumAddresses = 256;
+
+/**
+ * A mock server whose replies come back after a fixed delay.
+ * The chain is kept small, since these benchmarks time the protocol,
+ * not the size of the history.
+ */
+struct StratumFixture
+{
+    SyntheticChain chain;
+    std::unique_ptr<StratumMock> server;
+
+    StratumFixture(size_t delay, size_t transactions)
+    {
+        std::vector<std::string> addresses;
+        for (size_t i = 0; i < stratumAddresses; ++i)
+        {
+            bc::ec_secret secret{{static_cast<uint8_t>(i + 1),
+                                  static_cast<uint8_t>(i >> 8), 0x5a}};
+            bc::payment_address address(bc::payment_address::pubkey_version,
+                                        bc::bitcoin_short_hash(
+                                            bc::secret_to_public_key(secret)));
+            addresses.push_back(address.encoded());
+        }
+
+        SyntheticParams params;
+        params.transactions = transactions;
+        chain.build(addresses, params).log();
+
+        server.reset(new StratumMock(chain));
+        server->replyDelaySet(std::chrono::milliseconds(delay));
+        server->start().log();
+    }
+};
+
+static StratumFixture &
+stratumFixture(size_t delay, size_t transactions=1000)
+{
+    static std::map<std::pair<size_t, size_t>,
+           std::unique_ptr<StratumFixture>> fixtures;
+    auto &slot = fixtures[std::make_pair(delay, transactions)];
+    if (!slot)
+        slot.reset(new StratumFixture(delay, transactions));
+    return *slot;
+}
+
+/**
+ * Runs the connection until every request has come back.
+ */
+static Status
+stratumPump(StratumConnection &connection, const size_t &pending)
+{
+    ABC_CHECK(connection.flush());
+    while (pending)
+    {
+        SleepTime sleep;
+        ABC_CHECK(connection.wakeup(sleep));
+        ABC_CHECK(connection.flush());
+
+        struct pollfd fd = { connection.pollfd(), POLLIN, 0 };
+        poll(&fd, 1, sleep.count() ? sleep.count() : -1);
+    }
+    return Status();
+}
+
+/**
+ * Parses a batch of address notifications, with no socket involved.
+ * This is the floor for any reply the connection handles.
+ */
+ABC_BENCH(stratumNotify, 1, 100, 1000)
+{
+    std::string message = "[";
+    for (size_t i = 0; i < state.arg(); ++i)
+    {
+        if (i)
+            message += ',';
+        message += "{\"jsonrpc\": \"2.0\", "
+                   "\"method\": \"blockchain.address.subscribe\", "
+                   "\"params\": [\"1BitcoinEaterAddressDontSendf59kuE\", "
+                   "\"3f5a8e0d7c6b2a19f4e3d2c1b0a99887766554433221100ffeeddccbbaa9988\"]}";
+    }
+    message += "]";
+    state.itemsSet(state.arg());
+    state.bytesSet(message.size());
+
+    StratumConnection connection;
+    while (state.keepRunning())
+        connection.inject(DataSlice(message)).log();
+}
+
+/**
+ * Sends a burst of address subscriptions over loopback,
+ * and waits for every reply. The argument is the server's reply delay,
+ * in milliseconds, which shows how well the request window hides latency.
+ */
+ABC_BENCH(stratumSubscribe, 0, 20, 100)
+{
+    auto &fixture = stratumFixture(state.arg());
+    const auto &addresses = fixture.chain.addresses();
+    state.itemsSet(addresses.size());
+
+    while (state.keepRunning())
+    {
+        StratumConnection connection;
+        if (!connection.connect(fixture.server->uri()).log())
+            return;
+
+        size_t pending = 0;
+        auto onError = [&pending](Status s)
+        {
+            --pending;
+        };
+        auto onReply = [&pending](const std::string &hash)
+        {
+            --pending;
+        };
+        for (const auto &address: addresses)
+        {
+            ++pending;
+            connection.addressSubscribe(onError, onReply, address);
+        }
+        stratumPump(connection, pending).log();
+    }
+}
+
+/**
+ * Fetches every address history from a busier chain,
+ * so the replies are big enough for parsing to dominate.
+ */
+ABC_BENCH(stratumHistory, 1000, 10000)
+{
+    auto &fixture = stratumFixture(0, state.arg());
+    const auto &addresses = fixture.chain.addresses();
+
+    size_t rows = 0;
+    for (const auto &address: addresses)
+        rows += fixture.chain.history(address).size();
+    state.itemsSet(rows);
+
+    StratumConnection connection;
+    if (!connection.connect(fixture.server->uri()).log())
+        return;
+
+    while (state.keepRunning())
+    {
+        size_t pending = 0;
+        auto onError = [&pending](Status s)
+        {
+            --pending;
+        };
+        auto onReply = [&pending](const AddressHistory &history)
+        {
+            benchKeep(history);
+            --pending;
+        };
+        for (const auto &address: addresses)
+        {
+            ++pending;
+            connection.addressHistoryFetch(onError, onReply, address, 0);
+        }
+        stratumPump(connection, pending).log();
+    }
+}
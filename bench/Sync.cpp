@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Bench.hpp"
+#include "../abcd/bitcoin/SyntheticChain.hpp"
+#include "../abcd/bitcoin/cache/BlockCache.hpp"
+#include "../abcd/bitcoin/cache/TxCache.hpp"
+#include "../abcd/bitcoin/network/StratumConnection.hpp"
+#include "../abcd/bitcoin/network/StratumMock.hpp"
+#include "../abcd/util/Debug.hpp"
+#include <poll.h>
+#include <map>
+#include <set>
+#include <memory>
+
+using namespace abcd;
+
+constexpr size_t syncAddresses = 64;
+
+/**
+ * A synthetic wallet history and a mock server to hand it out.
+ */
+struct SyncFixture
+{
+    SyntheticChain chain;
+    std::unique_ptr<StratumMock> server;
+
+    SyncFixture(size_t size)
+    {
+        std::vector<std::string> addresses;
+        for (size_t i = 0; i < syncAddresses; ++i)
+        {
+            bc::ec_secret secret{{static_cast<uint8_t>(i + 1),
+                                  static_cast<uint8_t>(i >> 8)}};
+            bc::payment_address address(bc::payment_address::pubkey_version,
+                                        bc::bitcoin_short_hash(
+                                            bc::secret_to_public_key(secret)));
+            addresses.push_back(address.encoded());
+        }
+
+        SyntheticParams params;
+        params.transactions = size;
+        chain.build(addresses, params).log();
+
+        server.reset(new StratumMock(chain));
+        server->start().log();
+    }
+};
+
+static SyncFixture &
+syncFixture(size_t size)
+{
+    static std::map<size_t, std::unique_ptr<SyncFixture>> fixtures;
+    auto &slot = fixtures[size];
+    if (!slot)
+        slot.reset(new SyncFixture(size));
+    return *slot;
+}
+
+/**
+ * Syncs a fresh cache from the mock server over loopback:
+ * every address history, then every transaction it names.
+ */
+ABC_BENCH(mockSync, 1000, 10000)
+{
+    auto &fixture = syncFixture(state.arg());
+    state.itemsSet(fixture.chain.rows().size());
+
+    while (state.keepRunning())
+    {
+        BlockCache blockCache("", "");
+        TxCache txCache(blockCache);
+        StratumConnection connection;
+        if (!connection.connect(fixture.server->uri()).log())
+            return;
+
+        size_t pending = 0;
+        Status failure;
+        std::set<std::string> fetched;
+        auto onError = [&](Status s)
+        {
+            failure = s;
+            --pending;
+        };
+
+        for (const auto &address: fixture.chain.addresses())
+        {
+            auto onHistory = [&](const AddressHistory &history)
+            {
+                for (const auto &i: history)
+                {
+                    if (!fetched.insert(i.first).second)
+                        continue;
+                    auto onTx = [&](const bc::transaction_type &tx)
+                    {
+                        txCache.insert(tx);
+                        --pending;
+                    };
+                    ++pending;
+                    connection.txDataFetch(onError, onTx, i.first);
+                }
+                --pending;
+            };
+            ++pending;
+            connection.addressHistoryFetch(onError, onHistory, address, 0);
+        }
+
+        while (pending && failure)
+        {
+            SleepTime sleep;
+            failure = connection.wakeup(sleep);
+            if (!failure)
+                break;
+
+            struct pollfd fd = { connection.pollfd(), POLLIN, 0 };
+            poll(&fd, 1, sleep.count() ? sleep.count() : -1);
+        }
+        failure.log();
+        benchKeep(txCache);
+    }
+}
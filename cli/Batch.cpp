@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "Batch.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+
+using namespace abcd;
+
+struct BatchResultJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(BatchResultJson, JsonObject)
+
+    ABC_JSON_INTEGER(line, "line", 0)
+    ABC_JSON_STRING(command, "command", nullptr)
+    ABC_JSON_STRING(username, "username", nullptr)
+    ABC_JSON_BOOLEAN(ok, "ok", false)
+    ABC_JSON_INTEGER(code, "code", 0)
+    ABC_JSON_STRING(error, "error", nullptr)
+    ABC_JSON_STRING(output, "output", nullptr)
+};
+
+// The output buffer for whatever job this thread is running:
+static thread_local std::string *tCapture = nullptr;
+
+/**
+ * Sends `std::cout` to the running job's buffer on worker threads,
+ * and straight through everywhere else.
+ */
+class CaptureBuffer:
+    public std::streambuf
+{
+public:
+    CaptureBuffer(std::streambuf *original):
+        original_(original)
+    {}
+
+    /**
+     * Writes a finished line to the real output.
+     */
+    void
+    emit(const std::string &text)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        original_->sputn(text.data(), text.size());
+        original_->pubsync();
+    }
+
+protected:
+    int_type
+    overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+
+        if (tCapture)
+        {
+            tCapture->push_back(traits_type::to_char_type(c));
+            return c;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return original_->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize
+    xsputn(const char *s, std::streamsize n) override
+    {
+        if (tCapture)
+        {
+            tCapture->append(s, n);
+            return n;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        return original_->sputn(s, n);
+    }
+
+    int
+    sync() override
+    {
+        if (tCapture)
+            return 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        return original_->pubsync();
+    }
+
+private:
+    std::streambuf *original_;
+    std::mutex mutex_;
+};
+
+std::vector<std::string>
+batchSplit(const std::string &line)
+{
+    std::vector<std::string> out;
+    std::string word;
+    bool inWord = false;
+    bool quoted = false;
+
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        const char c = line[i];
+        if ('\\' == c && i + 1 < line.size())
+        {
+            word += line[++i];
+            inWord = true;
+        }
+        else if ('"' == c)
+        {
+            quoted = !quoted;
+            inWord = true;
+        }
+        else if (!quoted && isspace(static_cast<unsigned char>(c)))
+        {
+            if (inWord)
+                out.push_back(word);
+            word.clear();
+            inWord = false;
+        }
+        else
+        {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord)
+        out.push_back(word);
+
+    return out;
+}
+
+static Status
+jobRun(BatchJob &job, const BatchPrepare &prepare)
+{
+    ABC_CHECK(job.status);
+    ABC_CHECK(prepare(job));
+
+    // Commands take a C-style argument list:
+    std::vector<char *> argv;
+    for (auto &arg: job.args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+
+    return (*job.command)(job.session, job.args.size(), argv.data());
+}
+
+void
+batchRun(std::vector<BatchJob> &jobs, unsigned workers,
+         const BatchPrepare &prepare)
+{
+    // Jobs for the same user share a login, so they run in order.
+    // Jobs that never log in can go anywhere:
+    std::map<std::string, std::vector<BatchJob *>> users;
+    std::vector<std::vector<BatchJob *>> groups;
+    for (auto &job: jobs)
+    {
+        if (job.command && InitLevel::store <= job.command->level())
+            users[job.session.username].push_back(&job);
+        else
+            groups.push_back(std::vector<BatchJob *>{&job});
+    }
+    for (auto &user: users)
+        groups.push_back(std::move(user.second));
+
+    CaptureBuffer capture(std::cout.rdbuf());
+    auto original = std::cout.rdbuf(&capture);
+
+    std::atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < groups.size(); i = next++)
+        {
+            for (auto *job: groups[i])
+            {
+                std::string output;
+                tCapture = &output;
+                const auto s = jobRun(*job, prepare);
+                std::cout.flush();
+                tCapture = nullptr;
+
+                BatchResultJson result;
+                result.lineSet(job->line);
+                if (job->command)
+                    result.commandSet(job->command->name());
+                if (!job->session.username.empty())
+                    result.usernameSet(job->session.username);
+                result.okSet(!!s);
+                if (!s)
+                {
+                    result.codeSet(s.value());
+                    result.errorSet(s.message());
+                }
+                result.outputSet(output);
+                capture.emit(result.encode(true) + '\n');
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const auto count = std::min<size_t>(std::max(workers, 1u), groups.size());
+    for (size_t i = 1; i < count; ++i)
+        threads.emplace_back(work);
+    work();
+    for (auto &thread: threads)
+        thread.join();
+
+    std::cout.rdbuf(original);
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * Parses and runs abc-cli batch files.
+ */
+
+#ifndef CLI_BATCH_HPP
+#define CLI_BATCH_HPP
+
+#include "Command.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * One line of a batch file, parsed and ready to run.
+ */
+struct BatchJob
+{
+    size_t line = 0;
+    abcd::Status status; // Holds any parse error, so the line still reports
+    Command *command = nullptr;
+    Session session;
+    std::vector<std::string> args;
+};
+
+/**
+ * Fills in a job's session up to the level its command needs.
+ */
+typedef std::function<abcd::Status (BatchJob &job)> BatchPrepare;
+
+/**
+ * Splits a batch line into words.
+ * Double quotes group words with spaces, and a backslash escapes
+ * the next character.
+ */
+std::vector<std::string>
+batchSplit(const std::string &line);
+
+/**
+ * Runs a list of jobs, writing one JSON line per job to standard output.
+ * Jobs for the same user run one after another, in file order,
+ * while different users run at the same time on up to `workers` threads.
+ * Anything a command prints goes into its own result line.
+ */
+void
+batchRun(std::vector<BatchJob> &jobs, unsigned workers,
+         const BatchPrepare &prepare);
+
+#endif
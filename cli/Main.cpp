@@ -5,6 +5,7 @@
  * See the LICENSE file for more information.
  */
 
+#include "Batch.hpp"
 #include "Command.hpp"
 #include "../abcd/json/JsonObject.hpp"
 #include "../abcd/login/Otp.hpp"
@@ -12,6 +13,7 @@
 #include "../abcd/login/server/LoginServer.hpp"
 #include "../abcd/util/Util.hpp"
 #include "../src/LoginShim.hpp"
+#include <fstream>
 #include <iostream>
 #include <getopt.h>
 
@@ -50,24 +52,31 @@ configPath()
 }
 
 /**
- * The main program body.
+ * The options that come before the command name.
  */
-static Status run(int argc, char *argv[])
+struct Options
 {
-    ConfigJson json;
-    ABC_CHECK(json.load(configPath()));
-    ABC_CHECK(json.apiKeyOk());
-
-    // Parse out the command-line options:
-    std::string accountType = json.accountType();
+    std::string accountType;
     std::string workingDir;
     Session session;
     bool wantHelp = false;
+    std::string batchPath;
+    unsigned jobs = 4;
+};
 
+/**
+ * Parses the command-line options,
+ * leaving `argc` and `argv` pointing at the command name.
+ */
+static Status
+optionsParse(Options &options, int &argc, char **&argv)
+{
     static const struct option long_options[] =
     {
         {"account-type", required_argument, nullptr, 'a'},
+        {"batch",       required_argument, nullptr, 'b'},
         {"working-dir", required_argument, nullptr, 'd'},
+        {"jobs",        required_argument, nullptr, 'j'},
         {"username",    required_argument, nullptr, 'u'},
         {"password",    required_argument, nullptr, 'p'},
         {"wallet",      required_argument, nullptr, 'w'},
@@ -75,37 +84,48 @@ static Status run(int argc, char *argv[])
         {nullptr, 0, nullptr, 0}
     };
     opterr = 0;
+    optind = 0; // Start over, since batch mode parses many lines
     int c;
     while (-1 != (c = getopt_long(argc, argv,
-                                  "a:d:hu:p:w:",
+                                  "a:b:d:hj:u:p:w:",
                                   long_options,
                                   nullptr)))
     {
         switch (c)
         {
         case 'a':
-            accountType = optarg;
+            options.accountType = optarg;
+            break;
+        case 'b':
+            options.batchPath = optarg;
             break;
         case 'd':
-            workingDir = optarg;
+            options.workingDir = optarg;
             break;
         case 'h':
-            wantHelp = true;
+            options.wantHelp = true;
+            break;
+        case 'j':
+            options.jobs = atoi(optarg);
             break;
         case 'p':
-            session.password = optarg;
+            options.session.password = optarg;
             break;
         case 'u':
-            session.username = optarg;
+            options.session.username = optarg;
             break;
         case 'w':
-            session.uuid = optarg;
+            options.session.uuid = optarg;
             break;
         case '?':
             if (optopt == 'a')
                 return ABC_ERROR(ABC_CC_Error, std::string("-a requires an account type"));
+            else if (optopt == 'b')
+                return ABC_ERROR(ABC_CC_Error, std::string("-b requires a batch file"));
             else if (optopt == 'd')
                 return ABC_ERROR(ABC_CC_Error, std::string("-d requires a working directory"));
+            else if (optopt == 'j')
+                return ABC_ERROR(ABC_CC_Error, std::string("-j requires a job count"));
             else if (optopt == 'p')
                 return ABC_ERROR(ABC_CC_Error, std::string("-p requires a password"));
             else if (optopt == 'u')
@@ -122,52 +142,45 @@ static Status run(int argc, char *argv[])
     // At this point, all non-option arguments should be out of the list:
     argc -= optind;
     argv += optind;
+    return Status();
+}
 
-    // Find the command:
-    if (argc < 1)
-    {
-        CommandRegistry::print();
-        return Status();
-    }
-    const auto commandName = argv[0];
-    --argc;
-    ++argv;
-
-    Command *command = CommandRegistry::find(commandName);
-    if (!command)
-        return ABC_ERROR(ABC_CC_Error,
-                         "unknown command " + std::string(commandName));
-
-    // If the user wants help, just print the string and return:
-    if (wantHelp)
+/**
+ * Starts up the core library.
+ */
+static Status
+contextInit(Options &options, ConfigJson &json, const std::string &usage)
+{
+    if (options.workingDir.empty())
     {
-        std::cout << helpString(*command) << std::endl;
-        return Status();
+        if (json.workingDirOk())
+            options.workingDir = json.workingDir();
+        else
+            return ABC_ERROR(ABC_CC_Error, "No working directory given, " +
+                             usage);
     }
 
-    // Populate the session up to the required level:
-    if (InitLevel::context <= command->level())
-    {
-        if (workingDir.empty())
-        {
-            if (json.workingDirOk())
-                workingDir = json.workingDir();
-            else
-                return ABC_ERROR(ABC_CC_Error, "No working directory given, " +
-                                 helpString(*command));
-        }
+    unsigned char seed[] = {1, 2, 3};
+    ABC_CHECK_OLD(ABC_Initialize(options.workingDir.c_str(),
+                                 CA_CERT,
+                                 json.apiKey(),
+                                 options.accountType.c_str(),
+                                 json.hiddenBitsKey(),
+                                 seed,
+                                 sizeof(seed),
+                                 &error));
+    return Status();
+}
 
-        unsigned char seed[] = {1, 2, 3};
-        ABC_CHECK_OLD(ABC_Initialize(workingDir.c_str(),
-                                     CA_CERT,
-                                     json.apiKey(),
-                                     accountType.c_str(),
-                                     json.hiddenBitsKey(),
-                                     seed,
-                                     sizeof(seed),
-                                     &error));
-    }
-    if (InitLevel::store <= command->level())
+/**
+ * Populates the session up to the level the command requires.
+ * The logins and wallets stay cached in the core,
+ * so later commands for the same user pick them right up.
+ */
+static Status
+sessionLoad(Session &session, const Command &command, ConfigJson &json)
+{
+    if (InitLevel::store <= command.level())
     {
         if (session.username.empty())
         {
@@ -175,12 +188,12 @@ static Status run(int argc, char *argv[])
                 session.username = json.username();
             else
                 return ABC_ERROR(ABC_CC_Error, "No username given, " +
-                                 helpString(*command));
+                                 helpString(command));
         }
 
         ABC_CHECK(cacheLoginStore(session.store, session.username.c_str()));
     }
-    if (InitLevel::login <= command->level())
+    if (InitLevel::login <= command.level())
     {
         if (session.password.empty())
         {
@@ -188,7 +201,7 @@ static Status run(int argc, char *argv[])
                 session.password = json.password();
             else
                 return ABC_ERROR(ABC_CC_Error, "No password given, " +
-                                 helpString(*command));
+                                 helpString(command));
         }
 
         AuthError authError;
@@ -207,11 +220,11 @@ static Status run(int argc, char *argv[])
         }
         ABC_CHECK(s);
     }
-    if (InitLevel::account <= command->level())
+    if (InitLevel::account <= command.level())
     {
         ABC_CHECK(cacheAccount(session.account, session.username.c_str()));
     }
-    if (InitLevel::wallet <= command->level())
+    if (InitLevel::wallet <= command.level())
     {
         if (session.uuid.empty())
         {
@@ -219,15 +232,142 @@ static Status run(int argc, char *argv[])
                 session.uuid = json.wallet();
             else
                 return ABC_ERROR(ABC_CC_Error, "No wallet name given, " +
-                                 helpString(*command));
+                                 helpString(command));
         }
 
         ABC_CHECK(cacheWallet(session.wallet,
                               session.username.c_str(), session.uuid.c_str()));
     }
 
+    return Status();
+}
+
+/**
+ * Parses one line of a batch file.
+ * Each line is an ordinary command line, minus the program name.
+ * The line's options start from the ones given for the whole batch.
+ */
+static Status
+batchParse(BatchJob &job, const Options &defaults, const std::string &line)
+{
+    std::vector<std::string> words = batchSplit(line);
+    words.insert(words.begin(), "abc-cli");
+    std::vector<char *> args;
+    for (auto &word: words)
+        args.push_back(&word[0]);
+    args.push_back(nullptr);
+
+    Options options;
+    options.session = defaults.session;
+    int argc = words.size();
+    char **argv = args.data();
+    ABC_CHECK(optionsParse(options, argc, argv));
+    if (!options.workingDir.empty() || !options.accountType.empty() ||
+            !options.batchPath.empty())
+        return ABC_ERROR(ABC_CC_Error,
+                         "-d, -a and -b only work for the whole batch");
+    if (argc < 1)
+        return ABC_ERROR(ABC_CC_Error, "No command given");
+
+    job.command = CommandRegistry::find(argv[0]);
+    if (!job.command)
+        return ABC_ERROR(ABC_CC_Error,
+                         "unknown command " + std::string(argv[0]));
+    job.session = options.session;
+    job.args.assign(argv + 1, argv + argc);
+    return Status();
+}
+
+/**
+ * Runs every command in a batch file, reusing one context throughout.
+ */
+static Status
+batchMain(Options &options, ConfigJson &json)
+{
+    std::ifstream file;
+    std::istream *in = &std::cin;
+    if ("-" != options.batchPath)
+    {
+        file.open(options.batchPath);
+        if (!file)
+            return ABC_ERROR(ABC_CC_FileOpenError,
+                             "Cannot open " + options.batchPath);
+        in = &file;
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (size_t number = 1; std::getline(*in, line); ++number)
+    {
+        // Skip blank lines and comments:
+        const auto first = line.find_first_not_of(" \t");
+        if (std::string::npos == first || '#' == line[first])
+            continue;
+
+        BatchJob job;
+        job.line = number;
+        job.status = batchParse(job, options, line);
+        jobs.push_back(std::move(job));
+    }
+
+    ABC_CHECK(contextInit(options, json,
+                          "usage: abc-cli [-d <dir>] -b <file> [-j <jobs>]"));
+    batchRun(jobs, options.jobs, [&json](BatchJob &job)
+    {
+        return sessionLoad(job.session, *job.command, json);
+    });
+
+    ABC_Terminate();
+    return Status();
+}
+
+/**
+ * The main program body.
+ */
+static Status run(int argc, char *argv[])
+{
+    ConfigJson json;
+    ABC_CHECK(json.load(configPath()));
+    ABC_CHECK(json.apiKeyOk());
+
+    // Parse out the command-line options:
+    Options options;
+    ABC_CHECK(optionsParse(options, argc, argv));
+    if (options.accountType.empty())
+        options.accountType = json.accountType();
+
+    if (!options.batchPath.empty())
+        return batchMain(options, json);
+
+    // Find the command:
+    if (argc < 1)
+    {
+        CommandRegistry::print();
+        return Status();
+    }
+    const auto commandName = argv[0];
+    --argc;
+    ++argv;
+
+    Command *command = CommandRegistry::find(commandName);
+    if (!command)
+        return ABC_ERROR(ABC_CC_Error,
+                         "unknown command " + std::string(commandName));
+
+    // If the user wants help, just print the string and return:
+    if (options.wantHelp)
+    {
+        std::cout << helpString(*command) << std::endl;
+        return Status();
+    }
+
+    // Populate the session up to the required level:
+    if (InitLevel::context <= command->level())
+        ABC_CHECK(contextInit(options, json, helpString(*command)));
+    ABC_CHECK(sessionLoad(options.session, *command, json));
+
     // Invoke the command:
-    ABC_CHECK((*command)(session, argc, argv));
+    ABC_CHECK((*command)(options.session, argc, argv));
 
     // Clean up:
     ABC_Terminate();
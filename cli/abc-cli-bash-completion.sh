@@ -80,7 +80,8 @@ _abc_cli_complete()
     wallet-remove
     wallet-seed
     wallet-sync
-    watcher'
+    watcher
+    watcher-daemon'
 
     # COMPREPLY is the array of possible completions, generated with
     # the compgen builtin.
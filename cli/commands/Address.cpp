@@ -44,8 +44,8 @@ COMMAND(InitLevel::wallet, CliAddressList, "address-list",
     if (argc != 0)
         return ABC_ERROR(ABC_CC_Error, helpString(*this));
 
-    auto list = session.wallet->addresses.list();
-    for (const auto &i: list)
+    const auto list = session.wallet->addresses.snapshot();
+    for (const auto &i: *list)
     {
         abcd::AddressMeta address;
         ABC_CHECK(session.wallet->addresses.get(address, i));
@@ -64,7 +64,8 @@ COMMAND(InitLevel::wallet, CliAddressCalculate, "address-calculate",
         return ABC_ERROR(ABC_CC_Error, helpString(*this));
     const auto count = atol(argv[0]);
 
-    bc::hd_private_key m(session.wallet->bitcoinKey());
+    const auto key = session.wallet->bitcoinKey();
+    bc::hd_private_key m(DataChunk(key.begin(), key.end()));
     bc::hd_private_key m0 = m.generate_private_key(0);
     bc::hd_private_key m00 = m0.generate_private_key(0);
     for (int i = 0; i < count; ++i)
@@ -85,7 +86,8 @@ COMMAND(InitLevel::wallet, CliAddressSearch, "address-search",
     const auto start = atol(argv[1]);
     const auto end = atol(argv[2]);
 
-    bc::hd_private_key m(session.wallet->bitcoinKey());
+    const auto key = session.wallet->bitcoinKey();
+    bc::hd_private_key m(DataChunk(key.begin(), key.end()));
     bc::hd_private_key m0 = m.generate_private_key(0);
     bc::hd_private_key m00 = m0.generate_private_key(0);
 
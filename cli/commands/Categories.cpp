@@ -26,13 +26,14 @@ COMMAND(InitLevel::account, CategoryList, "category-list",
 }
 
 COMMAND(InitLevel::account, CategoryAdd, "category-add",
-        " <category>")
+        " <category>...")
 {
-    if (argc != 1)
+    if (argc < 1)
         return ABC_ERROR(ABC_CC_Error, helpString(*this));
-    const auto category = argv[0];
+    const AccountCategories categories(argv, argv + argc);
 
-    ABC_CHECK(accountCategoriesAdd(*session.account, category));
+    ABC_CHECK(accountCategoriesUpdate(*session.account, categories,
+                                      AccountCategories()));
     return Status();
 }
 
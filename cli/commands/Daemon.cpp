@@ -0,0 +1,562 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../Command.hpp"
+#include "../../abcd/bitcoin/WatcherBridge.hpp"
+#include "../../abcd/bitcoin/cache/Cache.hpp"
+#include "../../abcd/json/JsonArray.hpp"
+#include "../../abcd/json/JsonObject.hpp"
+#include "../../abcd/login/server/LoginServer.hpp"
+#include "../../abcd/util/LineBuffer.hpp"
+#include "../../abcd/wallet/Wallet.hpp"
+#include "../../src/LoginShim.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace abcd;
+
+constexpr int pollTimeout = 1000; // ms, for noticing ctrl-c
+constexpr size_t readChunk = 65536;
+constexpr size_t historyMax = 10000; // Transaction events kept for cursors
+constexpr size_t requestMax = 65536; // Longest request line we will buffer
+constexpr size_t outgoingMax = 4 * 1024 * 1024; // Per client, before we drop it
+
+static bool running = true;
+
+static void
+signalCallback(int dummy)
+{
+    running = false;
+}
+
+struct DaemonRequestJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(DaemonRequestJson, JsonObject)
+
+    ABC_JSON_VALUE(id, "id", JsonPtr)
+    ABC_JSON_STRING(method, "method", "")
+    ABC_JSON_STRING(username, "username", nullptr)
+    ABC_JSON_STRING(password, "password", nullptr)
+    ABC_JSON_STRING(wallet, "wallet", nullptr)
+    ABC_JSON_STRING(address, "address", nullptr)
+    ABC_JSON_INTEGER(cursor, "cursor", 0)
+};
+
+struct DaemonReplyJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(DaemonReplyJson, JsonObject)
+
+    ABC_JSON_VALUE(id, "id", JsonPtr)
+    ABC_JSON_STRING(error, "error", nullptr)
+    ABC_JSON_VALUE(result, "result", JsonPtr)
+};
+
+struct DaemonEventJson:
+    public JsonObject
+{
+    ABC_JSON_CONSTRUCTORS(DaemonEventJson, JsonObject)
+
+    ABC_JSON_STRING(event, "event", nullptr)
+    ABC_JSON_STRING(wallet, "wallet", "")
+    ABC_JSON_STRING(txid, "txid", nullptr)
+    ABC_JSON_INTEGER(cursor, "cursor", 0)
+};
+
+/**
+ * Serves wallet queries over a local socket, one JSON object per line,
+ * while the shared network engine keeps every watched wallet in sync.
+ * The poll loop owns the sockets and wallet table.
+ * Watcher threads only touch the event queue, under its mutex.
+ */
+class Daemon
+{
+public:
+    ~Daemon();
+
+    Status
+    listen(const std::string &path);
+
+    /**
+     * Runs the poll loop until ctrl-c.
+     */
+    void
+    run();
+
+private:
+    struct WatchedWallet
+    {
+        std::shared_ptr<Wallet> wallet;
+        std::thread thread;
+    };
+    std::map<std::string, WatchedWallet> wallets_;
+
+    struct Client
+    {
+        int fd;
+        LineBuffer incoming;
+        std::string outgoing;
+        bool subscribed;
+    };
+    std::list<Client> clients_;
+
+    // Event state, shared with the watcher threads:
+    std::mutex mutex_;
+    uint64_t cursor_ = 0;
+    std::deque<DaemonEventJson> history_; // Transaction events, for cursors
+    std::vector<DaemonEventJson> unsent_; // Events not yet pushed
+
+    std::string path_;
+    int fd_ = -1;
+    int wakeRead_ = -1;
+    int wakeWrite_ = -1;
+    std::thread engine_;
+
+    static void
+    eventCallback(const tABC_AsyncBitCoinInfo *pInfo);
+
+    void
+    eventAdd(const std::string &event, const std::string &wallet,
+             const std::string &txid="");
+
+    Status
+    dispatch(JsonPtr &result, DaemonRequestJson request, Client &client);
+
+    Status
+    walletFind(std::shared_ptr<Wallet> &result, const std::string &id);
+
+    Status
+    watch(const std::string &username, const std::string &password,
+          const std::string &id);
+
+    Status
+    unwatch(const std::string &id);
+};
+
+Daemon::~Daemon()
+{
+    for (auto &i: wallets_)
+        unwatch(i.first).log();
+    wallets_.clear();
+
+    if (engine_.joinable())
+    {
+        bridgeEngineStop().log();
+        engine_.join();
+    }
+
+    for (const auto &client: clients_)
+        close(client.fd);
+    if (0 <= fd_)
+    {
+        close(fd_);
+        unlink(path_.c_str());
+    }
+    if (0 <= wakeRead_)
+        close(wakeRead_);
+    if (0 <= wakeWrite_)
+        close(wakeWrite_);
+}
+
+Status
+Daemon::listen(const std::string &path)
+{
+    struct sockaddr_un address {};
+    if (sizeof(address.sun_path) <= path.size())
+        return ABC_ERROR(ABC_CC_Error, "Socket path too long: " + path);
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0)
+        return ABC_ERROR(ABC_CC_SysError, "Cannot create socket");
+    unlink(path.c_str());
+
+    // Clients send passwords, so only our own user may connect.
+    // Nobody can connect before `listen`, so tightening the mode
+    // in between leaves no window:
+    if (bind(fd_, reinterpret_cast<struct sockaddr *>(&address),
+             sizeof(address)) || chmod(path.c_str(), 0600) ||
+            ::listen(fd_, 16))
+        return ABC_ERROR(ABC_CC_SysError, "Cannot listen on " + path + ": " +
+                         strerror(errno));
+    path_ = path;
+
+    // Watcher threads poke this pipe when they have news:
+    int pipes[2];
+    if (pipe(pipes))
+        return ABC_ERROR(ABC_CC_SysError, "Cannot create wakeup pipe");
+    wakeRead_ = pipes[0];
+    wakeWrite_ = pipes[1];
+    fcntl(wakeRead_, F_SETFL, fcntl(wakeRead_, F_GETFL) | O_NONBLOCK);
+    fcntl(wakeWrite_, F_SETFL, fcntl(wakeWrite_, F_GETFL) | O_NONBLOCK);
+
+    // Every watched wallet joins this engine:
+    engine_ = std::thread([]()
+    {
+        bridgeEngineLoop().log();
+    });
+    return Status();
+}
+
+void
+Daemon::run()
+{
+    while (running)
+    {
+        std::vector<struct pollfd> fds;
+        fds.push_back(pollfd{fd_, POLLIN, 0});
+        fds.push_back(pollfd{wakeRead_, POLLIN, 0});
+        for (const auto &client: clients_)
+        {
+            short events = POLLIN;
+            if (!client.outgoing.empty())
+                events |= POLLOUT;
+            fds.push_back(pollfd{client.fd, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), pollTimeout) <= 0)
+            continue;
+
+        // New clients:
+        if (fds[0].revents & POLLIN)
+        {
+            const int fd = accept(fd_, nullptr, nullptr);
+            if (0 <= fd)
+            {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                clients_.push_back(Client{fd, LineBuffer(), "", false});
+            }
+        }
+
+        // Push events to subscribers:
+        if (fds[1].revents & POLLIN)
+        {
+            char buffer[256];
+            while (0 < read(wakeRead_, buffer, sizeof(buffer)))
+                ;
+
+            std::vector<DaemonEventJson> events;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                events.swap(unsent_);
+            }
+            for (auto &event: events)
+            {
+                const auto text = event.encode(true) + '\n';
+                for (auto &client: clients_)
+                    if (client.subscribed)
+                        client.outgoing += text;
+            }
+        }
+
+        // Existing clients. Clients accepted in this pass have no pollfd yet:
+        size_t n = 2;
+        for (auto i = clients_.begin(); i != clients_.end() && n < fds.size();
+                ++n)
+        {
+            bool closed = false;
+            if (fds[n].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                auto *buffer = i->incoming.prepare(readChunk);
+                const auto size = read(i->fd, buffer, readChunk);
+                if (0 < size)
+                {
+                    i->incoming.commit(size);
+                    DataSlice line;
+                    while (i->incoming.line(line))
+                    {
+                        DaemonReplyJson out;
+                        JsonPtr result;
+                        DaemonRequestJson request;
+                        auto s = request.decode(
+                                     reinterpret_cast<const char *>(line.data()),
+                                     line.size());
+                        if (s)
+                            s = request.ok();
+                        if (s)
+                        {
+                            const auto id = request.id();
+                            if (id)
+                                out.idSet(id).log();
+                            s = dispatch(result, request, *i);
+                        }
+                        if (s)
+                            out.resultSet(result).log();
+                        else
+                            out.errorSet(s.message()).log();
+                        i->outgoing += out.encode(true) + '\n';
+                    }
+
+                    // A line this long is not a request we understand:
+                    if (requestMax < i->incoming.size())
+                        closed = true;
+                }
+                else if (!size || EAGAIN != errno)
+                    closed = true;
+            }
+
+            // Don't let a stuck reader pile up replies and events forever:
+            if (outgoingMax < i->outgoing.size())
+                closed = true;
+
+            if (!closed && !i->outgoing.empty())
+            {
+                const auto size = send(i->fd, i->outgoing.data(),
+                                       i->outgoing.size(), MSG_NOSIGNAL);
+                if (0 < size)
+                    i->outgoing.erase(0, size);
+                else if (EAGAIN != errno)
+                    closed = true;
+            }
+
+            if (closed)
+            {
+                close(i->fd);
+                i = clients_.erase(i);
+            }
+            else
+                ++i;
+        }
+    }
+}
+
+void
+Daemon::eventCallback(const tABC_AsyncBitCoinInfo *pInfo)
+{
+    auto *self = static_cast<Daemon *>(pInfo->pData);
+    const std::string wallet = pInfo->szWalletUUID ? pInfo->szWalletUUID : "";
+
+    switch (pInfo->eventType)
+    {
+    case ABC_AsyncEventType_IncomingBitCoin:
+    case ABC_AsyncEventType_TransactionUpdate:
+        for (unsigned i = 0; i < pInfo->countTxIDs; ++i)
+            self->eventAdd("tx", wallet, pInfo->aszTxIDs[i]);
+        if (!pInfo->countTxIDs && pInfo->szTxID)
+            self->eventAdd("tx", wallet, pInfo->szTxID);
+        break;
+    case ABC_AsyncEventType_BlockHeightChange:
+        self->eventAdd("height", wallet);
+        break;
+    case ABC_AsyncEventType_BalanceUpdate:
+        self->eventAdd("balance", wallet);
+        break;
+    default:
+        break;
+    }
+}
+
+void
+Daemon::eventAdd(const std::string &event, const std::string &wallet,
+                 const std::string &txid)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        DaemonEventJson json;
+        json.eventSet(event).log();
+        if (!wallet.empty())
+            json.walletSet(wallet).log();
+        if (!txid.empty())
+        {
+            json.txidSet(txid).log();
+            json.cursorSet(++cursor_).log();
+            history_.push_back(json);
+            if (historyMax < history_.size())
+                history_.pop_front();
+        }
+        unsent_.push_back(json);
+    }
+
+    const char c = 0;
+    if (write(wakeWrite_, &c, 1) < 0)
+        ; // A full pipe means the loop is already awake
+}
+
+Status
+Daemon::dispatch(JsonPtr &result, DaemonRequestJson request, Client &client)
+{
+    const std::string method = request.method();
+
+    if ("watch" == method)
+    {
+        ABC_CHECK(request.usernameOk());
+        ABC_CHECK(request.passwordOk());
+        ABC_CHECK(request.walletOk());
+        ABC_CHECK(watch(request.username(), request.password(),
+                        request.wallet()));
+        result.reset(json_true());
+    }
+    else if ("unwatch" == method)
+    {
+        ABC_CHECK(request.walletOk());
+        ABC_CHECK(unwatch(request.wallet()));
+        wallets_.erase(request.wallet());
+        result.reset(json_true());
+    }
+    else if ("wallets" == method)
+    {
+        JsonArray out;
+        for (const auto &i: wallets_)
+            ABC_CHECK(out.append(json_string(i.first.c_str())));
+        result = out;
+    }
+    else if ("balance" == method)
+    {
+        ABC_CHECK(request.walletOk());
+        std::shared_ptr<Wallet> wallet;
+        ABC_CHECK(walletFind(wallet, request.wallet()));
+
+        int64_t balance;
+        ABC_CHECK(wallet->balance(balance));
+        const auto progress = wallet->cache.addresses.progress();
+
+        JsonObject out;
+        ABC_CHECK(out.set("balance", static_cast<json_int_t>(balance)));
+        ABC_CHECK(out.set("synced", progress.first == progress.second));
+        result = out;
+    }
+    else if ("txs" == method)
+    {
+        const std::string wallet =
+            request.walletOk() ? request.wallet() : "";
+        const uint64_t cursor = request.cursor();
+
+        JsonArray txs;
+        JsonObject out;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto &event: history_)
+        {
+            if (static_cast<uint64_t>(event.cursor()) <= cursor)
+                continue;
+            if (!wallet.empty() && wallet != event.wallet())
+                continue;
+            ABC_CHECK(txs.append(event.clone()));
+        }
+        ABC_CHECK(out.set("txs", txs));
+        ABC_CHECK(out.set("cursor", static_cast<json_int_t>(cursor_)));
+        result = out;
+    }
+    else if ("address" == method)
+    {
+        ABC_CHECK(request.walletOk());
+        ABC_CHECK(request.addressOk());
+        std::shared_ptr<Wallet> wallet;
+        ABC_CHECK(walletFind(wallet, request.wallet()));
+
+        AddressStatus status;
+        if (!wallet->cache.addresses.statusFind(status, request.address()))
+            return ABC_ERROR(ABC_CC_Error, "Address not in this wallet");
+
+        JsonObject out;
+        ABC_CHECK(out.set("dirty", status.dirty));
+        ABC_CHECK(out.set("needsCheck", status.needsCheck));
+        ABC_CHECK(out.set("nextCheck", static_cast<json_int_t>(status.nextCheck)));
+        ABC_CHECK(out.set("missing",
+                          static_cast<json_int_t>(status.missingTxids.size())));
+        if (!status.server.empty())
+            ABC_CHECK(out.set("server", status.server));
+        result = out;
+    }
+    else if ("subscribe" == method)
+    {
+        client.subscribed = true;
+        result.reset(json_true());
+    }
+    else
+    {
+        return ABC_ERROR(ABC_CC_Error, "Unknown method " + method);
+    }
+
+    return Status();
+}
+
+Status
+Daemon::walletFind(std::shared_ptr<Wallet> &result, const std::string &id)
+{
+    const auto i = wallets_.find(id);
+    if (wallets_.end() == i)
+        return ABC_ERROR(ABC_CC_Error, "Not watching wallet " + id);
+
+    result = i->second.wallet;
+    return Status();
+}
+
+Status
+Daemon::watch(const std::string &username, const std::string &password,
+              const std::string &id)
+{
+    if (wallets_.count(id))
+        return Status();
+
+    std::shared_ptr<Login> login;
+    AuthError authError;
+    ABC_CHECK(cacheLoginPassword(login, username.c_str(), password,
+                                 authError));
+
+    // Holding the wallet keeps it alive, even if the login cache
+    // drops this user to make room for others:
+    std::shared_ptr<Wallet> wallet;
+    ABC_CHECK(cacheWallet(wallet, username.c_str(), id.c_str()));
+    ABC_CHECK(bridgeWatcherStart(*wallet));
+
+    auto &watched = wallets_[id];
+    watched.wallet = wallet;
+    watched.thread = std::thread([wallet, this]()
+    {
+        bridgeWatcherLoop(*wallet, eventCallback, this).log();
+    });
+    ABC_CHECK(bridgeWatcherConnect(*wallet));
+
+    return Status();
+}
+
+Status
+Daemon::unwatch(const std::string &id)
+{
+    std::shared_ptr<Wallet> wallet;
+    ABC_CHECK(walletFind(wallet, id));
+
+    auto &watched = wallets_[id];
+    bridgeWatcherStop(*wallet).log();
+    if (watched.thread.joinable())
+        watched.thread.join();
+    ABC_CHECK(bridgeWatcherDelete(*wallet));
+
+    return Status();
+}
+
+COMMAND(InitLevel::context, WatcherDaemon, "watcher-daemon",
+        " <socket-path>")
+{
+    if (argc != 1)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+
+    Daemon daemon;
+    ABC_CHECK(daemon.listen(argv[0]));
+    std::cout << "Listening on " << argv[0] << std::endl;
+
+    // The command stops with ctrl-c:
+    signal(SIGINT, signalCallback);
+    signal(SIGTERM, signalCallback);
+    daemon.run();
+
+    return Status();
+}
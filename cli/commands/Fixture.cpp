@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../Command.hpp"
+#include "../../abcd/bitcoin/SyntheticChain.hpp"
+#include "../../abcd/bitcoin/Utility.hpp"
+#include "../../abcd/bitcoin/network/StratumMock.hpp"
+#include "../../abcd/wallet/Wallet.hpp"
+#include <unistd.h>
+#include <iostream>
+
+using namespace abcd;
+
+static const char *categories[] =
+{
+    "Expense:Food & Dining", "Expense:Shopping", "Income:Salary",
+    "Transfer:Exchange", "Exchange:Buy Bitcoin"
+};
+
+COMMAND(InitLevel::wallet, CliFixtureCreate, "fixture-create",
+        " <file> <transactions> [<seed>]")
+{
+    if (argc < 2 || 3 < argc)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+    const auto path = argv[0];
+
+    SyntheticParams params;
+    params.transactions = atol(argv[1]);
+    if (2 < argc)
+        params.seed = atol(argv[2]);
+
+    const auto list = session.wallet->addresses.snapshot();
+    const std::vector<std::string> addresses(list->begin(), list->end());
+
+    SyntheticChain chain;
+    ABC_CHECK(chain.build(addresses, params));
+    ABC_CHECK(chain.save(path));
+
+    // Give every transaction some metadata, as a real user would:
+    size_t n = 0;
+    for (const auto &i: chain.rows())
+    {
+        const auto &row = i.second;
+        TxMeta meta;
+        meta.ntxid = bc::encode_hash(makeNtxid(row.tx));
+        meta.txid = i.first;
+        meta.timeCreation = SyntheticChain::header(row.height ? row.height :
+                            chain.height()).timestamp;
+        meta.internal = row.balance < 0;
+        meta.metadata.name = "Payee " + std::to_string(n % 97);
+        meta.metadata.category = categories[n % 5];
+        meta.metadata.notes = "Synthetic transaction " + std::to_string(n);
+        ABC_CHECK(session.wallet->txs.save(meta, row.balance, row.fee));
+        ++n;
+    }
+
+    std::cout << "Wrote " << chain.rows().size() << " transactions over " <<
+              addresses.size() << " addresses to " << path << std::endl;
+    return Status();
+}
+
+COMMAND(InitLevel::context, CliFixtureServe, "fixture-serve",
+        " <file> [<port>]")
+{
+    if (argc < 1 || 2 < argc)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+    const unsigned port = 1 < argc ? atol(argv[1]) : 0;
+
+    SyntheticChain chain;
+    ABC_CHECK(chain.load(argv[0]));
+
+    StratumMock server(chain);
+    ABC_CHECK(server.start(port));
+    std::cout << "Serving " << chain.rows().size() << " transactions at " <<
+              server.uri() << std::endl;
+    std::cout << "Point a wallet here with the overrideBitcoinServers "
+              "and overrideBitcoinServerList settings" << std::endl;
+
+    // Serve until killed:
+    while (true)
+        sleep(60);
+
+    return Status();
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../Command.hpp"
+#include "../../abcd/util/Metrics.hpp"
+#include <iostream>
+
+using namespace abcd;
+
+COMMAND(InitLevel::context, Metrics, "metrics",
+        "")
+{
+    if (argc != 0)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+
+    JsonPtr json;
+    ABC_CHECK(metricsJson(json));
+    std::cout << json.encode() << std::endl;
+
+    return Status();
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../Command.hpp"
+#include "../../abcd/Context.hpp"
+#include "../../abcd/util/FileIO.hpp"
+#include "../../abcd/util/Trace.hpp"
+#include <iostream>
+
+using namespace abcd;
+
+COMMAND(InitLevel::context, TraceDump, "trace-dump",
+        " [<file>]")
+{
+    if (1 < argc)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+
+    // Starting up moves the last run's trace aside, so that is the default:
+    const std::string path = argc ? argv[0] : gContext->paths.tracePrevPath();
+
+    DataChunk file;
+    ABC_CHECK(fileLoad(file, path));
+
+    std::string json;
+    ABC_CHECK(traceDecode(json, file));
+    std::cout << json << std::endl;
+
+    return Status();
+}
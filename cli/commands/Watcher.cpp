@@ -9,9 +9,11 @@
 #include "../../abcd/bitcoin/Text.hpp"
 #include "../../abcd/bitcoin/WatcherBridge.hpp"
 #include "../../abcd/bitcoin/cache/Cache.hpp"
+#include "../../abcd/util/Metrics.hpp"
 #include "../../abcd/wallet/Wallet.hpp"
 #include <unistd.h>
 #include <signal.h>
+#include <iomanip>
 #include <iostream>
 #include <thread>
 
@@ -83,6 +85,58 @@ static void showReport(Wallet &wallet)
     }
 }
 
+/**
+ * Prints one line per watcher timing histogram.
+ * The percentile is the top of the bucket it lands in,
+ * so it can overshoot by up to a factor of two.
+ */
+static Status
+showProfile()
+{
+    JsonPtr metrics;
+    ABC_CHECK(metricsJson(metrics));
+    json_t *histograms = json_object_get(metrics.get(), "histograms");
+
+    std::cout << std::left << std::setw(48) << "phase" << std::right <<
+              std::setw(10) << "count" << std::setw(12) << "total ms" <<
+              std::setw(10) << "mean us" << std::setw(10) << "p90 us" <<
+              std::endl;
+
+    for (void *i = json_object_iter(histograms); i;
+            i = json_object_iter_next(histograms, i))
+    {
+        const char *name = json_object_iter_key(i);
+        json_t *value = json_object_iter_value(i);
+        if (std::string(name).compare(0, 8, "watcher."))
+            continue;
+
+        const auto count = json_integer_value(json_object_get(value, "count"));
+        const auto sum = json_integer_value(json_object_get(value, "sum"));
+        if (!count)
+            continue;
+
+        json_int_t seen = 0;
+        json_int_t p90 = 0;
+        json_t *buckets = json_object_get(value, "buckets");
+        for (size_t i = 0; i < json_array_size(buckets); ++i)
+        {
+            seen += json_integer_value(json_array_get(buckets, i));
+            if (10 * seen >= 9 * count)
+            {
+                p90 = json_int_t(1) << i;
+                break;
+            }
+        }
+
+        std::cout << std::left << std::setw(48) << name << std::right <<
+                  std::setw(10) << count << std::setw(12) << sum / 1000 <<
+                  std::setw(10) << sum / count << std::setw(10) << p90 <<
+                  std::endl;
+    }
+
+    return Status();
+}
+
 /**
  * Launches and runs a watcher thread.
  */
@@ -191,3 +245,23 @@ COMMAND(InitLevel::wallet, WatcherSweep, "watcher-sweep",
 
     return Status();
 }
+
+COMMAND(InitLevel::wallet, WatcherProfile, "watcher-profile",
+        " <seconds>")
+{
+    if (argc != 1)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+    const auto seconds = atol(argv[0]);
+
+    {
+        WatcherThread thread;
+        ABC_CHECK(thread.init(session));
+
+        // The command stops with ctrl-c, or once the time is up:
+        signal(SIGINT, signalCallback);
+        for (long i = 0; running && i < seconds; ++i)
+            sleep(1);
+    }
+
+    return showProfile();
+}
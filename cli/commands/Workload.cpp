@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../Command.hpp"
+#include "../../abcd/account/Account.hpp"
+#include "../../abcd/json/JsonObject.hpp"
+#include "../../abcd/util/Workload.hpp"
+#include "../../src/ABC.h"
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace abcd;
+
+// Search queries are replayed as prefixes of this, at the recorded length,
+// which matches the payee names `fixture-create` writes:
+constexpr auto replayQuery = "payee payee payee payee payee payee payee ";
+
+/**
+ * Re-issues one recorded call against the logged-in account.
+ * @return false if the replayer does not know how to make this call.
+ */
+static bool
+replayCall(const Session &session, const WorkloadCall &call,
+           const std::string &wallet)
+{
+    const char *user = session.username.c_str();
+    const char *pass = session.password.c_str();
+    const char *uuid = wallet.c_str();
+    const auto &f = call.function;
+    tABC_Error error;
+    tABC_TxInfo **txs = nullptr;
+    unsigned int count = 0;
+
+    if ("ABC_GetTransactions" == f)
+    {
+        if (ABC_CC_Ok == ABC_GetTransactions(user, pass, uuid,
+                                             ABC_GET_TX_ALL_TIMES,
+                                             ABC_GET_TX_ALL_TIMES,
+                                             &txs, &count, &error))
+            ABC_FreeTransactions(txs, count);
+    }
+    else if ("ABC_GetTransactionsSummary" == f)
+    {
+        if (ABC_CC_Ok == ABC_GetTransactionsSummary(user, pass, uuid,
+                ABC_GET_TX_ALL_TIMES, ABC_GET_TX_ALL_TIMES,
+                &txs, &count, &error))
+            ABC_FreeTransactions(txs, count);
+    }
+    else if ("ABC_GetTransactionsArena" == f)
+    {
+        if (ABC_CC_Ok == ABC_GetTransactionsArena(user, pass, uuid,
+                ABC_GET_TX_ALL_TIMES, ABC_GET_TX_ALL_TIMES,
+                &txs, &count, &error))
+            ABC_FreeTransactionsArena(txs);
+    }
+    else if ("ABC_GetTransactionsPage" == f)
+    {
+        uint64_t revision = 0;
+        char **removed = nullptr;
+        unsigned int removedCount = 0;
+        if (ABC_CC_Ok == ABC_GetTransactionsPage(user, pass, uuid,
+                0, call.shape, 0, &revision, &txs, &count,
+                &removed, &removedCount, &error))
+        {
+            ABC_FreeTransactions(txs, count);
+            for (unsigned int i = 0; i < removedCount; ++i)
+                free(removed[i]);
+            free(removed);
+        }
+    }
+    else if ("ABC_GetTransactionsConfirming" == f)
+    {
+        unsigned int height = 0;
+        if (ABC_CC_Ok == ABC_GetTransactionsConfirming(user, pass, uuid, 0,
+                &height, &txs, &count, &error))
+            ABC_FreeTransactions(txs, count);
+    }
+    else if ("ABC_SearchTransactions" == f)
+    {
+        const std::string pattern = replayQuery;
+        const size_t length = std::max<int64_t>(call.shape, 0);
+        const auto query = pattern.substr(0, std::min(length, pattern.size()));
+        if (ABC_CC_Ok == ABC_SearchTransactions(user, pass, uuid,
+                query.c_str(), &txs, &count, &error))
+            ABC_FreeTransactions(txs, count);
+    }
+    else if ("ABC_WalletBalance" == f)
+    {
+        int64_t balance;
+        ABC_WalletBalance(user, uuid, &balance, &error);
+    }
+    else if ("ABC_WalletBalances" == f)
+    {
+        int64_t confirmed, unconfirmed, spendable;
+        ABC_WalletBalances(user, uuid, &confirmed, &unconfirmed, &spendable,
+                           &error);
+    }
+    else if ("ABC_DataSyncWallet" == f)
+    {
+        bool dirty;
+        ABC_DataSyncWallet(user, pass, uuid, &dirty, &error);
+    }
+    else if ("ABC_BlockHeight" == f)
+    {
+        int height;
+        ABC_BlockHeight(uuid, &height, &error);
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Picks the value below which the given fraction of samples fall.
+ * The samples must be sorted.
+ */
+static uint64_t
+percentile(const std::vector<uint64_t> &sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+    const size_t i = fraction * (sorted.size() - 1) + 0.5;
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+COMMAND(InitLevel::account, CliWorkloadReplay, "workload-replay",
+        " <file> [<speed>]")
+{
+    if (argc < 1 || 2 < argc)
+        return ABC_ERROR(ABC_CC_Error, helpString(*this));
+    const double speed = 1 < argc ? atof(argv[1]) : 1;
+
+    std::vector<WorkloadCall> calls;
+    ABC_CHECK(workloadLoad(calls, argv[0]));
+
+    // Recorded wallet numbers map onto this account's wallets, in order:
+    const auto list = session.account->wallets.list();
+    const std::vector<std::string> wallets(list.begin(), list.end());
+    if (wallets.empty())
+        return ABC_ERROR(ABC_CC_Error, "The account has no wallets");
+
+    // Each recorded thread gets its own thread again,
+    // so overlapping calls still overlap:
+    std::map<unsigned, std::vector<const WorkloadCall *>> threads;
+    for (const auto &call: calls)
+        threads[call.thread].push_back(&call);
+
+    std::mutex mutex;
+    std::map<std::string, std::vector<uint64_t>> replayed;
+    std::map<std::string, std::vector<uint64_t>> recorded;
+    std::atomic<size_t> skipped(0);
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (const auto &thread: threads)
+    {
+        const auto &todo = thread.second;
+        workers.emplace_back([&, todo]()
+        {
+            for (const auto call: todo)
+            {
+                if (call->wallet < 0)
+                {
+                    ++skipped;
+                    continue;
+                }
+                const auto &wallet = wallets[call->wallet % wallets.size()];
+
+                // A speed of zero runs the calls back to back:
+                if (0 < speed)
+                {
+                    const auto offset = uint64_t(call->start / speed);
+                    std::this_thread::sleep_until(
+                        begin + std::chrono::microseconds(offset));
+                }
+
+                const auto start = std::chrono::steady_clock::now();
+                if (!replayCall(session, *call, wallet))
+                {
+                    ++skipped;
+                    continue;
+                }
+                const uint64_t elapsed =
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                replayed[call->function].push_back(elapsed);
+                recorded[call->function].push_back(call->duration);
+            }
+        });
+    }
+    for (auto &worker: workers)
+        worker.join();
+
+    // Report the percentiles, next to the recorded ones for comparison:
+    JsonObject apis;
+    for (auto &i: replayed)
+    {
+        auto &times = i.second;
+        auto &before = recorded[i.first];
+        std::sort(times.begin(), times.end());
+        std::sort(before.begin(), before.end());
+
+        JsonObject api;
+        ABC_CHECK(api.set("count", json_int_t(times.size())));
+        ABC_CHECK(api.set("p50_us", json_int_t(percentile(times, 0.5))));
+        ABC_CHECK(api.set("p90_us", json_int_t(percentile(times, 0.9))));
+        ABC_CHECK(api.set("p99_us", json_int_t(percentile(times, 0.99))));
+        ABC_CHECK(api.set("max_us", json_int_t(times.back())));
+        ABC_CHECK(api.set("recorded_p50_us",
+                          json_int_t(percentile(before, 0.5))));
+        ABC_CHECK(api.set("recorded_p99_us",
+                          json_int_t(percentile(before, 0.99))));
+        ABC_CHECK(apis.set(i.first.c_str(), api));
+    }
+
+    JsonObject json;
+    ABC_CHECK(json.set("calls", json_int_t(calls.size())));
+    ABC_CHECK(json.set("skipped", json_int_t(skipped)));
+    ABC_CHECK(json.set("apis", apis));
+    std::cout << json.encode() << std::endl;
+
+    return Status();
+}
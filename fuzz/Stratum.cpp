@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A libFuzzer target for the Stratum reply parser and decoders.
+ *
+ * Each input is one message from a hostile server. The connection
+ * has one of each request outstanding, with ids 0 through 8, so
+ * replies can reach every decoder as well as the notification handlers.
+ */
+
+#include "../abcd/bitcoin/network/StratumConnection.hpp"
+#include <stdint.h>
+
+using namespace abcd;
+
+extern "C" int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    auto onError = [](Status s) {};
+
+    // Nothing listens on port 1, but requests queue up until the
+    // connection finishes, which never happens since we never wake it:
+    StratumConnection connection;
+    if (!connection.connect("stratum://127.0.0.1:1"))
+        return 0;
+    connection.heightSubscribe(onError, [](unsigned height) {});
+    connection.addressSubscribe(onError, [](const std::string &hash) {},
+                                "1BitcoinEaterAddressDontSendf59kuE");
+    connection.addressHistoryFetch(onError, [](const AddressHistory &) {},
+                                   "1BitcoinEaterAddressDontSendf59kuE", 0);
+    connection.txDataFetch(onError, [](const libbitcoin::transaction_type &) {},
+                           std::string(64, '0'));
+    connection.blockHeaderFetch(onError,
+                                [](const libbitcoin::block_header_type &) {}, 1);
+    connection.blockHeadersFetch(onError, [](const HeaderList &) {}, 1, 10);
+    connection.feeEstimateFetch(onError, [](double fee) {}, 2);
+    connection.sendTx(onError, DataSlice());
+
+    connection.inject(DataSlice(data, data + size));
+    return 0;
+}
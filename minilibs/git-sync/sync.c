@@ -10,7 +10,9 @@
 
 #include "sync.h"
 #include <git2/sys/commit.h> /* For git_commit_create_from_ids */
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define git_check(f) if ((e = f) < 0) goto exit;
 
@@ -320,6 +322,81 @@ exit:
     return e;
 }
 
+/**
+ * Creates a git tree object representing the state of the working directory,
+ * looking only at the listed paths.
+ * The index must match the master tree for this to work,
+ * since it supplies the state of every path not on the list.
+ * Falls back on a full rescan if that is not the case.
+ */
+static int sync_workdir_tree_paths(git_oid *out,
+                                   git_repository *repo,
+                                   const git_oid *master_tree,
+                                   const git_strarray *paths)
+{
+    int e = 0;
+    git_index *index = NULL;
+    char *full = NULL;
+    const char *workdir = git_repository_workdir(repo);
+    git_oid index_tree;
+    size_t i;
+
+    git_check(git_repository_index(&index, repo));
+    git_check(git_index_read(index, 0));
+    git_check(git_index_write_tree(&index_tree, index));
+    if (git_oid_cmp(&index_tree, master_tree))
+    {
+        git_index_free(index);
+        index = NULL;
+        git_check(sync_workdir_tree(out, repo));
+        goto exit;
+    }
+
+    for (i = 0; i < paths->count; ++i)
+    {
+        const char *path = paths->strings[i];
+        struct stat st;
+
+        full = malloc(strlen(workdir) + strlen(path) + 1);
+        if (!full)
+        {
+            e = -1;
+            goto exit;
+        }
+        strcpy(full, workdir);
+        strcat(full, path);
+
+        if (stat(full, &st))
+        {
+            // Gone, whether it was a file or a directory:
+            git_check(git_index_remove_bypath(index, path));
+            git_check(git_index_remove_directory(index, path, 0));
+        }
+        else if (S_ISDIR(st.st_mode))
+        {
+            char *spec[] = {(char *)path};
+            git_strarray specs = {spec, 1};
+            git_check(git_index_remove_directory(index, path, 0));
+            git_check(git_index_add_all(index, &specs, 0, NULL, NULL));
+        }
+        else
+        {
+            git_check(git_index_add_bypath(index, path));
+        }
+
+        free(full);
+        full = NULL;
+    }
+
+    git_check(git_index_write_tree(out, index));
+    git_check(git_index_write(index));
+
+exit:
+    if (full)           free(full);
+    if (index)          git_index_free(index);
+    return e;
+}
+
 /**
  * Fetches the contents of the server into the "incoming" branch.
  */
@@ -344,9 +421,10 @@ exit:
  * Updates the master branch with the latest changes, including local
  * changes and changes from the remote repository.
  */
-int sync_master(git_repository *repo,
-                int *files_changed,
-                int *need_push)
+static int sync_master_impl(git_repository *repo,
+                            const git_strarray *paths,
+                            int *files_changed,
+                            int *need_push)
 {
     int e = 0;
     git_oid master_id = {{0}};
@@ -355,6 +433,8 @@ int sync_master(git_repository *repo,
     int master_dirty = 0;
     int remote_dirty = 0;
     int local_dirty = 0;
+    int have_local_tree = 0;
+    git_oid local_tree;
 
     // Find the relevant commit objects:
     git_check(sync_lookup_soft(&master_id, repo, SYNC_REF_MASTER));
@@ -371,21 +451,31 @@ int sync_master(git_repository *repo,
     // Figure out what needs syncing:
     master_dirty = git_oid_cmp(&master_id, &base_id);
     remote_dirty = git_oid_cmp(&remote_id, &base_id);
-    git_check(sync_local_dirty(&local_dirty, repo, &master_id));
+    if (paths && !git_repository_is_bare(repo))
+    {
+        git_oid master_tree;
+        git_check(sync_get_tree(&master_tree, repo, &master_id));
+        git_check(sync_workdir_tree_paths(&local_tree, repo, &master_tree, paths));
+        local_dirty = !!git_oid_cmp(&local_tree, &master_tree);
+        have_local_tree = 1;
+    }
+    else
+    {
+        git_check(sync_local_dirty(&local_dirty, repo, &master_id));
+    }
 
     if (remote_dirty)
     {
         if (master_dirty || local_dirty)
         {
             // 3-way merge:
-            git_oid local_tree;
             git_oid base_tree;
             git_oid remote_tree;
-            if (local_dirty)
+            if (!have_local_tree && local_dirty)
             {
                 git_check(sync_workdir_tree(&local_tree, repo));
             }
-            else
+            else if (!have_local_tree)
             {
                 git_check(sync_get_tree(&local_tree, repo, &master_id));
             }
@@ -423,8 +513,10 @@ int sync_master(git_repository *repo,
     else if (local_dirty)
     {
         // Commit local changes:
-        git_oid local_tree;
-        git_check(sync_workdir_tree(&local_tree, repo));
+        if (!have_local_tree)
+        {
+            git_check(sync_workdir_tree(&local_tree, repo));
+        }
         if (git_oid_iszero(&master_id))
         {
             const git_oid *parents[] = {NULL};
@@ -445,6 +537,21 @@ exit:
     return e;
 }
 
+int sync_master(git_repository *repo,
+                int *files_changed,
+                int *need_push)
+{
+    return sync_master_impl(repo, NULL, files_changed, need_push);
+}
+
+int sync_master_paths(git_repository *repo,
+                      const git_strarray *paths,
+                      int *files_changed,
+                      int *need_push)
+{
+    return sync_master_impl(repo, paths, files_changed, need_push);
+}
+
 /**
  * Pushes the master branch to the server.
  */
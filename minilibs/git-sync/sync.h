@@ -34,6 +34,17 @@ int sync_master(git_repository *repo,
                 int *files_changed,
                 int *need_push);
 
+/**
+ * Like `sync_master`, but only looks at the listed workdir paths
+ * for local changes, rather than scanning the whole directory.
+ * The caller must know that nothing else has changed since the last sync.
+ * @param paths changed files or directories, relative to the workdir.
+ */
+int sync_master_paths(git_repository *repo,
+                      const git_strarray *paths,
+                      int *files_changed,
+                      int *need_push);
+
 /**
  * Pushes the master branch to the server.
  */
@@ -261,6 +261,27 @@ void obelisk_codec::subscribe(error_handler on_error,
         std::bind(decode_empty, _1, std::move(on_reply)));
 }
 
+void obelisk_codec::renew(error_handler on_error,
+    empty_handler on_reply,
+    subscribe_type discriminator,
+    const binary_type& prefix)
+{
+    if (prefix.size() > max_uint8)
+    {
+        on_error(std::make_error_code(std::errc::bad_address));
+        return;
+    }
+
+    auto data = build_data({
+        to_byte(static_cast<uint8_t>(discriminator)),
+        to_byte(static_cast<uint8_t>(prefix.size())),
+        prefix.blocks()
+    });
+
+    send_request("address.renew", data, std::move(on_error),
+        std::bind(decode_empty, _1, std::move(on_reply)));
+}
+
 // See below for description of updates data format.
 //enum class subscribe_type : uint8_t
 //{
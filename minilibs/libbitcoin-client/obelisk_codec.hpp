@@ -112,6 +112,10 @@ public:
         empty_handler on_reply,
         subscribe_type discriminator,
         const bc::binary_type& prefix);
+    void renew(error_handler on_error,
+        empty_handler on_reply,
+        subscribe_type discriminator,
+        const bc::binary_type& prefix);
 
 private:
     static void decode_empty(data_deserial& payload,
@@ -117,37 +117,53 @@ void obelisk_router::write(const data_stack& data)
 
 period_ms obelisk_router::wakeup()
 {
-    period_ms next_wakeup(0);
     auto now = std::chrono::steady_clock::now();
 
-    auto i = pending_requests_.begin();
-    while (i != pending_requests_.end())
+    while (!deadlines_.empty())
     {
-        auto request = i++;
-        auto elapsed = std::chrono::duration_cast<period_ms>(
-            now - request->second.last_action);
-        if (timeout_ <= elapsed)
+        const auto entry = deadlines_.front();
+
+        // Skip requests that have been answered or re-sent since:
+        auto request = pending_requests_.find(entry.id);
+        if (request == pending_requests_.end() ||
+            request->second.deadline != entry.deadline)
         {
-            if (request->second.retries < retries_)
-            {
-                // Resend:
-                ++request->second.retries;
-                request->second.last_action = now;
-                next_wakeup = min_sleep(next_wakeup, timeout_);
-                send(request->second.message);
-            }
-            else
-            {
-                // Cancel:
-                auto ec = std::make_error_code(std::errc::timed_out);
-                request->second.on_error(ec);
-                pending_requests_.erase(request);
-            }
+            deadlines_.pop_front();
+            continue;
+        }
+
+        if (now < entry.deadline)
+        {
+            // Round up, so we don't wake up just before the deadline:
+            auto left = std::chrono::duration_cast<period_ms>(
+                entry.deadline - now) + period_ms(1);
+            return left;
+        }
+        deadlines_.pop_front();
+
+        if (request->second.retries < retries_)
+        {
+            // Resend:
+            ++request->second.retries;
+            schedule(request->second, now);
+            send(request->second.message);
         }
         else
-            next_wakeup = min_sleep(next_wakeup, timeout_ - elapsed);
+        {
+            // Cancel:
+            auto on_error = std::move(request->second.on_error);
+            pending_requests_.erase(request);
+            on_error(std::make_error_code(std::errc::timed_out));
+        }
     }
-    return next_wakeup;
+    return period_ms(0);
+}
+
+void obelisk_router::schedule(pending_request& request, time_point now)
+{
+    request.deadline = now + timeout_;
+    deadlines_.push_back(deadline_entry{request.deadline,
+        request.message.id});
 }
 
 void obelisk_router::send_request(const std::string& command,
@@ -160,7 +176,7 @@ void obelisk_router::send_request(const std::string& command,
     request.on_error = std::move(on_error);
     request.on_reply = std::move(on_reply);
     request.retries = 0;
-    request.last_action = std::chrono::steady_clock::now();
+    schedule(request, std::chrono::steady_clock::now());
     send(request.message);
 }
 
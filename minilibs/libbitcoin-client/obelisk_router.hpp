@@ -20,8 +20,9 @@
 #ifndef LIBBITCOIN_CLIENT_OBELISK_OBELISK_ROUTER_HPP
 #define LIBBITCOIN_CLIENT_OBELISK_OBELISK_ROUTER_HPP
 
+#include <deque>
 #include <functional>
-#include <map>
+#include <unordered_map>
 #include "message_stream.hpp"
 #include "sleeper.hpp"
 
@@ -113,6 +114,7 @@ protected:
     static void check_end(data_deserial& payload);
 
     // Request management:
+    typedef std::chrono::steady_clock::time_point time_point;
     uint32_t last_request_id_;
     struct pending_request
     {
@@ -120,9 +122,25 @@ protected:
         error_handler on_error;
         decoder on_reply;
         unsigned retries;
-        std::chrono::steady_clock::time_point last_action;
+        time_point deadline;
     };
-    std::map<uint32_t, pending_request> pending_requests_;
+    std::unordered_map<uint32_t, pending_request> pending_requests_;
+
+    /**
+     * Request deadlines, in the order they were set.
+     * Every request shares the same timeout, so this stays sorted,
+     * and wakeups only need to look at the expired entries up front.
+     * Entries for requests that were answered or re-sent are left behind,
+     * and get skipped once they reach the front.
+     */
+    struct deadline_entry
+    {
+        time_point deadline;
+        uint32_t id;
+    };
+    std::deque<deadline_entry> deadlines_;
+
+    void schedule(pending_request& request, time_point now);
 
     // Timeout parameters:
     period_ms timeout_;
@@ -35,6 +35,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* Most threads a single derivation will use for its lanes: */
+#define LANES_THREADS_MAX 8
+
+/*
+ * SIMD kernels replace the portable smix where the compiler can build them.
+ * SSE2 is picked at run time on x86; NEON is part of the ARM build target.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCRYPT_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCRYPT_NEON
+#include <arm_neon.h>
+#endif
 
 static void blkcpy(uint8_t *, uint8_t *, size_t);
 static void blkxor(uint8_t *, uint8_t *, size_t);
@@ -201,12 +219,424 @@ smix(uint8_t * B, size_t r, uint64_t N, uint8_t * V, uint8_t * XY)
 	blkcpy(B, X, 128 * r);
 }
 
+#if defined(SCRYPT_SSE2) || defined(SCRYPT_NEON)
+/*
+ * The SIMD kernels keep each 64-byte block as 16 native-endian words in the
+ * diagonal order (word i holds input word i * 5 % 16) from Colin Percival's
+ * SSE2 scrypt, so each Salsa20/8 column or row sits in one vector register.
+ */
+
+/**
+ * blockmix_fn(Bin, Bxor, Bout, r):
+ * Compute Bout = BlockMix_{salsa20/8, r}(Bin \xor Bxor), with Bxor optional.
+ * All three are 32r words in the diagonal order, and must not overlap.
+ */
+typedef void (*blockmix_fn)(const uint32_t *, const uint32_t *, uint32_t *,
+    size_t);
+
+#ifdef SCRYPT_SSE2
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define ROTL_SSE2(a, b) \
+	_mm_xor_si128(_mm_slli_epi32((a), (b)), _mm_srli_epi32((a), 32 - (b)))
+
+/**
+ * salsa20_8_sse2(X):
+ * Apply the salsa20/8 core to a block held in four registers.
+ */
+static inline void SSE2_TARGET
+salsa20_8_sse2(__m128i X[4])
+{
+	__m128i X0 = X[0], X1 = X[1], X2 = X[2], X3 = X[3];
+	size_t i;
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on "columns". */
+		X1 = _mm_xor_si128(X1, ROTL_SSE2(_mm_add_epi32(X0, X3), 7));
+		X2 = _mm_xor_si128(X2, ROTL_SSE2(_mm_add_epi32(X1, X0), 9));
+		X3 = _mm_xor_si128(X3, ROTL_SSE2(_mm_add_epi32(X2, X1), 13));
+		X0 = _mm_xor_si128(X0, ROTL_SSE2(_mm_add_epi32(X3, X2), 18));
+
+		/* Rearrange data. */
+		X1 = _mm_shuffle_epi32(X1, 0x93);
+		X2 = _mm_shuffle_epi32(X2, 0x4E);
+		X3 = _mm_shuffle_epi32(X3, 0x39);
+
+		/* Operate on "rows". */
+		X3 = _mm_xor_si128(X3, ROTL_SSE2(_mm_add_epi32(X0, X1), 7));
+		X2 = _mm_xor_si128(X2, ROTL_SSE2(_mm_add_epi32(X3, X0), 9));
+		X1 = _mm_xor_si128(X1, ROTL_SSE2(_mm_add_epi32(X2, X3), 13));
+		X0 = _mm_xor_si128(X0, ROTL_SSE2(_mm_add_epi32(X1, X2), 18));
+
+		/* Rearrange data. */
+		X1 = _mm_shuffle_epi32(X1, 0x39);
+		X2 = _mm_shuffle_epi32(X2, 0x4E);
+		X3 = _mm_shuffle_epi32(X3, 0x93);
+	}
+
+	X[0] = _mm_add_epi32(X[0], X0);
+	X[1] = _mm_add_epi32(X[1], X1);
+	X[2] = _mm_add_epi32(X[2], X2);
+	X[3] = _mm_add_epi32(X[3], X3);
+}
+
+static inline void SSE2_TARGET
+load_sse2(__m128i X[4], const uint32_t * B, const uint32_t * Bxor)
+{
+	size_t k;
+
+	for (k = 0; k < 4; k++) {
+		X[k] = _mm_xor_si128(X[k],
+		    _mm_loadu_si128((const __m128i *)&B[4 * k]));
+		if (Bxor)
+			X[k] = _mm_xor_si128(X[k],
+			    _mm_loadu_si128((const __m128i *)&Bxor[4 * k]));
+	}
+}
+
+static void SSE2_TARGET
+blockmix_salsa8_sse2(const uint32_t * Bin, const uint32_t * Bxor,
+    uint32_t * Bout, size_t r)
+{
+	__m128i X[4];
+	size_t i, k;
+
+	/* 1: X <-- B_{2r - 1} */
+	X[0] = X[1] = X[2] = X[3] = _mm_setzero_si128();
+	load_sse2(X, &Bin[(2 * r - 1) * 16],
+	    Bxor ? &Bxor[(2 * r - 1) * 16] : NULL);
+
+	/* 2: for i = 0 to 2r - 1 do */
+	for (i = 0; i < 2 * r; i++) {
+		/* 3: X <-- H(X \xor B_i) */
+		load_sse2(X, &Bin[i * 16], Bxor ? &Bxor[i * 16] : NULL);
+		salsa20_8_sse2(X);
+
+		/* 4, 6: Even blocks go in the first half, odd in the second. */
+		for (k = 0; k < 4; k++)
+			_mm_storeu_si128((__m128i *)
+			    &Bout[((i & 1) * r + i / 2) * 16 + 4 * k], X[k]);
+	}
+}
+
+#undef ROTL_SSE2
+#endif /* SCRYPT_SSE2 */
+
+#ifdef SCRYPT_NEON
+#define ROTL_NEON(a, b) vsliq_n_u32(vshrq_n_u32((a), 32 - (b)), (a), (b))
+
+/**
+ * salsa20_8_neon(X):
+ * Apply the salsa20/8 core to a block held in four registers.
+ */
+static inline void
+salsa20_8_neon(uint32x4_t X[4])
+{
+	uint32x4_t X0 = X[0], X1 = X[1], X2 = X[2], X3 = X[3];
+	size_t i;
+
+	for (i = 0; i < 8; i += 2) {
+		/* Operate on "columns". */
+		X1 = veorq_u32(X1, ROTL_NEON(vaddq_u32(X0, X3), 7));
+		X2 = veorq_u32(X2, ROTL_NEON(vaddq_u32(X1, X0), 9));
+		X3 = veorq_u32(X3, ROTL_NEON(vaddq_u32(X2, X1), 13));
+		X0 = veorq_u32(X0, ROTL_NEON(vaddq_u32(X3, X2), 18));
+
+		/* Rearrange data. */
+		X1 = vextq_u32(X1, X1, 3);
+		X2 = vextq_u32(X2, X2, 2);
+		X3 = vextq_u32(X3, X3, 1);
+
+		/* Operate on "rows". */
+		X3 = veorq_u32(X3, ROTL_NEON(vaddq_u32(X0, X1), 7));
+		X2 = veorq_u32(X2, ROTL_NEON(vaddq_u32(X3, X0), 9));
+		X1 = veorq_u32(X1, ROTL_NEON(vaddq_u32(X2, X3), 13));
+		X0 = veorq_u32(X0, ROTL_NEON(vaddq_u32(X1, X2), 18));
+
+		/* Rearrange data. */
+		X1 = vextq_u32(X1, X1, 1);
+		X2 = vextq_u32(X2, X2, 2);
+		X3 = vextq_u32(X3, X3, 3);
+	}
+
+	X[0] = vaddq_u32(X[0], X0);
+	X[1] = vaddq_u32(X[1], X1);
+	X[2] = vaddq_u32(X[2], X2);
+	X[3] = vaddq_u32(X[3], X3);
+}
+
+static inline void
+load_neon(uint32x4_t X[4], const uint32_t * B, const uint32_t * Bxor)
+{
+	size_t k;
+
+	for (k = 0; k < 4; k++) {
+		X[k] = veorq_u32(X[k], vld1q_u32(&B[4 * k]));
+		if (Bxor)
+			X[k] = veorq_u32(X[k], vld1q_u32(&Bxor[4 * k]));
+	}
+}
+
+static void
+blockmix_salsa8_neon(const uint32_t * Bin, const uint32_t * Bxor,
+    uint32_t * Bout, size_t r)
+{
+	uint32x4_t X[4];
+	size_t i, k;
+
+	/* 1: X <-- B_{2r - 1} */
+	X[0] = X[1] = X[2] = X[3] = vdupq_n_u32(0);
+	load_neon(X, &Bin[(2 * r - 1) * 16],
+	    Bxor ? &Bxor[(2 * r - 1) * 16] : NULL);
+
+	/* 2: for i = 0 to 2r - 1 do */
+	for (i = 0; i < 2 * r; i++) {
+		/* 3: X <-- H(X \xor B_i) */
+		load_neon(X, &Bin[i * 16], Bxor ? &Bxor[i * 16] : NULL);
+		salsa20_8_neon(X);
+
+		/* 4, 6: Even blocks go in the first half, odd in the second. */
+		for (k = 0; k < 4; k++)
+			vst1q_u32(&Bout[((i & 1) * r + i / 2) * 16 + 4 * k], X[k]);
+	}
+}
+
+#undef ROTL_NEON
+#endif /* SCRYPT_NEON */
+
+/**
+ * blockmix_select():
+ * Return the fastest BlockMix this machine supports, or NULL if only the
+ * portable smix will do.
+ */
+static blockmix_fn
+blockmix_select(void)
+{
+#ifdef SCRYPT_SSE2
+	if (__builtin_cpu_supports("sse2"))
+		return (blockmix_salsa8_sse2);
+#endif
+#ifdef SCRYPT_NEON
+	return (blockmix_salsa8_neon);
+#endif
+	return (NULL);
+}
+
+/**
+ * smix_simd(B, r, N, V, XY, blockmix):
+ * Compute B = SMix_r(B, N) like smix, using the given SIMD BlockMix.  The
+ * temporary storage V must be 32rN words; XY must be 64r words.
+ */
+static void
+smix_simd(uint8_t * B, size_t r, uint64_t N, uint32_t * V, uint32_t * XY,
+    blockmix_fn blockmix)
+{
+	uint32_t * X = XY;
+	uint32_t * Y = &XY[32 * r];
+	uint32_t * T;
+	uint32_t * Xlast;
+	uint64_t i;
+	uint64_t j;
+	size_t k;
+	size_t w;
+
+	/* 1: X <-- B, in diagonal order */
+	for (k = 0; k < 2 * r; k++)
+		for (w = 0; w < 16; w++)
+			X[k * 16 + w] = le32dec(&B[(k * 16 + (w * 5 % 16)) * 4]);
+
+	/* 2: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i++) {
+		/* 3: V_i <-- X */
+		memcpy(&V[i * (32 * r)], X, 128 * r);
+
+		/* 4: X <-- H(X) */
+		blockmix(X, NULL, Y, r);
+		T = X; X = Y; Y = T;
+	}
+
+	/* 6: for i = 0 to N - 1 do */
+	for (i = 0; i < N; i++) {
+		/* 7: j <-- Integerify(X) mod N; words 0 and 1 sit at 0 and 13 */
+		Xlast = &X[(2 * r - 1) * 16];
+		j = (((uint64_t)(Xlast[13]) << 32) + Xlast[0]) & (N - 1);
+
+		/* 8: X <-- H(X \xor V_j) */
+		blockmix(X, &V[j * (32 * r)], Y, r);
+		T = X; X = Y; Y = T;
+	}
+
+	/* 10: B' <-- X, in the original order */
+	for (k = 0; k < 2 * r; k++)
+		for (w = 0; w < 16; w++)
+			le32enc(&B[(k * 16 + (w * 5 % 16)) * 4], X[k * 16 + w]);
+}
+#endif /* SCRYPT_SSE2 || SCRYPT_NEON */
+
+/*
+ * Scratch buffers are kept between calls, so back-to-back derivations
+ * skip the page faults of mapping a fresh V.  Cached buffers are wiped,
+ * since V_0 is only one PBKDF2 round away from the password.
+ */
+#define ARENA_SLOTS 4
+#define ARENA_MAX ((size_t)32 * 1024 * 1024)
+
+/* Lanes only run in parallel while their V buffers fit in this: */
+#define LANES_MEMORY_MAX ((size_t)256 * 1024 * 1024)
+
+static pthread_mutex_t arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+static void * arena_buffers[ARENA_SLOTS];
+static size_t arena_sizes[ARENA_SLOTS];
+
+/**
+ * arena_take(size):
+ * Return a buffer of at least size bytes, from the cache if possible.
+ */
+static void *
+arena_take(size_t size)
+{
+	void * out = NULL;
+	size_t i;
+	size_t best = ARENA_SLOTS;
+
+	pthread_mutex_lock(&arena_mutex);
+	for (i = 0; i < ARENA_SLOTS; i++) {
+		if (arena_buffers[i] && size <= arena_sizes[i] &&
+		    (best == ARENA_SLOTS || arena_sizes[i] < arena_sizes[best]))
+			best = i;
+	}
+	if (best < ARENA_SLOTS) {
+		out = arena_buffers[best];
+		arena_buffers[best] = NULL;
+	}
+	pthread_mutex_unlock(&arena_mutex);
+
+	return (out ? out : malloc(size));
+}
+
+/**
+ * arena_give(buffer, size):
+ * Wipe a buffer from arena_take and cache it, or free it if the cache
+ * is full.
+ */
+static void
+arena_give(void * buffer, size_t size)
+{
+	size_t i;
+	size_t total = size;
+	size_t slot = ARENA_SLOTS;
+
+	if (buffer == NULL)
+		return;
+	memset(buffer, 0, size);
+
+	pthread_mutex_lock(&arena_mutex);
+	for (i = 0; i < ARENA_SLOTS; i++) {
+		if (arena_buffers[i])
+			total += arena_sizes[i];
+		else
+			slot = i;
+	}
+	if (slot < ARENA_SLOTS && total <= ARENA_MAX) {
+		arena_buffers[slot] = buffer;
+		arena_sizes[slot] = size;
+		buffer = NULL;
+	}
+	pthread_mutex_unlock(&arena_mutex);
+
+	free(buffer);
+}
+
+void
+crypto_scrypt_arena_free(void)
+{
+	size_t i;
+
+	pthread_mutex_lock(&arena_mutex);
+	for (i = 0; i < ARENA_SLOTS; i++) {
+		free(arena_buffers[i]);
+		arena_buffers[i] = NULL;
+	}
+	pthread_mutex_unlock(&arena_mutex);
+}
+
+/* A share of the lanes for one thread to work through. */
+struct lanes_job {
+	uint8_t * B;
+	size_t r;
+	uint64_t N;
+	uint32_t first;
+	uint32_t step;
+	uint32_t p;
+	int rc;
+};
+
+/**
+ * lanes_run(job):
+ * Compute B_i <-- MF(B_i, N) for every lane i = first, first + step, ...
+ */
+static void *
+lanes_run(void * arg)
+{
+	struct lanes_job * job = arg;
+	size_t r = job->r;
+	size_t Vsize = (size_t)(128 * r * job->N);
+	uint8_t * V;
+	uint8_t * XY;
+	uint32_t i;
+#if defined(SCRYPT_SSE2) || defined(SCRYPT_NEON)
+	blockmix_fn blockmix = blockmix_select();
+#endif
+
+	job->rc = -1;
+	if ((XY = malloc(256 * r)) == NULL)
+		return (NULL);
+	if ((V = arena_take(Vsize)) == NULL) {
+		free(XY);
+		return (NULL);
+	}
+
+	for (i = job->first; i < job->p; i += job->step) {
+		/* 3: B_i <-- MF(B_i, N) */
+#if defined(SCRYPT_SSE2) || defined(SCRYPT_NEON)
+		if (blockmix) {
+			smix_simd(&job->B[i * 128 * r], r, job->N, (uint32_t *)V,
+			    (uint32_t *)XY, blockmix);
+			continue;
+		}
+#endif
+		smix(&job->B[i * 128 * r], r, job->N, V, XY);
+	}
+
+	arena_give(V, Vsize);
+	free(XY);
+	job->rc = 0;
+	return (NULL);
+}
+
+/**
+ * lanes_threads(r, N, p):
+ * Decide how many threads should share the p lanes.
+ */
+static uint32_t
+lanes_threads(size_t r, uint64_t N, uint32_t p)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t fit = LANES_MEMORY_MAX / ((uint64_t)128 * r * N);
+	uint32_t out = p;
+
+	if (cpus > 0 && (uint64_t)cpus < out)
+		out = (uint32_t)cpus;
+	if (fit < out)
+		out = (uint32_t)fit;
+	return (out ? out : 1);
+}
+
 /**
  * crypto_scrypt(passwd, passwdlen, salt, saltlen, N, r, p, buf, buflen):
  * Compute scrypt(passwd[0 .. passwdlen - 1], salt[0 .. saltlen - 1], N, r,
  * p, buflen) and write the result into buf.  The parameters r, p, and buflen
  * must satisfy r * p < 2^30 and buflen <= (2^32 - 1) * 32.  The parameter N
- * must be a power of 2.
+ * must be a power of 2.  Independent lanes run on separate threads.
  *
  * Return 0 on success; or -1 on error.
  */
@@ -216,9 +646,12 @@ crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
     uint8_t * buf, size_t buflen)
 {
 	uint8_t * B;
-	uint8_t * V;
-	uint8_t * XY;
-	uint32_t i;
+	struct lanes_job jobs[LANES_THREADS_MAX];
+	pthread_t threads[LANES_THREADS_MAX];
+	int started[LANES_THREADS_MAX];
+	uint32_t nthreads;
+	uint32_t t;
+	int rc = 0;
 
 	/* Sanity-check parameters. */
 #if SIZE_MAX > UINT32_MAX
@@ -247,37 +680,53 @@ crypto_scrypt(const uint8_t * passwd, size_t passwdlen,
 	/* Allocate memory. */
 	if ((B = malloc(128 * r * p)) == NULL)
 		goto err0;
-	if ((XY = malloc(256 * r)) == NULL)
-		goto err1;
-	if ((V = malloc((unsigned long)((uint64_t) 128 * r * (uint64_t) N))) == NULL)
-		goto err2;
 
 	/* 1: (B_0 ... B_{p-1}) <-- PBKDF2(P, S, 1, p * MFLen) */
 	if (!PKCS5_PBKDF2_HMAC((char *)passwd, passwdlen, salt, saltlen,
 		1, EVP_sha256(), p * 128 * r, B))
-		goto err2;
+		goto err1;
 
-	/* 2: for i = 0 to p - 1 do */
-	for (i = 0; i < p; i++) {
-		/* 3: B_i <-- MF(B_i, N) */
-		smix(&B[i * 128 * r], r, N, V, XY);
+	/* 2: for i = 0 to p - 1 do, spread over the threads */
+	nthreads = lanes_threads(r, N, p);
+	if (nthreads > LANES_THREADS_MAX)
+		nthreads = LANES_THREADS_MAX;
+	for (t = 0; t < nthreads; t++) {
+		jobs[t].B = B;
+		jobs[t].r = r;
+		jobs[t].N = N;
+		jobs[t].first = t;
+		jobs[t].step = nthreads;
+		jobs[t].p = p;
+		jobs[t].rc = 0;
+		started[t] = t != 0 &&
+		    pthread_create(&threads[t], NULL, lanes_run, &jobs[t]) == 0;
+	}
+
+	/* The calling thread takes the first share, plus any that failed: */
+	for (t = 0; t < nthreads; t++) {
+		if (!started[t])
+			lanes_run(&jobs[t]);
 	}
+	for (t = 0; t < nthreads; t++) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+		if (jobs[t].rc)
+			rc = -1;
+	}
+	if (rc)
+		goto err1;
 
 	/* 5: DK <-- PBKDF2(P, B, 1, dkLen) */
 	if (!PKCS5_PBKDF2_HMAC((char *)passwd, passwdlen, B, p * 128 * r,
 		1, EVP_sha256(), buflen, buf))
-		goto err2;
+		goto err1;
 
 	/* Free memory. */
-	free(V);
-	free(XY);
 	free(B);
 
 	/* Success! */
 	return (0);
 
-err2:
-	free(XY);
 err1:
 	free(B);
 err0:
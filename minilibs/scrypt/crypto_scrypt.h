@@ -48,6 +48,12 @@ extern "C" {
 int crypto_scrypt(const uint8_t *, size_t, const uint8_t *, size_t, uint64_t,
     uint32_t, uint32_t, uint8_t *, size_t);
 
+/**
+ * crypto_scrypt_arena_free():
+ * Release the scratch buffers crypto_scrypt keeps between calls.
+ */
+void crypto_scrypt_arena_free(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,8 +14,10 @@
 #include "../abcd/Context.hpp"
 #include "../abcd/General.hpp"
 #include "../abcd/Export.hpp"
+#include "../abcd/QrCode.hpp"
 #include "../abcd/account/Account.hpp"
 #include "../abcd/account/AccountSettings.hpp"
+#include "../abcd/account/AccountSummary.hpp"
 #include "../abcd/account/AccountCategories.hpp"
 #include "../abcd/account/PluginData.hpp"
 #include "../abcd/bitcoin/Testnet.hpp"
@@ -23,13 +25,18 @@
 #include "../abcd/bitcoin/cache/Cache.hpp"
 #include "../abcd/bitcoin/WatcherBridge.hpp"
 #include "../abcd/bitcoin/spend/AirbitzFee.hpp"
+#include "../abcd/bitcoin/spend/Batch.hpp"
+#include "../abcd/bitcoin/spend/Bump.hpp"
+#include "../abcd/bitcoin/spend/Consolidate.hpp"
 #include "../abcd/bitcoin/spend/PaymentProto.hpp"
 #include "../abcd/bitcoin/spend/Spend.hpp"
 #include "../abcd/crypto/Encoding.hpp"
 #include "../abcd/crypto/Random.hpp"
+#include "../abcd/crypto/Scrypt.hpp"
 #include "../abcd/exchange/ExchangeCache.hpp"
 #include "../abcd/http/Http.hpp"
 #include "../abcd/http/Uri.hpp"
+#include "../abcd/json/JsonBox.hpp"
 #include "../abcd/login/Sharing.hpp"
 #include "../abcd/login/Bitid.hpp"
 #include "../abcd/login/Login.hpp"
@@ -45,24 +52,41 @@
 #include "../abcd/login/server/LoginServer.hpp"
 #include "../abcd/util/Debug.hpp"
 #include "../abcd/util/FileIO.hpp"
+#include "../abcd/util/Metrics.hpp"
+#include "../abcd/util/Parallel.hpp"
 #include "../abcd/util/Sync.hpp"
+#include "../abcd/util/SyncScheduler.hpp"
+#include "../abcd/util/TaskPool.hpp"
+#include "../abcd/util/Trace.hpp"
 #include "../abcd/util/Util.hpp"
+#include "../abcd/util/Workload.hpp"
+#include "../abcd/util/WriteQueue.hpp"
 #include "../abcd/wallet/Wallet.hpp"
-#include <qrencode.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
 #include <math.h>
+#include <unistd.h>
+#include <thread>
 
 using namespace abcd;
 
+// Times the call into "api.<function>_us" and the slow-call log:
+#define ABC_CALL_TIMER() \
+    static auto &abcCallTime = \
+        metricHistogram(std::string("api.") + __FUNCTION__ + "_us"); \
+    MetricCall abcCall(__FUNCTION__, abcCallTime)
+
 #define ABC_PROLOG() \
+    ABC_CALL_TIMER(); \
     ABC_DebugLog("%s called", __FUNCTION__); \
     tABC_CC cc = ABC_CC_Ok; \
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok); \
     ABC_CHECK_ASSERT(gContext, ABC_CC_NotInitialized, "The core library has not been initalized")
 
 #define ABC_PROLOG_QUIET() \
+    ABC_CALL_TIMER(); \
     tABC_CC cc = ABC_CC_Ok; \
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok); \
     ABC_CHECK_ASSERT(gContext, ABC_CC_NotInitialized, "The core library has not been initalized")
@@ -81,11 +105,18 @@ using namespace abcd;
 
 #define ABC_GET_WALLET() \
     std::shared_ptr<Wallet> wallet; \
-    ABC_CHECK_NEW(cacheWallet(wallet, szUserName, szWalletUUID));
+    ABC_CHECK_NEW(cacheWallet(wallet, szUserName, szWalletUUID)); \
+    abcCall.walletSet(wallet->id())
 
 #define ABC_GET_WALLET_N() \
     std::shared_ptr<Wallet> wallet; \
-    ABC_CHECK_NEW(cacheWallet(wallet, nullptr, szWalletUUID));
+    ABC_CHECK_NEW(cacheWallet(wallet, nullptr, szWalletUUID)); \
+    abcCall.walletSet(wallet->id())
+
+#define ABC_GET_WALLET_H() \
+    std::shared_ptr<Wallet> wallet; \
+    ABC_CHECK_NEW(gWalletHandles.find(wallet, hWallet)); \
+    abcCall.walletSet(wallet->id())
 
 /** Helper macro for ABC_GetCurrencies. */
 #define CURRENCY_GUI_ROW(code, number, name) {#code, number, name, ""},
@@ -120,11 +151,16 @@ tABC_CC ABC_Initialize(const char               *szRootDir,
 
         // initialize logging
         ABC_CHECK_NEW(debugInitialize());
+        traceInitialize(gContext->paths.tracePath(),
+                        gContext->paths.tracePrevPath()).log();
 
         ABC_CHECK_NEW(randomInitialize(DataSlice(pSeedData, pSeedData + seedLength)));
 
         ABC_CHECK_NEW(httpInit());
         ABC_CHECK_NEW(syncInit(szCaCertPath));
+
+        // The background loads can reach the network, so they go last:
+        gContext->startup();
     }
 
 exit:
@@ -143,11 +179,20 @@ void ABC_Terminate()
     // Cannot use ABC_PROLOG - no pError
     if (gContext)
     {
+        // Asynchronous requests still need the context:
+        taskPoolStop();
+
+        writeQueueFlush().log();
         ABC_ClearKeyCache(NULL);
         gContext.reset();
+        scryptArenaFree();
+
+        // Wallets shutting down may have queued their final cache saves:
+        writeQueueFlush().log();
 
         syncTerminate();
 
+        traceTerminate();
         debugTerminate();
     }
 }
@@ -157,6 +202,100 @@ void ABC_Log(const char *szMessage)
     ABC_DebugLog("%s", szMessage);
 }
 
+void ABC_SetLogLevel(int level)
+{
+    debugLevelSet(level);
+}
+
+void ABC_SetCompressionThreshold(unsigned int bytes)
+{
+    jsonBoxCompressionSet(bytes);
+}
+
+void ABC_SetSyncCacheLimits(unsigned int objectCacheBytes,
+                            unsigned int mappedBytes)
+{
+    syncCacheLimitsSet(objectCacheBytes, mappedBytes);
+}
+
+void ABC_SetHistoryPruning(unsigned int depth)
+{
+    txCachePruneDepthSet(depth);
+}
+
+void ABC_SetSlowCallThreshold(unsigned int milliseconds)
+{
+    metricSlowThresholdSet(std::chrono::milliseconds(milliseconds));
+}
+
+tABC_CC ABC_RecordWorkload(const char *szPath,
+                           tABC_Error *pError)
+{
+    // Cannot use ABC_PROLOG - can be called before initialization
+    tABC_CC cc = ABC_CC_Ok;
+    ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
+
+    if (szPath)
+        ABC_CHECK_NEW(workloadRecordStart(szPath));
+    else
+        workloadRecordStop();
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_GetMetrics(char **pszJson,
+                       tABC_Error *pError)
+{
+    // Cannot use ABC_PROLOG - can be called before initialization
+    tABC_CC cc = ABC_CC_Ok;
+    ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
+    ABC_CHECK_NULL(pszJson);
+
+    {
+        JsonPtr json;
+        ABC_CHECK_NEW(metricsJson(json));
+        *pszJson = stringCopy(json.encode());
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_GetMemoryUsage(char **pszJson,
+                           tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(pszJson);
+
+    {
+        JsonPtr wallets;
+        ABC_CHECK_NEW(cacheMemoryJson(wallets));
+
+        JsonObject json;
+        ABC_CHECK_NEW(json.set("wallets", wallets));
+        ABC_CHECK_NEW(json.set("blockCache", static_cast<json_int_t>(
+                                   gContext->blockCache.memoryUsed())));
+        *pszJson = stringCopy(json.encode());
+    }
+
+exit:
+    return cc;
+}
+
+void ABC_TrimMemory(tABC_TrimLevel level)
+{
+    // Cannot use ABC_PROLOG - no pError
+    scryptArenaFree();
+    syncRepoCacheClear();
+    qrCacheClear();
+    if (gContext)
+    {
+        cacheTrim(ABC_TrimWallets <= level);
+        gContext->blockCache.trim();
+    }
+}
+
 void ABC_FreeLobby(int hLobby)
 {
     gLobbyCache.erase(hLobby);
@@ -179,6 +318,43 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_FetchLobbies(const char **aszIds,
+                         unsigned int count,
+                         int *ahResults,
+                         tABC_CC *aResults,
+                         tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(aszIds);
+    ABC_CHECK_NULL(ahResults);
+    ABC_CHECK_NULL(aResults);
+
+    {
+        std::vector<std::string> ids;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            ABC_CHECK_NULL(aszIds[i]);
+            ids.push_back(aszIds[i]);
+        }
+
+        std::vector<Lobby> lobbies;
+        std::vector<Status> statuses;
+        lobbyFetchMany(lobbies, statuses, ids);
+        for (unsigned i = 0; i < count; ++i)
+        {
+            aResults[i] = statuses[i].value();
+            ahResults[i] = statuses[i] ?
+                           gLobbyCache.insert(
+                               std::make_shared<Lobby>(std::move(lobbies[i]))) :
+                           0;
+            statuses[i].log();
+        }
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_GetLobbyAccountRequest(int hLobby,
                                    char **pszType,
                                    char **pszDisplayName,
@@ -218,8 +394,7 @@ tABC_CC ABC_ApproveLobbyAccountRequest(const char *szUserName,
         std::shared_ptr<Lobby> lobby;
         ABC_CHECK_NEW(gLobbyCache.find(lobby, hLobby));
 
-        AutoFree<tABC_AccountSettings, accountSettingsFree> settings;
-        settings.get() = accountSettingsLoad(*account);
+        const auto settings = accountSettingsShared(*account);
 
         std::string pin = "";
         if (nullptr != settings->szPIN && !settings->bDisablePINLogin)
@@ -378,11 +553,8 @@ tABC_CC ABC_AccountDelete(const char *szUserName,
     {
         std::string fixed;
         ABC_CHECK_NEW(LoginStore::fixUsername(fixed, szUserName));
-        AccountPaths paths;
-        ABC_CHECK_NEW(gContext->paths.accountDir(paths, fixed));
-
-        ABC_CHECK_NEW(fileDelete(paths.dir()));
-        cacheLogout();
+        ABC_CHECK_NEW(gContext->paths.accountDirDelete(fixed));
+        cacheLogoutUser(fixed);
     }
 
 exit:
@@ -834,7 +1006,7 @@ tABC_CC ABC_BitidLogin(const char *szUserName,
 
     {
         ABC_GET_LOGIN();
-        ABC_CHECK_NEW(bitidLogin(login->rootKey(), trimSpace(szBitidURI)));
+        ABC_CHECK_NEW(bitidLogin(*login, trimSpace(szBitidURI)));
     }
 
 exit:
@@ -860,7 +1032,7 @@ tABC_CC ABC_BitidLoginMeta(const char *szUserName,
         if (szBitIDKYCURI)
             kycUri = szBitIDKYCURI;
 
-        ABC_CHECK_NEW(bitidLogin(login->rootKey(), trimSpace(szBitidURI), 0,
+        ABC_CHECK_NEW(bitidLogin(*login, trimSpace(szBitidURI), 0,
                                  wallet.get(), kycUri));
     }
 
@@ -887,8 +1059,8 @@ tABC_CC ABC_BitidSign(const char *szUserName,
 
         Uri callback;
         ABC_CHECK_NEW(bitidCallback(callback, trimSpace(szBitidURI), false));
-        const auto signature = bitidSign(login->rootKey(),
-                                         szMessage, callback.encode(), 0);
+        const auto signature = bitidKeys(*login)->sign(szMessage,
+                               callback.encode(), 0);
 
         *pszBitidAddress = stringCopy(signature.address);
         *pszBitidSignature = stringCopy(signature.signature);
@@ -898,6 +1070,59 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_BitidSignMany(const char *szUserName,
+                          const char *szPassword,
+                          const char **aszBitidURIs,
+                          const char **aszMessages,
+                          unsigned int count,
+                          char ***paszBitidAddresses,
+                          char ***paszBitidSignatures,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(paszBitidAddresses);
+    ABC_CHECK_NULL(paszBitidSignatures);
+    if (count)
+    {
+        ABC_CHECK_NULL(aszBitidURIs);
+        ABC_CHECK_NULL(aszMessages);
+    }
+
+    {
+        ABC_GET_LOGIN();
+
+        std::vector<BitidChallenge> challenges;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            ABC_CHECK_NULL(aszBitidURIs[i]);
+            ABC_CHECK_NULL(aszMessages[i]);
+
+            Uri callback;
+            ABC_CHECK_NEW(bitidCallback(callback, trimSpace(aszBitidURIs[i]),
+                                        false));
+            challenges.push_back(BitidChallenge{aszMessages[i],
+                                                callback.encode(), 0});
+        }
+        const auto signatures = bitidKeys(*login)->sign(challenges);
+
+        char **aszAddresses;
+        char **aszSignatures;
+        ABC_ARRAY_NEW(aszAddresses, signatures.size(), char *);
+        ABC_ARRAY_NEW(aszSignatures, signatures.size(), char *);
+        for (size_t i = 0; i < signatures.size(); ++i)
+        {
+            aszAddresses[i] = stringCopy(signatures[i].address);
+            aszSignatures[i] = stringCopy(signatures[i].signature);
+        }
+
+        *paszBitidAddresses = aszAddresses;
+        *paszBitidSignatures = aszSignatures;
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Create a new wallet.
  *
@@ -934,6 +1159,32 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_CreateWatchOnlyWallet(const char *szUserName,
+                                  const char *szPassword,
+                                  const char *szWalletName,
+                                  const char *szXPub,
+                                  int currencyNum,
+                                  char **pszUuid,
+                                  tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szWalletName);
+    ABC_CHECK_ASSERT(strlen(szWalletName) > 0, ABC_CC_Error,
+                     "No wallet name provided");
+    ABC_CHECK_NULL(szXPub);
+    ABC_CHECK_NULL(pszUuid);
+
+    {
+        std::shared_ptr<Wallet> wallet;
+        ABC_CHECK_NEW(cacheWalletNew(wallet, szUserName, szWalletName,
+                                     currencyNum, szXPub));
+        *pszUuid = stringCopy(wallet->id());
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_WalletLoad(const char *szUserName,
                        const char *szWalletUUID,
                        tABC_Error *pError)
@@ -948,6 +1199,38 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_WalletsPreload(const char *szUserName,
+                           const char *szFirstUUID,
+                           tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        ABC_CHECK_NEW(cacheWalletsPreload(szUserName,
+                                          szFirstUUID ? szFirstUUID : ""));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WalletReady(const char *szUserName,
+                        const char *szWalletUUID,
+                        bool *pResult,
+                        tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(szWalletUUID);
+    ABC_CHECK_NULL(pResult);
+
+    {
+        ABC_CHECK_NEW(cacheWalletReady(*pResult, szUserName, szWalletUUID));
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_WalletRemove(const char *szUserName,
                          const char *szWalletUUID,
                          tABC_Error *pError)
@@ -1013,107 +1296,333 @@ exit:
     return cc;
 }
 
-/**
- * Clear cached keys.
- *
- * This function clears any keys that might be cached.
- *
- * @param pError    A pointer to the location to store the error if there is one
- */
-tABC_CC ABC_ClearKeyCache(tABC_Error *pError)
+tABC_CC ABC_WalletBalances(const char *szUserName,
+                           const char *szWalletUUID,
+                           int64_t *pConfirmed,
+                           int64_t *pUnconfirmed,
+                           int64_t *pSpendable,
+                           tABC_Error *pError)
 {
-    ABC_PROLOG();
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(pConfirmed);
+    ABC_CHECK_NULL(pUnconfirmed);
+    ABC_CHECK_NULL(pSpendable);
 
-    cacheLogout();
+    {
+        ABC_GET_WALLET();
+        const auto balance = wallet->cache.txs.balance();
+        *pConfirmed = balance.confirmed;
+        *pUnconfirmed = balance.unconfirmed;
+        *pSpendable = balance.spendable;
+    }
 
 exit:
     return cc;
 }
 
-tABC_CC ABC_GeneralInfoUpdate(tABC_Error *pError)
+tABC_CC ABC_GetWalletSummaries(const char *szUserName,
+                               tABC_WalletSummary **paSummaries,
+                               unsigned int *pCount,
+                               tABC_Error *pError)
 {
-    ABC_PROLOG();
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(paSummaries);
+    ABC_CHECK_NULL(pCount);
 
-    ABC_CHECK_NEW(generalUpdate());
+    {
+        std::shared_ptr<Account> account;
+        std::map<std::string, std::shared_ptr<Wallet>> loaded;
+        ABC_CHECK_NEW(cacheWalletsLoaded(account, loaded, szUserName));
+
+        struct Row
+        {
+            std::string id;
+            std::shared_ptr<Wallet> wallet;
+            std::string name;
+        };
+        std::vector<Row> rows;
+        size_t size = 0;
+        for (const auto &id: account->wallets.list())
+        {
+            Row row{id, nullptr, ""};
+            auto i = loaded.find(id);
+            if (loaded.end() != i)
+            {
+                row.wallet = i->second;
+                row.name = row.wallet->name();
+                size += row.name.size() + 1;
+            }
+            size += id.size() + 1;
+            rows.push_back(std::move(row));
+        }
+
+        *paSummaries = nullptr;
+        *pCount = 0;
+        if (rows.empty())
+            goto exit;
+
+        // The strings go right after the structures:
+        const size_t head = rows.size() * sizeof(tABC_WalletSummary);
+        char *block;
+        ABC_ARRAY_NEW(block, head + size, char);
+        auto aSummaries = reinterpret_cast<tABC_WalletSummary *>(block);
+        char *text = block + head;
+        auto copy = [&text](const std::string &s)
+        {
+            auto out = text;
+            memcpy(text, s.c_str(), s.size() + 1);
+            text += s.size() + 1;
+            return out;
+        };
+
+        const auto archived = account->wallets.archivedSnapshot();
+        for (size_t i = 0; i < rows.size(); ++i)
+        {
+            const auto &row = rows[i];
+            auto &out = aSummaries[i];
+            out.szUUID = copy(row.id);
+            auto flag = archived->find(row.id);
+            out.bArchived = archived->end() != flag && flag->second;
+            out.bLoaded = !!row.wallet;
+            if (!row.wallet)
+                continue;
+
+            // These all read snapshots the caches keep up to date:
+            const auto balance = row.wallet->cache.txs.balance();
+            const auto progress = row.wallet->cache.addresses.progress();
+            out.szName = copy(row.name);
+            out.currencyNum = row.wallet->currency();
+            out.balance = balance.total();
+            out.confirmed = balance.confirmed;
+            out.unconfirmed = balance.unconfirmed;
+            out.addressesChecked = progress.first;
+            out.addressesTotal = progress.second;
+        }
+
+        *paSummaries = aSummaries;
+        *pCount = rows.size();
+    }
 
 exit:
     return cc;
 }
 
-/**
- * Create a new wallet.
- *
- * This function provides the array of currencies.
- * The array returned should not be modified and should not be deallocated.
- *
- * @param paCurrencyArray           Pointer in which to store the currency array
- * @param pCount                    Pointer in which to store the count of array entries
- * @param pError                    A pointer to the location to store the error if there is one
- */
-tABC_CC ABC_GetCurrencies(tABC_Currency **paCurrencyArray,
-                          int *pCount,
-                          tABC_Error *pError)
+void ABC_FreeWalletSummaries(tABC_WalletSummary *aSummaries)
+{
+    // Cannot use ABC_PROLOG - no pError
+    free(aSummaries);
+}
+
+void ABC_FreeWalletHandle(int hWallet)
+{
+    gWalletHandles.erase(hWallet);
+}
+
+tABC_CC ABC_WalletHandle(const char *szUserName,
+                         const char *szWalletUUID,
+                         int *phResult,
+                         tABC_Error *pError)
 {
     ABC_PROLOG();
-    ABC_CHECK_NULL(paCurrencyArray);
-    ABC_CHECK_NULL(pCount);
+    ABC_CHECK_NULL(phResult);
 
     {
-        static tABC_Currency aCurrencies[] =
-        {
-            ABC_CURRENCY_LIST(CURRENCY_GUI_ROW)
-        };
-
-        *paCurrencyArray = aCurrencies;
-        *pCount = std::end(aCurrencies) - std::begin(aCurrencies);
+        ABC_GET_WALLET();
+        *phResult = gWalletHandles.insert(wallet);
     }
 
 exit:
     return cc;
 }
 
-/**
- * Get the categories for an account.
- *
- * This function gets the categories for an account.
- * An array of allocated strings is allocated so the user is responsible for
- * free'ing all the elements as well as the array itself.
- *
- * @param szUserName            UserName for the account
- * @param paszCategories        Pointer to store results (NULL is stored if no categories)
- * @param pCount                Pointer to store result count (can be 0)
- * @param pError                A pointer to the location to store the error if there is one
- */
-tABC_CC ABC_GetCategories(const char *szUserName,
-                          const char *szPassword,
-                          char ***paszCategories,
-                          unsigned int *pCount,
-                          tABC_Error *pError)
+tABC_CC ABC_WalletHandleBalances(int hWallet,
+                                 int64_t *pConfirmed,
+                                 int64_t *pUnconfirmed,
+                                 int64_t *pSpendable,
+                                 tABC_Error *pError)
 {
-    ABC_PROLOG();
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(pConfirmed);
+    ABC_CHECK_NULL(pUnconfirmed);
+    ABC_CHECK_NULL(pSpendable);
 
     {
-        ABC_GET_ACCOUNT();
-        AccountCategories categories;
-        ABC_CHECK_NEW(accountCategoriesLoad(categories, *account));
-
-        char **aszCategories;
-        ABC_ARRAY_NEW(aszCategories, categories.size(), char *);
-        size_t i = 0;
-        for (const auto &category: categories)
-        {
-            aszCategories[i++] = stringCopy(category);
-        }
-
-        *paszCategories = aszCategories;
-        *pCount = categories.size();
+        ABC_GET_WALLET_H();
+        const auto balance = wallet->cache.txs.balance();
+        *pConfirmed = balance.confirmed;
+        *pUnconfirmed = balance.unconfirmed;
+        *pSpendable = balance.spendable;
     }
 
 exit:
     return cc;
 }
 
-/**
+tABC_CC ABC_WalletHandleTransactionsPage(int hWallet,
+                                         unsigned int offset,
+                                         unsigned int limit,
+                                         uint64_t since,
+                                         uint64_t *pRevision,
+                                         tABC_TxInfo ***paTransactions,
+                                         unsigned int *pCount,
+                                         char ***paszRemoved,
+                                         unsigned int *pRemovedCount,
+                                         tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(pRevision);
+    ABC_CHECK_NULL(paTransactions);
+    ABC_CHECK_NULL(pCount);
+    ABC_CHECK_NULL(paszRemoved);
+    ABC_CHECK_NULL(pRemovedCount);
+
+    {
+        ABC_GET_WALLET_H();
+        ABC_CHECK_RET(ABC_TxGetTransactionsPage(*wallet, offset, limit, since,
+                                                pRevision, paTransactions, pCount,
+                                                paszRemoved, pRemovedCount, pError));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WalletHandleReceiveRequest(int hWallet,
+                                       char **pszRequestID,
+                                       tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(pszRequestID);
+
+    {
+        ABC_GET_WALLET_H();
+
+        AddressMeta address;
+        ABC_CHECK_NEW(wallet->addresses.getNew(address));
+        *pszRequestID = stringCopy(address.address);
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WalletHandleSpendNew(int hWallet,
+                                 void **ppResult,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(ppResult);
+
+    {
+        ABC_GET_WALLET_H();
+        *ppResult = new Spend(*wallet);
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Clear cached keys.
+ *
+ * This function clears any keys that might be cached.
+ *
+ * @param pError    A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_ClearKeyCache(tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    cacheLogout();
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_GeneralInfoUpdate(tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    ABC_CHECK_NEW(generalUpdate());
+
+exit:
+    return cc;
+}
+
+/**
+ * Create a new wallet.
+ *
+ * This function provides the array of currencies.
+ * The array returned should not be modified and should not be deallocated.
+ *
+ * @param paCurrencyArray           Pointer in which to store the currency array
+ * @param pCount                    Pointer in which to store the count of array entries
+ * @param pError                    A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetCurrencies(tABC_Currency **paCurrencyArray,
+                          int *pCount,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(paCurrencyArray);
+    ABC_CHECK_NULL(pCount);
+
+    {
+        static tABC_Currency aCurrencies[] =
+        {
+            ABC_CURRENCY_LIST(CURRENCY_GUI_ROW)
+        };
+
+        *paCurrencyArray = aCurrencies;
+        *pCount = std::end(aCurrencies) - std::begin(aCurrencies);
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Get the categories for an account.
+ *
+ * This function gets the categories for an account.
+ * An array of allocated strings is allocated so the user is responsible for
+ * free'ing all the elements as well as the array itself.
+ *
+ * @param szUserName            UserName for the account
+ * @param paszCategories        Pointer to store results (NULL is stored if no categories)
+ * @param pCount                Pointer to store result count (can be 0)
+ * @param pError                A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetCategories(const char *szUserName,
+                          const char *szPassword,
+                          char ***paszCategories,
+                          unsigned int *pCount,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        ABC_GET_ACCOUNT();
+        AccountCategories categories;
+        ABC_CHECK_NEW(accountCategoriesLoad(categories, *account));
+
+        char **aszCategories;
+        ABC_ARRAY_NEW(aszCategories, categories.size(), char *);
+        size_t i = 0;
+        for (const auto &category: categories)
+        {
+            aszCategories[i++] = stringCopy(category);
+        }
+
+        *paszCategories = aszCategories;
+        *pCount = categories.size();
+    }
+
+exit:
+    return cc;
+}
+
+/**
  * Add a category for an account.
  *
  * This function adds a category to an account.
@@ -1168,6 +1677,43 @@ exit:
     return cc;
 }
 
+/**
+ * Add several categories to an account at once.
+ *
+ * This is much faster than calling ABC_AddCategory in a loop,
+ * since the categories file is only written once.
+ *
+ * @param szUserName            UserName for the account
+ * @param aszCategories         Categories to add
+ * @param count                 Number of categories in the array
+ * @param pError                A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_AddCategories(const char *szUserName,
+                          const char *szPassword,
+                          char **aszCategories,
+                          unsigned int count,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+    if (count)
+        ABC_CHECK_NULL(aszCategories);
+
+    {
+        ABC_GET_ACCOUNT();
+        AccountCategories categories;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            ABC_CHECK_NULL(aszCategories[i]);
+            categories.insert(aszCategories[i]);
+        }
+        ABC_CHECK_NEW(accountCategoriesUpdate(*account, categories,
+                                              AccountCategories()));
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Renames a wallet.
  *
@@ -1358,8 +1904,7 @@ tABC_CC ABC_PinCheck(const char *szUserName,
     {
         ABC_GET_ACCOUNT();
 
-        AutoFree<tABC_AccountSettings, accountSettingsFree> settings;
-        settings.get() = accountSettingsLoad(*account);
+        const auto settings = accountSettingsShared(*account);
 
         *pbResult = false;
         if (settings->szPIN && !strcmp(settings->szPIN, szPin))
@@ -1408,6 +1953,8 @@ tABC_CC ABC_ExportWalletSeed(const char *szUserName,
 
     {
         ABC_GET_WALLET();
+        ABC_CHECK_ASSERT(!wallet->watchOnly(), ABC_CC_Error,
+                         "Watch-only wallets have no seed");
         *pszWalletSeed = stringCopy(base16Encode(wallet->bitcoinKey()));
     }
 
@@ -1495,14 +2042,15 @@ tABC_CC ABC_SetWalletOrder(const char *szUserName,
         AutoString temp(stringCopy(szUUIDs));
 
         // Break apart the text:
-        unsigned i = 0;
+        std::vector<std::string> ids;
         char *uuid, *brkt;
         for (uuid = strtok_r(temp, "\n", &brkt);
                 uuid;
                 uuid = strtok_r(nullptr, "\n", &brkt))
         {
-            ABC_CHECK_NEW(account->wallets.reorder(uuid, i++));
+            ids.push_back(uuid);
         }
+        ABC_CHECK_NEW(account->wallets.reorder(ids));
     }
 
 exit:
@@ -1653,6 +2201,110 @@ exit:
     return cc;
 }
 
+/**
+ * Converts a batch of Satoshi amounts to the given currency
+ * at the current exchange rate, such as for a screen full of balances.
+ *
+ * @param aSatoshi    Array of amounts in Satoshi
+ * @param count       Number of entries in each array
+ * @param currencyNum Currency ISO 4217 num
+ * @param aCurrency   Array of `count` entries to receive the results
+ * @param pError      A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_SatoshiToCurrencyArray(const int64_t *aSatoshi,
+                                   unsigned int count,
+                                   int currencyNum,
+                                   double *aCurrency,
+                                   tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    if (count)
+    {
+        ABC_CHECK_NULL(aSatoshi);
+        ABC_CHECK_NULL(aCurrency);
+    }
+
+    ABC_CHECK_NEW(gContext->exchangeCache.satoshiToCurrency(aCurrency, aSatoshi,
+                  count, static_cast<Currency>(currencyNum)));
+
+exit:
+    return cc;
+}
+
+/**
+ * Converts a batch of Satoshi amounts to the given currency,
+ * each at the exchange rate in effect at its timestamp.
+ * This is meant for valuing a whole transaction list in one call.
+ *
+ * @param aSatoshi    Array of amounts in Satoshi
+ * @param aTimes      Array of matching Unix timestamps
+ * @param count       Number of entries in each array
+ * @param currencyNum Currency ISO 4217 num
+ * @param aCurrency   Array of `count` entries to receive the results
+ * @param pError      A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_SatoshiToCurrencyHistory(const int64_t *aSatoshi,
+                                     const int64_t *aTimes,
+                                     unsigned int count,
+                                     int currencyNum,
+                                     double *aCurrency,
+                                     tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    if (count)
+    {
+        ABC_CHECK_NULL(aSatoshi);
+        ABC_CHECK_NULL(aTimes);
+        ABC_CHECK_NULL(aCurrency);
+    }
+
+    {
+        const std::vector<int64_t> satoshi(aSatoshi, aSatoshi + count);
+        const std::vector<time_t> times(aTimes, aTimes + count);
+        std::vector<double> result;
+        ABC_CHECK_NEW(gContext->exchangeCache.satoshiToCurrencyAt(result,
+                      satoshi, times, static_cast<Currency>(currencyNum)));
+        std::copy(result.begin(), result.end(), aCurrency);
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Seeds the exchange-rate history with rates from an outside source,
+ * such as a charting service.
+ *
+ * @param currencyNum Currency ISO 4217 num
+ * @param aTimes      Array of Unix timestamps
+ * @param aRates      Array of matching rates, in currency per bitcoin
+ * @param count       Number of entries in each array
+ * @param pError      A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_AddExchangeRateHistory(int currencyNum,
+                                   const int64_t *aTimes,
+                                   const double *aRates,
+                                   unsigned int count,
+                                   tABC_Error *pError)
+{
+    ABC_PROLOG();
+    if (count)
+    {
+        ABC_CHECK_NULL(aTimes);
+        ABC_CHECK_NULL(aRates);
+    }
+
+    {
+        const std::vector<time_t> times(aTimes, aTimes + count);
+        const std::vector<double> rates(aRates, aRates + count);
+        ABC_CHECK_NEW(gContext->exchangeCache.historyInsert(
+                          static_cast<Currency>(currencyNum), times, rates));
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Parses a Bitcoin amount string to an integer.
  * @param the amount to parse, in bitcoins
@@ -2071,6 +2723,48 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_SpendBatch(const char *szUserName,
+                       const char *szWalletUUID,
+                       const tABC_BatchPayment *aPayments,
+                       unsigned int count,
+                       tABC_SpendFeeLevel feeLevel,
+                       uint64_t customFeeSatoshi,
+                       tABC_BatchPayment_Callback fCallback,
+                       void *pData,
+                       tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(aPayments);
+    ABC_CHECK_NULL(fCallback);
+
+    {
+        ABC_GET_WALLET();
+
+        std::vector<BatchPayment> payments;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            ABC_CHECK_NULL(aPayments[i].szAddress);
+            payments.push_back(BatchPayment
+            {
+                aPayments[i].szAddress, aPayments[i].amount
+            });
+        }
+
+        auto callback = [fCallback, pData](size_t index, const Status &status,
+                                           const std::string &txid)
+        {
+            tABC_Error error;
+            status.toError(error, ABC_HERE());
+            fCallback(pData, index, &error, status ? txid.c_str() : nullptr);
+        };
+        ABC_CHECK_NEW(batchSpend(*wallet, payments, feeLevel, customFeeSatoshi,
+                                 callback));
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_SweepKey(const char *szUserName,
                      const char *szPassword,
                      const char *szWalletUUID,
@@ -2094,30 +2788,148 @@ exit:
     return cc;
 }
 
-/**
- * Gets the transaction specified
- *
- * @param szUserName        UserName for the account associated with the transactions
- * @param szPassword        Password for the account associated with the transactions
- * @param szWalletUUID      UUID of the wallet associated with the transactions
- * @param szID              ID of the transaction
- * @param ppTransaction     Location to store allocated transaction
- *                          (caller must free)
- * @param pError            A pointer to the location to store the error if there is one
- */
-tABC_CC ABC_GetTransaction(const char *szUserName,
-                           const char *szPassword,
-                           const char *szWalletUUID,
-                           const char *szID,
-                           tABC_TxInfo **ppTransaction,
-                           tABC_Error *pError)
+tABC_CC ABC_SweepKeys(const char *szUserName,
+                      const char *szPassword,
+                      const char *szWalletUUID,
+                      const char **aszKeys,
+                      unsigned int count,
+                      tABC_Error *pError)
 {
     ABC_PROLOG();
+    ABC_CHECK_NULL(aszKeys);
 
     {
         ABC_GET_WALLET();
 
-        TxInfo info;
+        KeyTable keys;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            ABC_CHECK_NULL(aszKeys[i]);
+            ParsedUri uri;
+            ABC_CHECK_NEW(parseUri(uri, aszKeys[i]));
+            if (uri.wif.empty())
+                ABC_RET_ERROR(ABC_CC_ParseError, "Not a Bitcoin private key");
+            keys[uri.address] = uri.wif;
+        }
+        ABC_CHECK_NEW(bridgeSweepKeys(*wallet, keys));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_ConsolidateUtxos(const char *szUserName,
+                             const char *szPassword,
+                             const char *szWalletUUID,
+                             uint64_t smallSatoshi,
+                             unsigned int targetCount,
+                             uint64_t maxFeeRate,
+                             uint64_t feeBudget,
+                             char ***paszTxIds,
+                             unsigned int *pCount,
+                             tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(paszTxIds);
+    ABC_CHECK_NULL(pCount);
+
+    {
+        ABC_GET_WALLET();
+
+        ConsolidateOptions options;
+        options.smallSatoshi = smallSatoshi;
+        options.targetCount = targetCount;
+        options.maxFeeRate = maxFeeRate;
+        options.feeBudget = feeBudget;
+
+        std::vector<std::string> txids;
+        ABC_CHECK_NEW(consolidateUtxos(txids, *wallet, options));
+
+        *paszTxIds = nullptr;
+        if (txids.size())
+        {
+            ABC_ARRAY_NEW(*paszTxIds, txids.size(), char *);
+            for (size_t i = 0; i < txids.size(); ++i)
+                (*paszTxIds)[i] = stringCopy(txids[i]);
+        }
+        *pCount = txids.size();
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_BumpFee(const char *szUserName,
+                    const char *szPassword,
+                    const char *szWalletUUID,
+                    const char *szTxId,
+                    tABC_SpendFeeLevel feeLevel,
+                    uint64_t customFeeSatoshi,
+                    char **pszResult,
+                    tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szTxId);
+    ABC_CHECK_NULL(pszResult);
+
+    {
+        ABC_GET_WALLET();
+
+        std::string txid;
+        ABC_CHECK_NEW(bumpFee(txid, *wallet, szTxId,
+                              feeLevel, customFeeSatoshi));
+        *pszResult = stringCopy(txid);
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_CancelRebroadcast(const char *szUserName,
+                              const char *szPassword,
+                              const char *szWalletUUID,
+                              const char *szTxId,
+                              tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szTxId);
+
+    {
+        ABC_GET_WALLET();
+
+        if (!wallet->cache.outbox.remove(szTxId))
+            ABC_RET_ERROR(ABC_CC_NoTransaction, "Transaction is not waiting");
+        ABC_CHECK_NEW(wallet->cache.save());
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Gets the transaction specified
+ *
+ * @param szUserName        UserName for the account associated with the transactions
+ * @param szPassword        Password for the account associated with the transactions
+ * @param szWalletUUID      UUID of the wallet associated with the transactions
+ * @param szID              ID of the transaction
+ * @param ppTransaction     Location to store allocated transaction
+ *                          (caller must free)
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetTransaction(const char *szUserName,
+                           const char *szPassword,
+                           const char *szWalletUUID,
+                           const char *szID,
+                           tABC_TxInfo **ppTransaction,
+                           tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        ABC_GET_WALLET();
+
+        TxInfo info;
         TxStatus status;
         ABC_CHECK_NEW(wallet->cache.txs.info(info, szID));
         ABC_CHECK_NEW(wallet->cache.txs.status(status, szID));
@@ -2159,6 +2971,137 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_GetTransactionsSummary(const char *szUserName,
+                                   const char *szPassword,
+                                   const char *szWalletUUID,
+                                   int64_t startTime,
+                                   int64_t endTime,
+                                   tABC_TxInfo ***paTransactions,
+                                   unsigned int *pCount,
+                                   tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(paTransactions);
+    ABC_CHECK_NULL(pCount);
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_RET(ABC_TxGetTransactionsSummary(*wallet, startTime, endTime,
+                      paTransactions, pCount, pError));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_GetTransactionsArena(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szWalletUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_TxInfo ***paTransactions,
+                                 unsigned int *pCount,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(paTransactions);
+    ABC_CHECK_NULL(pCount);
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_RET(ABC_TxGetTransactionsArena(*wallet, startTime, endTime,
+                      paTransactions, pCount, pError));
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Gets one page of the transactions that have changed since an earlier call.
+ *
+ * @param szUserName        UserName for the account associated with the transactions
+ * @param szPassword        Password for the account associated with the transactions
+ * @param szWalletUUID      UUID of the wallet associated with the transactions
+ * @param offset            The number of transactions to skip
+ * @param limit             The maximum number of transactions to return, or 0 for all
+ * @param since             The revision from an earlier call, or 0 for everything
+ * @param pRevision         Pointer to store the current revision
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param paszRemoved       Pointer to store array of removed transaction ids
+ * @param pRemovedCount     Pointer to store number of removed transaction ids
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetTransactionsPage(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                unsigned int offset,
+                                unsigned int limit,
+                                uint64_t since,
+                                uint64_t *pRevision,
+                                tABC_TxInfo ***paTransactions,
+                                unsigned int *pCount,
+                                char ***paszRemoved,
+                                unsigned int *pRemovedCount,
+                                tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    abcCall.shapeSet(limit);
+    ABC_CHECK_NULL(pRevision);
+    ABC_CHECK_NULL(paTransactions);
+    ABC_CHECK_NULL(pCount);
+    ABC_CHECK_NULL(paszRemoved);
+    ABC_CHECK_NULL(pRemovedCount);
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_RET(ABC_TxGetTransactionsPage(*wallet, offset, limit, since,
+                                                pRevision, paTransactions, pCount,
+                                                paszRemoved, pRemovedCount, pError));
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Gets the transactions whose confirmation count has changed
+ * since the chain was at an earlier height.
+ *
+ * @param szUserName        UserName for the account associated with the transactions
+ * @param szPassword        Password for the account associated with the transactions
+ * @param szWalletUUID      UUID of the wallet associated with the transactions
+ * @param sinceHeight       The height returned by an earlier call, or 0
+ * @param pHeight           Pointer to store the current chain height
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_GetTransactionsConfirming(const char *szUserName,
+                                      const char *szPassword,
+                                      const char *szWalletUUID,
+                                      unsigned int sinceHeight,
+                                      unsigned int *pHeight,
+                                      tABC_TxInfo ***paTransactions,
+                                      unsigned int *pCount,
+                                      tABC_Error *pError)
+{
+    ABC_PROLOG_QUIET();
+    ABC_CHECK_NULL(pHeight);
+    ABC_CHECK_NULL(paTransactions);
+    ABC_CHECK_NULL(pCount);
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_RET(ABC_TxGetTransactionsConfirming(*wallet, sinceHeight,
+                      pHeight, paTransactions, pCount, pError));
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Searches the transactions associated with the given wallet.
  *
@@ -2179,6 +3122,7 @@ tABC_CC ABC_SearchTransactions(const char *szUserName,
                                tABC_Error *pError)
 {
     ABC_PROLOG();
+    abcCall.shapeSet(szQuery ? strlen(szQuery) : 0);
 
     {
         ABC_GET_WALLET();
@@ -2218,6 +3162,12 @@ void ABC_FreeTransactions(tABC_TxInfo **aTransactions,
     ABC_TxFreeTransactions(aTransactions, count);
 }
 
+void ABC_FreeTransactionsArena(tABC_TxInfo **aTransactions)
+{
+    // Cannot use ABC_PROLOG - no pError
+    ABC_TxFreeTransactionsArena(aTransactions);
+}
+
 /**
  * Sets the details for a specific transaction.
  *
@@ -2502,17 +3452,12 @@ tABC_CC ABC_QrEncode(const char *szText,
     ABC_CHECK_NULL(pWidth);
 
     {
-        AutoFree<QRcode, QRcode_free>
-        qr(QRcode_encodeString(szText, 0, QR_ECLEVEL_L, QR_MODE_8, 1));
-        ABC_CHECK_ASSERT(qr, ABC_CC_Error, "Unable to create QR code");
-        size_t size = qr->width * qr->width;
+        std::shared_ptr<const QrMatrix> qr;
+        ABC_CHECK_NEW(qrEncode(qr, szText));
 
         unsigned char *aData;
-        ABC_ARRAY_NEW(aData, size, unsigned char);
-        for (unsigned i = 0; i < size; i++)
-        {
-            aData[i] = qr->data[i] & 0x1;
-        }
+        ABC_ARRAY_NEW(aData, qr->modules.size(), unsigned char);
+        memcpy(aData, qr->modules.data(), qr->modules.size());
         *pWidth = qr->width;
         *paData = aData;
     }
@@ -2521,6 +3466,42 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_QrEncodeBitmap(const char *szText,
+                           unsigned int level,
+                           unsigned int scale,
+                           unsigned char **paData,
+                           unsigned int *pWidth,
+                           unsigned int *pStride,
+                           tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szText);
+    ABC_CHECK_NULL(paData);
+    ABC_CHECK_NULL(pWidth);
+    ABC_CHECK_NULL(pStride);
+    ABC_CHECK_ASSERT(level <= static_cast<unsigned>(QrLevel::high),
+                     ABC_CC_Error, "Unknown QR error-correction level");
+    ABC_CHECK_ASSERT(0 < scale, ABC_CC_Error, "QR scale must be positive");
+
+    {
+        std::shared_ptr<const QrMatrix> qr;
+        ABC_CHECK_NEW(qrEncode(qr, szText, static_cast<QrLevel>(level)));
+
+        size_t stride;
+        const auto bitmap = qrBitmap(*qr, scale, stride);
+
+        unsigned char *aData;
+        ABC_ARRAY_NEW(aData, bitmap.size(), unsigned char);
+        memcpy(aData, bitmap.data(), bitmap.size());
+        *pWidth = qr->width * scale;
+        *pStride = stride;
+        *paData = aData;
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_CreateHbits(char **pszResult,
                         char **pszAddress,
                         tABC_Error *pError)
@@ -2592,6 +3573,10 @@ tABC_CC ABC_ParseUri(char *szURI,
         ParsedUri uri;
         ABC_CHECK_NEW(parseUri(uri, trimSpace(szURI)));
 
+        // The GUI will want this next, so start downloading it now:
+        if (!uri.paymentProto.empty())
+            paymentRequestPrefetch(uri.paymentProto);
+
         tABC_ParsedUri *pResult = structAlloc<tABC_ParsedUri>();
         pResult->szAddress = uri.address.empty() ? nullptr :
                              stringCopy(uri.address);
@@ -2701,6 +3686,29 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_GetAccountSummary(const char *szUserName,
+                              char **pszJson,
+                              tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(pszJson);
+
+    {
+        std::string fixed;
+        AccountPaths paths;
+        ABC_CHECK_NEW(LoginStore::fixUsername(fixed, szUserName));
+        ABC_CHECK_NEW(gContext->paths.accountDir(paths, fixed));
+
+        std::string json;
+        ABC_CHECK_NEW(accountSummaryLoad(json, paths));
+        *pszJson = stringCopy(json);
+    }
+
+exit:
+    return cc;
+}
+
 /**
  * Loads the settings for a specific account
  *
@@ -2775,17 +3783,20 @@ tABC_CC ABC_DataSyncAccount(const char *szUserName,
     {
         ABC_GET_ACCOUNT();
 
+        // The general information and the login check each
+        // hit a different server, so run them alongside the sync:
+        ParallelTask general([]() { generalUpdate().log(); }); // Non-critical
+        Status s;
+        ParallelTask login([&]() { s = account->login.update(); });
+
         // Sync the account data:
         bool dirty = false;
         ABC_CHECK_NEW(account->sync(dirty));
         *pbDirty = dirty;
 
-        // Non-critical general information update:
-        generalUpdate().log();
-
         // Has the password changed?
         bool passwordChanged = false;
-        auto s = account->login.update();
+        login.wait();
         switch (s.value())
         {
         case ABC_CC_InvalidOTP:
@@ -2839,22 +3850,50 @@ exit:
 }
 
 /**
- * Start the watcher for a wallet
+ * Syncs the account repo and every loaded wallet's repo at once.
+ * Archived wallets that have already been checked are skipped,
+ * as they are in ABC_DataSyncWallet.
  *
- * @param szUserName   UserName for the account
- * @param szPassword   Password for the account
- * @param szWalletUUID The wallet watcher to use
+ * @param pbDirty Set to true if any of the repos changed.
  */
-tABC_CC ABC_WatcherStart(const char *szUserName,
-                         const char *szPassword,
-                         const char *szWalletUUID,
-                         tABC_Error *pError)
+tABC_CC ABC_DataSyncAll(const char *szUserName,
+                        const char *szPassword,
+                        bool *pbDirty,
+                        tABC_Error *pError)
 {
     ABC_PROLOG();
+    ABC_CHECK_NULL(pbDirty);
 
     {
-        ABC_GET_WALLET();
-        ABC_CHECK_NEW(bridgeWatcherStart(*wallet));
+        ABC_GET_ACCOUNT();
+
+        std::vector<std::shared_ptr<Wallet>> wallets;
+        const auto archived = account->wallets.archivedSnapshot();
+        for (const auto &id: account->wallets.list())
+        {
+            auto wallet = cacheWalletSoft(id);
+            auto row = archived->find(id);
+            if (wallet && archived->end() != row &&
+                    !(wallet->cache.addressCheckDoneGet() && row->second))
+                wallets.push_back(wallet);
+        }
+
+        // Index 0 is the account, and the rest are the wallets:
+        std::unique_ptr<bool[]> dirty(new bool[wallets.size() + 1]());
+        std::vector<std::function<Status ()>> jobs;
+        jobs.push_back([&]() { return account->sync(dirty[0]); });
+        for (size_t i = 0; i < wallets.size(); ++i)
+            jobs.push_back([&, i]() { return wallets[i]->sync(dirty[i + 1]); });
+
+        std::vector<Status> results;
+        syncAll(results, jobs);
+        ABC_CHECK_NEW(results[0]);
+        for (size_t i = 1; i < results.size(); ++i)
+            results[i].log(); // One bad wallet shouldn't stop the rest
+
+        *pbDirty = false;
+        for (size_t i = 0; i < results.size(); ++i)
+            *pbDirty = *pbDirty || dirty[i];
     }
 
 exit:
@@ -2862,31 +3901,175 @@ exit:
 }
 
 /**
- * Runs the watcher update loop. This function will run for an arbitrarily
- * long amount of time as it works to keep the watcher up-to-date with the
- * network. To cause the function to return, call ABC_WatcherStop.
+ * Waits for every queued metadata write to reach the disk,
+ * such as before the app goes into the background.
+ */
+tABC_CC ABC_DataFlush(tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NEW(writeQueueFlush());
+
+exit:
+    return cc;
+}
+
+static SyncScheduler gSyncScheduler;
+
+/**
+ * Keeps the account and its loaded wallets in sync from a background loop.
+ * This function runs until ABC_DataSyncStop is called,
+ * so the caller should give it a dedicated thread.
  *
- * @param szWalletUUID The wallet watcher to use
+ * Each repo gets polled less and less often while it stays quiet,
+ * and syncs a few seconds after any local change.
+ * Archived wallets that have already been checked only sync
+ * for local changes, as in ABC_DataSyncWallet.
+ * Password changes and OTP errors are not checked here,
+ * so the app should still call ABC_DataSyncAccount now and then.
+ *
+ * @param fAsyncBitCoinEventCallback receives an
+ * ABC_AsyncEventType_DataSyncUpdate event whenever a sync brings in changes.
+ * szWalletUUID is null for the account repo.
  */
-tABC_CC ABC_WatcherLoop(const char *szWalletUUID,
-                        tABC_BitCoin_Event_Callback fAsyncBitCoinEventCallback,
-                        void *pData,
-                        tABC_Error *pError)
+tABC_CC ABC_DataSyncLoop(const char *szUserName,
+                         const char *szPassword,
+                         tABC_BitCoin_Event_Callback fAsyncBitCoinEventCallback,
+                         void *pData,
+                         tABC_Error *pError)
 {
     ABC_PROLOG();
     ABC_CHECK_NULL(fAsyncBitCoinEventCallback);
 
     {
-        ABC_GET_WALLET_N();
-        ABC_CHECK_NEW(bridgeWatcherLoop(*wallet,
-                                        fAsyncBitCoinEventCallback, pData));
+        ABC_GET_ACCOUNT();
+
+        auto repos = [account]()
+        {
+            std::vector<SyncScheduler::Repo> out;
+            out.push_back(SyncScheduler::Repo{account->dir(), "",
+                                              [account](bool &dirty)
+            {
+                return account->sync(dirty);
+            }, false});
+
+            const auto archived = account->wallets.archivedSnapshot();
+            for (const auto &id: account->wallets.list())
+            {
+                auto wallet = cacheWalletSoft(id);
+                auto row = archived->find(id);
+                if (!wallet || archived->end() == row)
+                    continue;
+                const bool isArchived = row->second;
+                out.push_back(SyncScheduler::Repo{wallet->paths.syncDir(), id,
+                                                  [wallet](bool &dirty)
+                {
+                    airbitzFeeAutoSend(*wallet).log();
+                    return wallet->sync(dirty);
+                }, isArchived && wallet->cache.addressCheckDoneGet()});
+            }
+            return out;
+        };
+
+        auto fCallback = fAsyncBitCoinEventCallback;
+        auto done = [fCallback, pData](const SyncScheduler::Repo &repo,
+                                       const Status &status, bool dirty)
+        {
+            if (!status.log() || !dirty)
+                return;
+
+            tABC_AsyncBitCoinInfo info;
+            info.pData = pData;
+            info.eventType = ABC_AsyncEventType_DataSyncUpdate;
+            Status().toError(info.status, ABC_HERE());
+            info.szWalletUUID = repo.id.empty() ? nullptr : repo.id.c_str();
+            info.szTxID = nullptr;
+            info.sweepSatoshi = 0;
+            info.aszTxIDs = nullptr;
+            info.countTxIDs = 0;
+            fCallback(&info);
+        };
+
+        gSyncScheduler.run(repos, done);
     }
 
 exit:
     return cc;
 }
 
-tABC_CC ABC_WatcherConnect(const char *szWalletUUID, tABC_Error *pError)
+/**
+ * Makes ABC_DataSyncLoop sync everything right away,
+ * such as when the app returns to the foreground.
+ */
+tABC_CC ABC_DataSyncWakeup(tABC_Error *pError)
+{
+    ABC_PROLOG();
+    gSyncScheduler.wakeup();
+
+exit:
+    return cc;
+}
+
+/**
+ * Makes ABC_DataSyncLoop return, once any syncs in progress finish.
+ */
+tABC_CC ABC_DataSyncStop(tABC_Error *pError)
+{
+    ABC_PROLOG();
+    gSyncScheduler.stop();
+
+exit:
+    return cc;
+}
+
+/**
+ * Start the watcher for a wallet
+ *
+ * @param szUserName   UserName for the account
+ * @param szPassword   Password for the account
+ * @param szWalletUUID The wallet watcher to use
+ */
+tABC_CC ABC_WatcherStart(const char *szUserName,
+                         const char *szPassword,
+                         const char *szWalletUUID,
+                         tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        ABC_GET_WALLET();
+        ABC_CHECK_NEW(bridgeWatcherStart(*wallet));
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Runs the watcher update loop. This function will run for an arbitrarily
+ * long amount of time as it works to keep the watcher up-to-date with the
+ * network. To cause the function to return, call ABC_WatcherStop.
+ *
+ * @param szWalletUUID The wallet watcher to use
+ */
+tABC_CC ABC_WatcherLoop(const char *szWalletUUID,
+                        tABC_BitCoin_Event_Callback fAsyncBitCoinEventCallback,
+                        void *pData,
+                        tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(fAsyncBitCoinEventCallback);
+
+    {
+        ABC_GET_WALLET_N();
+        ABC_CHECK_NEW(bridgeWatcherLoop(*wallet,
+                                        fAsyncBitCoinEventCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WatcherConnect(const char *szWalletUUID, tABC_Error *pError)
 {
     ABC_PROLOG();
 
@@ -2911,6 +4094,8 @@ exit:
 /**
  * Watch a single address for a wallet.
  * Pass a nullptr address to cancel the priority poll.
+ * This also gives the wallet's watcher first pick of the network
+ * connections, since the user is looking at it.
  *
  * @param szUserName   DEPRECATED. Completely unused.
  * @param szPassword   DEPRECATED. Completely unused.
@@ -2930,6 +4115,7 @@ tABC_CC ABC_PrioritizeAddress(const char *szUserName, const char *szPassword,
         if (szAddress)
             address = szAddress;
         wallet->cache.addresses.prioritize(address);
+        bridgeWatcherActiveSet(*wallet);
     }
 
 exit:
@@ -2991,6 +4177,37 @@ exit:
     return cc;
 }
 
+/**
+ * Runs the shared network engine until `ABC_WatcherEngineStop` is called.
+ */
+tABC_CC ABC_WatcherEngineLoop(tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NEW(bridgeEngineLoop());
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WatcherEngineStop(tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NEW(bridgeEngineStop());
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_WatcherEventInterval(unsigned int milliseconds,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG();
+    bridgeEventIntervalSet(std::chrono::milliseconds(milliseconds));
+
+exit:
+    return cc;
+}
+
 /**
  * Deletes the on-disk transaction cache for a wallet.
  */
@@ -3055,6 +4272,18 @@ exit:
     return cc;
 }
 
+tABC_CC ABC_LoadHeaderCheckpoints(const char *szPath,
+                                  tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szPath);
+
+    ABC_CHECK_NEW(gContext->blockCache.checkpointsLoad(szPath));
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_PluginDataList(const char *szUserName,
                            const char *szPassword,
                            char ***paszPlugins,
@@ -3197,8 +4426,7 @@ ABC_RequestExchangeRateUpdate(const char *szUserName,
         currencies.insert(static_cast<Currency>(currencyNum));
 
         // Find the user's exchange-rate preference:
-        AutoFree<tABC_AccountSettings, accountSettingsFree> settings;
-        settings.get() = accountSettingsLoad(*account);
+        const auto settings = accountSettingsShared(*account);
         std::string preference = settings->szExchangeRateSource;
 
         // Move the user's preference to the front of the list:
@@ -3308,6 +4536,112 @@ exit:
     return cc;
 }
 
+/**
+ * Streams a wallet's transactions through an export writer.
+ */
+static Status
+exportTransactions(Wallet &wallet, int64_t startTime, int64_t endTime,
+                   tABC_ExportFormat format, const ExportWriter::Sink &sink)
+{
+    std::string currency;
+    ABC_CHECK(currencyCode(currency, static_cast<Currency>(wallet.currency())));
+
+    ExportWriter writer(format, currency, sink);
+    ABC_CHECK(writer.begin());
+    ABC_CHECK(txInfoForEach(wallet, startTime, endTime,
+                            [&writer](tABC_TxInfo *pTransaction)
+    {
+        return writer.add(pTransaction);
+    }));
+    ABC_CHECK(writer.finish());
+
+    return Status();
+}
+
+/**
+ * Exports the transactions in a time range, handing the file
+ * to a callback in chunks as it gets built.
+ * Unlike the older export calls, an empty range produces a valid,
+ * empty file rather than an error.
+ *
+ * @param format    The file format to produce
+ * @param fCallback Receives each chunk, and can return false to stop
+ * @param pData     Passed through to the callback
+ */
+tABC_CC ABC_ExportTransactions(const char *szUserName,
+                               const char *szPassword,
+                               const char *szWalletUUID,
+                               int64_t startTime,
+                               int64_t endTime,
+                               tABC_ExportFormat format,
+                               tABC_Export_Callback fCallback,
+                               void *pData,
+                               tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(fCallback);
+
+    {
+        ABC_GET_WALLET();
+
+        auto sink = [fCallback, pData](const char *data, size_t size)
+        {
+            if (!fCallback(pData, data, size))
+                return ABC_ERROR(ABC_CC_Error, "Export cancelled");
+            return Status();
+        };
+        ABC_CHECK_NEW(exportTransactions(*wallet, startTime, endTime,
+                                         format, sink));
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Exports the transactions in a time range straight to a file descriptor.
+ * The caller keeps ownership of the descriptor.
+ *
+ * @param format    The file format to produce
+ * @param fd        An open, writable file descriptor
+ */
+tABC_CC ABC_ExportTransactionsFd(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szWalletUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_ExportFormat format,
+                                 int fd,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        ABC_GET_WALLET();
+
+        auto sink = [fd](const char *data, size_t size)
+        {
+            while (size)
+            {
+                const auto written = write(fd, data, size);
+                if (written < 0 && EINTR == errno)
+                    continue;
+                if (written <= 0)
+                    return ABC_ERROR(ABC_CC_FileWriteError,
+                                     "Cannot write export file");
+                data += written;
+                size -= written;
+            }
+            return Status();
+        };
+        ABC_CHECK_NEW(exportTransactions(*wallet, startTime, endTime,
+                                         format, sink));
+    }
+
+exit:
+    return cc;
+}
+
 tABC_CC ABC_UploadLogs(const char *szUserName,
                        const char *szPassword,
                        tABC_Error *pError)
@@ -3325,3 +4659,365 @@ tABC_CC ABC_UploadLogs(const char *szUserName,
 exit:
     return cc;
 }
+
+tABC_CC ABC_UploadLogsAsync(const char *szUserName,
+                            const char *szPassword,
+                            tABC_Upload_Callback fCallback,
+                            void *pData,
+                            tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(fCallback);
+
+    {
+        std::shared_ptr<Account> account;
+        cacheAccount(account, szUserName);
+
+        taskPoolRun([account, fCallback, pData]()
+        {
+            uint64_t lastSent = 0, lastTotal = 0;
+            auto progress = [&](uint64_t sent, uint64_t total)
+            {
+                lastSent = sent;
+                lastTotal = total;
+                fCallback(pData, sent, total, nullptr);
+            };
+            const auto s = loginServerUploadLogs(account.get(), progress).log();
+
+            tABC_Error error;
+            s.toError(error, ABC_HERE());
+            fCallback(pData, lastSent, lastTotal, &error);
+        }, TaskPriority::interactive);
+    }
+
+exit:
+    return cc;
+}
+
+/**
+ * Holds a copy of a C string argument, which might be null,
+ * for a call that finishes on another thread.
+ */
+class AsyncArg
+{
+public:
+    AsyncArg(const char *s):
+        null_(!s),
+        value_(s ? s : "")
+    {}
+
+    const char *
+    get() const { return null_ ? nullptr : value_.c_str(); }
+
+private:
+    bool null_;
+    std::string value_;
+};
+
+typedef std::function<void (tABC_Error *pError)> AsyncCall;
+typedef std::function<void (unsigned int requestId,
+                            const tABC_Error *pStatus)> AsyncDeliver;
+
+/**
+ * Runs a blocking call on the core's worker pool.
+ * The call fills in the error and any results,
+ * which `deliver` then hands to the app.
+ * A request cancelled before `deliver` runs reports `ABC_CC_Cancelled`,
+ * so `deliver` must free any results it is not passing on.
+ */
+static unsigned int
+asyncStart(AsyncCall call, AsyncDeliver deliver)
+{
+    return taskPoolAdd([call, deliver](TaskId id,
+                                       const std::atomic<bool> &cancelled)
+    {
+        tABC_Error error;
+        Status().toError(error, ABC_HERE());
+        if (!cancelled)
+            call(&error);
+        if (cancelled)
+            ABC_ERROR(ABC_CC_Cancelled, "Request cancelled").
+            toError(error, ABC_HERE());
+        deliver(id, &error);
+    });
+}
+
+/**
+ * Delivers a JSON result, or NULL for failures and empty results.
+ */
+static AsyncDeliver
+asyncJson(std::shared_ptr<JsonObject> result,
+          tABC_Request_Callback fCallback, void *pData)
+{
+    return [result, fCallback, pData](unsigned int requestId,
+                                      const tABC_Error *pStatus)
+    {
+        std::string json;
+        if (result && ABC_CC_Ok == pStatus->code)
+            json = result->encode();
+        fCallback(pData, requestId, pStatus,
+                  json.empty() ? nullptr : json.c_str());
+    };
+}
+
+tABC_CC ABC_CancelRequest(unsigned int requestId,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+
+    {
+        if (!taskPoolCancel(requestId))
+            ABC_RET_ERROR(ABC_CC_NoRequest, "No such request");
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_PasswordLoginAsync(const char *szUserName,
+                               const char *szPassword,
+                               tABC_Request_Callback fCallback,
+                               void *pData,
+                               unsigned int *pRequestId,
+                               tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(szPassword);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        const AsyncArg username(szUserName), password(szPassword);
+        auto result = std::make_shared<JsonObject>();
+        auto call = [username, password, result](tABC_Error *pError)
+        {
+            char *szOtpResetToken = nullptr;
+            char *szOtpResetDate = nullptr;
+            ABC_PasswordLogin(username.get(), password.get(),
+                              &szOtpResetToken, &szOtpResetDate, pError);
+            if (szOtpResetToken)
+                result->set("otpResetToken", szOtpResetToken).log();
+            if (szOtpResetDate)
+                result->set("otpResetDate", szOtpResetDate).log();
+            ABC_FREE_STR(szOtpResetToken);
+            ABC_FREE_STR(szOtpResetDate);
+        };
+        *pRequestId = asyncStart(call, asyncJson(result, fCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_PinLoginAsync(const char *szUserName,
+                          const char *szPin,
+                          tABC_Request_Callback fCallback,
+                          void *pData,
+                          unsigned int *pRequestId,
+                          tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(szPin);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        const AsyncArg username(szUserName), pin(szPin);
+        auto result = std::make_shared<int>(0);
+        auto call = [username, pin, result](tABC_Error *pError)
+        {
+            ABC_PinLogin(username.get(), pin.get(), result.get(), pError);
+        };
+        auto deliver = [result, fCallback, pData](unsigned int requestId,
+                       const tABC_Error *pStatus)
+        {
+            // The wait only matters when the login fails:
+            std::string json;
+            if (ABC_CC_Ok != pStatus->code && ABC_CC_Cancelled != pStatus->code)
+            {
+                JsonObject out;
+                out.set("waitSeconds", json_int_t(*result)).log();
+                json = out.encode();
+            }
+            fCallback(pData, requestId, pStatus,
+                      json.empty() ? nullptr : json.c_str());
+        };
+        *pRequestId = asyncStart(call, deliver);
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_SpendSignTxAsync(void *pSpend,
+                             tABC_Request_Callback fCallback,
+                             void *pData,
+                             unsigned int *pRequestId,
+                             tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(pSpend);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        auto result = std::make_shared<JsonObject>();
+        auto call = [pSpend, result](tABC_Error *pError)
+        {
+            char *szRawTx = nullptr;
+            if (ABC_CC_Ok == ABC_SpendSignTx(pSpend, &szRawTx, pError))
+                result->set("rawTx", szRawTx).log();
+            ABC_FREE_STR(szRawTx);
+        };
+        *pRequestId = asyncStart(call, asyncJson(result, fCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_DataSyncAccountAsync(const char *szUserName,
+                                 const char *szPassword,
+                                 tABC_Request_Callback fCallback,
+                                 void *pData,
+                                 unsigned int *pRequestId,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        const AsyncArg username(szUserName), password(szPassword);
+        auto result = std::make_shared<JsonObject>();
+        auto call = [username, password, result](tABC_Error *pError)
+        {
+            bool dirty = false;
+            bool passwordChanged = false;
+            if (ABC_CC_Ok == ABC_DataSyncAccount(username.get(), password.get(),
+                                                 &dirty, &passwordChanged,
+                                                 pError))
+            {
+                result->set("dirty", dirty).log();
+                result->set("passwordChanged", passwordChanged).log();
+            }
+        };
+        *pRequestId = asyncStart(call, asyncJson(result, fCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_DataSyncWalletAsync(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                tABC_Request_Callback fCallback,
+                                void *pData,
+                                unsigned int *pRequestId,
+                                tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(szWalletUUID);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        const AsyncArg username(szUserName), password(szPassword);
+        const AsyncArg uuid(szWalletUUID);
+        auto result = std::make_shared<JsonObject>();
+        auto call = [username, password, uuid, result](tABC_Error *pError)
+        {
+            bool dirty = false;
+            if (ABC_CC_Ok == ABC_DataSyncWallet(username.get(), password.get(),
+                                                uuid.get(), &dirty, pError))
+                result->set("dirty", dirty).log();
+        };
+        *pRequestId = asyncStart(call, asyncJson(result, fCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_RequestExchangeRateUpdateAsync(const char *szUserName,
+                                           const char *szPassword,
+                                           int currencyNum,
+                                           tABC_Request_Callback fCallback,
+                                           void *pData,
+                                           unsigned int *pRequestId,
+                                           tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        const AsyncArg username(szUserName), password(szPassword);
+        auto call = [username, password, currencyNum](tABC_Error *pError)
+        {
+            ABC_RequestExchangeRateUpdate(username.get(), password.get(),
+                                          currencyNum, pError);
+        };
+        *pRequestId = asyncStart(call, asyncJson(nullptr, fCallback, pData));
+    }
+
+exit:
+    return cc;
+}
+
+tABC_CC ABC_GetTransactionsAsync(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szWalletUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_Transactions_Callback fCallback,
+                                 void *pData,
+                                 unsigned int *pRequestId,
+                                 tABC_Error *pError)
+{
+    ABC_PROLOG();
+    ABC_CHECK_NULL(szUserName);
+    ABC_CHECK_NULL(szWalletUUID);
+    ABC_CHECK_NULL(fCallback);
+    ABC_CHECK_NULL(pRequestId);
+
+    {
+        struct Result
+        {
+            tABC_TxInfo **aTransactions = nullptr;
+            unsigned int count = 0;
+        };
+        const AsyncArg username(szUserName), password(szPassword);
+        const AsyncArg uuid(szWalletUUID);
+        auto result = std::make_shared<Result>();
+        auto call = [username, password, uuid, startTime, endTime, result]
+                    (tABC_Error *pError)
+        {
+            ABC_GetTransactions(username.get(), password.get(), uuid.get(),
+                                startTime, endTime, &result->aTransactions,
+                                &result->count, pError);
+        };
+        auto deliver = [result, fCallback, pData](unsigned int requestId,
+                       const tABC_Error *pStatus)
+        {
+            // Cancelled requests can still have finished the query:
+            if (ABC_CC_Ok != pStatus->code)
+            {
+                ABC_FreeTransactions(result->aTransactions, result->count);
+                *result = Result();
+            }
+            fCallback(pData, requestId, pStatus,
+                      result->aTransactions, result->count);
+        };
+        *pRequestId = asyncStart(call, deliver);
+    }
+
+exit:
+    return cc;
+}
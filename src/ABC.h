@@ -155,6 +155,8 @@ typedef enum eABC_CC
     ABC_CC_InvalidOTP = 37,
     /** Trying to send too little money. */
     ABC_CC_SpendDust = 38,
+    /** The request was cancelled before it finished. */
+    ABC_CC_Cancelled = 39,
     /** The server says app is obsolete and needs to be upgraded. */
     ABC_CC_Obsolete = 1000
 } tABC_CC;
@@ -190,11 +192,13 @@ typedef struct sABC_Error
 typedef enum eABC_AsyncEventType
 {
     ABC_AsyncEventType_IncomingBitCoin,
+    /** Lists the transactions whose confirmation count changed, if any. */
     ABC_AsyncEventType_BlockHeightChange,
     ABC_AsyncEventType_BalanceUpdate,
     ABC_AsyncEventType_AddressCheckDone,
     ABC_AsyncEventType_IncomingSweep,
     ABC_AsyncEventType_TransactionUpdate,
+    ABC_AsyncEventType_DataSyncUpdate,
 } tABC_AsyncEventType;
 
 /**
@@ -208,6 +212,26 @@ typedef enum eABC_SpendFeeLevel
     ABC_SpendFeeLevelCustom,
 } tABC_SpendFeeLevel;
 
+/**
+ * File formats for transaction exports.
+ */
+typedef enum eABC_ExportFormat
+{
+    ABC_ExportCsv = 0,
+    ABC_ExportQbo,
+} tABC_ExportFormat;
+
+/**
+ * How much `ABC_TrimMemory` should give back.
+ */
+typedef enum eABC_TrimLevel
+{
+    /** Drop caches that rebuild on demand. */
+    ABC_TrimCaches = 0,
+    /** Also unload idle wallets for every account but the current one. */
+    ABC_TrimWallets,
+} tABC_TrimLevel;
+
 /**
  * AirBitz Core Asynchronous Structure
  *
@@ -234,6 +258,14 @@ typedef struct sABC_AsyncBitCoinInfo
 
     /** The amount swept, if this is a sweep. */
     int64_t sweepSatoshi;
+
+    /**
+     * Every transaction this event covers, since events that arrive
+     * close together are merged into one (see `ABC_WatcherEventInterval`).
+     * `szTxID` is the first of these.
+     */
+    const char **aszTxIDs;
+    unsigned int countTxIDs;
 } tABC_AsyncBitCoinInfo;
 
 /**
@@ -503,6 +535,89 @@ typedef struct sABC_AccountSettings
  */
 typedef void (*tABC_BitCoin_Event_Callback)(const tABC_AsyncBitCoinInfo *pInfo);
 
+/**
+ * What the wallet list shows about one wallet.
+ */
+typedef struct sABC_WalletSummary
+{
+    const char *szUUID;
+    /** NULL if the wallet has not loaded yet */
+    const char *szName;
+    int currencyNum;
+    bool bArchived;
+    /** false if the wallet has not loaded yet,
+     * in which case the fields below are all 0 */
+    bool bLoaded;
+    int64_t balance;
+    int64_t confirmed;
+    int64_t unconfirmed;
+    /** addresses checked against the network, out of the total */
+    unsigned int addressesChecked;
+    unsigned int addressesTotal;
+} tABC_WalletSummary;
+
+/**
+ * One payment in a batch spend.
+ */
+typedef struct sABC_BatchPayment
+{
+    const char *szAddress;
+    uint64_t amount;
+} tABC_BatchPayment;
+
+/**
+ * Reports the outcome of one payment in a batch spend.
+ * @param index the payment's position in the array passed in.
+ * @param szTxID the transaction carrying the payment, or NULL on failure.
+ */
+typedef void (*tABC_BatchPayment_Callback)(void *pData,
+                                           unsigned int index,
+                                           const tABC_Error *pStatus,
+                                           const char *szTxID);
+
+/**
+ * Receives one chunk of a streaming export.
+ * @return false to stop the export.
+ */
+typedef bool (*tABC_Export_Callback)(void *pData,
+                                     const char *data,
+                                     unsigned int size);
+
+/**
+ * Reports on a background upload.
+ * @param pStatus NULL while the upload is still going,
+ * or the outcome once it is done.
+ */
+typedef void (*tABC_Upload_Callback)(void *pData,
+                                     uint64_t sent,
+                                     uint64_t total,
+                                     const tABC_Error *pStatus);
+
+/**
+ * Reports the outcome of an asynchronous request.
+ * This runs on one of the core's worker threads,
+ * exactly once for every request that was started.
+ * @param requestId the id the request handed back.
+ * @param pStatus the outcome, which is `ABC_CC_Cancelled`
+ * if `ABC_CancelRequest` got there first.
+ * @param szResult the request's results as a JSON object,
+ * or NULL if it failed or has no results.
+ */
+typedef void (*tABC_Request_Callback)(void *pData,
+                                      unsigned int requestId,
+                                      const tABC_Error *pStatus,
+                                      const char *szResult);
+
+/**
+ * Same as `tABC_Request_Callback`, but hands over a transaction list,
+ * which the callback must free with `ABC_FreeTransactions`.
+ */
+typedef void (*tABC_Transactions_Callback)(void *pData,
+                                           unsigned int requestId,
+                                           const tABC_Error *pStatus,
+                                           tABC_TxInfo **aTransactions,
+                                           unsigned int count);
+
 /* === Library lifetime: === */
 
 /**
@@ -529,6 +644,94 @@ void ABC_Terminate();
 
 void ABC_Log(const char *szMessage);
 
+/**
+ * Sets how much the core logs, where 0 turns logging off
+ * and 1 is the default.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_SetLogLevel(int level);
+
+/**
+ * Sets the size, in bytes, above which encrypted files get compressed,
+ * where 0 (the default) turns compression off.
+ * Core versions without compression support cannot read these files,
+ * so only turn this on once every device on the account is up to date.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_SetCompressionThreshold(unsigned int bytes);
+
+/**
+ * Limits the memory spent on the sync repos kept open between syncs.
+ * @param objectCacheBytes the most parsed git objects to keep, in bytes.
+ * @param mappedBytes the most pack file data to map at once.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_SetSyncCacheLimits(unsigned int objectCacheBytes,
+                            unsigned int mappedBytes);
+
+/**
+ * Lets the wallets drop the raw data of old transactions,
+ * once they have this many confirmations and every output paying
+ * the wallet has been spent just as deeply.
+ * The balance and transaction details stay available,
+ * but signing or exporting such a transaction fetches it again.
+ * @param depth the confirmations needed, or 0 (the default) to keep
+ * everything.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_SetHistoryPruning(unsigned int depth);
+
+/**
+ * Sets how long an API call can run before it is reported
+ * in the "slowCalls" section of `ABC_GetMetrics`.
+ * Each report names the function and wallet, and splits the time
+ * into waiting on the login cache and everything else.
+ * Defaults to 250ms, and zero turns the reports off.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_SetSlowCallThreshold(unsigned int milliseconds);
+
+/**
+ * Starts recording the app's API calls to a file, for replaying later
+ * with the `workload-replay` command in `abc-cli`.
+ * The recording holds each top-level call's name, thread, start time
+ * and duration. Wallets are numbered in the order they first appear,
+ * and no other arguments are kept beyond a size hint, such as a
+ * search query's length, so nothing in it identifies the user.
+ * Can be called at any time, including before `ABC_Initialize`.
+ * @param szPath The file to write, or NULL to stop recording.
+ */
+tABC_CC ABC_RecordWorkload(const char *szPath,
+                           tABC_Error *pError);
+
+/**
+ * Returns the core's counters and timing histograms as JSON.
+ * Histogram bucket `i` counts the values below 2^i,
+ * in the units given by the metric's name.
+ * Each API call gets an "api.<function>_us" histogram.
+ * Can be called at any time, including before `ABC_Initialize`.
+ * @param pszJson A string holding the JSON results.
+ */
+tABC_CC ABC_GetMetrics(char **pszJson,
+                       tABC_Error *pError);
+
+/**
+ * Reports roughly how many bytes the core is holding, as JSON.
+ * The "wallets" section breaks each loaded wallet down by subsystem,
+ * and "blockCache" gives the size of the shared block header map.
+ * @param pszJson A string holding the JSON results.
+ */
+tABC_CC ABC_GetMemoryUsage(char **pszJson,
+                           tABC_Error *pError);
+
+/**
+ * Gives back memory when the operating system is running low,
+ * such as from Android's `onTrimMemory`.
+ * Everything dropped here reloads on its own the next time it is needed.
+ * Can be called at any time, including before `ABC_Initialize`.
+ */
+void ABC_TrimMemory(tABC_TrimLevel level);
+
 tABC_CC ABC_Version(char **szVersion, tABC_Error *pError);
 
 tABC_CC ABC_IsTestNet(bool *pResult, tABC_Error *pError);
@@ -573,11 +776,32 @@ tABC_CC ABC_CheckPassword(const char *szPassword,
 void ABC_FreePasswordRuleArray(tABC_PasswordRule **aRules,
                                unsigned int nCount);
 
+/**
+ * Encodes some text as a QR code, with one byte per module.
+ * Recent results are cached, so redrawing the same code is cheap.
+ */
 tABC_CC ABC_QrEncode(const char *szText,
                      unsigned char **paData,
                      unsigned int *pWidth,
                      tABC_Error *pError);
 
+/**
+ * Encodes some text as a QR code, returning a ready-to-draw bitmap.
+ * Each row starts on a fresh byte, with the leftmost pixel in the
+ * most significant bit, and dark pixels are set.
+ * @param level error correction, from 0 (low) to 3 (high).
+ * @param scale the number of pixels per module.
+ * @param pWidth receives the bitmap's width and height, in pixels.
+ * @param pStride receives the number of bytes in each row.
+ */
+tABC_CC ABC_QrEncodeBitmap(const char *szText,
+                           unsigned int level,
+                           unsigned int scale,
+                           unsigned char **paData,
+                           unsigned int *pWidth,
+                           unsigned int *pStride,
+                           tABC_Error *pError);
+
 /**
  * Generates a random private key in the hbits format.
  */
@@ -624,7 +848,7 @@ void ABC_FreePaymentRequest(tABC_PaymentRequest *pRequest);
 /* === Communications lobby: === */
 
 /**
- * Frees a lobby handle obtained from `ABC_FetchLobby`.
+ * Frees a lobby handle obtained from `ABC_FetchLobby` or `ABC_FetchLobbies`.
  */
 void ABC_FreeLobby(int hLobby);
 
@@ -637,6 +861,22 @@ tABC_CC ABC_FetchLobby(char *szId,
                        int *phResult,
                        tABC_Error *pError);
 
+/**
+ * Fetches several communications lobbies at once.
+ * The requests run side by side, so this takes about as long
+ * as the slowest single fetch.
+ * @param aszIds The lobby IDs.
+ * @param ahResults Receives a handle for each lobby that loaded,
+ * or zero for the ones that did not.
+ * @param aResults Receives the outcome of each fetch.
+ * Free the successful handles with `ABC_FreeLobby`.
+ */
+tABC_CC ABC_FetchLobbies(const char **aszIds,
+                         unsigned int count,
+                         int *ahResults,
+                         tABC_CC *aResults,
+                         tABC_Error *pError);
+
 /**
  * Returns the account request contained within a lobby
  * (or an error if there is none).
@@ -958,6 +1198,22 @@ tABC_CC ABC_BitidSign(const char *szUserName,
                       char **pszBitidSignature,
                       tABC_Error *pError);
 
+/**
+ * Signs several BitID messages at once.
+ * Each message is signed with the key for the URI at the same position.
+ * @param paszBitidAddresses the public address for each message.
+ * @param paszBitidSignatures the signature for each message.
+ * The caller frees both arrays and the strings they hold.
+ */
+tABC_CC ABC_BitidSignMany(const char *szUserName,
+                          const char *szPassword,
+                          const char **aszBitidURIs,
+                          const char **aszMessages,
+                          unsigned int count,
+                          char ***paszBitidAddresses,
+                          char ***paszBitidSignatures,
+                          tABC_Error *pError);
+
 /* === Account sync data: === */
 
 /**
@@ -967,6 +1223,23 @@ tABC_CC ABC_AccountSyncExists(const char *szUserName,
                               bool *pResult,
                               tABC_Error *pError);
 
+/**
+ * Reads a snapshot of the account's wallets, without logging in.
+ * This is one small file read, so the app can show something
+ * right away while the real login and wallet loading go on.
+ * The snapshot is refreshed after each sync and balance change.
+ * It is stored unencrypted in the login directory,
+ * so anyone who can read the device's files can read the wallet names,
+ * balances, and recent transactions it holds.
+ * @param pszJson receives an object like
+ * {"wallets": [{"id", "name", "currency", "balanceSatoshi", "archived",
+ * "updated", "transactions": [{"txid", "time", "amountSatoshi", "name"}]}]},
+ * with the wallets in account order and the newest transactions first.
+ */
+tABC_CC ABC_GetAccountSummary(const char *szUserName,
+                              char **pszJson,
+                              tABC_Error *pError);
+
 tABC_CC ABC_LoadAccountSettings(const char *szUserName,
                                 const char *szPassword,
                                 tABC_AccountSettings **ppSettings,
@@ -995,6 +1268,12 @@ tABC_CC ABC_RemoveCategory(const char *szUserName,
                            char *szCategory,
                            tABC_Error *pError);
 
+tABC_CC ABC_AddCategories(const char *szUserName,
+                          const char *szPassword,
+                          char **aszCategories,
+                          unsigned int count,
+                          tABC_Error *pError);
+
 tABC_CC ABC_DataSyncAccount(const char *szUserName,
                             const char *szPassword,
                             bool *pbDirty,
@@ -1005,6 +1284,17 @@ tABC_CC ABC_UploadLogs(const char *szUserName,
                        const char *szPassword,
                        tABC_Error *pError);
 
+/**
+ * Uploads the logs on a background thread, returning right away.
+ * The callback reports progress as the upload goes,
+ * and is called one last time with the outcome.
+ */
+tABC_CC ABC_UploadLogsAsync(const char *szUserName,
+                            const char *szPassword,
+                            tABC_Upload_Callback fCallback,
+                            void *pData,
+                            tABC_Error *pError);
+
 /** === Plugin data: === */
 
 /**
@@ -1129,6 +1419,25 @@ tABC_CC ABC_CurrencyToSatoshi(const char *szUserName,
                               int64_t *pSatoshi,
                               tABC_Error *pError);
 
+tABC_CC ABC_SatoshiToCurrencyArray(const int64_t *aSatoshi,
+                                   unsigned int count,
+                                   int currencyNum,
+                                   double *aCurrency,
+                                   tABC_Error *pError);
+
+tABC_CC ABC_SatoshiToCurrencyHistory(const int64_t *aSatoshi,
+                                     const int64_t *aTimes,
+                                     unsigned int count,
+                                     int currencyNum,
+                                     double *aCurrency,
+                                     tABC_Error *pError);
+
+tABC_CC ABC_AddExchangeRateHistory(int currencyNum,
+                                   const int64_t *aTimes,
+                                   const double *aRates,
+                                   unsigned int count,
+                                   tABC_Error *pError);
+
 /* === Wallet data: === */
 tABC_CC ABC_CreateWallet(const char *szUserName,
                          const char *szPassword,
@@ -1137,6 +1446,22 @@ tABC_CC ABC_CreateWallet(const char *szUserName,
                          char       **pszUuid,
                          tABC_Error *pError);
 
+/**
+ * Creates a watch-only wallet from an extended public key,
+ * such as `ABC_ExportWalletXPub` returns.
+ * The wallet tracks its addresses and transactions like any other,
+ * but holds no private keys, so spending from it fails.
+ * Its transaction data stays on this device,
+ * although the wallet itself joins the account's wallet list.
+ */
+tABC_CC ABC_CreateWatchOnlyWallet(const char *szUserName,
+                                  const char *szPassword,
+                                  const char *szWalletName,
+                                  const char *szXPub,
+                                  int currencyNum,
+                                  char **pszUuid,
+                                  tABC_Error *pError);
+
 /**
  * Loads a wallet into memory, doing the initial sync if necessary.
  */
@@ -1144,6 +1469,24 @@ tABC_CC ABC_WalletLoad(const char *szUserName,
                        const char *szWalletUUID,
                        tABC_Error *pError);
 
+/**
+ * Starts loading the account's wallets in the background,
+ * beginning with the given wallet, or the top of the list if it is null.
+ * Archived wallets load when they are first used.
+ */
+tABC_CC ABC_WalletsPreload(const char *szUserName,
+                           const char *szFirstUUID,
+                           tABC_Error *pError);
+
+/**
+ * Determines whether the wallet is loaded,
+ * so the other wallet calls will not block on loading it.
+ */
+tABC_CC ABC_WalletReady(const char *szUserName,
+                        const char *szWalletUUID,
+                        bool *pResult,
+                        tABC_Error *pError);
+
 /**
  * Obtains the wallet's text name.
  */
@@ -1168,6 +1511,101 @@ tABC_CC ABC_WalletBalance(const char *szUserName,
                           int64_t *pResult,
                           tABC_Error *pError);
 
+/**
+ * Breaks the wallet's balance down by confirmation state.
+ * The confirmed and unconfirmed amounts add up to `ABC_WalletBalance`.
+ * This reads a running total, so it is cheap enough to poll.
+ * The results are plain values written into the caller's variables,
+ * so there is nothing to free.
+ * @param szUserName the account that owns the wallet.
+ * @param szWalletUUID the wallet to look at.
+ * @param pConfirmed receives the unspent satoshis from confirmed
+ * transactions.
+ * @param pUnconfirmed receives the unspent satoshis from transactions
+ * that have not confirmed yet, including change from the wallet's own spends.
+ * @param pSpendable receives the funds that are safe to spend right now,
+ * excluding double-spent, replace-by-fee, and unconfirmed incoming funds.
+ */
+tABC_CC ABC_WalletBalances(const char *szUserName,
+                           const char *szWalletUUID,
+                           int64_t *pConfirmed,
+                           int64_t *pUnconfirmed,
+                           int64_t *pSpendable,
+                           tABC_Error *pError);
+
+/**
+ * Gathers what the wallet list shows about every wallet in the account,
+ * in account order, in one call.
+ * Wallets that are still loading come back with `bLoaded` false,
+ * rather than making the call wait for them.
+ * The result lives in one allocation,
+ * which must be freed with `ABC_FreeWalletSummaries`.
+ */
+tABC_CC ABC_GetWalletSummaries(const char *szUserName,
+                               tABC_WalletSummary **paSummaries,
+                               unsigned int *pCount,
+                               tABC_Error *pError);
+
+/**
+ * Frees a result from `ABC_GetWalletSummaries`.
+ */
+void ABC_FreeWalletSummaries(tABC_WalletSummary *aSummaries);
+
+/* === Wallet handles: === */
+
+/**
+ * Frees a wallet handle obtained from `ABC_WalletHandle`.
+ */
+void ABC_FreeWalletHandle(int hWallet);
+
+/**
+ * Obtains an integer handle for a logged-in user's wallet.
+ * The handle functions below skip the username and wallet id lookups,
+ * which adds up for bindings that poll many times per screen.
+ * Handles stop working once the user logs out or `ABC_ClearKeyCache` runs.
+ */
+tABC_CC ABC_WalletHandle(const char *szUserName,
+                         const char *szWalletUUID,
+                         int *phResult,
+                         tABC_Error *pError);
+
+/**
+ * Same as `ABC_WalletBalances`, but using a wallet handle.
+ */
+tABC_CC ABC_WalletHandleBalances(int hWallet,
+                                 int64_t *pConfirmed,
+                                 int64_t *pUnconfirmed,
+                                 int64_t *pSpendable,
+                                 tABC_Error *pError);
+
+/**
+ * Same as `ABC_GetTransactionsPage`, but using a wallet handle.
+ */
+tABC_CC ABC_WalletHandleTransactionsPage(int hWallet,
+                                         unsigned int offset,
+                                         unsigned int limit,
+                                         uint64_t since,
+                                         uint64_t *pRevision,
+                                         tABC_TxInfo ***paTransactions,
+                                         unsigned int *pCount,
+                                         char ***paszRemoved,
+                                         unsigned int *pRemovedCount,
+                                         tABC_Error *pError);
+
+/**
+ * Same as `ABC_CreateReceiveRequest`, but using a wallet handle.
+ */
+tABC_CC ABC_WalletHandleReceiveRequest(int hWallet,
+                                       char **pszRequestID,
+                                       tABC_Error *pError);
+
+/**
+ * Same as `ABC_SpendNew`, but using a wallet handle.
+ */
+tABC_CC ABC_WalletHandleSpendNew(int hWallet,
+                                 void **ppResult,
+                                 tABC_Error *pError);
+
 tABC_CC ABC_RenameWallet(const char *szUserName,
                          const char *szPassword,
                          const char *szUUID,
@@ -1205,12 +1643,48 @@ tABC_CC ABC_QBOExport(const char *szUserName,
                       char **szQBOData,
                       tABC_Error *pError);
 
+tABC_CC ABC_ExportTransactions(const char *szUserName,
+                               const char *szPassword,
+                               const char *szUUID,
+                               int64_t startTime,
+                               int64_t endTime,
+                               tABC_ExportFormat format,
+                               tABC_Export_Callback fCallback,
+                               void *pData,
+                               tABC_Error *pError);
+
+tABC_CC ABC_ExportTransactionsFd(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_ExportFormat format,
+                                 int fd,
+                                 tABC_Error *pError);
+
 tABC_CC ABC_DataSyncWallet(const char *szUserName,
                            const char *szPassword,
                            const char *szWalletUUID,
                            bool *pbDirty,
                            tABC_Error *pError);
 
+tABC_CC ABC_DataSyncAll(const char *szUserName,
+                        const char *szPassword,
+                        bool *pbDirty,
+                        tABC_Error *pError);
+
+tABC_CC ABC_DataFlush(tABC_Error *pError);
+
+tABC_CC ABC_DataSyncLoop(const char *szUserName,
+                         const char *szPassword,
+                         tABC_BitCoin_Event_Callback fAsyncBitCoinEventCallback,
+                         void *pData,
+                         tABC_Error *pError);
+
+tABC_CC ABC_DataSyncWakeup(tABC_Error *pError);
+
+tABC_CC ABC_DataSyncStop(tABC_Error *pError);
+
 /* === Receiving: === */
 tABC_CC ABC_CreateReceiveRequest(const char *szUserName,
                                  const char *szPassword,
@@ -1341,6 +1815,22 @@ tABC_CC ABC_SpendApprove(void *pSpend,
                          char **pszTxId,
                          tABC_Error *pError);
 
+/**
+ * Sends a list of payments from a wallet, packing them into
+ * as few transactions as the size limits allow.
+ * The callback fires once for each payment before this returns,
+ * as its transaction is broadcast and saved.
+ */
+tABC_CC ABC_SpendBatch(const char *szUserName,
+                       const char *szWalletUUID,
+                       const tABC_BatchPayment *aPayments,
+                       unsigned int count,
+                       tABC_SpendFeeLevel feeLevel,
+                       uint64_t customFeeSatoshi,
+                       tABC_BatchPayment_Callback fCallback,
+                       void *pData,
+                       tABC_Error *pError);
+
 /**
  * Sweeps a private key into the wallet.
  * The core will fire a callback when the sweep is done.
@@ -1353,6 +1843,71 @@ tABC_CC ABC_SweepKey(const char *szUsername,
                      const char *szKey,
                      tABC_Error *pError);
 
+/**
+ * Sweeps a group of private keys into the wallet with one transaction,
+ * such as a stack of paper wallets.
+ * The core checks every address at once and fires a single
+ * sweep callback when the transaction is done.
+ * @param aszKeys  Private keys in any format `ABC_ParseUri` accepts.
+ */
+tABC_CC ABC_SweepKeys(const char *szUsername,
+                      const char *szPassword,
+                      const char *szWalletUUID,
+                      const char **aszKeys,
+                      unsigned int count,
+                      tABC_Error *pError);
+
+/**
+ * Merges the wallet's small confirmed outputs into larger ones,
+ * so later spends need fewer inputs.
+ * This does nothing while the low-priority fee rate is above the limit,
+ * so the GUI can call it on a timer and let the core decide.
+ * @param smallSatoshi outputs below this value get merged.
+ * @param targetCount stop once no more than this many small outputs remain.
+ * @param maxFeeRate the highest satoshi-per-KB rate worth paying.
+ * @param feeBudget the most to spend on fees across all transactions.
+ * @param paszTxIds receives the ids of the transactions sent, if any.
+ */
+tABC_CC ABC_ConsolidateUtxos(const char *szUserName,
+                             const char *szPassword,
+                             const char *szWalletUUID,
+                             uint64_t smallSatoshi,
+                             unsigned int targetCount,
+                             uint64_t maxFeeRate,
+                             uint64_t feeBudget,
+                             char ***paszTxIds,
+                             unsigned int *pCount,
+                             tABC_Error *pError);
+
+/**
+ * Speeds up a stuck, unconfirmed wallet transaction.
+ * The core sends the transaction's outputs in this wallet back to itself
+ * with a fee that covers both transactions at the chosen level,
+ * so miners pick them up together (child pays for parent).
+ * @param szTxId the transaction to speed up.
+ * @param pszResult receives the id of the new child transaction.
+ */
+tABC_CC ABC_BumpFee(const char *szUserName,
+                    const char *szPassword,
+                    const char *szWalletUUID,
+                    const char *szTxId,
+                    tABC_SpendFeeLevel feeLevel,
+                    uint64_t customFeeSatoshi,
+                    char **pszResult,
+                    tABC_Error *pError);
+
+/**
+ * Stops the core from re-sending a transaction that the network
+ * has not reported back yet, such as one the user has replaced.
+ * Fails with ABC_CC_NoTransaction if the transaction is not waiting.
+ * @param szTxId the transaction to give up on.
+ */
+tABC_CC ABC_CancelRebroadcast(const char *szUserName,
+                              const char *szPassword,
+                              const char *szWalletUUID,
+                              const char *szTxId,
+                              tABC_Error *pError);
+
 /* === Transactions: === */
 tABC_CC ABC_GetTransaction(const char *szUserName,
                            const char *szPassword,
@@ -1370,6 +1925,83 @@ tABC_CC ABC_GetTransactions(const char *szUserName,
                             unsigned int *pCount,
                             tABC_Error *pError);
 
+/**
+ * Same as `ABC_GetTransactions`, but leaves out the inputs and outputs,
+ * so `countOutputs` is zero and `aOutputs` is NULL in every entry.
+ * This is much cheaper for list views, which can fetch the full
+ * details of one transaction with `ABC_GetTransaction`.
+ * Free the result with `ABC_FreeTransactions` as usual.
+ */
+tABC_CC ABC_GetTransactionsSummary(const char *szUserName,
+                                   const char *szPassword,
+                                   const char *szWalletUUID,
+                                   int64_t startTime,
+                                   int64_t endTime,
+                                   tABC_TxInfo ***paTransactions,
+                                   unsigned int *pCount,
+                                   tABC_Error *pError);
+
+/**
+ * Same as `ABC_GetTransactions`, but the whole result set lives in
+ * one allocation, which is much cheaper for long histories.
+ * The result must be freed with `ABC_FreeTransactionsArena`,
+ * and individual transactions must not be freed on their own.
+ */
+tABC_CC ABC_GetTransactionsArena(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szWalletUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_TxInfo ***paTransactions,
+                                 unsigned int *pCount,
+                                 tABC_Error *pError);
+
+/**
+ * Gets the transactions that have changed since an earlier call,
+ * sorted by time. This is much faster than `ABC_GetTransactions`
+ * for refreshing a large transaction history.
+ * @param offset The number of transactions to skip.
+ * @param limit The maximum number of transactions to return, or 0 for all.
+ * @param since The revision returned by an earlier call,
+ * or 0 to get the entire history.
+ * @param pRevision Receives the revision to pass as `since` next time.
+ * @param paszRemoved Receives the ids of transactions that have left
+ * the history since the `since` revision.
+ * The caller must free the strings and the array.
+ */
+tABC_CC ABC_GetTransactionsPage(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                unsigned int offset,
+                                unsigned int limit,
+                                uint64_t since,
+                                uint64_t *pRevision,
+                                tABC_TxInfo ***paTransactions,
+                                unsigned int *pCount,
+                                char ***paszRemoved,
+                                unsigned int *pRemovedCount,
+                                tABC_Error *pError);
+
+/**
+ * Gets the transactions whose confirmation count, counting no higher
+ * than six, has changed since the chain was at an earlier height.
+ * These are the same transactions the `ABC_AsyncEventType_BlockHeightChange`
+ * events list, so the app can refresh just these after a new block.
+ * @param sinceHeight The height returned by an earlier call,
+ * or 0 to get every transaction with fewer than six confirmations,
+ * including unconfirmed ones.
+ * @param pHeight Receives the height to pass as `sinceHeight` next time.
+ * Free the result with `ABC_FreeTransactions` as usual.
+ */
+tABC_CC ABC_GetTransactionsConfirming(const char *szUserName,
+                                      const char *szPassword,
+                                      const char *szWalletUUID,
+                                      unsigned int sinceHeight,
+                                      unsigned int *pHeight,
+                                      tABC_TxInfo ***paTransactions,
+                                      unsigned int *pCount,
+                                      tABC_Error *pError);
+
 tABC_CC ABC_SearchTransactions(const char *szUserName,
                                const char *szPassword,
                                const char *szWalletUUID,
@@ -1383,6 +2015,11 @@ void ABC_FreeTransaction(tABC_TxInfo *pTransaction);
 void ABC_FreeTransactions(tABC_TxInfo **aTransactions,
                           unsigned int count);
 
+/**
+ * Frees a result set from `ABC_GetTransactionsArena`.
+ */
+void ABC_FreeTransactionsArena(tABC_TxInfo **aTransactions);
+
 tABC_CC ABC_SetTransactionDetails(const char *szUserName,
                                   const char *szPassword,
                                   const char *szWalletUUID,
@@ -1424,12 +2061,133 @@ tABC_CC ABC_WatcherDelete(const char *szWalletUUID, tABC_Error *pError);
 
 tABC_CC ABC_WatcherDeleteCache(const char *szWalletUUID, tABC_Error *pError);
 
+/**
+ * Runs the shared network engine, which syncs every wallet over a single
+ * connection pool and event loop. Wallet watchers started while the engine
+ * is running join it, rather than opening their own connections,
+ * and their `ABC_WatcherLoop` calls simply wait for `ABC_WatcherStop`.
+ * This function returns once `ABC_WatcherEngineStop` is called.
+ */
+tABC_CC ABC_WatcherEngineLoop(tABC_Error *pError);
+
+tABC_CC ABC_WatcherEngineStop(tABC_Error *pError);
+
+/**
+ * Sets the minimum time between bitcoin event callbacks for one wallet.
+ * Height, transaction and balance events that arrive in between
+ * are merged into a single callback. Zero turns merging off.
+ */
+tABC_CC ABC_WatcherEventInterval(unsigned int milliseconds,
+                                 tABC_Error *pError);
+
 tABC_CC ABC_TxHeight(const char *szWalletUUID, const char *szTxId, int *height,
                      tABC_Error *pError);
 
 tABC_CC ABC_BlockHeight(const char *szWalletUUID, int *height,
                         tABC_Error *pError);
 
+/**
+ * Loads a table of block timestamps shipped with the app,
+ * so old transactions can be dated without fetching their headers.
+ */
+tABC_CC ABC_LoadHeaderCheckpoints(const char *szPath,
+                                  tABC_Error *pError);
+
+/* === Asynchronous requests: === */
+
+/*
+ * These run the matching blocking calls on a pool of core threads,
+ * returning right away with an id for the request.
+ * Every string argument gets copied, but a spend handle
+ * must stay alive until its request calls back.
+ */
+
+/**
+ * Stops a request that is no longer needed, such as a query
+ * superseded by a newer one. A request that has not started yet
+ * never runs, and one already running has its result thrown away.
+ * Either way, the callback still happens, with `ABC_CC_Cancelled`.
+ */
+tABC_CC ABC_CancelRequest(unsigned int requestId,
+                          tABC_Error *pError);
+
+/**
+ * Same as `ABC_PasswordLogin`.
+ * The result holds any "otpResetToken" and "otpResetDate".
+ */
+tABC_CC ABC_PasswordLoginAsync(const char *szUserName,
+                               const char *szPassword,
+                               tABC_Request_Callback fCallback,
+                               void *pData,
+                               unsigned int *pRequestId,
+                               tABC_Error *pError);
+
+/**
+ * Same as `ABC_PinLogin`.
+ * On failure, the result holds the "waitSeconds" before the next try.
+ */
+tABC_CC ABC_PinLoginAsync(const char *szUserName,
+                          const char *szPin,
+                          tABC_Request_Callback fCallback,
+                          void *pData,
+                          unsigned int *pRequestId,
+                          tABC_Error *pError);
+
+/**
+ * Same as `ABC_SpendSignTx`. The result holds the "rawTx" in hex.
+ */
+tABC_CC ABC_SpendSignTxAsync(void *pSpend,
+                             tABC_Request_Callback fCallback,
+                             void *pData,
+                             unsigned int *pRequestId,
+                             tABC_Error *pError);
+
+/**
+ * Same as `ABC_DataSyncAccount`.
+ * The result holds the "dirty" and "passwordChanged" flags.
+ */
+tABC_CC ABC_DataSyncAccountAsync(const char *szUserName,
+                                 const char *szPassword,
+                                 tABC_Request_Callback fCallback,
+                                 void *pData,
+                                 unsigned int *pRequestId,
+                                 tABC_Error *pError);
+
+/**
+ * Same as `ABC_DataSyncWallet`. The result holds the "dirty" flag.
+ */
+tABC_CC ABC_DataSyncWalletAsync(const char *szUserName,
+                                const char *szPassword,
+                                const char *szWalletUUID,
+                                tABC_Request_Callback fCallback,
+                                void *pData,
+                                unsigned int *pRequestId,
+                                tABC_Error *pError);
+
+/**
+ * Same as `ABC_RequestExchangeRateUpdate`, with no result.
+ */
+tABC_CC ABC_RequestExchangeRateUpdateAsync(const char *szUserName,
+                                           const char *szPassword,
+                                           int currencyNum,
+                                           tABC_Request_Callback fCallback,
+                                           void *pData,
+                                           unsigned int *pRequestId,
+                                           tABC_Error *pError);
+
+/**
+ * Same as `ABC_GetTransactions`.
+ */
+tABC_CC ABC_GetTransactionsAsync(const char *szUserName,
+                                 const char *szPassword,
+                                 const char *szWalletUUID,
+                                 int64_t startTime,
+                                 int64_t endTime,
+                                 tABC_Transactions_Callback fCallback,
+                                 void *pData,
+                                 unsigned int *pRequestId,
+                                 tABC_Error *pError);
+
 #ifdef __cplusplus
 }
 #endif
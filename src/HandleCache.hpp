@@ -62,6 +62,23 @@ public:
         cache_.erase(handle);
     }
 
+    /**
+     * Removes every item matching a predicate.
+     */
+    template<typename F> void
+    eraseIf(F predicate)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        for (auto i = cache_.begin(); i != cache_.end();)
+        {
+            if (predicate(*i->second))
+                i = cache_.erase(i);
+            else
+                ++i;
+        }
+    }
+
 private:
     mutable std::mutex mutex_;
     int lastHandle_ = 0;
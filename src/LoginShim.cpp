@@ -7,7 +7,10 @@
 
 #include "LoginShim.hpp"
 #include "../abcd/account/Account.hpp"
+#include "../abcd/bitcoin/cache/Cache.hpp"
+#include "../abcd/json/JsonObject.hpp"
 #include "../abcd/login/Login.hpp"
+#include "../abcd/login/LoginKeyCache.hpp"
 #include "../abcd/login/LoginPassword.hpp"
 #include "../abcd/login/LoginPin.hpp"
 #include "../abcd/login/LoginPin2.hpp"
@@ -18,69 +21,243 @@
 #include "../abcd/login/json/AuthJson.hpp"
 #include "../abcd/login/json/LoginJson.hpp"
 #include "../abcd/login/server/LoginServer.hpp"
+#include "../abcd/util/Metrics.hpp"
+#include "../abcd/util/Parallel.hpp"
+#include "../abcd/util/TaskPool.hpp"
 #include "../abcd/wallet/Wallet.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <map>
 #include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
 
 namespace abcd {
 
 HandleCache<Lobby> gLobbyCache;
+HandleCache<Wallet> gWalletHandles;
 
-// This mutex protects the shared_ptr caches themselves.
+// Logged-in accounts stay warm for this many users at once,
+// so services that juggle several accounts do not thrash:
+constexpr size_t sessionsMax = 8;
+
+/**
+ * The cached objects for one user.
+ * The session mutex protects the fields, and is held while logging in,
+ * so slow logins for different users can run at the same time.
+ */
+struct Session
+{
+    std::mutex mutex;
+    std::string username; // Fixed, and never changes
+    std::shared_ptr<LoginStore> store;
+    std::shared_ptr<Login> login;
+    std::shared_ptr<Account> account;
+    std::map<std::string, std::shared_ptr<Wallet>> wallets;
+    std::atomic<uint64_t> lastUse{0};
+
+    // Counts wallet removals, so index inserts can spot one they raced:
+    std::atomic<uint64_t> walletRemovals{0};
+
+    // Wallets being loaded right now, so nobody loads one twice:
+    std::set<std::string> walletsLoading;
+    std::condition_variable walletLoaded;
+};
+
+/**
+ * A read-only map from the exact username and wallet id strings
+ * the API was called with, to the wallets they found.
+ * Lookups go through an atomic pointer copy, so the hot read-only calls
+ * neither fix up the username nor touch any mutex.
+ * Writers copy the map, change it, and swap it in under the login mutex.
+ */
+struct WalletEntry
+{
+    std::shared_ptr<Session> session;
+    std::shared_ptr<Wallet> wallet;
+};
+typedef std::unordered_map<std::string, WalletEntry> WalletIndex;
+
+// This mutex protects the session table itself.
 // Using a reference count ensures that any objects still in use
 // on another thread will not be destroyed during a cache update.
 // The mutex only needs to be locked when updating the cache,
 // not when using the objects inside.
 // The cached objects must provide their own thread safety.
 static std::mutex gLoginMutex;
-static std::shared_ptr<LoginStore> gLoginStoreCache;
-static std::shared_ptr<Login> gLoginCache;
-static std::shared_ptr<Account> gAccountCache;
-static std::map<std::string, std::shared_ptr<Wallet>> gWalletCache;
+static std::map<std::string, std::shared_ptr<Session>> gSessions;
+static std::string gLastUsername; // For calls that pass no username
+static std::atomic<uint64_t> gSessionClock(0);
+static std::shared_ptr<const WalletIndex> gWalletIndex;
 
 /**
- * Clears the cached login.
+ * How long callers wait on the login mutex, for the metrics API.
+ */
+static MetricHistogram &
+loginWaitTime()
+{
+    static auto &histogram = metricHistogram("api.login_lock_wait_us");
+    return histogram;
+}
+
+static std::string
+walletKey(const char *szUserName, const char *szUUID)
+{
+    return std::string(szUserName) + '\n' + szUUID;
+}
+
+/**
+ * Drops the index entries that match a predicate.
  * The caller should already be holding the login mutex.
  */
+template<typename F> static void
+walletIndexErase(F predicate)
+{
+    auto index = std::atomic_load(&gWalletIndex);
+    if (!index)
+        return;
+
+    std::shared_ptr<WalletIndex> fresh(new WalletIndex(*index));
+    for (auto i = fresh->begin(); i != fresh->end();)
+    {
+        if (predicate(i->second))
+            i = fresh->erase(i);
+        else
+            ++i;
+    }
+    std::atomic_store(&gWalletIndex,
+                      std::shared_ptr<const WalletIndex>(fresh));
+}
+
+/**
+ * Adds a wallet to the index, provided its session is still cached
+ * and has not removed any wallets since the caller found this one.
+ * @param removals the session's removal count from before the lookup.
+ */
 static void
-cacheClear()
+walletIndexInsert(const std::string &key,
+                  std::shared_ptr<Session> session,
+                  std::shared_ptr<Wallet> wallet, uint64_t removals)
 {
-    gLoginStoreCache.reset();
-    gLoginCache.reset();
-    gAccountCache.reset();
-    gWalletCache.clear();
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
+    auto i = gSessions.find(session->username);
+    if (gSessions.end() == i || i->second != session)
+        return;
+    if (removals != session->walletRemovals)
+        return;
+
+    auto index = std::atomic_load(&gWalletIndex);
+    std::shared_ptr<WalletIndex> fresh(index ?
+                                       new WalletIndex(*index) : new WalletIndex());
+    (*fresh)[key] = WalletEntry{session, wallet};
+    std::atomic_store(&gWalletIndex,
+                      std::shared_ptr<const WalletIndex>(fresh));
 }
 
-void
-cacheLogout()
+/**
+ * Drops the least-recently-used sessions until there is room for one more.
+ * The caller should already be holding the login mutex.
+ */
+static void
+sessionsTrim()
 {
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    cacheClear();
+    while (sessionsMax <= gSessions.size())
+    {
+        auto oldest = gSessions.begin();
+        for (auto i = gSessions.begin(); i != gSessions.end(); ++i)
+            if (i->second->lastUse < oldest->second->lastUse)
+                oldest = i;
+
+        const auto session = oldest->second;
+        walletIndexErase([&session](const WalletEntry &entry)
+        {
+            return entry.session == session;
+        });
+        gSessions.erase(oldest);
+    }
 }
 
-Status
-cacheLoginStore(std::shared_ptr<LoginStore> &result, const char *szUserName)
+/**
+ * Finds or creates the session for a user.
+ * If the username is null, this returns the most recently used session.
+ */
+static Status
+sessionGet(std::shared_ptr<Session> &result, const char *szUserName)
 {
-    std::lock_guard<std::mutex> lock(gLoginMutex);
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
 
-    // Clear the cache if the username has changed:
-    if (szUserName && gLoginStoreCache)
-    {
-        std::string fixed;
+    std::string fixed;
+    if (szUserName)
         ABC_CHECK(LoginStore::fixUsername(fixed, szUserName));
-        if (gLoginStoreCache->username() != fixed)
-            cacheClear();
-    }
+    else
+        fixed = gLastUsername;
 
-    // Load the new store, if necessary:
-    if (!gLoginStoreCache)
+    auto i = gSessions.find(fixed);
+    if (gSessions.end() == i)
     {
         if (!szUserName)
             return ABC_ERROR(ABC_CC_NULLPtr, "No user name");
-        ABC_CHECK(LoginStore::create(gLoginStoreCache, szUserName));
+
+        std::shared_ptr<Session> session(new Session());
+        session->username = fixed;
+        ABC_CHECK(LoginStore::create(session->store, szUserName));
+
+        sessionsTrim();
+        i = gSessions.insert(std::make_pair(fixed, session)).first;
     }
 
-    result = gLoginStoreCache;
+    i->second->lastUse = ++gSessionClock;
+    gLastUsername = fixed;
+    result = i->second;
+    return Status();
+}
+
+void
+cacheLogout()
+{
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
+    gSessions.clear();
+    gLastUsername.clear();
+    loginKeysClear();
+    std::atomic_store(&gWalletIndex, std::shared_ptr<const WalletIndex>());
+    gWalletHandles.eraseIf([](const Wallet &)
+    {
+        return true;
+    });
+}
+
+void
+cacheLogoutUser(const std::string &username)
+{
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
+    loginKeysClear(username);
+    auto i = gSessions.find(username);
+    if (gSessions.end() == i)
+        return;
+    const auto session = i->second;
+    gSessions.erase(i);
+    gWalletHandles.eraseIf([&session](const Wallet &wallet)
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        auto i = session->wallets.find(wallet.id());
+        return session->wallets.end() != i && i->second.get() == &wallet;
+    });
+    walletIndexErase([&username](const WalletEntry &entry)
+    {
+        return entry.session->username == username;
+    });
+    if (gLastUsername == username)
+        gLastUsername.clear();
+}
+
+Status
+cacheLoginStore(std::shared_ptr<LoginStore> &result, const char *szUserName)
+{
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+
+    result = session->store;
     return Status();
 }
 
@@ -88,17 +265,18 @@ Status
 cacheLoginNew(std::shared_ptr<Login> &result,
               const char *szUserName, const char *szPassword)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
-        ABC_CHECK(Login::createNew(gLoginCache, *store, szPassword));
+        ABC_CHECK(Login::createNew(session->login, *store, szPassword));
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
@@ -107,17 +285,18 @@ cacheLoginPassword(std::shared_ptr<Login> &result,
                    const char *szUserName, const std::string &password,
                    AuthError &authError)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
-        ABC_CHECK(loginPassword(gLoginCache, *store, password, authError));
+        ABC_CHECK(loginPassword(session->login, *store, password, authError));
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
@@ -126,18 +305,19 @@ cacheLoginRecovery(std::shared_ptr<Login> &result,
                    const char *szUserName, const std::string &recoveryAnswers,
                    AuthError &authError)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
-        ABC_CHECK(loginRecovery(gLoginCache, *store, recoveryAnswers,
+        ABC_CHECK(loginRecovery(session->login, *store, recoveryAnswers,
                                 authError));
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
@@ -147,18 +327,19 @@ cacheLoginRecovery2(std::shared_ptr<Login> &result,
                     const std::list<std::string> &answers,
                     AuthError &authError)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
-        ABC_CHECK(loginRecovery2(gLoginCache, *store, recovery2Key, answers,
+        ABC_CHECK(loginRecovery2(session->login, *store, recovery2Key, answers,
                                  authError));
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
@@ -167,12 +348,13 @@ cacheLoginPin(std::shared_ptr<Login> &result,
               const char *szUserName, const std::string pin,
               AuthError &authError)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
         AccountPaths paths;
         ABC_CHECK(store->paths(paths));
@@ -180,20 +362,20 @@ cacheLoginPin(std::shared_ptr<Login> &result,
         if (loginPin2Key(pin2Key, paths))
         {
             // Always use PIN login v2 if we have it:
-            ABC_CHECK(loginPin2(gLoginCache, *store, pin2Key, pin, authError));
+            ABC_CHECK(loginPin2(session->login, *store, pin2Key, pin, authError));
         }
         else
         {
             // Otherwise try PIN login v1:
-            ABC_CHECK(loginPin(gLoginCache, *store, pin, authError));
+            ABC_CHECK(loginPin(session->login, *store, pin, authError));
 
             // Upgrade to PIN login v2:
-            ABC_CHECK(loginPin2Set(pin2Key, *gLoginCache, pin));
+            ABC_CHECK(loginPin2Set(pin2Key, *session->login, pin));
             ABC_CHECK(loginPinDelete(*store));
         }
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
@@ -201,99 +383,229 @@ Status
 cacheLoginKey(std::shared_ptr<Login> &result,
               const char *szUserName, DataSlice key)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
+    auto &store = session->store;
 
     // Log the user in, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
     {
-        ABC_CHECK(Login::createOffline(gLoginCache, *store, key));
+        ABC_CHECK(Login::createOffline(session->login, *store, key));
     }
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
 Status
 cacheLogin(std::shared_ptr<Login> &result, const char *szUserName)
 {
-    std::shared_ptr<LoginStore> store;
-    ABC_CHECK(cacheLoginStore(store, szUserName));
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionGet(session, szUserName));
 
     // Verify that the user is logged in:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gLoginCache)
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
         return ABC_ERROR(ABC_CC_AccountDoesNotExist, "Not logged in");
 
-    result = gLoginCache;
+    result = session->login;
     return Status();
 }
 
-Status
-cacheAccount(std::shared_ptr<Account> &result, const char *szUserName)
+/**
+ * Finds the session for a user, creating its account object if necessary.
+ */
+static Status
+sessionAccount(std::shared_ptr<Session> &session,
+               std::shared_ptr<Account> &result, const char *szUserName)
 {
-    std::shared_ptr<Login> login;
-    ABC_CHECK(cacheLogin(login, szUserName));
+    ABC_CHECK(sessionGet(session, szUserName));
 
     // Create the object, if necessary:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    if (!gAccountCache)
-        ABC_CHECK(Account::create(gAccountCache, *login));
+    std::lock_guard<std::mutex> lock(session->mutex);
+    if (!session->login)
+        return ABC_ERROR(ABC_CC_AccountDoesNotExist, "Not logged in");
+    if (!session->account)
+        ABC_CHECK(Account::create(session->account, *session->login));
 
-    result = gAccountCache;
+    result = session->account;
     return Status();
 }
 
+Status
+cacheAccount(std::shared_ptr<Account> &result, const char *szUserName)
+{
+    std::shared_ptr<Session> session;
+    return sessionAccount(session, result, szUserName);
+}
+
 Status
 cacheWalletNew(std::shared_ptr<Wallet> &result, const char *szUserName,
-               const std::string &name, int currency)
+               const std::string &name, int currency,
+               const std::string &xpub)
 {
+    std::shared_ptr<Session> session;
     std::shared_ptr<Account> account;
-    ABC_CHECK(cacheAccount(account, szUserName));
+    ABC_CHECK(sessionAccount(session, account, szUserName));
 
     // Create the wallet:
     std::shared_ptr<Wallet> out;
-    ABC_CHECK(Wallet::createNew(out, *account, name, currency));
+    if (xpub.empty())
+        ABC_CHECK(Wallet::createNew(out, *account, name, currency));
+    else
+        ABC_CHECK(Wallet::createWatchOnly(out, *account, name, currency, xpub));
 
     // Add to the cache:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    gWalletCache[out->id()] = out;
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->wallets[out->id()] = out;
 
     result = std::move(out);
     return Status();
 }
 
-Status
-cacheWallet(std::shared_ptr<Wallet> &result, const char *szUserName,
-            const char *szUUID)
+/**
+ * Returns true if the session is still in the cache.
+ */
+static bool
+sessionLive(const std::shared_ptr<Session> &session)
 {
-    std::shared_ptr<Account> account;
-    ABC_CHECK(cacheAccount(account, szUserName));
-
-    if (!szUUID)
-        return ABC_ERROR(ABC_CC_NULLPtr, "No wallet id");
-    std::string id = szUUID;
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
+    auto i = gSessions.find(session->username);
+    return gSessions.end() != i && i->second == session;
+}
 
-    // Try to return the wallet from the cache:
+/**
+ * Finds a wallet in the session, loading it if necessary.
+ * If another thread is already loading the wallet, this waits for it.
+ */
+static Status
+sessionWallet(std::shared_ptr<Wallet> &result, Session &session,
+              Account &account, const std::string &id)
+{
     {
-        std::lock_guard<std::mutex> lock(gLoginMutex);
-        auto i = gWalletCache.find(id);
-        if (i != gWalletCache.end())
+        std::unique_lock<std::mutex> lock(session.mutex);
+        session.walletLoaded.wait(lock, [&session, &id]()
+        {
+            return !session.walletsLoading.count(id);
+        });
+
+        auto i = session.wallets.find(id);
+        if (i != session.wallets.end())
         {
             result = i->second;
             return Status();
         }
+        session.walletsLoading.insert(id);
     }
 
-    // Load the wallet:
+    // Load without the lock, so other wallets can load at the same time:
     std::shared_ptr<Wallet> out;
-    ABC_CHECK(Wallet::create(out, *account, id));
+    const Status s = Wallet::create(out, account, id);
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        session.walletsLoading.erase(id);
+        if (s)
+            session.wallets[id] = out;
+    }
+    session.walletLoaded.notify_all();
+    ABC_CHECK(s);
 
-    // Add to the cache:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    gWalletCache[id] = out;
+    result = std::move(out);
+    return Status();
+}
+
+Status
+cacheWalletsPreload(const char *szUserName, const std::string &first)
+{
+    std::shared_ptr<Session> session;
+    std::shared_ptr<Account> account;
+    ABC_CHECK(sessionAccount(session, account, szUserName));
+
+    // The selected wallet goes first, then the rest in list order.
+    // Archived wallets wait until something asks for them:
+    std::vector<std::string> ids;
+    if (!first.empty())
+        ids.push_back(first);
+    for (const auto &id: account->wallets.list())
+    {
+        bool archived = false;
+        account->wallets.archived(archived, id).log();
+        if (!archived && id != first)
+            ids.push_back(id);
+    }
+    if (ids.empty())
+        return Status();
+
+    taskPoolRun([session, account, ids]()
+    {
+        // Let the first wallet have the whole machine:
+        std::shared_ptr<Wallet> wallet;
+        if (sessionLive(session))
+            sessionWallet(wallet, *session, *account, ids[0]).log();
+
+        parallelFor(ids.size() - 1, [&](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; ++i)
+            {
+                std::shared_ptr<Wallet> wallet;
+                if (sessionLive(session))
+                    sessionWallet(wallet, *session, *account, ids[i + 1]).log();
+            }
+        }, 2);
+    });
+
+    return Status();
+}
 
+Status
+cacheWalletReady(bool &result, const char *szUserName, const std::string &id)
+{
+    std::shared_ptr<Session> session;
+    std::shared_ptr<Account> account;
+    ABC_CHECK(sessionAccount(session, account, szUserName));
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    result = session->wallets.count(id);
+    return Status();
+}
+
+Status
+cacheWallet(std::shared_ptr<Wallet> &result, const char *szUserName,
+            const char *szUUID)
+{
+    // Try the lock-free index first:
+    if (szUserName && szUUID)
+    {
+        const auto index = std::atomic_load(&gWalletIndex);
+        if (index)
+        {
+            auto i = index->find(walletKey(szUserName, szUUID));
+            if (index->end() != i)
+            {
+                i->second.session->lastUse = ++gSessionClock;
+                result = i->second.wallet;
+                return Status();
+            }
+        }
+    }
+
+    std::shared_ptr<Session> session;
+    std::shared_ptr<Account> account;
+    ABC_CHECK(sessionAccount(session, account, szUserName));
+
+    if (!szUUID)
+        return ABC_ERROR(ABC_CC_NULLPtr, "No wallet id");
+    std::string id = szUUID;
+
+    // Find or load the wallet:
+    const uint64_t removals = session->walletRemovals;
+    std::shared_ptr<Wallet> out;
+    ABC_CHECK(sessionWallet(out, *session, *account, id));
+
+    if (szUserName)
+        walletIndexInsert(walletKey(szUserName, szUUID), session, out,
+                          removals);
     result = std::move(out);
     return Status();
 }
@@ -301,32 +613,62 @@ cacheWallet(std::shared_ptr<Wallet> &result, const char *szUserName,
 Status
 cacheWalletRemove(const char *szUserName, const char *szUUID)
 {
+    std::shared_ptr<Session> session;
     std::shared_ptr<Account> account;
-    ABC_CHECK(cacheAccount(account, szUserName));
+    ABC_CHECK(sessionAccount(session, account, szUserName));
 
     if (!szUUID)
         return ABC_ERROR(ABC_CC_NULLPtr, "No wallet id");
     std::string id = szUUID;
 
     // remove the wallet from the cache:
-    std::lock_guard<std::mutex> lock(gLoginMutex);
-    auto i = gWalletCache.find(id);
-    if (i != gWalletCache.end())
     {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        auto i = session->wallets.find(id);
+        if (i == session->wallets.end())
+            return Status();
         ABC_CHECK(account->wallets.remove(id));
-        gWalletCache.erase(i);
+        session->wallets.erase(i);
+        ++session->walletRemovals;
     }
+
+    MetricLockGuard lock(gLoginMutex, loginWaitTime());
+    walletIndexErase([&session, &id](const WalletEntry &entry)
+    {
+        return entry.session == session && entry.wallet->id() == id;
+    });
+    return Status();
+}
+
+Status
+cacheWalletsLoaded(std::shared_ptr<Account> &account,
+                   std::map<std::string, std::shared_ptr<Wallet>> &result,
+                   const char *szUserName)
+{
+    std::shared_ptr<Session> session;
+    ABC_CHECK(sessionAccount(session, account, szUserName));
+
+    std::lock_guard<std::mutex> lock(session->mutex);
+    result = session->wallets;
     return Status();
 }
 
 std::shared_ptr<Wallet>
 cacheWalletSoft(const std::string &id)
 {
-    // Try to return the wallet from the cache:
+    std::vector<std::shared_ptr<Session>> sessions;
     {
-        std::lock_guard<std::mutex> lock(gLoginMutex);
-        auto i = gWalletCache.find(id);
-        if (i != gWalletCache.end())
+        MetricLockGuard lock(gLoginMutex, loginWaitTime());
+        for (const auto &session: gSessions)
+            sessions.push_back(session.second);
+    }
+
+    // Try to return the wallet from any of the caches:
+    for (const auto &session: sessions)
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        auto i = session->wallets.find(id);
+        if (i != session->wallets.end())
         {
             return i->second;
         }
@@ -336,4 +678,81 @@ cacheWalletSoft(const std::string &id)
     return nullptr;
 }
 
+Status
+cacheMemoryJson(JsonPtr &result)
+{
+    std::vector<std::shared_ptr<Session>> sessions;
+    {
+        MetricLockGuard lock(gLoginMutex, loginWaitTime());
+        for (const auto &session: gSessions)
+            sessions.push_back(session.second);
+    }
+
+    std::vector<std::shared_ptr<Wallet>> wallets;
+    for (const auto &session: sessions)
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        for (const auto &wallet: session->wallets)
+            wallets.push_back(wallet.second);
+    }
+
+    JsonObject out;
+    for (const auto &wallet: wallets)
+    {
+        JsonObject json;
+        ABC_CHECK(json.set("txCache", static_cast<json_int_t>(
+                               wallet->cache.txs.memoryUsed())));
+        ABC_CHECK(json.set("addressCache", static_cast<json_int_t>(
+                               wallet->cache.addresses.memoryUsed())));
+        ABC_CHECK(json.set("txDb", static_cast<json_int_t>(
+                               wallet->txs.memoryUsed())));
+        ABC_CHECK(json.set("addressDb", static_cast<json_int_t>(
+                               wallet->addresses.memoryUsed())));
+        ABC_CHECK(out.set(wallet->id().c_str(), json));
+    }
+
+    result = out;
+    return Status();
+}
+
+void
+cacheTrim(bool unload)
+{
+    std::vector<std::shared_ptr<Session>> sessions;
+    std::string current;
+    {
+        MetricLockGuard lock(gLoginMutex, loginWaitTime());
+        for (const auto &session: gSessions)
+            sessions.push_back(session.second);
+        current = gLastUsername;
+
+        // The index would keep the wallets alive:
+        if (unload)
+            walletIndexErase([&current](const WalletEntry &entry)
+        {
+            return entry.session->username != current;
+        });
+    }
+
+    for (const auto &session: sessions)
+    {
+        std::lock_guard<std::mutex> lock(session->mutex);
+        for (auto i = session->wallets.begin(); i != session->wallets.end();)
+        {
+            // Only unload wallets that no handle, watcher,
+            // or other thread still holds, or they would load twice:
+            if (unload && session->username != current &&
+                    1 == i->second.use_count())
+            {
+                i = session->wallets.erase(i);
+                continue;
+            }
+
+            i->second->cache.txs.trim();
+            i->second->addresses.trim();
+            ++i;
+        }
+    }
+}
+
 } // namespace abcd
@@ -19,6 +19,7 @@
 #include "../abcd/json/JsonPtr.hpp"
 #include "../abcd/util/Data.hpp"
 #include "../abcd/util/Status.hpp"
+#include <map>
 #include <memory>
 
 namespace abcd {
@@ -33,14 +34,29 @@ struct Lobby;
 extern HandleCache<Lobby> gLobbyCache;
 
 /**
- * Clears all cached login objects.
+ * Wallets the API has handed out integer handles for.
+ * Logging out drops the handles along with the rest of the cache.
+ */
+extern HandleCache<Wallet> gWalletHandles;
+
+/**
+ * Clears all cached login objects, for every user.
  */
 void
 cacheLogout();
 
+/**
+ * Clears the cached login objects for one user.
+ * @param username the fixed username.
+ */
+void
+cacheLogoutUser(const std::string &username);
+
 /**
  * Loads the store for the given user into the cache.
- * If the username is null, the function returns whatever is cached.
+ * Several users can be cached at once, with the least recently used
+ * dropping out once the cache fills.
+ * If the username is null, the function returns the most recently used one.
  */
 Status
 cacheLoginStore(std::shared_ptr<LoginStore> &result, const char *szUserName);
@@ -93,23 +109,41 @@ cacheLoginKey(std::shared_ptr<Login> &result,
               const char *szUserName, DataSlice key);
 
 /**
- * Retrieves the cached login, assuming the username still matches.
+ * Retrieves the cached login for the user.
  */
 Status
 cacheLogin(std::shared_ptr<Login> &result, const char *szUserName);
 
 /**
- * Retrieves the cached account, assuming the username still matches.
+ * Retrieves the cached account for the user.
  */
 Status
 cacheAccount(std::shared_ptr<Account> &result, const char *szUserName);
 
 /**
  * Creates a new wallet and adds it to the cache.
+ * Passing an xpub makes a watch-only wallet.
  */
 Status
 cacheWalletNew(std::shared_ptr<Wallet> &result, const char *szUserName,
-               const std::string &name, int currency);
+               const std::string &name, int currency,
+               const std::string &xpub="");
+
+/**
+ * Starts loading the user's wallets on a background worker pool.
+ * The `first` wallet loads on its own before the others start,
+ * or the top of the wallet list if `first` is blank.
+ * Archived wallets are left until something asks for them.
+ */
+Status
+cacheWalletsPreload(const char *szUserName, const std::string &first);
+
+/**
+ * Determines whether a wallet is in memory,
+ * so that using it will not wait on a load.
+ */
+Status
+cacheWalletReady(bool &result, const char *szUserName, const std::string &id);
 
 /**
  * Retrieves a wallet for the currently logged-in user.
@@ -125,12 +159,36 @@ cacheWallet(std::shared_ptr<Wallet> &result, const char *szUserName,
 Status
 cacheWalletRemove(const char *szUserName, const char *szUUID);
 
+/**
+ * Lists the user's wallets that are already in memory, by id,
+ * without loading any of the others.
+ */
+Status
+cacheWalletsLoaded(std::shared_ptr<Account> &account,
+                   std::map<std::string, std::shared_ptr<Wallet>> &result,
+                   const char *szUserName);
+
 /**
  * Grabs a wallet from the cache, if it's already there.
  */
 std::shared_ptr<Wallet>
 cacheWalletSoft(const std::string &id);
 
+/**
+ * Reports roughly how much memory each cached wallet is holding,
+ * broken down by subsystem.
+ */
+Status
+cacheMemoryJson(JsonPtr &result);
+
+/**
+ * Drops the parts of the wallet caches that rebuild on demand.
+ * @param unload true to also unload wallets nothing else is using,
+ * for every account but the most recent. They load again on next use.
+ */
+void
+cacheTrim(bool unload);
+
 } // namespace abcd
 
 #endif
@@ -10,38 +10,55 @@
 #include "../abcd/bitcoin/cache/Cache.hpp"
 #include "../abcd/wallet/Wallet.hpp"
 #include "../abcd/wallet/TxDb.hpp"
+#include "../abcd/wallet/TxIndex.hpp"
+#include "../abcd/util/Parallel.hpp"
 #include "../abcd/util/Util.hpp"
+#include <string.h>
+#include <cstddef>
+#include <vector>
 
 namespace abcd {
 
+// Shorter histories build faster than the threads take to start:
+constexpr size_t txInfoParallelMin = 256;
+
 static void     ABC_TxFreeOutputs(tABC_TxOutput **aOutputs, unsigned int count);
-static int      ABC_TxInfoPtrCompare (const void *a, const void *b);
-static void     ABC_TxStrTable(const char *needle, int *table);
-static int      ABC_TxStrStr(const char *haystack, const char *needle,
-                             tABC_Error *pError);
 
-tABC_TxInfo *
-makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
+/**
+ * Everything the API structures need to know about one transaction,
+ * gathered up before anything gets laid out in C memory.
+ */
+struct TxRecord
 {
-    auto out = structAlloc<tABC_TxInfo>();
+    std::string txid;
+    int64_t balance;
+    int64_t minerFee;
+    int64_t timeCreation;
+    int64_t airbitzFeeWanted;
+    int64_t airbitzFeeSent;
+    unsigned long height;
+    bool isDoubleSpent;
+    bool isReplaceByFee;
+    std::vector<TxInOut> ios;
+    Metadata metadata;
+};
 
+/**
+ * @param outputs false to leave out the inputs and outputs,
+ * which list views never show.
+ */
+static void
+makeTxRecord(TxRecord &result, Wallet &self,
+             const TxInfo &info, const TxStatus &status, bool outputs=true)
+{
     // Basic information:
-    out->szID = stringCopy(info.txid);
-    out->balance = self.addresses.balance(info);
-    out->minerFee = info.fee;
-
-    // Outputs array:
-    out->countOutputs = info.ios.size();
-    out->aOutputs = arrayAlloc<tABC_TxOutput *>(info.ios.size());
-    int i = 0;
-    for (const auto &io: info.ios)
-    {
-        tABC_TxOutput *txo = structAlloc<tABC_TxOutput>();
-        txo->input = io.input;
-        txo->value = io.value;
-        txo->szAddress = stringCopy(io.address);
-        out->aOutputs[i++] = txo;
-    }
+    result.txid = info.txid;
+    result.balance = self.addresses.balance(info);
+    result.minerFee = info.fee;
+    if (outputs)
+        result.ios = info.ios;
+    else
+        result.ios.clear();
 
     // Best-effort timestamp:
     time_t timestamp = time(nullptr);
@@ -52,60 +69,289 @@ makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
     TxMeta meta;
     if (self.txs.get(meta, info.ntxid))
     {
-        out->timeCreation = std::min(timestamp, meta.timeCreation);
-        out->airbitzFeeWanted = meta.airbitzFeeWanted;
-        out->airbitzFeeSent = meta.airbitzFeeSent;
-        out->pDetails = meta.metadata.toDetails();
+        result.timeCreation = std::min(timestamp, meta.timeCreation);
+        result.airbitzFeeWanted = meta.airbitzFeeWanted;
+        result.airbitzFeeSent = meta.airbitzFeeSent;
+        result.metadata = meta.metadata;
     }
     else
     {
-        out->timeCreation = timestamp;
-        out->airbitzFeeWanted = 0;
-        out->airbitzFeeSent = 0;
-        out->pDetails = Metadata().toDetails();
+        result.timeCreation = timestamp;
+        result.airbitzFeeWanted = 0;
+        result.airbitzFeeSent = 0;
+        result.metadata = Metadata();
     }
-    out->pDetails->amountSatoshi = out->balance;
-    out->pDetails->amountFeesMinersSatoshi = out->minerFee;
-    out->pDetails->amountFeesAirbitzSatoshi = out->airbitzFeeSent;
 
     // Status:
-    out->height = status.height;
-    out->bDoubleSpent = status.isDoubleSpent;
-    out->bReplaceByFee = status.isReplaceByFee;
+    result.height = status.height;
+    result.isDoubleSpent = status.isDoubleSpent;
+    result.isReplaceByFee = status.isReplaceByFee;
+}
+
+static void
+makeTxRecordMetaOnly(TxRecord &result, const TxMeta &meta)
+{
+    // Basic information:
+    result.txid = meta.txid;
+    result.balance = 0;
+    result.minerFee = 0;
+    result.ios.clear();
+
+    // Details:
+    result.timeCreation = meta.timeCreation;
+    result.airbitzFeeWanted = meta.airbitzFeeWanted;
+    result.airbitzFeeSent = meta.airbitzFeeSent;
+    result.metadata = meta.metadata;
+
+    // Status:
+    result.height = -1;
+    result.isDoubleSpent = false;
+    result.isReplaceByFee = false;
+}
+
+/**
+ * Gathers the information for an item in the transaction index.
+ * @return false if the transaction has vanished since it was indexed.
+ */
+static bool
+makeTxRecordIndexed(TxRecord &result, Wallet &self, const TxIndexItem &item,
+                    bool outputs=true)
+{
+    if (item.cached)
+    {
+        TxInfo info;
+        TxStatus status;
+        if (!self.cache.txs.info(info, item.id) ||
+                !self.cache.txs.status(status, item.id))
+            return false;
+        makeTxRecord(result, self, info, status, outputs);
+    }
+    else
+    {
+        // Assume transactions that only have metadata are dropped:
+        TxMeta meta;
+        if (!self.txs.get(meta, item.ntxid))
+            return false;
+        makeTxRecordMetaOnly(result, meta);
+    }
+
+    // Use the same timestamp as the index, so the order matches:
+    result.timeCreation = item.time;
+    return true;
+}
+
+static std::vector<TxRecord>
+makeTxRecords(Wallet &self, const std::vector<TxIndexItem> &items,
+              bool outputs=true)
+{
+    // Each item fills its own slot, so the workers never share anything
+    // but the wallet, whose databases do their own locking:
+    std::vector<TxRecord> out(items.size());
+    std::vector<char> found(items.size());
+    parallelFor(items.size(), [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+            found[i] = makeTxRecordIndexed(out[i], self, items[i], outputs);
+    }, txInfoParallelMin);
 
+    // Close the gaps left by vanished transactions, keeping the order:
+    size_t used = 0;
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        if (!found[i])
+            continue;
+        if (used != i)
+            out[used] = std::move(out[i]);
+        ++used;
+    }
+    out.resize(used);
     return out;
 }
 
-tABC_TxInfo *
-makeTxInfoMetaOnly(Wallet &self, const TxMeta &meta)
+/**
+ * Copies the fixed-size fields of a record into the API structures.
+ */
+static void
+fillTxInfo(tABC_TxInfo *out, tABC_TxDetails *details, const TxRecord &record)
 {
-    auto out = structAlloc<tABC_TxInfo>();
+    out->balance = record.balance;
+    out->minerFee = record.minerFee;
+    out->timeCreation = record.timeCreation;
+    out->airbitzFeeWanted = record.airbitzFeeWanted;
+    out->airbitzFeeSent = record.airbitzFeeSent;
+    out->height = record.height;
+    out->bDoubleSpent = record.isDoubleSpent;
+    out->bReplaceByFee = record.isReplaceByFee;
+    out->countOutputs = record.ios.size();
+
+    details->bizId = record.metadata.bizId;
+    details->amountCurrency = record.metadata.amountCurrency;
+    details->amountSatoshi = record.balance;
+    details->amountFeesMinersSatoshi = record.minerFee;
+    details->amountFeesAirbitzSatoshi = record.airbitzFeeSent;
+    out->pDetails = details;
+}
 
-    // Basic information:
-    out->szID = stringCopy(meta.txid);
-    out->balance = 0;
-    out->minerFee = 0;
+/**
+ * Lays a record out the traditional way, with one allocation per piece.
+ */
+static tABC_TxInfo *
+makeTxInfoRecord(const TxRecord &record)
+{
+    auto out = structAlloc<tABC_TxInfo>();
+    fillTxInfo(out, record.metadata.toDetails(), record);
+    out->szID = stringCopy(record.txid);
 
     // Outputs array:
-    out->countOutputs = 0;
-    out->aOutputs = NULL;
+    out->aOutputs = record.ios.size() ?
+                    arrayAlloc<tABC_TxOutput *>(record.ios.size()) : nullptr;
+    int i = 0;
+    for (const auto &io: record.ios)
+    {
+        tABC_TxOutput *txo = structAlloc<tABC_TxOutput>();
+        txo->input = io.input;
+        txo->value = io.value;
+        txo->szAddress = stringCopy(io.address);
+        out->aOutputs[i++] = txo;
+    }
 
-    // Details:
-    out->timeCreation = meta.timeCreation;
-    out->airbitzFeeWanted = meta.airbitzFeeWanted;
-    out->airbitzFeeSent = meta.airbitzFeeSent;
-    out->pDetails = meta.metadata.toDetails();
+    return out;
+}
+
+tABC_TxInfo *
+makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status)
+{
+    TxRecord record;
+    makeTxRecord(record, self, info, status);
+    return makeTxInfoRecord(record);
+}
 
-    out->pDetails->amountSatoshi = out->balance;
-    out->pDetails->amountFeesMinersSatoshi = out->minerFee;
-    out->pDetails->amountFeesAirbitzSatoshi = out->airbitzFeeSent;
+/**
+ * Builds an array of API structures for some index items.
+ */
+static void
+makeTxInfoArray(Wallet &self, const std::vector<TxIndexItem> &items,
+                tABC_TxInfo ***paTransactions, unsigned int *pCount,
+                bool outputs=true)
+{
+    const auto records = makeTxRecords(self, items, outputs);
 
-    // Status:
-    out->height = -1;
-    out->bDoubleSpent = false;
-    out->bReplaceByFee = false;
+    tABC_TxInfo **aTransactions = nullptr;
+    if (records.size())
+        aTransactions = arrayAlloc<tABC_TxInfo *>(records.size());
+    parallelFor(records.size(), [&](size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; ++i)
+            aTransactions[i] = makeTxInfoRecord(records[i]);
+    }, txInfoParallelMin);
 
-    return out;
+    *paTransactions = aTransactions;
+    *pCount = records.size();
+}
+
+/**
+ * Hands out aligned pieces of one block of memory.
+ */
+class TxArena
+{
+public:
+    TxArena(char *base):
+        base_(base)
+    {}
+
+    template<typename T> T *
+    alloc(size_t count)
+    {
+        used_ += (alignof(T) - used_ % alignof(T)) % alignof(T);
+        auto out = reinterpret_cast<T *>(base_ + used_);
+        used_ += sizeof(T) * count;
+        return out;
+    }
+
+    char *
+    copy(const std::string &s)
+    {
+        auto out = alloc<char>(s.size() + 1);
+        memcpy(out, s.c_str(), s.size() + 1);
+        return out;
+    }
+
+    size_t
+    used() const { return used_; }
+
+private:
+    char *base_;
+    size_t used_ = 0;
+};
+
+// The arena starts with its own size, so the free can wipe it:
+constexpr size_t arenaHeader = alignof(std::max_align_t);
+
+/**
+ * Lays the records out in one allocation.
+ * The array of pointers comes first, so it doubles as the arena handle.
+ */
+static tABC_TxInfo **
+makeTxInfoArena(const std::vector<TxRecord> &records)
+{
+    if (!records.size())
+        return nullptr;
+
+    // Measure everything:
+    size_t outputs = 0;
+    size_t chars = 0;
+    for (const auto &record: records)
+    {
+        outputs += record.ios.size();
+        chars += record.txid.size() + 1;
+        chars += record.metadata.name.size() + 1;
+        chars += record.metadata.category.size() + 1;
+        chars += record.metadata.notes.size() + 1;
+        for (const auto &io: record.ios)
+            chars += io.address.size() + 1;
+    }
+    TxArena sizer(nullptr);
+    sizer.alloc<tABC_TxInfo *>(records.size());
+    sizer.alloc<tABC_TxInfo>(records.size());
+    sizer.alloc<tABC_TxDetails>(records.size());
+    sizer.alloc<tABC_TxOutput *>(outputs);
+    sizer.alloc<tABC_TxOutput>(outputs);
+    sizer.alloc<char>(chars);
+    const size_t size = arenaHeader + sizer.used();
+
+    char *block = arrayAlloc<char>(size);
+    *reinterpret_cast<size_t *>(block) = size;
+    TxArena arena(block + arenaHeader);
+    auto aTransactions = arena.alloc<tABC_TxInfo *>(records.size());
+    auto aInfos = arena.alloc<tABC_TxInfo>(records.size());
+    auto aDetails = arena.alloc<tABC_TxDetails>(records.size());
+    auto aOutputs = arena.alloc<tABC_TxOutput *>(outputs);
+    auto aOutputStructs = arena.alloc<tABC_TxOutput>(outputs);
+
+    size_t o = 0;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        const auto &record = records[i];
+        auto out = &aInfos[i];
+        fillTxInfo(out, &aDetails[i], record);
+        out->szID = arena.copy(record.txid);
+        aDetails[i].szName = arena.copy(record.metadata.name);
+        aDetails[i].szCategory = arena.copy(record.metadata.category);
+        aDetails[i].szNotes = arena.copy(record.metadata.notes);
+
+        out->aOutputs = record.ios.size() ? &aOutputs[o] : nullptr;
+        for (const auto &io: record.ios)
+        {
+            auto txo = &aOutputStructs[o];
+            txo->input = io.input;
+            txo->value = io.value;
+            txo->szAddress = arena.copy(io.address);
+            aOutputs[o++] = txo;
+        }
+        aTransactions[i] = out;
+    }
+
+    return aTransactions;
 }
 
 /**
@@ -126,84 +372,134 @@ tABC_CC ABC_TxGetTransactions(Wallet &self,
 {
     tABC_CC cc = ABC_CC_Ok;
 
-    tABC_TxInfo *pTransaction = NULL;
-    tABC_TxInfo **aTransactions = NULL;
-    unsigned int count = 0;
+    // The index is already sorted by time:
+    const auto items = (endTime == ABC_GET_TX_ALL_TIMES) ?
+                       self.txIndex.page(0, 0).items :
+                       self.txIndex.range(startTime, endTime);
+    makeTxInfoArray(self, items, paTransactions, pCount);
 
-    const auto infos = self.cache.txs.statuses(self.cache.addresses.txids());
+    return cc;
+}
 
-    std::map<std::string, TxMeta> txsMap = self.txs.getTxs();
-    std::map<std::string, TxMeta>::iterator it;
+Status
+txInfoForEach(Wallet &self, int64_t startTime, int64_t endTime,
+              const std::function<Status (tABC_TxInfo *)> &visit)
+{
+    // The index is already sorted by time:
+    const auto items = (endTime == ABC_GET_TX_ALL_TIMES) ?
+                       self.txIndex.page(0, 0).items :
+                       self.txIndex.range(startTime, endTime);
 
-    for (const auto &info: infos)
+    for (const auto &item: items)
     {
-        pTransaction = makeTxInfo(self, info.first, info.second);
+        TxRecord record;
+        if (!makeTxRecordIndexed(record, self, item))
+            continue;
 
-        std::string ntxidStr = info.first.ntxid;
-        it = txsMap.find(info.first.ntxid);
-        if (it != txsMap.end())
-            txsMap.erase(it);
+        AutoFree<tABC_TxInfo, ABC_TxFreeTransaction>
+        info(makeTxInfoRecord(record));
+        ABC_CHECK(visit(info.get()));
+    }
+    return Status();
+}
 
-        if ((endTime == ABC_GET_TX_ALL_TIMES) ||
-                (pTransaction->timeCreation >= startTime &&
-                 pTransaction->timeCreation < endTime))
-        {
-            // create space for new entry
-            if (aTransactions == NULL)
-            {
-                ABC_ARRAY_NEW(aTransactions, 1, tABC_TxInfo *);
-                count = 1;
-            }
-            else
-            {
-                count++;
-                ABC_ARRAY_RESIZE(aTransactions, count, tABC_TxInfo *);
-            }
+/**
+ * Same as `ABC_TxGetTransactions`, but without the inputs and outputs.
+ */
+tABC_CC ABC_TxGetTransactionsSummary(Wallet &self,
+                                     int64_t startTime,
+                                     int64_t endTime,
+                                     tABC_TxInfo ***paTransactions,
+                                     unsigned int *pCount,
+                                     tABC_Error *pError)
+{
+    tABC_CC cc = ABC_CC_Ok;
 
-            // add it to the array
-            aTransactions[count - 1] = pTransaction;
-            pTransaction = NULL;
-        }
-    }
+    const auto items = (endTime == ABC_GET_TX_ALL_TIMES) ?
+                       self.txIndex.page(0, 0).items :
+                       self.txIndex.range(startTime, endTime);
+    makeTxInfoArray(self, items, paTransactions, pCount, false);
 
-    // Add transactions that only have metadata and assume they are dropped
-    for (const auto &tx: txsMap)
-    {
-        pTransaction = makeTxInfoMetaOnly(self, tx.second);
+    return cc;
+}
 
-        // create space for new entry
-        if (aTransactions == NULL)
-        {
-            ABC_ARRAY_NEW(aTransactions, 1, tABC_TxInfo *);
-            count = 1;
-        }
-        else
-        {
-            count++;
-            ABC_ARRAY_RESIZE(aTransactions, count, tABC_TxInfo *);
-        }
+/**
+ * Gets one page of the transactions that have changed since
+ * an earlier call, sorted by time.
+ *
+ * @param offset            The number of transactions to skip
+ * @param limit             The maximum number of transactions to return,
+ *                          or 0 for no limit
+ * @param since             The revision returned by an earlier call,
+ *                          or 0 to get the entire history
+ * @param pRevision         Pointer to store the current revision
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param paszRemoved       Pointer to store array of removed transaction ids
+ * @param pRemovedCount     Pointer to store number of removed transaction ids
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_TxGetTransactionsPage(Wallet &self,
+                                  unsigned int offset,
+                                  unsigned int limit,
+                                  uint64_t since,
+                                  uint64_t *pRevision,
+                                  tABC_TxInfo ***paTransactions,
+                                  unsigned int *pCount,
+                                  char ***paszRemoved,
+                                  unsigned int *pRemovedCount,
+                                  tABC_Error *pError)
+{
+    tABC_CC cc = ABC_CC_Ok;
 
-        // add it to the array
-        aTransactions[count - 1] = pTransaction;
-        pTransaction = NULL;
-    }
+    const auto page = self.txIndex.page(offset, limit, since);
+    makeTxInfoArray(self, page.items, paTransactions, pCount);
 
-    // if we have more than one, then let's sort them
-    if (count > 1)
-    {
-        // sort the transactions by creation date using qsort
-        qsort(aTransactions, count, sizeof(tABC_TxInfo *), ABC_TxInfoPtrCompare);
-    }
+    char **aszRemoved = nullptr;
+    if (page.removed.size())
+        aszRemoved = arrayAlloc<char *>(page.removed.size());
+    for (size_t i = 0; i < page.removed.size(); ++i)
+        aszRemoved[i] = stringCopy(page.removed[i]);
 
-    // store final results
-    *paTransactions = aTransactions;
-    aTransactions = NULL;
-    *pCount = count;
-    count = 0;
+    *pRevision = page.revision;
+    *paszRemoved = aszRemoved;
+    *pRemovedCount = page.removed.size();
 
-exit:
-    ABC_TxFreeTransaction(pTransaction);
-    ABC_TxFreeTransactions(aTransactions, count);
+    return cc;
+}
+
+/**
+ * Gets the transactions whose displayed confirmation count has changed
+ * since the chain was at an earlier height, sorted by time.
+ *
+ * @param sinceHeight       The height returned by an earlier call,
+ *                          or 0 to get every shallow transaction
+ * @param pHeight           Pointer to store the current chain height
+ * @param paTransactions    Pointer to store array of transactions info pointers
+ * @param pCount            Pointer to store number of transactions
+ * @param pError            A pointer to the location to store the error if there is one
+ */
+tABC_CC ABC_TxGetTransactionsConfirming(Wallet &self,
+                                        unsigned int sinceHeight,
+                                        unsigned int *pHeight,
+                                        tABC_TxInfo ***paTransactions,
+                                        unsigned int *pCount,
+                                        tABC_Error *pError)
+{
+    tABC_CC cc = ABC_CC_Ok;
+
+    const auto height = self.cache.blocks.height();
+    const auto txids = self.cache.txs.confirmationsChanged(
+                           sinceHeight, height, confirmationsShallow);
+
+    // The index only holds this wallet's transactions, already sorted:
+    std::vector<TxIndexItem> items;
+    if (txids.size())
+        for (const auto &item: self.txIndex.page(0, 0).items)
+            if (txids.count(item.id))
+                items.push_back(item);
+    makeTxInfoArray(self, items, paTransactions, pCount);
+    *pHeight = height;
 
     return cc;
 }
@@ -223,11 +519,6 @@ tABC_CC ABC_TxSearchTransactions(Wallet &self,
                                  tABC_Error *pError)
 {
     tABC_CC cc = ABC_CC_Ok;
-    tABC_TxInfo **aTransactions = NULL;
-    tABC_TxInfo **aSearchTransactions = NULL;
-    unsigned int i;
-    unsigned int count = 0;
-    unsigned int matchCount = 0;
 
     ABC_SET_ERR_CODE(pError, ABC_CC_Ok);
     ABC_CHECK_NULL(paTransactions);
@@ -235,63 +526,72 @@ tABC_CC ABC_TxSearchTransactions(Wallet &self,
     ABC_CHECK_NULL(pCount);
     *pCount = 0;
 
-    ABC_TxGetTransactions(self, ABC_GET_TX_ALL_TIMES, ABC_GET_TX_ALL_TIMES,
-                          &aTransactions, &count, pError);
-    ABC_ARRAY_NEW(aSearchTransactions, count, tABC_TxInfo *);
-    for (i = 0; i < count; i++)
     {
-        tABC_TxInfo *pInfo = aTransactions[i];
-        auto satoshi = std::to_string(pInfo->pDetails->amountSatoshi);
-        auto currency = std::to_string(pInfo->pDetails->amountCurrency);
-        if (ABC_TxStrStr(satoshi.c_str(), szQuery, pError))
+        // The metadata index finds the matches, and the main index sorts them:
+        const std::string query = szQuery ? szQuery : "";
+        const auto ntxids = self.txs.search(query);
+        std::vector<TxIndexItem> items;
+        for (const auto &item: self.txIndex.page(0, 0).items)
         {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        if (ABC_TxStrStr(currency.c_str(), szQuery, pError))
-        {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        if (ABC_TxStrStr(pInfo->pDetails->szName, szQuery, pError))
-        {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        else if (ABC_TxStrStr(pInfo->pDetails->szCategory, szQuery, pError))
-        {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        else if (ABC_TxStrStr(pInfo->pDetails->szNotes, szQuery, pError))
-        {
-            aSearchTransactions[matchCount] = pInfo;
-            matchCount++;
-            continue;
-        }
-        else
-        {
-            ABC_TxFreeTransaction(pInfo);
+            if (ntxids.count(item.ntxid))
+            {
+                items.push_back(item);
+                continue;
+            }
+
+            // Transactions without metadata can still match by amount:
+            TxInfo info;
+            if (query.size() && item.cached && !self.txs.has(item.ntxid) &&
+                    self.cache.txs.info(info, item.id))
+            {
+                const auto satoshi =
+                    std::to_string(self.addresses.balance(info));
+                if (std::string::npos != satoshi.find(query))
+                    items.push_back(item);
+            }
         }
-        aTransactions[i] = NULL;
-    }
-    if (matchCount > 0)
-    {
-        ABC_ARRAY_RESIZE(aSearchTransactions, matchCount, tABC_TxInfo *);
+        makeTxInfoArray(self, items, paTransactions, pCount);
     }
 
-    *paTransactions = aSearchTransactions;
-    *pCount = matchCount;
-    aTransactions = NULL;
 exit:
-    ABC_FREE(aTransactions);
     return cc;
 }
 
+/**
+ * Gets the transactions associated with the given wallet,
+ * laid out in a single allocation.
+ * Free the result with `ABC_TxFreeTransactionsArena`.
+ */
+tABC_CC ABC_TxGetTransactionsArena(Wallet &self,
+                                   int64_t startTime,
+                                   int64_t endTime,
+                                   tABC_TxInfo ***paTransactions,
+                                   unsigned int *pCount,
+                                   tABC_Error *pError)
+{
+    tABC_CC cc = ABC_CC_Ok;
+
+    // The index is already sorted by time:
+    const auto items = (endTime == ABC_GET_TX_ALL_TIMES) ?
+                       self.txIndex.page(0, 0).items :
+                       self.txIndex.range(startTime, endTime);
+    const auto records = makeTxRecords(self, items);
+    *paTransactions = makeTxInfoArena(records);
+    *pCount = records.size();
+
+    return cc;
+}
+
+void ABC_TxFreeTransactionsArena(tABC_TxInfo **aTransactions)
+{
+    if (aTransactions)
+    {
+        char *block = reinterpret_cast<char *>(aTransactions) - arenaHeader;
+        const size_t size = *reinterpret_cast<size_t *>(block);
+        ABC_CLEAR_FREE(block, size);
+    }
+}
+
 /**
  * Frees the given transaction
  *
@@ -328,37 +628,6 @@ void ABC_TxFreeTransactions(tABC_TxInfo **aTransactions,
     }
 }
 
-/**
- * This function is used to support sorting an array of tTxInfo pointers via qsort.
- * qsort has the following documentation for the required function:
- *
- * Pointer to a function that compares two elements.
- * This function is called repeatedly by qsort to compare two elements. It shall follow the following prototype:
- *
- * int compar (const void* p1, const void* p2);
- *
- * Taking two pointers as arguments (both converted to const void*). The function defines the order of the elements by returning (in a stable and transitive manner):
- * return value	meaning
- * <0	The element pointed by p1 goes before the element pointed by p2
- * 0	The element pointed by p1 is equivalent to the element pointed by p2
- * >0	The element pointed by p1 goes after the element pointed by p2
- *
- */
-static
-int ABC_TxInfoPtrCompare (const void *a, const void *b)
-{
-    tABC_TxInfo **ppInfoA = (tABC_TxInfo **)a;
-    tABC_TxInfo *pInfoA = (tABC_TxInfo *)*ppInfoA;
-    tABC_TxInfo **ppInfoB = (tABC_TxInfo **)b;
-    tABC_TxInfo *pInfoB = (tABC_TxInfo *)*ppInfoB;
-
-    if (pInfoA->timeCreation < pInfoB->timeCreation) return -1;
-    if (pInfoA->timeCreation == pInfoB->timeCreation) return 0;
-    if (pInfoA->timeCreation > pInfoB->timeCreation) return 1;
-
-    return 0;
-}
-
 void ABC_TxFreeOutputs(tABC_TxOutput **aOutputs, unsigned int count)
 {
     if ((aOutputs != NULL) && (count > 0))
@@ -376,106 +645,4 @@ void ABC_TxFreeOutputs(tABC_TxOutput **aOutputs, unsigned int count)
     }
 }
 
-/**
- * This implemens the KMP failure function. Its the preprocessing before we can
- * search for substrings.
- *
- * @param needle - The string to preprocess
- * @param table - An array of integers the string length of needle
- *
- * Returns 1 if a match is found otherwise returns 0
- *
- */
-static
-void ABC_TxStrTable(const char *needle, int *table)
-{
-    size_t pos = 2, cnd = 0;
-    table[0] = -1;
-    table[1] = 0;
-    size_t needle_size = strlen(needle);
-
-    while (pos < needle_size)
-    {
-        if (tolower(needle[pos - 1]) == tolower(needle[cnd]))
-        {
-            cnd = cnd + 1;
-            table[pos] = cnd;
-            pos = pos + 1;
-        }
-        else if (cnd > 0)
-            cnd = table[cnd];
-        else
-        {
-            table[pos] = 0;
-            pos = pos + 1;
-        }
-    }
-}
-
-/**
- * This function implemens the KMP string searching algo. This function is
- * used for string matching when searching transactions.
- *
- * @param haystack - The string to search
- * @param needle - The string to find in the haystack
- *
- * Returns 1 if a match is found otherwise returns 0
- *
- */
-static
-int ABC_TxStrStr(const char *haystack, const char *needle,
-                 tABC_Error *pError)
-{
-    tABC_CC cc = ABC_CC_Ok;
-    if (haystack == NULL || needle == NULL)
-    {
-        return 0;
-    }
-    int result = -1;
-    size_t haystack_size;
-    size_t needle_size;
-    size_t m = 0, i = 0;
-    int *table;
-
-    haystack_size = strlen(haystack);
-    needle_size = strlen(needle);
-
-    if (haystack_size == 0 || needle_size == 0)
-    {
-        return 0;
-    }
-
-    ABC_ARRAY_NEW(table, needle_size, int);
-    ABC_TxStrTable(needle, table);
-
-    while (m + i < haystack_size)
-    {
-        if (tolower(needle[i]) == tolower(haystack[m + i]))
-        {
-            if (i == needle_size - 1)
-            {
-                result = m;
-                break;
-            }
-            i = i + 1;
-        }
-        else
-        {
-            if (table[i] > -1)
-            {
-                i = table[i];
-                m = m + i - table[i];
-            }
-            else
-            {
-                i = 0;
-                m = m + 1;
-            }
-        }
-    }
-exit:
-    ABC_FREE(table);
-    return result > -1 ? 1 : 0;
-}
-
 } // namespace abcd
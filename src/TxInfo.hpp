@@ -9,6 +9,7 @@
 #define SRC_TX_INFO_HPP
 
 #include "../abcd/util/Status.hpp"
+#include <functional>
 
 namespace abcd {
 
@@ -23,6 +24,15 @@ class Wallet;
 tABC_TxInfo *
 makeTxInfo(Wallet &self, const TxInfo &info, const TxStatus &status);
 
+/**
+ * Visits the transactions in a time range one at a time, oldest first,
+ * so callers never hold the whole history in memory.
+ * The visitor must not keep the structure it is handed.
+ */
+Status
+txInfoForEach(Wallet &self, int64_t startTime, int64_t endTime,
+              const std::function<Status (tABC_TxInfo *)> &visit);
+
 tABC_CC ABC_TxGetTransactions(Wallet &self,
                               int64_t startTime,
                               int64_t endTime,
@@ -30,12 +40,46 @@ tABC_CC ABC_TxGetTransactions(Wallet &self,
                               unsigned int *pCount,
                               tABC_Error *pError);
 
+tABC_CC ABC_TxGetTransactionsSummary(Wallet &self,
+                                     int64_t startTime,
+                                     int64_t endTime,
+                                     tABC_TxInfo ***paTransactions,
+                                     unsigned int *pCount,
+                                     tABC_Error *pError);
+
+tABC_CC ABC_TxGetTransactionsPage(Wallet &self,
+                                  unsigned int offset,
+                                  unsigned int limit,
+                                  uint64_t since,
+                                  uint64_t *pRevision,
+                                  tABC_TxInfo ***paTransactions,
+                                  unsigned int *pCount,
+                                  char ***paszRemoved,
+                                  unsigned int *pRemovedCount,
+                                  tABC_Error *pError);
+
+tABC_CC ABC_TxGetTransactionsConfirming(Wallet &self,
+                                        unsigned int sinceHeight,
+                                        unsigned int *pHeight,
+                                        tABC_TxInfo ***paTransactions,
+                                        unsigned int *pCount,
+                                        tABC_Error *pError);
+
 tABC_CC ABC_TxSearchTransactions(Wallet &self,
                                  const char *szQuery,
                                  tABC_TxInfo ***paTransactions,
                                  unsigned int *pCount,
                                  tABC_Error *pError);
 
+tABC_CC ABC_TxGetTransactionsArena(Wallet &self,
+                                   int64_t startTime,
+                                   int64_t endTime,
+                                   tABC_TxInfo ***paTransactions,
+                                   unsigned int *pCount,
+                                   tABC_Error *pError);
+
+void ABC_TxFreeTransactionsArena(tABC_TxInfo **aTransactions);
+
 void ABC_TxFreeTransaction(tABC_TxInfo *pTransactions);
 
 void ABC_TxFreeTransactions(tABC_TxInfo **aTransactions,
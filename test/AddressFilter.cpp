@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/AddressFilter.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Address filter", "[bitcoin][filter]")
+{
+    abcd::AddressFilter filter;
+    REQUIRE(!filter.mayContain("1BitcoinEaterAddressDontSendf59kuE"));
+
+    SECTION("no misses while growing")
+    {
+        for (int i = 0; i < 1000; ++i)
+            filter.insert("address" + std::to_string(i));
+        for (int i = 0; i < 1000; ++i)
+            REQUIRE(filter.mayContain("address" + std::to_string(i)));
+
+        size_t hits = 0;
+        for (int i = 1000; i < 11000; ++i)
+            if (filter.mayContain("address" + std::to_string(i)))
+                ++hits;
+        REQUIRE(hits < 200);
+    }
+
+    SECTION("assign")
+    {
+        filter.assign(std::vector<std::string>{"a", "b"});
+        REQUIRE(filter.mayContain("a"));
+        REQUIRE(filter.mayContain("b"));
+        filter.clear();
+        REQUIRE(!filter.mayContain("a"));
+    }
+}
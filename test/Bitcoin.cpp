@@ -5,6 +5,7 @@
  * See the LICENSE file for more information.
  */
 
+#include "../abcd/bitcoin/TxView.hpp"
 #include "../abcd/bitcoin/Utility.hpp"
 #include "../abcd/crypto/Encoding.hpp"
 #include "../abcd/json/JsonBox.hpp"
@@ -26,3 +27,33 @@ TEST_CASE("Decode segwit transaction", "[bitcoin]")
     REQUIRE(result.outputs.size() == 1);
     REQUIRE(result.locktime == 0);
 }
+
+TEST_CASE("Index a transaction without decoding it", "[bitcoin]")
+{
+    abcd::DataChunk rawTx;
+    abcd::base16Decode(rawTx, rawTxHex);
+    bc::transaction_type tx;
+    REQUIRE(abcd::decodeTx(tx, rawTx));
+
+    abcd::TxView view;
+    REQUIRE(view.parse(rawTx));
+    REQUIRE(view.segwit());
+    REQUIRE(view.inputs().size() == 1);
+    REQUIRE(view.outputs().size() == 1);
+    REQUIRE(view.outputs()[0].value == tx.outputs[0].value);
+    REQUIRE(view.ntxid() == abcd::makeNtxid(tx));
+    REQUIRE(!view.isReplaceByFee());
+
+    bc::payment_address address;
+    REQUIRE(bc::extract(address, tx.outputs[0].script));
+    REQUIRE(abcd::outputScriptAddress(view.outputs()[0].script) ==
+            address.encoded());
+    abcd::AddressNames names;
+    for (int i = 0; i < 2; ++i)
+        REQUIRE(abcd::outputScriptAddress(view.outputs()[0].script, &names) ==
+                address.encoded());
+
+    // Truncated data should fail cleanly:
+    const abcd::DataSlice half(rawTx.data(), rawTx.data() + rawTx.size() / 2);
+    REQUIRE(!view.parse(half));
+}
@@ -44,3 +44,37 @@ TEST_CASE("BitID key derivation", "[login][bitid]")
                                            "test", "http://bitid.bitcoin.blue/callback", 0);
     REQUIRE(signature.address == "1J34vj4wowwPYafbeibZGht3zy3qERoUM1");
 }
+
+TEST_CASE("BitID key cache", "[login][bitid]")
+{
+    bc::word_list mnemonic =
+    {
+        "inhale", "praise", "target", "steak", "garlic", "cricket",
+        "paper", "better", "evil", "almost", "sadness", "crawl",
+        "city", "banner", "amused", "fringe", "fox", "insect",
+        "roast", "aunt", "prefer", "hollow", "basic", "ladder"
+    };
+    const auto rootKey = bc::decode_mnemonic(mnemonic);
+    const std::string callback = "http://bitid.bitcoin.blue/callback";
+    abcd::BitidKeys keys(rootKey);
+
+    SECTION("single")
+    {
+        const auto expected = abcd::bitidSign(rootKey, "test", callback, 1);
+        REQUIRE(keys.sign("test", callback, 1).address == expected.address);
+        REQUIRE(keys.sign("test", callback, 1).address == expected.address);
+    }
+    SECTION("batch")
+    {
+        std::vector<abcd::BitidChallenge> challenges =
+        {
+            {"a", callback, 0}, {"b", "https://example.com/bitid", 0}, {"c", callback, 0}
+        };
+        const auto signatures = keys.sign(challenges);
+        REQUIRE(3 == signatures.size());
+        REQUIRE(signatures[0].address == "1J34vj4wowwPYafbeibZGht3zy3qERoUM1");
+        REQUIRE(signatures[2].address == signatures[0].address);
+        REQUIRE(signatures[1].address != signatures[0].address);
+        REQUIRE(signatures[0].signature != signatures[2].signature);
+    }
+}
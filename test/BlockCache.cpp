@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/cache/BlockCache.hpp"
+#include "../abcd/util/SharedState.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("Block cache clear", "[bitcoin][cache]")
+{
+    TempDir dir;
+    auto shared = std::make_shared<abcd::SharedState>();
+    REQUIRE(shared->open(dir.path("Shared.bin")));
+
+    abcd::BlockCache blocks(dir.path("Blocks.json"), dir.path("Headers.bin"),
+                            shared);
+    blocks.heightSet(400000);
+    REQUIRE(400000 == blocks.height());
+    REQUIRE(400000 == shared->get(abcd::SharedSlot::blockHeight));
+
+    // A cleared cache must not pick the old height back up:
+    blocks.clear();
+    REQUIRE(0 == blocks.height());
+    REQUIRE(0 == shared->get(abcd::SharedSlot::blockHeight));
+}
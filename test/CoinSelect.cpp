@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/spend/CoinSelect.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+static abcd::CoinSelectParams
+testParams(uint64_t target)
+{
+    // A flat 1000 satoshis plus 100 per input:
+    auto fee = [](size_t inputs)
+    {
+        return 1000 + 100 * static_cast<uint64_t>(inputs);
+    };
+    return abcd::CoinSelectParams{target, fee, 100, 500, 5};
+}
+
+TEST_CASE("Coin selection", "[bitcoin][spend]")
+{
+    abcd::CoinSelection chosen;
+
+    SECTION("finds a changeless combination")
+    {
+        // 3000 + 7000 - 1200 in fees lands exactly on the target:
+        std::vector<uint64_t> values{50000, 3000, 7000, 20000};
+        REQUIRE(abcd::coinSelect(chosen, values, testParams(8800)));
+        REQUIRE(0 == chosen.change);
+        REQUIRE(1200 == chosen.fee);
+        REQUIRE(2 == chosen.inputs.size());
+        REQUIRE(2 == chosen.inputs[0]);
+        REQUIRE(1 == chosen.inputs[1]);
+    }
+
+    SECTION("falls back to the smallest sufficient coin")
+    {
+        std::vector<uint64_t> values{50000, 3000, 20000};
+        REQUIRE(abcd::coinSelect(chosen, values, testParams(10000)));
+        REQUIRE(1 == chosen.inputs.size());
+        REQUIRE(2 == chosen.inputs[0]);
+        REQUIRE(1100 == chosen.fee);
+        REQUIRE(8900 == chosen.change);
+    }
+
+    SECTION("skips coins worth less than their fee")
+    {
+        std::vector<uint64_t> values{100, 100, 100, 100};
+        REQUIRE(!abcd::coinSelect(chosen, values, testParams(0)));
+        REQUIRE(!abcd::coinSelectMaximum(chosen, values, testParams(0)));
+    }
+
+    SECTION("respects the input limit")
+    {
+        std::vector<uint64_t> values(10, 2000);
+        REQUIRE(!abcd::coinSelect(chosen, values, testParams(15000)));
+
+        REQUIRE(abcd::coinSelectMaximum(chosen, values, testParams(0)));
+        REQUIRE(5 == chosen.inputs.size());
+        REQUIRE(1500 == chosen.fee);
+        REQUIRE(8500 == chosen.change);
+    }
+
+    SECTION("reports insufficient funds")
+    {
+        std::vector<uint64_t> values{5000, 5000};
+        REQUIRE(!abcd::coinSelect(chosen, values, testParams(9000)));
+    }
+}
@@ -22,6 +22,20 @@ TEST_CASE("File name", "[crypto]")
           "5vJNMWZ68tsp2HJa1AfMhZpcpU9Wm9ccEw7cTwvARHXh");
 }
 
+TEST_CASE("HMAC-SHA256", "[crypto]")
+{
+    // RFC 4231 test cases 2 and 6:
+    CHECK(abcd::base16Encode(abcd::HmacKey(std::string("Jefe")).hash(
+                                 std::string("what do ya want for nothing?"))) ==
+          "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    const abcd::DataChunk longKey(131, 0xaa);
+    CHECK(abcd::base16Encode(abcd::hmacSha256(
+                                 std::string("Test Using Larger Than Block-Size Key - Hash Key First"),
+                                 longKey)) ==
+          "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+}
+
 TEST_CASE("Decryption", "[crypto][encryption]")
 {
     tABC_Error error;
@@ -62,3 +76,22 @@ TEST_CASE("Encryption round-trip", "[crypto][encryption]")
     CHECK(box.decrypt(data, key));
     CHECK(abcd::toString(data) == payload);
 }
+
+TEST_CASE("Compressed encryption round-trip", "[crypto][encryption]")
+{
+    abcd::DataChunk key;
+    abcd::base16Decode(key, keyHex);
+    std::string payload;
+    for (int i = 0; i < 200; ++i)
+        payload += "{\"name\": \"Coffee\", \"category\": \"Expense:Food\"},";
+
+    abcd::jsonBoxCompressionSet(1024);
+    abcd::JsonBox box;
+    CHECK(box.encrypt(payload, key));
+    abcd::jsonBoxCompressionSet(0);
+    CHECK(box.encode().size() < payload.size());
+
+    abcd::DataChunk data;
+    CHECK(box.decrypt(data, key));
+    CHECK(abcd::toString(data) == payload);
+}
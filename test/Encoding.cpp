@@ -151,3 +151,30 @@ TEST_CASE("Bad base64 strings", "[crypto][base64]")
     REQUIRE_FALSE(abcd::base64Decode(result, "AAAA===="));
     REQUIRE_FALSE(abcd::base64Decode(result, "A==="));
 }
+
+TEST_CASE("Long base16 and base64 round trips", "[crypto][base16][base64]")
+{
+    // Cover the vector loops, their tails, and every byte value:
+    for (size_t size = 0; size < 100; ++size)
+    {
+        abcd::DataChunk data(size);
+        for (size_t i = 0; i < size; ++i)
+            data[i] = 37 * i + size;
+
+        abcd::DataChunk result;
+        const auto hex = abcd::base16Encode(data);
+        REQUIRE(hex.size() == 2 * size);
+        REQUIRE(abcd::base16Decode(result, hex));
+        REQUIRE(result == data);
+
+        const auto base64 = abcd::base64Encode(data);
+        REQUIRE(base64.size() == 4 * ((size + 2) / 3));
+        REQUIRE(abcd::base64Decode(result, base64));
+        REQUIRE(result == data);
+    }
+
+    abcd::DataChunk result;
+    REQUIRE(abcd::base16Decode(result, "00ff7F80"));
+    REQUIRE(abcd::base16Encode(result) == "00ff7f80");
+    REQUIRE_FALSE(abcd::base16Decode(result, "0g"));
+}
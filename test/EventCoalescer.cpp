@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/EventCoalescer.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Event coalescing", "[bitcoin][watcher]")
+{
+    abcd::EventCoalescer coalescer(std::chrono::milliseconds(100));
+    const auto start = std::chrono::steady_clock::now();
+    const auto later = start + std::chrono::milliseconds(50);
+    const auto done = start + std::chrono::milliseconds(150);
+
+    size_t calls = 0;
+    abcd::EventCoalescer::TxidSet txids;
+    auto deliver = [&](tABC_AsyncEventType type,
+                       const abcd::EventCoalescer::TxidSet &set)
+    {
+        ++calls;
+        txids = set;
+    };
+
+    SECTION("first event goes out immediately")
+    {
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "a",
+                       deliver, start);
+        REQUIRE(1 == calls);
+        REQUIRE(1 == txids.size());
+        REQUIRE(0 == coalescer.flush(later).count());
+    }
+
+    SECTION("bursts are merged")
+    {
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "a",
+                       deliver, start);
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "b",
+                       deliver, later);
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "c",
+                       deliver, later);
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "b",
+                       deliver, later);
+        REQUIRE(1 == calls);
+        REQUIRE(51 == coalescer.flush(later).count());
+
+        REQUIRE(0 == coalescer.flush(done).count());
+        REQUIRE(2 == calls);
+        REQUIRE((abcd::EventCoalescer::TxidSet{"b", "c"} == txids));
+    }
+
+    SECTION("wallets are independent")
+    {
+        coalescer.post("w1", ABC_AsyncEventType_BlockHeightChange, "",
+                       deliver, start);
+        coalescer.post("w2", ABC_AsyncEventType_BlockHeightChange, "",
+                       deliver, later);
+        REQUIRE(2 == calls);
+        REQUIRE(txids.empty());
+    }
+
+    SECTION("dropped wallets get nothing")
+    {
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "a",
+                       deliver, start);
+        coalescer.post("w", ABC_AsyncEventType_BalanceUpdate, "b",
+                       deliver, later);
+        coalescer.drop("w");
+        coalescer.flush(done);
+        REQUIRE(1 == calls);
+    }
+}
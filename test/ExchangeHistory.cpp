@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/exchange/ExchangeHistory.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Exchange rate history", "[exchange]")
+{
+    abcd::ExchangeHistory history("");
+    const auto usd = abcd::Currency::USD;
+    history.insert(usd, 7200, 400);
+    history.insert(usd, 3600 * 5, 500);
+    history.insert(usd, 3600 * 5 + 60, 510);
+
+    std::vector<double> rates;
+    history.rates(rates, {0, 7300, 3600 * 4, 3600 * 9}, usd);
+    REQUIRE(4 == rates.size());
+    REQUIRE(400 == rates[0]);
+    REQUIRE(400 == rates[1]);
+    REQUIRE(400 == rates[2]);
+    REQUIRE(510 == rates[3]);
+
+    history.rates(rates, {7200}, abcd::Currency::EUR);
+    REQUIRE(0 == rates[0]);
+}
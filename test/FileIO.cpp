@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/FileIO.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("File journal", "[util][file]")
+{
+    const std::string dir = "/journal-test/sync";
+    std::vector<std::string> paths;
+
+    SECTION("starts without history")
+    {
+        abcd::fileJournalNote(dir + "/a.json");
+        REQUIRE(!abcd::fileJournalTake(paths, dir));
+        REQUIRE(abcd::fileJournalTake(paths, dir));
+        REQUIRE(paths.empty());
+    }
+
+    SECTION("collects relative paths once")
+    {
+        abcd::fileJournalTake(paths, dir);
+        abcd::fileJournalNote(dir + "/Transactions/b.json");
+        abcd::fileJournalNote(dir + "/a.json");
+        abcd::fileJournalNote(dir + "/a.json");
+        abcd::fileJournalNote("/journal-test/other.json");
+
+        time_t lastWrite = 0;
+        REQUIRE(abcd::fileJournalPending(lastWrite, dir));
+        REQUIRE(0 < lastWrite);
+
+        REQUIRE(abcd::fileJournalTake(paths, dir));
+        REQUIRE(!abcd::fileJournalPending(lastWrite, dir));
+        REQUIRE(2 == paths.size());
+        REQUIRE("Transactions/b.json" == paths[0]);
+        REQUIRE("a.json" == paths[1]);
+        REQUIRE(abcd::fileJournalTake(paths, dir));
+        REQUIRE(paths.empty());
+    }
+
+    SECTION("forgets directories that change wholesale")
+    {
+        abcd::fileJournalTake(paths, dir);
+        abcd::fileJournalNote(dir);
+        REQUIRE(!abcd::fileJournalTake(paths, dir));
+
+        abcd::fileJournalNote("/journal-test");
+        REQUIRE(!abcd::fileJournalTake(paths, dir));
+
+        abcd::fileJournalReset(dir);
+        REQUIRE(!abcd::fileJournalTake(paths, dir));
+    }
+
+    abcd::fileJournalReset(dir);
+}
+
+TEST_CASE("Checksummed files", "[util][file]")
+{
+    TempDir dir;
+    const std::string path = dir.path("cache.json");
+    const std::string text = "{\"height\": 1}";
+    abcd::DataChunk data;
+
+    SECTION("round-trips")
+    {
+        REQUIRE(abcd::fileSaveChecked(abcd::DataSlice(text), path));
+        REQUIRE(abcd::fileSyncDirs());
+        REQUIRE(abcd::fileLoadChecked(data, path));
+        REQUIRE(text == abcd::toString(data));
+    }
+
+    SECTION("accepts files without a trailer")
+    {
+        REQUIRE(abcd::fileSave(abcd::DataSlice(text), path));
+        REQUIRE(abcd::fileLoadChecked(data, path));
+        REQUIRE(text == abcd::toString(data));
+    }
+
+    SECTION("rejects damaged files")
+    {
+        REQUIRE(abcd::fileSaveChecked(abcd::DataSlice(text), path));
+        REQUIRE(abcd::fileLoad(data, path));
+        data[2] ^= 1;
+        REQUIRE(abcd::fileSave(data, path));
+        REQUIRE(!abcd::fileLoadChecked(data, path));
+    }
+}
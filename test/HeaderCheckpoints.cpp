@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/cache/HeaderCheckpoints.hpp"
+#include "../abcd/util/FileIO.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("Header checkpoints", "[bitcoin][cache]")
+{
+    TempDir dir;
+    const std::string path = dir.path("checkpoints");
+
+    const std::vector<uint32_t> times{1000, 2000, 2600};
+    REQUIRE(abcd::HeaderCheckpoints::write(path, 100, 10, times));
+
+    abcd::HeaderCheckpoints checkpoints;
+    REQUIRE(checkpoints.open(path));
+
+    SECTION("exact")
+    {
+        time_t out;
+        REQUIRE(checkpoints.time(out, 100));
+        REQUIRE(1000 == out);
+        REQUIRE(checkpoints.time(out, 120));
+        REQUIRE(2600 == out);
+    }
+
+    SECTION("interpolated")
+    {
+        time_t out;
+        REQUIRE(checkpoints.time(out, 105));
+        REQUIRE(1500 == out);
+        REQUIRE(checkpoints.time(out, 115));
+        REQUIRE(2300 == out);
+    }
+
+    SECTION("out of range")
+    {
+        time_t out;
+        REQUIRE(!checkpoints.covers(99));
+        REQUIRE(!checkpoints.time(out, 99));
+        REQUIRE(!checkpoints.covers(121));
+        REQUIRE(!checkpoints.time(out, 121));
+    }
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/General.hpp"
+#include "../abcd/util/FileIO.hpp"
+#include "../src/ABC.h"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+#include <utime.h>
+
+TEST_CASE("Initialize with stale general info", "[abc]")
+{
+    TempDir dir;
+
+    // Old enough that startup kicks off a background refresh:
+    const std::string path = dir.path("Servers.json");
+    const std::string text =
+        "{\"obeliskServers\": [\"stratum://stale.example:50001\"]}";
+    REQUIRE(abcd::fileSave(abcd::DataSlice(text), path));
+    struct utimbuf times = {};
+    times.actime = times.modtime = time(nullptr) - 7 * 24 * 60 * 60;
+    REQUIRE(!utime(path.c_str(), &times));
+
+    const unsigned char seed[] = {1, 2, 3, 4};
+    tABC_Error error;
+    REQUIRE(ABC_CC_Ok == ABC_Initialize(dir.path("").c_str(), nullptr,
+                                        "test", "account:repo:test", "hidden",
+                                        seed, sizeof(seed), &error));
+
+    // The stale copy serves callers while the refresh runs:
+    const auto servers = abcd::generalBitcoinServers();
+    REQUIRE(1 == servers.size());
+    REQUIRE("stratum://stale.example:50001" == servers[0]);
+
+    ABC_Terminate();
+}
@@ -7,6 +7,8 @@
 
 #include "../abcd/json/JsonArray.hpp"
 #include "../abcd/json/JsonObject.hpp"
+#include "../abcd/json/JsonReader.hpp"
+#include "../abcd/json/JsonSchema.hpp"
 #include "../minilibs/catch/catch.hpp"
 
 TEST_CASE("JsonPtr lifetime", "[util][json]")
@@ -152,4 +154,158 @@ TEST_CASE("JsonPtr encoding", "[util][json]")
         abcd::JsonPtr json;
         REQUIRE("null" == json.encode());
     }
+
+    SECTION("into a buffer")
+    {
+        abcd::JsonPtr json;
+        REQUIRE(json.decode("{\"b\": [1, 2], \"a\": \"text\"}"));
+
+        abcd::DataChunk buffer(3, 'x');
+        json.encode(buffer);
+        REQUIRE(json.encode() == abcd::toString(buffer));
+        json.encode(buffer, true);
+        REQUIRE(json.encode(true) == abcd::toString(buffer));
+    }
+}
+
+struct SchemaRow
+{
+    std::string name;
+    int64_t count = 0;
+    bool flag = false;
+    std::vector<std::string> tags;
+};
+
+static const auto schemaRow = abcd::jsonSchema(
+    abcd::jsonField("name", &SchemaRow::name, abcd::jsonRequired),
+    abcd::jsonField("count", &SchemaRow::count),
+    abcd::jsonField("flag", &SchemaRow::flag, abcd::jsonSkipEmpty),
+    abcd::jsonField("tags", &SchemaRow::tags));
+
+TEST_CASE("JsonSchema binding", "[util][json]")
+{
+    SECTION("decode")
+    {
+        abcd::JsonPtr json;
+        REQUIRE(json.decode("{\"count\": 3, \"extra\": 1, "
+                            "\"tags\": [\"a\", 2, \"b\"], \"name\": \"x\"}"));
+
+        SchemaRow row;
+        REQUIRE(schemaRow.decode(row, json.get()));
+        REQUIRE("x" == row.name);
+        REQUIRE(3 == row.count);
+        REQUIRE_FALSE(row.flag);
+        REQUIRE(2 == row.tags.size());
+        REQUIRE("b" == row.tags[1]);
+    }
+
+    SECTION("missing required field")
+    {
+        abcd::JsonPtr json;
+        REQUIRE(json.decode("{\"count\": 3}"));
+
+        SchemaRow row;
+        REQUIRE_FALSE(schemaRow.decode(row, json.get()));
+    }
+
+    SECTION("wrong type")
+    {
+        abcd::JsonPtr json;
+        REQUIRE(json.decode("{\"name\": \"x\", \"count\": \"3\"}"));
+
+        SchemaRow row;
+        REQUIRE(schemaRow.decode(row, json.get()));
+        REQUIRE(0 == row.count);
+    }
+
+    SECTION("encode")
+    {
+        SchemaRow row;
+        row.name = "x";
+        row.tags.push_back("a");
+
+        abcd::JsonPtr json;
+        REQUIRE(schemaRow.encode(json, row));
+        REQUIRE("{\"count\":0,\"name\":\"x\",\"tags\":[\"a\"]}" ==
+                json.encode(true));
+    }
+}
+
+TEST_CASE("JsonReader parsing", "[util][json]")
+{
+    SECTION("reply envelope")
+    {
+        std::string text = "{\"id\": 7, \"result\": [{\"tx_hash\": "
+                           "\"a\\u00e9\", \"height\": -1}], \"x\": null}";
+        abcd::JsonReader reader(text);
+        std::string key;
+        int64_t id = 0;
+        abcd::DataSlice result;
+
+        REQUIRE(reader.objectBegin());
+        REQUIRE(reader.objectKey(key));
+        REQUIRE(key == "id");
+        REQUIRE(reader.readInteger(id));
+        REQUIRE(7 == id);
+        REQUIRE(reader.objectKey(key));
+        REQUIRE(key == "result");
+        REQUIRE(reader.skip(&result));
+        REQUIRE(reader.objectKey(key));
+        REQUIRE(reader.skip());
+        REQUIRE_FALSE(reader.objectKey(key));
+        REQUIRE(reader.ok());
+
+        abcd::JsonReader payload(result);
+        std::string txid;
+        int64_t height = 0;
+        REQUIRE(payload.arrayBegin());
+        REQUIRE(payload.arrayItem());
+        REQUIRE(payload.objectBegin());
+        REQUIRE(payload.objectKey(key));
+        REQUIRE_FALSE(payload.readInteger(height));
+        REQUIRE(payload.readString(txid));
+        REQUIRE(txid == "a\xc3\xa9");
+        REQUIRE(payload.objectKey(key));
+        REQUIRE(payload.readInteger(height));
+        REQUIRE(-1 == height);
+        REQUIRE_FALSE(payload.objectKey(key));
+        REQUIRE_FALSE(payload.arrayItem());
+        REQUIRE(payload.ok());
+    }
+    SECTION("integer limits")
+    {
+        int64_t value = 0;
+        std::string text = "[9223372036854775807, -9223372036854775808]";
+        abcd::JsonReader big(text);
+        REQUIRE(big.arrayBegin());
+        REQUIRE(big.arrayItem());
+        REQUIRE(big.readInteger(value));
+        REQUIRE(INT64_MAX == value);
+        REQUIRE(big.arrayItem());
+        REQUIRE(big.readInteger(value));
+        REQUIRE(INT64_MIN == value);
+        REQUIRE_FALSE(big.arrayItem());
+        REQUIRE(big.ok());
+
+        text = "9223372036854775808";
+        abcd::JsonReader overflow(text);
+        REQUIRE_FALSE(overflow.readInteger(value));
+        REQUIRE_FALSE(overflow.ok());
+
+        text = "-";
+        abcd::JsonReader sign(text);
+        REQUIRE_FALSE(sign.readInteger(value));
+        REQUIRE_FALSE(sign.ok());
+    }
+    SECTION("malformed")
+    {
+        std::string text = "[1, \"open";
+        abcd::JsonReader reader(text);
+        REQUIRE(reader.arrayBegin());
+        REQUIRE(reader.arrayItem());
+        REQUIRE(reader.skip());
+        REQUIRE(reader.arrayItem());
+        REQUIRE_FALSE(reader.skip());
+        REQUIRE_FALSE(reader.ok());
+    }
 }
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/LineBuffer.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <string.h>
+
+static void
+write(abcd::LineBuffer &buffer, const std::string &data)
+{
+    memcpy(buffer.prepare(data.size()), data.data(), data.size());
+    buffer.commit(data.size());
+}
+
+TEST_CASE("Line buffer", "[util][network]")
+{
+    abcd::LineBuffer buffer(8);
+    abcd::DataSlice line;
+
+    SECTION("split lines")
+    {
+        write(buffer, "{\"a\":");
+        REQUIRE(!buffer.line(line));
+        write(buffer, "1}\n{}\n{");
+        REQUIRE(buffer.line(line));
+        REQUIRE("{\"a\":1}\n" == abcd::toString(line));
+        REQUIRE(buffer.line(line));
+        REQUIRE("{}\n" == abcd::toString(line));
+        REQUIRE(!buffer.line(line));
+        REQUIRE(1 == buffer.size());
+    }
+
+    SECTION("wrap around")
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            write(buffer, "abc\nde");
+            REQUIRE(buffer.line(line));
+            write(buffer, "f\n");
+            REQUIRE(buffer.line(line));
+            REQUIRE("def\n" == abcd::toString(line));
+            REQUIRE(0 == buffer.size());
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/login/LoginKeyCache.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Login key cache", "[login][cache]")
+{
+    const abcd::DataChunk dataKey{1, 2, 3, 4};
+    abcd::LoginKeys keys;
+    keys.dataKey.assign(dataKey.begin(), dataKey.end());
+    keys.rootKey = abcd::SecureChunk{5, 6, 7};
+    keys.loginPackageTime = 100;
+    abcd::loginKeysSave("alice", keys);
+
+    SECTION("hit")
+    {
+        abcd::LoginKeys out;
+        REQUIRE(abcd::loginKeysFind(out, "alice", dataKey, 100));
+        REQUIRE(keys.rootKey == out.rootKey);
+    }
+
+    SECTION("wrong dataKey or stale package")
+    {
+        abcd::LoginKeys out;
+        const abcd::DataChunk wrong{1, 2, 3, 5};
+        REQUIRE(!abcd::loginKeysFind(out, "alice", wrong, 100));
+        REQUIRE(!abcd::loginKeysFind(out, "alice", dataKey, 101));
+        REQUIRE(!abcd::loginKeysFind(out, "bob", dataKey, 100));
+    }
+
+    SECTION("clear")
+    {
+        abcd::LoginKeys out;
+        abcd::loginKeysClear("alice");
+        REQUIRE(!abcd::loginKeysFind(out, "alice", dataKey, 100));
+    }
+
+    abcd::loginKeysClear();
+}
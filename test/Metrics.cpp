@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/json/JsonArray.hpp"
+#include "../abcd/json/JsonObject.hpp"
+#include "../abcd/util/Metrics.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <thread>
+
+TEST_CASE("Metrics registry", "[util][metrics]")
+{
+    SECTION("counters")
+    {
+        auto &counter = abcd::metricCounter("test.counter");
+        REQUIRE(&counter == &abcd::metricCounter("test.counter"));
+        counter.add(5);
+        counter.add(-2);
+        REQUIRE(3 == counter.value());
+    }
+
+    SECTION("histograms")
+    {
+        auto &histogram = abcd::metricHistogram("test.histogram");
+        histogram.record(0);
+        histogram.record(1);
+        histogram.record(5);
+
+        abcd::JsonPtr json;
+        REQUIRE(histogram.save(json));
+        abcd::JsonObject object(json);
+        REQUIRE(3 == object.getInteger("count", 0));
+        REQUIRE(6 == object.getInteger("sum", 0));
+
+        abcd::JsonArray buckets(object.getValue("buckets"));
+        REQUIRE(4 == buckets.size());
+        REQUIRE(1 == json_integer_value(buckets[0].get()));
+        REQUIRE(1 == json_integer_value(buckets[1].get()));
+        REQUIRE(0 == json_integer_value(buckets[2].get()));
+        REQUIRE(1 == json_integer_value(buckets[3].get()));
+    }
+
+    SECTION("slow calls")
+    {
+        auto &histogram = abcd::metricHistogram("test.call_us");
+        std::mutex mutex;
+        auto &waitTime = abcd::metricHistogram("test.wait_us");
+        abcd::metricSlowThresholdSet(std::chrono::microseconds(1));
+        {
+            abcd::MetricCall call("testCall", histogram);
+            call.walletSet("wallet");
+
+            // Make the call wait on a lock someone else holds:
+            mutex.lock();
+            std::thread holder([&mutex]()
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                mutex.unlock();
+            });
+            {
+                abcd::MetricLockGuard lock(mutex, waitTime);
+            }
+            holder.join();
+        }
+        abcd::metricSlowThresholdSet(std::chrono::milliseconds(250));
+
+        abcd::JsonPtr json;
+        REQUIRE(abcd::metricsJson(json));
+        abcd::JsonObject root(json);
+        abcd::JsonArray slowCalls(root.getValue("slowCalls"));
+        REQUIRE(slowCalls.size());
+        abcd::JsonObject last(slowCalls[slowCalls.size() - 1]);
+        REQUIRE(std::string("testCall") == last.getString("function", ""));
+        REQUIRE(std::string("wallet") == last.getString("wallet", ""));
+        REQUIRE(last.getInteger("lock_us", 0) <= last.getInteger("total_us", 0));
+        REQUIRE(5000 <= last.getInteger("lock_us", 0));
+        abcd::JsonObject histograms(root.getValue("histograms"));
+        REQUIRE(histograms.getValue("test.call_us"));
+    }
+}
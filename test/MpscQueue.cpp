@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/MpscQueue.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Lock-free queue", "[util][thread]")
+{
+    SECTION("keeps order")
+    {
+        abcd::MpscQueue<std::unique_ptr<int>> queue;
+        std::unique_ptr<int> out;
+        REQUIRE(!queue.pop(out));
+
+        for (int i = 0; i < 3; ++i)
+            queue.push(std::unique_ptr<int>(new int(i)));
+        for (int i = 0; i < 3; ++i)
+        {
+            REQUIRE(queue.pop(out));
+            REQUIRE(i == *out);
+        }
+        REQUIRE(!queue.pop(out));
+
+        // Leftovers get cleaned up with the queue:
+        queue.push(std::unique_ptr<int>(new int(3)));
+    }
+
+    SECTION("many producers")
+    {
+        abcd::MpscQueue<int> queue;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t)
+            threads.emplace_back([&queue, t]()
+        {
+            for (int i = 0; i < 1000; ++i)
+                queue.push(t * 1000 + i);
+        });
+        for (auto &thread: threads)
+            thread.join();
+
+        // Each producer's items arrive in the order it pushed them:
+        int next[4] = {0, 0, 0, 0};
+        int value;
+        size_t count = 0;
+        while (queue.pop(value))
+        {
+            const int t = value / 1000;
+            REQUIRE(next[t] == value % 1000);
+            ++next[t];
+            ++count;
+        }
+        REQUIRE(4000 == count);
+    }
+}
@@ -42,3 +42,19 @@ TEST_CASE("Leading zeros in OTP output", "[crypto][otp]" )
     REQUIRE(key.hotp(2) == "073348");
     REQUIRE(key.hotp(9) == "003773");
 }
+
+TEST_CASE("OTP code ranges", "[crypto][otp]" )
+{
+    std::string secretData = "12345678901234567890";
+    abcd::OtpKey key(secretData);
+
+    const auto codes = key.hotpRange(3, 3);
+    REQUIRE(codes.size() == 3);
+    REQUIRE(codes[0] == "969429");
+    REQUIRE(codes[1] == "338314");
+    REQUIRE(codes[2] == "254676");
+
+    const auto window = key.totpWindow(1, 1);
+    REQUIRE(window.size() == 3);
+    REQUIRE(window[0] != window[1]);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/cache/Outbox.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Broadcast outbox", "[bitcoin][cache]")
+{
+    const abcd::DataChunk tx{1, 2, 3};
+    abcd::Outbox outbox;
+    time_t sleep;
+
+    SECTION("backs off between tries")
+    {
+        outbox.add("a", tx, 1000);
+        auto due = outbox.due(sleep, 1000);
+        REQUIRE(1 == due.size());
+        REQUIRE("a" == due.front().txid);
+        REQUIRE(tx == due.front().tx);
+        REQUIRE(5 == sleep);
+
+        REQUIRE(outbox.due(sleep, 1004).empty());
+        REQUIRE(1 == outbox.due(sleep, 1005).size());
+        REQUIRE(10 == sleep);
+
+        // A new connection makes it due right away:
+        outbox.wake();
+        REQUIRE(1 == outbox.due(sleep, 1006).size());
+        REQUIRE(5 == sleep);
+    }
+
+    SECTION("forgets sent and stale transactions")
+    {
+        outbox.add("a", tx, 1000);
+        outbox.add("b", tx, 1000);
+        REQUIRE(outbox.remove("a"));
+        REQUIRE(!outbox.remove("a"));
+        REQUIRE(1 == outbox.size());
+
+        REQUIRE(outbox.due(sleep, 1000 + 4 * 24 * 60 * 60).empty());
+        REQUIRE(0 == sleep);
+        REQUIRE(0 == outbox.size());
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/Parallel.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <atomic>
+#include <vector>
+
+TEST_CASE("Parallel for", "[util][parallel]")
+{
+    SECTION("covers every index once")
+    {
+        for (size_t size: {0, 1, 15, 16, 17, 1000})
+        {
+            std::vector<std::atomic<int>> hits(size);
+            for (auto &hit: hits)
+                hit = 0;
+            abcd::parallelFor(size, [&hits](size_t start, size_t end)
+            {
+                for (size_t i = start; i < end; ++i)
+                    ++hits[i];
+            });
+
+            for (const auto &hit: hits)
+                REQUIRE(1 == hit);
+        }
+    }
+
+    SECTION("shares threads with nested calls")
+    {
+        const size_t size = 64;
+        std::vector<std::atomic<int>> hits(size * size);
+        for (auto &hit: hits)
+            hit = 0;
+        abcd::parallelFor(size, [&hits, size](size_t start, size_t end)
+        {
+            for (size_t i = start; i < end; ++i)
+            {
+                auto *row = &hits[i * size];
+                abcd::parallelFor(size, [row](size_t start, size_t end)
+                {
+                    for (size_t j = start; j < end; ++j)
+                        ++row[j];
+                });
+            }
+        });
+
+        for (const auto &hit: hits)
+            REQUIRE(1 == hit);
+    }
+}
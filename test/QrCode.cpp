@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/QrCode.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("QR bitmap packing", "[qr]")
+{
+    abcd::QrMatrix qr;
+    qr.width = 3;
+    qr.modules = abcd::DataChunk
+    {
+        1, 0, 1,
+        0, 1, 0,
+        1, 1, 1
+    };
+
+    SECTION("one pixel per module")
+    {
+        size_t stride;
+        auto bitmap = abcd::qrBitmap(qr, 1, stride);
+        REQUIRE(1 == stride);
+        REQUIRE((abcd::DataChunk{0xa0, 0x40, 0xe0}) == bitmap);
+    }
+
+    SECTION("scaled rows cross byte boundaries")
+    {
+        size_t stride;
+        auto bitmap = abcd::qrBitmap(qr, 3, stride);
+        REQUIRE(2 == stride);
+        REQUIRE((abcd::DataChunk
+        {
+            0xe3, 0x80, 0xe3, 0x80, 0xe3, 0x80,
+            0x1c, 0x00, 0x1c, 0x00, 0x1c, 0x00,
+            0xff, 0x80, 0xff, 0x80, 0xff, 0x80
+        }) == bitmap);
+    }
+}
+
+TEST_CASE("QR encoding cache", "[qr]")
+{
+    std::shared_ptr<const abcd::QrMatrix> a, b, c;
+    REQUIRE(abcd::qrEncode(a, "bitcoin:1BitcoinEaterAddressDontSendf59kuE"));
+    REQUIRE(abcd::qrEncode(b, "bitcoin:1BitcoinEaterAddressDontSendf59kuE"));
+    REQUIRE(a == b);
+
+    REQUIRE(abcd::qrEncode(c, "bitcoin:1BitcoinEaterAddressDontSendf59kuE",
+                           abcd::QrLevel::high));
+    REQUIRE(a != c);
+    const size_t size = a->width * a->width;
+    REQUIRE(size == a->modules.size());
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/AccountPaths.hpp"
+#include "../abcd/RootPaths.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("Account index", "[paths]")
+{
+    TempDir dir;
+
+    // Each instance stands in for a separate process:
+    abcd::RootPaths ours(dir.path(""), "");
+    abcd::RootPaths theirs(dir.path(""), "");
+    abcd::AccountPaths paths;
+
+    SECTION("sees accounts added within the same second")
+    {
+        REQUIRE(ours.accountDirNew(paths, "alice"));
+        REQUIRE(1 == theirs.accountList().size());
+
+        REQUIRE(ours.accountDirNew(paths, "bob"));
+        REQUIRE(theirs.accountDir(paths, "bob"));
+        REQUIRE(2 == theirs.accountList().size());
+    }
+
+    SECTION("forgets deleted accounts")
+    {
+        REQUIRE(ours.accountDirNew(paths, "alice"));
+        REQUIRE(theirs.accountDir(paths, "alice"));
+
+        REQUIRE(ours.accountDirDelete("alice"));
+        REQUIRE(!theirs.accountDir(paths, "alice"));
+        REQUIRE(theirs.accountList().empty());
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/SearchIndex.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Search index", "[util][search]")
+{
+    abcd::SearchIndex index;
+    index.insert("a", {"Coffee Shop", "Food"});
+    index.insert("b", {"Rent", "Housing"});
+    index.insert("c", {"Coffee beans", "Groceries"});
+
+    SECTION("substrings")
+    {
+        REQUIRE(2 == index.search("coffee").size());
+        REQUIRE(1 == index.search("OFFEE S").size());
+        REQUIRE(1 == index.search("ous").count("b"));
+        REQUIRE(index.search("shop food").empty());
+        REQUIRE(index.search("").empty());
+    }
+
+    SECTION("short queries")
+    {
+        REQUIRE(3 == index.search("o").size());
+        REQUIRE(1 == index.search("re").count("b"));
+    }
+
+    SECTION("updates")
+    {
+        index.insert("a", {"Tea House"});
+        REQUIRE(1 == index.search("coffee").size());
+        REQUIRE(2 == index.search("hous").size());
+
+        index.erase("b");
+        REQUIRE(1 == index.search("hous").count("a"));
+        REQUIRE(index.search("rent").empty());
+    }
+}
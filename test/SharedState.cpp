@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/SharedState.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("Shared state", "[util]")
+{
+    TempDir dir;
+    const std::string path = dir.path("Shared.bin");
+
+    // Two mappings of one file stand in for two processes:
+    abcd::SharedState a;
+    abcd::SharedState b;
+    REQUIRE(a.open(path));
+    REQUIRE(b.open(path));
+
+    SECTION("counters")
+    {
+        const auto slot = abcd::SharedSlot::exchangeRates;
+        REQUIRE(0 == b.get(slot));
+        REQUIRE(1 == a.bump(slot));
+        REQUIRE(1 == b.get(slot));
+        REQUIRE(2 == b.bump(slot));
+        REQUIRE(2 == a.get(slot));
+    }
+
+    SECTION("raise")
+    {
+        const auto slot = abcd::SharedSlot::blockHeight;
+        REQUIRE(400000 == a.raise(slot, 400000));
+        REQUIRE(400000 == b.raise(slot, 399999));
+        REQUIRE(400000 == b.get(slot));
+        REQUIRE(400001 == b.raise(slot, 400001));
+        REQUIRE(400001 == a.get(slot));
+    }
+
+    SECTION("writers within a process")
+    {
+        const auto slot = abcd::SharedSlot::exchangeRates;
+        auto first = a.writerTry(slot);
+        REQUIRE(first);
+        auto second = a.writerTry(slot);
+        REQUIRE(second);
+        first.reset();
+        second.reset();
+        REQUIRE(a.writerTry(slot));
+    }
+
+    SECTION("unopened")
+    {
+        abcd::SharedState local;
+        const auto slot = abcd::SharedSlot::serverScores;
+        REQUIRE(1 == local.bump(slot));
+        REQUIRE(0 == a.get(slot));
+        REQUIRE(local.writerTry(slot));
+    }
+}
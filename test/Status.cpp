@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/Status.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+namespace abcd {
+
+static Status
+statusCheck(int i)
+{
+    if (i < 0)
+        return ABC_ERROR(ABC_CC_Error, "negative");
+    return Status();
+}
+
+static Status
+statusNested(int i)
+{
+    ABC_CHECK(statusCheck(i));
+    return Status();
+}
+
+} // namespace abcd
+
+TEST_CASE("Status success and failure", "[util][status]")
+{
+    SECTION("success")
+    {
+        abcd::Status s;
+        REQUIRE(s);
+        REQUIRE(ABC_CC_Ok == s.value());
+        REQUIRE(s.message().empty());
+        REQUIRE(s.backtrace().empty());
+        REQUIRE(sizeof(void *) == sizeof(abcd::Status));
+    }
+
+    SECTION("ok code is success")
+    {
+        REQUIRE(abcd::Status(ABC_CC_Ok, "fine",
+                             abcd::ErrorLocation{"f", "file", 1}));
+    }
+
+    SECTION("failure")
+    {
+        const auto s = abcd::statusNested(-1);
+        REQUIRE(!s);
+        REQUIRE(ABC_CC_Error == s.value());
+        REQUIRE("negative" == s.message());
+        REQUIRE(2 == s.backtrace().size());
+    }
+
+    SECTION("copies are independent")
+    {
+        auto a = abcd::statusCheck(-1);
+        auto b = a;
+        b.at(abcd::ErrorLocation{"f", "file", 1});
+        REQUIRE(1 == a.backtrace().size());
+        REQUIRE(2 == b.backtrace().size());
+
+        a = abcd::Status();
+        REQUIRE(a);
+        REQUIRE(!b);
+    }
+}
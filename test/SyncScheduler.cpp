@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/SyncScheduler.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Sync scheduler", "[util][sync]")
+{
+    abcd::SyncScheduler scheduler;
+    size_t syncs = 0;
+
+    auto repos = [&syncs]()
+    {
+        auto sync = [&syncs](bool &dirty)
+        {
+            ++syncs;
+            dirty = true;
+            return abcd::Status();
+        };
+        return std::vector<abcd::SyncScheduler::Repo>
+        {
+            {"/scheduler-test/active/", "active", sync, false},
+            {"/scheduler-test/dormant/", "dormant", sync, true}
+        };
+    };
+
+    SECTION("syncs new repos right away, except dormant ones")
+    {
+        std::vector<std::string> done;
+        scheduler.run(repos, [&](const abcd::SyncScheduler::Repo &repo,
+                                 const abcd::Status &status, bool dirty)
+        {
+            REQUIRE(status);
+            REQUIRE(dirty);
+            done.push_back(repo.id);
+            scheduler.stop();
+        });
+
+        REQUIRE(1 == syncs);
+        REQUIRE(1 == done.size());
+        REQUIRE("active" == done[0]);
+    }
+
+    SECTION("returns right away if stopped early")
+    {
+        scheduler.stop();
+        scheduler.run(repos, [](const abcd::SyncScheduler::Repo &,
+                                const abcd::Status &, bool) {});
+        REQUIRE(0 == syncs);
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/TaskPool.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+TEST_CASE("Task pool", "[util][thread]")
+{
+    SECTION("runs every task")
+    {
+        std::atomic<int> total(0);
+        for (int i = 1; i <= 10; ++i)
+            abcd::taskPoolAdd([&total, i](abcd::TaskId,
+                                          const std::atomic<bool> &)
+        {
+            total += i;
+        });
+        abcd::taskPoolStop();
+        REQUIRE(55 == total);
+    }
+
+    SECTION("keeps a thread for interactive tasks")
+    {
+        // Tie up every thread background work can get:
+        std::atomic<bool> release(false);
+        for (int i = 0; i < 32; ++i)
+            abcd::taskPoolRun([&release]()
+        {
+            while (!release)
+                std::this_thread::yield();
+        });
+
+        std::atomic<bool> ran(false);
+        abcd::taskPoolRun([&ran]()
+        {
+            ran = true;
+        }, abcd::TaskPriority::interactive);
+        while (!ran)
+            std::this_thread::yield();
+        REQUIRE(ran);
+
+        release = true;
+        abcd::taskPoolStop();
+    }
+
+    SECTION("cancels running tasks")
+    {
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool started = false;
+        bool sawCancel = false;
+        const auto id = abcd::taskPoolAdd(
+                            [&](abcd::TaskId, const std::atomic<bool> &cancelled)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                started = true;
+            }
+            ready.notify_one();
+            while (!cancelled)
+                std::this_thread::yield();
+            sawCancel = true;
+        });
+        REQUIRE(id);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return started; });
+        }
+        REQUIRE(abcd::taskPoolCancel(id));
+        abcd::taskPoolStop();
+        REQUIRE(sawCancel);
+        REQUIRE(!abcd::taskPoolCancel(id));
+    }
+}
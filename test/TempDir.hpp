@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+/**
+ * @file
+ * A scratch directory for tests that touch the filesystem.
+ */
+
+#ifndef TEST_TEMP_DIR_HPP
+#define TEST_TEMP_DIR_HPP
+
+#include "../abcd/util/FileIO.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <stdlib.h>
+#include <string>
+
+/**
+ * Creates a fresh directory under /tmp,
+ * and deletes it along with its contents when it goes out of scope,
+ * even if a check fails partway through.
+ */
+class TempDir
+{
+public:
+    ~TempDir()
+    {
+        if (!path_.empty())
+            abcd::fileDelete(path_).log();
+    }
+
+    TempDir()
+    {
+        char dirTemplate[] = "/tmp/abc-test-XXXXXX";
+        REQUIRE(mkdtemp(dirTemplate));
+        path_ = dirTemplate;
+    }
+
+    /**
+     * Returns the path to a file inside the directory.
+     */
+    std::string
+    path(const std::string &name) const
+    {
+        return path_ + "/" + name;
+    }
+
+    TempDir(const TempDir &copy) = delete;
+    TempDir &operator=(const TempDir &copy) = delete;
+
+private:
+    std::string path_;
+};
+
+#endif
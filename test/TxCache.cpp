@@ -183,7 +183,7 @@ hasTxid(const bc::output_info_list &utxos, bc::hash_digest txid, uint32_t index)
 
 TEST_CASE("Transaction database", "[bitcoin][database]")
 {
-    abcd::BlockCache blockCache("");
+    abcd::BlockCache blockCache("", "");
     abcd::TxCache txCache(blockCache);
     abcd::TxCacheTest test(txCache);
     const auto rawUtxos = txCache.utxos(test.ourAddresses);
@@ -208,4 +208,142 @@ TEST_CASE("Transaction database", "[bitcoin][database]")
         REQUIRE(hasTxid(utxos, test.changeId, 1));
         REQUIRE(!hasTxid(utxos, test.badSpendId, 0));
     }
+
+    SECTION("dropped spend")
+    {
+        REQUIRE(txCache.drop(bc::encode_hash(test.badSpendId),
+                             time(nullptr) + 2*60*60));
+        const auto utxos =
+            filterOutputs(txCache.utxos(test.ourAddresses), false);
+        REQUIRE(4 == utxos.size());
+        REQUIRE(hasTxid(utxos, test.changeId, 0));
+        REQUIRE(hasTxid(utxos, test.changeId, 1));
+        REQUIRE(!hasTxid(utxos, test.doubleSpendId, 0));
+    }
+
+    SECTION("batched drops")
+    {
+        const auto badSpendId = bc::encode_hash(test.badSpendId);
+        const auto dropped = txCache.dropMany(
+                                 abcd::TxidSet{badSpendId, bc::encode_hash(test.buriedId)},
+                                 time(nullptr) + 2*60*60);
+        REQUIRE(abcd::TxidSet{badSpendId} == dropped);
+        const auto utxos =
+            filterOutputs(txCache.utxos(test.ourAddresses), false);
+        REQUIRE(4 == utxos.size());
+        REQUIRE(!hasTxid(utxos, test.doubleSpendId, 0));
+    }
+
+    SECTION("changes since")
+    {
+        const auto revision = txCache.revision();
+        REQUIRE(txCache.changedSince(revision).empty());
+
+        const auto changeId = bc::encode_hash(test.changeId);
+        txCache.confirmed(changeId, 100);
+        const auto changed = txCache.changedSince(revision);
+        REQUIRE(changed.count(changeId));
+        REQUIRE(!changed.count(bc::encode_hash(test.incomingId)));
+        REQUIRE(revision < txCache.revision());
+    }
+
+    SECTION("confirmation changes")
+    {
+        const auto confirmedId = bc::encode_hash(test.confirmedId);
+        REQUIRE(txCache.confirmationsChanged(102, 103, 6).count(confirmedId));
+        REQUIRE(txCache.confirmationsChanged(110, 111, 6).empty());
+
+        // Starting from nothing lists the shallow ones:
+        const auto shallow = txCache.confirmationsChanged(0, 200, 6);
+        REQUIRE(shallow.count(bc::encode_hash(test.incomingId)));
+        REQUIRE(!shallow.count(confirmedId));
+    }
+
+    SECTION("snapshot round trip")
+    {
+        abcd::TxCache copy(blockCache);
+        REQUIRE(copy.loadSnapshot(txCache.snapshot()));
+        const auto utxos = filterOutputs(copy.utxos(test.ourAddresses), true);
+        REQUIRE(filterOutputs(rawUtxos, true).size() == utxos.size());
+        REQUIRE(hasTxid(utxos, test.confirmedId, 0));
+        REQUIRE(!copy.missing(bc::encode_hash(test.badSpendId)));
+
+        auto bad = txCache.snapshot();
+        bad.pop_back();
+        REQUIRE(!copy.loadSnapshot(bad));
+    }
+
+    SECTION("expiry queue")
+    {
+        const auto incomingId = bc::encode_hash(test.incomingId);
+        const time_t now = 1000000;
+        txCache.confirmed(incomingId, 0, now);
+        REQUIRE(txCache.expiredTake(now).empty());
+
+        // Each check waits for the transaction's age to double:
+        REQUIRE(abcd::TxidSet{incomingId} ==
+                txCache.expiredTake(now + 60*60));
+        REQUIRE(txCache.expiredTake(now + 60*60).empty());
+        REQUIRE(txCache.expiredTake(now + 2*60*60).count(incomingId));
+
+        txCache.confirmed(incomingId, 100, now);
+        REQUIRE(txCache.expiredTake(now + 100*60*60).empty());
+    }
+
+    SECTION("pruning")
+    {
+        const auto buriedId = bc::encode_hash(test.buriedId);
+        bc::transaction_type buried;
+        REQUIRE(txCache.get(buried, buriedId));
+        abcd::TxInfo before;
+        REQUIRE(txCache.info(before, buriedId));
+
+        // Both of buried's outputs need deep spends first:
+        txCache.balanceAddressesSet(test.ourAddresses);
+        blockCache.heightSet(200);
+        REQUIRE(0 == txCache.prune(50));
+        txCache.confirmed(bc::encode_hash(test.changeId), 100);
+        REQUIRE(1 == txCache.prune(50));
+
+        bc::transaction_type tx;
+        REQUIRE(!txCache.get(tx, buriedId));
+        REQUIRE(txCache.refetchTxids().count(buriedId));
+        abcd::TxInfo after;
+        REQUIRE(txCache.info(after, buriedId));
+        REQUIRE(before.fee == after.fee);
+        REQUIRE(before.ios.size() == after.ios.size());
+        REQUIRE(!txCache.missing(buriedId));
+
+        // The summary survives a snapshot:
+        abcd::TxCache copy(blockCache);
+        REQUIRE(copy.loadSnapshot(txCache.snapshot()));
+        REQUIRE(!copy.get(tx, buriedId));
+        REQUIRE(copy.info(after, buriedId));
+
+        // Inserting the transaction again brings it back:
+        REQUIRE(!txCache.insert(buried));
+        REQUIRE(txCache.get(tx, buriedId));
+        REQUIRE(txCache.refetchTxids().empty());
+    }
+
+    SECTION("running balance")
+    {
+        txCache.balanceAddressesSet(test.ourAddresses);
+        int64_t total = 0;
+        for (const auto &utxo: filterOutputs(rawUtxos, false))
+            total += utxo.value;
+        int64_t spendable = 0;
+        for (const auto &utxo: filterOutputs(rawUtxos, true))
+            spendable += utxo.value;
+        REQUIRE(total == txCache.balance().total());
+        REQUIRE(spendable == txCache.balance().spendable);
+
+        // Dropping the double-spend frees up its inputs:
+        REQUIRE(txCache.drop(bc::encode_hash(test.badSpendId),
+                             time(nullptr) + 2*60*60));
+        int64_t after = 0;
+        for (const auto &utxo: txCache.utxos(test.ourAddresses))
+            after += utxo.value;
+        REQUIRE(after == txCache.balance().total());
+    }
 }
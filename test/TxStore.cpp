@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/bitcoin/cache/TxStore.hpp"
+#include "../minilibs/catch/catch.hpp"
+
+TEST_CASE("Shared transaction store", "[bitcoin][cache]")
+{
+    bc::hash_digest hash = bc::null_hash;
+    hash[0] = 1;
+
+    auto a = abcd::txStoreShare(hash, abcd::DataChunk{1, 2, 3});
+    auto b = abcd::txStoreShare(hash, abcd::DataChunk{4, 5, 6});
+    REQUIRE(a == b);
+    REQUIRE(abcd::DataChunk({1, 2, 3}) == *b);
+    REQUIRE(a == abcd::txStoreFind(hash));
+
+    // The store lets go once the holders do:
+    a.reset();
+    b.reset();
+    REQUIRE(!abcd::txStoreFind(hash));
+}
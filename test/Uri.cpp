@@ -195,6 +195,83 @@ TEST_CASE("URI encoding test", "[util][uri]" )
             "test:/some/path/%3F/%23");
 }
 
+TEST_CASE("URI view tests", "[util][uri]" )
+{
+    const std::string test = "BitCoin://x/%41?&a=1&b%3D=%20&a=2#f";
+    abcd::UriView uri;
+    REQUIRE(uri.decode(test));
+
+    REQUIRE(uri.schemeIs("bitcoin"));
+    REQUIRE(!uri.schemeIs("bitcoi"));
+    REQUIRE(!uri.schemeIs("bitcoins"));
+    REQUIRE(uri.authority().raw() == "x");
+    REQUIRE(uri.path().unescape() == "/A");
+    REQUIRE(uri.opaquePath().unescape() == "x/A");
+    REQUIRE(uri.fragment().raw() == "f");
+
+    SECTION("query iteration")
+    {
+        auto query = uri.queryIterator();
+        abcd::UriSlice key, value;
+        REQUIRE(query.next(key, value));
+        REQUIRE(key.empty());
+        REQUIRE(query.next(key, value));
+        REQUIRE(key.unescapedEquals("a"));
+        REQUIRE(value.raw() == "1");
+        REQUIRE(query.next(key, value));
+        REQUIRE(key.unescapedEquals("b="));
+        REQUIRE(!key.unescapedEquals("b"));
+        REQUIRE(value.unescape() == " ");
+        REQUIRE(query.next(key, value));
+        REQUIRE(!query.next(key, value));
+    }
+    SECTION("query lookup")
+    {
+        abcd::UriSlice value;
+        REQUIRE(uri.queryFind(value, "a"));
+        REQUIRE(value.raw() == "2");
+        REQUIRE(!uri.queryFind(value, "c"));
+    }
+}
+
+TEST_CASE("Scanned text shapes", "[bitcoin][uri]")
+{
+    SECTION("URI")
+    {
+        const auto shape = abcd::textShape("bitcoin:113Pfw4sFqN1T5kXUnKbqZHMJHN9oyjtgD");
+        REQUIRE(shape.uri);
+        REQUIRE(!shape.address);
+        REQUIRE(!abcd::textShape("1bad:x").uri);
+    }
+    SECTION("address")
+    {
+        const auto shape = abcd::textShape("113Pfw4sFqN1T5kXUnKbqZHMJHN9oyjtgD");
+        REQUIRE(shape.address);
+        REQUIRE(!shape.wif);
+        REQUIRE(!shape.minikey);
+    }
+    SECTION("keys")
+    {
+        const auto hbits = abcd::textShape("S23c2fe8dbd330539a5fbab16a7602");
+        REQUIRE(!hbits.address);
+        REQUIRE(hbits.minikey);
+        REQUIRE(hbits.hbits);
+
+        const auto wif = abcd::textShape(
+                             "5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ");
+        REQUIRE(wif.wif);
+        REQUIRE(!wif.address);
+    }
+    SECTION("noise")
+    {
+        const auto shape = abcd::textShape("Table 12, please");
+        REQUIRE(!shape.uri);
+        REQUIRE(!shape.address);
+        REQUIRE(!shape.wif);
+        REQUIRE(!shape.hbits);
+    }
+}
+
 TEST_CASE("ParsedUri test", "[bitcoin][uri]")
 {
     abcd::ParsedUri uri;
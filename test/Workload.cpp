@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/Workload.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include "TempDir.hpp"
+
+TEST_CASE("Workload recording", "[util]")
+{
+    TempDir dir;
+    const std::string path = dir.path("workload");
+
+    REQUIRE(abcd::workloadRecordStart(path));
+    REQUIRE(abcd::workloadRecording());
+    const auto now = std::chrono::steady_clock::now();
+    const auto later = now + std::chrono::milliseconds(5);
+
+    // Finishing order is not starting order:
+    abcd::workloadRecord("ABC_SearchTransactions", "secret-b", 3, later, 10);
+    abcd::workloadRecord("ABC_GetTransactions", "secret-a", 0, now, 900);
+    abcd::workloadRecord("ABC_WalletBalance", "secret-a", 0, later, 20);
+    abcd::workloadRecord("ABC_GetMetrics", "", 0, later, 5);
+    abcd::workloadRecordStop();
+    REQUIRE(!abcd::workloadRecording());
+
+    // Stopped recordings ignore new calls:
+    abcd::workloadRecord("ABC_GetTransactions", "secret-a", 0, later, 1);
+
+    std::vector<abcd::WorkloadCall> calls;
+    REQUIRE(abcd::workloadLoad(calls, path));
+    REQUIRE(4 == calls.size());
+
+    REQUIRE("ABC_GetTransactions" == calls[0].function);
+    REQUIRE(1 == calls[0].wallet);
+    REQUIRE(900 == calls[0].duration);
+    REQUIRE(calls[0].start < calls[1].start);
+
+    REQUIRE("ABC_SearchTransactions" == calls[1].function);
+    REQUIRE(0 == calls[1].wallet);
+    REQUIRE(3 == calls[1].shape);
+    REQUIRE(1 == calls[2].wallet);
+    REQUIRE(-1 == calls[3].wallet);
+    REQUIRE(0 == calls[3].thread);
+}
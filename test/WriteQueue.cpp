@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016, Airbitz, Inc.
+ * All rights reserved.
+ *
+ * See the LICENSE file for more information.
+ */
+
+#include "../abcd/util/WriteQueue.hpp"
+#include "../minilibs/catch/catch.hpp"
+#include <map>
+
+TEST_CASE("Write-behind queue", "[util][file]")
+{
+    std::map<std::string, int> written;
+    auto writer = [&written](const std::string &path, int value)
+    {
+        return [&written, path, value]()
+        {
+            written[path] = value;
+            return abcd::Status();
+        };
+    };
+
+    SECTION("coalesces writes to the same path")
+    {
+        abcd::writeQueueAdd("/queue-test/a", writer("/queue-test/a", 1));
+        abcd::writeQueueAdd("/queue-test/a", writer("/queue-test/a", 2));
+        REQUIRE(abcd::writeQueuePending("/queue-test/a"));
+
+        REQUIRE(abcd::writeQueueFlush("/queue-test"));
+        REQUIRE(!abcd::writeQueuePending("/queue-test/a"));
+        REQUIRE(1 == written.size());
+        REQUIRE(2 == written["/queue-test/a"]);
+    }
+
+    SECTION("flushes and cancels by directory")
+    {
+        abcd::writeQueueAdd("/queue-test/x/1", writer("/queue-test/x/1", 1));
+        abcd::writeQueueAdd("/queue-test/xy", writer("/queue-test/xy", 1));
+        abcd::writeQueueAdd("/queue-test/z", writer("/queue-test/z", 1));
+
+        REQUIRE(abcd::writeQueueFlush("/queue-test/x"));
+        REQUIRE(written.count("/queue-test/x/1"));
+        REQUIRE(!written.count("/queue-test/xy"));
+
+        abcd::writeQueueCancel("/queue-test/xy");
+        REQUIRE(!abcd::writeQueuePending("/queue-test/xy"));
+        REQUIRE(abcd::writeQueueFlush());
+        REQUIRE(!written.count("/queue-test/xy"));
+        REQUIRE(written.count("/queue-test/z"));
+    }
+}